@@ -77,6 +77,10 @@ int DEFAULT__RESIZINGZONE = 2;
 QString VIEWED_UNITS = "ViewedUnits";
 /** Default value for viewed units. */
 QString DEFAULT__VIEWED_UNITS = "cm";
+/** Name of setting for number of prefetched pages. */
+QString PREFETCH_PAGES = "PrefetchPages";
+/** Default value for number of prefetched pages. */
+int DEFAULT__PREFETCH_PAGES = 0;
 /** Template for viewing mouse position on page. */
 QString format = "x:%1 y:%2 %3";
 
@@ -256,6 +260,8 @@ void PageSpace::refresh ( QSPage * pageToView, QSPdf * pdf ) {		// if pageToView
 		if ((actualPdf == NULL) || (pdf->get() != actualPdf->get())) {
 			delete actualPdf;
 			actualPdf = new QSPdf( pdf->get() , NULL );
+			// following pages are prepared on background while the actual one is viewed
+			actualPdf->get()->setPagePrefetch( globalSettings->readNum( PAGESPC + PREFETCH_PAGES, DEFAULT__PREFETCH_PAGES ) );
 		}
 		actualPage = pageToView->get();
 	} else {
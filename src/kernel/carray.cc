@@ -73,7 +73,7 @@ CArray::CArray (const Object& o)
 void 
 CArray::getStringRepresentation (string& str) const 
 {
-	utils::complexValueToString<CArray> (value,str);
+	utils::complexValueToString<CArray> (_getValue(),str);
 }
 
 
@@ -85,9 +85,31 @@ CArray::getProperty (PropertyId id) const
 {
 	//kernelPrintDbg (debug::DBG_DBG,"getProperty() " << id);
 
-	if (id >= value.size())
+	if (id >= getPropertyCount())
 		throw OutOfRange ();
 	
+	// Shared items can be read only if they belong to our pdf and reference
+	_detachForeign ();
+	boost::shared_ptr<IProperty> ip = _getValue()[id];
+	// Set mode only if pdf is valid
+	_setMode (ip,id);
+
+	return ip;
+}
+
+//
+//
+//
+boost::shared_ptr<IProperty>
+CArray::getProperty (PropertyId id)
+{
+	//kernelPrintDbg (debug::DBG_DBG,"getProperty() " << id);
+
+	if (id >= getPropertyCount())
+		throw OutOfRange ();
+	
+	// Item can be changed by the caller so it can't be shared anymore
+	_detach ();
 	boost::shared_ptr<IProperty> ip = value[id];
 	// Set mode only if pdf is valid
 	_setMode (ip,id);
@@ -109,6 +131,10 @@ CArray::setPdf (boost::weak_ptr<CPdf> pdf)
 	// Set pdf to this object
 	IProperty::setPdf (pdf);
 
+	// Shared items get pdf when they are detached
+	if (shared)
+		return;
+
 	// Set new pdf to all its children
 	Value::iterator it = value.begin();
 	for (; it != value.end(); ++it)
@@ -124,6 +150,10 @@ CArray::setIndiRef (const IndiRef& rf)
 	// Set pdf to this object
 	IProperty::setIndiRef (rf);
 
+	// Shared items get ref when they are detached
+	if (shared)
+		return;
+
 	// Set new pdf to all its children
 	Value::iterator it = value.begin();
 	for (; it != value.end(); ++it)
@@ -140,11 +170,12 @@ CArray::delProperty (PropertyId id)
 	//kernelPrintDbg (debug::DBG_DBG,"delProperty(" << id << ")");
 
 	// Check if we are out of bounds
-	if (id >= value.size())
+	if (id >= getPropertyCount())
 		throw OutOfRange ();
 	
 	// Check whether we can make the change
 	this->canChange();
+	_detach ();
 
 	boost::shared_ptr<IProperty> oldip = value[id];
 
@@ -185,7 +216,7 @@ boost::shared_ptr<IProperty>
 CArray::addProperty (const IProperty& newIp)
 {
 	//kernelPrintDbg (debug::DBG_DBG,"addProperty(...)");
-	return addProperty (value.size(), newIp);
+	return addProperty (getPropertyCount(), newIp);
 }
 
 //
@@ -201,7 +232,7 @@ CArray::addProperty (PropertyId position, const IProperty& newIp)
 	//
 	// Check if we add to a valid position
 	//
-	if (position > value.size())
+	if (position > getPropertyCount())
 		throw OutOfRange ();
 	
 	// Check whether we can make the change
@@ -215,15 +246,9 @@ CArray::addProperty (PropertyId position, const IProperty& newIp)
 	newIpClone->setPdf (this->getPdf());
 	newIpClone->setIndiRef (this->getIndiRef());
 	
-	// Find the correct position
-	Value::iterator it;
-	if (value.size() == position)
-		it = value.end ();
-	else
-		for (it = value.begin(); 0 != position; ++it, --position)
-			;
-	// Insert it
-	value.insert (it,newIpClone);
+	// Insert it at the correct position (position is kept for the context)
+	_detach ();
+	value.insert (value.begin() + position, newIpClone);
 	
 	if (hasValidPdf (this))
 	{
@@ -262,11 +287,12 @@ CArray::setProperty (PropertyId id, IProperty& newIp)
 	//kernelPrintDbg (debug::DBG_DBG, "setProperty(" << id << ")");
 
 	// Check the bounds, if fails add it
-	if (id >= value.size())
+	if (id >= getPropertyCount())
 		return addProperty (id, newIp);
 
 	// Check whether we can make the change
 	this->canChange();
+	_detach ();
 
 	// Save the old one
 	boost::shared_ptr<IProperty> oldip = value[id];
@@ -338,8 +364,9 @@ CArray::_makeXpdfObject () const
 		xref = pdf->getCXref();
 	arrayObj->initArray(xref);
 
-	Value::const_iterator it = value.begin();
-	for (; it != value.end(); ++it)
+	const Value& items = _getValue ();
+	Value::const_iterator it = items.begin();
+	for (; it != items.end(); ++it)
 	{
 		Object * propObj = (*it)->_makeXpdfObject();
 		arrayObj->arrayAdd(propObj);
@@ -424,15 +451,102 @@ CArray::doClone () const
 	// Make new complex object
 	// NOTE: We do not want to inherit any IProperty variable
 	CArray* clone_ = _newInstance ();
-	
-	// Loop through all items and clone them as well and finally add them to the new object
-	Value::const_iterator it = value.begin ();
-	for (; it != value.end (); ++it)
-		clone_->value.push_back ((*it)->clone());
+
+	if (!shared)
+	{
+		if (!_hasExclusiveChildren ())
+		{
+			// Some item can be changed without our knowledge, so loop 
+			// through all items and clone them as well and finally add them to the new object
+			Value::const_iterator it = value.begin ();
+			for (; it != value.end (); ++it)
+				clone_->value.push_back ((*it)->clone());
+			return clone_;
+		}
+
+		// Our items become shared
+		shared = boost::shared_ptr<SharedValue> (new SharedValue (this));
+		shared->items.swap (value);
+	}
+	clone_->shared = shared;
 
 	return clone_;
 }
 
+//
+//
+//
+void
+CArray::_detach () const
+{
+	if (!shared)
+		return;
+
+	assert (value.empty ());
+	if (this == shared->owner || (shared->fresh && shared.unique ()))
+	{
+		// We can take items
+		value.swap (shared->items);
+		if (!shared.unique ())
+		{
+			// Others get clones which were never given away
+			Value::const_iterator it = value.begin ();
+			for (; it != value.end (); ++it)
+				shared->items.push_back ((*it)->clone());
+			shared->owner = NULL;
+			shared->fresh = true;
+		}
+	}else
+	{
+		// Clone items
+		Value::const_iterator it = shared->items.begin ();
+		for (; it != shared->items.end (); ++it)
+			value.push_back ((*it)->clone());
+	}
+	shared.reset ();
+
+	// Set pdf and ref which were not propagated to shared items
+	Value::iterator it = value.begin();
+	for (; it != value.end(); ++it)
+	{
+		(*it)->setPdf (getPdf());
+		(*it)->setIndiRef (getIndiRef());
+	}
+}
+
+//
+//
+//
+void
+CArray::_detachForeign () const
+{
+	if (!shared || shared->items.empty ())
+		return;
+
+	// All shared items have pdf and reference of the array which has created
+	// them, so it is enough to check one of them
+	const IProperty& item = *shared->items.front();
+	if (item.getPdf().lock() != getPdf().lock() || !(item.getIndiRef() == getIndiRef()))
+		_detach ();
+}
+
+//
+//
+//
+bool
+CArray::_hasExclusiveChildren () const
+{
+	// Shared items are never changed
+	if (shared)
+		return true;
+
+	Value::const_iterator it = value.begin ();
+	for (; it != value.end (); ++it)
+		if (!(*it).unique () || !(*it)->_hasExclusiveChildren ())
+			return false;
+	return true;
+}
+
 //
 //
 //
@@ -54,6 +54,11 @@ namespace pdfobjects {
  * Copying complex types could be very expensive so we have made the decision to
  * avoid it.
  *
+ * Clones share items with the original object until one of them changes an
+ * item or gives it to the caller for writing (copy-on-write). Const access
+ * returns shared items. Only items which are not referenced from outside can
+ * be shared (see _hasExclusiveChildren).
+ *
  * REMARK: It is similar to CDict but it has also too much differences to be
  * cleanly implemented as one template class. (It has been implemented like one
  * template class but later was seperated to CArray and CDict)
@@ -74,9 +79,31 @@ public:
 	 */
 	static const PropertyType type = pArray;
 private:
+
+	/** Items shared by clones. */
+	struct SharedValue
+	{
+		/** Shared items. */
+		Value items;
+		/** Array which has given its own items (NULL if items are
+		 * clones which were never given to the caller). */
+		const CArray* owner;
+		/** True if items can be taken by anybody who holds the last reference. */
+		bool fresh;
+
+		SharedValue (const CArray* o) : owner (o), fresh (false) {}
+	};
 	
-	/** Array representation. */
-	Value value;
+	/** Array representation. 
+	 * It is empty while items are shared. */
+	mutable Value value;
+
+	/** Items shared with clones.
+	 * Shared items are never changed and they are given to the caller only
+	 * by const methods. Each array gets its own items by _detach before an
+	 * item is changed or returned by a non-const method.
+	 */
+	mutable boost::shared_ptr<SharedValue> shared;
 
 
 	//
@@ -118,10 +145,36 @@ protected:
 	 * REMARK: It will not copy pdf indirect objects that are referenced from the pdf object tree 
 	 * starting in this object.
 	 *
+	 * Items are shared with the clone until they are accessed (see
+	 * _detach).
+	 *
 	 * @return Deep copy of this object.
 	 */
 	virtual IProperty* doClone () const;
 
+	/**
+	 * Makes sure that items are not shared. Must be called before an item is
+	 * changed or returned to the caller by a non-const method.
+	 *
+	 * Items are taken from the shared storage if nobody else can use them,
+	 * otherwise they are cloned.
+	 */
+	void _detach () const;
+
+	/**
+	 * Makes sure that shared items can be returned by const methods.
+	 * Shared items keep pdf and reference of the array which has created
+	 * them, so they are detached if ours are different.
+	 */
+	void _detachForeign () const;
+
+	/**
+	 * Returns items for read-only access (they may be shared).
+	 * @return Items.
+	 */
+	const Value& _getValue () const
+		{ return (shared) ? shared->items : value; }
+
 	/** 
 	 * Return new instance. 
 	 *
@@ -163,23 +216,35 @@ public:
 	size_t getPropertyCount () const 
 	{
 		//kernelPrintDbg (debug::DBG_DBG, "getPropertyCount(" << debug::getStringType<Tp>() << ") = " << value.size());
-		return value.size();
+		return _getValue().size();
 	}
  
 
 	/**
 	 * Returns value of property identified by its position.
+	 * Returned property can be shared with clones, so it must not be
+	 * changed.
    	 *
    	 * @param 	id 	Variable identifying position of the property.
 	 * @return	Output variable where the value will be stored.
    	 */
 	boost::shared_ptr<IProperty> getProperty (PropertyId id) const;
 
+	/**
+	 * Returns value of property identified by its position.
+	 * Returned property belongs only to this array, so it can be changed.
+   	 *
+   	 * @param 	id 	Variable identifying position of the property.
+	 * @return	Output variable where the value will be stored.
+   	 */
+	boost::shared_ptr<IProperty> getProperty (PropertyId id);
+
 	/** 
 	 * Returns property identified by its name.
 	 * This is a convenient method which also does the casting trickery
 	 * and indirect object resolution if the given template type is not
 	 * reference itself.
+	 * Returned property must not be changed (see getProperty).
 	 *
    	 * @param 	id 	Name of the property.
 	 * @return	Output variable where the value will be stored.
@@ -199,6 +264,31 @@ public:
 		return IProperty::getSmartCObjectPtr<ItemType>(ip);
 	}
 
+	/** 
+	 * Returns property identified by its name.
+	 * This is a convenient method which also does the casting trickery
+	 * and indirect object resolution if the given template type is not
+	 * reference itself.
+	 * Returned property can be changed (see getProperty).
+	 *
+   	 * @param 	id 	Name of the property.
+	 * @return	Output variable where the value will be stored.
+	 */
+	template<typename ItemType> boost::shared_ptr<ItemType> getProperty(PropertyId id) {
+		boost::shared_ptr<IProperty> ip = getProperty(id);
+
+		if (ItemType::type != pRef && isRef(ip))
+			ip = utils::getReferencedObject(ip);
+
+		if(ItemType::type != ip->getType()) {
+			kernelPrintDbg (debug::DBG_DBG, "wanted type " << ItemType::type 
+					<< " got " << ip->getType () << " key[" << id << "]");
+			throw ElementBadTypeException("");
+		}
+
+		return IProperty::getSmartCObjectPtr<ItemType>(ip);
+	}
+
 	/**
 	 * Returns property type of an item identified by position.
 	 *
@@ -277,7 +367,12 @@ public:
 	/**
 	 * Destructor
 	 */
-	~CArray () {}
+	~CArray () 
+	{
+		// our own items can't be taken by anybody else
+		if (shared && this == shared->owner)
+			shared->owner = NULL;
+	}
 		
 
 	//
@@ -295,11 +390,29 @@ public:
 	template<typename Fctor>
 	void forEach (Fctor& fctor)
 	{
+		_detach ();
 		typename Value::iterator it = value.begin ();
 		for (int pos = 0; it != value.end (); ++it, ++pos)
 			fctor (std::make_pair (pos, *it));
 	}
 
+	/**
+	 * Apply functor operator() on each element without changing it.
+	 * The operator() will get std::pair<int, shared_ptr<IProperty>> as
+	 * parameter. Items can be shared with clones.
+	 * 
+	 * @param fctor Functor that will do the work.
+	 */
+	template<typename Fctor>
+	void forEach (Fctor& fctor) const
+	{
+		_detachForeign ();
+		const Value& items = _getValue ();
+		typename Value::const_iterator it = items.begin ();
+		for (int pos = 0; it != items.end (); ++it, ++pos)
+			fctor (std::make_pair (pos, *it));
+	}
+
 	/**
 	 * Make xpdf Object from this object. This function allocates and initializes xpdf object.
 	 * Caller has to deallocate the xpdf Object.
@@ -311,6 +424,13 @@ public:
 	 */
 	virtual ::Object* _makeXpdfObject () const;
 
+	/**
+	 * Checks whether items are not referenced from outside.
+	 *
+	 * @return True if items can be shared by clones.
+	 */
+	virtual bool _hasExclusiveChildren () const;
+
 private:
 	/**
 	 * Create context of a change.
@@ -349,12 +469,30 @@ protected:
 public:
 	/**
 	 * Return all child objects.
+	 * Children can be shared with clones, so they must not be changed.
 	 *
 	 * @param store Output container of all child objects.
 	 */
 	template <typename Storage>
 	void _getAllChildObjects (Storage& store) const
 	{
+		_detachForeign ();
+		const Value& items = _getValue ();
+		Value::const_iterator it = items.begin ();
+		for	(; it != items.end (); ++it)
+			store.push_back (*it);
+	}
+
+	/**
+	 * Return all child objects.
+	 * Children belong only to this array, so they can be changed.
+	 *
+	 * @param store Output container of all child objects.
+	 */
+	template <typename Storage>
+	void _getAllChildObjects (Storage& store)
+	{
+		_detach ();
 		Value::const_iterator it = value.begin ();
 		for	(; it != value.end (); ++it)
 			store.push_back (*it);
@@ -418,8 +556,9 @@ getSimpleValueFromArray (const boost::shared_ptr<CArray>& array, size_t position
 {
 	utilsPrintDbg (debug::DBG_DBG, "array[" << position << "]");
 	
-	// Get the item and check if it is the correct type
-	boost::shared_ptr<IProperty> ip = array->getProperty (position);
+	// Get the item (read-only, so it can stay shared with clones) and check
+	// if it is the correct type
+	boost::shared_ptr<IProperty> ip = static_cast<const CArray&>(*array).getProperty (position);
 	// Check the type and get the value
 	return getValueFromSimple<ItemType> (ip);
 }
@@ -439,8 +578,9 @@ getSimpleValueFromArray (const boost::shared_ptr<CArray>& array, size_t position
 {
 	utilsPrintDbg (debug::DBG_DBG, "array[" << position << "]");
 	
-	// Get the item and check if it is the correct type
-	boost::shared_ptr<IProperty> ip = array->getProperty (position);
+	// Get the item (read-only, so it can stay shared with clones) and check
+	// if it is the correct type
+	boost::shared_ptr<IProperty> ip = static_cast<const CArray&>(*array).getProperty (position);
 	// Check the type and get the value
 	return getValueFromSimple<ItemType> (ip);
 }
@@ -36,6 +36,7 @@
 #include "kernel/cinlineimage.h"
 #include "kernel/contentschangetag.h"
 #include "kernel/pdfoperatorsiter.h"
+#include "kernel/metrics.h"
 
 //fabs
 #include <math.h>
@@ -338,6 +339,8 @@ namespace {
 						boost::shared_ptr<IPropertyObserver> observer,
 						CContentStream::CStreams* parsedstreams = NULL)
 	{
+		metrics::ScopedTimer timer(metrics::contentStreamParseTime);
+
 		// Clear operators
 		operators.clear ();
 	
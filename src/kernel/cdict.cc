@@ -72,7 +72,7 @@ CDict::CDict (const Object& o)
 void 
 CDict::getStringRepresentation (string& str) const 
 {
-	utils::complexValueToString<CDict> (value,str);
+	utils::complexValueToString<CDict> (_getValue(),str);
 }
 
 //
@@ -83,7 +83,8 @@ CDict::containsProperty (const string& name) const
 {
 	//kernelPrintDbg (debug::DBG_DBG, "getAllPropertyNames()");
 
-	for ( Value::const_iterator it = value.begin(); it != value.end(); ++it)
+	const Value& items = _getValue ();
+	for ( Value::const_iterator it = items.begin(); it != items.end(); ++it)
 	{
 		if ((*it).first == name)
 			return true;
@@ -99,24 +100,57 @@ boost::shared_ptr<IProperty>
 CDict::getProperty (PropertyId id) const
 {
 	//kernelPrintDbg (debug::DBG_DBG,"getProperty() " << id);
+
+	// Shared items can be read only if they belong to our pdf and reference
+	_detachForeign ();
+
+	boost::shared_ptr<IProperty> ip = _findProperty (id);
+
+	// Set mode only if pdf is valid
+	_setMode (ip,id);
+
+	return ip;
+}
+
+//
+//
+//
+boost::shared_ptr<IProperty>
+CDict::getProperty (PropertyId id)
+{
+	//kernelPrintDbg (debug::DBG_DBG,"getProperty() " << id);
+
+	// Item can be changed by the caller so it can't be shared anymore
+	_detach ();
+
+	boost::shared_ptr<IProperty> ip = _findProperty (id);
+
+	// Set mode only if pdf is valid
+	_setMode (ip,id);
+
+	return ip;
+}
+
+//
+//
+//
+boost::shared_ptr<IProperty>
+CDict::_findProperty (PropertyId id) const
+{
 	//
 	// BEWARE using find_if with stateful functors !!!!!
 	//
 	DictIdxComparator cmp (id);
-	Value::const_iterator it = value.begin();
-	for (; it != value.end(); ++it)
+	const Value& items = _getValue ();
+	Value::const_iterator it = items.begin();
+	for (; it != items.end(); ++it)
 		if (cmp (*it))
 			break;
 
-	if (it == value.end())
+	if (it == items.end())
 		throw ElementNotFoundException ("", "");
 	
-	boost::shared_ptr<IProperty> ip = cmp.getIProperty ();
-
-	// Set mode only if pdf is valid
-	_setMode (ip,id);
-
-	return ip;
+	return cmp.getIProperty ();
 }
 
 
@@ -133,6 +167,10 @@ CDict::setPdf (boost::weak_ptr<CPdf> pdf)
 	// Set pdf to this object
 	IProperty::setPdf (pdf);
 
+	// Shared items get pdf when they are detached
+	if (shared)
+		return;
+
 	// Set new pdf to all its children
 	Value::iterator it = value.begin();
 	for (; it != value.end(); ++it)
@@ -145,6 +183,8 @@ CDict::setPdf (boost::weak_ptr<CPdf> pdf)
 void
 CDict::init (const CDict& dict)
 {
+	dict._detach ();
+	_detach ();
 	std::copy (dict.value.begin(), dict.value.end(), std::back_inserter (value));
 }
 
@@ -157,6 +197,10 @@ CDict::setIndiRef (const IndiRef& rf)
 	// Set pdf to this object
 	IProperty::setIndiRef (rf);
 
+	// Shared items get ref when they are detached
+	if (shared)
+		return;
+
 	// Set new pdf to all its children
 	Value::iterator it = value.begin();
 	for (; it != value.end(); ++it)
@@ -174,6 +218,7 @@ CDict::delProperty (PropertyId id)
 
 	// Check whether we can make the change
 	this->canChange();
+	_detach ();
 
 	//
 	// BEWARE using find_if with stateful functors !!!!!
@@ -247,6 +292,7 @@ CDict::addProperty (const string& propertyName, const IProperty& newIp)
 		newIpClone->setPdf (this->getPdf());
 	
 		// Store it
+		_detach ();
 		value.push_back (make_pair (propertyName,newIpClone));
 		
 	}else
@@ -292,6 +338,7 @@ CDict::setProperty (PropertyId id, IProperty& newIp)
 	
 	// Check whether we can make the change
 	this->canChange();
+	_detach ();
 
 	//
 	// Find the item we want
@@ -379,8 +426,9 @@ CDict::_makeXpdfObject () const
 		xref = pdf->getCXref();
 	dictObj->initDict(xref);
 
-	Value::const_iterator it = value.begin();
-	for (; it != value.end(); ++it)
+	const Value& items = _getValue ();
+	Value::const_iterator it = items.begin();
+	for (; it != items.end(); ++it)
 	{
 		boost::shared_ptr<IProperty> prop = it->second;
 		Object * propObj = prop->_makeXpdfObject();
@@ -438,13 +486,14 @@ CDict::_setMode (boost::shared_ptr<IProperty> ip, PropertyId id) const
 		// function and an infinite  cycle would occur
 		//
 		DictIdxComparator cmp ("Type");
-		Value::const_iterator it = value.begin();
-		for (; it != value.end(); ++it)
+		const Value& items = _getValue ();
+		Value::const_iterator it = items.begin();
+		for (; it != items.end(); ++it)
 		{
 			if (cmp (*it))
 				break;
 		}
-		if (it == value.end())
+		if (it == items.end())
 		{ // No type found
 			mode = modecontroller->getMode ("", id);
 			
@@ -483,17 +532,114 @@ CDict::doClone () const
 	// Make new complex object
 	// NOTE: We do not want to inherit any IProperty variable
 	CDict* clone_ = _newInstance ();
-	
-	//
-	// Loop through all items and clone them as well and finally add them to the new object
-	//
-	 Value::const_iterator it = value.begin ();
-	for (; it != value.end (); ++it)
-		clone_->value.push_back (make_pair ((*it).first, (*it).second->clone()));
+	_cloneValue (*clone_);
 
 	return clone_;
 }
 
+//
+//
+//
+void
+CDict::_cloneValue (const CDict& clone) const
+{
+	assert (clone.value.empty () && !clone.shared);
+
+	if (!shared)
+	{
+		if (!_hasExclusiveChildren ())
+		{
+			//
+			// Some item can be changed without our knowledge, so loop 
+			// through all items and clone them as well and finally add them to the new object
+			//
+			Value::const_iterator it = value.begin ();
+			for (; it != value.end (); ++it)
+				clone.value.push_back (make_pair ((*it).first, (*it).second->clone()));
+			return;
+		}
+
+		// Our items become shared
+		shared = boost::shared_ptr<SharedValue> (new SharedValue (this));
+		shared->items.swap (value);
+	}
+	clone.shared = shared;
+}
+
+//
+//
+//
+void
+CDict::_detach () const
+{
+	if (!shared)
+		return;
+
+	assert (value.empty ());
+	if (this == shared->owner || (shared->fresh && shared.unique ()))
+	{
+		// We can take items
+		value.swap (shared->items);
+		if (!shared.unique ())
+		{
+			// Others get clones which were never given away
+			Value::const_iterator it = value.begin ();
+			for (; it != value.end (); ++it)
+				shared->items.push_back (make_pair ((*it).first, (*it).second->clone()));
+			shared->owner = NULL;
+			shared->fresh = true;
+		}
+	}else
+	{
+		// Clone items
+		Value::const_iterator it = shared->items.begin ();
+		for (; it != shared->items.end (); ++it)
+			value.push_back (make_pair ((*it).first, (*it).second->clone()));
+	}
+	shared.reset ();
+
+	// Set pdf and ref which were not propagated to shared items
+	Value::iterator it = value.begin();
+	for (; it != value.end(); ++it)
+	{
+		(*it).second->setPdf (getPdf());
+		(*it).second->setIndiRef (getIndiRef());
+	}
+}
+
+//
+//
+//
+void
+CDict::_detachForeign () const
+{
+	if (!shared || shared->items.empty ())
+		return;
+
+	// All shared items have pdf and reference of the dictionary which has
+	// created them, so it is enough to check one of them
+	const IProperty& item = *shared->items.front().second;
+	if (item.getPdf().lock() != getPdf().lock() || !(item.getIndiRef() == getIndiRef()))
+		_detach ();
+}
+
+//
+//
+//
+bool
+CDict::_hasExclusiveChildren () const
+{
+	// Shared items are never changed
+	if (shared)
+		return true;
+
+	Value::const_iterator it = value.begin ();
+	for (; it != value.end (); ++it)
+		if (!(*it).second.unique () || !(*it).second->_hasExclusiveChildren ())
+			return false;
+	return true;
+}
+
 //
 //
 //
@@ -58,6 +58,11 @@ namespace pdfobjects {
  * Copying complex types could be very expensive so we have made the decision to
  * avoid it.
  *
+ * Clones share items with the original object until one of them changes an
+ * item or gives it to the caller for writing (copy-on-write). Const access
+ * returns shared items. Only items which are not referenced from outside can
+ * be shared (see _hasExclusiveChildren).
+ *
  * REMARK: It is similar to CArray but it has also too much differences to be
  * cleanly implemented as one template class. (It has been implemented like one
  * template class but later was seperated to CArray and CDict)
@@ -80,9 +85,31 @@ public:
 	 */
 	static const PropertyType type = pDict;
 private:
+
+	/** Items shared by clones. */
+	struct SharedValue
+	{
+		/** Shared items. */
+		Value items;
+		/** Dictionary which has given its own items (NULL if items are
+		 * clones which were never given to the caller). */
+		const CDict* owner;
+		/** True if items can be taken by anybody who holds the last reference. */
+		bool fresh;
+
+		SharedValue (const CDict* o) : owner (o), fresh (false) {}
+	};
 	
-	/** Dictionary representation. */
-	Value value;
+	/** Dictionary representation. 
+	 * It is empty while items are shared. */
+	mutable Value value;
+
+	/** Items shared with clones.
+	 * Shared items are never changed and they are given to the caller only
+	 * by const methods. Each dictionary gets its own items by _detach before
+	 * an item is changed or returned by a non-const method.
+	 */
+	mutable boost::shared_ptr<SharedValue> shared;
 
 
 	//
@@ -124,10 +151,53 @@ protected:
 	 * REMARK: It will not copy pdf indirect objects that are referenced from the pdf object tree 
 	 * starting in this object.
 	 *
+	 * Items are shared with the clone until they are accessed (see
+	 * _cloneValue).
+	 *
 	 * @return Deep copy of this object.
 	 */
 	virtual IProperty* doClone () const;
 
+	/**
+	 * Makes items of given dictionary equal to items of this dictionary.
+	 * Items are shared if they are not referenced from outside, otherwise
+	 * they are cloned.
+	 *
+	 * @param clone Dictionary without items.
+	 */
+	void _cloneValue (const CDict& clone) const;
+
+	/**
+	 * Makes sure that items are not shared. Must be called before an item is
+	 * changed or returned to the caller by a non-const method.
+	 *
+	 * Items are taken from the shared storage if nobody else can use them,
+	 * otherwise they are cloned.
+	 */
+	void _detach () const;
+
+	/**
+	 * Makes sure that shared items can be returned by const methods.
+	 * Shared items keep pdf and reference of the dictionary which has
+	 * created them, so they are detached if ours are different.
+	 */
+	void _detachForeign () const;
+
+	/**
+	 * Returns item identified by its name without detaching.
+	 *
+	 * @param id Name of the property.
+	 * @return Item (it may be shared).
+	 */
+	boost::shared_ptr<IProperty> _findProperty (PropertyId id) const;
+
+	/**
+	 * Returns items for read-only access (they may be shared).
+	 * @return Items.
+	 */
+	const Value& _getValue () const
+		{ return (shared) ? shared->items : value; }
+
 	/** 
 	 * Return new instance. 
 	 *
@@ -178,7 +248,7 @@ public:
 	size_t getPropertyCount () const 
 	{
 		//kernelPrintDbg (debug::DBG_DBG, "getPropertyCount(" << debug::getStringType<Tp>() << ") = " << value.size());
-		return value.size();
+		return _getValue().size();
 	}
  
 
@@ -190,7 +260,8 @@ public:
 	template<typename Container>
 	void getAllPropertyNames (Container& container) const
 	{
-		for (Value::const_iterator it = value.begin();it != value.end(); ++it)
+		const Value& items = _getValue ();
+		for (Value::const_iterator it = items.begin();it != items.end(); ++it)
 			container.push_back ((*it).first);
 	}
 
@@ -205,17 +276,30 @@ public:
 	
 	/**
 	 * Returns value of property identified by its name.
+	 * Returned property can be shared with clones, so it must not be
+	 * changed.
    	 *
    	 * @param 	id 	Name of the property.
 	 * @return	Output variable where the value will be stored.
    	 */
 	boost::shared_ptr<IProperty> getProperty (PropertyId id) const;
 
+	/**
+	 * Returns value of property identified by its name.
+	 * Returned property belongs only to this dictionary, so it can be
+	 * changed.
+   	 *
+   	 * @param 	id 	Name of the property.
+	 * @return	Output variable where the value will be stored.
+   	 */
+	boost::shared_ptr<IProperty> getProperty (PropertyId id);
+
 	/** 
 	 * Returns property identified by its name.
 	 * This is a convenient method which also does the casting trickery
 	 * and indirect object resolution if the given template type is not
 	 * reference itself.
+	 * Returned property must not be changed (see getProperty).
 	 *
    	 * @param 	id 	Name of the property.
 	 * @return	Output variable where the value will be stored.
@@ -240,6 +324,7 @@ public:
 	 * This is a convenient method which also does the casting trickery
 	 * and indirect object resolution if the given template type is not
 	 * reference itself.
+	 * Returned property must not be changed (see getProperty).
 	 *
    	 * @param 	id 	Name of the property.
 	 * @return	Output variable where the value will be stored.
@@ -250,6 +335,47 @@ public:
 		return getProperty<ItemType>(n);
 	}
 
+	/** 
+	 * Returns property identified by its name.
+	 * This is a convenient method which also does the casting trickery
+	 * and indirect object resolution if the given template type is not
+	 * reference itself.
+	 * Returned property can be changed (see getProperty).
+	 *
+   	 * @param 	id 	Name of the property.
+	 * @return	Output variable where the value will be stored.
+	 */
+	template<typename ItemType> boost::shared_ptr<ItemType> getProperty(PropertyId id) {
+		boost::shared_ptr<IProperty> ip = getProperty(id);
+
+		if (ItemType::type != pRef && isRef(ip))
+			ip = utils::getReferencedObject(ip);
+
+		if(ItemType::type != ip->getType()) {
+			kernelPrintDbg (debug::DBG_DBG, "wanted type " << ItemType::type 
+					<< " got " << ip->getType () << " key[" << id << "]");
+			throw ElementBadTypeException(id);
+		}
+
+		return IProperty::getSmartCObjectPtr<ItemType>(ip);
+	}
+
+	/** 
+	 * Returns property identified by its name.
+	 * This is a convenient method which also does the casting trickery
+	 * and indirect object resolution if the given template type is not
+	 * reference itself.
+	 * Returned property can be changed (see getProperty).
+	 *
+   	 * @param 	id 	Name of the property.
+	 * @return	Output variable where the value will be stored.
+	 */
+	template<typename ItemType> boost::shared_ptr<ItemType> getProperty(const char *name) {
+		assert(name);
+		PropertyId n(name);
+		return getProperty<ItemType>(n);
+	}
+
 	/**
 	 * Returns property type of an item identified by name.
 	 *
@@ -327,7 +453,12 @@ public:
 	/**
 	 * Destructor
 	 */
-	~CDict () {}
+	~CDict () 
+	{
+		// our own items can't be taken by anybody else
+		if (shared && this == shared->owner)
+			shared->owner = NULL;
+	}
 	
 
 	//
@@ -345,11 +476,29 @@ public:
 	template<typename Fctor>
 	void forEach (Fctor& fctor)
 	{
+		_detach ();
 		Value::iterator it = value.begin ();
 		for (; it != value.end (); ++it)
 			fctor (*it);
 	}
 
+	/**
+	 * Apply functor operator() on each element without changing it.
+	 * The operator() will get const std::pair<string, shared_ptr<IProperty>>
+	 * as parameter. Items can be shared with clones.
+	 * 
+	 * @param fctor Functor that will do the work.
+	 */
+	template<typename Fctor>
+	void forEach (Fctor& fctor) const
+	{
+		_detachForeign ();
+		const Value& items = _getValue ();
+		Value::const_iterator it = items.begin ();
+		for (; it != items.end (); ++it)
+			fctor (*it);
+	}
+
 	/**
 	 * Make xpdf Object from this object. This function allocates and initializes xpdf object.
 	 * Caller has to deallocate the xpdf Object.
@@ -362,6 +511,13 @@ public:
 	 */
 	virtual ::Object* _makeXpdfObject () const;
 
+	/**
+	 * Checks whether items are not referenced from outside.
+	 *
+	 * @return True if items can be shared by clones.
+	 */
+	virtual bool _hasExclusiveChildren () const;
+
 private:
 	/**
 	 * Create context of a change.
@@ -400,12 +556,30 @@ protected:
 public:
 	/**
 	 * Return all child objects.
+	 * Children can be shared with clones, so they must not be changed.
 	 *
 	 * @param store Output container of all child objects.
 	 */
 	template <typename Storage>
 	void _getAllChildObjects (Storage& store) const
 	{
+		_detachForeign ();
+		const Value& items = _getValue ();
+		Value::const_iterator it = items.begin ();
+		for(; it != items.end (); ++it)
+			store.push_back ((*it).second);
+	}
+
+	/**
+	 * Return all child objects.
+	 * Children belong only to this dictionary, so they can be changed.
+	 *
+	 * @param store Output container of all child objects.
+	 */
+	template <typename Storage>
+	void _getAllChildObjects (Storage& store)
+	{
+		_detach ();
 		Value::const_iterator it = value.begin ();
 		for(; it != value.end (); ++it)
 			store.push_back ((*it).second);
@@ -631,8 +805,9 @@ getSimpleValueFromDict (const boost::shared_ptr<CDict>& dict, const std::string&
 {
 	//utilsPrintDbg (debug::DBG_DBG, "dict[" << id << "]");
 	
-	// Get the item and check if it is the correct type
-	boost::shared_ptr<IProperty> ip = getReferencedObject (dict->getProperty (id));
+	// Get the item (read-only, so it can stay shared with clones) and check
+	// if it is the correct type
+	boost::shared_ptr<IProperty> ip = getReferencedObject (static_cast<const CDict&>(*dict).getProperty (id));
 	// Check the type and get the value
 	return getValueFromSimple<ItemType> (ip);
 }
@@ -652,8 +827,9 @@ getSimpleValueFromDict (const boost::shared_ptr<CDict>& dict, CDict::PropertyId
 {
 	utilsPrintDbg (debug::DBG_DBG, "dict[" << id << "]");
 	
-	// Get the item and check if it is the correct type
-	boost::shared_ptr<IProperty> ip = getReferencedObject (dict->getProperty (id));
+	// Get the item (read-only, so it can stay shared with clones) and check
+	// if it is the correct type
+	boost::shared_ptr<IProperty> ip = getReferencedObject (static_cast<const CDict&>(*dict).getProperty (id));
 	// Check the type and get the value
 	return getValueFromSimple<ItemType> (ip);
 }
@@ -142,7 +142,7 @@ void CInlineImage::initialize( const CStream::Buffer& buf )
 	}catch(CObjectException&){}
 	
 	// Set buffer, do not use setRawBuffer because CStream would be ... copied
-	std::copy (buf.begin(), buf.end(), std::back_inserter (this->buffer));
+	this->buffer = boost::shared_ptr<const Buffer> (new Buffer (buf));
 }
 
 //
@@ -169,7 +169,7 @@ CInlineImage::getStringRepresentation (std::string& str) const
 	str += CINLINEIMAGE_MIDDLE;
 	str += CINLINEIMAGE_MIDDLE_CHAR_AFTER_ID;
 	
-	for (Buffer::const_iterator it = buffer.begin(); it != buffer.end(); ++it)
+	for (Buffer::const_iterator it = buffer->begin(); it != buffer->end(); ++it)
 		str +=  static_cast<std::string::value_type> (*it);
 	str += CINLINEIMAGE_END;
 }
@@ -905,13 +905,12 @@ unsigned char* bufferFromStream(Stream& str, size_t dictLength, size_t& size)
 		return NULL;
 	}
 	str.reset();
-	int ch;
 	size_t i = 0;
-	while((ch=str.getChar())!=EOF)
+	for(;;)
 	{
 		if(i == streamLength)
 		{
-			streamLength *= 2;
+			streamLength = (streamLength)?streamLength*2:BUFSIZ;
 			unsigned char *buf = (unsigned char*)realloc(buffer, sizeof(unsigned char)*streamLength);
 			if(!buf)
 			{
@@ -921,11 +920,14 @@ unsigned char* bufferFromStream(Stream& str, size_t dictLength, size_t& size)
 			}
 			buffer = buf;
 		}
-		// NOTE that we are reducing int -> char here, so multi-bytes
-		// returned from a stream will be stripped to 1B
-		if((unsigned char)ch != ch)
-			utilsPrintDbg(debug::DBG_DBG, "Too wide character("<<(int)ch<<") in the stream at pos="<<i);
-		buffer[i++]=(unsigned char)ch;
+		// reads as much as fits into the buffer at once
+		size_t toRead = streamLength - i;
+		if(toRead > (size_t)std::numeric_limits<int>::max())
+			toRead = std::numeric_limits<int>::max();
+		int read = str.getBlock((char *)buffer + i, (int)toRead);
+		if(read <= 0)
+			break;
+		i += read;
 	}
 
 	// restore stream object to the begining
@@ -40,25 +40,25 @@ using namespace boost;
 
 int getIntFromDict(std::string name, boost::shared_ptr<CDict> dict)
 {
-	boost::shared_ptr<CInt> int_ptr=dict->getProperty<CInt>(name);
+	boost::shared_ptr<CInt> int_ptr=static_cast<const CDict&>(*dict).getProperty<CInt>(name);
 	return int_ptr->getValue();
 }
 
 IndiRef getRefFromDict(std::string name, boost::shared_ptr<CDict> dict)
 {
-	boost::shared_ptr<CRef> int_ptr=dict->getProperty<CRef>(name);
+	boost::shared_ptr<CRef> int_ptr=static_cast<const CDict&>(*dict).getProperty<CRef>(name);
 	return int_ptr->getValue();
 }
 
 std::string getStringFromDict(std::string name, boost::shared_ptr<CDict> dict)
 {
-	boost::shared_ptr<CString> str_ptr=dict->getProperty<CString>(name);
+	boost::shared_ptr<CString> str_ptr=static_cast<const CDict&>(*dict).getProperty<CString>(name);
 	return str_ptr->getValue();
 }
 	
 std::string getNameFromDict(std::string name, boost::shared_ptr<CDict> dict)
 {
-	boost::shared_ptr<CName> name_ptr=dict->getProperty<CName>(name);
+	boost::shared_ptr<CName> name_ptr=static_cast<const CDict&>(*dict).getProperty<CName>(name);
 	std::string value;
 	name_ptr->getValue(value);
 
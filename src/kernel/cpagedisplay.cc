@@ -31,6 +31,7 @@
 #include "kernel/cpage.h"
 #include "kernel/cpdf.h"
 #include "kernel/cpageattributes.h"
+#include "kernel/metrics.h"
 
 // =====================================================================================
 namespace pdfobjects {
@@ -127,6 +128,7 @@ CPageDisplay::displayPage (::OutputDev& out,
 	// Page object display (..., useMediaBox, crop, links, catalog)
 	//
 	// TODO ROTATION !! int rotation = _params.rotate - pagedict->getRotation ();
+	metrics::ScopedTimer timer(metrics::pageRenderTime);
 	page.displaySlice (&out, _params.hDpi, _params.vDpi,
 			0, _params.useMediaBox, _params.crop,
 			x, y, w, h, 
@@ -31,8 +31,13 @@
 #include "kernel/factories.h"
 #include "utils/debug.h"
 #include "kernel/cpageattributes.h"
+#include "kernel/pdfspecification.h"
 #include "kernel/pdfedit-core-dev.h"
 #include "kernel/streamwriter.h"
+#include "kernel/metrics.h"
+#include "kernel/xrefcache.h"
+#include "kernel/linearizator.h"
+#include "kernel/revisiondiff.h"
 
 using namespace boost;
 using namespace std;
@@ -916,17 +921,24 @@ using namespace pdfobjects::utils;
 	if(!cleanup)
 	{
 		bool unregister=true;
-		try
-		{
-			unregister=!getNodePosition(_this.lock(), dict_ptr, &nodeCountCache);
-		}catch(AmbiguousPageTreeException &)
+		if(pageIndex.isValid() && getNodeType(dict_ptr)==LeafNode)
 		{
-			// node is still in the tree and even more it is still ambiguous
-			unregister=false;	
-		}catch(...)
+			// synchronized pageIndex knows all pages from the tree
+			unregister=!pageIndex.getRefCount(dict_ptr->getIndiRef());
+		}else
 		{
-			// all other exceptions means that node is not found for some reason
-			unregister=true;
+			try
+			{
+				unregister=!getNodePosition(_this.lock(), dict_ptr, &nodeCountCache);
+			}catch(AmbiguousPageTreeException &)
+			{
+				// node is still in the tree and even more it is still ambiguous
+				unregister=false;	
+			}catch(...)
+			{
+				// all other exceptions means that node is not found for some reason
+				unregister=true;
+			}
 		}
 		if(!unregister)
 		{
@@ -1102,17 +1114,11 @@ using namespace utils;
 		}
 	}
 
-	// invalidates pageCount
-	pdf->pageCount=0;
-	
-	// removes and invalidates whole pageList
-	kernelPrintDbg(DBG_DBG, "Invalidating pageList with "<<pdf->pageList.size()<<" elements");
-	for(PageList::iterator i=pdf->pageList.begin(); i!=pdf->pageList.end(); ++i)
-	{
-		boost::shared_ptr<CPage> page=i->second;
-		page->invalidate();
-	}
-	pdf->pageList.clear();
+	// removes and invalidates whole pageIndex
+	kernelPrintDbg(DBG_DBG, "Invalidating pageIndex with "<<pdf->pageIndex.size()<<" elements");
+	PageIndex::PageStorage pages;
+	pdf->pageIndex.clear(pages);
+	invalidatePages(pages);
 
 	// clears nodeCountCache
 	kernelPrintDbg(DBG_DBG, "Discarding nodeCountCache with "<<pdf->nodeCountCache.size()<<" entries");
@@ -1270,16 +1276,14 @@ using namespace observer;
 	// This is ok, because at least one of oldValue or newValue must be non
 	// pNull and they must be direct members of node dictionary
 	IndiRef interNodeRef=(!isNull(oldValue))?oldValue->getIndiRef():newValue->getIndiRef();
+	boost::shared_ptr<CDict> interNode;
 	try
 	{
 		boost::shared_ptr<IProperty> interNodeProp=pdf->getIndirectProperty(interNodeRef);
 		if(isDict(interNodeProp))
 		{
-			boost::shared_ptr<CDict> interNode=IProperty::getSmartCObjectPtr<CDict>(interNodeProp);
-			// if consolidatePageTree hasn't kept page count numbers, total number
-			// of pages must be invalidated
-			if(!pdf->consolidatePageTree(interNode, true))
-				pdf->pageCount=0;
+			interNode=IProperty::getSmartCObjectPtr<CDict>(interNodeProp);
+			pdf->consolidatePageTreeOrDefer(interNode);
 		}
 	}catch(...)
 	{
@@ -1291,16 +1295,24 @@ using namespace observer;
 
 	// removes all pages from removed array
 	boost::shared_ptr<IProperty> null(CNullFactory::getInstance());
-	kernelPrintDbg(DBG_DBG, "Consolidating page list by removing oldValues.");
+	kernelPrintDbg(DBG_DBG, "Consolidating page index by removing oldValues.");
 	size_t index=0;
 	for(ChildrenStorage::iterator i=oldValues.begin(); i!=oldValues.end(); ++i, ++index)
 	{
 		boost::shared_ptr<IProperty> child=*i;
 		// consider just referencies, other elements are just mess in array
-		// unregisters observers and consolidates pageList like this node has
-		// been removed 
+		// consolidates pageIndex like this node has been removed and 
+		// unregisters observers
 		if(isRef(child))
 		{
+			pdf->consolidatePageList(child, null, interNode, NO_KIDS_INDEX);
+			try
+			{
+				UNREGISTER_SHAREDPTR_OBSERVER(child, pdf->pageTreeKidsObserver);
+			}catch(ObserverException & e)
+			{
+				kernelPrintDbg(DBG_WARN, "kids["<<index<<"] doesn't have registered pageTreeKidsObserver");
+			}
 			try
 			{
 				pdf->unregisterPageTreeObservers(child);
@@ -1308,22 +1320,27 @@ using namespace observer;
 			{
 				kernelPrintDbg(DBG_ERR, "kids["<<index<<"] unregisterPageTreeObservers has failed");
 			}
-			pdf->consolidatePageList(child, null);
 		}
 	}
-	kernelPrintDbg(DBG_DBG, "Consolidating page list by adding newValues.");
-	for(ChildrenStorage::iterator i=newValues.begin(); i!=newValues.end(); ++i)
+	kernelPrintDbg(DBG_DBG, "Consolidating page index by adding newValues.");
+	index=0;
+	for(ChildrenStorage::iterator i=newValues.begin(); i!=newValues.end(); ++i, ++index)
 	{
 		boost::shared_ptr<IProperty> child=*i;
 		// consider just referencies, other elements are just mess in array
-		// registers observers and consolidates pageList like this node has
+		// registers observers and consolidates pageIndex like this node has
 		// been added 
 		if(isRef(child))
 		{
-			pdf->consolidatePageList(null, child);
+			pdf->consolidatePageList(null, child, interNode, 
+					(interNode)?index:NO_KIDS_INDEX);
+			REGISTER_SHAREDPTR_OBSERVER(child, pdf->pageTreeKidsObserver);
 			pdf->registerPageTreeObservers(child);
 		}
 	}
+
+	// rebuilds page index if it couldn't be consolidated
+	pdf->syncPageIndex();
 }
 
 void CPdf::PageTreeKidsObserver::notify(
@@ -1346,6 +1363,7 @@ using namespace utils;
 	// gets original value from given context. It has to at least
 	// BasicChangeContext
 	boost::shared_ptr<IProperty> oldValue;
+	size_t kidsIndex=NO_KIDS_INDEX;
 	switch(contextType)
 	{
 		// This context means that just simple value has been changed and so
@@ -1373,8 +1391,9 @@ using namespace utils;
 					kernelPrintDbg(DBG_WARN, "ComplexChangeContext contains unsupported property id.");
 					return;
 				}
-				// change value identificator is not important in this moment
+				// change value identificator is the index of changed element
 				oldValue=complexContex->getOriginalValue();
+				kidsIndex=complexContex->getValueId();
 
 				// unregisters obsever from reference element
 				if(isRef(oldValue))
@@ -1422,25 +1441,6 @@ using namespace utils;
 		return;
 	}
 
-	// if oldValue is reference to dictionary (node), this node needs observers
-	// unregistration
-	if(isRef(oldValue))
-	{
-		try
-		{
-			boost::shared_ptr<IProperty> oldValueDict=getCObjectFromRef<CDict>(oldValue);
-			pdf->unregisterPageTreeObservers(oldValueDict);
-		}catch(CObjectException & e)
-		{
-			IndiRef ref=getValueFromSimple<CRef>(oldValue);
-			kernelPrintDbg(DBG_WARN, "oldValue "<<ref<<" doesn't refer to dictionary.");
-		}catch(ObserverException & e)
-		{
-			kernelPrintDbg(DBG_ERR, "oldValue "<<oldValue
-					<<" unregisterPageTreeObservers has failed.");
-		}
-	}
-		
 	// consolidates page tree from newValue's indirect parent. If newValue is
 	// CNull, uses oldValue's. Indirect reference can't be used directly,
 	// although reference must be direct value (and so its indirect parent
@@ -1468,24 +1468,59 @@ using namespace utils;
 	boost::shared_ptr<CDict> parentDict_ptr=IProperty::getSmartCObjectPtr<CDict>(parentProp_ptr);
 	try
 	{
-		// if consolidatePageTree hasn't kept page count numbers, total number
-		// of pages must be invalidated
 		kernelPrintDbg(DBG_DBG, "consolidating page tree.");
-		if(!pdf->consolidatePageTree(parentDict_ptr, true))
-			pdf->pageCount=0;
+		pdf->consolidatePageTreeOrDefer(parentDict_ptr);
 	}catch(CObjectException & e)
 	{
 		kernelPrintDbg(DBG_ERR, "consolidatePageTree failed with cause="<<e.what());
 	}
 
-	// consolidates pageList 
+	// reference element has changed its value, so we have to find its index
+	// (also checks index from the context)
+	if(isRef(newValue))
+	{
+		ChildrenStorage kids;
+		getKidsFromInterNode(parentDict_ptr, kids);
+		if(kidsIndex>=kids.size() || kids[kidsIndex]!=newValue)
+			kidsIndex=NO_KIDS_INDEX;
+		for(size_t i=0; i<kids.size() && kidsIndex==NO_KIDS_INDEX; ++i)
+			if(kids[i]==newValue)
+			{
+				kidsIndex=i;
+				break;
+			}
+	}
+
+	// consolidates pageIndex 
 	try
 	{
-		kernelPrintDbg(DBG_DBG, "consolidating page list.");
-		pdf->consolidatePageList(oldValue, newValue);
+		kernelPrintDbg(DBG_DBG, "consolidating page index.");
+		pdf->consolidatePageList(oldValue, newValue, parentDict_ptr, kidsIndex);
 	}catch(CObjectException &e)
 	{
 		kernelPrintDbg(DBG_ERR, "consolidatePageList failed with cause="<<e.what());
+		pdf->pageIndex.invalidate();
+	}
+
+	// if oldValue is reference to dictionary (node), this node needs observers
+	// unregistration. This has to be done after pageIndex consolidation 
+	// because unregisterPageTreeObservers uses it to find out whether node
+	// is still in the tree.
+	if(isRef(oldValue))
+	{
+		try
+		{
+			boost::shared_ptr<IProperty> oldValueDict=getCObjectFromRef<CDict>(oldValue);
+			pdf->unregisterPageTreeObservers(oldValueDict);
+		}catch(CObjectException & e)
+		{
+			IndiRef ref=getValueFromSimple<CRef>(oldValue);
+			kernelPrintDbg(DBG_WARN, "oldValue "<<ref<<" doesn't refer to dictionary.");
+		}catch(ObserverException & e)
+		{
+			kernelPrintDbg(DBG_ERR, "oldValue "<<oldValue
+					<<" unregisterPageTreeObservers has failed.");
+		}
 	}
 
 	// kidsCount cache couldn't have beem discarded until now because it is used
@@ -1511,6 +1546,9 @@ using namespace utils;
 			kernelPrintDbg(DBG_WARN, "newValue "<<ref<<" doesn't refer to dictionary.");
 		}
 	}
+
+	// rebuilds page index if it couldn't be consolidated
+	pdf->syncPageIndex();
 	
 	kernelPrintDbg(DBG_DBG, "observer handler finished");
 }
@@ -1552,7 +1590,7 @@ using namespace observer;
 	}
 }
 
-void CPdf::initRevisionSpecific()
+void CPdf::initRevisionSpecific(const XRefWriter::ObjectNumSet * changed)
 {
 	kernelPrintDbg(debug::DBG_DBG, "");
 
@@ -1567,6 +1605,9 @@ void CPdf::initRevisionSpecific()
 		return;
 	}
 
+	// prefetched objects has been dropped with the previous revision
+	lastPrefetchPos=0;
+
 	// Clean up part:
 	// =============
 	
@@ -1576,37 +1617,59 @@ void CPdf::initRevisionSpecific()
 	unregisterPageObservers();
 
 	// cleans up and invalidates all returned pages
-	if(pageList.size())
+	if(pageIndex.size())
 	{
-		kernelPrintDbg(debug::DBG_DBG, "Cleaning up pages list with "<<pageList.size()<<" elements");
-		PageList::iterator i;
-		for(i=pageList.begin(); i!=pageList.end(); ++i)
+		PageIndex::PageStorage pages;
+		if(changed)
+		{
+			// pages which don't depend on changed objects are kept and taken
+			// over when the index is rebuilt for the new page tree
+			utils::PageDependencies deps(*changed);
+			for(size_t i=0; i<pageIndex.size() && changed->size(); ++i)
+			{
+				boost::shared_ptr<CPage> page=pageIndex.getPage(i);
+				if(page && utils::pageDependsOnObjects(*xref, pageIndex.getRef(i), deps))
+				{
+					pages.push_back(page);
+					pageIndex.setPage(i, boost::shared_ptr<CPage>());
+				}
+			}
+			kernelPrintDbg(debug::DBG_DBG, "Invalidating page index with "<<pageIndex.size()<<" elements. "
+					<<pages.size()<<" pages depend on changed objects");
+			pageIndex.invalidate();
+		}else
 		{
-			kernelPrintDbg(debug::DBG_DBG, "invalidating page at pos="<<i->first);
-			i->second->invalidate();
+			kernelPrintDbg(debug::DBG_DBG, "Cleaning up page index with "<<pageIndex.size()<<" elements");
+			pageIndex.clear(pages);
 		}
-		pageList.clear();
+		invalidatePages(pages);
 	}
 
 	// cleans up indirect mapping
 	if(indMap.size())
 	{
 		// checks for held values (smart pointer is not unique, so somebody
-		// has to keep shared_ptr to same value)
+		// has to keep shared_ptr to same value). Unchanged objects are 
+		// shared with the new revision.
+		std::vector<IndiRef> dropped;
 		for(IndirectMapping::iterator i=indMap.begin(); i!=indMap.end(); ++i)
 		{
 			IndiRef ref=i->first;
+			if(changed && !changed->count(ref.num))
+				continue;
 			boost::shared_ptr<IProperty> value=i->second;
 			if(!value.unique())
 				kernelPrintDbg(debug::DBG_WARN, "Somebody still holds property with with "<<ref);
+			dropped.push_back(ref);
 		}
-		kernelPrintDbg(debug::DBG_DBG, "Cleaning up indirect mapping with "<<indMap.size()<<" elements");
-		indMap.clear();
+		kernelPrintDbg(debug::DBG_DBG, "Cleaning up "<<dropped.size()<<" of "<<indMap.size()<<" elements from indirect mapping");
+		if(dropped.size()==indMap.size())
+			indMap.clear();
+		else
+			for(std::vector<IndiRef>::const_iterator i=dropped.begin(); i!=dropped.end(); ++i)
+				indMap.erase(*i);
 	}
 
-	// invalidates pageCount
-	pageCount=0;
-
 	if((docCatalog.get()) && (!docCatalog.unique()))
 		kernelPrintDbg(debug::DBG_WARN, "Document catalog dictionary is held by somebody.");
 	
@@ -1616,6 +1679,9 @@ void CPdf::initRevisionSpecific()
 	kernelPrintDbg(debug::DBG_DBG, "Cleaning up pageTreeKidsParentCache with "<<pageTreeKidsParentCache.size()<<" entries");
 	utils::clearCache(pageTreeKidsParentCache);
 
+	// nodes from different revision can't be consolidated
+	deferredPageTreeNodes.clear();
+
 	// cleanup all returned outlines  -------------||----------------- 
 	
 	// Initialization part:
@@ -1658,18 +1724,23 @@ void CPdf::initRevisionSpecific()
 		registerPageTreeObservers(pageTreeRoot);
 }
 
-CPdf::CPdf(StreamWriter * stream, OpenMode openMode)
+CPdf::CPdf(StreamWriter * stream, OpenMode openMode, 
+		const xrefcache::XRefSnapshot * snapshot)
 	:pageTreeRootObserver(new PageTreeRootObserver(this)),
 	 pageTreeNodeObserver(new PageTreeNodeObserver(this)),
 	 pageTreeKidsObserver(new PageTreeKidsObserver(this)),
 	 id(NO_PDF_ID),
 	 change(false), 
-	 modeController(NULL)
+	 modeController(NULL),
+	 pageTreeFanOut(0),
+	 prefetchPageCount(0),
+	 lastPrefetchPos(0),
+	 notificationBatchDepth(0)
 {
 	// gets xref writer - if error occures, exception is thrown 
 	// Note that we can't do anything that could use cobjects here
 	// because of weak_ptr & shared_ptr are not initialized yet
-	xref=new XRefWriter(stream, this);
+	xref=new XRefWriter(stream, this, snapshot);
 	mode=openMode;
 
 	// sets mode accoring openMode
@@ -1773,12 +1844,9 @@ void CPdf::invalidate()
 	// indirect mapping is cleaned up automaticaly
 	
 	// discards all returned pages
-	for(PageList::iterator i=pageList.begin(); i!=pageList.end(); ++i)
-	{
-		kernelPrintDbg(DBG_DBG, "Invalidating page at pos="<<i->first);
-		i->second->invalidate();
-	}
-	pageList.clear();
+	PageIndex::PageStorage pages;
+	pageIndex.clear(pages);
+	invalidatePages(pages);
 
 	// idealy we should unregister page tree observers but as the _this
 	// is no longer valid in this context (last reference to 
@@ -1836,10 +1904,12 @@ boost::shared_ptr<IProperty> CPdf::getIndirectProperty(const IndiRef &ref)const
 	if(i!=indMap.end())
 	{
 		// mapping exists, so returns value
+		metrics::indirectCacheHits.add();
 		return i->second;
 	}
 
 	kernelPrintDbg(DBG_DBG, "No mapping for "<<ref);
+	metrics::indirectCacheMisses.add();
 
 	// mapping doesn't exist yet, so tries to create one
 	// fetches object according reference
@@ -2324,6 +2394,13 @@ using namespace std;
 		throw PdfOpenException("Unable to open file.");
 	}
 	kernelPrintDbg(debug::DBG_DBG,"File \"" << filename << "\" open successfully in mode=" << openMode);
+
+	// loads xref sidecar if enabled - this has to be done before the file is
+	// used by stream
+	xrefcache::FileKey key;
+	xrefcache::XRefSnapshot snapshot;
+	bool sidecar=xrefcache::isEnabled() && xrefcache::getFileKey(file, key);
+	bool cached=sidecar && xrefcache::load(filename, key, snapshot);
 	
 	// creates FileStream writer to enable changes to the File stream
 	Object obj;
@@ -2335,13 +2412,16 @@ using namespace std;
 	boost::shared_ptr<CPdf> instance;
 	try
 	{
-		instance = boost::shared_ptr<CPdf>(new CPdf(stream, mode), PdfFileDeleter(file));
+		instance = boost::shared_ptr<CPdf>(new CPdf(stream, mode, (cached)?&snapshot:NULL), 
+				PdfFileDeleter(file));
 		instance->_this = instance;
 
 		// initializes revision specific data for the newest revision
 		// We can't do it in constructor because we are using cobjects
 		// there and thus shared_ptr and _this have to be initialized
 		instance->initRevisionSpecific();
+		if(sidecar)
+			instance->syncXRefSidecar(filename, key, snapshot);
 
 		// We don't want to enable editing linearized documents because
 		// it leads to almost 100% damage of content - we are not able
@@ -2371,6 +2451,281 @@ using namespace std;
 // pos must be without sideeffects
 #define POSITION_IN_RANGE(pos) (((pos) >= 1) && (pos)<=getPageCount())
 
+namespace {
+
+/** Type for set of page tree node references. */
+typedef std::set<IndiRef, utils::IndComparator> NodeRefSet;
+
+/** Gets dictionary from page tree node property.
+ * @param prop Node property (reference or dictionary).
+ * @return Node dictionary or NULL pointer if prop doesn't refer to
+ * dictionary.
+ */
+boost::shared_ptr<CDict> getNodeDict(const boost::shared_ptr<IProperty> & prop)
+{
+using namespace utils;
+
+	if(isDict(prop))
+		return IProperty::getSmartCObjectPtr<CDict>(prop);
+	if(isRef(prop))
+	{
+		try
+		{
+			return getCObjectFromRef<CDict>(prop);
+		}catch(CObjectException &)
+		{
+			// target is not a dictionary
+		}
+	}
+	return boost::shared_ptr<CDict>();
+}
+
+/** Collects references of all page dictionaries from given sub tree.
+ * @param prop Root of the sub tree (reference or dictionary).
+ * @param refs Container where to add references (in document order).
+ * @param path References of intermediate nodes on the current path (used to
+ * prevent infinite recursion for cyclic page trees).
+ *
+ * Pages are collected in the same way as getKidsCount counts them, so
+ * page referenced from more places is collected more times.
+ */
+void collectPageRefs(const boost::shared_ptr<IProperty> & prop, PageIndex::RefList & refs, NodeRefSet & path)
+{
+using namespace utils;
+
+	boost::shared_ptr<CDict> nodeDict=getNodeDict(prop);
+	if(!nodeDict)
+		return;
+	IndiRef ref=nodeDict->getIndiRef();
+	if(getNodeType(nodeDict)==LeafNode)
+	{
+		refs.push_back(ref);
+		return;
+	}
+
+	if(!path.insert(ref).second)
+	{
+		kernelPrintDbg(debug::DBG_ERR, "Page tree cycle detected at "<<ref);
+		return;
+	}
+	ChildrenStorage children;
+	getKidsFromInterNode(nodeDict, children);
+	for(ChildrenStorage::const_iterator i=children.begin(); i!=children.end(); ++i)
+		if(isRef(*i))
+			collectPageRefs(*i, refs, path);
+	path.erase(ref);
+}
+
+/** Result of findLastIndexedPage. */
+enum IndexedPageResult {PAGE_FOUND, PAGE_NOT_FOUND, PAGE_AMBIGUOUS};
+
+/** Searches for the last page in given sub tree which is stored in index.
+ * @param index Page index.
+ * @param prop Root of the sub tree (reference).
+ * @param pos Position of the found page (set only if PAGE_FOUND is
+ * returned).
+ * @param path References of intermediate nodes on the current path.
+ *
+ * @return PAGE_FOUND if the last page of the sub tree is in the index
+ * exactly once, PAGE_NOT_FOUND if the sub tree doesn't contain any indexed
+ * page and PAGE_AMBIGUOUS if position can't be determined.
+ */
+IndexedPageResult findLastIndexedPage(const PageIndex & index, const boost::shared_ptr<IProperty> & prop, size_t & pos, NodeRefSet & path)
+{
+using namespace utils;
+
+	boost::shared_ptr<CDict> nodeDict=getNodeDict(prop);
+	if(!nodeDict)
+		return PAGE_NOT_FOUND;
+	IndiRef ref=nodeDict->getIndiRef();
+	if(getNodeType(nodeDict)==LeafNode)
+	{
+		switch(index.getRefCount(ref))
+		{
+			case 0:
+				return PAGE_NOT_FOUND;
+			case 1:
+				index.findRef(ref, pos);
+				return PAGE_FOUND;
+			default:
+				return PAGE_AMBIGUOUS;
+		}
+	}
+
+	if(!path.insert(ref).second)
+		return PAGE_AMBIGUOUS;
+	IndexedPageResult result=PAGE_NOT_FOUND;
+	ChildrenStorage children;
+	getKidsFromInterNode(nodeDict, children);
+	for(ChildrenStorage::reverse_iterator i=children.rbegin(); i!=children.rend() && result==PAGE_NOT_FOUND; ++i)
+		if(isRef(*i))
+			result=findLastIndexedPage(index, *i, pos, path);
+	path.erase(ref);
+	return result;
+}
+
+} // end of anonymous namespace for pageIndex helpers
+
+bool CPdf::getPageIndexPosition(boost::shared_ptr<CDict> interNode, size_t kidsIndex, size_t & pos)const
+{
+using namespace utils;
+
+	boost::shared_ptr<CDict> rootDict=getPageTreeRoot(_this.lock());
+	if(!rootDict)
+		return false;
+
+	NodeRefSet visited;
+	for(;;)
+	{
+		// searches preceding siblings (from the nearest one)
+		ChildrenStorage children;
+		getKidsFromInterNode(interNode, children);
+		if(kidsIndex>children.size())
+			return false;
+		for(size_t i=kidsIndex; i>0; --i)
+		{
+			boost::shared_ptr<IProperty> child=children[i-1];
+			if(!isRef(child))
+				continue;
+			NodeRefSet path;
+			size_t pagePos;
+			switch(findLastIndexedPage(pageIndex, child, pagePos, path))
+			{
+				case PAGE_FOUND:
+					pos=pagePos+1;
+					return true;
+				case PAGE_AMBIGUOUS:
+					return false;
+				case PAGE_NOT_FOUND:
+					break;
+			}
+		}
+
+		// no preceding page in this node, continues with the parent
+		IndiRef nodeRef=interNode->getIndiRef();
+		if(rootDict==interNode)
+		{
+			pos=0;
+			return true;
+		}
+		// Parent fields are not reliable until deferred nodes are consolidated
+		if(!deferredPageTreeNodes.empty())
+			return false;
+		if(!visited.insert(nodeRef).second)
+			return false;
+		try
+		{
+			interNode=interNode->getProperty<CDict>("Parent");
+		}catch(std::exception &)
+		{
+			// node without (valid) parent is not in page tree
+			return false;
+		}
+
+		// index of the node in its parent Kids array must be unique
+		kidsIndex=NO_KIDS_INDEX;
+		ChildrenStorage parentChildren;
+		getKidsFromInterNode(interNode, parentChildren);
+		for(size_t i=0; i<parentChildren.size(); ++i)
+		{
+			boost::shared_ptr<IProperty> child=parentChildren[i];
+			if(!isRef(child) || !(getValueFromSimple<CRef>(child)==nodeRef))
+				continue;
+			if(kidsIndex!=NO_KIDS_INDEX)
+				return false;
+			kidsIndex=i;
+		}
+		if(kidsIndex==NO_KIDS_INDEX)
+			return false;
+	}
+}
+
+void CPdf::buildPageIndex()const
+{
+using namespace utils;
+
+	kernelPrintDbg(DBG_DBG, "");
+
+	PageIndex::RefList refs;
+	boost::shared_ptr<CDict> rootDict=getPageTreeRoot(_this.lock());
+	if(rootDict)
+	{
+		NodeRefSet path;
+		collectPageRefs(rootDict, refs, path);
+	}
+	PageIndex::PageStorage pages;
+	pageIndex.assign(refs, pages);
+	invalidatePages(pages);
+	kernelPrintDbg(DBG_DBG, "Page index built with "<<pageIndex.size()<<" pages. "
+			<<pages.size()<<" pages invalidated");
+}
+
+void CPdf::syncXRefSidecar(const char * filename, const xrefcache::FileKey & key, 
+		const xrefcache::XRefSnapshot & snapshot)
+{
+	try
+	{
+		if(xref->isRestored())
+		{
+			// document has been just opened, so the current revision is the
+			// newest one which page references belong to
+			if(snapshot.hasPageRefs && !needsCredentials())
+			{
+				PageIndex::PageStorage pages;
+				pageIndex.assign(snapshot.pageRefs, pages);
+				invalidatePages(pages);
+			}
+			return;
+		}
+
+		xrefcache::XRefSnapshot current;
+		xref->getSnapshot(current);
+		if(!needsCredentials())
+		{
+			if(!pageIndex.isValid())
+				buildPageIndex();
+			pageIndex.getRefs(current.pageRefs);
+			current.hasPageRefs=true;
+		}
+		xrefcache::store(filename, key, current);
+	}catch(std::exception & e)
+	{
+		kernelPrintDbg(debug::DBG_WARN, "Unable to synchronize xref sidecar. cause="<<e.what());
+	}
+}
+
+void CPdf::syncPageIndex()const
+{
+	if(!pageIndex.isValid() && pageIndex.size())
+	{
+		kernelPrintDbg(DBG_INFO, "Page index is not synchronized. Rebuilding.");
+		buildPageIndex();
+	}
+}
+
+void CPdf::invalidatePages(const PageIndex::PageStorage & pages)
+{
+	for(PageIndex::PageStorage::const_iterator i=pages.begin(); i!=pages.end(); ++i)
+		(*i)->invalidate();
+}
+
+boost::shared_ptr<CDict> CPdf::getPageDict(size_t pos)const
+{
+using namespace utils;
+
+	if(!POSITION_IN_RANGE(pos))
+		throw PageNotFoundException(pos);
+
+	// page index is valid now, because getPageCount has built it
+	boost::shared_ptr<IProperty> pageProp=getIndirectProperty(pageIndex.getRef(pos-1));
+	if(!isDict(pageProp))
+	{
+		kernelPrintDbg(DBG_ERR, "Page at pos="<<pos<<" is not a dictionary.");
+		throw PageNotFoundException(pos);
+	}
+	return IProperty::getSmartCObjectPtr<CDict>(pageProp);
+}
+
 boost::shared_ptr<CPage> CPdf::getPage(size_t pos)const
 {
 using namespace utils;
@@ -2385,31 +2740,48 @@ using namespace utils;
 		throw PageNotFoundException(pos);
 	}
 
-	// checks if page is available in pageList
-	PageList::const_iterator i;
-	if((i=pageList.find(pos))!=pageList.end())
+	// following pages are prepared while the caller works with this one
+	if(prefetchPageCount && pos!=lastPrefetchPos)
+		prefetchFollowingPages(pos);
+
+	// checks if page is available in pageIndex
+	boost::shared_ptr<CPage> page_ptr=pageIndex.getPage(pos-1);
+	if(page_ptr)
 	{
-		kernelPrintDbg(DBG_DBG, "Page at pos="<<pos<<" found in pageList");
-		return i->second;
+		kernelPrintDbg(DBG_DBG, "Page at pos="<<pos<<" found in pageIndex");
+		return page_ptr;
 	}
 
-	// page is not available in pageList, searching has to be done
-	// find throws an exception if any problem found, otherwise pageDict_ptr
-	// contians Page dictionary at specified position.
-	boost::shared_ptr<CDict> rootPages_ptr=getPageTreeRoot(_this.lock());
-	if(!rootPages_ptr.get())
-		throw PageNotFoundException(pos);
-	boost::shared_ptr<CDict> pageDict_ptr=findPageDict(_this.lock(), rootPages_ptr, 1, pos, &nodeCountCache);
-
-	// creates CPage instance from page dictionary and stores it to the pageList
-	CPage * page=CPageFactory::getInstance(pageDict_ptr);
-	boost::shared_ptr<CPage> page_ptr(page);
-	pageList.insert(PageList::value_type(pos, page_ptr));
-	kernelPrintDbg(DBG_DBG, "New page added to the pageList size="<<pageList.size());
+	// creates CPage instance from page dictionary and stores it to the
+	// pageIndex
+	page_ptr=boost::shared_ptr<CPage>(CPageFactory::getInstance(getPageDict(pos)));
+	pageIndex.setPage(pos-1, page_ptr);
+	kernelPrintDbg(DBG_DBG, "New page added to the pageIndex at pos="<<pos);
 
 	return page_ptr;
 }
 
+void CPdf::prefetchFollowingPages(size_t pos)const
+{
+	lastPrefetchPos=pos;
+
+	// older revisions don't use CXref::fetch
+	if(!utils::isLatestRevision(*xref))
+		return;
+
+	// pageIndex is 0 based, so pos is the position of the following page
+	CXref::RefList refs;
+	for(size_t i=pos; i<pageIndex.size() && i<pos+prefetchPageCount; ++i)
+	{
+		const IndiRef & ref=pageIndex.getRef(i);
+		::Ref pageRef={(int)ref.num, (int)ref.gen};
+		refs.push_back(pageRef);
+	}
+	kernelPrintDbg(DBG_DBG, "Prefetching "<<refs.size()<<" pages after pos="<<pos);
+	if(!refs.empty())
+		getCXref()->prefetchPages(refs);
+}
+
 unsigned int CPdf::getPageCount()const
 {
 using namespace utils;
@@ -2418,19 +2790,11 @@ using namespace utils;
 	
 	check_need_credentials(xref);
 
-	// try to use cached value - if zero, we have to get it from Page tree root
-	if(pageCount)
-	{
-		kernelPrintDbg(DBG_DBG, "cached page count="<<pageCount);
-		return pageCount;
-	}
-	
-	boost::shared_ptr<CDict> rootDict=getPageTreeRoot(_this.lock());
-	if(!rootDict.get())
-		return 0;
-	pageCount=getKidsCount(rootDict, &nodeCountCache);
-	kernelPrintDbg(DBG_DBG, "page count="<<pageCount);
-	return pageCount;
+	// pageIndex holds all pages - if it is not valid, we have to build it from
+	// Page tree root
+	if(!pageIndex.isValid())
+		buildPageIndex();
+	return pageIndex.size();
 }
 
 bool CPdf::hasNextPage(const boost::shared_ptr<CPage> &page) const
@@ -2486,17 +2850,17 @@ size_t CPdf::getPagePosition(const boost::shared_ptr<CPage> &page)const
 		
 	check_need_credentials(xref);
 
-	// search in returned page list
-	PageList::iterator i;
-	for(i=pageList.begin(); i!=pageList.end(); ++i)
+	if(!pageIndex.isValid())
+		buildPageIndex();
+
+	// search in returned pages by page dictionary reference and compares page
+	// instances. This is ok even if they manage same page dictionary
+	size_t pos;
+	if(page && page->isValid() 
+			&& pageIndex.findPage(page->getDictionary()->getIndiRef(), page, pos))
 	{
-		// compares page instances
-		// This is ok even if they manage same page dictionary
-		if(i->second == page)
-		{
-			kernelPrintDbg(DBG_DBG, "Page found at pos="<<i->first);
-			return i->first;
-		}
+		kernelPrintDbg(DBG_DBG, "Page found at pos="<<pos+1);
+		return pos+1;
 	}
 
 	// page not found, it hasn't been returned by this pdf
@@ -2504,225 +2868,110 @@ size_t CPdf::getPagePosition(const boost::shared_ptr<CPage> &page)const
 }
 
 
-void CPdf::consolidatePageList(const boost::shared_ptr<IProperty> & oldValue, const boost::shared_ptr<IProperty> & newValue)
+void CPdf::consolidatePageList(const boost::shared_ptr<IProperty> & oldValue, 
+		const boost::shared_ptr<IProperty> & newValue,
+		const boost::shared_ptr<CDict> & interNode, size_t kidsIndex)
 {
 using namespace utils;
 
 	kernelPrintDbg(DBG_DBG, "");
 
-	// correction for all pages affected by this subtree change
-	int difference=0;
-
-	// position of first page which should be considered during consolidation 
-	// because of value change
-	size_t minPos=0;
+	// index which is not synchronized will be rebuilt anyway
+	if(!pageIndex.isValid())
+	{
+		kernelPrintDbg(DBG_DBG, "pageIndex is not valid. Nothing to consolidate.");
+		return;
+	}
 
 	// handles original value - one before change
 	// pNull means no previous value available (new sub tree has been added)
-	kernelPrintDbg(DBG_DBG, "oldValue type="<<oldValue->getType());
 	if(!isNull(oldValue))
 	{
-		// oldValue is reference
-		
-		PageTreeNodeType oldNodeType=getNodeType(oldValue);
+		PageIndex::RefList refs;
+		NodeRefSet path;
+		collectPageRefs(oldValue, refs, path);
+		kernelPrintDbg(DBG_DBG, "oldValue sub tree had "<<refs.size()<<" page dictionaries");
 
-		switch(oldNodeType)
+		// all removed pages are stored in sequence, so the first unique
+		// reference determines position of the whole sequence
+		bool found=false;
+		size_t start=0;
+		for(size_t i=0; i<refs.size() && !found; ++i)
 		{
-			// simple page is compared with all from pageList and if found, 
-			// removes it from list and invalidates it.
-			// Difference is set to - 1, because one page is removed 
-			case LeafNode:
+			size_t pos;
+			if(pageIndex.findRef(refs[i], pos) && pos>=i)
 			{
-				kernelPrintDbg(DBG_DBG, "oldValue was simple page dictionary");
-				difference = -1;
-				boost::shared_ptr<CDict> oldDict_ptr=getCObjectFromRef<CDict>(oldValue);
-
-				for(PageList::iterator i=pageList.begin(); i!=pageList.end(); ++i)
-				{
-					// checks page's dictionary with old one
-					boost::shared_ptr<CPage> page=i->second;
-					if(page->getDictionary() == oldDict_ptr)
-					{
-						i->second->invalidate();
-						size_t pos=i->first;
-						minPos=pos;
-						pageList.erase(i);
-						kernelPrintDbg(DBG_DBG, "CPage(pos="
-								<<pos
-								<<") associated with oldValue page dictionary removed. pageList.size="
-								<<pageList.size());
-						break;
-					}
-				}
-				break;
+				found=true;
+				start=pos-i;
 			}
-			case InterNode:
-			case RootNode:
+		}
+		if(refs.size())
+		{
+			// checks that sequence really matches
+			if(found && start+refs.size()<=pageIndex.size())
+				for(size_t i=0; i<refs.size() && found; ++i)
+					found=(pageIndex.getRef(start+i)==refs[i]);
+			if(!found)
 			{
-				// all CPages from this sub tree are removed and invalidated
-				// difference is set to -getKidsCount value (total page lost)
-				kernelPrintDbg(DBG_DBG, "oldValue was intermediate node dictionary.");
-				difference = -getKidsCount(oldValue, &nodeCountCache);
-
-				// gets reference of oldValue - which is the root of removed
-				// subtree
-				IndiRef ref=getValueFromSimple<CRef>(oldValue);
-				
-				bool found=false;
-				for(PageList::iterator i=pageList.begin(); i!=pageList.end();)
-				{
-					boost::shared_ptr<CPage> page=i->second;
-					// checks page's dictionary whether it is in oldDict_ptr sub
-					// tree and if so removes it from pageList
-					if(isNodeDescendant(_this.lock(), ref, page->getDictionary()))
-					{
-						// sets flag, that at least one descendants is found
-						found=true;
-						
-						// updates minPos with page position (if greater)
-						size_t pos=i->first;
-						if(pos > minPos)
-							minPos=pos;
-						
-						page->invalidate();
-						pageList.erase(i++);
-						kernelPrintDbg(DBG_DBG, "CPage(pos="
-								<<pos
-								<<") associated with oldValue page dictionary removed. pageList.size="
-								<<pageList.size());
-						continue;
-					}
-					// if this element is not in subtree and found is true,
-					// this is first node which is in different node and so
-					// none of following pages can be descendant (PageList
-					// is sorted) 
-					if(found)
-						break;
-					// note: we can't do this in for iteration section 
-					// because of erase above which invalidas iterator
-					++i;
-				}
-				break;
+				kernelPrintDbg(DBG_WARN, "oldValue pages can't be found unambiguously in pageIndex.");
+				pageIndex.invalidate();
+				return;
 			}
-			default:
-				kernelPrintDbg(DBG_DBG, "oldValue is not leaf or intermediate node.");
+			PageIndex::PageStorage pages;
+			pageIndex.remove(start, refs.size(), pages);
+			invalidatePages(pages);
+			kernelPrintDbg(DBG_DBG, refs.size()<<" pages removed from pos="<<start+1
+					<<". "<<pages.size()<<" pages invalidated");
 		}
 	}
 
-	// oldValue subtree (if any) is consolidated now
-	kernelPrintDbg(DBG_DBG, "All page dictionaries from oldValue subtree removed. count="<<-difference);
-
-	// number of added pages by newValue tree
-	int pagesCount=0;
-	
 	// handles new value - one after change
 	// if pNull - no new value is available (subtree has been removed)
-	kernelPrintDbg(DBG_DBG, "newValue type="<<newValue->getType());
 	if(!isNull(newValue))
 	{
-		// newValue is reference
-		PageTreeNodeType newValueType=getNodeType(newValue);
+		PageIndex::RefList refs;
+		NodeRefSet path;
+		collectPageRefs(newValue, refs, path);
+		kernelPrintDbg(DBG_DBG, "newValue sub tree has "<<refs.size()<<" page dictionaries");
+		if(refs.empty())
+			return;
+
+		// page dictionary which is already in the tree makes it ambiguous
+		for(PageIndex::RefList::const_iterator i=refs.begin(); i!=refs.end(); ++i)
+			if(pageIndex.getRefCount(*i))
+			{
+				kernelPrintDbg(DBG_WARN, "Page "<<*i<<" is already in the page tree.");
+				pageIndex.invalidate();
+				return;
+			}
 
-		// gets count of pages in newValue node (if intermediate all pages
-		// under this node)
-		switch(newValueType)
+		// gets position from the nearest preceding page which is already in
+		// pageIndex. If this is not possible, uses node position in the tree
+		size_t pos;
+		if(!interNode || kidsIndex==NO_KIDS_INDEX 
+				|| !getPageIndexPosition(interNode, kidsIndex, pos))
 		{
-			case LeafNode:
-				pagesCount=1;
-				break;
-			case InterNode:
-			case RootNode:
-				pagesCount=getKidsCount(newValue, &nodeCountCache);
-				break;
-			default:
-				kernelPrintDbg(DBG_DBG, "newValue is not leaf or intermediate node.");
+			// node position depends on Count and Parent fields
+			consolidateDeferredPageTree();
+			try
+			{
+				pos=getNodePosition(_this.lock(), newValue, &nodeCountCache)-1;
+			}catch(std::exception &e)
+			{
+				kernelPrintDbg(DBG_WARN, "Couldn't get newValue position. reason="<<e.what());
+				pageIndex.invalidate();
+				return;
+			}
 		}
-			
-		// try to get position of newValue node.  No pages from this subtree can
-		// be in the pageList, so we can set minPos to its position.
-		// If getNodePosition throws, then this node is ambiguous and so we have
-		// no information
-		try
-		{
-			minPos = getNodePosition(_this.lock(), newValue, &nodeCountCache);
-		}catch(std::exception &e)
-		{
-			// position can't be determined
-			// no special handling is needed, minPos keeps its value
-			kernelPrintDbg(DBG_WARN, "Couldn't get newValue position. reason="<<e.what());
-		}
-
-		kernelPrintDbg(DBG_DBG, "newValue sub tree has "<<pagesCount<<" page dictionaries");
-	}
-
-	// corrects difference with added pages
-	difference += pagesCount;
-
-	// no difference means no speacial handling for other pages
-	// we have replaced old sub tree with new subtree with same number of pages
-	if(difference==0)
-		return;
-
-	kernelPrintDbg(DBG_INFO, "pageList consolidation from minPos="<<minPos<<" with difference="<<difference);
-	 
-	// all pages with position greater than minPos, has to be consolidated
-	PageList::iterator i;
-	PageList readdContainer;
-	for(i=pageList.begin(); i!=pageList.end();)
-	{
-		size_t pos=i->first;
-		boost::shared_ptr<CPage> page=i->second;
-
-		if(pos>=minPos)
+		if(pos>pageIndex.size())
 		{
-			// collects all removed
-			readdContainer.insert(PageList::value_type(pos, page));	
-			pageList.erase(i++);
-		}else
-			++i;
-	}
-	
-	// checks minPos==0 and if so, we have to handle situation special way,
-	// because don't have any information about previous position of oldValue
-	// subtree. In such case it has to get current position for all pages in
-	// pageList
-	if(!minPos)
-	{
-		kernelPrintDbg(DBG_DBG,"Reassingning all pages posititions.");
-		for(i=readdContainer.begin(); i!=readdContainer.end(); ++i)
-		{
-			// uses getNodePosition for each page's dictionary to find out
-			// current position. If getNodePosition throws an exception, it
-			// means that it can't be determined. Such page is invalidated.
-			try
-			{
-				size_t pos=getNodePosition(_this.lock(), i->second->getDictionary(), &nodeCountCache);
-				kernelPrintDbg(DBG_DBG, "Original position="<<i->first<<" new="<<pos);
-				pageList.insert(PageList::value_type(pos, i->second));	
-			}catch(AmbiguousPageTreeException & e)
-			{
-				kernelPrintDbg(DBG_WARN, "page with original position="<<i->first<<" is ambiguous. Invalidating.");
-				// page position is ambiguous and so it has to be invalidate
-				i->second->invalidate();
-			}catch(std::exception & e)
-			{
-				kernelPrintDbg(DBG_CRIT, "Unexpected error. cause="<<e.what()<<" Possibly BUG");
-				assert(!"Possibly bug.");
-			}
+			kernelPrintDbg(DBG_WARN, "newValue position="<<pos<<" out of range.");
+			pageIndex.invalidate();
+			return;
 		}
-		return;
-	}
-	
-	kernelPrintDbg(DBG_DBG, "Moving pages position with difference="<<difference<<" from page pos="<<minPos);
-	// Information about page numbers which should be consolidated is available
-	// so just adds difference for each in readdContainer
-	// readds all removed with changed position (according difference)
-	for(i=readdContainer.begin(); i!=readdContainer.end(); ++i)
-	{
-		kernelPrintDbg(DBG_DBG, "Original position="<<i->first<<" new="<<i->first+difference);
-		pageList.insert(PageList::value_type(i->first+difference, i->second));	
+		pageIndex.insert(pos, refs);
+		kernelPrintDbg(DBG_DBG, refs.size()<<" pages inserted at pos="<<pos+1);
 	}
-	kernelPrintDbg(DBG_DBG, "pageList consolidation done.");
 }
 
 
@@ -2750,8 +2999,11 @@ using namespace utils;
 	// gets current count of kids and compares it to Count property
 	// if values are different, sets new value and sets countChanged to true and
 	// also node's parent should be consolidated
-	// Doesn't use cache to be sure that value is really collected
-	size_t count=getKidsCount(interNode, NULL);
+	// Discards cached value for this node but keeps values in subtree (they
+	// contain correct values because change was just in this intermediate
+	// node), so that count is collected just from direct kids
+	discardKidsCountCache(interNodeRef, _this.lock(), nodeCountCache, false);
+	size_t count=getKidsCount(interNode, &nodeCountCache);
 	bool countChanged=false;
 	if(interNode->containsProperty("Count"))
 	{
@@ -2792,12 +3044,6 @@ using namespace utils;
 		countChanged=true;
 	}
 
-	// if page count has changed, discards cache for this node but keeps values
-	// in subtree (they contain correct values because change was just in this
-	// intermediate node)
-	if(countChanged)
-		discardKidsCountCache(interNodeRef, _this.lock(), nodeCountCache, false);
-	
 	kernelPrintDbg(DBG_DBG, "consolidating Kids array members");
 
 	// collects all kids from internode for consolidation
@@ -2899,23 +3145,140 @@ using namespace utils;
 	return !countChanged;
 }
 
-boost::shared_ptr<CPage> CPdf::insertPage(const boost::shared_ptr<CPage> &page, size_t pos)
+void CPdf::consolidatePageTreeOrDefer(const boost::shared_ptr<CDict> & interNode)
+{
+	if(!isNotificationBatch())
+	{
+		consolidatePageTree(interNode, true);
+		return;
+	}
+	kernelPrintDbg(DBG_DBG, "consolidation of "<<interNode->getIndiRef()<<" is deferred");
+	deferredPageTreeNodes.insert(interNode->getIndiRef());
+}
+
+namespace {
+
+/** Checks whether intermediate node is in the page tree.
+ * @param node Intermediate node dictionary.
+ *
+ * Follows Parent fields up to the page tree root and checks that each
+ * parent has the node in its Kids array.
+ *
+ * @return true if node is reachable from the page tree root.
+ */
+bool isInPageTree(const boost::shared_ptr<CDict> & node)
 {
 using namespace utils;
 
-	kernelPrintDbg(DBG_DBG, "pos="<<pos);
+	NodeRefSet visited;
+	boost::shared_ptr<CDict> current=node;
+	while(getNodeType(current)!=RootNode)
+	{
+		IndiRef ref=current->getIndiRef();
+		if(!visited.insert(ref).second || !current->containsProperty("Parent"))
+			return false;
+		boost::shared_ptr<CDict> parent;
+		try
+		{
+			parent=current->getProperty<CDict>("Parent");
+		}catch(CObjectException &)
+		{
+			return false;
+		}
+		ChildrenStorage kids;
+		getKidsFromInterNode(parent, kids);
+		ChildrenStorage::const_iterator i;
+		for(i=kids.begin(); i!=kids.end(); ++i)
+			if(isRef(*i) && getValueFromSimple<CRef>(*i)==ref)
+				break;
+		if(i==kids.end())
+			return false;
+		current=parent;
+	}
+	return true;
+}
 
-	check_need_credentials(xref);
+} // end of anonymous namespace for deferred consolidation helpers
 
-	if(getMode()==ReadOnly)
+void CPdf::consolidateDeferredPageTree()
+{
+using namespace utils;
+
+	if(deferredPageTreeNodes.empty())
+		return;
+	kernelPrintDbg(DBG_DBG, "consolidating "<<deferredPageTreeNodes.size()<<" deferred nodes");
+
+	// counts cached for ancestors of changed nodes are not valid
+	clearCache(nodeCountCache);
+	NodeRefSet nodes;
+	nodes.swap(deferredPageTreeNodes);
+
+	// nodes which have been removed from the tree meanwhile mustn't be
+	// consolidated, because they would set Parent fields of their former
+	// kids. Node which has been moved is recognized after its new parent
+	// sets its Parent field, so that nodes are checked until some of them
+	// is consolidated
+	bool progress=true;
+	while(progress && !nodes.empty())
+	{
+		progress=false;
+		for(NodeRefSet::iterator i=nodes.begin(); i!=nodes.end();)
+		{
+			try
+			{
+				boost::shared_ptr<IProperty> nodeProp=getIndirectProperty(*i);
+				if(isDict(nodeProp))
+				{
+					boost::shared_ptr<CDict> node=IProperty::getSmartCObjectPtr<CDict>(nodeProp);
+					if(!isInPageTree(node))
+					{
+						++i;
+						continue;
+					}
+					consolidatePageTree(node, true);
+				}
+			}catch(...)
+			{
+				kernelPrintDbg(DBG_CRIT, "consolidatePageTree has failed for "<<*i<<". Should not happen. Possibly bug.");
+			}
+			nodes.erase(i++);
+			progress=true;
+		}
+	}
+	if(nodes.size())
+		kernelPrintDbg(DBG_DBG, nodes.size()<<" nodes are not in the page tree anymore");
+}
+
+void CPdf::beginNotificationBatch()
+{
+	++notificationBatchDepth;
+	kernelPrintDbg(DBG_DBG, "depth="<<notificationBatchDepth);
+}
+
+void CPdf::endNotificationBatch()
+{
+	if(!notificationBatchDepth)
 	{
-		kernelPrintDbg(DBG_ERR, "Document is in read-only mode now");
-		throw ReadOnlyDocumentException("Document is in read-only mode.");
+		kernelPrintDbg(DBG_WARN, "No notification batch is open.");
+		return;
 	}
-		
-	// zero position is corrected to 1
-	if(pos==0)
-		pos=1;
+	kernelPrintDbg(DBG_DBG, "depth="<<notificationBatchDepth);
+	if(--notificationBatchDepth)
+		return;
+
+	// page tree is consolidated before other observers are notified, so that
+	// they can see consistent page tree
+	consolidateDeferredPageTree();
+	notificationQueue.flush();
+}
+
+boost::shared_ptr<CDict> CPdf::getPageInsertionPoint(size_t pos, 
+		boost::shared_ptr<CArray> & kids_ptr, size_t & kidsIndex)
+{
+using namespace utils;
+
+	// Parent fields of pages are used
+	consolidateDeferredPageTree();
 
 	// gets intermediate node which includes node at given position. To enable
 	// also to insert after last page, following work around is done:
@@ -2951,7 +3314,7 @@ using namespace utils;
 		// searches for page at storePosition and gets its reference
 		// page dictionary has to be an indirect object, so getIndiRef returns
 		// dictionary reference
-		boost::shared_ptr<CDict> currentPage_ptr=findPageDict(_this.lock(), interNode_ptr, 1, storePostion, &nodeCountCache);
+		boost::shared_ptr<CDict> currentPage_ptr=getPageDict(storePostion);
 		currRef=boost::shared_ptr<CRef>(CRefFactory::getInstance(currentPage_ptr->getIndiRef()));
 		
 		// gets parent of found dictionary which maintains 
@@ -2959,7 +3322,6 @@ using namespace utils;
 	}
 
 	// gets Kids array where to insert new page dictionary
-	boost::shared_ptr<CArray> kids_ptr;
 	try {
 		kids_ptr=interNode_ptr->getProperty<CArray>("Kids");
 	}catch(...) {
@@ -2970,7 +3332,7 @@ using namespace utils;
 	
 	// gets index in Kids array where to store.
 	// by default insert at 1st position (index is 0)
-	size_t kidsIndex=0;
+	kidsIndex=0;
 	if(count)
 	{
 		// gets index of searched node's reference in Kids array - if position 
@@ -2987,29 +3349,61 @@ using namespace utils;
 		kidsIndex=positions[0]+append;
 	}
 
+	return interNode_ptr;
+}
+
+boost::shared_ptr<CDict> CPdf::clonePageDict(const boost::shared_ptr<CPage> & page)
+{
+	// page comes from different valid pdf - we have to create clone and
+	// remove Parent field from it. Also inheritable properties have to be
+	// handled
+	boost::shared_ptr<CDict> pageDict=page->getDictionary();
+	boost::shared_ptr<CPdf> pageDictPdf = pageDict->getPdf().lock();
+	IndiRef pageDictIndiRef=pageDict->getIndiRef();
+	pageDict=IProperty::getSmartCObjectPtr<CDict>(pageDict->clone());
+	pageDict->delProperty("Parent");
+
+	// clone needs to set pdf and indirect, because these values are not
+	// cloned and they are needed for indirect properties dereferencing
+	// (pdf) and for internal referencies (some of pageDict members may
+	// refer to page). This implies that pageDict has to be locked for
+	// dispatchChange.
+	pageDict->lockChange();
+	pageDict->setPdf(pageDictPdf);
+	pageDict->setIndiRef(pageDictIndiRef);
+	CPageAttributes::setInheritable(pageDict);
+	return pageDict;
+}
+
+boost::shared_ptr<CPage> CPdf::insertPage(const boost::shared_ptr<CPage> &page, size_t pos)
+{
+using namespace utils;
+
+	kernelPrintDbg(DBG_DBG, "pos="<<pos);
+
+	check_need_credentials(xref);
+
+	if(getMode()==ReadOnly)
+	{
+		kernelPrintDbg(DBG_ERR, "Document is in read-only mode now");
+		throw ReadOnlyDocumentException("Document is in read-only mode.");
+	}
+		
+	// zero position is corrected to 1
+	if(pos==0)
+		pos=1;
+
+	size_t count=getPageCount();
+	boost::shared_ptr<CArray> kids_ptr;
+	size_t kidsIndex;
+	getPageInsertionPoint(pos, kids_ptr, kidsIndex);
+
 	// Now it is safe to add indirect object, because there is nothing that can
 	// fail
 	boost::shared_ptr<CDict> pageDict=page->getDictionary();
 	boost::shared_ptr<CPdf> pageDictPdf = pageDict->getPdf().lock();
 	if(pageDictPdf && pageDictPdf !=_this.lock())
-	{
-		// page comes from different valid pdf - we have to create clone and
-		// remove Parent field from it. Also inheritable properties have to be
-		// handled
-		IndiRef pageDictIndiRef=pageDict->getIndiRef();
-		pageDict=IProperty::getSmartCObjectPtr<CDict>(pageDict->clone());
-		pageDict->delProperty("Parent");
-
-		// clone needs to set pdf and indirect, because these values are not
-		// cloned and they are needed for indirect properties dereferencing
-		// (pdf) and for internal referencies (some of pageDict members may
-		// refer to page). This implies that pageDict has to be locked for
-		// dispatchChange.
-		pageDict->lockChange();
-		pageDict->setPdf(pageDictPdf);
-		pageDict->setIndiRef(pageDictIndiRef);
-		CPageAttributes::setInheritable(pageDict);
-	}
+		pageDict=clonePageDict(page);
 
 	// Adds pageDict as new indirect property (also with properties referenced 
 	// by this dictionary) if it comes from different pdf. Otherwise simply
@@ -3038,14 +3432,26 @@ using namespace utils;
 	// is registered also on newly added reference
 	CRef pageCRef(pageRef);
 	kids_ptr->addProperty(kidsIndex, pageCRef);
+	consolidateDeferredPageTree();
 	
 	// page dictionary is stored in the tree, consolidation is also done at this
 	// moment
-	// CPage can be created and inserted to the pageList
+	// CPage can be created and associated with its pageIndex entry
 	boost::shared_ptr<CDict> newPageDict_ptr=IProperty::getSmartCObjectPtr<CDict>(getIndirectProperty(pageRef));
 	boost::shared_ptr<CPage> newPage_ptr(CPageFactory::getInstance(newPageDict_ptr));
-	pageList.insert(PageList::value_type(storePostion+append, newPage_ptr));
-	kernelPrintDbg(DBG_DBG, "New page added to the pageList size="<<pageList.size());
+	if(!pageIndex.isValid())
+		buildPageIndex();
+	// page is expected at the requested position but the tree may be
+	// ambiguous or Parent fields may be broken, so checks the reference
+	size_t indexPos=(pos>count)?count:pos-1;
+	if(indexPos>=pageIndex.size() || !(pageIndex.getRef(indexPos)==pageRef))
+		pageIndex.findRef(pageRef, indexPos);
+	if(indexPos<pageIndex.size() && pageIndex.getRef(indexPos)==pageRef 
+			&& !pageIndex.getPage(indexPos))
+	{
+		pageIndex.setPage(indexPos, newPage_ptr);
+		kernelPrintDbg(DBG_DBG, "New page added to the pageIndex at pos="<<indexPos+1);
+	}
 	return newPage_ptr;
 }
 
@@ -3067,11 +3473,11 @@ using namespace utils;
 	if(!POSITION_IN_RANGE(pos))
 		throw PageNotFoundException(pos);
 
+	// Parent field of the page is used
+	consolidateDeferredPageTree();
+
 	// Searches for page dictionary at given pos and gets its reference.
-	// getPageTreeRoot doesn't fail, because we are in page range and so it has
-	// to exist
-	boost::shared_ptr<CDict> rootDict=getPageTreeRoot(_this.lock());
-	boost::shared_ptr<CDict> currentPage_ptr=findPageDict(_this.lock(), rootDict, 1, pos, &nodeCountCache);
+	boost::shared_ptr<CDict> currentPage_ptr=getPageDict(pos);
 	boost::shared_ptr<CRef> currRef(CRefFactory::getInstance(currentPage_ptr->getIndiRef()));
 	
 	// Gets parent field from found page dictionary and gets its Kids array
@@ -3101,9 +3507,483 @@ using namespace utils;
 	// removing triggers pageTreeWatchDog consolidation
 	size_t kidsIndex=positions[0];
 	kids_ptr->delProperty(kidsIndex);
+	consolidateDeferredPageTree();
 	
 	// page dictionary is removed from the tree, consolidation is done also for
-	// pageList at this moment
+	// pageIndex at this moment
+}
+
+namespace {
+
+/** Type for inherited attribute name to value mapping. */
+typedef std::map<std::string, boost::shared_ptr<IProperty> > InheritedMapping;
+
+/** Page collected for page tree rebuild. */
+struct RebuiltPage
+{
+	/** Page dictionary. */
+	boost::shared_ptr<CDict> dict;
+	/** Attributes which page inherits from replaced intermediate nodes. */
+	InheritedMapping inherited;
+};
+
+/** Type for list of pages collected for page tree rebuild. */
+typedef std::vector<RebuiltPage> RebuiltPageList;
+
+/** Names of inheritable page attributes. */
+const std::string * const inheritableAttributes[]=
+{
+	&Specification::Page::RESOURCES,
+	&Specification::Page::MEDIABOX,
+	&Specification::Page::CROPBOX,
+	&Specification::Page::ROTATE
+};
+
+/** Collects pages for page tree rebuild.
+ * @param nodeDict Intermediate node dictionary.
+ * @param inherited Attributes inherited from nodeDict's ancestors (without
+ * page tree root).
+ * @param isRoot Flag whether nodeDict is the page tree root.
+ * @param pages Container where to add pages (in document order).
+ * @param visited References of all already visited nodes.
+ *
+ * Each page gets attributes inherited from nodeDict and its ancestors (except
+ * for page tree root) which it doesn't define itself.
+ *
+ * @throw AmbiguousPageTreeException if some node is referenced more times.
+ */
+void collectRebuiltPages(const boost::shared_ptr<CDict> & nodeDict, const InheritedMapping & inherited,
+		bool isRoot, RebuiltPageList & pages, NodeRefSet & visited)
+{
+using namespace utils;
+
+	InheritedMapping nodeInherited(inherited);
+	if(!isRoot)
+		for(size_t i=0; i<sizeof(inheritableAttributes)/sizeof(*inheritableAttributes); ++i)
+		{
+			const std::string & name=*inheritableAttributes[i];
+			if(nodeDict->containsProperty(name))
+				nodeInherited[name]=nodeDict->getProperty(name);
+		}
+
+	ChildrenStorage children;
+	getKidsFromInterNode(nodeDict, children);
+	for(ChildrenStorage::const_iterator i=children.begin(); i!=children.end(); ++i)
+	{
+		if(!isRef(*i))
+			continue;
+		boost::shared_ptr<CDict> childDict=getNodeDict(*i);
+		if(!childDict)
+			continue;
+		IndiRef childRef=childDict->getIndiRef();
+		if(!visited.insert(childRef).second)
+		{
+			kernelPrintDbg(DBG_ERR, "Node "<<childRef<<" is referenced more times.");
+			throw AmbiguousPageTreeException();
+		}
+		if(getNodeType(childDict)!=LeafNode)
+		{
+			collectRebuiltPages(childDict, nodeInherited, false, pages, visited);
+			continue;
+		}
+		RebuiltPage page;
+		page.dict=childDict;
+		for(InheritedMapping::const_iterator j=nodeInherited.begin(); j!=nodeInherited.end(); ++j)
+			if(!childDict->containsProperty(j->first))
+				page.inherited.insert(*j);
+		pages.push_back(page);
+	}
+}
+
+/** Description of new intermediate node created by page tree rebuild. */
+struct RebuiltNode
+{
+	/** Reserved reference of the node. */
+	IndiRef ref;
+	/** Reference of the parent node. */
+	IndiRef parent;
+	/** References of kids. */
+	PageIndex::RefList kids;
+	/** Number of pages under the node. */
+	size_t count;
+};
+
+/** Fills intermediate node dictionary.
+ * @param kids References of kids.
+ * @param count Number of pages under the node.
+ * @param parent Reference of the parent node (or NULL if node is root).
+ * @param node Node dictionary where to set Kids, Count and Parent fields.
+ */
+void fillInterNode(const PageIndex::RefList & kids, size_t count, const IndiRef * parent, CDict & node)
+{
+	boost::scoped_ptr<CArray> kidsArray(CArrayFactory::getInstance());
+	for(PageIndex::RefList::const_iterator i=kids.begin(); i!=kids.end(); ++i)
+	{
+		CRef kidRef(*i);
+		kidsArray->addProperty(kidRef);
+	}
+	boost::scoped_ptr<CInt> countInt(CIntFactory::getInstance(count));
+	node.setProperty("Kids", *kidsArray);
+	node.setProperty("Count", *countInt);
+	if(parent)
+	{
+		CRef parentRef(*parent);
+		node.setProperty("Parent", parentRef);
+	}
+}
+
+/** Plans intermediate nodes above given page tree level.
+ * @param xref Cross reference table where to reserve node references.
+ * @param fanOut Maximal number of kids of each node.
+ * @param topParent Parent reference of the top level nodes.
+ * @param level References of pages. Replaced by references of the top level
+ * nodes (at most fanOut).
+ * @param levelParents Set to parent references for given pages.
+ * @param nodes Container where to add planned nodes.
+ *
+ * Nodes are planned level by level from pages up. Each level has the minimal
+ * number of nodes for given fanOut and kids are split among them evenly.
+ * If there are at most fanOut pages, no node is planned and parent of all 
+ * pages is topParent.
+ */
+void planInterNodes(XRefWriter & xref, size_t fanOut, const IndiRef & topParent, 
+		PageIndex::RefList & level, PageIndex::RefList & levelParents, 
+		std::vector<RebuiltNode> & nodes)
+{
+	levelParents.assign(level.size(), topParent);
+	std::vector<size_t> levelCounts(level.size(), 1);
+	size_t levelStart=nodes.size();
+	bool pageLevel=true;
+	while(level.size()>fanOut)
+	{
+		size_t groups=(level.size()+fanOut-1)/fanOut;
+		PageIndex::RefList upperLevel;
+		std::vector<size_t> upperCounts;
+		size_t upperStart=nodes.size();
+		size_t begin=0;
+		for(size_t group=0; group<groups; ++group)
+		{
+			size_t end=level.size()*(group+1)/groups;
+			RebuiltNode node;
+			node.ref=xref.reserveRef();
+			node.parent=topParent;
+			node.count=0;
+			for(size_t i=begin; i<end; ++i)
+			{
+				node.kids.push_back(level[i]);
+				node.count+=levelCounts[i];
+				if(pageLevel)
+					levelParents[i]=node.ref;
+				else
+					nodes[levelStart+i].parent=node.ref;
+			}
+			upperLevel.push_back(node.ref);
+			upperCounts.push_back(node.count);
+			nodes.push_back(node);
+			begin=end;
+		}
+		level.swap(upperLevel);
+		levelCounts.swap(upperCounts);
+		levelStart=upperStart;
+		pageLevel=false;
+	}
+}
+
+/** Creates dictionary of planned intermediate node.
+ * @param node Node planned by planInterNodes.
+ * @return New intermediate node dictionary.
+ */
+boost::shared_ptr<CDict> createInterNode(const RebuiltNode & node)
+{
+	boost::shared_ptr<CDict> nodeDict(CDictFactory::getInstance());
+	boost::scoped_ptr<CName> type(CNameFactory::getInstance("Pages"));
+	nodeDict->addProperty("Type", *type);
+	fillInterNode(node.kids, node.count, &(node.parent), *nodeDict);
+	return nodeDict;
+}
+
+} // end of anonymous namespace for page tree rebuild helpers
+
+void CPdf::rebuildPageTree(size_t fanOut)
+{
+using namespace utils;
+
+	kernelPrintDbg(DBG_DBG, "fanOut="<<fanOut);
+
+	check_need_credentials(xref);
+
+	if(getMode()==ReadOnly)
+	{
+		kernelPrintDbg(DBG_ERR, "Document is in read-only mode now");
+		throw ReadOnlyDocumentException("Document is in read-only mode.");
+	}
+	if(fanOut<2)
+	{
+		kernelPrintDbg(DBG_ERR, "Page tree fan-out "<<fanOut<<" is too small");
+		throw ElementBadTypeException("fanOut");
+	}
+
+	// replaced nodes mustn't be consolidated later
+	consolidateDeferredPageTree();
+	boost::shared_ptr<CDict> rootDict=getPageTreeRoot(_this.lock());
+	if(!rootDict)
+		throw NoPageRootException();
+	IndiRef rootRef=rootDict->getIndiRef();
+
+	// collects all pages with attributes which they inherit from nodes which
+	// will be replaced. Nothing is changed yet, so ambiguous page tree is
+	// simply refused
+	RebuiltPageList pages;
+	NodeRefSet visited;
+	visited.insert(rootRef);
+	collectRebuiltPages(rootDict, InheritedMapping(), true, pages, visited);
+
+	// plans new nodes level by level from pages up to the root
+	std::vector<RebuiltNode> nodes;
+	PageIndex::RefList level;
+	for(RebuiltPageList::const_iterator i=pages.begin(); i!=pages.end(); ++i)
+		level.push_back(i->dict->getIndiRef());
+	PageIndex::RefList pageParents;
+	planInterNodes(*xref, fanOut, rootRef, level, pageParents, nodes);
+	kernelPrintDbg(DBG_INFO, "Rebuilding page tree with "<<pages.size()<<" pages to "
+			<<nodes.size()<<" intermediate nodes with fanOut="<<fanOut);
+
+	// page tree observers would consolidate pageIndex after each change. 
+	// Page order is the same in the new tree, so they are disabled and the 
+	// pageIndex is kept
+	boost::shared_ptr<IProperty> rootProp=rootDict;
+	unregisterPageTreeObservers(rootProp, true);
+	try
+	{
+		// registers new intermediate nodes
+		for(std::vector<RebuiltNode>::const_iterator i=nodes.begin(); i!=nodes.end(); ++i)
+		{
+			IndiRef nodeRef=i->ref;
+			registerIndirectProperty(createInterNode(*i), nodeRef);
+		}
+
+		// pushes down inherited attributes and sets new parents. Direct 
+		// dictionaries (Resources) are shared as indirect objects
+		typedef std::map<IProperty *, IndiRef> SharedMapping;
+		SharedMapping shared;
+		for(size_t i=0; i<pages.size(); ++i)
+		{
+			boost::shared_ptr<CDict> pageDict=pages[i].dict;
+			const InheritedMapping & inherited=pages[i].inherited;
+			for(InheritedMapping::const_iterator j=inherited.begin(); j!=inherited.end(); ++j)
+			{
+				if(!isDict(j->second))
+				{
+					pageDict->addProperty(j->first, *(j->second));
+					continue;
+				}
+				SharedMapping::iterator k=shared.find(j->second.get());
+				if(k==shared.end())
+					k=shared.insert(SharedMapping::value_type(j->second.get(), 
+								addIndirectProperty(j->second, false))).first;
+				CRef valueRef(k->second);
+				pageDict->addProperty(j->first, valueRef);
+			}
+			CRef parentRef(pageParents[i]);
+			pageDict->setProperty("Parent", parentRef);
+		}
+
+		// finally replaces root's kids
+		fillInterNode(level, pages.size(), NULL, *rootDict);
+	}catch(...)
+	{
+		// page tree may be changed partially
+		kernelPrintDbg(DBG_ERR, "Page tree rebuild failed");
+		pageIndex.invalidate();
+		clearCache(nodeCountCache);
+		clearCache(pageTreeKidsParentCache);
+		registerPageTreeObservers(rootProp);
+		syncPageIndex();
+		throw;
+	}
+
+	clearCache(nodeCountCache);
+	clearCache(pageTreeKidsParentCache);
+	registerPageTreeObservers(rootProp);
+}
+
+bool CPdf::needsPageTreeRebuild(size_t fanOut)const
+{
+using namespace utils;
+
+	boost::shared_ptr<CDict> rootDict=getPageTreeRoot(_this.lock());
+	if(!rootDict)
+		return false;
+
+	// pageIndex knows all pages, so only intermediate nodes are fetched
+	getPageCount();
+	std::vector<boost::shared_ptr<CDict> > nodes(1, rootDict);
+	NodeRefSet visited;
+	visited.insert(rootDict->getIndiRef());
+	while(!nodes.empty())
+	{
+		boost::shared_ptr<CDict> nodeDict=nodes.back();
+		nodes.pop_back();
+		ChildrenStorage children;
+		getKidsFromInterNode(nodeDict, children);
+		if(children.size()>fanOut)
+			return true;
+		for(ChildrenStorage::const_iterator i=children.begin(); i!=children.end(); ++i)
+		{
+			if(!isRef(*i) || pageIndex.getRefCount(getValueFromSimple<CRef>(*i)))
+				continue;
+			boost::shared_ptr<CDict> childDict=getNodeDict(*i);
+			if(childDict && getNodeType(childDict)!=LeafNode 
+					&& visited.insert(childDict->getIndiRef()).second)
+				nodes.push_back(childDict);
+		}
+	}
+	return false;
+}
+
+void CPdf::importPages(const boost::shared_ptr<CPdf> & source, size_t from, size_t to, size_t pos)
+{
+using namespace utils;
+
+	kernelPrintDbg(DBG_DBG, "from="<<from<<" to="<<to<<" pos="<<pos);
+
+	check_need_credentials(xref);
+
+	if(getMode()==ReadOnly)
+	{
+		kernelPrintDbg(DBG_ERR, "Document is in read-only mode now");
+		throw ReadOnlyDocumentException("Document is in read-only mode.");
+	}
+	if(!source)
+	{
+		kernelPrintDbg(DBG_ERR, "No source document given");
+		throw ElementBadTypeException("source");
+	}
+	if(source.get()==this)
+	{
+		kernelPrintDbg(DBG_ERR, "Pages are already in the pdf");
+		throw AmbiguousPageTreeException();
+	}
+	size_t sourceCount=source->getPageCount();
+	if(!from || from>to || to>sourceCount)
+	{
+		kernelPrintDbg(DBG_ERR, "Range ["<<from<<", "<<to<<"] is out of source pages range [1, "
+				<<sourceCount<<"]");
+		throw PageNotFoundException((!from || from>sourceCount)?from:to);
+	}
+
+	// zero position is corrected to 1
+	if(pos==0)
+		pos=1;
+
+	// gets place for new pages and source pages, so that nothing is changed
+	// if they can't be imported
+	boost::shared_ptr<CArray> kids_ptr;
+	size_t kidsIndex;
+	boost::shared_ptr<CDict> interNode=getPageInsertionPoint(pos, kids_ptr, kidsIndex);
+	std::vector<boost::shared_ptr<CPage> > pages;
+	for(size_t i=from; i<=to; ++i)
+		pages.push_back(source->getPage(i));
+
+	// copies page dictionaries with all referenced objects. All of them use
+	// the same resolved references storage for source pdf, so shared objects
+	// are copied only once
+	ResolvedRefMapping::iterator resolved=resolvedRefMapping.find(source->getId());
+	if(resolved==resolvedRefMapping.end())
+		resolved=resolvedRefMapping.insert(
+				ResolvedRefMapping::value_type(source->getId(), new ResolvedRefStorage())).first;
+	ResolvedRefStorage & storage=*resolved->second;
+	PageIndex::RefList pageRefs;
+	for(std::vector<boost::shared_ptr<CPage> >::const_iterator i=pages.begin(); i!=pages.end(); ++i)
+	{
+		boost::shared_ptr<CDict> pageDict=clonePageDict(*i);
+		IndiRef sourceRef=pageDict->getIndiRef();
+
+		// page dictionary itself is always copied to a new object (mapping
+		// from previous import would make the same page twice in the page
+		// tree). Its mapping is replaced only temporarily, so that
+		// references to the page from its own objects (e.g. annotation's P)
+		// refer to this copy
+		ResolvedRefEntry * previousEntry=NULL;
+		ResolvedRefStorage::iterator entry=storage.find(sourceRef);
+		if(entry!=storage.end())
+		{
+			previousEntry=entry->second;
+			storage.erase(entry);
+		}
+		IndiRef pageRef=xref->reserveRef();
+		ResolvedRefEntry pageEntry(pageRef, STATE_RESOLVING);
+		storage.insert(ResolvedRefStorage::value_type(sourceRef, &pageEntry));
+		try
+		{
+			addProperty(pageDict, pageRef, storage, true);
+		}catch(...)
+		{
+			storage.erase(sourceRef);
+			if(previousEntry)
+				storage.insert(ResolvedRefStorage::value_type(sourceRef, previousEntry));
+			throw;
+		}
+		storage.erase(sourceRef);
+		if(previousEntry)
+			storage.insert(ResolvedRefStorage::value_type(sourceRef, previousEntry));
+		pageRefs.push_back(pageRef);
+	}
+	pages.clear();
+	kernelPrintDbg(DBG_INFO, pageRefs.size()<<" pages copied from pdf="<<source->getId());
+
+	// creates new intermediate node (with balanced subtree if there are too 
+	// many pages) for all pages. Nothing in the page tree refers to these 
+	// objects yet, so no page tree observer is triggered
+	size_t fanOut=(pageTreeFanOut)?pageTreeFanOut:DEFAULT_PAGE_TREE_FANOUT;
+	RebuiltNode importNode;
+	importNode.ref=xref->reserveRef();
+	importNode.parent=interNode->getIndiRef();
+	importNode.kids=pageRefs;
+	importNode.count=pageRefs.size();
+	std::vector<RebuiltNode> nodes;
+	PageIndex::RefList pageParents;
+	planInterNodes(*xref, fanOut, importNode.ref, importNode.kids, pageParents, nodes);
+	nodes.push_back(importNode);
+	for(std::vector<RebuiltNode>::const_iterator i=nodes.begin(); i!=nodes.end(); ++i)
+	{
+		IndiRef nodeRef=i->ref;
+		registerIndirectProperty(createInterNode(*i), nodeRef);
+	}
+	for(size_t i=0; i<pageRefs.size(); ++i)
+	{
+		boost::shared_ptr<CDict> pageDict=IProperty::getSmartCObjectPtr<CDict>(getIndirectProperty(pageRefs[i]));
+		CRef parentRef(pageParents[i]);
+		pageDict->setProperty("Parent", parentRef);
+	}
+
+	// inserts the node to the page tree. This triggers page tree 
+	// consolidation and pageIndex update for all pages at once
+	CRef importCRef(importNode.ref);
+	kids_ptr->addProperty(kidsIndex, importCRef);
+	kernelPrintDbg(DBG_INFO, pageRefs.size()<<" pages imported under "<<importNode.ref
+			<<" with "<<nodes.size()-1<<" additional intermediate nodes");
+}
+
+void CPdf::setPageTreeFanOut(size_t fanOut)
+{
+	kernelPrintDbg(DBG_DBG, "fanOut="<<fanOut);
+
+	if(fanOut==1)
+	{
+		kernelPrintDbg(DBG_ERR, "Page tree fan-out "<<fanOut<<" is too small");
+		throw ElementBadTypeException("fanOut");
+	}
+	pageTreeFanOut=fanOut;
+}
+
+void CPdf::setPagePrefetch(size_t pages, size_t memoryLimit)
+{
+	kernelPrintDbg(DBG_DBG, "pages="<<pages<<" memoryLimit="<<memoryLimit);
+
+	prefetchPageCount=(memoryLimit)?pages:0;
+	lastPrefetchPos=0;
+	getCXref()->setPrefetchLimit((prefetchPageCount)?memoryLimit:0);
 }
 
 void CPdf::save(bool newRevision)const
@@ -3127,12 +4007,24 @@ void CPdf::save(bool newRevision)const
 		throw ReadOnlyDocumentException("Document is in read-only mode.");
 	}
 	
+	// rebuilds too wide page tree if required. This is the only change of
+	// document content done by save, so constness is cast away
+	if(pageTreeFanOut && needsPageTreeRebuild(pageTreeFanOut))
+	{
+		kernelPrintDbg(DBG_INFO, "Page tree is too wide. Rebuilding with fanOut="<<pageTreeFanOut);
+		const_cast<CPdf *>(this)->rebuildPageTree(pageTreeFanOut);
+	}
+
 	// we are in the newest revision, so changes can be saved
 	// delegates all work to the XRefWriter and set change to 
 	// mark, that no changes were stored
 	// check for credentials is done in XRefWriter
+	metrics::ScopedTimer timer(metrics::saveTime);
 	xref->saveChanges(newRevision);
 	change=false;
+
+	// prefetched objects are dropped when the cross reference table changes
+	lastPrefetchPos=0;
 }
 
 void CPdf::clone(FILE * file)const
@@ -3155,6 +4047,45 @@ using namespace debug;
 	xref->cloneRevision(file);
 }
 
+int CPdf::saveLinearized(FILE * file)const
+{
+using namespace debug;
+
+	kernelPrintDbg(DBG_DBG, "");
+	metrics::ScopedTimer timer(metrics::saveTime);
+
+	if(!file)
+	{
+		kernelPrintDbg(DBG_ERR, "output file is NULL");
+		return EINVAL;
+	}
+
+	// Linearized document content can't be cloned
+	if(isLinearized())
+		throw NotImplementedException("Linearized PDF cloning is not supported");
+
+	FILE * tmp=tmpfile();
+	if(!tmp)
+	{
+		int err=errno;
+		kernelPrintDbg(DBG_ERR, "Unable to create temporary file. Error message="<<strerror(err));
+		return err;
+	}
+	try
+	{
+		xref->cloneRevision(tmp);
+	}catch(...)
+	{
+		fclose(tmp);
+		throw;
+	}
+
+	// linearizator takes care of tmp from now
+	boost::shared_ptr<utils::Linearizator> linearizator=
+		utils::Linearizator::getInstance(tmp, new utils::OldStylePdfWriter());
+	return linearizator->linearize(file);
+}
+
 boost::shared_ptr<const CDict> CPdf::getTrailer()const
 {
 	CDict *trailer = CDictFactory::getInstance(*xref->getTrailerDict());
@@ -3180,10 +4111,16 @@ void CPdf::changeRevision(revision_t revisionNum)
 	kernelPrintDbg(DBG_DBG, "");
 
 	// credentials are checked in XRefWriter
+	revision_t previous=xref->getActualRevision();
 	xref->changeRevision(revisionNum);
 	
-	// prepares internal structures for new revision
-	initRevisionSpecific();
+	// prepares internal structures for new revision - objects which are the
+	// same in both revisions are kept
+	XRefWriter::ObjectNumSet changed;
+	if(xref->getChangedObjects(previous, changed))
+		initRevisionSpecific(&changed);
+	else
+		initRevisionSpecific();
 }
 
 void CPdf::canChange () const
@@ -32,6 +32,10 @@
 #include "kernel/modecontroller.h"
 #include "kernel/iproperty.h"
 #include "kernel/cstream.h"
+#include "kernel/pageindex.h"
+#include "kernel/indirefmap.h"
+#include "kernel/notificationqueue.h"
+#include "kernel/xrefcache.h"
 
 class StreamWriter;
 
@@ -50,34 +54,6 @@ template<typename Container> void getAllChildrenOfPdfObject (boost::shared_ptr<C
 
 class IPdfWriter;
 
-/**
- * Indirect referencies comparator.
- *
- * Handles comparing of Indirect referencies.
- */
-class IndComparator
-{
-public:
-	/** Ordering functional operator.
-	 * @param one Indirect reference.
-	 * @param two Indirect reference.
-	 *
-	 * Strict weak ordering comparision of referencies.
-	 * <br>
-	 * Referencies are compared by their fields. First num is compared (it is
-	 * more significant) and if nums are same, gen number is compared.
-	 *
-	 * @return true if one &lt; two or false otherwise.
-	 */
-	bool operator() (const pdfobjects::IndiRef one, const pdfobjects::IndiRef two) const
-	{
-		if (one.num == two.num)
-			return (one.gen < two.gen);
-		else
-			return (one.num < two.num);
-	}
-};
-
 } // namespace utils
 
 	
@@ -126,12 +102,13 @@ typedef std::pair<IndiRef, enum ResolveRefState> ResolvedRefEntry;
  *
  * @see CPdf::addIndirectProperty
  */
-typedef std::map<IndiRef, ResolvedRefEntry*, utils::IndComparator > ResolvedRefStorage;
+typedef IndiRefMap<ResolvedRefEntry*> ResolvedRefStorage;
 
 /**
  * Indirect properties mapping type.
+ * Hash based, because it is searched for each indirect object access.
  */
-typedef std::map<const IndiRef, boost::shared_ptr<IProperty>, utils::IndComparator> IndirectMapping;
+typedef IndiRefMap<boost::shared_ptr<IProperty> > IndirectMapping;
 
 /** Type for pdf identificator.
  */
@@ -194,8 +171,11 @@ typedef std::map<cpdf_id_t, ResolvedRefStorage *> ResolvedRefMapping;
  * One of CPdf responsiblities is to keep CPage instances synchronized with
  * current state of page tree. Page instances (CPage typed) can be obtained by
  * getPage, getFirstPage, getLastPage, getNextPage, getPrevPage methods. All
- * returned instances are kept in pageList to guarantee that request for page at
- * same position returns same page instance (unless page tree is changed).
+ * returned instances are kept in pageIndex to guarantee that request for page
+ * at same position returns same page instance (unless page tree is changed).
+ * pageIndex is a flat list of all page dictionary references which is built
+ * in one pass over the page tree when it is needed for the first time, so
+ * that page at given position is found in constant time.
  * CPdf uses several observers to keep this synchronization. Observer classes
  * are inner to this class to have good access to protected and private fields.
  * Each observer is specialized for one type of change in page tree:
@@ -254,6 +234,17 @@ typedef std::map<cpdf_id_t, ResolvedRefStorage *> ResolvedRefMapping;
  * enables making changes.
  * 
  * <p>
+ * <b>Notification batching</b><br>
+ * Each change of a property notifies all its observers immediately. Bulk
+ * changes (e.g. done by script) can be enclosed by beginNotificationBatch 
+ * and endNotificationBatch calls. Notifications for deferrable observers
+ * are queued and coalesced per property (see NotificationQueue) and they are
+ * delivered when the outermost batch ends. Page tree observers are not
+ * deferrable, but they don't consolidate Count and Parent fields of changed
+ * intermediate nodes until the batch ends either (unless insertPage or 
+ * removePage needs them), so that each node is consolidated just once.
+ * 
+ * <p>
  * <b>Implementation notes and limitations</b><br>
  * This version of CPdf and all its components doesn't support linearized pdf
  * files very well. Revision handling and all related, are not prepared for
@@ -375,8 +366,7 @@ protected:
 		 * <li>tries to get dictionary from oldValue (if it is reference) and 
 		 * unregister observers from whole page tree (uses 
 		 * pdf::unregisterPageTreeObservers method). 
-		 * <li>invalidates pdf-::pageCount
-		 * <li>clears pdf::pageList and invalidates all pages.
+		 * <li>clears pdf::pageIndex and invalidates all pages.
 		 * <li>clears pdf::nodeCountCache
 		 * <li>tries to get dictionary from newValue (if it is reference) and
 		 * registers observers to whole new page tree (uses
@@ -394,6 +384,14 @@ protected:
 			// TODO some constant
 			return 0;
 		}
+
+		/** Page tree has to be synchronized all the time.
+		 * @return false.
+		 */
+		virtual bool isDeferrable()const throw()
+		{
+			return false;
+		}
 	};
 
 	/** Observer for page tree node synchronization.
@@ -462,11 +460,11 @@ protected:
 		 * pageTreeKidsObserver to the array property.
 		 * <li>consolidates parent of parent node (either newValue or oldValue -
 		 * depends on which is defined, because one of them may be CNull)
-		 * <li>unregisters observers for all collected properties from oldValue
-		 * array (uses pdf::unregisterPageTreeObservers) and consolidates
-		 * pageList for each element (equivalent to removig this node)
+		 * <li>consolidates pageIndex for each reference from oldValue array
+		 * and unregisters observers from its subtree (uses
+		 * pdf::unregisterPageTreeObservers) - equivalent to removig this node
 		 * <li>similary to collected referencies from newValue array property,
-		 * except that observers are registered and pageList is consolidated as
+		 * except that observers are registered and pageIndex is consolidated as
 		 * if elemented has been inserted
 		 * </ul>
 		 * 
@@ -482,6 +480,14 @@ protected:
 			// TODO some constant
 			return 0;
 		}
+
+		/** Page tree has to be synchronized all the time.
+		 * @return false.
+		 */
+		virtual bool isDeferrable()const throw()
+		{
+			return false;
+		}
 	};
 
 	/** Observer for page tree node kids array synchronization.
@@ -539,23 +545,21 @@ protected:
 		 * <li>If both newValue and oldValue are not referencies, there is 
 		 * nothing to do here, because both values are just mess in array and 
 		 * so immediatelly returns.
-		 * <li>If oldValue is reference, than observers from whole subtree have
-		 * to be unregistered because it is no more accessible from the tree.
-		 * Uses pdf::unregisterPageTreeObservers method.
 		 * <li>consolidates page tree for intermediate node, where change has
 		 * occured. Uses getIndiRef from oldValue or newValue (depends on which
 		 * is defined, because one can be CNull) and checks
 		 * CPdf::pageTreeKidsParentCache. If cache entry exists, uses it. This is
 		 * kind of work around to handle situation when Kids array is indirect
 		 * property (cache entries are done just for such Kids arrays). Uses
-		 * CPdf::consolidatePageTree method. If this method returns with
-		 * false, discards CPdf::pageCount field (sets it to 0). Consolidation
-		 * will change node's Count property and checks all direct childs
-		 * whether they contain correct reference to parent (consolidated node).
-		 * <li>consolidate CPdf::pageList with Cpdf::consolidatePageList
+		 * CPdf::consolidatePageTree method. Consolidation will change node's
+		 * Count property and checks all direct childs whether they contain
+		 * correct reference to parent (consolidated node).
+		 * <li>consolidate CPdf::pageIndex with Cpdf::consolidatePageList
 		 * method. Consolidation will remove and invalidate all pages from
-		 * oldValue subtree and moves all which position has changed because of
-		 * this removing.
+		 * oldValue subtree and inserts pages from newValue subtree.
+		 * <li>If oldValue is reference, than observers from whole subtree have
+		 * to be unregistered because it is no more accessible from the tree.
+		 * Uses pdf::unregisterPageTreeObservers method.
 		 * <li>If oldValue is reference, discards Cpdf::nodeCountCache for it
 		 * and all nodes in its subtree.
 		 * <li>If newValue is reference, registers obserers to new subtree. Uses
@@ -573,6 +577,14 @@ protected:
 			// TODO some constant
 			return 0;
 		}
+
+		/** Page tree has to be synchronized all the time.
+		 * @return false.
+		 */
+		virtual bool isDeferrable()const throw()
+		{
+			return false;
+		}
 	};
 	
 	/** Observer for page tree root.
@@ -650,34 +662,30 @@ protected:
 	 */
 	bool consolidatePageTree(const boost::shared_ptr<CDict> & interNode, bool propagate=false);
 	
-	/** Consolidates pageList after change in Page tree.
+	/** Consolidates pageIndex after change in Page tree.
 	 * @param oldValue Old reference (CNull if no previous state).
 	 * @param newValue New reference (CNull if no future state).
-	 *
-	 * Removes all CPages, which are in old reference sub tree (if oldValue is 
-	 * not CNull - what means that new element to Kids array has been added) 
-	 * from pageList and invalidates them. Uses isNodeDescendant method for each 
-	 * page from pageList to find out if it is in sub tree.
-	 * <br>
-	 * Also calculates difference between lost pages and newly added pages (each
-	 * is calculated by number of leaf nodes from oldValue resp. newValue sub
-	 * tree - uses getKidsCount helper function). If oldValue or newValue is
-	 * CNull 0 is used.
-	 * <br>
-	 * Tries to determine which pages have to be consolidated (those which
-	 * position has changed). If newValue is CNull, we have no information about 
-	 * oldValue position so we can either get page information from all pages in 
-	 * the list or if at least one page from oldValue subtree has been removed 
-	 * from pageList, we can use this as starting point and just change position
-	 * according calculated difference.
+	 * @param interNode Intermediate node whose Kids array has changed.
+	 * @param kidsIndex Index of newValue in interNode's Kids array (or
+	 * NO_KIDS_INDEX if not known).
+	 *
+	 * Collects references of all pages from oldValue sub tree (if oldValue is
+	 * not CNull - what means that new element to Kids array has been added),
+	 * removes them from pageIndex and invalidates their CPage instances.
+	 * Position of the removed pages is found by their references in
+	 * pageIndex.
 	 * <br>
-	 * Page position getting is rather complex operation and may lead to whole 
-	 * page tree searching. This is done only if no page position is available 
-	 * from oldValue subtree.
+	 * Then collects references of all pages from newValue sub tree (if
+	 * newValue is not CNull) and inserts them to the pageIndex. Insert
+	 * position is determined by the nearest page preceding kidsIndex-th
+	 * element in the page tree which is already in pageIndex (uses 
+	 * getPageIndexPosition) or by getNodePosition as a fallback.
 	 * <br>
-	 * This guaranties, that pages from removed subtree are not available 
-	 * anymore and are invalidated and also valid returned CPage instances are 
-	 * associated with correct position in pageList.
+	 * Both operations take time proportional to the number of pages in the
+	 * changed subtrees (plus logarithm of the total page count). Whenever the
+	 * change can't be applied unambiguously (e.g. page dictionary is
+	 * referenced from more places of the page tree), pageIndex is just marked
+	 * as invalid and it is rebuilt by buildPageIndex.
 	 * <p>
 	 * <b>Implementation notes</b><br>
 	 * This method should be called by obsever monitoring Kids array and Kids
@@ -685,14 +693,6 @@ protected:
 	 * Some previous checking and consolidation of page tree should be done
 	 * before, because this method relies on proper page tree structure.
 	 * <br>
-	 * No parameters checking is done here. Caller must be sure that:
-	 * <ul>
-	 * <li>parameter must be CNull or CRef
-	 * <li>CRef must point to dictionary
-	 * <li>dictionary must have Type field with value Page or Pages
-	 * <li>Pages dictionary must contain Count field with integer value
-	 * </ul>
-	 * <br>
 	 * oldValue and newValue can be CNull or CRef instances. CNull case stands 
 	 * for adding (if oldValue) resp. deleting (if newValue) event. If both of 
 	 * them are CNull no change is done by this method. 
@@ -701,12 +701,122 @@ protected:
 	 * to refer to page or pages dictionary. 
 	 * <br>
 	 * If both values are CRef instances then oldValue has been replaced by 
-	 * newValue reference. This implementation assumes that both of them were 
-	 * on same position in the page tree - one sub tree was replaced by new one
-	 * but on the same position. It is not possible that these values could be 
-	 * on different positions (this would cause page numbering problem).
+	 * newValue reference. 
+	 */
+	void consolidatePageList(const boost::shared_ptr<IProperty> & oldValue, 
+			const boost::shared_ptr<IProperty> & newValue,
+			const boost::shared_ptr<CDict> & interNode, size_t kidsIndex);
+
+	/** Constant for unknown index in Kids array.
+	 */
+	static const size_t NO_KIDS_INDEX=(size_t)-1;
+
+	/** Checks whether page tree has to be rebuilt.
+	 * @param fanOut Maximal number of kids of intermediate node.
+	 *
+	 * Checks all intermediate nodes of the page tree (pages are recognized
+	 * by pageIndex, so that their dictionaries are not fetched).
+	 *
+	 * @return true if there is an intermediate node with more than fanOut
+	 * kids, false otherwise.
+	 */
+	bool needsPageTreeRebuild(size_t fanOut)const;
+
+	/** Gets pageIndex position for new page tree element.
+	 * @param interNode Intermediate node.
+	 * @param kidsIndex Index of the element in interNode's Kids array.
+	 * @param pos Position in pageIndex where pages from element's subtree 
+	 * belong to (set only on success).
+	 *
+	 * Searches elements preceding kidsIndex-th one in interNode's Kids array
+	 * (and recursively all preceding elements of interNode's ancestors) for
+	 * the nearest page which is already in pageIndex. Ancestors are not
+	 * searched while there are nodes with deferred consolidation, because
+	 * their Parent fields may be out of date.
+	 *
+	 * @return true if position has been found, false otherwise (e.g. page 
+	 * tree is ambiguous).
+	 */
+	bool getPageIndexPosition(boost::shared_ptr<CDict> interNode, size_t kidsIndex, size_t & pos)const;
+
+	/** Gets place in the page tree where new page belongs to.
+	 * @param pos Position of the new page (starting from 1, values greater
+	 * than page count stand for position after the last page).
+	 * @param kids Set to Kids array where to insert.
+	 * @param kidsIndex Set to index in kids array where to insert.
+	 *
+	 * @throw NoPageRootException if no page tree root can be found.
+	 * @throw MalformedFormatExeption if intermediate node Kids field is not
+	 * an array.
+	 * @throw AmbiguousPageTreeException if position of the page currently at
+	 * pos in its parent Kids array is ambiguous.
+	 * @return Intermediate node which owns kids array.
+	 */
+	boost::shared_ptr<CDict> getPageInsertionPoint(size_t pos, 
+			boost::shared_ptr<CArray> & kids, size_t & kidsIndex);
+
+	/** Prepares page dictionary for adding to this document.
+	 * @param page Page from different pdf.
+	 *
+	 * Clones page dictionary, removes Parent field and sets all inheritable
+	 * attributes, so that it can be added by addIndirectProperty without
+	 * following parent nodes. 
+	 *
+	 * @return Cloned dictionary (locked for dispatchChange).
+	 */
+	static boost::shared_ptr<CDict> clonePageDict(const boost::shared_ptr<CPage> & page);
+
+	/** Prefetches pages following the given position.
+	 * @param pos Position of the page returned by getPage.
+	 *
+	 * Starts prefetching of prefetchPageCount pages after pos and stores pos
+	 * to lastPrefetchPos.
 	 */
-	void consolidatePageList(const boost::shared_ptr<IProperty> & oldValue, const boost::shared_ptr<IProperty> & newValue);
+	void prefetchFollowingPages(size_t pos)const;
+
+	/** Builds pageIndex from the page tree.
+	 *
+	 * Collects references of all page dictionaries in one pass over the page
+	 * tree and fills pageIndex with them. Already returned CPage instances are
+	 * kept if their page dictionary is referenced just once in the page tree.
+	 * Otherwise they are invalidated.
+	 */
+	void buildPageIndex()const;
+
+	/** Synchronizes cross reference sidecar with the opened document.
+	 * @param filename Document file name.
+	 * @param key Key of the document file content.
+	 *
+	 * If xref has been restored from the sidecar snapshot, pageIndex is 
+	 * filled with page references from it (unless credentials are required).
+	 * Otherwise a new sidecar is stored with the current cross reference 
+	 * information and page references (pageIndex is built for that).
+	 * Problems with sidecar are never reported to the caller.
+	 */
+	void syncXRefSidecar(const char * filename, const xrefcache::FileKey & key, 
+			const xrefcache::XRefSnapshot & snapshot);
+
+	/** Invalidates all pages from given storage.
+	 * @param pages Storage of pages.
+	 */
+	static void invalidatePages(const PageIndex::PageStorage & pages);
+
+	/** Returns page dictionary at given position.
+	 * @param pos Position of the page (starting from 1).
+	 *
+	 * @throw PageNotFoundException if page is out of range or page dictionary
+	 * can't be found.
+	 * @return Page dictionary.
+	 */
+	boost::shared_ptr<CDict> getPageDict(size_t pos)const;
+
+	/** Rebuilds pageIndex if it is not synchronized with page tree.
+	 *
+	 * Index is rebuilt only if it has some content (it has been already
+	 * used). Otherwise it is built lazily when it is needed for the first
+	 * time.
+	 */
+	void syncPageIndex()const;
 
 	/** Registers definitive value of property to the xref.
 	 * @param ip Property to be used.
@@ -870,42 +980,23 @@ private:
 	 */
 	boost::shared_ptr<CDict> docCatalog;
 
-	/** Type of returned pages list.
+	/** Index of all pages.
 	 *
-	 * It is association of page position with CPage instance. Elements are
-	 * sorted according their position.
-	 */
-	typedef std::map<size_t, boost::shared_ptr<CPage> > PageList;
-
-	/** Returned pages list.
-	 *
-	 * This container stores CPage instances returned by this class. Each time
-	 * new page is returned, it is stored here with actual page position. This
-	 * is because, page position may change from property interface from page
-	 * tree. Each time this tree is changed, this list is consolidated and all
-	 * page instances which are no more available on its position are
-	 * invalidated (Uses CPage::invalidate method). 
-	 * <br>
-	 * pageList is invalidate on each revision change (with all its pages).
-	 * <br>
-	 * It is safe to try to find page in this list at first and if not found,
-	 * than searching is neccessary. 
+	 * This container stores references of all page dictionaries in the
+	 * document order and CPage instances returned by this class. Each time
+	 * new page is returned, it is stored here with its entry, so that request
+	 * for page at same position returns same page instance. Each time page 
+	 * tree is changed, index is consolidated (consolidatePageList) and all
+	 * page instances which are no more available are invalidated (Uses 
+	 * CPage::invalidate method). 
 	 * <br>
-	 * This storage behaves like CPage cache.
-	 */
-	mutable PageList pageList;
-
-	/** Number of pages in document.
-	 *
-	 * Keeps value of actual number of pages or 0 if value is invalid and
-	 * getPageCount has to find out it. Whenever this is set to non 0 and change
-	 * in page tree occures which can change total number of pages, it is set to
-	 * 0. Value is also invalidated in initRevisionSpecific method.
+	 * Index is built lazily by buildPageIndex when it is needed for the first
+	 * time (or after it has been invalidated) and it is cleared on each 
+	 * revision change (with all its pages).
 	 * <br>
-	 * This is kind of optimalization to prevent geting Root of page tree node
-	 * each time when total number of pages is required.
+	 * Total number of pages is the size of this index.
 	 */
-	mutable size_t pageCount;
+	mutable PageIndex pageIndex;
 
 	/** Cache for page count information for intermediate nodes.
 	 *
@@ -938,13 +1029,44 @@ private:
 	 */
 	PageTreeKidsParentCache pageTreeKidsParentCache;
 
+	/** Intermediate nodes which need consolidation.
+	 *
+	 * Page tree observers store here nodes which have changed during
+	 * notification batch instead of calling consolidatePageTree.
+	 * @see consolidateDeferredPageTree
+	 */
+	std::set<IndiRef, utils::IndComparator> deferredPageTreeNodes;
+
+	/** Consolidates or defers consolidation of the page tree.
+	 * @param interNode Intermediate node dictionary under which change has
+	 * occured.
+	 *
+	 * Calls consolidatePageTree with propagation or just remembers the node
+	 * in deferredPageTreeNodes if a notification batch is open.
+	 */
+	void consolidatePageTreeOrDefer(const boost::shared_ptr<CDict> & interNode);
+
+	/** Consolidates all nodes from deferredPageTreeNodes.
+	 *
+	 * Discards nodeCountCache (counts of ancestors of changed nodes are not
+	 * discarded while consolidation is deferred) and consolidates each node
+	 * with propagation.
+	 */
+	void consolidateDeferredPageTree();
+
 	// TODO returned outlines list
 
 	/** Intializes revision specific stuff.
+	 * @param changed Numbers of objects which differ between the previous
+	 * and the current revision (NULL if all objects should be considered
+	 * different).
 	 * 
 	 * Cleans up all internal structures which may depend on the current revision.
-	 * This includes indirect mapping and pageList (all pages are invalidated).
-	 * After clean up is ready, initializes docCatalog field.
+	 * This includes indirect mapping and pageIndex (all pages are invalidated).
+	 * If changed objects are known, only indirect properties of changed objects
+	 * are dropped and only pages which depend on them are invalidated. Other
+	 * pages are kept in the invalidated pageIndex and taken over when it is
+	 * rebuilt. After clean up is ready, initializes docCatalog field.
 	 * <br>
 	 * Finally registers pageTreeWatchDog observer. Uses
 	 * registerPageTreeObserver method with Pages reference as parameter.
@@ -955,7 +1077,7 @@ private:
 	 * dictionary.
 	 * 
 	 */
-	void initRevisionSpecific();
+	void initRevisionSpecific(const XRefWriter::ObjectNumSet * changed=NULL);
 
 	/**************************************************************************
 	 * End of revision specific data
@@ -991,6 +1113,32 @@ private:
 	 */
 	configuration::ModeController* modeController;
 
+	/** Fan-out of page tree rebuilt by save.
+	 *
+	 * If non 0, save rebuilds page tree by rebuildPageTree with this fan-out
+	 * whenever some of intermediate nodes has more kids than this value.
+	 * Use setPageTreeFanOut to set it.
+	 */
+	size_t pageTreeFanOut;
+
+	/** Number of pages prefetched after the page returned by getPage.
+	 * Use setPagePrefetch to set it.
+	 */
+	size_t prefetchPageCount;
+
+	/** Position of the page which triggered the last prefetching (0 if 
+	 * none).
+	 */
+	mutable size_t lastPrefetchPos;
+
+	/** Depth of nested notification batches.
+	 */
+	size_t notificationBatchDepth;
+
+	/** Notifications postponed by notification batch.
+	 */
+	NotificationQueue notificationQueue;
+
 	/** Weak reference to this instance for proper reference counting
 	 * with combination to published shared_ptr.
 	 */
@@ -1004,17 +1152,20 @@ private:
 	 * If you want to create instance, please use static factory method 
 	 * getInstance.
 	 */
-	CPdf ():mode(ReadOnly), modeController(NULL){}
+	CPdf ():mode(ReadOnly), modeController(NULL), pageTreeFanOut(0), prefetchPageCount(0), lastPrefetchPos(0), notificationBatchDepth(0){}
 
 	/** Initializating constructor.
 	 * @param stream Stream with data.
 	 * @param openMode Mode for this file.
+	 * @param snapshot Resolved cross reference information for XRefWriter
+	 * (NULL if not available).
 	 *
 	 * Creates XRefWriter, initializes pageTreeWatchDog and finally calls
 	 * initRevisionSpecific method for initialization of internal structures
 	 * which depends on current revision.
 	 */
-	CPdf(StreamWriter * stream, OpenMode openMode);
+	CPdf(StreamWriter * stream, OpenMode openMode, 
+			const xrefcache::XRefSnapshot * snapshot=NULL);
 	
 	/** Destructor.
 	 * 
@@ -1025,7 +1176,7 @@ private:
 	~CPdf();
 
 	/** Helper method to cleanup all data structure before CPdf destroying.
-	 * This includes invalidating all pages from pageList (those returned 
+	 * This includes invalidating all pages from pageIndex (those returned 
 	 * by getPage), unregistering all observers, clearing all cached
 	 * indirect objects and cleaning up resolvedRefMapping.
 	 * <br>
@@ -1042,6 +1193,10 @@ public:
 	 *
 	 * This is only way how to get instance of CPdf type. All necessary 
 	 * initialization is done.
+	 * <br>
+	 * If xref sidecars are enabled (see xrefcache::setEnabled), cross 
+	 * reference information is restored from the file sidecar when it is
+	 * valid and the sidecar is (re)created otherwise.
 	 *
 	 * @throw PdfOpenException if file open fails.
 	 * @return Initialized (and ready to be used) CPdf instance.
@@ -1232,6 +1387,10 @@ public:
 	 * </ul>
 	 * <br>
 	 * As a side effect sets change field to false
+	 * <br>
+	 * If page tree fan-out is set (@see setPageTreeFanOut) and some
+	 * intermediate node of the page tree has more kids, page tree is rebuilt
+	 * by rebuildPageTree before changes are stored.
 	 *
 	 * @throw ReadOnlyDocumentException if mode is set to ReadOnly or we aren't
 	 * in the newest revision (where changes are enabled).
@@ -1270,6 +1429,25 @@ public:
 	 */
 	void clone(FILE * fname)const;
 
+	/** Writes linearized copy of the document to file.
+	 * @param file File handle, where to store content.
+	 *
+	 * Stores the same document state as clone (all objects until the current
+	 * revision without actual changes) but linearized (see 
+	 * utils::Linearizator), so the result can be displayed before it is
+	 * completely downloaded. Only reachable objects are written and all
+	 * revisions are merged into the single one.
+	 * <br>
+	 * The current revision is cloned to a temporary file at first, because
+	 * linearizator needs its own input stream.
+	 * <br>
+	 * Same note as for clone about the target of the file handle applies.
+	 *
+	 * @return 0 on success, errno otherwise.
+	 * @throw NotImplementedException if document is linearized or encrypted.
+	 */
+	int saveLinearized(FILE * file)const;
+
 	/** Returns document catalog for property access.
 	 * 
 	 * @return Document catalog dictionary wrapped by smart pointer (using
@@ -1343,7 +1521,7 @@ public:
 	 * @param pos Position of the page.
 	 *
 	 * Removes given page from its parent Kids array. This method triggers
-	 * pageList and page tree consolidation same way as it was removed manualy. 
+	 * pageIndex and page tree consolidation same way as it was removed manualy. 
 	 * As a result page count is decreased. 
 	 * <br>
 	 * Method may fail if page at given position is ambigues. This means that it
@@ -1362,6 +1540,160 @@ public:
 	 */
 	void removePage(size_t pos);
 
+	/** Imports pages from different document.
+	 * @param source Document to import pages from.
+	 * @param from Position of the first imported page in source.
+	 * @param to Position of the last imported page in source.
+	 * @param pos Position where to insert the first imported page (same 
+	 * meaning as for insertPage).
+	 *
+	 * Does the same as insertPage for each page from the given range, but
+	 * all pages are handled as one batch. Page dictionaries are copied with
+	 * all referenced objects first (objects shared by more pages, like fonts
+	 * or images, are copied just once for the whole batch and also for
+	 * previous insertPage or importPages calls with the same source).
+	 * Then all copied pages are put under a new intermediate node (nodes
+	 * with at most getPageTreeFanOut kids, or DEFAULT_PAGE_TREE_FANOUT if
+	 * not set, if there are more pages) and this node is inserted to the
+	 * page tree, so that page tree consolidation and page tree observers
+	 * are triggered only once.
+	 * <br>
+	 * Each page dictionary is copied to a new object, so that the same
+	 * source page may be imported more times (also in one range) and each
+	 * import creates separate page.
+	 * <br>
+	 * Imported pages are available at positions pos, pos+1, ... (or after
+	 * the last page if pos is greater than page count).
+	 *
+	 * @throw ReadOnlyDocumentException if mode is set to ReadOnly or we are in
+	 * older revision (where no changes are allowed).
+	 * @throw ElementBadTypeException if source is NULL.
+	 * @throw PageNotFoundException if range is empty or out of source 
+	 * page range.
+	 * @throw AmbiguousPageTreeException if pages can't be inserted to given
+	 * position because of ambiguous page tree or source is this document.
+	 * @throw NoPageRootException if no page tree root can be found.
+	 */
+	void importPages(const boost::shared_ptr<CPdf> & source, size_t from, size_t to, size_t pos);
+
+	/** Default fan-out for rebuildPageTree.
+	 */
+	static const size_t DEFAULT_PAGE_TREE_FANOUT=32;
+
+	/** Rebuilds page tree to the balanced one.
+	 * @param fanOut Maximal number of kids of each intermediate node (must be
+	 * at least 2).
+	 *
+	 * Replaces all intermediate nodes of the page tree (except for the page
+	 * tree root dictionary) by new nodes, so that each intermediate node has
+	 * at most fanOut kids and all pages have the same depth. Pages are split
+	 * among nodes of each level evenly. Page order is not changed and so all
+	 * returned pages stay valid.
+	 * <br>
+	 * Attributes inherited from the replaced nodes (Resources, MediaBox,
+	 * CropBox and Rotate) are pushed down to each page which doesn't define
+	 * them itself. Attributes of the page tree root are still inherited.
+	 * Direct Resources dictionaries are stored as new indirect objects, so
+	 * that all pages which inherited them share the same object.
+	 * <br>
+	 * Replaced nodes are not referenced anymore, but they are kept in the
+	 * document until it is flattened (@see utils::Flattener).
+	 *
+	 * @throw ReadOnlyDocumentException if mode is set to ReadOnly or we are in
+	 * older revision (where no changes are allowed).
+	 * @throw NoPageRootException if the document doesn't have page tree.
+	 * @throw AmbiguousPageTreeException if some page is referenced from more
+	 * places of the page tree.
+	 * @throw ElementBadTypeException if fanOut is less than 2.
+	 */
+	void rebuildPageTree(size_t fanOut=DEFAULT_PAGE_TREE_FANOUT);
+
+	/** Sets fan-out of page tree rebuilt by save.
+	 * @param fanOut Maximal number of kids of intermediate node or 0 to
+	 * disable rebuilding (must not be 1).
+	 *
+	 * If set, save rebuilds page tree with rebuildPageTree method whenever
+	 * some intermediate node has more kids than given value. Disabled by
+	 * default.
+	 *
+	 * @throw ElementBadTypeException if fanOut is 1.
+	 */
+	void setPageTreeFanOut(size_t fanOut);
+
+	/** Returns fan-out of page tree rebuilt by save.
+	 * @return Fan-out value or 0 if page tree is not rebuilt by save.
+	 */
+	size_t getPageTreeFanOut()const
+	{
+		return pageTreeFanOut;
+	}
+
+	/** Opens notification batch.
+	 *
+	 * Until the batch is closed by endNotificationBatch, notifications of
+	 * property changes for deferrable observers (see 
+	 * observer::IObserver::isDeferrable) are queued and changes of the same
+	 * property are coalesced. Batches can be nested, notifications are 
+	 * delivered when the outermost one is closed.
+	 * <br>
+	 * Consolidation of page tree nodes changed inside the batch is postponed
+	 * as well. Page positions are kept up to date.
+	 * <p>
+	 * <b>Example</b>
+	 * <pre>
+	 * pdf->beginNotificationBatch();
+	 * try
+	 * {
+	 * 	// a lot of property changes
+	 * }catch(...)
+	 * {
+	 * 	pdf->endNotificationBatch();
+	 * 	throw;
+	 * }
+	 * pdf->endNotificationBatch();
+	 * </pre>
+	 */
+	void beginNotificationBatch();
+
+	/** Closes notification batch.
+	 *
+	 * If this is the outermost batch, consolidates page tree nodes changed
+	 * inside the batch and delivers all queued notifications.
+	 * Does nothing if there is no open batch.
+	 */
+	void endNotificationBatch();
+
+	/** Checks whether notification batch is open.
+	 * @return true if notifications are postponed, false otherwise.
+	 */
+	bool isNotificationBatch()const
+	{
+		return notificationBatchDepth>0;
+	}
+
+	/** Postpones notification until the batch ends.
+	 * @param subject Changed property.
+	 * @param newValue New value.
+	 * @param context Change context.
+	 *
+	 * Used by IProperty::notifyObservers, shouldn't be used directly.
+	 */
+	void _queueNotification(IProperty & subject, const boost::shared_ptr<IProperty> & newValue,
+			const boost::shared_ptr<const IProperty::ObserverContext> & context)
+	{
+		notificationQueue.push(subject, newValue, context);
+	}
+
+	/** Discards postponed notifications of given property.
+	 * @param subject Property which is destroyed or which leaves this pdf.
+	 *
+	 * Used by IProperty, shouldn't be used directly.
+	 */
+	void _cancelNotifications(IProperty & subject)
+	{
+		notificationQueue.cancel(subject);
+	}
+
 	/** Returns absolute position of given page.
 	 * @param page Page to look for.
 	 * 
@@ -1369,6 +1701,9 @@ public:
 	 * by this CPdf instance or it is no longer available, exception is thrown.
 	 * <br>
 	 * NOTE: instances are same if they are stand for same instance.
+	 * <br>
+	 * Page is searched in pageIndex by its dictionary reference, so this
+	 * takes logarithmic time.
 	 *
 	 * @throw PageNotFoundException if given page is not recognized by CPdf
 	 * instance.
@@ -1377,8 +1712,8 @@ public:
 
 	/** Returnes total page count.
 	 *
-	 * Calculates (uses getKidsCount helper function) all direct pages under
-	 * page tree root node.
+	 * Returns size of pageIndex (which is built by buildPageIndex if it is not
+	 * valid).
 	 * <br>
 	 * Note that if page tree root doesn't exists, it will return 0 rather than
 	 * error (exception) announcing.
@@ -1393,16 +1728,45 @@ public:
 	/** Returns page at given position.
 	 * @param pos Position (starting from 1).
 	 *
-	 * At first tries to find page with given position in pageList. If found,
-	 * returns instance from list. Otherwise, searches page tree by findPageDict
-	 * helper function and if page dictionary is found, creates new CPage
-	 * instance and inserts new mapping (postion to CPage instance) to pageList.
+	 * Gets page entry at given position from pageIndex (builds index by 
+	 * buildPageIndex if it is not valid). If the entry already contains CPage
+	 * instance, returns it. Otherwise creates new CPage instance from page 
+	 * dictionary and stores it to the entry.
 	 *
 	 * @throw PageNotFoundException if pos can't be found or out of range.
 	 * @return CPage instance wrapped by smart pointer.
 	 */
 	boost::shared_ptr<CPage> getPage(size_t pos)const;
 
+	/** Default memory limit for page prefetching (in bytes).
+	 */
+	static const size_t DEFAULT_PREFETCH_MEMORY=32*1024*1024;
+
+	/** Enables prefetching of pages following the requested one.
+	 * @param pages Number of pages to prefetch or 0 to disable prefetching.
+	 * @param memoryLimit Maximal memory used by prefetched objects (in
+	 * bytes).
+	 *
+	 * If enabled, each getPage call for a different position starts 
+	 * prefetching of objects used by the given number of pages which follow
+	 * the returned one (see CXref::prefetchPages). So page dictionaries, 
+	 * resources, content streams and images of following pages are parsed on 
+	 * background while the caller processes the current page. This is 
+	 * useful for sequential page processing (e.g. batch tools or page 
+	 * navigation). Prefetching is used only in the latest revision. Disabled
+	 * by default.
+	 */
+	void setPagePrefetch(size_t pages, size_t memoryLimit=DEFAULT_PREFETCH_MEMORY);
+
+	/** Returns number of pages prefetched after the page returned by 
+	 * getPage.
+	 * @return Number of pages or 0 if prefetching is disabled.
+	 */
+	size_t getPagePrefetch()const
+	{
+		return prefetchPageCount;
+	}
+
 	/** Returns first page.
 	 *
 	 * Calls getPage(1).
@@ -1540,8 +1904,10 @@ public:
 	 * Delegates to xref field and reinitializes all internal structures
 	 * which are revision specific (calls initRevisionSpecific method).
 	 * <br>
-	 * NOTE: indirect mapping is cleared so, all indirect properties are lost
-	 * and shouldn't be used anymore.
+	 * NOTE: indirect properties of objects which differ between revisions are
+	 * lost and shouldn't be used anymore. The same holds for pages which
+	 * depend on such objects. Unchanged objects and pages are shared by both
+	 * revisions.
 	 *
 	 * @see XRefWriter::changeRevision
 	 * @see initRevisionSpecific
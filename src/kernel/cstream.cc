@@ -68,7 +68,9 @@ CStream::CStream (boost::weak_ptr<CPdf> p, const ::Object& o, const IndiRef& rf)
 	dictionary.setIndiRef (rf);
 	
 	// Save the contents of the container
-	utils::parseStreamToContainer (buffer, o);
+	boost::shared_ptr<Buffer> buf (new Buffer);
+	utils::parseStreamToContainer (*buf, o);
+	buffer = buf;
 }
 
 
@@ -91,14 +93,16 @@ CStream::CStream (const ::Object& o) : parser (NULL), tmpObj (NULL)
 	utils::complexValueFromXpdfObj<pDict,CDict::Value&> (dictionary, *objDict, dictionary.value);
 
 	// Save the contents of the container
-	utils::parseStreamToContainer (buffer, o);
+	boost::shared_ptr<Buffer> buf (new Buffer);
+	utils::parseStreamToContainer (*buf, o);
+	buffer = buf;
 }
 
 
 //
 //
 //
-CStream::CStream (const CDict& dict) : parser (NULL), tmpObj (NULL)
+CStream::CStream (const CDict& dict) : buffer (new Buffer), parser (NULL), tmpObj (NULL)
 {
 	kernelPrintDbg (debug::DBG_DBG,"");
 
@@ -108,7 +112,7 @@ CStream::CStream (const CDict& dict) : parser (NULL), tmpObj (NULL)
 //
 //
 //
-CStream::CStream (bool makeReqEntries) : parser (NULL)
+CStream::CStream (bool makeReqEntries) : buffer (new Buffer), parser (NULL)
 {
 	kernelPrintDbg (debug::DBG_DBG,"");
 
@@ -146,19 +150,9 @@ CStream::doClone () const
 	// NOTE: We do not want to inherit any IProperty variable
 	CStream* clone_ = _newInstance ();
 	
-	//
-	// Loop through all items and clone them as well and finally add them to the new object
-	//
-	CDict::Value::const_iterator it = dictionary.value.begin ();
-	for (; it != dictionary.value.end (); ++it)
-	{
-		boost::shared_ptr<IProperty> newIp = ((*it).second)->clone ();
-		assert (newIp);
-		CDict::Value::value_type item =  make_pair ((*it).first, newIp);
-		clone_->dictionary.value.push_back (item);
-	}
-
-	copy (buffer.begin(), buffer.end(), back_inserter (clone_->buffer));
+	// Dictionary items and buffer are shared until they are changed
+	dictionary._cloneValue (clone_->dictionary);
+	clone_->buffer = buffer;
 	
 	return clone_;
 }
@@ -207,10 +201,9 @@ CStream::setRawBuffer (const Buffer& buf)
 	boost::shared_ptr<ObserverContext> context (this->_createContext());
 
 	// Copy buf to buffer
-	buffer.clear ();
-	copy (buf.begin(), buf.end(), back_inserter (buffer));
+	buffer = boost::shared_ptr<const Buffer> (new Buffer (buf));
 	// Change length
-	setLength (buffer.size());
+	setLength (buffer->size());
 	
 	try {
 		//Dispatch change 
@@ -263,11 +256,11 @@ CStream::_makeXpdfObject () const
 	// Set correct length. This can ONLY happen e.g. when length is an indirect
 	// object
 	// 
-	if (getLength() != buffer.size())
+	if (getLength() != buffer->size())
 		kernelPrintDbg (debug::DBG_WARN, "Length attribute of a stream is not valid. Changing it to buffer size.");
 
 	// Dictionary will be deallocated in ~BaseStream
-	::Object* obj = utils::xpdfStreamObjFromBuffer (buffer, dictionary);
+	::Object* obj = utils::xpdfStreamObjFromBuffer (*buffer, dictionary);
 	assert (NULL != obj);
 	assert (objStream == obj->getType());
 	return obj;
@@ -290,7 +283,7 @@ CStream::getStringRepresentation (string& str) const
 	dictionary.getStringRepresentation (str);
 
 	// Put them together
-	return utils::streamToString (strDict, buffer.begin(), buffer.end(), back_inserter(str));
+	return utils::streamToString (strDict, buffer->begin(), buffer->end(), back_inserter(str));
 }
 
 
@@ -358,10 +351,10 @@ CStream::_objectChanged (boost::shared_ptr<const ObserverContext> context)
 	assert (hasValidRef (this));
 
 	// Set correct length
-	if (getLength() != buffer.size())
+	if (getLength() != buffer->size())
 	{
 		kernelPrintDbg (debug::DBG_WARN, "Length attribute of a stream is not valid. Changing it to buffer size.");
-		setLength (buffer.size());
+		setLength (buffer->size());
 	}
 	
 	// Dispatch the change
@@ -84,8 +84,10 @@ public:
 protected:
 	/** Stream dictionary. */
 	CDict dictionary;
-	/** Stream buffer. */
-	Buffer buffer;
+	/** Stream buffer. 
+	 * It is never changed in place (only replaced) so it is shared by clones.
+	 */
+	boost::shared_ptr<const Buffer> buffer;
 
 	//
 	// Parsing
@@ -147,6 +149,7 @@ protected:
 
 	/**
      * Implementation of clone method. 
+	 * Buffer and dictionary items are shared with the clone (copy-on-write).
      * @return Deep copy of this object.
 	 */
 	virtual IProperty* doClone () const;
@@ -175,10 +178,19 @@ public:
 	boost::shared_ptr<IProperty> getProperty (PropertyId id) const
 		{return dictionary.getProperty (id);}
 
+	/** Delagate this operation to underlying dictionary. \see CDict */
+	boost::shared_ptr<IProperty> getProperty (PropertyId id)
+		{return dictionary.getProperty (id);}
+
 	/** Delagate this operation to underlying dictionary. \see CDict */
 	template<typename ItemType>
 	boost::shared_ptr<ItemType> getProperty (PropertyId id) const
 		{return dictionary.getProperty<ItemType> (id);}
+
+	/** Delagate this operation to underlying dictionary. \see CDict */
+	template<typename ItemType>
+	boost::shared_ptr<ItemType> getProperty (PropertyId id)
+		{return dictionary.getProperty<ItemType> (id);}
 	
 	/** Delagate this operation to underlying dictionary. \see CDict */
 	bool containsProperty (PropertyId id) const
@@ -232,7 +244,7 @@ public:
 	 *
 	 * @return Buffer.
 	 */
-	const Buffer& getBuffer () const {return buffer;}
+	const Buffer& getBuffer () const {return *buffer;}
 	
 	/**
 	 * Get filters.
@@ -334,8 +346,7 @@ public:
 		// Make buffer pdf valid, encode buf and save it to buffer
 		std::string strbuf;
 		utils::makeStreamPdfValid (buf.begin(), buf.end(), strbuf);
-		buffer.clear();
-		copy(strbuf.begin(), strbuf.end(), back_inserter(buffer));
+		buffer = boost::shared_ptr<const Buffer> (new Buffer (strbuf.begin(), strbuf.end()));
 		// Change length
 		std::vector<std::string> filters;
 		getFilters(filters);
@@ -345,7 +356,7 @@ public:
 			kernelPrintDbg(debug::DBG_DBG, "Removing Filter entry from the stream");
 			dictionary.delProperty ("Filter");
 		}
-		setLength (buffer.size());
+		setLength (buffer->size());
 		
 		try {
 			//Dispatch change 
@@ -480,10 +491,27 @@ public:
 	template <typename Storage>
 	void _getAllChildObjects (Storage& store) const
 	{
-		CDict::Value::const_iterator it = dictionary.value.begin ();
-		for	(; it != dictionary.value.end (); ++it)
-			store.push_back ((*it).second);
+		dictionary._getAllChildObjects (store);
+	}
+
+	/**
+	 * Return all child objects which can be changed.
+	 *
+	 * @param store Container of objects.
+	 */
+	template <typename Storage>
+	void _getAllChildObjects (Storage& store)
+	{
+		dictionary._getAllChildObjects (store);
 	}
+
+	/**
+	 * Checks whether dictionary items are not referenced from outside.
+	 *
+	 * @return True if dictionary items can be shared by clones.
+	 */
+	virtual bool _hasExclusiveChildren () const
+		{ return dictionary._hasExclusiveChildren (); }
 	
 };
 
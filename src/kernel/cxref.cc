@@ -29,6 +29,12 @@
 #include "utils/debug.h"
 #include "kernel/factories.h"
 #include "kernel/pdfedit-core-dev.h"
+#include "kernel/metrics.h"
+#include "kernel/xrefcache.h"
+#include "kernel/cobject.h"
+#include "kernel/objectprefetcher.h"
+#include <goo/GThread.h>
+#include <goo/gfile.h>
 
 using namespace pdfobjects;
 
@@ -52,10 +58,20 @@ void CXref::init()
 	internal_fetch = false;
 }
 
-CXref::CXref(BaseStream * stream):XRef(stream), internal_fetch(true)
+CXref::CXref(BaseStream * stream, const xrefcache::XRefSnapshot * snapshot)
+	:XRef(stream, gFalse), internal_fetch(true), newObjectCount(0), restored(false), prefetcher(NULL)
 {
+	resetReserveState();
 	try
 	{
+		// header has been read, so we can initialize internals either from
+		// the snapshot or from xref sections
+		if(isOk() && !(snapshot && (restored=restoreSnapshot(*snapshot))))
+		{
+			Guint pos=getStartXref();
+			if(isOk())
+				initInternals(pos);
+		}
 		init();
 	}catch(...)
 	{
@@ -64,6 +80,56 @@ CXref::CXref(BaseStream * stream):XRef(stream), internal_fetch(true)
 	}
 }
 
+bool CXref::restoreSnapshot(const xrefcache::XRefSnapshot & snapshot)
+{
+	::Object * trailer;
+	try
+	{
+		trailer=utils::xpdfObjFromString(snapshot.trailer);
+	}catch(std::exception & e)
+	{
+		kernelPrintDbg(debug::DBG_WARN, "Unable to parse snapshot trailer. cause="<<e.what());
+		return false;
+	}
+	XRefEntry * entriesA=(XRefEntry *)gmallocn(snapshot.entries.size(), sizeof(XRefEntry));
+	std::copy(snapshot.entries.begin(), snapshot.entries.end(), entriesA);
+	Guint * streamEndsA=NULL;
+	if(snapshot.streamEnds.size())
+	{
+		streamEndsA=(Guint *)gmallocn(snapshot.streamEnds.size(), sizeof(Guint));
+		std::copy(snapshot.streamEnds.begin(), snapshot.streamEnds.end(), streamEndsA);
+	}
+	GBool ret=initInternals(entriesA, snapshot.entries.size(), 
+			streamEndsA, snapshot.streamEnds.size(), trailer);
+	gfree(trailer);
+	if(!ret)
+	{
+		kernelPrintDbg(debug::DBG_WARN, "Xref snapshot is not usable");
+		destroyInternals();
+		return false;
+	}
+	lastXRefPos=snapshot.lastXRefPos;
+	eofPos=snapshot.eofPos;
+	maxObj=snapshot.maxObj;
+	kernelPrintDbg(debug::DBG_DBG, "XRef restored from snapshot with "<<size<<" entries");
+	return true;
+}
+
+void CXref::getSnapshot(xrefcache::XRefSnapshot & snapshot)const
+{
+	snapshot.entries.assign(entries, entries+size);
+	snapshot.lastXRefPos=lastXRefPos;
+	snapshot.eofPos=eofPos;
+	snapshot.maxObj=maxObj;
+	snapshot.streamEnds.assign(streamEnds, streamEnds+streamEndsLen);
+	// uses trailer as it has been read (not the changed one)
+	::Object * trailer=XRef::getTrailerDict()->clone();
+	snapshot.trailer.clear();
+	utils::xpdfObjToString(*trailer, snapshot.trailer);
+	trailer->free();
+	gfree(trailer);
+}
+
 void CXref::cleanUp()
 {
 	using namespace debug;
@@ -111,10 +177,38 @@ void CXref::cleanUp()
 	kernelPrintDbg(DBG_DBG, "Cleaning newStorage");
 	// newStorage doesn't need special entries deallocation
 	newStorage.clear();
+	newObjectCount=0;
+	resetReserveState();
 	kernelPrintDbg(DBG_DBG, "newStorage cleaned up");
 
 	// remove changed trailer
 	currTrailer.reset();
+
+	dropPrefetched();
+}
+
+void CXref::dropPrefetched()
+{
+	if(prefetcher)
+		prefetcher->clear();
+}
+
+void CXref::setPrefetchLimit(size_t memoryLimit)
+{
+	using namespace debug;
+
+	kernelPrintDbg(DBG_DBG, "memoryLimit="<<memoryLimit);
+	delete prefetcher;
+	prefetcher=NULL;
+	if(memoryLimit)
+		prefetcher=new ObjectPrefetcher(*this, str, memoryLimit);
+}
+
+void CXref::prefetchPages(const RefList & pageRefs)
+{
+	if(!prefetcher || needs_credentials)
+		return;
+	prefetcher->prefetch(pageRefs);
 }
 
 CXref::~CXref()
@@ -130,6 +224,10 @@ using namespace debug;
 	}
 	*/
 	
+	// prefetcher works with the stream
+	delete prefetcher;
+	prefetcher=NULL;
+
 	kernelPrintDbg(DBG_DBG, "Deallocating internal structures");
 	cleanUp();
 	
@@ -188,7 +286,8 @@ using namespace debug;
 	// been set after initialization)
 	if(newStorage.contains(ref))
 	{
-		newStorage.put(ref, INITIALIZED_REF);
+		if(newStorage.put(ref, INITIALIZED_REF)!=INITIALIZED_REF)
+			++newObjectCount;
 		kernelPrintDbg(DBG_DBG, "newStorage entry changed to INITIALIZED_REF for "<<ref);
 	}
 	
@@ -247,7 +346,6 @@ using namespace debug;
 {
 using namespace debug;
 
-	int i=1;
 	int num=-1, gen=0;
 
 	kernelPrintDbg(DBG_DBG, "");
@@ -259,7 +357,10 @@ using namespace debug;
 	// Considers just first XRef::getNumObjects because entries array
 	// is allocated by blocks and so there are entries which are marked 
 	// as free but they are not realy removed objects.
-	int objectCount=0, xrefCount=XRef::getNumObjects();
+	// Entries are not changed and newStorage only grows until the next
+	// resetReserveState, so searching continues where the last one ended
+	int i=reserveEntryIndex;
+	int objectCount=reserveObjectCount, xrefCount=XRef::getNumObjects();
 	for(; i<size && i<MAXOBJNUM && objectCount<xrefCount; ++i)
 	{
 		if(entries[i].type!=xrefEntryFree)
@@ -300,12 +401,16 @@ using namespace debug;
 		gen=ref.gen;
 		break;
 	}
+	reserveEntryIndex=i;
+	reserveObjectCount=objectCount;
 
 	// no entry for reuse, so new has to be used
 	if(num==-1)
 	{
 		// checks if num, gen is not in newStorage and if yes,
 		// use num+1
+		if(i<reserveNewNum)
+			i=reserveNewNum;
 		for(;i<MAXOBJNUM; ++i)
 		{
 			Ref ref={i, 0};
@@ -325,6 +430,7 @@ using namespace debug;
 
 		// ok, we have new num and gen is 0, because object is new
 		gen=0;
+		reserveNewNum=num+1;
 		kernelPrintDbg(DBG_DBG, "Using new entry ["<<num<<", "<<gen<<"]");
 	}
 	
@@ -621,10 +727,38 @@ using namespace debug;
 		return obj;
 	}
 
+	if(prefetcher && !isInChangedObjStream(ref))
+	{
+		if(prefetcher->take(ref, *obj))
+		{
+			kernelPrintDbg(DBG_DBG, ref<<" is prefetched");
+			return obj;
+		}
+	}
+
 	// delegates to original implementation
 	kernelPrintDbg(DBG_DBG, ref<<" is not changed - using Xref");
 	boost::shared_ptr< ::Object> tmpObj(XPdfObjectFactory::getInstance(), xpdf::object_deleter());
-	XRef::fetch(num, gen, tmpObj.get());
+	metrics::ScopedTimer fetchTimer(metrics::xrefFetchTime);
+	bool decode=false;
+	if(metrics::isEnabled() && num>=0 && num<size 
+			&& entries[num].type==xrefEntryCompressed)
+	{
+		// compressed object requires decoding unless its object stream is
+		// the cached one
+		decode=getObjStrNum()!=(int)entries[num].offset;
+		if(decode)
+			metrics::objectStreamCacheMisses.add();
+		else
+			metrics::objectStreamCacheHits.add();
+	}
+	if(decode)
+	{
+		metrics::Stopwatch decodeWatch;
+		XRef::fetch(num, gen, tmpObj.get());
+		metrics::objectStreamDecodeTime.observe(decodeWatch.elapsed());
+	}else
+		XRef::fetch(num, gen, tmpObj.get());
 	if (!isOk())
 	{
 		kernelPrintDbg(DBG_ERR, ref<<" object fetching failed with code="
@@ -663,21 +797,214 @@ using namespace debug;
 	return obj;
 }
 
+namespace {
+
+/** Minimal number of objects for which parallel parsing is used.
+ */
+const size_t MIN_PARALLEL_OBJECTS = 64;
+
+/** Minimal number of objects parsed by one job.
+ * Small batches would decode shared object streams too many times.
+ */
+const size_t MIN_BATCH_SIZE = 32;
+
+/** Status of parsed object.
+ */
+enum ParseStatus {parseOk, parseDamaged, parseCloneFailed};
+
+/** Objects parsed by parseBatchJob.
+ */
+struct ParseBatches
+{
+	const XRef * xref;				/**< Cross reference table. */
+	BaseStream * str;				/**< Document stream (if not mapped). */
+	const GFileMap * fileMap;		/**< Mapped document stream. */
+	const CXref::RefList * refs;	/**< References to parse. */
+	CXref::ObjectList * objs;		/**< Parsed objects (only NULL are parsed). */
+	std::vector<int> * status;		/**< ParseStatus for each reference. */
+	size_t batchSize;				/**< Number of references in one batch. */
+};
+
+/** gParallelFor job: parses references of batch number idx.
+ *
+ * Each batch reads through its own view of the mapped document stream
+ * and uses its own object stream cache.
+ */
+void parseBatchJob(void * data, int idx)
+{
+	ParseBatches * batches = (ParseBatches *)data;
+	size_t first = idx * batches->batchSize;
+	size_t last = std::min(first + batches->batchSize, batches->refs->size());
+
+	BaseStream * view = batches->str;
+	::Object viewDict;
+	viewDict.initNull();
+	if(batches->fileMap)
+		view = new MemStream(const_cast<char *>(batches->fileMap->getData()), 
+				0, batches->fileMap->getLength(), &viewDict);
+	ObjectStream * objStr = NULL;
+	for(size_t i = first; i < last; ++i)
+	{
+		if((*batches->objs)[i])
+			continue;
+		const ::Ref & ref = (*batches->refs)[i];
+		::Object obj;
+		if(!batches->xref->fetchFrom(view, &objStr, ref.num, ref.gen, &obj))
+		{
+			(*batches->status)[i] = parseDamaged;
+			continue;
+		}
+		// parsed object may refer to the view, so it has to be cloned
+		::Object * cloneObj = obj.clone();
+		obj.free();
+		if(!cloneObj)
+		{
+			(*batches->status)[i] = parseCloneFailed;
+			continue;
+		}
+		(*batches->objs)[i] = cloneObj;
+	}
+	XRef::freeObjectStream(objStr);
+	if(batches->fileMap)
+		delete view;
+}
+
+/** Deallocates all objects from the list and clears it.
+ */
+void freeObjects(CXref::ObjectList & objs)
+{
+	for(size_t i = 0; i < objs.size(); ++i)
+		if(objs[i])
+			xpdf::freeXpdfObject(objs[i]);
+	objs.clear();
+}
+
+} // annonymous namespace
+
+void CXref::parseObjects(const RefList & refs, ObjectList & objs)const
+{
+	using namespace debug;
+
+	size_t count = 0;
+	for(size_t i = 0; i < objs.size(); ++i)
+		if(!objs[i])
+			count++;
+	if(!count)
+		return;
+
+	std::vector<int> status(refs.size(), parseOk);
+	ParseBatches batches;
+	batches.xref = this;
+	batches.str = str;
+	batches.fileMap = NULL;
+	batches.refs = &refs;
+	batches.objs = &objs;
+	batches.status = &status;
+	batches.batchSize = refs.size();
+
+	// mapping starts at the stream start, while views are addressed by file
+	// offsets
+	int nThreads = 1;
+	GFileMap * fileMap = NULL;
+	if(count >= MIN_PARALLEL_OBJECTS && str->getStart() == 0 
+			&& (fileMap = str->map()))
+	{
+		nThreads = globalParams ? globalParams->getDecodeThreads() : 0;
+		size_t jobs = 4 * ((nThreads > 0) ? nThreads : gGetNumCPUs());
+		batches.fileMap = fileMap;
+		batches.batchSize = std::max((refs.size() + jobs - 1) / jobs, MIN_BATCH_SIZE);
+	}
+	int nBatches = (refs.size() + batches.batchSize - 1) / batches.batchSize;
+	kernelPrintDbg(DBG_DBG, "Parsing "<<count<<" objects in "<<nBatches
+			<<" batches"<<(fileMap ? "" : " (not mapped)"));
+	gParallelFor(nBatches, parseBatchJob, &batches, nThreads);
+	delete fileMap;
+
+	// reports the first failure the same way as fetch would do
+	for(size_t i = 0; i < status.size(); ++i)
+	{
+		if(status[i] == parseOk)
+			continue;
+		freeObjects(objs);
+		if(status[i] == parseCloneFailed)
+		{
+			kernelPrintDbg(DBG_ERR, refs[i] << " object can't be cloned.");
+			throw NotImplementedException("clone failure.");
+		}
+		setErrCode(errDamaged);
+		kernelPrintDbg(DBG_ERR, refs[i]<<" object fetching failed with code="
+				<<errCode);
+		throw MalformedFormatExeption("bad stream");
+	}
+	setErrCode(errNone);
+}
+
+void CXref::fetchObjects(const RefList & refs, ObjectList & objs)const
+{
+	using namespace debug;
+
+	kernelPrintDbg(DBG_DBG, refs.size()<<" objects");
+
+	// see fetch
+	if(!internal_fetch)
+		check_need_credentials(this);
+
+	metrics::ScopedTimer fetchTimer(metrics::bulkFetchTime);
+	objs.assign(refs.size(), (::Object *)NULL);
+
+	try
+	{
+		// changed objects are used directly
+		for(size_t i = 0; i < refs.size(); ++i)
+		{
+			const ::Ref & ref = refs[i];
+			ObjectEntry * entry = changedStorage.get(ref);
+			if(!entry)
+			{
+				// compressed objects from a changed object stream are taken
+				// from the changed stream by fetch
+				if(isInChangedObjStream(ref))
+				{
+					objs[i] = XPdfObjectFactory::getInstance();
+					fetch(ref.num, ref.gen, objs[i]);
+				}
+				continue;
+			}
+			if(!entry->object)
+			{
+				// this shouldn't not happen - see fetch
+				kernelPrintDbg(DBG_CRIT, ref << " changed object is NULL!");
+				objs[i] = XPdfObjectFactory::getInstance();
+				continue;
+			}
+			objs[i] = entry->object->clone();
+			assert(objs[i]);
+		}
+	}catch(...)
+	{
+		freeObjects(objs);
+		throw;
+	}
+	parseObjects(refs, objs);
+}
+
+bool CXref::isInChangedObjStream(const ::Ref & ref)const
+{
+	if(ref.num < 0 || ref.num >= size 
+			|| entries[ref.num].type != xrefEntryCompressed)
+		return false;
+	::Ref streamRef = {(int)entries[ref.num].offset, 0};
+	return changedStorage.get(streamRef)!=NULL;
+}
+
 int CXref::getNumObjects()const
 { 
 	using namespace debug;
 
 	kernelPrintDbg(DBG_DBG, "");
 
-	size_t newSize=0;
-	RefStorage::ConstIterator begin, i;
-
-	for(i=newStorage.begin(); i!=newStorage.end(); ++i)
-		if(i->second==INITIALIZED_REF)
-			++newSize;
-
-	kernelPrintDbg(DBG_DBG, "original objects count="<<XRef::getNumObjects()<<" newly created="<<newSize);
-	return XRef::getNumObjects() + newSize;
+	kernelPrintDbg(DBG_DBG, "original objects count="<<XRef::getNumObjects()<<" newly created="<<newObjectCount);
+	return XRef::getNumObjects() + newObjectCount;
 }
 
 
@@ -691,12 +1018,15 @@ using namespace debug;
 	kernelPrintDbg(DBG_DBG, "Destroying CXref internals");
 	if(dropChanges)
 		cleanUp();
+	else
+		dropPrefetched();
 
 	// clears XRef internals and forces to fill them again
 	kernelPrintDbg(DBG_DBG, "Destroing XRef internals");
 	XRef::destroyInternals();
 	kernelPrintDbg(DBG_DBG, "Initializes XRef internals");
 	XRef::initInternals(xrefOff);
+	resetReserveState();
 
 	// sets lastXRefPos to xrefOff, because initRevisionSpecific doesn't do it
 	lastXRefPos=xrefOff;
@@ -706,6 +1036,67 @@ using namespace debug;
 	checkEncryptedContent();
 }
 
+bool CXref::reopen(size_t xrefOff, XRefEntry * entriesA, int sizeA,
+		Guint maxObjA, ::Object * trailerA)
+{
+using namespace debug;
+
+	kernelPrintDbg(DBG_DBG, "xrefOff="<<xrefOff<<" size="<<sizeA);
+
+	dropPrefetched();
+	XRef::destroyInternals();
+	GBool ret=XRef::initInternals(entriesA, sizeA, NULL, 0, trailerA);
+	gfree(trailerA);
+	if(!ret)
+	{
+		kernelPrintDbg(DBG_WARN, "Resolved entries are not usable");
+		XRef::destroyInternals();
+		return false;
+	}
+	resetReserveState();
+	lastXRefPos=xrefOff;
+	maxObj=maxObjA;
+
+	// checks encryption state for the revision
+	checkEncryptedContent();
+	return true;
+}
+
+void CXref::appendSection(size_t xrefOff, size_t eofOff, const ObjectOffsets & offsets)
+{
+using namespace debug;
+
+	kernelPrintDbg(DBG_DBG, "xrefOff="<<xrefOff<<" objects="<<offsets.size());
+
+	// writer updates the trailer in place, so the current one is exactly
+	// what has been written. It has to be copied because changed trailer
+	// is dropped together with other changes
+	::Object * trailer=getTrailerDict()->clone();
+	cleanUp();
+
+	int sizeA=size;
+	for(ObjectOffsets::const_iterator i=offsets.begin(); i!=offsets.end(); ++i)
+		sizeA=std::max(sizeA, i->first.num+1);
+	XRef::appendInternals(sizeA, trailer);
+	gfree(trailer);
+
+	for(ObjectOffsets::const_iterator i=offsets.begin(); i!=offsets.end(); ++i)
+	{
+		XRefEntry & entry=entries[i->first.num];
+		entry.offset=i->second;
+		entry.gen=i->first.gen;
+		entry.type=xrefEntryUncompressed;
+		if((Guint)i->first.num>maxObj)
+			maxObj=i->first.num;
+	}
+	lastXRefPos=xrefOff;
+	eofPos=eofOff;
+	kernelPrintDbg(DBG_DBG, "New lastXRefPos value="<<lastXRefPos<<" size="<<size);
+
+	// checks encryption state for the revision
+	checkEncryptedContent();
+}
+
 bool CXref::checkEncryptedContent()
 {
 	boost::shared_ptr< ::Object> encrypt(XPdfObjectFactory::getInstance(), xpdf::object_deleter());
@@ -35,6 +35,13 @@
 namespace pdfobjects
 {
 
+namespace xrefcache
+{
+struct XRefSnapshot;
+}
+
+class ObjectPrefetcher;
+
 /** Maximal object number.
  */
 const int MAXOBJNUM = INT_MAX;
@@ -76,7 +83,8 @@ const int MAXOBJGEN = 65535;
  * use CXref instance as XRef in rest of xpdf code. Initialization of xref from
  * file (respectively from basestream) is done only by xpdf layer (if no changes 
  * are done to the file - Maintaining layer doesn't contain any additional 
- * information than after CXref initialization). 
+ * information than after CXref initialization). Xref entries may be also
+ * restored from a previously stored snapshot (see xrefcache).
  * <br>
  * Because, in fact, all object which can be changed (we are meaning change 
  * value inside Object instance) has to be indirect Object, obj and gen number 
@@ -111,17 +119,69 @@ private:
 	 */
 	bool internal_fetch;
 
+	/** Index of XRef entry where reserveRef continues searching for a free
+	 * entry.
+	 * All entries before this one are either used, not reusable or already
+	 * reserved (in newStorage).
+	 */
+	int reserveEntryIndex;
+
+	/** Number of used XRef entries before reserveEntryIndex.
+	 */
+	int reserveObjectCount;
+
+	/** Object number where reserveRef continues searching for a new
+	 * reference.
+	 * All numbers before this one (and after the last XRef entry) are already
+	 * in newStorage.
+	 */
+	int reserveNewNum;
+
+	/** Number of INITIALIZED_REF entries in newStorage.
+	 */
+	int newObjectCount;
+
+	/** Flag whether internals were restored from a snapshot.
+	 */
+	bool restored;
+
+	/** Background prefetcher of page objects (NULL if disabled).
+	 * @see setPrefetchLimit
+	 */
+	ObjectPrefetcher * prefetcher;
+
+	/** Resets reserveRef search positions.
+	 * Must be called whenever XRef entries or newStorage are reinitialized.
+	 */
+	void resetReserveState()
+	{
+		reserveEntryIndex=1;
+		reserveObjectCount=0;
+		reserveNewNum=1;
+	}
+
 	/** Core initialization for instance.
 	 * Called by constructor only.
 	 */
 	void init();
+
+	/** Initializes XRef internals from snapshot.
+	 * @param snapshot Resolved cross reference information.
+	 *
+	 * @return true on success, false if snapshot is not usable (XRef
+	 * internals are destroyed in such a case).
+	 */
+	bool restoreSnapshot(const xrefcache::XRefSnapshot & snapshot);
 protected:
 	/** Empty constructor.
 	 *
 	 * This constructor is protected to prevent uninitialized instances.
 	 * We need at least to specify stream with data.
 	 */
-	CXref(): XRef(NULL), needs_credentials(false), internal_fetch(false){}
+	CXref(): XRef(NULL), needs_credentials(false), internal_fetch(false), newObjectCount(0), restored(false), prefetcher(NULL)
+	{
+		resetReserveState();
+	}
 
 	/** Entry for ChangedStorage.
 	 *
@@ -232,6 +292,41 @@ protected:
 	 */
 	void reopen(size_t xrefOff, bool dropChanges=true);
 
+	/** Reinitializes internal structures from resolved entries.
+	 * @param xrefOff Offset of cross reference table of the entries.
+	 * @param entriesA Resolved xref entries (gmalloc-ed).
+	 * @param sizeA Number of entries.
+	 * @param maxObjA Maximum present object number in entries.
+	 * @param trailerA Trailer dictionary (gmalloc-ed).
+	 *
+	 * Same as reopen(xrefOff, false) but cross reference sections are not
+	 * parsed. Ownership of entriesA and trailerA is taken over even on
+	 * failure.
+	 *
+	 * @return true on success, false if given data are not usable (e.g. Root
+	 * is missing) and reopen has to be used instead.
+	 */
+	bool reopen(size_t xrefOff, XRefEntry * entriesA, int sizeA,
+			Guint maxObjA, ::Object * trailerA);
+
+	/** Type for offsets of objects written to a cross reference section.
+	 * Pairs of object reference and file offset.
+	 */
+	typedef std::vector<std::pair< ::Ref, size_t> > ObjectOffsets;
+
+	/** Updates internal structures by an appended cross reference section.
+	 * @param xrefOff Offset of the appended cross reference section.
+	 * @param eofOff Offset behind the appended section.
+	 * @param offsets Offsets of all objects written to the section.
+	 *
+	 * Same as reopen(xrefOff) (all changes are dropped) for sections which
+	 * were written from the current changes, but nothing is parsed. Entries
+	 * of written objects are updated in place and the current trailer (which
+	 * has been written with the section) is kept. So the cost depends only on
+	 * the size of the appended section.
+	 */
+	void appendSection(size_t xrefOff, size_t eofOff, const ObjectOffsets & offsets);
+
 	/** Reserves reference for new indirect object.
 	 *
 	 * Searches for free object number and generation number and uses
@@ -304,6 +399,21 @@ protected:
 	 */
 	void cleanUp();
 
+	/** Drops all prefetched objects.
+	 *
+	 * Must be called before XRef internals or the stream are changed,
+	 * because prefetched objects are parsed from them on background.
+	 */
+	void dropPrefetched();
+
+	/** Checks whether given object is compressed in a changed object
+	 * stream.
+	 * @param ref Object reference.
+	 *
+	 * Such objects have to be fetched from the changed object stream.
+	 */
+	bool isInChangedObjStream(const ::Ref & ref)const;
+
 	/** Checks whether document is encrypted and if so, sets needs_credentials
 	 * and encrypted fields to true.
 	 *
@@ -335,8 +445,12 @@ public:
 
 	/** Initialize constructor.
 	 * @param stream Stream with file data.
+	 * @param snapshot Resolved cross reference information of the stream 
+	 * data (NULL if not available).
 	 *
-	 * Delegates to XRef constructor with same parameter.
+	 * Delegates to XRef constructor with same parameter. If snapshot is
+	 * given, xref sections are not parsed and internals are restored from
+	 * the snapshot instead. If it is not usable, it is silently ignored.
 	 * <br>
 	 * Given stream is always deallocated in this class. Caller should never
 	 * (even if an exception is thrown) deallocate it.
@@ -345,7 +459,7 @@ public:
 	 * unusable in such situation).
 	 * @throw PDFedit_devException if pdfedit-core-dev is not initialized.
 	 */
-	CXref(BaseStream * stream);
+	CXref(BaseStream * stream, const xrefcache::XRefSnapshot * snapshot=NULL);
 
 	/** Initialize constructor with cache.
 	 * @param stream Stream with file data.
@@ -376,6 +490,23 @@ public:
 	 */
 	virtual ~CXref();
 
+	/** Checks whether internals were restored from snapshot.
+	 * @return true if snapshot given to constructor was used, false 
+	 * otherwise.
+	 */
+	bool isRestored()const
+	{
+		return restored;
+	}
+
+	/** Gets resolved cross reference information.
+	 * @param snapshot Snapshot to be filled.
+	 *
+	 * Fills entries, positions and the trailer as they were read from the
+	 * stream (changes are not included). Other fields are kept untouched.
+	 */
+	void getSnapshot(xrefcache::XRefSnapshot & snapshot)const;
+
 	/** Sets credentials for encrypted documents.
 	 * This method is mandatory prerequisity if encrypted content is required.
 	 * If it has not been called before the fetch method is called, it will
@@ -481,8 +612,9 @@ public:
 	 * @param gen Object generation.
 	 * @param obj Object where to store content.
 	 *
-	 * Try to find object in changedStorage and if not found, delegates
-	 * to original implementation.
+	 * Try to find object in changedStorage and if not found, uses
+	 * prefetched object (see prefetchPages) or delegates to original
+	 * implementation.
 	 * <br>
 	 * NOTE:
 	 * Returned value is deepCopy of object and changes made to object 
@@ -503,6 +635,84 @@ public:
 	 * found obj is set to objNull.
 	 */
 	virtual ::Object * fetch(int num, int gen, ::Object *obj)const;
+
+	/** Type for references of objects fetched by fetchObjects. */
+	typedef std::vector< ::Ref> RefList;
+
+	/** Type for objects fetched by fetchObjects. */
+	typedef std::vector< ::Object *> ObjectList;
+
+	/** Fetches several indirect objects at once.
+	 * @param refs References of objects to fetch.
+	 * @param objs Vector where to store fetched objects (previous content
+	 * is dropped).
+	 *
+	 * Result is the same as if all references were fetched by fetch method
+	 * one by one: objs[i] is a deep copy of the object for refs[i] (objNull
+	 * for unknown references) and it has to be deallocated by caller (e.g.
+	 * by xpdf::freeXpdfObject). Objects which are not changed are parsed
+	 * concurrently (see parseObjects), so this should be prefered when many
+	 * objects are needed (e.g. whole document scans).
+	 *
+	 * @throw MalformedFormatExeption if some of objects is damaged (objs is
+	 * empty then).
+	 * @throw NotImplementedException if object cloning fails.
+	 * @throw PermissionException if we don't have credentials for encrypted
+	 * document.
+	 */
+	virtual void fetchObjects(const RefList & refs, ObjectList & objs)const;
+
+	/** Enables or disables background prefetching.
+	 * @param memoryLimit Maximal memory used by prefetched objects (in 
+	 * bytes) or 0 to disable prefetching.
+	 *
+	 * All prefetched objects are dropped.
+	 */
+	void setPrefetchLimit(size_t memoryLimit);
+
+	/** Checks whether background prefetching is enabled.
+	 */
+	bool isPrefetchEnabled()const
+	{
+		return prefetcher!=NULL;
+	}
+
+	/** Prefetches objects of given pages on background.
+	 * @param pageRefs References of page dictionaries in the priority
+	 * order.
+	 *
+	 * Objects reachable from given pages are parsed by ObjectPrefetcher on
+	 * a background thread while the caller continues. Prefetched objects are
+	 * returned by fetch (each only once, because callers keep their own 
+	 * copies) unless they are changed. Previous prefetching round is stopped
+	 * but its objects are kept within the memory limit.
+	 * <br>
+	 * Does nothing if prefetching is not enabled or credentials are 
+	 * required.
+	 */
+	void prefetchPages(const RefList & pageRefs);
+
+protected:
+	/** Parses objects directly from the document stream.
+	 * @param refs References of objects to parse.
+	 * @param objs Objects for references (same size as refs). Only NULL
+	 * entries are parsed.
+	 *
+	 * Changes are not considered. References are split to batches which are
+	 * parsed on up to GlobalParams::getDecodeThreads threads. Each batch
+	 * reads through its own view of the mapped document stream and uses its
+	 * own object stream cache (see XRef::fetchFrom), so batches don't share
+	 * any mutable state. Parsed objects are deep copies which don't refer to
+	 * the mapping. Falls back to sequential parsing if the stream can't be
+	 * mapped or there are only few objects to parse.
+	 * <br>
+	 * All objects (including those which were not NULL) are deallocated and
+	 * objs is cleared if an exception is thrown.
+	 *
+	 * @throw MalformedFormatExeption if some of objects is damaged.
+	 * @throw NotImplementedException if object cloning fails.
+	 */
+	void parseObjects(const RefList & refs, ObjectList & objs)const;
 };
 
 // implemented as macro because we want to have better log information
@@ -98,10 +98,11 @@ int Delinearizator::fillObjectList(IPdfWriter::ObjectList &objectList, int maxOb
   	// free, to the objectList. Skips also Linearized dictionary
 	utilsPrintDbg(debug::DBG_DBG, "Collecting objects starting from "<<lastObj);
 	objectList.clear();
+	RefList refs;
 	for(; lastObj < ::XRef::size; )
   	{
 		// stop if we reach the maximum objects
-		if(maxObjectCount>0 && (int)objectList.size()>=maxObjectCount)
+		if(maxObjectCount>0 && (int)refs.size()>=maxObjectCount)
 			break;
 
   		// gets object and generation number
@@ -121,18 +122,15 @@ int Delinearizator::fillObjectList(IPdfWriter::ObjectList &objectList, int maxOb
   		if(num==linearizedRef.num && gen==linearizedRef.gen)
   			continue;
   
-  		::Object * obj=XPdfObjectFactory::getInstance();
   		::Ref ref={num, gen};
-  		XRef::fetch(num, gen, obj);
-  		if(!isOk())
-  		{
-			kernelPrintDbg(debug::DBG_ERR, ref<<" object fetching failed with code="
-					<<errCode);
-  			xpdf::freeXpdfObject(obj);
-  			throw MalformedFormatExeption("bad data stream");
-  		}
-  		objectList.push_back(IPdfWriter::ObjectElement(ref, obj));
+		refs.push_back(ref);
   	}
+
+	// objects are parsed at once (concurrently)
+	ObjectList objs(refs.size(), (::Object *)NULL);
+	parseObjects(refs, objs);
+	for(size_t i=0; i<refs.size(); i++)
+  		objectList.push_back(IPdfWriter::ObjectElement(refs[i], objs[i]));
 	utilsPrintDbg(debug::DBG_DBG, "Returned "<<objectList.size()<<" objects");
 	return objectList.size();
   }
@@ -34,7 +34,7 @@ using namespace pdfobjects;
 using namespace utils;
 
 Flattener::Flattener(FileStreamData &streamData, IPdfWriter * writer)
-	:PdfDocumentWriter(streamData, writer)
+	:PdfDocumentWriter(streamData, writer), deduplicate(false)
 {
 }
 
@@ -66,42 +66,35 @@ boost::shared_ptr<Flattener> Flattener::getInstance(const char * fileName, IPdfW
 
 namespace {
 
-/** Equality operator for refList lookup.
- */
-bool operator==(const ::Ref& r1, const ::Ref& r2)
-{
-	return r1.num == r2.num && r1.gen== r2.gen;
-}
-
-bool containsRef(const Flattener::RefList & refList, const ::Ref& ref)
-{
-	Flattener::RefList::const_iterator i;
-	for(i=refList.begin(); i!=refList.end(); ++i)
-		if(*i == ref)
-			return true;
-	return false;
-}
+typedef Flattener::RefSet RefSet;
+typedef Flattener::ReachableFilter ReachableFilter;
 
 // fwd declaration
-void collectReachableRefs(::XRef& xref, const ::Object &obj, Flattener::RefList &refList);
+void collectReachableRefs(::XRef& xref, const ::Object &obj, Flattener::RefList &refList, 
+		RefSet &seen, const ReachableFilter *filter);
 
 /** Helper function to find all references from given dictionary.
  * @param xref XRef table.
  * @param dict Dictionary to be examined.
  * @param refList List of already collected references.
+ * @param seen Set of references from refList.
+ * @param filter Restriction of the traversal (may be NULL).
  * 
  */
-void collectDictRefElems(::XRef &xref, const ::Dict &dict, Flattener::RefList &refList)
+void collectDictRefElems(::XRef &xref, const ::Dict &dict, Flattener::RefList &refList, 
+		RefSet &seen, const ReachableFilter *filter)
 {
 	boost::shared_ptr< ::Object> elem(XPdfObjectFactory::getInstance(), xpdf::object_deleter());
 	for(int i=0; i<dict.getLength(); i++)
 	{
+		if(filter && !filter->followKey(dict.getKey(i)))
+			continue;
 		if(!dict.getValNF(i, elem.get()))
 		{
 			utilsPrintDbg(debug::DBG_ERR, "Unable to get dictionary entry with index "<<i);
 			throw MalformedFormatExeption("bad data stream");
 		}
-		collectReachableRefs(xref, *elem, refList);
+		collectReachableRefs(xref, *elem, refList, seen, filter);
 		elem->free();
 	}
 }
@@ -110,6 +103,8 @@ void collectDictRefElems(::XRef &xref, const ::Dict &dict, Flattener::RefList &r
  * @param xref XRef table.
  * @param obj Object to traverse.
  * @param refList List of alreadt collected references.
+ * @param seen Set of references from refList.
+ * @param filter Restriction of the traversal (may be NULL).
  *
  * Fills the given list with references which are recursively reachable 
  * from the given object.
@@ -117,7 +112,8 @@ void collectDictRefElems(::XRef &xref, const ::Dict &dict, Flattener::RefList &r
  * If you start with the Trailer then you will collect all reachable 
  * objects.
  */
-void collectReachableRefs(XRef& xref, const ::Object &obj, Flattener::RefList &refList)
+void collectReachableRefs(XRef& xref, const ::Object &obj, Flattener::RefList &refList, 
+		RefSet &seen, const ReachableFilter *filter)
 {
 	switch(obj.getType())
 	{
@@ -131,7 +127,7 @@ void collectReachableRefs(XRef& xref, const ::Object &obj, Flattener::RefList &r
 					utilsPrintDbg(debug::DBG_ERR, "Unable to get array entry");
 					throw MalformedFormatExeption("bad data stream");
 				}
-				collectReachableRefs(xref, *elem, refList);
+				collectReachableRefs(xref, *elem, refList, seen, filter);
 				elem->free();
 			}
 			break;
@@ -139,20 +135,22 @@ void collectReachableRefs(XRef& xref, const ::Object &obj, Flattener::RefList &r
 		case objDict:
 		{
 			const Dict *dict = obj.getDict();
-			collectDictRefElems(xref, *dict, refList);
+			collectDictRefElems(xref, *dict, refList, seen, filter);
 			break;
 		}
 		case objStream:
 		{
 			const Dict *streamDict = obj.streamGetDict();
-			collectDictRefElems(xref, *streamDict, refList);
+			collectDictRefElems(xref, *streamDict, refList, seen, filter);
 			break;
 		}
 		case objRef:
 		{
 			::Ref ref = obj.getRef();
+			if(filter && !filter->followRef(ref))
+				return;
 			// check for already seen referencies and skip them
-			if (containsRef(refList, ref))
+			if (!seen.insert(std::make_pair(IndiRef(ref), true)).second)
 				return;
 			// TODO should be sorted by offset to keep the same
 			// ordering in the file as the original document
@@ -164,7 +162,7 @@ void collectReachableRefs(XRef& xref, const ::Object &obj, Flattener::RefList &r
 						<<xref.getErrorCode());
 				throw MalformedFormatExeption("bad data stream");
 			}
-			collectReachableRefs(xref, *target, refList);
+			collectReachableRefs(xref, *target, refList, seen, filter);
 			break;
 		}
 		default:
@@ -174,6 +172,12 @@ void collectReachableRefs(XRef& xref, const ::Object &obj, Flattener::RefList &r
 }
 } // annonymous namespace
 
+void Flattener::collectReachableRefs(const ::Object &obj, RefList &refList, RefSet &seen, 
+		const ReachableFilter * filter)
+{
+	::collectReachableRefs(*this, obj, refList, seen, filter);
+}
+
 void Flattener::initReachableObjects()
 {
 	utilsPrintDbg(debug::DBG_DBG, "Creating a list of the reachable objects");
@@ -183,9 +187,34 @@ void Flattener::initReachableObjects()
 	// to the reachAbleRefs - this should provide complete list of all objects
 	// required for document
 	const Object *trailer = getTrailerDict();
-	collectReachableRefs(*this, *trailer, reachAbleRefs);
+	RefSet seen;
+	collectReachableRefs(*trailer, reachAbleRefs, seen);
 	utilsPrintDbg(debug::DBG_INFO, reachAbleRefs.size()<<" indirect objects collected");
 	lastIndex=0;
+
+	deduplicator.clear();
+	if(!deduplicate)
+		return;
+
+	// objects referenced from the trailer have to keep their numbers
+	RefList pinned;
+	boost::shared_ptr< ::Object> elem(XPdfObjectFactory::getInstance(), xpdf::object_deleter());
+	for(int i=0; i<trailer->dictGetLength(); i++)
+	{
+		trailer->dictGetValNF(i, elem.get());
+		if(elem->isRef())
+			pinned.push_back(elem->getRef());
+		elem->free();
+	}
+	deduplicator.init(*this, reachAbleRefs, pinned);
+	if(!deduplicator.getDuplicateCount())
+		return;
+	RefList uniqueRefs;
+	for(RefList::const_iterator i=reachAbleRefs.begin(); i!=reachAbleRefs.end(); ++i)
+		if(!deduplicator.isDuplicate(*i))
+			uniqueRefs.push_back(*i);
+	reachAbleRefs.swap(uniqueRefs);
+	utilsPrintDbg(debug::DBG_INFO, deduplicator.getDuplicateCount()<<" duplicate objects merged");
 }
 
 int Flattener::flatten(const char * fileName)
@@ -206,27 +235,20 @@ int Flattener::fillObjectList(IPdfWriter::ObjectList &objectList, int maxObjectC
 	// free, to the objectList. Skips also Linearized dictionary
 	utilsPrintDbg(debug::DBG_DBG, "Collecting objects starting from "<<lastIndex);
 	objectList.clear();
-	for(; lastIndex < reachAbleRefs.size(); lastIndex++)
+	size_t count = reachAbleRefs.size() - lastIndex;
+	if(maxObjectCount>0 && count>(size_t)maxObjectCount)
+		count = maxObjectCount;
+
+	// objects are parsed at once (concurrently)
+	RefList refs(reachAbleRefs.begin()+lastIndex, reachAbleRefs.begin()+lastIndex+count);
+	CXref::ObjectList objs(count, (::Object *)NULL);
+	parseObjects(refs, objs);
+	for(size_t i=0; i<count; i++)
 	{
-		::Ref ref = reachAbleRefs[lastIndex];
-		// gets object and generation number
-		int num=ref.num, gen=ref.gen;
-
-		// stop if we reach the maximum objects
-		if(maxObjectCount>0 && objectList.size()>=(size_t)maxObjectCount)
-			break;
-
-		::Object * obj=XPdfObjectFactory::getInstance();
-		XRef::fetch(num, gen, obj);
-		if(!isOk())
-		{
-			kernelPrintDbg(debug::DBG_ERR, ref<<" object fetching failed with code="
-					<<errCode);
-			xpdf::freeXpdfObject(obj);
-			throw MalformedFormatExeption("bad data stream");
-		}
-		objectList.push_back(IPdfWriter::ObjectElement(ref, obj));
+		deduplicator.replaceRefs(*objs[i]);
+		objectList.push_back(IPdfWriter::ObjectElement(refs[i], objs[i]));
 	}
+	lastIndex += count;
 	utilsPrintDbg(debug::DBG_DBG, "Returned "<<objectList.size()<<" objects");
 	return objectList.size();
 }
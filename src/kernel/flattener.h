@@ -28,6 +28,7 @@
 #include "kernel/xpdf.h"
 #include "kernel/exceptions.h"
 #include "kernel/pdfwriter.h"
+#include "kernel/objectdeduplicator.h"
 
 namespace pdfobjects 
 {
@@ -58,8 +59,11 @@ namespace utils
  * if (flattener->isEncrypted())
  * 	flattener->setCredentials(ownerPasswd, userPasswd);
  *
+ * // optionally merge objects with the same content
+ * flattener->setDeduplicate(true);
+ *
  * // flatten file content to the file specified by name
- * flattener->delinearize(outputFile);
+ * flattener->flatten(outputFile);
  *
  * ...
  *
@@ -70,9 +74,34 @@ namespace utils
 class Flattener: public PdfDocumentWriter
 {
 public:
-	// TODO maybe some more lookup efficient structure
 	typedef std::vector<Ref> RefList;
 
+	/** Set of already collected references.
+	 * Keeps collecting linear in number of objects.
+	 */
+	typedef IndiRefMap<bool> RefSet;
+
+	/** Restriction of the reachable objects traversal.
+	 * Used by collectReachableRefs to skip some parts of the object graph
+	 * (e.g. to collect only objects used by a single page).
+	 */
+	class ReachableFilter
+	{
+	public:
+		virtual ~ReachableFilter() {}
+
+		/** Checks whether the dictionary entry should be traversed.
+		 * @param key Dictionary key.
+		 */
+		virtual bool followKey(const char * key)const =0;
+
+		/** Checks whether the referenced object should be collected
+		 * (and traversed).
+		 * @param ref Reference to the object.
+		 */
+		virtual bool followRef(const ::Ref & ref)const =0;
+	};
+
 	/** List of all reachable indirect objects.
 	 * Initialized in initReachableObjects.
 	 */
@@ -84,7 +113,15 @@ private:
 	 */
 	size_t lastIndex;
 
-	virtual ~Flattener() {};
+	/** Flag whether duplicate objects should be merged.
+	 * False by default.
+	 */
+	bool deduplicate;
+
+	/** Deduplicator initialized in initReachableObjects if deduplicate is
+	 * set.
+	 */
+	ObjectDeduplicator deduplicator;
 
 	// deallocator for this class
 	friend class FileStreamDataDeleter<Flattener>;
@@ -92,10 +129,29 @@ private:
 protected:
 	Flattener(FileStreamData &streamData, IPdfWriter * writer);
 
+	virtual ~Flattener() {};
+
+	/** Collects all reachable objects from the given one.
+	 * @param obj Object to traverse.
+	 * @param refList List of already collected references.
+	 * @param seen Set of references from refList.
+	 * @param filter Restriction of the traversal (NULL to collect 
+	 * everything).
+	 *
+	 * Fills the given list with references which are recursively reachable 
+	 * from the given object in the depth first order.
+	 * @throw MalformedFormatExeption if an object cannot be fetched.
+	 */
+	void collectReachableRefs(const ::Object &obj, RefList &refList, RefSet &seen, 
+			const ReachableFilter * filter=NULL);
+
 	/** Initializes all reachable objects.
 	 *
 	 * Starts with the Trailer and recursively travels all reachable
 	 * indirect objects which are stored in reachAbleRefs container.
+	 * If deduplication is enabled, objects with the same content as some
+	 * previous one are removed from the container and references to them
+	 * are redirected in fillObjectList.
 	 */
 	void initReachableObjects();
 
@@ -116,6 +172,26 @@ public:
 	 */
 	static boost::shared_ptr<Flattener> getInstance(const char * fileName, IPdfWriter * pdfWriter);
 
+	/** Enables/disables merging of objects with the same content.
+	 * @param dedup True to merge duplicate objects.
+	 *
+	 * When enabled, all reachable objects are compared by their content
+	 * (see ObjectDeduplicator) and only one object of each group of equal
+	 * objects is written. This is usefull for documents merged from
+	 * several sources which contain the same fonts or images many times.
+	 */
+	void setDeduplicate(bool dedup)
+	{
+		deduplicate = dedup;
+	}
+
+	/** Returns number of objects merged by the last flatten.
+	 */
+	size_t getDuplicateCount()const
+	{
+		return deduplicator.getDuplicateCount();
+	}
+
 	/** Flattens this document and puts the result into the given file.
 	 * @param fileName Output file name.
 	 *
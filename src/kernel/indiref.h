@@ -87,6 +87,38 @@ struct IndiRef
 
 
 
+namespace utils {
+
+/**
+ * Indirect referencies comparator.
+ *
+ * Handles comparing of Indirect referencies.
+ */
+class IndComparator
+{
+public:
+	/** Ordering functional operator.
+	 * @param one Indirect reference.
+	 * @param two Indirect reference.
+	 *
+	 * Strict weak ordering comparision of referencies.
+	 * <br>
+	 * Referencies are compared by their fields. First num is compared (it is
+	 * more significant) and if nums are same, gen number is compared.
+	 *
+	 * @return true if one &lt; two or false otherwise.
+	 */
+	bool operator() (const pdfobjects::IndiRef one, const pdfobjects::IndiRef two) const
+	{
+		if (one.num == two.num)
+			return (one.gen < two.gen);
+		else
+			return (one.num < two.num);
+	}
+};
+
+} // namespace utils
+
 /** 
  * Prints reference.
  * Prints given reference according to pdf specification.
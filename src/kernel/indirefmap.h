@@ -0,0 +1,322 @@
+/*
+ * PDFedit - free program for PDF document manipulation.
+ * Copyright (C) 2006-2009  PDFedit team: Michal Hocko,
+ *                                        Jozef Misutka,
+ *                                        Martin Petricek
+ *                   Former team members: Miroslav Jahoda
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (in doc/LICENSE.GPL); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA  02111-1307  USA
+ *
+ * Project is hosted on http://sourceforge.net/projects/pdfedit
+ */
+// vim:tabstop=4:shiftwidth=4:noexpandtab:textwidth=80
+
+#ifndef __INDIREFMAP_H__
+#define __INDIREFMAP_H__
+
+#include "kernel/static.h"
+#include "kernel/indiref.h"
+
+// =============================================================================
+namespace pdfobjects {
+
+/** Associative container with indirect reference keys.
+ *
+ * Provides subset of std::map interface (find, insert, erase, iteration) for
+ * mappings keyed by IndiRef. Elements are stored in open addressing hash
+ * table with linear probing, so that lookups don't need to walk the tree
+ * with IndComparator on each level. This matters for CPdf mappings which
+ * are accessed for each indirect object and which can have hundreds of
+ * thousands of entries.
+ * <br>
+ * Table size is always power of 2 and it is doubled whenever it is more
+ * than half full. Erase uses backward shift so no tombstones are needed.
+ * <br>
+ * Iteration order is unspecified. Any insert invalidates all iterators,
+ * erase invalidates iterators to the erased and following elements.
+ */
+template<typename T>
+class IndiRefMap
+{
+public:
+	typedef IndiRef key_type;
+	typedef T mapped_type;
+	typedef std::pair<IndiRef, T> value_type;
+	typedef size_t size_type;
+
+private:
+	/** Table slot. */
+	struct Slot
+	{
+		value_type value;	/**< Stored element. */
+		bool used;			/**< Flag whether slot holds element. */
+
+		Slot():used(false) {}
+	};
+	typedef std::vector<Slot> SlotTable;
+
+	/** Iterator template for both mutable and constant iterators.
+	 * Skips unused slots.
+	 */
+	template<typename V, typename S>
+	class Iterator
+	{
+		friend class IndiRefMap;
+		S * slot;
+		S * last;
+
+		Iterator(S * s, S * l):slot(s), last(l)
+		{
+			skip();
+		}
+		void skip()
+		{
+			while(slot!=last && !slot->used)
+				++slot;
+		}
+	public:
+		Iterator():slot(NULL), last(NULL) {}
+		/** Conversion from mutable iterator. */
+		template<typename V2, typename S2>
+		Iterator(const Iterator<V2, S2> & other):slot(other.slot), last(other.last) {}
+
+		V & operator*()const
+		{
+			return slot->value;
+		}
+		V * operator->()const
+		{
+			return &slot->value;
+		}
+		Iterator & operator++()
+		{
+			++slot;
+			skip();
+			return *this;
+		}
+		Iterator operator++(int)
+		{
+			Iterator tmp=*this;
+			++*this;
+			return tmp;
+		}
+		bool operator==(const Iterator & other)const
+		{
+			return slot==other.slot;
+		}
+		bool operator!=(const Iterator & other)const
+		{
+			return slot!=other.slot;
+		}
+
+		template<typename V2, typename S2> friend class Iterator;
+	};
+
+public:
+	typedef Iterator<value_type, Slot> iterator;
+	typedef Iterator<const value_type, const Slot> const_iterator;
+
+private:
+	/** Hash table. */
+	SlotTable table;
+
+	/** Number of stored elements. */
+	size_t count;
+
+	/** Number of bits used for slot index (log2 of table size). */
+	unsigned int bits;
+
+	/** Returns home slot index for given reference.
+	 * Uses Fibonacci hashing (multiplicative hash taking the highest bits),
+	 * so that consecutive object numbers are spread over the table.
+	 */
+	size_t slotIndex(const IndiRef & ref)const
+	{
+		unsigned int h=(ref.num ^ (ref.gen << 20)) * 2654435769U;
+		return h >> (32-bits);
+	}
+
+	size_t mask()const
+	{
+		return table.size()-1;
+	}
+
+	/** Finds slot with given key.
+	 * @return slot index or table size if not found.
+	 */
+	size_t lookup(const IndiRef & ref)const
+	{
+		if(!count)
+			return table.size();
+		for(size_t i=slotIndex(ref); table[i].used; i=(i+1)&mask())
+			if(table[i].value.first==ref)
+				return i;
+		return table.size();
+	}
+
+	/** Stores element to the first free slot of its probe sequence.
+	 * Caller has to make sure that the key is not present and there
+	 * is a free slot.
+	 * @return slot index.
+	 */
+	size_t place(const value_type & value)
+	{
+		size_t i=slotIndex(value.first);
+		while(table[i].used)
+			i=(i+1)&mask();
+		table[i].value=value;
+		table[i].used=true;
+		return i;
+	}
+
+	/** Resizes table to 2^newBits slots and rehashes all elements. */
+	void rehash(unsigned int newBits)
+	{
+		SlotTable old(size_t(1) << newBits);
+		old.swap(table);
+		bits=newBits;
+		for(typename SlotTable::iterator i=old.begin(); i!=old.end(); ++i)
+			if(i->used)
+				place(i->value);
+	}
+
+	/** Removes element from given slot and shifts following elements of
+	 * the cluster backwards to keep probe sequences unbroken.
+	 */
+	void eraseSlot(size_t hole)
+	{
+		table[hole]=Slot();
+		for(size_t i=(hole+1)&mask(); table[i].used; i=(i+1)&mask())
+		{
+			size_t home=slotIndex(table[i].value.first);
+			// element stays if its home is cyclically in (hole, i]
+			bool stays=(hole<=i)
+				?(hole<home && home<=i)
+				:(hole<home || home<=i);
+			if(stays)
+				continue;
+			table[hole]=table[i];
+			table[i]=Slot();
+			hole=i;
+		}
+		--count;
+	}
+
+	iterator makeIterator(size_t i)
+	{
+		Slot * first=table.empty()?NULL:&table[0];
+		return iterator(first+i, first+table.size());
+	}
+	const_iterator makeIterator(size_t i)const
+	{
+		const Slot * first=table.empty()?NULL:&table[0];
+		return const_iterator(first+i, first+table.size());
+	}
+
+public:
+	/** Initialization constructor.
+	 * Creates empty mapping without allocated table.
+	 */
+	IndiRefMap():count(0), bits(0) {}
+
+	iterator begin()
+	{
+		return makeIterator(0);
+	}
+	const_iterator begin()const
+	{
+		return makeIterator(0);
+	}
+	iterator end()
+	{
+		return makeIterator(table.size());
+	}
+	const_iterator end()const
+	{
+		return makeIterator(table.size());
+	}
+
+	size_t size()const
+	{
+		return count;
+	}
+	bool empty()const
+	{
+		return !count;
+	}
+
+	/** Finds element with given key.
+	 * @param ref Key.
+	 * @return iterator to the element or end().
+	 */
+	iterator find(const IndiRef & ref)
+	{
+		return makeIterator(lookup(ref));
+	}
+	const_iterator find(const IndiRef & ref)const
+	{
+		return makeIterator(lookup(ref));
+	}
+
+	/** Inserts element if its key is not present yet.
+	 * @param value Element to insert.
+	 * @return pair of iterator to element with value's key and flag whether
+	 * insertion took place.
+	 */
+	std::pair<iterator, bool> insert(const value_type & value)
+	{
+		size_t i=lookup(value.first);
+		if(i!=table.size())
+			return std::make_pair(makeIterator(i), false);
+		if(2*(count+1) > table.size())
+			rehash((bits)?bits+1:4);
+		i=place(value);
+		++count;
+		return std::make_pair(makeIterator(i), true);
+	}
+
+	/** Erases element with given key.
+	 * @param ref Key.
+	 * @return number of erased elements (0 or 1).
+	 */
+	size_t erase(const IndiRef & ref)
+	{
+		size_t i=lookup(ref);
+		if(i==table.size())
+			return 0;
+		eraseSlot(i);
+		return 1;
+	}
+
+	/** Erases element at given position.
+	 * @param pos Valid dereferencable iterator.
+	 */
+	void erase(iterator pos)
+	{
+		eraseSlot(pos.slot-&table[0]);
+	}
+
+	/** Removes all elements and deallocates table. */
+	void clear()
+	{
+		SlotTable().swap(table);
+		count=0;
+		bits=0;
+	}
+};
+
+} // namespace pdfobjects
+
+#endif // __INDIREFMAP_H__
@@ -37,7 +37,8 @@ namespace pdfobjects {
 //
 // Constructor
 //
-IProperty::IProperty (boost::weak_ptr<CPdf> _pdf) : mode(mdUnknown), pdf(_pdf), wantDispatch (true)
+IProperty::IProperty (boost::weak_ptr<CPdf> _pdf) 
+	: mode(mdUnknown), pdf(_pdf), wantDispatch (true), notificationQueued (false)
 {
 	ref.num = ref.gen = 0; 
 }
@@ -46,7 +47,7 @@ IProperty::IProperty (boost::weak_ptr<CPdf> _pdf) : mode(mdUnknown), pdf(_pdf),
 // Constructor
 //
 IProperty::IProperty (boost::weak_ptr<CPdf> _pdf, const IndiRef& rf) 
-	: ref(rf), mode(mdUnknown), pdf(_pdf), wantDispatch (true) {}
+	: ref(rf), mode(mdUnknown), pdf(_pdf), wantDispatch (true), notificationQueued (false) {}
 
 	
 //
@@ -73,7 +74,12 @@ IProperty::clone () const
 //
 void 
 IProperty::setPdf (boost::weak_ptr<CPdf> p)
-	{ pdf = p; }
+{ 
+	// postponed notifications are not delivered if this object leaves pdf
+	if (notificationQueued && p.lock () != pdf.lock ())
+		_cancelNotifications ();
+	pdf = p; 
+}
 
 
 void
@@ -121,6 +127,38 @@ IProperty::dispatchChange () const
 }
 
 
+//
+// Notification
+//
+void
+IProperty::notifyObservers (boost::shared_ptr<IProperty> newValue, boost::shared_ptr<const ObserverContext> context)
+{
+	boost::shared_ptr<CPdf> p;
+	if (observers.size () && (p = pdf.lock ()) && p->isNotificationBatch ())
+	{
+		// observers which can't wait are notified now, others are notified
+		// when the batch ends
+		IPropertyObserverSubject::notifyObservers (newValue, context, false);
+		if (hasActiveObservers (true))
+			p->_queueNotification (*this, newValue, context);
+		return;
+	}
+	IPropertyObserverSubject::notifyObservers (newValue, context);
+}
+
+//
+//
+//
+void
+IProperty::_cancelNotifications ()
+{
+	boost::shared_ptr<CPdf> p = pdf.lock ();
+	if (p)
+		p->_cancelNotifications (*this);
+	notificationQueued = false;
+}
+
+
 //=====================================================================================
 // Output functions
 //=====================================================================================
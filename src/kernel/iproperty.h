@@ -42,6 +42,7 @@ namespace pdfobjects {
 // 
 class CPdf;
 class IProperty;
+class NotificationQueue;
 typedef observer::ObserverHandler<IProperty> IPropertyObserverSubject;
 typedef observer::IObserver<IProperty> IPropertyObserver;
 
@@ -101,6 +102,9 @@ private:
 	PropertyMode	mode;		/**< Mode of this property. */
 	boost::weak_ptr<CPdf> 	pdf;/**< This object belongs to this pdf. */	
 	bool			wantDispatch;/**< If true changes are dispatched. */
+	bool			notificationQueued;/**< If true there are postponed notifications in pdf's queue. */
+
+	friend class NotificationQueue;
 
 	//
 	// Constructors
@@ -276,6 +280,24 @@ public:
 	 */
 	void unlockChange () {assert (false == wantDispatch); wantDispatch = true;}
 
+	//
+	// Notification
+	//
+public:
+	using IPropertyObserverSubject::notifyObservers;
+
+	/**
+	 * Notifies observers about a change.
+	 *
+	 * If pdf of this object has an open notification batch (see
+	 * CPdf::beginNotificationBatch), only observers which can't be deferred
+	 * are notified immediately. Others are notified when the batch ends.
+	 *
+	 * @param newValue Object with new value.
+	 * @param context Context in which the change has been made.
+	 */
+	virtual void notifyObservers (boost::shared_ptr<IProperty> newValue, boost::shared_ptr<const ObserverContext> context);
+
 	/**
 	 * Create xpdf object from this object. This is a factory method because we
 	 * do not know the type of instance of this object.
@@ -284,13 +306,30 @@ public:
 	 */
 	virtual Object* _makeXpdfObject () const = 0;
 
+	/**
+	 * Checks whether children of this object are referenced only by this
+	 * object (recursively). Such children can't be changed without our
+	 * knowledge so they can be shared by clones (copy-on-write).
+	 *
+	 * @return True if no child was given away, false otherwise.
+	 */
+	virtual bool _hasExclusiveChildren () const {return true;}
+
 	/**
 	 * Destructor.
 	 */
 	virtual ~IProperty () {
 		check_observerlist (this->observers);
+		if (notificationQueued)
+			_cancelNotifications ();
 	}
 
+private:
+	/**
+	 * Discards postponed notifications of this object.
+	 */
+	void _cancelNotifications ();
+
 }; /* class IProperty */
 
 
@@ -0,0 +1,853 @@
+/*
+ * PDFedit - free program for PDF document manipulation.
+ * Copyright (C) 2006-2009  PDFedit team: Michal Hocko,
+ *                                        Jozef Misutka,
+ *                                        Martin Petricek
+ *                   Former team members: Miroslav Jahoda
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (in doc/LICENSE.GPL); if not, write to the 
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, 
+ * MA  02111-1307  USA
+ *
+ * Project is hosted on http://sourceforge.net/projects/pdfedit
+ */
+// vim:tabstop=4:shiftwidth=4:noexpandtab:textwidth=80
+#include "kernel/static.h" // WIN32 port - precompiled headers - REMOVE IN FUTURE!
+#include <errno.h>
+#include <algorithm>
+#include "kernel/linearizator.h"
+#include "utils/debug.h"
+#include "kernel/cobject.h"
+#include "kernel/streamwriter.h"
+#include "kernel/factories.h"
+#include "kernel/pdfedit-core-dev.h"
+
+using namespace pdfobjects;
+using namespace utils;
+
+namespace {
+
+/** Inheritable page attributes (see PDF specification 3.6.2). */
+const char * INHERITABLE_ATTRS[] = {"Resources", "MediaBox", "CropBox", "Rotate"};
+
+/** Number of INHERITABLE_ATTRS. */
+const int INHERITABLE_COUNT = 4;
+
+/** Trailer entries which are not copied to the first page trailer. */
+const char * SKIPPED_TRAILER_FIELDS[] = {"Size", "Prev", "XRefStm", "Type", "Index", 
+	"W", "Length", "Filter", "DecodeParms", NULL};
+
+/** Page owner value for objects used by more pages. */
+const size_t SHARED = (size_t)-1;
+
+/** Collects pages from the page tree.
+ * @param xref XRef table.
+ * @param nodeRef Reference of the page tree node.
+ * @param inherited Values of INHERITABLE_ATTRS from ancestors (null if not
+ * present).
+ * @param pageRefs List of pages in the document order.
+ * @param pageDicts Page dictionaries with pushed down attributes.
+ * @param treeRefs All page tree nodes and pages.
+ *
+ * Nodes which were already seen are skipped, so cycles in the page tree are
+ * harmless.
+ * @throw MalformedFormatExeption if a node cannot be fetched.
+ */
+void collectPages(::XRef & xref, const ::Ref & nodeRef, const ::Object * inherited, 
+		Flattener::RefList & pageRefs, IndiRefMap< ::Object *> & pageDicts, 
+		Flattener::RefSet & treeRefs)
+{
+	if(!treeRefs.insert(std::make_pair(IndiRef(nodeRef), true)).second)
+	{
+		utilsPrintDbg(debug::DBG_WARN, "Page tree node "<<nodeRef<<" already seen. Skipping.");
+		return;
+	}
+	::Object * node = XPdfObjectFactory::getInstance();
+	xref.fetch(nodeRef.num, nodeRef.gen, node);
+	if(!xref.isOk())
+	{
+		utilsPrintDbg(debug::DBG_ERR, nodeRef<<" page tree node fetching failed with code="
+				<<xref.getErrorCode());
+		xpdf::freeXpdfObject(node);
+		throw MalformedFormatExeption("bad data stream");
+	}
+	if(!node->isDict())
+	{
+		utilsPrintDbg(debug::DBG_WARN, "Page tree node "<<nodeRef<<" is not a dictionary. Skipping.");
+		xpdf::freeXpdfObject(node);
+		return;
+	}
+
+	::Object type, kids;
+	node->dictLookup("Type", &type);
+	node->dictLookup("Kids", &kids);
+	bool isPage = type.isName("Page") || (!type.isName("Pages") && !kids.isArray());
+	type.free();
+	if(isPage)
+	{
+		kids.free();
+		// adds missing inheritable attributes
+		for(int i=0; i<INHERITABLE_COUNT; i++)
+		{
+			if(inherited[i].isNull() || inherited[i].isNone())
+				continue;
+			::Object value;
+			bool present = !node->dictLookupNF(INHERITABLE_ATTRS[i], &value)->isNull();
+			value.free();
+			if(present)
+				continue;
+			inherited[i].copy(&value);
+			node->dictAdd(copyString(INHERITABLE_ATTRS[i]), &value);
+		}
+		pageRefs.push_back(nodeRef);
+		pageDicts.insert(std::make_pair(IndiRef(nodeRef), node));
+		return;
+	}
+
+	// intermediate node overrides inherited values
+	::Object attrs[INHERITABLE_COUNT];
+	for(int i=0; i<INHERITABLE_COUNT; i++)
+		if(node->dictLookupNF(INHERITABLE_ATTRS[i], &attrs[i])->isNull())
+			inherited[i].copy(&attrs[i]);
+	xpdf::freeXpdfObject(node);
+	if(kids.isArray())
+	{
+		for(int i=0; i<kids.arrayGetLength(); i++)
+		{
+			::Object kid;
+			kids.arrayGetNF(i, &kid);
+			if(kid.isRef())
+				collectPages(xref, kid.getRef(), attrs, pageRefs, pageDicts, treeRefs);
+			else
+				utilsPrintDbg(debug::DBG_WARN, "Page tree node "<<nodeRef<<" contains direct kid. Skipping.");
+			kid.free();
+		}
+	}
+	kids.free();
+	for(int i=0; i<INHERITABLE_COUNT; i++)
+		attrs[i].free();
+}
+
+/** Restricts traversal to objects used by a single page.
+ * Parent entries are not followed as well as other pages, page tree nodes
+ * and the document catalog.
+ */
+class PageFilter: public Flattener::ReachableFilter
+{
+	const Flattener::RefSet & stopRefs;
+public:
+	PageFilter(const Flattener::RefSet & refs):stopRefs(refs) {}
+
+	virtual bool followKey(const char * key)const
+	{
+		return strcmp(key, "Parent")!=0;
+	}
+
+	virtual bool followRef(const ::Ref & ref)const
+	{
+		return stopRefs.find(ref)==stopRefs.end();
+	}
+};
+
+/** Writer of bit fields used by hint tables.
+ * Bits are stored from the most significant one.
+ */
+class BitWriter
+{
+	std::string & data;
+	unsigned int current;
+	int bits;
+public:
+	BitWriter(std::string & d):data(d), current(0), bits(0) {}
+
+	/** Writes value with given number of bits. */
+	void write(size_t value, int nbits)
+	{
+		for(int i=nbits-1; i>=0; i--)
+		{
+			current = (current<<1) | ((value>>i)&1);
+			if(++bits==8)
+			{
+				data += (char)current;
+				current = 0;
+				bits = 0;
+			}
+		}
+	}
+
+	/** Pads the last byte with zeros. */
+	void flush()
+	{
+		if(bits)
+			write(0, 8-bits);
+	}
+};
+
+/** Returns number of bits needed for the given value. */
+int bitsFor(size_t value)
+{
+	int bits = 0;
+	for(; value; value>>=1)
+		bits++;
+	return bits;
+}
+
+/** Page offset hint table entry. */
+struct PageHint
+{
+	/** Number of objects in the page section. */
+	size_t objects;
+	/** Length of the page section. */
+	size_t length;
+	/** Indexes of shared object groups used by the page. */
+	std::vector<size_t> shared;
+};
+
+/** Shared object hint table data. */
+struct SharedHint
+{
+	/** Number of the first object in the shared objects section (0 if
+	 * there is no such object).
+	 */
+	int firstObject;
+	/** Offset of the first object in the shared objects section. */
+	size_t firstOffset;
+	/** Number of groups in the first page section. */
+	size_t firstPageGroups;
+	/** Lengths of all groups (each group contains exactly one object). */
+	std::vector<size_t> lengths;
+};
+
+/** Returns maximal size of the hint stream data.
+ * Each value in hint tables has at most 32 bits.
+ */
+size_t maxHintDataSize(const std::vector<PageHint> & pages, const SharedHint & shared)
+{
+	// table headers and byte padding of each item
+	size_t size = 36 + 24 + 7 + 3;
+	for(size_t i=0; i<pages.size(); i++)
+		size += 4*4 + 4*pages[i].shared.size();
+	size += 4*shared.lengths.size() + (shared.lengths.size()+7)/8;
+	return size;
+}
+
+/** Creates hint stream data (see PDF specification F.4).
+ * @param pages Page offset hint table entries.
+ * @param firstPageOffset Offset of the first page object.
+ * @param shared Shared object hint table data.
+ * @param sharedOffset Offset of the shared object hint table in the
+ * returned data.
+ *
+ * All offsets have to be adjusted as if the hint stream wasn't present.
+ * Objects are not grouped and content streams are not distinguished so 
+ * the whole page is marked as content.
+ */
+std::string createHintData(const std::vector<PageHint> & pages, size_t firstPageOffset, 
+		const SharedHint & shared, size_t & sharedOffset)
+{
+	std::string data;
+	BitWriter writer(data);
+
+	size_t minObjects = pages[0].objects, maxObjects = minObjects;
+	size_t minLength = pages[0].length, maxLength = minLength;
+	size_t maxShared = 0, maxId = 0;
+	for(size_t i=0; i<pages.size(); i++)
+	{
+		minObjects = std::min(minObjects, pages[i].objects);
+		maxObjects = std::max(maxObjects, pages[i].objects);
+		minLength = std::min(minLength, pages[i].length);
+		maxLength = std::max(maxLength, pages[i].length);
+		maxShared = std::max(maxShared, pages[i].shared.size());
+		for(size_t j=0; j<pages[i].shared.size(); j++)
+			maxId = std::max(maxId, pages[i].shared[j]);
+	}
+	int objectsBits = bitsFor(maxObjects-minObjects);
+	int lengthBits = bitsFor(maxLength-minLength);
+	int sharedBits = bitsFor(maxShared);
+	int idBits = bitsFor(maxId);
+
+	// page offset hint table header
+	writer.write(minObjects, 32);
+	writer.write(firstPageOffset, 32);
+	writer.write(objectsBits, 16);
+	writer.write(minLength, 32);
+	writer.write(lengthBits, 16);
+	writer.write(0, 32);
+	writer.write(0, 16);
+	writer.write(minLength, 32);
+	writer.write(lengthBits, 16);
+	writer.write(sharedBits, 16);
+	writer.write(idBits, 16);
+	// numerators are not used so the denominator doesn't matter
+	writer.write(0, 16);
+	writer.write(4, 16);
+
+	// page offset hint table entries - each item for all pages
+	for(size_t i=0; i<pages.size(); i++)
+		writer.write(pages[i].objects-minObjects, objectsBits);
+	writer.flush();
+	for(size_t i=0; i<pages.size(); i++)
+		writer.write(pages[i].length-minLength, lengthBits);
+	writer.flush();
+	for(size_t i=0; i<pages.size(); i++)
+		writer.write(pages[i].shared.size(), sharedBits);
+	writer.flush();
+	for(size_t i=0; i<pages.size(); i++)
+		for(size_t j=0; j<pages[i].shared.size(); j++)
+			writer.write(pages[i].shared[j], idBits);
+	writer.flush();
+	// numerators and content stream offsets have 0 bits
+	for(size_t i=0; i<pages.size(); i++)
+		writer.write(pages[i].length-minLength, lengthBits);
+	writer.flush();
+
+	// shared object hint table
+	sharedOffset = data.size();
+	const std::vector<size_t> & lengths = shared.lengths;
+	size_t minGroup = lengths[0], maxGroup = minGroup;
+	for(size_t i=0; i<lengths.size(); i++)
+	{
+		minGroup = std::min(minGroup, lengths[i]);
+		maxGroup = std::max(maxGroup, lengths[i]);
+	}
+	int groupBits = bitsFor(maxGroup-minGroup);
+	writer.write(shared.firstObject, 32);
+	writer.write(shared.firstOffset, 32);
+	writer.write(shared.firstPageGroups, 32);
+	writer.write(lengths.size(), 32);
+	writer.write(0, 16);
+	writer.write(minGroup, 32);
+	writer.write(groupBits, 16);
+	for(size_t i=0; i<lengths.size(); i++)
+		writer.write(lengths[i]-minGroup, groupBits);
+	writer.flush();
+	// no signatures and group sizes have 0 bits
+	for(size_t i=0; i<lengths.size(); i++)
+		writer.write(0, 1);
+	writer.flush();
+
+	return data;
+}
+
+/** Formats linearization dictionary.
+ * Variable values have fixed width so that the dictionary can be rewritten
+ * when they are known.
+ */
+std::string formatLinearizationDict(int num, size_t fileLength, size_t hintOffset, size_t hintLength, 
+		int firstPageNum, size_t firstPageEnd, size_t pageCount, size_t mainXRefEntry)
+{
+	char buffer[256];
+	sprintf(buffer, "%d 0 obj\n<< /Linearized 1 /L %10u /H [ %10u %10u ] /O %d /E %10u /N %u /T %10u >>\nendobj", 
+			num, (unsigned)fileLength, (unsigned)hintOffset, (unsigned)hintLength, 
+			firstPageNum, (unsigned)firstPageEnd, (unsigned)pageCount, (unsigned)mainXRefEntry);
+	return buffer;
+}
+
+/** Formats hint stream object header. */
+std::string formatHintHeader(int num, size_t length, size_t sharedOffset)
+{
+	char buffer[128];
+	sprintf(buffer, "%d 0 obj\n<< /Length %10u /S %10u >>\nstream\n", 
+			num, (unsigned)length, (unsigned)sharedOffset);
+	return buffer;
+}
+
+/** Hint stream object footer. */
+const char * HINT_FOOTER = "\nendstream\nendobj";
+
+/** Formats the first page trailer.
+ * @param dict String representation of the trailer dictionary.
+ * @param prev Offset of the main cross reference table.
+ *
+ * Prev entry has fixed width so that the trailer can be rewritten when
+ * the offset is known. The first page trailer doesn't point to any cross
+ * reference table by startxref.
+ */
+std::string formatFirstPageTrailer(const std::string & dict, size_t prev)
+{
+	char buffer[32];
+	sprintf(buffer, "<< /Prev %10u", (unsigned)prev);
+	std::string trailer = TRAILER_KEYWORD;
+	trailer += "\n";
+	trailer += buffer;
+	trailer += dict.substr(2);
+	trailer += "\n";
+	trailer += STARTXREF_KEYWORD;
+	trailer += "\n0\n";
+	trailer += EOFMARKER;
+	return trailer;
+}
+
+/** Formats cross reference table section.
+ * @param first Number of the first object.
+ * @param offsets Offsets of objects.
+ * @param freeHead Flag whether the section starts with free entry for the
+ * object 0 (which is not in offsets).
+ */
+std::string formatXRef(int first, const std::vector<size_t> & offsets, bool freeHead)
+{
+	char buffer[32];
+	sprintf(buffer, "\n%d %u\n", first, (unsigned)(offsets.size()+freeHead));
+	std::string xref = XREF_KEYWORD;
+	xref += buffer;
+	if(freeHead)
+		xref += "0000000000 65535 f \n";
+	for(size_t i=0; i<offsets.size(); i++)
+	{
+		sprintf(buffer, "%010u 00000 n \n", (unsigned)offsets[i]);
+		xref += buffer;
+	}
+	return xref;
+}
+
+/** Writes indirect object by the IPdfWriter.
+ * @param writer Pdf content writer.
+ * @param stream Output stream.
+ * @param obj Object to write (deallocated by this function).
+ * @param num Object number.
+ * @return Offset of the object.
+ */
+size_t writeIndirect(IPdfWriter & writer, StreamWriter & stream, ::Object * obj, int num)
+{
+	size_t pos = stream.getPos();
+	::Ref ref;
+	ref.num = num;
+	ref.gen = 0;
+	IPdfWriter::ObjectList objectList;
+	objectList.push_back(IPdfWriter::ObjectElement(ref, obj));
+	try
+	{
+		writer.writeContent(objectList, stream);
+	}catch(...)
+	{
+		xpdf::freeXpdfObject(obj);
+		throw;
+	}
+	xpdf::freeXpdfObject(obj);
+	return pos;
+}
+
+/** Puts given data to the stream at given position.
+ * Data are terminated by new line.
+ */
+void rewrite(StreamWriter & stream, size_t pos, const std::string & data)
+{
+	stream.setPos(pos);
+	stream.putLine(data.c_str(), data.size());
+}
+
+} // annonymous namespace
+
+Linearizator::Linearizator(FileStreamData &streamData, IPdfWriter * writer)
+	:Flattener(streamData, writer)
+{
+}
+
+Linearizator::~Linearizator()
+{
+	clearPages();
+}
+
+boost::shared_ptr<Linearizator> Linearizator::getInstance(const char * fileName, IPdfWriter * pdfWriter)
+{
+	utilsPrintDbg(debug::DBG_DBG, "fileName="<<fileName);
+	FILE * file=fopen(fileName, "rb");
+	if(!file)
+	{
+		int err=errno;
+		utilsPrintDbg(debug::DBG_ERR, "Unable to open file. Error message="<<strerror(err));
+		return boost::shared_ptr<Linearizator>();
+	}
+	return getInstance(file, pdfWriter);
+}
+
+boost::shared_ptr<Linearizator> Linearizator::getInstance(FILE * file, IPdfWriter * pdfWriter)
+{
+	// creates instance
+	Linearizator * instance;
+	Object dict;
+	FileStreamData streamData;
+	streamData.stream = new FileStreamWriter(file, 0, false, 0, &dict);
+	streamData.file = file;
+	try
+	{
+		instance=new Linearizator(streamData, pdfWriter);
+	}catch(std::exception & e)
+	{
+		// exception thrown from CXref which has already deallocated the
+		// stream so only file handle has to be closed
+		utilsPrintDbg(debug::DBG_ERR, "Unable to create Linearizator instance. Error message="<<e.what());
+		fclose(streamData.file);
+		throw;
+	}
+
+	return boost::shared_ptr<Linearizator>(instance, 
+			FileStreamDataDeleter<Linearizator>(streamData));
+}
+
+void Linearizator::initPages(const ::Ref & catalogRef)
+{
+	clearPages();
+	::Object catalog, pages;
+	XRef::fetch(catalogRef.num, catalogRef.gen, &catalog);
+	if(!isOk() || !catalog.isDict())
+	{
+		utilsPrintDbg(debug::DBG_ERR, "Unable to fetch document catalog "<<catalogRef);
+		catalog.free();
+		throw MalformedFormatExeption("bad data stream");
+	}
+	catalog.dictLookupNF("Pages", &pages);
+	catalog.free();
+	if(pages.isRef())
+	{
+		::Object inherited[INHERITABLE_COUNT];
+		for(int i=0; i<INHERITABLE_COUNT; i++)
+			inherited[i].initNull();
+		collectPages(*this, pages.getRef(), inherited, pageRefs, pageDicts, pageTreeRefs);
+	}else
+		utilsPrintDbg(debug::DBG_ERR, "Document catalog doesn't refer page tree");
+	pages.free();
+	pageTreeRefs.insert(std::make_pair(IndiRef(catalogRef), true));
+	utilsPrintDbg(debug::DBG_INFO, pageRefs.size()<<" pages collected");
+}
+
+void Linearizator::clearPages()
+{
+	for(RefList::const_iterator i=pageRefs.begin(); i!=pageRefs.end(); ++i)
+	{
+		IndiRefMap< ::Object *>::iterator page = pageDicts.find(*i);
+		if(page!=pageDicts.end())
+			xpdf::freeXpdfObject(page->second);
+	}
+	pageRefs.clear();
+	pageDicts.clear();
+	pageTreeRefs.clear();
+}
+
+::Object * Linearizator::fetchObject(const ::Ref & ref)
+{
+	::Object * obj=XPdfObjectFactory::getInstance();
+	IndiRefMap< ::Object *>::const_iterator page = pageDicts.find(ref);
+	if(page!=pageDicts.end())
+	{
+		page->second->copy(obj);
+		return obj;
+	}
+	XRef::fetch(ref.num, ref.gen, obj);
+	if(!isOk())
+	{
+		kernelPrintDbg(debug::DBG_ERR, ref<<" object fetching failed with code="
+				<<errCode);
+		xpdf::freeXpdfObject(obj);
+		throw MalformedFormatExeption("bad data stream");
+	}
+
+	// stream Length is used when stream data are written, so it has to be
+	// direct because references are renumbered before
+	if(obj->isStream())
+	{
+		::Object length;
+		obj->streamGetDict()->lookupNF("Length", &length);
+		if(length.isRef())
+		{
+			::Object value;
+			length.fetch(this, &value);
+			char * key = copyString("Length");
+			::Object * old = obj->getStream()->getBaseStream()->dictUpdate(key, &value);
+			if(old)
+			{
+				// key is not stored if value is replaced
+				gfree(key);
+				xpdf::freeXpdfObject(old);
+			}
+		}
+		length.free();
+	}
+	return obj;
+}
+
+int Linearizator::linearize(const char * fileName)
+{
+	return PdfDocumentWriter::writeDocument(fileName);
+}
+
+int Linearizator::linearize(FILE * file)
+{
+	return writeDocument(file);
+}
+
+int Linearizator::writeDocument(FILE * file)
+{
+using namespace debug;
+
+	utilsPrintDbg(DBG_DBG, "");
+	if(!file)
+	{
+		utilsPrintDbg(DBG_ERR, "Bad file handle");
+		return EINVAL;
+	}
+	if(!pdfWriter)
+	{
+		utilsPrintDbg(DBG_ERR, "No pdfWriter specified. Aborting");
+		return EINVAL;
+	}
+	if(getNeedCredentials())
+	{
+		utilsPrintDbg(DBG_ERR, "No credentials available for encrypted document.");
+		return EPERM;
+	}
+	if(isEncrypted())
+	{
+		utilsPrintDbg(DBG_ERR, "Encrypted documents writing is not implemented");
+		throw NotImplementedException("Encrypted document");
+	}
+
+	const Object * trailer = getTrailerDict();
+	::Object rootRef;
+	trailer->dictLookupNF("Root", &rootRef);
+	if(!rootRef.isRef())
+	{
+		utilsPrintDbg(DBG_ERR, "Trailer doesn't refer document catalog");
+		rootRef.free();
+		throw MalformedFormatExeption("bad data stream");
+	}
+	::Ref catalogRef = rootRef.getRef();
+	rootRef.free();
+
+	// all reachable objects and pages
+	setDeduplicate(false);
+	initReachableObjects();
+	initPages(catalogRef);
+	if(pageRefs.empty())
+	{
+		utilsPrintDbg(DBG_ERR, "Document without pages cannot be linearized");
+		return EINVAL;
+	}
+	size_t pageCount = pageRefs.size();
+
+	// objects used by pages - each page list starts with the page
+	// dictionary
+	std::vector<RefList> pageObjects(pageCount);
+	IndiRefMap<size_t> owners;
+	PageFilter filter(pageTreeRefs);
+	for(size_t i=0; i<pageCount; i++)
+	{
+		RefList & objects = pageObjects[i];
+		RefSet seen;
+		objects.push_back(pageRefs[i]);
+		seen.insert(std::make_pair(IndiRef(pageRefs[i]), true));
+		collectReachableRefs(*pageDicts.find(pageRefs[i])->second, objects, seen, &filter);
+		for(RefList::const_iterator j=objects.begin(); j!=objects.end(); ++j)
+		{
+			std::pair<IndiRefMap<size_t>::iterator, bool> owner = 
+				owners.insert(std::make_pair(IndiRef(*j), i));
+			if(!owner.second && owner.first->second!=i)
+				owner.first->second = SHARED;
+		}
+	}
+
+	// splits objects to sections - first page section is pageObjects[0]
+	// and all other sections are in mainObjects
+	const RefList & firstPageObjects = pageObjects[0];
+	RefList mainObjects;
+	RefSet placed;
+	placed.insert(std::make_pair(IndiRef(catalogRef), true));
+	for(RefList::const_iterator i=firstPageObjects.begin(); i!=firstPageObjects.end(); ++i)
+		placed.insert(std::make_pair(IndiRef(*i), true));
+	std::vector<size_t> pageStarts(pageCount, 0);
+	for(size_t i=1; i<pageCount; i++)
+	{
+		pageStarts[i] = mainObjects.size();
+		for(RefList::const_iterator j=pageObjects[i].begin(); j!=pageObjects[i].end(); ++j)
+			if(owners.find(*j)->second==i)
+			{
+				placed.insert(std::make_pair(IndiRef(*j), true));
+				mainObjects.push_back(*j);
+			}
+	}
+	size_t sharedStart = mainObjects.size();
+	for(size_t i=1; i<pageCount; i++)
+		for(RefList::const_iterator j=pageObjects[i].begin(); j!=pageObjects[i].end(); ++j)
+			if(owners.find(*j)->second==SHARED && placed.insert(std::make_pair(IndiRef(*j), true)).second)
+				mainObjects.push_back(*j);
+	size_t otherStart = mainObjects.size();
+	for(RefList::const_iterator i=reachAbleRefs.begin(); i!=reachAbleRefs.end(); ++i)
+		if(placed.insert(std::make_pair(IndiRef(*i), true)).second)
+			mainObjects.push_back(*i);
+	utilsPrintDbg(DBG_INFO, firstPageObjects.size()<<" first page objects, "
+			<<sharedStart<<" other pages objects, "<<otherStart-sharedStart
+			<<" shared objects and "<<mainObjects.size()-otherStart<<" other objects");
+
+	// renumbers objects - main section objects from 1 and the first page 
+	// section starts with the linearization dictionary, catalog and hint 
+	// stream
+	int firstNum = mainObjects.size()+1;
+	int linearizedNum = firstNum, catalogNum = firstNum+1, hintNum = firstNum+2;
+	int firstPageNum = firstNum+3;
+	int size = firstPageNum+firstPageObjects.size();
+	RefReplacements numbers;
+	for(size_t i=0; i<mainObjects.size(); i++)
+		numbers.insert(std::make_pair(IndiRef(mainObjects[i]), IndiRef(i+1, 0)));
+	numbers.insert(std::make_pair(IndiRef(catalogRef), IndiRef(catalogNum, 0)));
+	for(size_t i=0; i<firstPageObjects.size(); i++)
+		numbers.insert(std::make_pair(IndiRef(firstPageObjects[i]), IndiRef(firstPageNum+i, 0)));
+
+	// first page trailer with fixed width Prev
+	::Object firstTrailer;
+	firstTrailer.initDict(this);
+	for(int i=0; i<trailer->dictGetLength(); i++)
+	{
+		const char * key = trailer->dictGetKey(i);
+		bool skip = false;
+		for(int j=0; SKIPPED_TRAILER_FIELDS[j] && !skip; j++)
+			skip = !strcmp(key, SKIPPED_TRAILER_FIELDS[j]);
+		if(skip)
+			continue;
+		::Object value;
+		trailer->dictGetValNF(i, &value);
+		replaceRefs(value, numbers, this);
+		firstTrailer.dictAdd(copyString(key), &value);
+	}
+	::Object sizeObj;
+	sizeObj.initInt(size);
+	firstTrailer.dictAdd(copyString("Size"), &sizeObj);
+	std::string trailerDict;
+	{
+		boost::scoped_ptr<IProperty> trailerProp(createObjFromXpdfObj(firstTrailer));
+		trailerProp->getStringRepresentation(trailerDict);
+	}
+	firstTrailer.free();
+	assert(trailerDict.compare(0, 2, "<<")==0);
+
+	// creates outputStream writer from given file
+	Object dict;
+	boost::shared_ptr<StreamWriter> outputStream(
+			new FileStreamWriter(file, 0, false, 0, &dict));
+	StreamWriter & out = *outputStream;
+	pdfWriter->writeHeader(getPDFVersion(), out);
+
+	// reserves linearization dictionary and first page xref
+	size_t linearizedPos = out.getPos();
+	std::string linearizedDict = formatLinearizationDict(linearizedNum, 0, 0, 0, 
+			firstPageNum, 0, pageCount, 0);
+	out.putLine(linearizedDict.c_str(), linearizedDict.size());
+	size_t firstXRefPos = out.getPos();
+	std::vector<size_t> firstOffsets(size-firstNum, 0);
+	std::string firstXRef = formatXRef(firstNum, firstOffsets, false)
+		+formatFirstPageTrailer(trailerDict, 0);
+	out.putLine(firstXRef.c_str(), firstXRef.size());
+
+	// catalog and reserved hint stream
+	firstOffsets[0] = linearizedPos;
+	::Object * catalog = fetchObject(catalogRef);
+	replaceRefs(*catalog, numbers, this);
+	firstOffsets[1] = writeIndirect(*pdfWriter, out, catalog, catalogNum);
+	size_t hintPos = out.getPos();
+	firstOffsets[2] = hintPos;
+
+	// hint tables entries (page lengths and shared object groups are filled
+	// when objects are written)
+	std::vector<PageHint> pageHints(pageCount);
+	IndiRefMap<size_t> groups;
+	SharedHint sharedHint;
+	sharedHint.firstPageGroups = firstPageObjects.size();
+	for(size_t i=0; i<firstPageObjects.size(); i++)
+		groups.insert(std::make_pair(IndiRef(firstPageObjects[i]), i));
+	for(size_t i=sharedStart; i<otherStart; i++)
+		groups.insert(std::make_pair(IndiRef(mainObjects[i]), firstPageObjects.size()+i-sharedStart));
+	for(size_t i=0; i<pageCount; i++)
+	{
+		pageHints[i].objects = (i==0)?firstPageObjects.size()
+			:((i+1<pageCount)?pageStarts[i+1]:sharedStart)-pageStarts[i];
+		for(RefList::const_iterator j=pageObjects[i].begin(); j!=pageObjects[i].end(); ++j)
+			if(owners.find(*j)->second==SHARED)
+				pageHints[i].shared.push_back(groups.find(*j)->second);
+	}
+	sharedHint.lengths.resize(firstPageObjects.size()+otherStart-sharedStart);
+	std::string hintHeader = formatHintHeader(hintNum, 0, 0);
+	size_t hintLength = hintHeader.size()+maxHintDataSize(pageHints, sharedHint)+strlen(HINT_FOOTER)+1;
+	out.putLine(std::string(hintLength-1, ' ').c_str(), hintLength-1);
+
+	// first page section
+	for(size_t i=0; i<firstPageObjects.size(); i++)
+	{
+		::Object * obj = fetchObject(firstPageObjects[i]);
+		replaceRefs(*obj, numbers, this);
+		firstOffsets[i+3] = writeIndirect(*pdfWriter, out, obj, firstPageNum+i);
+	}
+	size_t firstPageEnd = out.getPos();
+
+	// remaining pages, shared objects and others
+	std::vector<size_t> mainOffsets(mainObjects.size());
+	for(size_t i=0; i<mainObjects.size(); i++)
+	{
+		::Object * obj = fetchObject(mainObjects[i]);
+		replaceRefs(*obj, numbers, this);
+		mainOffsets[i] = writeIndirect(*pdfWriter, out, obj, i+1);
+	}
+	pdfWriter->reset();
+
+	// main xref and trailer
+	size_t mainXRefPos = out.getPos();
+	std::string mainXRef = formatXRef(0, mainOffsets, true);
+	// new line in front of the first entry (after subsection header)
+	size_t mainXRefEntry = mainXRefPos+mainXRef.find('\n', strlen(XREF_KEYWORD)+1);
+	char buffer[64];
+	sprintf(buffer, "<< /Size %d >>\n%s\n%u\n", firstNum, STARTXREF_KEYWORD, (unsigned)firstXRefPos);
+	mainXRef += std::string(TRAILER_KEYWORD)+"\n"+buffer+EOFMARKER;
+	out.putLine(mainXRef.c_str(), mainXRef.size());
+	size_t fileLength = out.getPos();
+	out.setPos(0, -1);
+	if((size_t)out.getPos()>fileLength)
+		out.trim(fileLength);
+
+	// hint stream with offsets adjusted as if it wasn't present
+	for(size_t i=0; i<pageCount; i++)
+	{
+		size_t start = (i==0)?firstOffsets[3]:mainOffsets[pageStarts[i]];
+		size_t end = firstPageEnd;
+		if(i>0)
+		{
+			size_t next = (i+1<pageCount)?pageStarts[i+1]:sharedStart;
+			end = (next<mainObjects.size())?mainOffsets[next]:mainXRefPos;
+		}
+		pageHints[i].length = end-start;
+	}
+	for(size_t i=0; i<firstPageObjects.size(); i++)
+		sharedHint.lengths[i] = ((i+1<firstPageObjects.size())?firstOffsets[i+4]:firstPageEnd)
+			-firstOffsets[i+3];
+	for(size_t i=sharedStart; i<otherStart; i++)
+		sharedHint.lengths[firstPageObjects.size()+i-sharedStart] = 
+			((i+1<mainObjects.size())?mainOffsets[i+1]:mainXRefPos)-mainOffsets[i];
+	sharedHint.firstObject = (sharedStart<otherStart)?sharedStart+1:0;
+	sharedHint.firstOffset = (sharedStart<otherStart)?mainOffsets[sharedStart]-hintLength:0;
+	size_t sharedOffset;
+	std::string hintData = createHintData(pageHints, firstOffsets[3]-hintLength, 
+			sharedHint, sharedOffset);
+	std::string hint = formatHintHeader(hintNum, hintData.size(), sharedOffset)+hintData+HINT_FOOTER;
+	assert(hint.size()<hintLength);
+	hint.append(hintLength-1-hint.size(), ' ');
+	rewrite(out, hintPos, hint);
+
+	// linearization dictionary and first page xref
+	linearizedDict = formatLinearizationDict(linearizedNum, fileLength, hintPos, hintLength, 
+			firstPageNum, firstPageEnd, pageCount, mainXRefEntry);
+	rewrite(out, linearizedPos, linearizedDict);
+	firstXRef = formatXRef(firstNum, firstOffsets, false)
+		+formatFirstPageTrailer(trailerDict, mainXRefPos);
+	rewrite(out, firstXRefPos, firstXRef);
+	outputStream->flush();
+	clearPages();
+
+	return 0;
+}
@@ -0,0 +1,183 @@
+/*
+ * PDFedit - free program for PDF document manipulation.
+ * Copyright (C) 2006-2009  PDFedit team: Michal Hocko,
+ *                                        Jozef Misutka,
+ *                                        Martin Petricek
+ *                   Former team members: Miroslav Jahoda
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (in doc/LICENSE.GPL); if not, write to the 
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, 
+ * MA  02111-1307  USA
+ *
+ * Project is hosted on http://sourceforge.net/projects/pdfedit
+ */
+// vim:tabstop=4:shiftwidth=4:noexpandtab:textwidth=80
+#ifndef _LINEARIZATOR_H_
+#define _LINEARIZATOR_H_
+
+#include "kernel/flattener.h"
+
+namespace pdfobjects 
+{
+namespace utils
+{
+
+/** Linearizator class.
+ * Writes a new linearized (also known as "fast web view" - see PDF 
+ * specification Appendix F) PDF document with all reachable objects from 
+ * the original document. This is the counterpart of the Delinearizator.
+ * <br>
+ * Output document contains objects in the following order:
+ * <ul>
+ * <li>linearization dictionary
+ * <li>first page cross reference table and trailer
+ * <li>document catalog
+ * <li>primary hint stream (page offset and shared objects hint tables)
+ * <li>all objects used by the first page (first page section)
+ * <li>objects used only by the particular page for all remaining pages
+ * <li>objects shared by more pages
+ * <li>all other objects
+ * <li>main cross reference table and trailer
+ * </ul>
+ * Objects are renumbered so that the first page section objects have the
+ * highest numbers and both cross reference tables are continuous. Inheritable
+ * page attributes are pushed down to the page dictionaries so that each page
+ * is complete without the page tree.
+ * <br>
+ * Objects used by a page are collected by the same reachable objects
+ * traversal as Flattener uses. Traversal starts in the page dictionary and
+ * doesn't follow Parent entries and other pages.
+ * <br>
+ * Note that objects deduplication (setDeduplicate) is not used for
+ * linearized output.
+ * <p>
+ * <b>Usage</b>
+ * <pre>
+ * IPdfWriter * contentWriter=new OldStylePdfWriter();
+ * boost::shared_ptr<Linearizator> linearizator = Linearizator::getInstance(fileName, contentWriter);
+ *
+ * // check for encryption and set credentials if necessary
+ * if (linearizator->isEncrypted())
+ * 	linearizator->setCredentials(ownerPasswd, userPasswd);
+ *
+ * linearizator->linearize(outputFile);
+ * </pre>
+ * Given IPdfWriter is used only for header and indirect objects writing.
+ * Cross reference tables are written by this class because of their special
+ * layout.
+ */
+class Linearizator: public Flattener
+{
+	/** Pages in the document order. */
+	RefList pageRefs;
+
+	/** Page dictionaries (for pageRefs) with pushed down inheritable 
+	 * attributes.
+	 */
+	IndiRefMap< ::Object *> pageDicts;
+
+	/** Page tree nodes, pages and document catalog.
+	 * Traversal of the objects used by pages stops on these objects.
+	 */
+	RefSet pageTreeRefs;
+
+	// deallocator for this class
+	friend class FileStreamDataDeleter<Linearizator>;
+
+	/** Initializes pageRefs, pageDicts and pageTreeRefs.
+	 * @param catalogRef Reference of the document catalog.
+	 * @throw MalformedFormatExeption if the page tree cannot be fetched.
+	 */
+	void initPages(const ::Ref & catalogRef);
+
+	/** Discards data collected by initPages.
+	 */
+	void clearPages();
+
+	/** Fetches object for writing.
+	 * @param ref Original reference of the object.
+	 *
+	 * Pages are provided with pushed down attributes.
+	 * @return Object allocated by XPdfObjectFactory.
+	 * @throw MalformedFormatExeption if the object cannot be fetched.
+	 */
+	::Object * fetchObject(const ::Ref & ref);
+
+protected:
+	Linearizator(FileStreamData &streamData, IPdfWriter * writer);
+
+	virtual ~Linearizator();
+
+	/** Writes linearized document to the given file.
+	 * @param file File handle where to write.
+	 *
+	 * Collects reachable objects, splits them to the sections described in
+	 * the class documentation, writes them and fills the linearization
+	 * dictionary, the first page cross reference table and hint stream 
+	 * (which are reserved with fixed width numbers) when offsets of all 
+	 * objects are known.
+	 * <br>
+	 * Caller is responsible for file handle closing.
+	 *
+	 * @return 0 on success, errno otherwise (EINVAL also if document has no
+	 * pages).
+	 * @throw NotImplementedException if document is encrypted.
+	 * @throw MalformedFormatExeption if the input file is currupted.
+	 */
+	virtual int writeDocument(FILE * file);
+public:
+	/** Factory method.
+	 * @param fileName Input PDF document.
+	 * @param pdfWriter PDF Writer to be used for content writing.
+	 * @throw MalformedFormatExeption if file content is not valid pdf document.
+	 * @return Instance ready to be used or NULL if file cannot be opened.
+	 */
+	static boost::shared_ptr<Linearizator> getInstance(const char * fileName, IPdfWriter * pdfWriter);
+
+	/** Factory method.
+	 * @param file Input PDF document opened for reading.
+	 * @param pdfWriter PDF Writer to be used for content writing.
+	 *
+	 * Given file handle is closed when the instance is destroyed (also if
+	 * the instance cannot be created).
+	 * @throw MalformedFormatExeption if file content is not valid pdf document.
+	 * @return Instance ready to be used.
+	 */
+	static boost::shared_ptr<Linearizator> getInstance(FILE * file, IPdfWriter * pdfWriter);
+
+	/** Linearizes this document and puts the result into the given file.
+	 * @param fileName Output file name.
+	 *
+	 * Delegates to PdfDocumentWriter::writeDocument(const char*).
+	 *
+	 * @return 0 on success, errno otherwise.
+	 * @throw NotImplementedException if document is encrypted.
+	 * @throw MalformedFormatExeption if the input file is currupted.
+	 */
+	int linearize(const char * fileName);
+
+	/** Linearizes this document and puts the result into the given file.
+	 * @param file File handle where to put data.
+	 *
+	 * Delegates to writeDocument(FILE*).
+	 * @return 0 on success, errno otherwise.
+	 * @throw NotImplementedException if document is encrypted.
+	 * @throw MalformedFormatExeption if the input file is currupted.
+	 */
+	int linearize(FILE * file);
+};
+
+} // namespace utils
+} // namespace pdfobjects
+
+#endif
@@ -0,0 +1,374 @@
+/*
+ * PDFedit - free program for PDF document manipulation.
+ * Copyright (C) 2006-2009  PDFedit team: Michal Hocko,
+ *                                        Jozef Misutka,
+ *                                        Martin Petricek
+ *                   Former team members: Miroslav Jahoda
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (in doc/LICENSE.GPL); if not, write to the 
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, 
+ * MA  02111-1307  USA
+ *
+ * Project is hosted on http://sourceforge.net/projects/pdfedit
+ */
+// vim:tabstop=4:shiftwidth=4:noexpandtab:textwidth=80
+#include "kernel/static.h"
+#include "kernel/metrics.h"
+
+#include <algorithm>
+#include <cstdlib>
+#ifndef WIN32
+#  include <pthread.h>
+#  include <signal.h>
+#  include <sys/time.h>
+#endif
+#include <goo/GMutex.h>
+
+namespace pdfobjects {
+namespace metrics {
+
+using namespace std;
+
+bool enabled=false;
+
+namespace {
+
+/** Returns list of all counters. */
+vector<Counter *> & getCounters()
+{
+	static vector<Counter *> counters;
+	return counters;
+}
+
+/** Returns list of all histograms. */
+vector<Histogram *> & getHistograms()
+{
+	static vector<Histogram *> histograms;
+	return histograms;
+}
+
+/** Writes duration in microseconds as seconds.
+ */
+void writeSeconds(ostream & out, unsigned long microseconds)
+{
+	out << microseconds/1000000 << "." 
+		<< setw(6) << setfill('0') << microseconds%1000000 << setfill(' ');
+}
+
+void dumpJson(ostream & out)
+{
+	out << "{\n\t\"counters\": {";
+	vector<Counter *> & counters=getCounters();
+	for(size_t i=0; i<counters.size(); ++i)
+	{
+		out << ((i)?",":"") << "\n\t\t\"" << counters[i]->getName() << "\": " 
+			<< counters[i]->getValue();
+	}
+	out << "\n\t},\n\t\"histograms\": {";
+	vector<Histogram *> & histograms=getHistograms();
+	for(size_t i=0; i<histograms.size(); ++i)
+	{
+		const Histogram & h=*histograms[i];
+		out << ((i)?",":"") << "\n\t\t\"" << h.getName() << "\": {"
+			<< "\"count\": " << h.getCount() << ", \"sum\": ";
+		writeSeconds(out, h.getSum());
+		out << ", \"buckets\": {";
+		unsigned long cumulative=0;
+		for(size_t j=0; j<Histogram::BOUNDS; ++j)
+		{
+			cumulative+=h.getBucket(j);
+			out << "\"";
+			writeSeconds(out, Histogram::bounds[j]);
+			out << "\": " << cumulative << ", ";
+		}
+		cumulative+=h.getBucket(Histogram::BOUNDS);
+		out << "\"+Inf\": " << cumulative << "}}";
+	}
+	out << "\n\t}\n}" << endl;
+}
+
+void dumpPrometheus(ostream & out)
+{
+	vector<Counter *> & counters=getCounters();
+	for(size_t i=0; i<counters.size(); ++i)
+	{
+		string name=string("pdfedit_")+counters[i]->getName()+"_total";
+		out << "# HELP " << name << " " << counters[i]->getHelp() << "\n"
+			<< "# TYPE " << name << " counter\n"
+			<< name << " " << counters[i]->getValue() << "\n";
+	}
+	vector<Histogram *> & histograms=getHistograms();
+	for(size_t i=0; i<histograms.size(); ++i)
+	{
+		const Histogram & h=*histograms[i];
+		string name=string("pdfedit_")+h.getName()+"_seconds";
+		out << "# HELP " << name << " " << h.getHelp() << "\n"
+			<< "# TYPE " << name << " histogram\n";
+		unsigned long cumulative=0;
+		for(size_t j=0; j<Histogram::BOUNDS; ++j)
+		{
+			cumulative+=h.getBucket(j);
+			out << name << "_bucket{le=\"";
+			writeSeconds(out, Histogram::bounds[j]);
+			out << "\"} " << cumulative << "\n";
+		}
+		cumulative+=h.getBucket(Histogram::BOUNDS);
+		out << name << "_bucket{le=\"+Inf\"} " << cumulative << "\n"
+			<< name << "_sum ";
+		writeSeconds(out, h.getSum());
+		out << "\n" << name << "_count " << h.getCount() << "\n";
+	}
+	out.flush();
+}
+
+/** Target of setupDump. */
+struct DumpTarget
+{
+	GMutex mutex;
+	Format format;
+	string fileName;
+	bool initialized;
+
+	DumpTarget():initialized(false)
+	{
+		gInitMutex(&mutex);
+	}
+};
+
+DumpTarget & getDumpTarget()
+{
+	// never destroyed, because it is used from atexit handler
+	static DumpTarget * target=new DumpTarget();
+	return *target;
+}
+
+void dumpToTarget()
+{
+	DumpTarget & target=getDumpTarget();
+	gLockMutex(&target.mutex);
+	if(target.fileName.empty() || target.fileName=="-")
+		dump(cerr, target.format);
+	else
+	{
+		ofstream out(target.fileName.c_str());
+		if(out)
+			dump(out, target.format);
+		else
+			kernelPrintDbg(debug::DBG_ERR, "Unable to open "<<target.fileName<<" for metrics");
+	}
+	gUnlockMutex(&target.mutex);
+}
+
+void dumpAtExit()
+{
+	dumpToTarget();
+}
+
+#ifndef WIN32
+/** Dumps metrics whenever SIGUSR1 is delivered.
+ */
+void * signalThread(void *)
+{
+	sigset_t set;
+	sigemptyset(&set);
+	sigaddset(&set, SIGUSR1);
+	for(;;)
+	{
+		int sig;
+		if(!sigwait(&set, &sig))
+			dumpToTarget();
+	}
+	return NULL;
+}
+#endif
+
+} // end of anonymous namespace for registry and dump helpers
+
+void setEnabled(bool enable)
+{
+	enabled=enable;
+}
+
+Counter::Counter(const char * n, const char * h)
+	:name(n), help(h), value(0)
+{
+	getCounters().push_back(this);
+}
+
+Counter::~Counter()
+{
+	vector<Counter *> & counters=getCounters();
+	counters.erase(std::remove(counters.begin(), counters.end(), this), counters.end());
+}
+
+const unsigned long Histogram::bounds[Histogram::BOUNDS]=
+{
+	1, 2, 5, 10, 20, 50, 100, 200, 500, 
+	1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000, 
+	1000000, 2000000, 5000000, 10000000
+};
+
+Histogram::Histogram(const char * n, const char * h)
+	:name(n), help(h)
+{
+	reset();
+	getHistograms().push_back(this);
+}
+
+Histogram::~Histogram()
+{
+	vector<Histogram *> & histograms=getHistograms();
+	histograms.erase(std::remove(histograms.begin(), histograms.end(), this), histograms.end());
+}
+
+void Histogram::observe(unsigned long microseconds)
+{
+	if(!isEnabled())
+		return;
+	size_t bucket=0;
+	while(bucket<BOUNDS && microseconds>bounds[bucket])
+		++bucket;
+	atomicAdd(buckets[bucket], 1);
+	atomicAdd(count, 1);
+	atomicAdd(sum, microseconds);
+}
+
+void Histogram::reset()
+{
+	for(size_t i=0; i<=BOUNDS; ++i)
+		buckets[i]=0;
+	count=0;
+	sum=0;
+}
+
+void Stopwatch::restart()
+{
+#ifdef WIN32
+	FILETIME ft;
+	GetSystemTimeAsFileTime(&ft);
+	ULARGE_INTEGER t;
+	t.LowPart=ft.dwLowDateTime;
+	t.HighPart=ft.dwHighDateTime;
+	// FILETIME counts 100ns intervals
+	seconds=(unsigned long)(t.QuadPart/10000000);
+	microseconds=(unsigned long)(t.QuadPart/10%1000000);
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	seconds=tv.tv_sec;
+	microseconds=tv.tv_usec;
+#endif
+}
+
+unsigned long Stopwatch::elapsed()const
+{
+	Stopwatch now;
+	// clock may go backwards
+	if(now.seconds<seconds || (now.seconds==seconds && now.microseconds<microseconds))
+		return 0;
+	return (now.seconds-seconds)*1000000+now.microseconds-microseconds;
+}
+
+void dump(std::ostream & out, Format format)
+{
+	switch(format)
+	{
+		case JSON:
+			dumpJson(out);
+			break;
+		case PROMETHEUS:
+			dumpPrometheus(out);
+			break;
+	}
+}
+
+void reset()
+{
+	vector<Counter *> & counters=getCounters();
+	for(size_t i=0; i<counters.size(); ++i)
+		counters[i]->reset();
+	vector<Histogram *> & histograms=getHistograms();
+	for(size_t i=0; i<histograms.size(); ++i)
+		histograms[i]->reset();
+}
+
+bool setupDump(const std::string & format, const std::string & fileName)
+{
+	Format f;
+	if(format=="json")
+		f=JSON;
+	else if(format=="prometheus")
+		f=PROMETHEUS;
+	else
+	{
+		kernelPrintDbg(debug::DBG_ERR, "Unknown metrics format "<<format);
+		return false;
+	}
+
+	DumpTarget & target=getDumpTarget();
+	gLockMutex(&target.mutex);
+	target.format=f;
+	target.fileName=fileName;
+	bool initialized=target.initialized;
+	target.initialized=true;
+	gUnlockMutex(&target.mutex);
+	setEnabled(true);
+	if(initialized)
+		return true;
+
+	atexit(dumpAtExit);
+#ifndef WIN32
+	// signal has to be blocked in all threads to be received by sigwait
+	sigset_t set;
+	sigemptyset(&set);
+	sigaddset(&set, SIGUSR1);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+	pthread_t thread;
+	if(!pthread_create(&thread, NULL, signalThread, NULL))
+		pthread_detach(thread);
+	else
+		kernelPrintDbg(debug::DBG_WARN, "Unable to start metrics signal thread");
+#endif
+	return true;
+}
+
+// kernel metrics
+Histogram xrefFetchTime("xref_fetch", 
+		"Time of object fetching from the cross reference table");
+Histogram bulkFetchTime("xref_bulk_fetch", 
+		"Time of bulk object fetching from the cross reference table");
+Histogram objectStreamDecodeTime("object_stream_decode", 
+		"Time of object stream decoding");
+Counter objectStreamCacheHits("object_stream_cache_hits", 
+		"Compressed objects fetched from already decoded object stream");
+Counter objectStreamCacheMisses("object_stream_cache_misses", 
+		"Compressed objects which required object stream decoding");
+Counter prefetchHits("prefetch_hits", 
+		"Objects fetched from the cross reference table which had been prefetched");
+Counter prefetchMisses("prefetch_misses", 
+		"Objects fetched with prefetching enabled which had not been prefetched");
+Counter prefetchedObjects("prefetched_objects", 
+		"Objects parsed by the background prefetcher");
+Counter indirectCacheHits("indirect_cache_hits", 
+		"Indirect objects served from already instantiated properties");
+Counter indirectCacheMisses("indirect_cache_misses", 
+		"Indirect objects which had to be instantiated");
+Histogram contentStreamParseTime("content_stream_parse", 
+		"Time of content stream parsing");
+Histogram pageRenderTime("page_render", 
+		"Time of page rendering");
+Histogram saveTime("save", 
+		"Time of document saving");
+
+} // namespace metrics
+} // namespace pdfobjects
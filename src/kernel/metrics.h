@@ -0,0 +1,337 @@
+/*
+ * PDFedit - free program for PDF document manipulation.
+ * Copyright (C) 2006-2009  PDFedit team: Michal Hocko,
+ *                                        Jozef Misutka,
+ *                                        Martin Petricek
+ *                   Former team members: Miroslav Jahoda
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (in doc/LICENSE.GPL); if not, write to the 
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, 
+ * MA  02111-1307  USA
+ *
+ * Project is hosted on http://sourceforge.net/projects/pdfedit
+ */
+// vim:tabstop=4:shiftwidth=4:noexpandtab:textwidth=80
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include "kernel/static.h"
+#ifdef WIN32
+#  include <windows.h>
+#endif
+
+// =============================================================================
+namespace pdfobjects {
+namespace metrics {
+
+/** Flag for metrics collection.
+ * Use setEnabled and isEnabled instead.
+ */
+extern bool enabled;
+
+/** Enables or disables collection of all metrics.
+ * @param enable Flag.
+ *
+ * Metrics are disabled by default and then counters and timers cost just one
+ * check of this flag.
+ */
+void setEnabled(bool enable);
+
+/** Checks whether metrics are collected.
+ */
+inline bool isEnabled()
+{
+	return enabled;
+}
+
+/** Atomically adds value.
+ * @param target Value to be updated.
+ * @param value Value to add.
+ */
+inline void atomicAdd(volatile unsigned long & target, unsigned long value)
+{
+#ifdef WIN32
+	InterlockedExchangeAdd((volatile LONG *)&target, (LONG)value);
+#else
+	__sync_fetch_and_add(&target, value);
+#endif
+}
+
+/** Monotonic counter.
+ *
+ * Counter is updated without locking, so it can be used from any thread.
+ * Each counter is registered in the global list of metrics when it is 
+ * created, so counters should be defined as globals.
+ */
+class Counter: noncopyable
+{
+	const char * name;
+	const char * help;
+	volatile unsigned long value;
+public:
+	/** Creates and registers counter.
+	 * @param name Name of the counter (string literal without pdfedit_ 
+	 * prefix and _total suffix).
+	 * @param help Description of the counter (string literal).
+	 */
+	Counter(const char * name, const char * help);
+
+	/** Unregisters counter. */
+	~Counter();
+
+	/** Increments counter if metrics are enabled.
+	 * @param n Value to add.
+	 */
+	void add(unsigned long n=1)
+	{
+		if(isEnabled())
+			atomicAdd(value, n);
+	}
+
+	/** Returns current value. */
+	unsigned long getValue()const
+	{
+		return value;
+	}
+
+	/** Returns name of the counter. */
+	const char * getName()const
+	{
+		return name;
+	}
+
+	/** Returns description of the counter. */
+	const char * getHelp()const
+	{
+		return help;
+	}
+
+	/** Sets value to 0. */
+	void reset()
+	{
+		value=0;
+	}
+};
+
+/** Histogram of durations.
+ *
+ * Durations (in microseconds) are counted in buckets with exponentially 
+ * growing upper bounds (1, 2, 5, 10, 20, 50, ... microseconds up to 10 
+ * seconds and one for longer durations). Histogram is updated without 
+ * locking and it is registered in the same way as Counter.
+ */
+class Histogram: noncopyable
+{
+public:
+	/** Number of finite bucket bounds. */
+	static const size_t BOUNDS=22;
+
+	/** Upper bounds of buckets in microseconds. */
+	static const unsigned long bounds[BOUNDS];
+private:
+	const char * name;
+	const char * help;
+	volatile unsigned long buckets[BOUNDS+1];
+	volatile unsigned long count;
+	volatile unsigned long sum;
+public:
+	/** Creates and registers histogram.
+	 * @param name Name of the histogram (string literal without pdfedit_ 
+	 * prefix and _seconds suffix).
+	 * @param help Description of the histogram (string literal).
+	 */
+	Histogram(const char * name, const char * help);
+
+	/** Unregisters histogram. */
+	~Histogram();
+
+	/** Adds one duration if metrics are enabled.
+	 * @param microseconds Duration.
+	 */
+	void observe(unsigned long microseconds);
+
+	/** Returns number of durations in the bucket.
+	 * @param bucket Bucket index (BOUNDS for durations longer than all 
+	 * bounds).
+	 */
+	unsigned long getBucket(size_t bucket)const
+	{
+		return buckets[bucket];
+	}
+
+	/** Returns number of all durations. */
+	unsigned long getCount()const
+	{
+		return count;
+	}
+
+	/** Returns sum of all durations in microseconds. */
+	unsigned long getSum()const
+	{
+		return sum;
+	}
+
+	/** Returns name of the histogram. */
+	const char * getName()const
+	{
+		return name;
+	}
+
+	/** Returns description of the histogram. */
+	const char * getHelp()const
+	{
+		return help;
+	}
+
+	/** Sets all buckets to 0. */
+	void reset();
+};
+
+/** Measures elapsed time.
+ */
+class Stopwatch
+{
+	unsigned long seconds;
+	unsigned long microseconds;
+public:
+	/** Starts measuring.
+	 * @param start Flag whether to read the clock (restart has to be called 
+	 * otherwise).
+	 */
+	explicit Stopwatch(bool start=true)
+		:seconds(0), microseconds(0)
+	{
+		if(start)
+			restart();
+	}
+
+	/** Starts measuring again. */
+	void restart();
+
+	/** Returns microseconds elapsed since start. */
+	unsigned long elapsed()const;
+};
+
+/** Adds duration of its scope to histogram.
+ *
+ * Time is not measured at all if metrics are disabled when timer is 
+ * created.
+ * <pre>
+ * {
+ * 	metrics::ScopedTimer timer(metrics::saveTime);
+ * 	// measured code
+ * }
+ * </pre>
+ */
+class ScopedTimer: noncopyable
+{
+	Histogram * histogram;
+	Stopwatch stopwatch;
+public:
+	/** Starts measuring if metrics are enabled.
+	 * @param h Histogram to be updated.
+	 */
+	explicit ScopedTimer(Histogram & h)
+		:histogram(isEnabled()?&h:NULL), stopwatch(histogram!=NULL)
+	{
+	}
+
+	~ScopedTimer()
+	{
+		if(histogram)
+			histogram->observe(stopwatch.elapsed());
+	}
+};
+
+/** Output formats for dump.
+ */
+enum Format 
+{
+	/** JSON object with counters and histograms members. */
+	JSON, 
+	/** Prometheus text exposition format. */
+	PROMETHEUS
+};
+
+/** Writes all registered metrics.
+ * @param out Output stream.
+ * @param format Output format.
+ *
+ * Histogram buckets are cumulative and durations are in seconds in both
+ * formats.
+ */
+void dump(std::ostream & out, Format format);
+
+/** Resets all registered metrics.
+ */
+void reset();
+
+/** Enables metrics and dumps them when the program exits.
+ * @param format Output format name ("json" or "prometheus").
+ * @param fileName Output file name (standard error output if empty or "-").
+ *
+ * Metrics are also dumped when SIGUSR1 is delivered (where supported). The
+ * signal is handled by a dedicated thread, so this should be called before
+ * other threads are started.
+ * <br>
+ * pdfedit_core_dev_init calls this function if PDFEDIT_METRICS environment
+ * variable (or --metrics command line parameter) is set.
+ *
+ * @return true on success, false if format is not known.
+ */
+bool setupDump(const std::string & format, const std::string & fileName);
+
+/** Time of object fetching from CXref. */
+extern Histogram xrefFetchTime;
+
+/** Time of bulk object fetching from CXref (CXref::fetchObjects). */
+extern Histogram bulkFetchTime;
+
+/** Time of object stream decoding (included in xrefFetchTime). */
+extern Histogram objectStreamDecodeTime;
+
+/** Fetches of compressed objects from already decoded object stream. */
+extern Counter objectStreamCacheHits;
+
+/** Fetches of compressed objects which required object stream decoding. */
+extern Counter objectStreamCacheMisses;
+
+/** Objects fetched from CXref which had been prefetched. */
+extern Counter prefetchHits;
+
+/** Objects fetched from CXref with prefetching enabled which had not been
+ * prefetched. */
+extern Counter prefetchMisses;
+
+/** Objects parsed by the background prefetcher. */
+extern Counter prefetchedObjects;
+
+/** CPdf::getIndirectProperty calls served from instantiated objects. */
+extern Counter indirectCacheHits;
+
+/** CPdf::getIndirectProperty calls which instantiated object. */
+extern Counter indirectCacheMisses;
+
+/** Time of content stream parsing. */
+extern Histogram contentStreamParseTime;
+
+/** Time of page rendering. */
+extern Histogram pageRenderTime;
+
+/** Time of document saving. */
+extern Histogram saveTime;
+
+} // namespace metrics
+} // namespace pdfobjects
+
+#endif // _METRICS_H_
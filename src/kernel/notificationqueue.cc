@@ -0,0 +1,181 @@
+/*
+ * PDFedit - free program for PDF document manipulation.
+ * Copyright (C) 2006-2009  PDFedit team: Michal Hocko,
+ *                                        Jozef Misutka,
+ *                                        Martin Petricek
+ *                   Former team members: Miroslav Jahoda
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (in doc/LICENSE.GPL); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA  02111-1307  USA
+ *
+ * Project is hosted on http://sourceforge.net/projects/pdfedit
+ */
+// vim:tabstop=4:shiftwidth=4:noexpandtab:textwidth=80
+
+#include "kernel/static.h"
+#include "kernel/notificationqueue.h"
+#include "kernel/cdict.h"
+#include "kernel/cobject.h"
+
+namespace pdfobjects
+{
+
+using namespace observer;
+
+namespace
+{
+
+/** Gets coalescing key for given change context.
+ * @param context Change context.
+ * @param key Key for coalescing (set only on success).
+ *
+ * Dictionary entries are identified by '/' prefixed name, so that they can't
+ * collide with simple value change which uses empty key.
+ * 
+ * @return true if changes with same key can be coalesced, false otherwise.
+ */
+bool getCoalescingKey(const boost::shared_ptr<const IChangeContext<IProperty> > & context, std::string & key)
+{
+	if(!context)
+		return false;
+	switch(context->getType())
+	{
+		case BasicChangeContextType:
+			key="";
+			return true;
+		case ComplexChangeContextType:
+			{
+				const CDict::CDictComplexObserverContext * dictContext=
+					dynamic_cast<const CDict::CDictComplexObserverContext *>(context.get());
+				if(!dictContext)
+					// array element index is not stable
+					return false;
+				key="/"+dictContext->getValueId();
+			}
+			return true;
+		default:
+			return false;
+	}
+}
+
+/** Gets original value from given change context.
+ * @param context Basic or complex change context.
+ * @return original value.
+ */
+boost::shared_ptr<IProperty> getOriginalValue(const boost::shared_ptr<const IChangeContext<IProperty> > & context)
+{
+	const BasicChangeContext<IProperty> * basicContext=
+		dynamic_cast<const BasicChangeContext<IProperty> *>(context.get());
+	assert(basicContext);
+	return basicContext->getOriginalValue();
+}
+
+} // anonymous namespace
+
+void NotificationQueue::push(IProperty & subject, const boost::shared_ptr<IProperty> & newValue, 
+		const boost::shared_ptr<const ObserverContext> & context)
+{
+	SubjectEntries & subjectEntries=subjects[&subject];
+	subject.notificationQueued=true;
+
+	std::string key;
+	bool coalescable=getCoalescingKey(context, key);
+	if(coalescable)
+	{
+		std::map<std::string, size_t>::iterator i=subjectEntries.coalesced.find(key);
+		if(i!=subjectEntries.coalesced.end())
+		{
+			// keeps original value from the first change and takes new 
+			// value from this one
+			Entry & entry=entries[i->second];
+			entry.newValue=newValue;
+
+			// dictionary entry which has been added and removed again
+			boost::shared_ptr<IProperty> originalValue=getOriginalValue(entry.context);
+			if(key.size() && isNull(newValue) && isNull(originalValue))
+			{
+				kernelPrintDbg(debug::DBG_DBG, "Discarding notification for "<<key<<" entry");
+				entry.subject=NULL;
+				entry.newValue.reset();
+				entry.context.reset();
+				subjectEntries.coalesced.erase(i);
+				++discarded;
+			}
+			return;
+		}
+	}
+
+	Entry entry;
+	entry.subject=&subject;
+	entry.newValue=newValue;
+	entry.context=context;
+	size_t pos=entries.size();
+	entries.push_back(entry);
+	subjectEntries.positions.push_back(pos);
+	if(coalescable)
+		subjectEntries.coalesced.insert(std::make_pair(key, pos));
+}
+
+void NotificationQueue::cancel(IProperty & subject)
+{
+	SubjectMapping::iterator i=subjects.find(&subject);
+	if(i==subjects.end())
+		return;
+	const std::vector<size_t> & positions=i->second.positions;
+	for(std::vector<size_t>::const_iterator j=positions.begin(); j!=positions.end(); ++j)
+	{
+		Entry & entry=entries[*j];
+		if(!entry.subject)
+			continue;
+		entry.subject=NULL;
+		entry.newValue.reset();
+		entry.context.reset();
+		++discarded;
+	}
+	subjects.erase(i);
+}
+
+void NotificationQueue::flush()
+{
+	// nested batch ended during flushing - its notifications are already 
+	// in entries and they are delivered by the running flush
+	if(flushing)
+		return;
+	flushing=true;
+	kernelPrintDbg(debug::DBG_DBG, "Delivering "<<size()<<" notifications");
+
+	// observers may change properties (and so add new entries) or destroy
+	// them (and so discard entries), so that entry is copied and size is
+	// checked in each step
+	for(size_t i=0; i<entries.size(); ++i)
+	{
+		Entry entry=entries[i];
+		if(!entry.subject)
+			continue;
+		entry.subject->notifyObservers(entry.newValue, entry.context, true);
+	}
+	clear();
+	flushing=false;
+}
+
+void NotificationQueue::clear()
+{
+	for(SubjectMapping::iterator i=subjects.begin(); i!=subjects.end(); ++i)
+		i->first->notificationQueued=false;
+	subjects.clear();
+	entries.clear();
+	discarded=0;
+}
+
+} // namespace pdfobjects
@@ -0,0 +1,149 @@
+/*
+ * PDFedit - free program for PDF document manipulation.
+ * Copyright (C) 2006-2009  PDFedit team: Michal Hocko,
+ *                                        Jozef Misutka,
+ *                                        Martin Petricek
+ *                   Former team members: Miroslav Jahoda
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (in doc/LICENSE.GPL); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA  02111-1307  USA
+ *
+ * Project is hosted on http://sourceforge.net/projects/pdfedit
+ */
+// vim:tabstop=4:shiftwidth=4:noexpandtab:textwidth=80
+
+#ifndef _NOTIFICATIONQUEUE_H_
+#define _NOTIFICATIONQUEUE_H_
+
+#include "kernel/static.h"
+#include "kernel/iproperty.h"
+
+namespace pdfobjects
+{
+
+/** Queue of postponed property change notifications.
+ *
+ * Collects notifications of IProperty changes done inside a notification
+ * batch (see CPdf::beginNotificationBatch) and delivers them to deferrable
+ * observers when the batch ends.
+ * <br>
+ * Changes of the same property are coalesced to one notification:
+ * <ul>
+ * <li>changes of dictionary entries are coalesced per entry name - the
+ * original value comes from the first change and new value from the last
+ * one. If the entry has been added and removed again, notification is
+ * discarded.
+ * <li>simple values (and stream buffers) are coalesced the same way.
+ * <li>changes of array elements are not coalesced, because element indexes
+ * change with each insertion and removal. They are delivered in the same
+ * order as they have happened.
+ * </ul>
+ * Notification is delivered at position of the first coalesced change.
+ * <br>
+ * Queue doesn't keep properties alive. Property which is destroyed or which
+ * leaves the pdf cancels its notifications (see cancel).
+ */
+class NotificationQueue: public noncopyable
+{
+public:
+	/** Type for notification context. */
+	typedef IProperty::ObserverContext ObserverContext;
+
+private:
+	/** Postponed notification.
+	 */
+	struct Entry
+	{
+		/** Changed property (NULL if notification has been discarded). */
+		IProperty * subject;
+		/** New value. */
+		boost::shared_ptr<IProperty> newValue;
+		/** Change context. */
+		boost::shared_ptr<const ObserverContext> context;
+	};
+
+	/** Type for list of notifications. */
+	typedef std::vector<Entry> EntryList;
+
+	/** Notifications of one property.
+	 */
+	struct SubjectEntries
+	{
+		/** Coalescing key to entry position mapping. */
+		std::map<std::string, size_t> coalesced;
+		/** Positions of all entries. */
+		std::vector<size_t> positions;
+	};
+
+	/** Type for property to its notifications mapping. */
+	typedef std::map<IProperty *, SubjectEntries> SubjectMapping;
+
+	/** All notifications in order of changes. */
+	EntryList entries;
+
+	/** Notifications of each property. */
+	SubjectMapping subjects;
+
+	/** Number of discarded entries. */
+	size_t discarded;
+
+	/** Flag whether queue is being flushed. */
+	bool flushing;
+
+	/** Discards all notifications.
+	 */
+	void clear();
+public:
+	/** Initialization constructor.
+	 * Creates empty queue.
+	 */
+	NotificationQueue():discarded(0), flushing(false) {}
+
+	/** Adds notification to the queue.
+	 * @param subject Changed property.
+	 * @param newValue New value.
+	 * @param context Change context.
+	 *
+	 * Coalesces notification with previous one for the same property and
+	 * value if possible.
+	 */
+	void push(IProperty & subject, const boost::shared_ptr<IProperty> & newValue, 
+			const boost::shared_ptr<const ObserverContext> & context);
+
+	/** Discards all notifications of given property.
+	 * @param subject Property.
+	 */
+	void cancel(IProperty & subject);
+
+	/** Delivers all notifications.
+	 *
+	 * Deferrable observers of each property are notified in order in which
+	 * changes have been queued. Notifications queued during flushing (by
+	 * nested batch) are delivered by the same flush. Queue is empty
+	 * afterwards.
+	 */
+	void flush();
+
+	/** Returns number of pending notifications.
+	 * @return number of notifications which would be delivered by flush.
+	 */
+	size_t size()const
+	{
+		return entries.size()-discarded;
+	}
+};
+
+} // namespace pdfobjects
+
+#endif
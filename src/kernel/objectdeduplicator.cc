@@ -0,0 +1,556 @@
+/*
+ * PDFedit - free program for PDF document manipulation.
+ * Copyright (C) 2006-2009  PDFedit team: Michal Hocko,
+ *                                        Jozef Misutka,
+ *                                        Martin Petricek
+ *                   Former team members: Miroslav Jahoda
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (in doc/LICENSE.GPL); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA  02111-1307  USA
+ *
+ * Project is hosted on http://sourceforge.net/projects/pdfedit
+ */
+// vim:tabstop=4:shiftwidth=4:noexpandtab:textwidth=80
+#include "kernel/static.h" // WIN32 port - precompiled headers - REMOVE IN FUTURE!
+#include <algorithm>
+#include <map>
+#include <string.h>
+#include <goo/GThread.h>
+#include "kernel/objectdeduplicator.h"
+#include "kernel/cxref.h"
+#include "kernel/exceptions.h"
+#include "kernel/factories.h"
+#include "utils/debug.h"
+
+using namespace pdfobjects;
+using namespace utils;
+
+namespace {
+
+/** Maximal size of canonical forms hashed at once. */
+const size_t MAX_BATCH_BYTES = 16*1024*1024;
+
+/** Maximal number of canonical forms hashed at once. */
+const size_t MAX_BATCH_OBJECTS = 4096;
+
+/** Number of objects fetched at once by ObjectFetcher. */
+const size_t FETCH_CHUNK_OBJECTS = 1024;
+
+/** Index used for references to objects outside of the considered list. */
+const size_t NO_INDEX = (size_t)-1;
+
+/** 128b hash of the canonical form. */
+struct Hash
+{
+	Guint h[4];
+};
+
+inline Guint rotl32(Guint x, int r)
+{
+	return (x << r) | (x >> (32 - r));
+}
+
+inline Guint fmix32(Guint h)
+{
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h;
+}
+
+inline Guint getBlock32(const unsigned char * p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((Guint)p[3] << 24);
+}
+
+/** Computes 128b hash of given data.
+ * @param data Data to be hashed.
+ * @param hash Result.
+ *
+ * Uses MurmurHash3 (x86 128b variant) which works with 32b lanes only.
+ */
+void hashData(const std::string & data, Hash & hash)
+{
+	const unsigned char * p = (const unsigned char *)data.data();
+	size_t len = data.size();
+	size_t nblocks = len / 16;
+	const Guint c1 = 0x239b961b, c2 = 0xab0e9789, c3 = 0x38b34ae5, c4 = 0xa1e38b93;
+	Guint h1 = 0, h2 = 0, h3 = 0, h4 = 0;
+
+	for(size_t i=0; i<nblocks; i++, p+=16)
+	{
+		Guint k1 = getBlock32(p), k2 = getBlock32(p+4);
+		Guint k3 = getBlock32(p+8), k4 = getBlock32(p+12);
+
+		k1 *= c1; k1 = rotl32(k1, 15); k1 *= c2; h1 ^= k1;
+		h1 = rotl32(h1, 19); h1 += h2; h1 = h1*5 + 0x561ccd1b;
+		k2 *= c2; k2 = rotl32(k2, 16); k2 *= c3; h2 ^= k2;
+		h2 = rotl32(h2, 17); h2 += h3; h2 = h2*5 + 0x0bcaa747;
+		k3 *= c3; k3 = rotl32(k3, 17); k3 *= c4; h3 ^= k3;
+		h3 = rotl32(h3, 15); h3 += h4; h3 = h3*5 + 0x96cd1c35;
+		k4 *= c4; k4 = rotl32(k4, 18); k4 *= c1; h4 ^= k4;
+		h4 = rotl32(h4, 13); h4 += h1; h4 = h4*5 + 0x32ac3b17;
+	}
+
+	// tail - zero lanes don't change the state so all of them can be mixed
+	Guint k[4] = {0, 0, 0, 0};
+	for(size_t i=0; i<(len & 15); i++)
+		k[i/4] ^= (Guint)p[i] << (8*(i%4));
+	k[3] *= c4; k[3] = rotl32(k[3], 18); k[3] *= c1; h4 ^= k[3];
+	k[2] *= c3; k[2] = rotl32(k[2], 17); k[2] *= c4; h3 ^= k[2];
+	k[1] *= c2; k[1] = rotl32(k[1], 16); k[1] *= c3; h2 ^= k[1];
+	k[0] *= c1; k[0] = rotl32(k[0], 15); k[0] *= c2; h1 ^= k[0];
+
+	h1 ^= (Guint)len; h2 ^= (Guint)len; h3 ^= (Guint)len; h4 ^= (Guint)len;
+	h1 += h2; h1 += h3; h1 += h4;
+	h2 += h1; h3 += h1; h4 += h1;
+	h1 = fmix32(h1); h2 = fmix32(h2); h3 = fmix32(h3); h4 = fmix32(h4);
+	h1 += h2; h1 += h3; h1 += h4;
+	h2 += h1; h3 += h1; h4 += h1;
+
+	hash.h[0] = h1; hash.h[1] = h2; hash.h[2] = h3; hash.h[3] = h4;
+}
+
+/** Batch of canonical forms to be hashed by gParallelFor.
+ */
+struct HashBatch
+{
+	std::vector<std::string> data;	/**< Canonical forms. */
+	std::vector<Hash> * hashes;		/**< Target for hashes. */
+	size_t first;					/**< Index of the first form in hashes. */
+};
+
+/** gParallelFor job: hashes canonical form number idx of the batch.
+ */
+void hashBatchJob(void * data, int idx)
+{
+	HashBatch * batch = (HashBatch *)data;
+	hashData(batch->data[idx], (*batch->hashes)[batch->first + idx]);
+}
+
+/** Hashes all forms from the batch and clears it.
+ */
+void flushBatch(HashBatch & batch)
+{
+	if(batch.data.empty())
+		return;
+	gParallelFor(batch.data.size(), hashBatchJob, &batch, 0);
+	batch.first += batch.data.size();
+	batch.data.clear();
+}
+
+template<typename T>
+void appendRaw(std::string & out, const T & value)
+{
+	out.append((const char *)&value, sizeof(value));
+}
+
+void appendLength(std::string & out, size_t len)
+{
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%lu:", (unsigned long)len);
+	out.append(buf);
+}
+
+/** Checks whether given dictionary type is bound to its position in the
+ * document.
+ */
+bool isPinnedType(const char * type)
+{
+	return !strcmp(type, "Page") || !strcmp(type, "Pages")
+		|| !strcmp(type, "Annot") || !strcmp(type, "StructElem")
+		|| !strcmp(type, "Catalog");
+}
+
+void canonize(const ::Object & obj, std::string & out, std::vector< ::Ref> & refs, bool & pinned);
+
+/** Appends canonical form of the dictionary with sorted keys.
+ */
+void canonizeDict(const ::Dict & dict, std::string & out, std::vector< ::Ref> & refs, bool & pinned)
+{
+	std::vector<std::pair<std::string, int> > keys;
+	for(int i=0; i<dict.getLength(); i++)
+		keys.push_back(std::make_pair(std::string(dict.getKey(i)), i));
+	std::sort(keys.begin(), keys.end());
+
+	::Object elem;
+	out += '<';
+	appendLength(out, keys.size());
+	for(size_t i=0; i<keys.size(); i++)
+	{
+		appendLength(out, keys[i].first.size());
+		out += keys[i].first;
+		if(!dict.getValNF(keys[i].second, &elem))
+		{
+			utilsPrintDbg(debug::DBG_ERR, "Unable to get dictionary entry with index "<<keys[i].second);
+			throw MalformedFormatExeption("bad data stream");
+		}
+		if(keys[i].first == "Type" && elem.isName() && isPinnedType(elem.getName()))
+			pinned = true;
+		canonize(elem, out, refs, pinned);
+		elem.free();
+	}
+	out += '>';
+}
+
+/** Appends canonical form of the given object.
+ * @param obj Object to be serialized.
+ * @param out Output buffer.
+ * @param refs List of references in the order of appearance.
+ * @param pinned Set to true if the object cannot be merged.
+ *
+ * References are replaced by placeholder and collected to the refs.
+ */
+void canonize(const ::Object & obj, std::string & out, std::vector< ::Ref> & refs, bool & pinned)
+{
+	switch(obj.getType())
+	{
+		case objBool:
+			out += obj.getBool()?"T":"F";
+			break;
+		case objInt:
+			out += 'i';
+			appendRaw(out, obj.getInt());
+			break;
+		case objReal:
+			out += 'r';
+			appendRaw(out, obj.getReal());
+			break;
+		case objString:
+		{
+			const GString * str = obj.getString();
+			out += '(';
+			appendLength(out, str->getLength());
+			out.append(str->getCString(), str->getLength());
+			break;
+		}
+		case objName:
+		{
+			const char * name = obj.getName();
+			out += '/';
+			appendLength(out, strlen(name));
+			out += name;
+			break;
+		}
+		case objNull:
+			out += 'n';
+			break;
+		case objArray:
+		{
+			::Object elem;
+			out += '[';
+			appendLength(out, obj.arrayGetLength());
+			for(int i=0; i<obj.arrayGetLength(); i++)
+			{
+				if(!obj.arrayGetNF(i, &elem))
+				{
+					utilsPrintDbg(debug::DBG_ERR, "Unable to get array entry");
+					throw MalformedFormatExeption("bad data stream");
+				}
+				canonize(elem, out, refs, pinned);
+				elem.free();
+			}
+			out += ']';
+			break;
+		}
+		case objDict:
+			canonizeDict(*obj.getDict(), out, refs, pinned);
+			break;
+		case objStream:
+		{
+			canonizeDict(*obj.streamGetDict(), out, refs, pinned);
+			// raw data - decoding is not necessary because the same
+			// dictionary implies the same filters
+			::BaseStream * str = obj.getStream()->getBaseStream();
+			str->reset();
+			out += 's';
+			int c;
+			while((c = str->getChar()) != EOF)
+				out += (char)c;
+			str->close();
+			break;
+		}
+		case objRef:
+			out += 'R';
+			refs.push_back(obj.getRef());
+			break;
+		default:
+			// objCmd, objError, objEOF and objNone can't be stored in
+			// indirect objects - make them unique
+			pinned = true;
+			break;
+	}
+}
+
+/** Fetches objects of the reference list in order.
+ *
+ * CXref objects are fetched ahead by chunks using CXref::fetchObjects (so
+ * they are parsed concurrently), objects from other XRef implementations are
+ * fetched one by one.
+ */
+class ObjectFetcher
+{
+	::XRef & xref;
+	const CXref * cxref;
+	const ObjectDeduplicator::RefList & refs;
+	/** Fetched objects not returned yet (NULL for returned). */
+	CXref::ObjectList objs;
+	/** Index of the first fetched object in refs. */
+	size_t first;
+
+	void release()
+	{
+		for(size_t i=0; i<objs.size(); i++)
+			if(objs[i])
+				xpdf::freeXpdfObject(objs[i]);
+		objs.clear();
+	}
+public:
+	ObjectFetcher(::XRef & x, const ObjectDeduplicator::RefList & r)
+		: xref(x), cxref(dynamic_cast<const CXref *>(&x)), refs(r), first(0)
+	{}
+
+	~ObjectFetcher()
+	{
+		release();
+	}
+
+	/** Fetches object with index i (indexes have to be increasing).
+	 * @param i Index of the reference.
+	 * @param obj Object where to store the content.
+	 * @throw MalformedFormatExeption if object is damaged.
+	 */
+	void fetch(size_t i, ::Object & obj)
+	{
+		if(!cxref)
+		{
+			xref.fetch(refs[i].num, refs[i].gen, &obj);
+			if(!xref.isOk())
+			{
+				utilsPrintDbg(debug::DBG_ERR, refs[i]<<" object fetching failed with code="
+						<<xref.getErrorCode());
+				obj.free();
+				throw MalformedFormatExeption("bad data stream");
+			}
+			return;
+		}
+		if(i >= first + objs.size())
+		{
+			release();
+			first = i;
+			CXref::RefList chunk(refs.begin()+i, 
+					refs.begin()+std::min(i+FETCH_CHUNK_OBJECTS, refs.size()));
+			cxref->fetchObjects(chunk, objs);
+		}
+		// shallow copy of the content
+		obj = *objs[i-first];
+		gfree(objs[i-first]);
+		objs[i-first] = NULL;
+	}
+};
+
+} // annonymous namespace
+
+void ObjectDeduplicator::init(::XRef & xref, const RefList & refs, const RefList & pinned)
+{
+	utilsPrintDbg(debug::DBG_DBG, "Deduplicating "<<refs.size()<<" objects");
+	replacements.clear();
+	this->xref = &xref;
+
+	size_t count = refs.size();
+	IndiRefMap<size_t> indexes;
+	for(size_t i=0; i<count; i++)
+		indexes.insert(std::make_pair(IndiRef(refs[i]), i));
+
+	// objects which can't be merged keep their own class
+	std::vector<bool> fixed(count, false);
+	for(size_t i=0; i<pinned.size(); i++)
+	{
+		IndiRefMap<size_t>::const_iterator idx = indexes.find(pinned[i]);
+		if(idx != indexes.end())
+			fixed[idx->second] = true;
+	}
+
+	// Canonical forms are created serially from objects fetched ahead (see
+	// ObjectFetcher) and hashed in parallel by batches. Only hashes and indexes of
+	// referenced objects are kept.
+	std::vector<Hash> hashes(count);
+	std::vector<size_t> kids;
+	std::vector<size_t> kidsStart(count+1, 0);
+	HashBatch batch;
+	batch.hashes = &hashes;
+	batch.first = 0;
+	size_t batchBytes = 0;
+	std::vector< ::Ref> objRefs;
+	ObjectFetcher fetcher(xref, refs);
+	for(size_t i=0; i<count; i++)
+	{
+		::Object obj;
+		fetcher.fetch(i, obj);
+		batch.data.push_back(std::string());
+		bool pinnedType = false;
+		objRefs.clear();
+		try
+		{
+			canonize(obj, batch.data.back(), objRefs, pinnedType);
+		}catch(...)
+		{
+			obj.free();
+			throw;
+		}
+		obj.free();
+		if(pinnedType)
+			fixed[i] = true;
+		for(size_t j=0; j<objRefs.size(); j++)
+		{
+			IndiRefMap<size_t>::const_iterator idx = indexes.find(objRefs[j]);
+			if(idx == indexes.end())
+			{
+				// not considered object - can't be merged with anything
+				// so hash its reference instead
+				batch.data.back() += 'x';
+				appendRaw(batch.data.back(), objRefs[j].num);
+				appendRaw(batch.data.back(), objRefs[j].gen);
+				kids.push_back(NO_INDEX);
+			}else
+				kids.push_back(idx->second);
+		}
+		kidsStart[i+1] = kids.size();
+
+		batchBytes += batch.data.back().size();
+		if(batchBytes >= MAX_BATCH_BYTES || batch.data.size() >= MAX_BATCH_OBJECTS)
+		{
+			flushBatch(batch);
+			batchBytes = 0;
+		}
+	}
+	flushBatch(batch);
+
+	// Refines classes of equal objects until they are stable. Starts with
+	// each object in its own class and merges objects with the same hash
+	// and with referenced objects in the same classes. Each class is
+	// represented by its first object.
+	std::vector<size_t> classes(count);
+	for(size_t i=0; i<count; i++)
+		classes[i] = i;
+	std::vector<size_t> newClasses(count);
+	bool changed = true;
+	size_t iterations = 0;
+	while(changed)
+	{
+		changed = false;
+		iterations++;
+		std::map<std::string, size_t> representatives;
+		std::string key;
+		for(size_t i=0; i<count; i++)
+		{
+			if(fixed[i])
+			{
+				newClasses[i] = i;
+				continue;
+			}
+			key.assign((const char *)hashes[i].h, sizeof(hashes[i].h));
+			for(size_t j=kidsStart[i]; j<kidsStart[i+1]; j++)
+				appendRaw(key, (kids[j] == NO_INDEX)?NO_INDEX:classes[kids[j]]);
+			newClasses[i] = representatives.insert(std::make_pair(key, i)).first->second;
+			if(newClasses[i] != classes[i])
+				changed = true;
+		}
+		classes.swap(newClasses);
+	}
+
+	for(size_t i=0; i<count; i++)
+		if(classes[i] != i)
+			replacements.insert(std::make_pair(IndiRef(refs[i]), IndiRef(refs[classes[i]])));
+	utilsPrintDbg(debug::DBG_INFO, replacements.size()<<" duplicates found in "
+			<<iterations<<" iterations");
+}
+
+bool pdfobjects::utils::replaceRefs(const ::Object & obj, ::Object & result, 
+		const RefReplacements & replacements, ::XRef * xref)
+{
+	switch(obj.getType())
+	{
+		case objRef:
+		{
+			RefReplacements::const_iterator i = replacements.find(obj.getRef());
+			if(i == replacements.end())
+				return false;
+			result.initRef(i->second.num, i->second.gen);
+			return true;
+		}
+		case objArray:
+		{
+			// arrays can't be updated so new one has to be created if any
+			// of elements is replaced
+			std::vector< ::Object> elems(obj.arrayGetLength());
+			bool replaced = false;
+			for(int i=0; i<obj.arrayGetLength(); i++)
+			{
+				::Object elem;
+				obj.arrayGetNF(i, &elem);
+				if(replaceRefs(elem, elems[i], replacements, xref))
+				{
+					elem.free();
+					replaced = true;
+				}else
+					elems[i] = elem;
+			}
+			if(!replaced)
+			{
+				for(size_t i=0; i<elems.size(); i++)
+					elems[i].free();
+				return false;
+			}
+			result.initArray(xref);
+			for(size_t i=0; i<elems.size(); i++)
+				result.arrayAdd(&elems[i]);
+			return true;
+		}
+		case objDict:
+		case objStream:
+		{
+			const ::Dict * dict = obj.isDict()?obj.getDict():obj.streamGetDict();
+			for(int i=0; i<dict->getLength(); i++)
+			{
+				::Object elem, value;
+				dict->getValNF(i, &elem);
+				if(replaceRefs(elem, value, replacements, xref))
+				{
+					::Object * old = (obj.isDict())
+						?obj.dictUpdate(dict->getKey(i), &value)
+						:obj.getStream()->getBaseStream()->dictUpdate(dict->getKey(i), &value);
+					if(old)
+						xpdf::freeXpdfObject(old);
+				}
+				elem.free();
+			}
+			return false;
+		}
+		default:
+			return false;
+	}
+}
+
+void pdfobjects::utils::replaceRefs(::Object & obj, const RefReplacements & replacements, ::XRef * xref)
+{
+	::Object result;
+	if(replaceRefs(obj, result, replacements, xref))
+	{
+		obj.free();
+		obj = result;
+	}
+}
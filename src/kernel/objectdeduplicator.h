@@ -0,0 +1,157 @@
+/*
+ * PDFedit - free program for PDF document manipulation.
+ * Copyright (C) 2006-2009  PDFedit team: Michal Hocko,
+ *                                        Jozef Misutka,
+ *                                        Martin Petricek
+ *                   Former team members: Miroslav Jahoda
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (in doc/LICENSE.GPL); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA  02111-1307  USA
+ *
+ * Project is hosted on http://sourceforge.net/projects/pdfedit
+ */
+// vim:tabstop=4:shiftwidth=4:noexpandtab:textwidth=80
+#ifndef _OBJECTDEDUPLICATOR_H_
+#define _OBJECTDEDUPLICATOR_H_
+
+#include "kernel/xpdf.h"
+#include "kernel/indirefmap.h"
+
+namespace pdfobjects
+{
+namespace utils
+{
+
+/** Mapping from references to their replacements. */
+typedef IndiRefMap<IndiRef> RefReplacements;
+
+/** Replaces references in given object.
+ * @param obj Object to be examined.
+ * @param result Object for replaced array value.
+ * @param replacements Mapping of references to be replaced (references
+ * which are not in the mapping are kept).
+ * @param xref XRef used for arrays created by replacing.
+ *
+ * Dictionaries (also stream dictionaries) are updated in place. Arrays
+ * don't provide setter so a new array with replaced references is created
+ * instead and stored to result. The same applies to the replaced reference
+ * itself.
+ * @return true if result has been initialized, false otherwise.
+ */
+bool replaceRefs(const ::Object & obj, ::Object & result, 
+		const RefReplacements & replacements, ::XRef * xref);
+
+/** Replaces references in given object.
+ * @param obj Object to be updated (e.g. fetched from the document).
+ * @param replacements Mapping of references to be replaced.
+ * @param xref XRef used for arrays created by replacing.
+ *
+ * Convenience wrapper which stores replaced value directly to obj.
+ */
+void replaceRefs(::Object & obj, const RefReplacements & replacements, ::XRef * xref);
+
+/** Content addressed deduplication of indirect objects.
+ *
+ * Finds indirect objects with the same content (typically fonts, images or
+ * color spaces shared by pages which were merged from several documents)
+ * and provides mapping from each duplicate to its representative.
+ * <br>
+ * Objects are compared by their canonical form - dictionary keys are
+ * sorted, strings and names are length prefixed, streams are compared by
+ * their dictionaries and raw (not decoded) data. Referenced objects are not
+ * part of the canonical form; two objects are equal only if their
+ * references point to equal objects as well, so the equality is refined
+ * until it is stable. Canonical forms are hashed by 128b hash in parallel
+ * (see gParallelFor) and discarded right after, so whole document is never
+ * held in memory.
+ * <br>
+ * Objects which are identified by their position in the document rather
+ * than by their content (page tree nodes, annotations, structure elements
+ * and objects given as pinned) are never merged.
+ * <p>
+ * <b>Usage</b>
+ * <pre>
+ * ObjectDeduplicator dedup;
+ * dedup.init(xref, reachableRefs, trailerRefs);
+ * for each ref in reachableRefs
+ * 	if(dedup.isDuplicate(ref))
+ * 		continue;
+ * 	fetch obj for ref
+ * 	dedup.replaceRefs(obj);
+ * 	write obj
+ * </pre>
+ */
+class ObjectDeduplicator
+{
+public:
+	typedef std::vector< ::Ref> RefList;
+
+private:
+	/** Mapping from duplicates to their representatives. */
+	RefReplacements replacements;
+
+	/** XRef used for arrays created by replaceRefs. */
+	::XRef * xref;
+public:
+	ObjectDeduplicator():xref(NULL) {}
+
+	/** Finds duplicates between given objects.
+	 * @param xref XRef used for fetching.
+	 * @param refs List of all indirect objects to be considered (usually
+	 * all reachable objects).
+	 * @param pinned Objects which must not be replaced (e.g. those
+	 * referenced from the trailer).
+	 *
+	 * Previous state is discarded.
+	 * @throw MalformedFormatExeption if an object cannot be fetched.
+	 */
+	void init(::XRef & xref, const RefList & refs, const RefList & pinned);
+
+	/** Returns number of objects which have a representative.
+	 */
+	size_t getDuplicateCount()const
+	{
+		return replacements.size();
+	}
+
+	/** Checks whether given object is a duplicate.
+	 * @param ref Object reference.
+	 * @return true if object is replaced by other object.
+	 */
+	bool isDuplicate(const ::Ref & ref)const
+	{
+		return replacements.find(ref) != replacements.end();
+	}
+
+	/** Redirects references to duplicates to their representatives.
+	 * @param obj Object to be updated (fetched from the document).
+	 */
+	void replaceRefs(::Object & obj)const
+	{
+		if(!replacements.empty())
+			utils::replaceRefs(obj, replacements, xref);
+	}
+
+	/** Discards all collected information.
+	 */
+	void clear()
+	{
+		replacements.clear();
+	}
+};
+
+} // namespace utils
+} // namespace pdfobjects
+
+#endif
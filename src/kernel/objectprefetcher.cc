@@ -0,0 +1,430 @@
+/*
+ * PDFedit - free program for PDF document manipulation.
+ * Copyright (C) 2006-2009  PDFedit team: Michal Hocko,
+ *                                        Jozef Misutka,
+ *                                        Martin Petricek
+ *                   Former team members: Miroslav Jahoda
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (in doc/LICENSE.GPL); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA  02111-1307  USA
+ *
+ * Project is hosted on http://sourceforge.net/projects/pdfedit
+ */
+// vim:tabstop=4:shiftwidth=4:noexpandtab:textwidth=80
+#include "kernel/static.h" // WIN32 port - precompiled headers - REMOVE IN FUTURE!
+#include <algorithm>
+#include <deque>
+#include <set>
+#include <string.h>
+#include <goo/gfile.h>
+#include "kernel/objectprefetcher.h"
+#include "kernel/metrics.h"
+#include "utils/debug.h"
+
+using namespace pdfobjects;
+
+namespace {
+
+/** Estimated memory overhead of one object (including cache entry). */
+const size_t OBJECT_OVERHEAD = 64;
+
+/** Checks whether reference in dictionary entry with given key should be
+ * followed.
+ *
+ * Entries which lead to other pages or to document level structures are
+ * not followed.
+ */
+bool isFollowedKey(const char * key)
+{
+	static const char * skipped[] =
+		{"Parent", "P", "Dest", "A", "AA", "B", "Thumb", NULL};
+	for(const char ** i = skipped; *i; ++i)
+		if(!strcmp(key, *i))
+			return false;
+	return true;
+}
+
+/** Checks whether given object is a page tree node.
+ * Only direct Type value is considered, because fetching must not be used
+ * by the worker.
+ */
+bool isPageTreeNode(const ::Object & obj)
+{
+	if(!obj.isDict())
+		return false;
+	::Object type;
+	obj.getDict()->lookupNF("Type", &type);
+	bool result = type.isName("Page") || type.isName("Pages");
+	type.free();
+	return result;
+}
+
+/** Collects references from given object and estimates its memory size.
+ * @param obj Parsed object.
+ * @param kids Vector where to add references to follow.
+ * @param xref Cross reference table.
+ * @param view Stream used for indirect stream length.
+ * @return estimated memory size.
+ */
+size_t inspect(const ::Object & obj, std::vector< ::Ref> & kids,
+		const ::XRef & xref, BaseStream * view);
+
+size_t inspectDict(const ::Dict & dict, std::vector< ::Ref> & kids,
+		const ::XRef & xref, BaseStream * view)
+{
+	size_t bytes = 0;
+	for(int i = 0; i < dict.getLength(); ++i)
+	{
+		const char * key = dict.getKey(i);
+		::Object value;
+		dict.getValNF(i, &value);
+		if(!value.isRef() || isFollowedKey(key))
+			bytes += inspect(value, kids, xref, view);
+		bytes += sizeof(::Object) + strlen(key);
+		value.free();
+	}
+	return bytes;
+}
+
+size_t inspect(const ::Object & obj, std::vector< ::Ref> & kids,
+		const ::XRef & xref, BaseStream * view)
+{
+	size_t bytes = sizeof(::Object);
+	switch(obj.getType())
+	{
+		case objRef:
+			kids.push_back(obj.getRef());
+			break;
+		case objString:
+			bytes += obj.getString()->getLength();
+			break;
+		case objName:
+			bytes += strlen(obj.getName());
+			break;
+		case objArray:
+			for(int i = 0; i < obj.arrayGetLength(); ++i)
+			{
+				::Object item;
+				obj.arrayGetNF(i, &item);
+				bytes += inspect(item, kids, xref, view);
+				item.free();
+			}
+			break;
+		case objDict:
+			bytes += inspectDict(*obj.getDict(), kids, xref, view);
+			break;
+		case objStream:
+		{
+			// raw stream data are copied when the object is cloned
+			const ::Dict * dict = obj.streamGetDict();
+			bytes += inspectDict(*dict, kids, xref, view);
+			::Object length;
+			xref.lookupFrom(view, dict, "Length", &length);
+			if(length.isInt() && length.getInt() > 0)
+				bytes += length.getInt();
+			length.free();
+			break;
+		}
+		default:
+			break;
+	}
+	return bytes;
+}
+
+/** Holds the mutex locked for the lifetime of the instance, so that it is
+ * unlocked also when an exception is thrown.
+ */
+class MutexLocker
+{
+	GMutex & mutex;
+public:
+	MutexLocker(GMutex & _mutex):mutex(_mutex)
+	{
+		gLockMutex(&mutex);
+	}
+	~MutexLocker()
+	{
+		gUnlockMutex(&mutex);
+	}
+};
+
+/** Orders cache entries by their round (older first). */
+struct RoundOrder
+{
+	bool operator()(ObjectPrefetcher::Cache::iterator a,
+			ObjectPrefetcher::Cache::iterator b)const
+	{
+		return a->second.round < b->second.round;
+	}
+};
+
+} // annonymous namespace
+
+ObjectPrefetcher::ObjectPrefetcher(const ::XRef & _xref, BaseStream * _str,
+		size_t _memoryLimit)
+	:xref(_xref), str(_str), memoryLimit(_memoryLimit), memoryUsage(0),
+	 round(0), cancelled(false),
+	 running(false), fileMap(NULL)
+{
+	gInitMutex(&mutex);
+}
+
+ObjectPrefetcher::~ObjectPrefetcher()
+{
+	clear();
+	gDestroyMutex(&mutex);
+}
+
+void ObjectPrefetcher::prefetch(const RefList & pageRefs)
+{
+	using namespace debug;
+
+	stop();
+
+	// views are addressed by file offsets
+	if(!fileMap && (str->getStart() != 0 || !(fileMap = str->map())))
+	{
+		kernelPrintDbg(DBG_DBG, "Document stream can't be mapped");
+		return;
+	}
+
+	gLockMutex(&mutex);
+	++round;
+	cancelled = false;
+	gUnlockMutex(&mutex);
+
+	pages = pageRefs;
+	kernelPrintDbg(DBG_DBG, "Prefetching "<<pages.size()<<" pages (round "
+			<<round<<")");
+	running = gStartThread(&thread, workerMain, this);
+	if(!running)
+		kernelPrintDbg(DBG_WARN, "Unable to start prefetching thread");
+}
+
+void ObjectPrefetcher::stop()
+{
+	if(!running)
+		return;
+	gLockMutex(&mutex);
+	cancelled = true;
+	gUnlockMutex(&mutex);
+	gJoinThread(&thread);
+	running = false;
+}
+
+void ObjectPrefetcher::clear()
+{
+	stop();
+	for(Cache::iterator i = cache.begin(); i != cache.end(); ++i)
+		xpdf::freeXpdfObject(i->second.obj);
+	cache.clear();
+	memoryUsage = 0;
+	taken.clear();
+	delete fileMap;
+	fileMap = NULL;
+}
+
+bool ObjectPrefetcher::take(const ::Ref & ref, ::Object & obj)
+{
+	bool found = false;
+
+	{
+		MutexLocker lock(mutex);
+		Cache::iterator i = cache.find(ref);
+		if(i != cache.end())
+		{
+			// only handed over objects are not prefetched again
+			if((size_t)ref.num >= taken.size())
+				taken.resize(ref.num + 1, false);
+			taken[ref.num] = true;
+
+			// shallow copy of the content, cloned instance is not needed
+			// anymore
+			obj = *i->second.obj;
+			gfree(i->second.obj);
+			memoryUsage -= i->second.bytes;
+			cache.erase(i);
+			found = true;
+		}
+	}
+
+	if(found)
+		metrics::prefetchHits.add();
+	else
+		metrics::prefetchMisses.add();
+	return found;
+}
+
+size_t ObjectPrefetcher::getMemoryUsage()const
+{
+	gLockMutex(&mutex);
+	size_t result = memoryUsage;
+	gUnlockMutex(&mutex);
+	return result;
+}
+
+size_t ObjectPrefetcher::getCount()const
+{
+	gLockMutex(&mutex);
+	size_t result = cache.size();
+	gUnlockMutex(&mutex);
+	return result;
+}
+
+bool ObjectPrefetcher::isTaken(const ::Ref & ref)const
+{
+	return ref.num >= 0 && (size_t)ref.num < taken.size() && taken[ref.num];
+}
+
+bool ObjectPrefetcher::makeRoom(size_t bytes)
+{
+	if(memoryUsage + bytes <= memoryLimit)
+		return true;
+
+	// evicts objects from older rounds - the oldest first
+	std::vector<Cache::iterator> old;
+	for(Cache::iterator i = cache.begin(); i != cache.end(); ++i)
+		if(i->second.round < round)
+			old.push_back(i);
+	std::stable_sort(old.begin(), old.end(), RoundOrder());
+	for(size_t i = 0; i < old.size() && memoryUsage + bytes > memoryLimit; ++i)
+	{
+		xpdf::freeXpdfObject(old[i]->second.obj);
+		memoryUsage -= old[i]->second.bytes;
+		cache.erase(old[i]);
+	}
+	return memoryUsage + bytes <= memoryLimit;
+}
+
+void ObjectPrefetcher::workerMain(void * data)
+{
+	using namespace debug;
+
+	// objects prefetched before a failure are kept
+	try
+	{
+		((ObjectPrefetcher *)data)->work();
+	}catch(std::exception & e)
+	{
+		kernelPrintDbg(DBG_ERR, "Prefetching failed: "<<e.what());
+	}catch(...)
+	{
+		kernelPrintDbg(DBG_ERR, "Prefetching failed");
+	}
+}
+
+void ObjectPrefetcher::work()
+{
+	::Object viewDict;
+	viewDict.initNull();
+	MemStream * view = new MemStream(const_cast<char *>(fileMap->getData()),
+			0, fileMap->getLength(), &viewDict);
+	ObjectStream * objStr = NULL;
+	std::set< ::Ref, xpdf::RefComparator> visited;
+	bool stopped = false;
+	size_t count = 0;
+
+	try
+	{
+		for(size_t p = 0; p < pages.size() && !stopped; ++p)
+		{
+			const ::Ref & page = pages[p];
+			std::deque< ::Ref> queue;
+			if(visited.insert(page).second)
+				queue.push_back(page);
+			while(!queue.empty() && !stopped)
+			{
+				::Ref ref = queue.front();
+				queue.pop_front();
+				std::vector< ::Ref> kids;
+
+				bool wanted, cached;
+				{
+					MutexLocker lock(mutex);
+					stopped = cancelled;
+					wanted = !isTaken(ref);
+					Cache::iterator i = cache.find(ref);
+					cached = i != cache.end();
+					if(cached)
+					{
+						// already prefetched - it is needed by this round as
+						// well
+						i->second.round = round;
+						kids = i->second.kids;
+					}
+				}
+				if(stopped)
+					break;
+
+				if(!cached)
+				{
+					// objects which have been taken already are parsed only
+					// to get their references
+					::Object obj;
+					if(!xref.fetchFrom(view, &objStr, ref.num, ref.gen, &obj)
+							|| obj.isNull() || ((ref.num != page.num 
+									|| ref.gen != page.gen) 
+								&& isPageTreeNode(obj)))
+					{
+						obj.free();
+						continue;
+					}
+					size_t bytes = OBJECT_OVERHEAD + inspect(obj, kids, xref, view);
+					if(wanted && bytes <= memoryLimit)
+					{
+						// parsed object may refer to the view, so it has to
+						// be cloned
+						::Object * cloneObj = obj.clone();
+						{
+							MutexLocker lock(mutex);
+							if(cloneObj && !isTaken(ref) && !cancelled)
+							{
+								if(makeRoom(bytes))
+								{
+									Entry & entry = cache[ref];
+									entry.obj = cloneObj;
+									entry.bytes = bytes;
+									entry.round = round;
+									entry.kids = kids;
+									memoryUsage += bytes;
+									cloneObj = NULL;
+									++count;
+								}else
+									// no more memory for this round
+									stopped = true;
+							}
+						}
+						if(cloneObj)
+							xpdf::freeXpdfObject(cloneObj);
+					}
+					obj.free();
+				}
+
+				for(size_t k = 0; k < kids.size(); ++k)
+					if(visited.insert(kids[k]).second)
+						queue.push_back(kids[k]);
+			}
+		}
+	}catch(...)
+	{
+		XRef::freeObjectStream(objStr);
+		delete view;
+		metrics::prefetchedObjects.add(count);
+		throw;
+	}
+
+	XRef::freeObjectStream(objStr);
+	delete view;
+	metrics::prefetchedObjects.add(count);
+}
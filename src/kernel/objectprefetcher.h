@@ -0,0 +1,162 @@
+/*
+ * PDFedit - free program for PDF document manipulation.
+ * Copyright (C) 2006-2009  PDFedit team: Michal Hocko,
+ *                                        Jozef Misutka,
+ *                                        Martin Petricek
+ *                   Former team members: Miroslav Jahoda
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (in doc/LICENSE.GPL); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA  02111-1307  USA
+ *
+ * Project is hosted on http://sourceforge.net/projects/pdfedit
+ */
+// vim:tabstop=4:shiftwidth=4:noexpandtab:textwidth=80
+#ifndef _OBJECTPREFETCHER_H_
+#define _OBJECTPREFETCHER_H_
+
+#include "kernel/xpdf.h"
+#include <goo/GMutex.h>
+#include <goo/GThread.h>
+
+class GFileMap;
+
+namespace pdfobjects
+{
+
+/** Background prefetcher of objects used by pages.
+ *
+ * Parses objects reachable from given page dictionaries (resources, fonts,
+ * content streams, images, annotations) on a background thread while the
+ * caller works with other pages. Objects are parsed by XRef::fetchFrom
+ * through a private view of the mapped document stream with its own object
+ * stream cache, so the worker doesn't share any mutable state with the
+ * XRef (the same way as CXref::parseObjects does).
+ * <br>
+ * Objects are traversed breadth first from each page in the given order, so
+ * that the first page is complete first. References which lead out of the
+ * page (Parent, P, Dest, A, B and Thumb entries, other page tree nodes) are
+ * not followed. Parsed objects are kept until they are taken by take
+ * method (each object is handed over only once) or until they are evicted.
+ * <br>
+ * Memory used by prefetched objects is limited. Objects from older rounds
+ * (see prefetch) are evicted first, the oldest ones at first. If there is
+ * still not enough memory, the round is stopped.
+ * <br>
+ * Prefetched objects reflect the document stream only, so the owner has to
+ * ignore them for changed objects and call clear whenever the cross
+ * reference table or the stream changes.
+ */
+class ObjectPrefetcher: noncopyable
+{
+public:
+	/** Type for references of page dictionaries. */
+	typedef std::vector< ::Ref> RefList;
+
+	/** Prefetched object. */
+	struct Entry
+	{
+		::Object * obj;					/**< Parsed object (deep copy). */
+		size_t bytes;					/**< Estimated memory size. */
+		unsigned round;					/**< Last round which needed it. */
+		std::vector< ::Ref> kids;		/**< References to follow. */
+	};
+
+	typedef std::map< ::Ref, Entry, xpdf::RefComparator> Cache;
+
+	/** Creates prefetcher.
+	 * @param xref Cross reference table of the document (has to live longer
+	 * than this instance).
+	 * @param str Document stream of the xref (it is mapped by prefetch).
+	 * @param memoryLimit Maximal memory used by prefetched objects (in
+	 * bytes).
+	 */
+	ObjectPrefetcher(const ::XRef & xref, BaseStream * str, size_t memoryLimit);
+
+	/** Stops worker and deallocates all prefetched objects.
+	 */
+	~ObjectPrefetcher();
+
+	/** Starts new prefetching round.
+	 * @param pageRefs References of page dictionaries in the priority
+	 * order.
+	 *
+	 * Stops the current round (already prefetched objects are kept) and
+	 * starts a background worker for given pages. Document stream is mapped
+	 * when it is needed for the first time (after clear). Does nothing if it
+	 * can't be mapped.
+	 */
+	void prefetch(const RefList & pageRefs);
+
+	/** Stops current round.
+	 * Waits for the worker thread and keeps prefetched objects.
+	 */
+	void stop();
+
+	/** Stops current round and deallocates all prefetched objects.
+	 * Also forgets which objects have been already taken and unmaps the
+	 * document stream.
+	 */
+	void clear();
+
+	/** Takes prefetched object.
+	 * @param ref Reference of the object.
+	 * @param obj Object to be initialized with the prefetched value (only
+	 * if found).
+	 *
+	 * Object is removed from the prefetcher and it is not prefetched again
+	 * (until clear is called), because the caller is supposed to keep its
+	 * own instance. Objects which have not been prefetched (yet) are not
+	 * marked, so they can be taken later.
+	 *
+	 * @return true if obj has been initialized, false otherwise.
+	 */
+	bool take(const ::Ref & ref, ::Object & obj);
+
+	/** Returns estimated memory used by prefetched objects.
+	 */
+	size_t getMemoryUsage()const;
+
+	/** Returns number of prefetched objects.
+	 */
+	size_t getCount()const;
+
+private:
+	const ::XRef & xref;
+	BaseStream * str;
+	size_t memoryLimit;
+
+	/** Protects all fields below. */
+	mutable GMutex mutex;
+	Cache cache;
+	size_t memoryUsage;
+	std::vector<bool> taken;
+	unsigned round;
+	bool cancelled;
+
+	// set by the calling thread, the worker only reads them while running
+	GThreadHandle thread;
+	bool running;
+	GFileMap * fileMap;
+	RefList pages;
+
+	/** Thread entry, no exception leaves it. */
+	static void workerMain(void * data);
+	void work();
+	bool isTaken(const ::Ref & ref)const;
+	bool makeRoom(size_t bytes);
+};
+
+} // namespace pdfobjects
+
+#endif // _OBJECTPREFETCHER_H_
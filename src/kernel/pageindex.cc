@@ -0,0 +1,358 @@
+/*
+ * PDFedit - free program for PDF document manipulation.
+ * Copyright (C) 2006-2009  PDFedit team: Michal Hocko,
+ *                                        Jozef Misutka,
+ *                                        Martin Petricek
+ *                   Former team members: Miroslav Jahoda
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (in doc/LICENSE.GPL); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA  02111-1307  USA
+ *
+ * Project is hosted on http://sourceforge.net/projects/pdfedit
+ */
+// vim:tabstop=4:shiftwidth=4:noexpandtab:textwidth=80
+#include "kernel/static.h"
+
+#include "kernel/pageindex.h"
+
+namespace pdfobjects
+{
+
+PageIndex::PageIndex()
+	:root(NULL), seed(1), valid(false), validEntries(0), staleLookups(0)
+{
+}
+
+PageIndex::~PageIndex()
+{
+	destroy(root, NULL);
+}
+
+void PageIndex::update(Entry * entry)
+{
+	entry->size=1+getSize(entry->left)+getSize(entry->right);
+	if(entry->left)
+		entry->left->parent=entry;
+	if(entry->right)
+		entry->right->parent=entry;
+}
+
+PageIndex::Entry * PageIndex::merge(Entry * left, Entry * right)
+{
+	if(!left)
+		return right;
+	if(!right)
+		return left;
+	if(left->priority > right->priority)
+	{
+		left->right=merge(left->right, right);
+		update(left);
+		return left;
+	}
+	right->left=merge(left, right->left);
+	update(right);
+	return right;
+}
+
+void PageIndex::split(Entry * entry, size_t count, Entry *& left, Entry *& right)
+{
+	if(!entry)
+	{
+		left=right=NULL;
+		return;
+	}
+	if(getSize(entry->left) >= count)
+	{
+		split(entry->left, count, left, entry->left);
+		update(entry);
+		right=entry;
+	}else
+	{
+		split(entry->right, count-getSize(entry->left)-1, entry->right, right);
+		update(entry);
+		left=entry;
+	}
+}
+
+PageIndex::Entry * PageIndex::first(Entry * entry)
+{
+	if(entry)
+		while(entry->left)
+			entry=entry->left;
+	return entry;
+}
+
+PageIndex::Entry * PageIndex::next(Entry * entry)
+{
+	// leftmost entry of the right subtree or the nearest parent where we
+	// come from the left
+	if(entry->right)
+		return first(entry->right);
+	while(entry->parent && entry==entry->parent->right)
+		entry=entry->parent;
+	return entry->parent;
+}
+
+void PageIndex::destroy(Entry * entry, PageStorage * pages)
+{
+	// left subtrees are rotated to the right until the leftmost entry is
+	// on the top, so entries are deleted in the document order and parent
+	// links (which would point to already deleted entries) are not used
+	while(entry)
+	{
+		if(entry->left)
+		{
+			Entry * left=entry->left;
+			entry->left=left->right;
+			left->right=entry;
+			entry=left;
+			continue;
+		}
+		Entry * right=entry->right;
+		if(pages && entry->page)
+			pages->push_back(entry->page);
+		delete entry;
+		entry=right;
+	}
+}
+
+PageIndex::Entry * PageIndex::getEntry(size_t pos)const
+{
+	assert(pos < size());
+	if(pos < validEntries)
+		return entries[pos];
+
+	// stale part is collected again when lookups into it have cost about
+	// the same as the collecting would, until then the treap is searched
+	if(++staleLookups*STALE_LOOKUP_COST >= size()-validEntries)
+	{
+		// entries before the last structural change are still on their
+		// positions
+		entries.resize(size());
+		Entry * entry=(validEntries)?next(entries[validEntries-1]):first(root);
+		for(; validEntries<entries.size(); ++validEntries, entry=next(entry))
+		{
+			entry->pos=validEntries;
+			entries[validEntries]=entry;
+		}
+		staleLookups=0;
+		return entries[pos];
+	}
+
+	Entry * entry=root;
+	for(;;)
+	{
+		size_t leftSize=getSize(entry->left);
+		if(pos==leftSize)
+			return entry;
+		if(pos<leftSize)
+			entry=entry->left;
+		else
+		{
+			pos-=leftSize+1;
+			entry=entry->right;
+		}
+	}
+}
+
+size_t PageIndex::getPosition(const Entry * entry)const
+{
+	if(entry->pos < validEntries && entries[entry->pos]==entry)
+		return entry->pos;
+
+	// stale entry - number of entries in the left subtree and all left
+	// subtrees (plus parent node) on the path to the root where we come
+	// from the right
+	size_t pos=getSize(entry->left);
+	for(; entry->parent; entry=entry->parent)
+		if(entry==entry->parent->right)
+			pos+=getSize(entry->parent->left)+1;
+	return pos;
+}
+
+void PageIndex::addRef(Entry * entry)
+{
+	RefMapping::iterator i=refMapping.find(entry->ref);
+	if(i==refMapping.end())
+	{
+		RefInfo info={entry, 1};
+		refMapping.insert(RefMapping::value_type(entry->ref, info));
+		return;
+	}
+	++i->second.count;
+	i->second.entry=NULL;
+}
+
+void PageIndex::removeRef(const IndiRef & ref)
+{
+	RefMapping::iterator i=refMapping.find(ref);
+	assert(i!=refMapping.end());
+	if(!--i->second.count)
+	{
+		refMapping.erase(i);
+		return;
+	}
+	if(i->second.count==1)
+	{
+		// reference is not ambiguous anymore, finds the remaining entry.
+		// This happens only for broken page trees.
+		for(Entry * entry=first(root); entry; entry=next(entry))
+			if(entry->ref==ref)
+			{
+				i->second.entry=entry;
+				break;
+			}
+	}
+}
+
+size_t PageIndex::getRefCount(const IndiRef & ref)const
+{
+	RefMapping::const_iterator i=refMapping.find(ref);
+	return (i!=refMapping.end())?i->second.count:0;
+}
+
+bool PageIndex::findRef(const IndiRef & ref, size_t & pos)const
+{
+	RefMapping::const_iterator i=refMapping.find(ref);
+	if(i==refMapping.end() || i->second.count!=1)
+		return false;
+	pos=getPosition(i->second.entry);
+	return true;
+}
+
+bool PageIndex::findPage(const IndiRef & ref, const boost::shared_ptr<CPage> & page, size_t & pos)const
+{
+	RefMapping::const_iterator i=refMapping.find(ref);
+	if(!page || i==refMapping.end())
+		return false;
+	if(i->second.count==1)
+	{
+		if(i->second.entry->page!=page)
+			return false;
+		pos=getPosition(i->second.entry);
+		return true;
+	}
+
+	// ambiguous reference, we have to check all entries
+	size_t j=0;
+	for(Entry * entry=first(root); entry; entry=next(entry), ++j)
+		if(entry->page==page)
+		{
+			pos=j;
+			return true;
+		}
+	return false;
+}
+
+void PageIndex::getRefs(RefList & refs)const
+{
+	refs.reserve(refs.size()+size());
+	for(Entry * entry=first(root); entry; entry=next(entry))
+		refs.push_back(entry->ref);
+}
+
+void PageIndex::insert(size_t pos, const RefList & refs)
+{
+	assert(pos <= size());
+	if(refs.empty())
+		return;
+
+	// creates treap from new entries
+	Entry * newRoot=NULL;
+	for(RefList::const_iterator i=refs.begin(); i!=refs.end(); ++i)
+	{
+		Entry * entry=new Entry;
+		entry->ref=*i;
+		entry->left=entry->right=entry->parent=NULL;
+		seed=seed*1103515245+12345;
+		entry->priority=seed;
+		entry->size=1;
+		entry->pos=0;
+		newRoot=merge(newRoot, entry);
+		addRef(entry);
+	}
+
+	// and puts it to the given position
+	validEntries=std::min(validEntries, pos);
+	Entry * left, * right;
+	split(root, pos, left, right);
+	root=merge(merge(left, newRoot), right);
+	root->parent=NULL;
+}
+
+void PageIndex::remove(size_t pos, size_t count, PageStorage & pages)
+{
+	assert(pos+count <= size());
+	if(!count)
+		return;
+
+	validEntries=std::min(validEntries, pos);
+	Entry * left, * middle, * right;
+	split(root, pos, left, middle);
+	split(middle, count, middle, right);
+	root=merge(left, right);
+	if(root)
+		root->parent=NULL;
+
+	// references are removed when the removed entries are not in the tree
+	// anymore, so that removeRef finds only remaining entries
+	middle->parent=NULL;
+	for(Entry * entry=first(middle); entry; entry=next(entry))
+		removeRef(entry->ref);
+	destroy(middle, &pages);
+}
+
+void PageIndex::clear(PageStorage & pages)
+{
+	destroy(root, &pages);
+	refMapping.clear();
+	root=NULL;
+	valid=false;
+	entries.clear();
+	validEntries=0;
+	staleLookups=0;
+}
+
+void PageIndex::assign(const RefList & refs, PageStorage & pages)
+{
+	// collects page instances which can be taken over - their
+	// reference has to be unique
+	typedef std::map<IndiRef, boost::shared_ptr<CPage>, utils::IndComparator> PageMapping;
+	PageMapping oldPages;
+	for(Entry * entry=first(root); entry; entry=next(entry))
+	{
+		boost::shared_ptr<CPage> page=entry->page;
+		if(!page)
+			continue;
+		if(getRefCount(entry->ref)==1)
+			oldPages.insert(PageMapping::value_type(entry->ref, page));
+		else
+			pages.push_back(page);
+		entry->page.reset();
+	}
+	clear(pages);
+
+	insert(0, refs);
+	for(PageMapping::iterator i=oldPages.begin(); i!=oldPages.end(); ++i)
+	{
+		RefMapping::iterator info=refMapping.find(i->first);
+		if(info!=refMapping.end() && info->second.count==1)
+			info->second.entry->page=i->second;
+		else
+			pages.push_back(i->second);
+	}
+	valid=true;
+}
+
+} // namespace pdfobjects
@@ -0,0 +1,274 @@
+/*
+ * PDFedit - free program for PDF document manipulation.
+ * Copyright (C) 2006-2009  PDFedit team: Michal Hocko,
+ *                                        Jozef Misutka,
+ *                                        Martin Petricek
+ *                   Former team members: Miroslav Jahoda
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (in doc/LICENSE.GPL); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA  02111-1307  USA
+ *
+ * Project is hosted on http://sourceforge.net/projects/pdfedit
+ */
+// vim:tabstop=4:shiftwidth=4:noexpandtab:textwidth=80
+
+#ifndef __PAGEINDEX_H__
+#define __PAGEINDEX_H__
+
+#include "kernel/static.h"
+#include "kernel/indiref.h"
+
+// =============================================================================
+namespace pdfobjects {
+
+class CPage;
+
+/** Index of document pages.
+ *
+ * Holds references of all page dictionaries (leaf nodes of the page tree) in
+ * the document order together with CPage instances which were already
+ * returned for them. Index positions are counted from 0.
+ * <br>
+ * Entries are nodes of an implicit treap (balanced binary tree ordered by
+ * position, where each node knows the size of its subtree), so that pages
+ * can be inserted or removed in logarithmic time without renumbering all
+ * following entries.
+ * <br>
+ * Positional access (getRef, getPage, setPage) and positions of entries
+ * (findRef, findPage) use an array of entries in the document order, so they
+ * take constant time while the page tree is not changed (e.g. page
+ * iteration). Array is not updated by insert and remove, which just mark
+ * entries from the changed position as stale. Lookups into the stale part
+ * search the treap (logarithmic time) until they have cost about as much as
+ * collecting of the stale entries, then the array is collected again. So
+ * editing mixed with a few lookups (e.g. random page reordering) doesn't
+ * pay the linear collecting after each change.
+ * <br>
+ * The same page dictionary may be referenced from more places of the page
+ * tree (ambiguous page tree). Such references are counted but they can't be
+ * found by findRef.
+ * <br>
+ * Index is maintained by CPdf, which keeps it synchronized with the page tree.
+ * Whenever the synchronization is not possible, the index is marked as
+ * invalid and it is rebuilt from scratch by assign method.
+ */
+class PageIndex: public noncopyable
+{
+public:
+	/** Type for list of page dictionary references. */
+	typedef std::vector<IndiRef> RefList;
+
+	/** Type for list of page instances. */
+	typedef std::vector<boost::shared_ptr<CPage> > PageStorage;
+
+private:
+	/** Index entry.
+	 * Entry is also treap node.
+	 */
+	struct Entry
+	{
+		IndiRef ref;						/**< Page dictionary reference. */
+		boost::shared_ptr<CPage> page;		/**< Returned page instance. */
+		Entry * left;						/**< Left subtree. */
+		Entry * right;						/**< Right subtree. */
+		Entry * parent;						/**< Parent node. */
+		unsigned int priority;				/**< Heap priority. */
+		size_t size;						/**< Size of the subtree. */
+		size_t pos;							/**< Position in entries array. */
+	};
+
+	/** Information about page dictionary reference.
+	 */
+	struct RefInfo
+	{
+		/** Entry with the reference (valid only if count is 1). */
+		Entry * entry;
+		/** Number of entries with the reference. */
+		size_t count;
+	};
+
+	/** Type for reference to entry mapping. */
+	typedef std::map<IndiRef, RefInfo, utils::IndComparator> RefMapping;
+
+	/** Root of the treap. */
+	Entry * root;
+
+	/** Reference to entry mapping. */
+	RefMapping refMapping;
+
+	/** Seed for treap priorities. */
+	unsigned int seed;
+
+	/** Flag whether index is synchronized with page tree. */
+	bool valid;
+
+	/** Entries in the document order.
+	 * Only first validEntries items are up to date (see getEntry).
+	 */
+	mutable std::vector<Entry *> entries;
+
+	/** Number of up to date items in entries. */
+	mutable size_t validEntries;
+
+	/** Number of lookups behind validEntries since entries were collected.
+	 */
+	mutable size_t staleLookups;
+
+	/** Cost of one treap lookup compared to collecting of one entry. */
+	static const size_t STALE_LOOKUP_COST=32;
+
+	static size_t getSize(Entry * entry)
+	{
+		return (entry)?entry->size:0;
+	}
+	static void update(Entry * entry);
+	static Entry * merge(Entry * left, Entry * right);
+	static void split(Entry * entry, size_t count, Entry *& left, Entry *& right);
+	static Entry * first(Entry * entry);
+	static Entry * next(Entry * entry);
+	static void destroy(Entry * entry, PageStorage * pages);
+	Entry * getEntry(size_t pos)const;
+	size_t getPosition(const Entry * entry)const;
+	void addRef(Entry * entry);
+	void removeRef(const IndiRef & ref);
+
+public:
+	/** Initialization constructor.
+	 * Creates empty invalid index.
+	 */
+	PageIndex();
+
+	/** Destructor.
+	 * Deallocates all entries.
+	 */
+	~PageIndex();
+
+	/** Checks whether index is synchronized with page tree.
+	 * @return true if index is valid, false otherwise.
+	 */
+	bool isValid()const
+	{
+		return valid;
+	}
+
+	/** Marks index as not synchronized with page tree.
+	 * Content is kept, so that page instances can be taken over by assign.
+	 */
+	void invalidate()
+	{
+		valid=false;
+	}
+
+	/** Returns number of entries.
+	 * @return number of pages in index.
+	 */
+	size_t size()const
+	{
+		return getSize(root);
+	}
+
+	/** Returns page dictionary reference at given position.
+	 * @param pos Position (must be in range).
+	 * @return Page dictionary reference.
+	 */
+	const IndiRef & getRef(size_t pos)const
+	{
+		return getEntry(pos)->ref;
+	}
+
+	/** Returns all page dictionary references.
+	 * @param refs Vector where references are added in the document order.
+	 */
+	void getRefs(RefList & refs)const;
+
+	/** Returns page instance at given position.
+	 * @param pos Position (must be in range).
+	 * @return Page instance or NULL pointer if no instance was set yet.
+	 */
+	boost::shared_ptr<CPage> getPage(size_t pos)const
+	{
+		return getEntry(pos)->page;
+	}
+
+	/** Sets page instance at given position.
+	 * @param pos Position (must be in range).
+	 * @param page Page instance.
+	 */
+	void setPage(size_t pos, const boost::shared_ptr<CPage> & page)
+	{
+		getEntry(pos)->page=page;
+	}
+
+	/** Returns number of entries with given reference.
+	 * @param ref Page dictionary reference.
+	 * @return 0 if reference is not in index, 1 if it is unique and more
+	 * if it is ambiguous.
+	 */
+	size_t getRefCount(const IndiRef & ref)const;
+
+	/** Gets position of page dictionary reference.
+	 * @param ref Page dictionary reference.
+	 * @param pos Position of the reference (set only on success).
+	 *
+	 * @return true if reference is in index just once, false otherwise.
+	 */
+	bool findRef(const IndiRef & ref, size_t & pos)const;
+
+	/** Gets position of page instance.
+	 * @param ref Reference of page dictionary.
+	 * @param page Page instance.
+	 * @param pos Position of the page (set only on success).
+	 *
+	 * @return true if page instance is stored in index, false otherwise.
+	 */
+	bool findPage(const IndiRef & ref, const boost::shared_ptr<CPage> & page, size_t & pos)const;
+
+	/** Inserts page dictionary references.
+	 * @param pos Position of the first inserted reference (must be in
+	 * [0, size()] range).
+	 * @param refs References to insert.
+	 */
+	void insert(size_t pos, const RefList & refs);
+
+	/** Removes entries.
+	 * @param pos Position of the first removed entry.
+	 * @param count Number of removed entries (pos+count must be in range).
+	 * @param pages Storage where page instances of removed entries are added.
+	 */
+	void remove(size_t pos, size_t count, PageStorage & pages);
+
+	/** Removes all entries.
+	 * @param pages Storage where all page instances are added.
+	 *
+	 * Index is invalid after this method.
+	 */
+	void clear(PageStorage & pages);
+
+	/** Fills index with given references.
+	 * @param refs References of all pages in the document order.
+	 * @param pages Storage where page instances which couldn't be taken over
+	 * are added.
+	 *
+	 * Page instances of the current content are taken over by new entries if
+	 * their reference is unique both in current content and given refs. All
+	 * other page instances are added to the given storage.
+	 * <br>
+	 * Index is valid after this method.
+	 */
+	void assign(const RefList & refs, PageStorage & pages);
+};
+
+} // namespace pdfobjects
+
+#endif // __PAGEINDEX_H__
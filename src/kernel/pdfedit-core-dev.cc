@@ -24,11 +24,36 @@
 #include <errno.h>
 #include "kernel/pdfedit-core-dev.h"
 #include "kernel/pdfwriter.h"
+#include "kernel/metrics.h"
+#include "kernel/xrefcache.h"
 
 static bool initialized = false;
 using namespace pdfobjects;
 using namespace utils;
 
+/** Metrics format from command line parameters. */
+static std::string metrics_format;
+/** Metrics output file from command line parameters. */
+static std::string metrics_file;
+/** Flag for xref sidecars from command line parameters. */
+static bool xref_cache = false;
+
+/** Checks whether parameter has given name and gets its value.
+ * @param arg Parameter.
+ * @param name Parameter name including =.
+ * @param value Value of the parameter (set only on match).
+ *
+ * @return true if parameter matches, false otherwise.
+ */
+static bool match_param(const char *arg, const char *name, std::string &value)
+{
+	size_t len = strlen(name);
+	if(strncmp(arg, name, len))
+		return false;
+	value = arg + len;
+	return true;
+}
+
 /** Parse command line parameters relevant for pdfedit-core-dev.
  * @param argc Pointer to the argv elements count (ignored if NULL).
  * @param argv Pointer to arguments array (ignoder if NULL).
@@ -46,10 +71,60 @@ static int parse_command_line(int *argc, char ***argv)
 	// argc, argv have to be either both NULL or nonNULL
 	if((!argc && argv) || (!argv && argc))
 		return -EINVAL;
-	// Nothing to do at the moment.
+	if(!argc)
+		return 0;
+
+	// removes recognized parameters (the first one is program name)
+	int dest = 1;
+	for(int i = 1; i < *argc; ++i)
+	{
+		const char *arg = (*argv)[i];
+		if(match_param(arg, "--metrics=", metrics_format) ||
+				match_param(arg, "--metrics-file=", metrics_file))
+			continue;
+		if(!strcmp(arg, "--xref-cache"))
+		{
+			xref_cache = true;
+			continue;
+		}
+		(*argv)[dest++] = (*argv)[i];
+	}
+	if(dest < *argc)
+		(*argv)[dest] = NULL;
+	*argc = (*argc) ? dest : 0;
 	return 0;
 }
 
+/** Sets up metrics dump if required.
+ * Command line parameters take precedence over environment variables.
+ *
+ * @return 0 on success, -error otherwise.
+ */
+static int init_metrics()
+{
+	std::string format = metrics_format;
+	std::string file = metrics_file;
+	const char *env;
+	if(format.empty() && (env = getenv("PDFEDIT_METRICS")))
+		format = env;
+	if(file.empty() && (env = getenv("PDFEDIT_METRICS_FILE")))
+		file = env;
+	if(format.empty())
+		return 0;
+	return (metrics::setupDump(format, file)) ? 0 : -EINVAL;
+}
+
+/** Enables xref sidecars if required.
+ * Sidecars are enabled by --xref-cache command line parameter or by
+ * PDFEDIT_XREF_CACHE environment variable with non 0 value.
+ */
+static void init_xref_cache()
+{
+	const char *env = getenv("PDFEDIT_XREF_CACHE");
+	if(xref_cache || (env && *env && strcmp(env, "0")))
+		xrefcache::setEnabled(true);
+}
+
 /** Initializes all xpdf core related stuff.
  * @param init Initialization structure (use default when NULL).
  *
@@ -93,11 +168,19 @@ int pdfedit_core_dev_init(int *argc, char ***argv, const struct pdfedit_core_dev
 	if((ret = init_xpdf_core(init)))
 		return ret;
 
+	if((ret = init_metrics()))
+		return ret;
+	init_xref_cache();
+
 	init_stream_filterwriters();
 	initialized = true;
 	return 0;
 }
 
+int pdfedit_core_dev_parse_args(int *argc, char ***argv)
+{
+	return parse_command_line(argc, argv);
+}
 bool pdfedit_core_dev_init_check()
 {
 	return initialized;
@@ -46,8 +46,8 @@ struct pdfedit_core_dev_init
  * library is called. All global wide configuration is done here (and only
  * here).
  * <br>
- * At this moment, it contains only xpdf core initialization (globalParams
- * and base fonts).
+ * At this moment, it contains xpdf core initialization (globalParams
+ * and base fonts), metrics and xref sidecar setup.
  * <br>
  * Function can be called with no parameters and all required values for
  * initialization will be set to default values. Nevertheless, it is highly
@@ -74,8 +74,21 @@ struct pdfedit_core_dev_init
  * <br>
  * If some of argc parameters are used by initialization code, they are
  * removed from the array and argc value is decreased appropriatelly.
+ * Recognized parameters are:
+ * <ul>
+ * <li>--metrics=FORMAT - enables metrics and dumps them in given format 
+ * (json or prometheus) at exit and on SIGUSR1 (see metrics::setupDump). 
+ * PDFEDIT_METRICS environment variable has the same meaning.
+ * <li>--metrics-file=FILE - file for metrics dump (standard error output 
+ * by default). PDFEDIT_METRICS_FILE environment variable has the same 
+ * meaning.
+ * <li>--xref-cache - enables xref sidecar files (see xrefcache::setEnabled).
+ * PDFEDIT_XREF_CACHE environment variable with non 0 value has the same
+ * meaning.
+ * </ul>
  * It is recommended to call this function before any command line parameters
- * are handled by application.
+ * are handled by application (or to call pdfedit_core_dev_parse_args if it
+ * is not possible).
  * <br>
  * If either argc or argv is NULL they must be NULL both of them. Also *argv
  * array must contain at least argc numbers of elements. Any violation of
@@ -93,6 +106,21 @@ struct pdfedit_core_dev_init
 int pdfedit_core_dev_init(int *argc=NULL, char ***argv=NULL, const struct pdfedit_core_dev_init * init=NULL)
 	WARN_UNUSED_RESULT;
 
+/** Removes parameters recognized by pdfedit_core_dev_init from argv.
+ * @param argc Pointer to the argv elements count.
+ * @param argv Pointer to arguments array.
+ *
+ * Recognized values are remembered and used by the following
+ * pdfedit_core_dev_init call, which can get the same (already stripped)
+ * argc and argv. This is useful for applications which have to parse
+ * their own command line parameters (and would reject unknown ones)
+ * before pdfedit_core_dev_init can be called.
+ *
+ * @return 0 on success, -error code otherwise (same rules for argc and argv
+ * as for pdfedit_core_dev_init apply).
+ */
+int pdfedit_core_dev_parse_args(int *argc, char ***argv)WARN_UNUSED_RESULT;
+
 /** Checks whether global pdfedit_core_dev_init has been called.
  * This method is for internal purposes only and should be called by all
  * methods which could possible deal with global wide configuration (e.g.
@@ -814,6 +814,14 @@ void OldStylePdfWriter::reset()
 	maxObjNum=0;
 }
 
+bool OldStylePdfWriter::getObjectOffsets(OffsetList & offsets)const
+{
+	offsets.reserve(offsets.size()+offTable.size());
+	for(OffsetTab::const_iterator i=offTable.begin(); i!=offTable.end(); ++i)
+		offsets.push_back(*i);
+	return true;
+}
+
 FileStreamData* PdfDocumentWriter::getStreamData(const char *fileName)
 {
 using namespace debug;
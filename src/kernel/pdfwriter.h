@@ -489,6 +489,27 @@ public:
 	 * cleared here.
 	 */
 	virtual void reset()=0;
+
+	/** Type for offsets of written objects.
+	 * Pairs of object reference and stream offset where it has been written.
+	 */
+	typedef std::vector<std::pair< ::Ref, size_t> > OffsetList;
+
+	/** Provides offsets of objects stored by writeContent.
+	 * @param offsets List where offsets of all objects stored since the last
+	 * reset are added.
+	 *
+	 * Has to be called before writeTrailer which resets collected data. 
+	 * Offsets are used to update cross reference table of the document
+	 * without parsing the written section. Default implementation doesn't
+	 * provide offsets.
+	 *
+	 * @return true if offsets have been provided, false otherwise.
+	 */
+	virtual bool getObjectOffsets(UNUSED_PARAM OffsetList & offsets)const
+	{
+		return false;
+	}
 };
 
 /** Implementator of old style cross reference table pdf writer.
@@ -629,6 +650,15 @@ public:
 	 * revision.
 	 */
 	virtual void reset();
+
+	/** Provides offsets of objects stored by writeContent.
+	 * @param offsets List where offsets of stored objects are added.
+	 *
+	 * Objects are provided from offTable in increasing reference order.
+	 *
+	 * @return always true.
+	 */
+	virtual bool getObjectOffsets(OffsetList & offsets)const;
 };
 
 /** Helper data structure which keeps all file stream related data.
@@ -0,0 +1,454 @@
+/*
+ * PDFedit - free program for PDF document manipulation.
+ * Copyright (C) 2006-2009  PDFedit team: Michal Hocko,
+ *                                        Jozef Misutka,
+ *                                        Martin Petricek
+ *                   Former team members: Miroslav Jahoda
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (in doc/LICENSE.GPL); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA  02111-1307  USA
+ *
+ * Project is hosted on http://sourceforge.net/projects/pdfedit
+ */
+// vim:tabstop=4:shiftwidth=4:noexpandtab:textwidth=80
+#include "kernel/static.h" // WIN32 port - precompiled headers - REMOVE IN FUTURE!
+#include <string.h>
+#include <sstream>
+#include "kernel/revisiondiff.h"
+#include "kernel/indirefmap.h"
+#include "kernel/exceptions.h"
+#include "kernel/factories.h"
+#include "utils/debug.h"
+
+using namespace pdfobjects;
+using namespace utils;
+
+namespace {
+
+/** Compares dictionaries entry by entry.
+ * @param from Source dictionary.
+ * @param to Target dictionary.
+ * @param diffs List where differences are added.
+ * @param path Path of dictionaries.
+ */
+void diffDicts(const ::Dict & from, const ::Dict & to, ObjectDiffs & diffs, const std::string & path)
+{
+	::Object fromValue, toValue;
+	for(int i=0; i<from.getLength(); ++i)
+	{
+		const char * key=from.getKey(i);
+		std::string keyPath=path+"/"+key;
+		to.lookupNF(key, &toValue);
+		if(toValue.isNull())
+			diffs.push_back(ObjectDiff(keyPath, ObjectDiff::entryRemoved));
+		else
+		{
+			from.getValNF(i, &fromValue);
+			diffObjects(fromValue, toValue, diffs, keyPath);
+			fromValue.free();
+		}
+		toValue.free();
+	}
+	for(int i=0; i<to.getLength(); ++i)
+	{
+		const char * key=to.getKey(i);
+		from.lookupNF(key, &fromValue);
+		if(fromValue.isNull())
+			diffs.push_back(ObjectDiff(path+"/"+key, ObjectDiff::entryAdded));
+		fromValue.free();
+	}
+}
+
+/** Compares raw data of streams.
+ * @return true if data are the same.
+ */
+bool sameStreamData(const ::Object & from, const ::Object & to)
+{
+	::BaseStream * fromStr=from.getStream()->getBaseStream();
+	::BaseStream * toStr=to.getStream()->getBaseStream();
+	fromStr->reset();
+	toStr->reset();
+	int c;
+	bool same=true;
+	while((c=fromStr->getChar())!=EOF)
+		if(c!=toStr->getChar())
+		{
+			same=false;
+			break;
+		}
+	if(same && toStr->getChar()!=EOF)
+		same=false;
+	fromStr->close();
+	toStr->close();
+	return same;
+}
+
+/** Checks whether simple objects of the same type have the same value.
+ */
+bool sameValue(const ::Object & from, const ::Object & to)
+{
+	switch(from.getType())
+	{
+		case objBool:
+			return from.getBool()==to.getBool();
+		case objInt:
+			return from.getInt()==to.getInt();
+		case objReal:
+			return from.getReal()==to.getReal();
+		case objString:
+			return !from.getString()->cmp(to.getString());
+		case objName:
+			return !strcmp(from.getName(), to.getName());
+		case objRef:
+			return from.getRefNum()==to.getRefNum() && from.getRefGen()==to.getRefGen();
+		default:
+			return true;
+	}
+}
+
+/** Checks whether dictionary depends on some of searched objects.
+ * @param xref Xref used to fetch referenced objects.
+ * @param dict Dictionary to examine.
+ * @param deps Examination state.
+ *
+ * Parent and Kids entries (page tree and fields hierarchy) are not followed.
+ *
+ * @return true if dictionary refers (even indirectly) to some of searched
+ * objects.
+ */
+bool dictDependsOnObjects(::XRef & xref, const ::Dict & dict, PageDependencies & deps);
+
+/** Checks whether object depends on some of searched objects.
+ * @param xref Xref used to fetch referenced objects.
+ * @param obj Object to examine.
+ * @param deps Examination state.
+ *
+ * Follows all references but ignores page dictionaries, because they are
+ * only referred (e.g. by link annotations or article beads) and their content
+ * doesn't influence the examined object.
+ *
+ * @return true if object refers (even indirectly) to some of searched
+ * objects.
+ */
+bool dependsOnObjects(::XRef & xref, const ::Object & obj, PageDependencies & deps)
+{
+	switch(obj.getType())
+	{
+		case objArray:
+		{
+			boost::shared_ptr< ::Object> elem(XPdfObjectFactory::getInstance(), xpdf::object_deleter());
+			for(int i=0; i<obj.arrayGetLength(); ++i)
+			{
+				obj.arrayGetNF(i, elem.get());
+				bool found=dependsOnObjects(xref, *elem, deps);
+				elem->free();
+				if(found)
+					return true;
+			}
+			return false;
+		}
+		case objDict:
+			return dictDependsOnObjects(xref, *obj.getDict(), deps);
+		case objStream:
+			return dictDependsOnObjects(xref, *obj.streamGetDict(), deps);
+		case objRef:
+		{
+			int num=obj.getRefNum();
+			if(deps.independent.count(num) || !deps.seen.insert(num).second)
+				return false;
+			boost::shared_ptr< ::Object> target(XPdfObjectFactory::getInstance(), xpdf::object_deleter());
+			xref.fetch(num, obj.getRefGen(), target.get());
+			if(target->isDict("Page"))
+			{
+				// page is not examined, so it can't be considered independent
+				deps.seen.erase(num);
+				return false;
+			}
+			if(deps.nums.count(num))
+				return true;
+			return dependsOnObjects(xref, *target, deps);
+		}
+		default:
+			return false;
+	}
+}
+
+bool dictDependsOnObjects(::XRef & xref, const ::Dict & dict, PageDependencies & deps)
+{
+	boost::shared_ptr< ::Object> elem(XPdfObjectFactory::getInstance(), xpdf::object_deleter());
+	for(int i=0; i<dict.getLength(); ++i)
+	{
+		const char * key=dict.getKey(i);
+		if(!strcmp(key, "Parent") || !strcmp(key, "Kids"))
+			continue;
+		dict.getValNF(i, elem.get());
+		bool found=dependsOnObjects(xref, *elem, deps);
+		elem->free();
+		if(found)
+			return true;
+	}
+	return false;
+}
+
+/** Collects all pages from the page tree.
+ * @param xref Xref used to fetch page tree nodes.
+ * @param nodeRef Reference of the page tree node.
+ * @param pageRefs List where page references are added in document order.
+ * @param treeRefs Already visited nodes (cycles protection).
+ */
+void collectPageRefs(::XRef & xref, const IndiRef & nodeRef, std::vector<IndiRef> & pageRefs, 
+		XRefWriter::ObjectNumSet & treeRefs)
+{
+	if(!treeRefs.insert(nodeRef.num).second)
+	{
+		utilsPrintDbg(debug::DBG_WARN, "Page tree node "<<nodeRef<<" already seen. Skipping.");
+		return;
+	}
+	::Object node, type, kids;
+	xref.fetch(nodeRef.num, nodeRef.gen, &node);
+	if(!node.isDict())
+	{
+		utilsPrintDbg(debug::DBG_WARN, "Page tree node "<<nodeRef<<" is not a dictionary. Skipping.");
+		node.free();
+		return;
+	}
+	node.dictLookup("Type", &type);
+	node.dictLookup("Kids", &kids);
+	node.free();
+	if(type.isName("Page") || (!type.isName("Pages") && !kids.isArray()))
+		pageRefs.push_back(nodeRef);
+	else if(kids.isArray())
+	{
+		::Object kid;
+		for(int i=0; i<kids.arrayGetLength(); ++i)
+		{
+			if(kids.arrayGetNF(i, &kid)->isRef())
+				collectPageRefs(xref, IndiRef(kid.getRef()), pageRefs, treeRefs);
+			kid.free();
+		}
+	}
+	type.free();
+	kids.free();
+}
+
+/** Collects all pages of the document.
+ * @param xref Xref of the document revision.
+ * @param pageRefs List where page references are added in document order.
+ */
+void collectPageRefs(::XRef & xref, std::vector<IndiRef> & pageRefs)
+{
+	::Object catalog, pages;
+	xref.getTrailerDict()->dictLookup("Root", &catalog);
+	if(catalog.isDict())
+		catalog.dictLookupNF("Pages", &pages);
+	if(pages.isRef())
+	{
+		XRefWriter::ObjectNumSet treeRefs;
+		collectPageRefs(xref, IndiRef(pages.getRef()), pageRefs, treeRefs);
+	}else
+		utilsPrintDbg(debug::DBG_ERR, "Document catalog doesn't refer page tree");
+	catalog.free();
+	pages.free();
+}
+
+} // annonymous namespace
+
+namespace pdfobjects {
+namespace utils {
+
+void diffObjects(const ::Object & from, const ::Object & to, ObjectDiffs & diffs, const std::string & path)
+{
+	if(from.getType()!=to.getType())
+	{
+		diffs.push_back(ObjectDiff(path, ObjectDiff::typeChanged));
+		return;
+	}
+	switch(from.getType())
+	{
+		case objArray:
+		{
+			int fromLen=from.arrayGetLength();
+			int toLen=to.arrayGetLength();
+			if(fromLen!=toLen)
+				diffs.push_back(ObjectDiff(path, ObjectDiff::lengthChanged));
+			::Object fromElem, toElem;
+			for(int i=0; i<std::min(fromLen, toLen); ++i)
+			{
+				std::ostringstream elemPath;
+				elemPath<<path<<"["<<i<<"]";
+				from.arrayGetNF(i, &fromElem);
+				to.arrayGetNF(i, &toElem);
+				diffObjects(fromElem, toElem, diffs, elemPath.str());
+				fromElem.free();
+				toElem.free();
+			}
+			break;
+		}
+		case objDict:
+			diffDicts(*from.getDict(), *to.getDict(), diffs, path);
+			break;
+		case objStream:
+			diffDicts(*from.streamGetDict(), *to.streamGetDict(), diffs, path);
+			if(!sameStreamData(from, to))
+				diffs.push_back(ObjectDiff(path, ObjectDiff::dataChanged));
+			break;
+		default:
+			if(!sameValue(from, to))
+				diffs.push_back(ObjectDiff(path, ObjectDiff::valueChanged));
+	}
+}
+
+bool pageDependsOnObjects(::XRef & xref, const IndiRef & pageRef, PageDependencies & deps)
+{
+	boost::shared_ptr< ::Object> node(XPdfObjectFactory::getInstance(), xpdf::object_deleter());
+	boost::shared_ptr< ::Object> parent(XPdfObjectFactory::getInstance(), xpdf::object_deleter());
+	deps.seen.clear();
+	try
+	{
+		IndiRef ref=pageRef;
+		while(!deps.independent.count(ref.num) && deps.seen.insert(ref.num).second)
+		{
+			if(deps.nums.count(ref.num))
+				return true;
+			xref.fetch(ref.num, ref.gen, node.get());
+			if(!node->isDict())
+				return !node->isNull();
+			if(dictDependsOnObjects(xref, *node->getDict(), deps))
+				return true;
+			node->dictLookupNF("Parent", parent.get());
+			node->free();
+			if(!parent->isRef())
+				break;
+			ref=IndiRef(parent->getRef());
+			parent->free();
+		}
+	}catch(std::exception & e)
+	{
+		utilsPrintDbg(debug::DBG_WARN, "Unable to examine page "<<pageRef<<". cause="<<e.what());
+		return true;
+	}
+	deps.independent.insert(deps.seen.begin(), deps.seen.end());
+	return false;
+}
+
+RevisionComparer::RevisionComparer(XRefWriter & xrefA, unsigned fromA, unsigned toA)
+	:xref(xrefA), from(fromA), to(toA)
+{
+	if(!xref.getRevisionDiff(from, to, diff))
+	{
+		utilsPrintDbg(debug::DBG_ERR, "Cross reference sections of revisions are not available");
+		throw NotImplementedException("Revision comparing is not implemented for damaged documents.");
+	}
+}
+
+::XRef & RevisionComparer::getXRef(unsigned rev, boost::shared_ptr< ::XRef> & revXRef)
+{
+	if(!revXRef)
+	{
+		::XRef * instance=xref.getRevisionXRef(rev);
+		if(!instance)
+		{
+			utilsPrintDbg(debug::DBG_ERR, "Unable to create xref for revision "<<rev);
+			throw NotImplementedException("Revision comparing is not implemented for damaged documents.");
+		}
+		revXRef.reset(instance);
+	}
+	return *revXRef;
+}
+
+void RevisionComparer::fetch(::XRef & revXRef, int num, ::Object * obj)
+{
+	if(num<0 || num>=revXRef.getSize())
+	{
+		obj->initNull();
+		return;
+	}
+	const XRefEntry * entry=revXRef.getEntry(num);
+	switch(entry->type)
+	{
+		case xrefEntryUncompressed:
+			revXRef.fetch(num, entry->gen, obj);
+			break;
+		case xrefEntryCompressed:
+			revXRef.fetch(num, 0, obj);
+			break;
+		default:
+			obj->initNull();
+	}
+}
+
+void RevisionComparer::diffObject(int num, ObjectDiffs & diffs)
+{
+	utilsPrintDbg(debug::DBG_DBG, "num="<<num);
+	::Object fromObj, toObj;
+	fetch(getXRef(from, fromXRef), num, &fromObj);
+	fetch(getXRef(to, toXRef), num, &toObj);
+	diffObjects(fromObj, toObj, diffs);
+	fromObj.free();
+	toObj.free();
+}
+
+void RevisionComparer::getPageChanges(PageChanges & changes)
+{
+	utilsPrintDbg(debug::DBG_DBG, "from="<<from<<" to="<<to);
+	std::vector<IndiRef> fromPages, toPages;
+	collectPageRefs(getXRef(from, fromXRef), fromPages);
+	::XRef & target=getXRef(to, toXRef);
+	collectPageRefs(target, toPages);
+
+	// pages are identified by their references
+	typedef IndiRefMap<size_t> PagePositions;
+	PagePositions fromPositions;
+	for(size_t i=0; i<fromPages.size(); ++i)
+		fromPositions.insert(std::make_pair(fromPages[i], i+1));
+
+	XRefWriter::ObjectNumSet nums(diff.changed.begin(), diff.changed.end());
+	nums.insert(diff.added.begin(), diff.added.end());
+	nums.insert(diff.removed.begin(), diff.removed.end());
+	PageDependencies deps(nums);
+	for(size_t i=0; i<toPages.size(); ++i)
+	{
+		PageChange change;
+		change.ref=toPages[i];
+		change.toPos=i+1;
+		PagePositions::iterator pos=fromPositions.find(toPages[i]);
+		if(pos==fromPositions.end())
+		{
+			change.fromPos=0;
+			change.kind=PageChange::pageAdded;
+		}else
+		{
+			change.fromPos=pos->second;
+			change.kind=(!nums.empty() && pageDependsOnObjects(target, change.ref, deps))
+				?PageChange::pageChanged
+				:PageChange::pageUnchanged;
+			fromPositions.erase(pos);
+		}
+		changes.push_back(change);
+	}
+	for(size_t i=0; i<fromPages.size(); ++i)
+	{
+		if(fromPositions.find(fromPages[i])==fromPositions.end())
+			continue;
+		PageChange change;
+		change.ref=fromPages[i];
+		change.fromPos=i+1;
+		change.toPos=0;
+		change.kind=PageChange::pageRemoved;
+		changes.push_back(change);
+	}
+}
+
+} // namespace utils
+} // namespace pdfobjects
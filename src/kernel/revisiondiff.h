@@ -0,0 +1,231 @@
+/*
+ * PDFedit - free program for PDF document manipulation.
+ * Copyright (C) 2006-2009  PDFedit team: Michal Hocko,
+ *                                        Jozef Misutka,
+ *                                        Martin Petricek
+ *                   Former team members: Miroslav Jahoda
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (in doc/LICENSE.GPL); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA  02111-1307  USA
+ *
+ * Project is hosted on http://sourceforge.net/projects/pdfedit
+ */
+// vim:tabstop=4:shiftwidth=4:noexpandtab:textwidth=80
+#ifndef _REVISIONDIFF_H_
+#define _REVISIONDIFF_H_
+
+#include "kernel/xpdf.h"
+#include "kernel/xrefwriter.h"
+
+namespace pdfobjects
+{
+namespace utils
+{
+
+/** Structural difference of two objects.
+ */
+struct ObjectDiff
+{
+	/** Kind of difference. */
+	enum Kind
+	{
+		/** Objects have different types (missing objects are null). */
+		typeChanged, 
+		/** Simple objects (including references) have different values. */
+		valueChanged, 
+		/** Dictionary entry is present only in the target object. */
+		entryAdded, 
+		/** Dictionary entry is present only in the source object. */
+		entryRemoved, 
+		/** Arrays have different number of elements. */
+		lengthChanged, 
+		/** Streams have different raw data. */
+		dataChanged
+	};
+
+	/** Path of the differing value within the object.
+	 * Consists of /Key for dictionary entries and [index] for array
+	 * elements. Empty path stands for the object itself.
+	 */
+	std::string path;
+
+	/** Kind of difference. */
+	Kind kind;
+
+	ObjectDiff(const std::string & pathA, Kind kindA): path(pathA), kind(kindA) {}
+};
+
+/** Type for list of structural differences. */
+typedef std::vector<ObjectDiff> ObjectDiffs;
+
+/** Compares two objects structurally.
+ * @param from Source object.
+ * @param to Target object.
+ * @param diffs List where differences are added.
+ * @param path Path of given objects (prefix for paths in diffs).
+ *
+ * Dictionaries are compared entry by entry and arrays element by element
+ * (common elements if lengths differ). Streams are compared by their
+ * dictionaries and raw data. References are compared as values and they are
+ * not followed.
+ */
+void diffObjects(const ::Object & from, const ::Object & to, ObjectDiffs & diffs, 
+		const std::string & path=std::string());
+
+/** State of page dependency examination.
+ */
+struct PageDependencies
+{
+	/** Numbers of objects to search for. */
+	const XRefWriter::ObjectNumSet & nums;
+	/** Objects which are known not to depend on nums objects. */
+	XRefWriter::ObjectNumSet independent;
+	/** Objects examined for the current page. */
+	XRefWriter::ObjectNumSet seen;
+
+	PageDependencies(const XRefWriter::ObjectNumSet & numsA): nums(numsA) {}
+};
+
+/** Checks whether page depends on some of searched objects.
+ * @param xref Xref used to fetch referenced objects.
+ * @param pageRef Reference of the page dictionary.
+ * @param deps Examination state (shared by all examined pages).
+ *
+ * Examines the page dictionary and all its page tree ancestors, because they
+ * may provide inherited attributes, and all objects referenced by them.
+ * Parent and Kids entries are not followed and referenced page dictionaries
+ * (e.g. by link annotations or article beads) are not examined, because they
+ * don't influence the examined page. If the page doesn't depend on searched
+ * objects, all examined objects are remembered as independent, so that they
+ * are not examined again for other pages.
+ *
+ * @return true if page depends on some of searched objects or if it can't
+ * be examined.
+ */
+bool pageDependsOnObjects(::XRef & xref, const IndiRef & pageRef, PageDependencies & deps);
+
+/** Change of a page between two revisions.
+ */
+struct PageChange
+{
+	/** Kind of page change. */
+	enum Kind
+	{
+		/** Page is present only in the target revision. */
+		pageAdded, 
+		/** Page is present only in the source revision. */
+		pageRemoved, 
+		/** Page or some object it depends on has changed. */
+		pageChanged, 
+		/** Page and all objects it depends on are the same. */
+		pageUnchanged
+	};
+
+	/** Reference of the page dictionary. */
+	IndiRef ref;
+	/** Position of the page in the source revision (0 if not present). */
+	size_t fromPos;
+	/** Position of the page in the target revision (0 if not present). */
+	size_t toPos;
+	/** Kind of change. */
+	Kind kind;
+};
+
+/** Type for list of page changes. */
+typedef std::vector<PageChange> PageChanges;
+
+/** Comparer of two document revisions.
+ *
+ * Provides differences between revisions based on their cross reference
+ * sections (see XRefWriter::getRevisionDiff) and optionally structural
+ * differences of changed objects and per page change summary. Objects are
+ * fetched directly from both revisions (see XRefWriter::getRevisionXRef),
+ * so the current revision of the document is not changed and only objects
+ * which are needed are parsed.
+ * <br>
+ * Instance must not outlive the given xref.
+ */
+class RevisionComparer
+{
+	/** Document xref. */
+	XRefWriter & xref;
+	/** Source revision number. */
+	unsigned from;
+	/** Target revision number. */
+	unsigned to;
+	/** Differences of cross reference tables. */
+	XRefWriter::RevisionDiff diff;
+	/** Xref of the source revision (created on demand). */
+	boost::shared_ptr< ::XRef> fromXRef;
+	/** Xref of the target revision (created on demand). */
+	boost::shared_ptr< ::XRef> toXRef;
+
+	/** Returns xref for given revision.
+	 * @param rev Revision number (from or to).
+	 * @param revXRef Cached xref for the revision.
+	 */
+	::XRef & getXRef(unsigned rev, boost::shared_ptr< ::XRef> & revXRef);
+
+	/** Fetches object from given revision xref.
+	 * @param revXRef Xref of the revision.
+	 * @param num Object number.
+	 * @param obj Object where to store fetched value (null if the object
+	 * is not present).
+	 */
+	static void fetch(::XRef & revXRef, int num, ::Object * obj);
+public:
+	/** Initialization constructor.
+	 * @param xrefA Document xref.
+	 * @param fromA Source revision number.
+	 * @param toA Target revision number.
+	 *
+	 * Collects differences of cross reference tables.
+	 *
+	 * @throw OutOfRange if some of revisions doesn't exist.
+	 * @throw NotImplementedException if cross reference sections of the
+	 * document can't be used (e.g. damaged document).
+	 */
+	RevisionComparer(XRefWriter & xrefA, unsigned fromA, unsigned toA);
+
+	/** Returns differences of cross reference tables.
+	 */
+	const XRefWriter::RevisionDiff & getDiff()const
+	{
+		return diff;
+	}
+
+	/** Compares given object in both revisions structurally.
+	 * @param num Object number (typically from getDiff).
+	 * @param diffs List where differences are added.
+	 *
+	 * Object missing in a revision is considered to be null.
+	 */
+	void diffObject(int num, ObjectDiffs & diffs);
+
+	/** Collects per page summary of changes.
+	 * @param changes List where page changes are added.
+	 *
+	 * Pages are identified by their references. Pages of the target
+	 * revision come first in their order followed by removed pages. Page
+	 * is changed if its dictionary, some of its page tree ancestors or
+	 * some object referenced by them (resources, content streams,
+	 * annotations...) has changed.
+	 */
+	void getPageChanges(PageChanges & changes);
+};
+
+} // namespace utils
+} // namespace pdfobjects
+
+#endif
@@ -0,0 +1,316 @@
+/*
+ * PDFedit - free program for PDF document manipulation.
+ * Copyright (C) 2006-2009  PDFedit team: Michal Hocko,
+ *                                        Jozef Misutka,
+ *                                        Martin Petricek
+ *                   Former team members: Miroslav Jahoda
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (in doc/LICENSE.GPL); if not, write to the 
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, 
+ * MA  02111-1307  USA
+ *
+ * Project is hosted on http://sourceforge.net/projects/pdfedit
+ */
+// vim:tabstop=4:shiftwidth=4:noexpandtab:textwidth=80
+#include "kernel/static.h"
+#include "kernel/xrefcache.h"
+
+#include <goo/gfile.h>
+
+namespace pdfobjects {
+namespace xrefcache {
+
+using namespace std;
+
+const char * const SUFFIX=".xrefcache";
+const Guint FileKey::TAIL_LENGTH;
+
+namespace {
+
+bool enabled=false;
+
+/** Sidecar file magic (the last character is the format version). */
+const char MAGIC[8]={'P', 'D', 'F', 'E', 'X', 'R', 'C', '1'};
+
+/** Flag for available page references. */
+const Guint FLAG_PAGE_REFS=1;
+
+/** Initial value of FNV-1a hash. */
+const Guint FNV_BASIS=2166136261U;
+
+/** FNV-1a hash.
+ * @param hash Hash of the previous data (or FNV_BASIS).
+ * @param data Data.
+ * @param len Length of the data.
+ */
+Guint fnvHash(Guint hash, const unsigned char * data, size_t len)
+{
+	for(size_t i=0; i<len; ++i)
+	{
+		hash^=data[i];
+		hash*=16777619U;
+	}
+	return hash;
+}
+
+/** Writes sidecar content.
+ * All values are stored as 32-bit little endian numbers.
+ */
+class Writer
+{
+	string data;
+public:
+	void put(Guint value)
+	{
+		for(int i=0; i<4; ++i, value>>=8)
+			data+=(char)(value & 0xff);
+	}
+
+	void put(const string & value)
+	{
+		put((Guint)value.size());
+		data+=value;
+	}
+
+	/** Appends checksum and returns the content. */
+	const string & finish()
+	{
+		put(fnvHash(FNV_BASIS, (const unsigned char *)data.data(), data.size()));
+		return data;
+	}
+
+	Writer()
+	{
+		data.append(MAGIC, sizeof(MAGIC));
+	}
+};
+
+/** Reads sidecar content.
+ * Once data are exhausted, reader is marked as failed and returns zeros.
+ */
+class Reader
+{
+	const unsigned char * pos;
+	const unsigned char * end;
+	bool ok;
+public:
+	Reader(const char * data, size_t len)
+		:pos((const unsigned char *)data), end(pos+len), ok(true)
+	{
+	}
+
+	bool isOk()const
+	{
+		return ok;
+	}
+
+	Guint get()
+	{
+		if(end-pos<4)
+		{
+			ok=false;
+			pos=end;
+			return 0;
+		}
+		Guint value=pos[0] | (pos[1]<<8) | (pos[2]<<16) | ((Guint)pos[3]<<24);
+		pos+=4;
+		return value;
+	}
+
+	/** Reads count of items which occupy itemSize bytes each.
+	 * Fails if there is not enough data, so that counts from damaged 
+	 * sidecar don't lead to huge allocations.
+	 */
+	Guint getCount(size_t itemSize)
+	{
+		Guint count=get();
+		if(count>(size_t)(end-pos)/itemSize)
+		{
+			ok=false;
+			pos=end;
+			return 0;
+		}
+		return count;
+	}
+
+	void get(string & value)
+	{
+		Guint len=getCount(1);
+		value.assign((const char *)pos, len);
+		pos+=len;
+	}
+};
+
+string getSidecarName(const string & fileName)
+{
+	return fileName+SUFFIX;
+}
+
+} // end of anonymous namespace for sidecar format helpers
+
+void setEnabled(bool enable)
+{
+	enabled=enable;
+}
+
+bool isEnabled()
+{
+	return enabled;
+}
+
+bool getFileKey(FILE * file, FileKey & key)
+{
+	struct stat st;
+	if(fstat(fileno(file), &st) || !S_ISREG(st.st_mode))
+		return false;
+	key.size=(Guint)st.st_size;
+	key.mtime=(Guint)st.st_mtime;
+
+	unsigned char buf[FileKey::TAIL_LENGTH];
+	Guint len=std::min(key.size, FileKey::TAIL_LENGTH);
+	bool ok=!fseek(file, -(long)len, SEEK_END) && fread(buf, 1, len, file)==len;
+	key.tailHash=fnvHash(FNV_BASIS, buf, (ok)?len:0);
+	fseek(file, 0, SEEK_SET);
+	return ok;
+}
+
+bool load(const string & fileName, const FileKey & key, XRefSnapshot & snapshot)
+{
+	string name=getSidecarName(fileName);
+	FILE * file=fopen(name.c_str(), "rb");
+	if(!file)
+		return false;
+	GFileMap map(file, 0, 0);
+	fclose(file);
+	if(!map.isOk())
+		return false;
+
+	// checks magic, checksum and key
+	const char * data=map.getData();
+	size_t len=map.getLength();
+	if(len<sizeof(MAGIC)+4 || memcmp(data, MAGIC, sizeof(MAGIC)))
+		return false;
+	Reader checksum(data+len-4, 4);
+	if(checksum.get()!=fnvHash(FNV_BASIS, (const unsigned char *)data, len-4))
+	{
+		kernelPrintDbg(debug::DBG_WARN, "Damaged xref sidecar "<<name);
+		return false;
+	}
+	Reader reader(data+sizeof(MAGIC), len-sizeof(MAGIC)-4);
+	if(reader.get()!=key.size || reader.get()!=key.mtime || reader.get()!=key.tailHash)
+	{
+		kernelPrintDbg(debug::DBG_INFO, "Xref sidecar "<<name<<" is outdated");
+		return false;
+	}
+
+	snapshot.lastXRefPos=reader.get();
+	snapshot.eofPos=reader.get();
+	snapshot.maxObj=reader.get();
+	Guint count=reader.getCount(12);
+	snapshot.entries.resize(count);
+	for(Guint i=0; i<count; ++i)
+	{
+		::XRefEntry & entry=snapshot.entries[i];
+		entry.offset=reader.get();
+		entry.gen=(int)reader.get();
+		Guint type=reader.get();
+		if(type>xrefEntryCompressed)
+			return false;
+		entry.type=(XRefEntryType)type;
+	}
+	count=reader.getCount(4);
+	snapshot.streamEnds.resize(count);
+	for(Guint i=0; i<count; ++i)
+		snapshot.streamEnds[i]=reader.get();
+	count=reader.getCount(4);
+	snapshot.revisions.resize(count);
+	for(Guint i=0; i<count; ++i)
+		snapshot.revisions[i]=reader.get();
+	snapshot.hasPageRefs=(reader.get() & FLAG_PAGE_REFS)!=0;
+	count=reader.getCount(8);
+	snapshot.pageRefs.resize(count);
+	for(Guint i=0; i<count; ++i)
+	{
+		snapshot.pageRefs[i].num=(int)reader.get();
+		snapshot.pageRefs[i].gen=(int)reader.get();
+	}
+	reader.get(snapshot.trailer);
+	if(!reader.isOk() || snapshot.entries.empty() || snapshot.revisions.empty())
+		return false;
+	kernelPrintDbg(debug::DBG_DBG, "Xref sidecar "<<name<<" loaded with "
+			<<snapshot.entries.size()<<" entries");
+	return true;
+}
+
+bool store(const string & fileName, const FileKey & key, const XRefSnapshot & snapshot)
+{
+	Writer writer;
+	writer.put(key.size);
+	writer.put(key.mtime);
+	writer.put(key.tailHash);
+	writer.put(snapshot.lastXRefPos);
+	writer.put(snapshot.eofPos);
+	writer.put(snapshot.maxObj);
+	writer.put((Guint)snapshot.entries.size());
+	for(size_t i=0; i<snapshot.entries.size(); ++i)
+	{
+		const ::XRefEntry & entry=snapshot.entries[i];
+		writer.put(entry.offset);
+		writer.put((Guint)entry.gen);
+		writer.put((Guint)entry.type);
+	}
+	writer.put((Guint)snapshot.streamEnds.size());
+	for(size_t i=0; i<snapshot.streamEnds.size(); ++i)
+		writer.put(snapshot.streamEnds[i]);
+	writer.put((Guint)snapshot.revisions.size());
+	for(size_t i=0; i<snapshot.revisions.size(); ++i)
+		writer.put((Guint)snapshot.revisions[i]);
+	writer.put((snapshot.hasPageRefs)?FLAG_PAGE_REFS:0);
+	writer.put((Guint)snapshot.pageRefs.size());
+	for(size_t i=0; i<snapshot.pageRefs.size(); ++i)
+	{
+		writer.put((Guint)snapshot.pageRefs[i].num);
+		writer.put((Guint)snapshot.pageRefs[i].gen);
+	}
+	writer.put(snapshot.trailer);
+	const string & data=writer.finish();
+
+	// writes a temporary file and replaces the sidecar by it
+	string name=getSidecarName(fileName);
+	string tmpName=name+".tmp";
+	FILE * file=fopen(tmpName.c_str(), "wb");
+	if(!file)
+	{
+		kernelPrintDbg(debug::DBG_WARN, "Unable to create xref sidecar "<<tmpName
+				<<" (reason="<<strerror(errno)<<")");
+		return false;
+	}
+	bool ok=fwrite(data.data(), 1, data.size(), file)==data.size();
+	ok=!fclose(file) && ok;
+#ifdef WIN32
+	// rename doesn't replace existing files on Windows
+	if(ok)
+		remove(name.c_str());
+#endif
+	if(!ok || rename(tmpName.c_str(), name.c_str()))
+	{
+		kernelPrintDbg(debug::DBG_WARN, "Unable to write xref sidecar "<<name);
+		remove(tmpName.c_str());
+		return false;
+	}
+	kernelPrintDbg(debug::DBG_DBG, "Xref sidecar "<<name<<" stored");
+	return true;
+}
+
+} // namespace xrefcache
+} // namespace pdfobjects
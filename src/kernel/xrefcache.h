@@ -0,0 +1,137 @@
+/*
+ * PDFedit - free program for PDF document manipulation.
+ * Copyright (C) 2006-2009  PDFedit team: Michal Hocko,
+ *                                        Jozef Misutka,
+ *                                        Martin Petricek
+ *                   Former team members: Miroslav Jahoda
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (in doc/LICENSE.GPL); if not, write to the 
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, 
+ * MA  02111-1307  USA
+ *
+ * Project is hosted on http://sourceforge.net/projects/pdfedit
+ */
+// vim:tabstop=4:shiftwidth=4:noexpandtab:textwidth=80
+#ifndef _XREFCACHE_H_
+#define _XREFCACHE_H_
+
+#include "kernel/static.h"
+#include "kernel/indiref.h"
+
+// =============================================================================
+namespace pdfobjects {
+namespace xrefcache {
+
+/** Enables or disables cross reference sidecar files.
+ * @param enable Flag.
+ *
+ * Sidecars are disabled by default. When enabled, CPdf::getInstance uses a
+ * sidecar (file name with SUFFIX appended) which holds resolved cross 
+ * reference information of the document, so that xref sections don't have 
+ * to be parsed (or reconstructed) again when the same document is opened 
+ * next time. Sidecar is created or replaced when it is missing or not valid.
+ */
+void setEnabled(bool enable);
+
+/** Checks whether cross reference sidecars are used.
+ */
+bool isEnabled();
+
+/** Suffix of sidecar file name. */
+extern const char * const SUFFIX;
+
+/** Identification of document file content.
+ *
+ * Sidecar is valid only for the file with the same key. Tail of the file is
+ * hashed because incremental updates always change it.
+ */
+struct FileKey
+{
+	/** File size. */
+	Guint size;
+	/** Modification time (truncated to 32 bits). */
+	Guint mtime;
+	/** Hash of the last TAIL_LENGTH bytes. */
+	Guint tailHash;
+
+	/** Number of bytes from the end of file which are hashed. */
+	static const Guint TAIL_LENGTH=4096;
+};
+
+/** Resolved cross reference information of a document.
+ */
+struct XRefSnapshot
+{
+	/** Xref entries (compressed entries hold object stream membership). */
+	std::vector< ::XRefEntry> entries;
+	/** Offset of the last xref section. */
+	Guint lastXRefPos;
+	/** Position of the end of file marker. */
+	Guint eofPos;
+	/** Maximum object number of all revisions. */
+	Guint maxObj;
+	/** Stream end positions (only for damaged documents). */
+	std::vector<Guint> streamEnds;
+	/** Trailer dictionary in PDF syntax. */
+	std::string trailer;
+	/** Xref section offsets of all revisions (the oldest first). */
+	std::vector<size_t> revisions;
+	/** Flag whether pageRefs are available. */
+	bool hasPageRefs;
+	/** Page dictionary references in the document order. */
+	std::vector<IndiRef> pageRefs;
+
+	XRefSnapshot()
+		:lastXRefPos(0), eofPos(0), maxObj(0), hasPageRefs(false)
+	{
+	}
+};
+
+/** Calculates key of the file content.
+ * @param file Opened file.
+ * @param key Key to be filled.
+ *
+ * File position is set to the beginning of the file.
+ *
+ * @return true on success, false if file can't be examined.
+ */
+bool getFileKey(FILE * file, FileKey & key);
+
+/** Loads sidecar of the file.
+ * @param fileName Name of the document file.
+ * @param key Key of the document file content.
+ * @param snapshot Snapshot to be filled.
+ *
+ * The whole sidecar is mapped to the memory at once. Sidecar is not used if
+ * it is missing, damaged or created for a different file content.
+ *
+ * @return true if snapshot was loaded, false otherwise.
+ */
+bool load(const std::string & fileName, const FileKey & key, XRefSnapshot & snapshot);
+
+/** Stores sidecar of the file.
+ * @param fileName Name of the document file.
+ * @param key Key of the document file content.
+ * @param snapshot Snapshot to be stored.
+ *
+ * Sidecar is written to a temporary file which replaces the previous one,
+ * so that concurrent readers never see it incomplete.
+ *
+ * @return true on success, false otherwise.
+ */
+bool store(const std::string & fileName, const FileKey & key, const XRefSnapshot & snapshot);
+
+} // namespace xrefcache
+} // namespace pdfobjects
+
+#endif // _XREFCACHE_H_
@@ -30,6 +30,7 @@
 #include "kernel/streamwriter.h"
 #include "kernel/pdfwriter.h"
 #include "kernel/factories.h"
+#include "kernel/xrefcache.h"
 
 using namespace debug;
 
@@ -145,11 +146,13 @@ bool isLatestRevision(const XRefWriter &xref)
 
 } // end of utils namespace
 
-XRefWriter::XRefWriter(StreamWriter * stream, CPdf * _pdf)
-	:CXref(stream), 
+XRefWriter::XRefWriter(StreamWriter * stream, CPdf * _pdf, 
+		const xrefcache::XRefSnapshot * snapshot)
+	:CXref(stream, snapshot), 
 	mode(paranoid), 
 	pdf(_pdf), 
 	revision(0), 
+	layersBroken(false),
 	pdfWriter(new utils::OldStylePdfWriter())
 {
 	// gets storePos
@@ -173,7 +176,12 @@ XRefWriter::XRefWriter(StreamWriter * stream, CPdf * _pdf)
 	// we are parsing only trailer which doesn't contain any directly
 	// encrypted data - strings
 	// revision is initialized to the most recent one
-	collectRevisions();
+	if(isRestored() && snapshot->revisions.size())
+	{
+		revisions=snapshot->revisions;
+		revision=revisions.size()-1;
+	}else
+		collectRevisions();
 
 	// sets internal fetch back to normal
 	disableInternalFetch();
@@ -520,15 +528,21 @@ void XRefWriter::saveChanges(bool newRevision)
 		xpdf::freeXpdfObject(o);
 	}
 
+	// offsets of written objects are needed to update the table in place
+	// when a new revision is created. Encrypted documents are reopened to 
+	// keep their credentials handling
+	IPdfWriter::OffsetList offsets;
+	bool inPlace=newRevision && !encrypted 
+		&& pdfWriter->getObjectOffsets(offsets) && !offsets.empty();
+
 	// Stores position of the cross reference section to xrefPos
 	size_t xrefPos=streamWriter->getPos();
 	IPdfWriter::PrevSecInfo secInfo={lastXRefPos, XRef::maxObj+1};
 	size_t newEofPos=pdfWriter->writeTrailer(*getTrailerDict(), secInfo, *streamWriter);
 
 	// if new revision should be created, moves storePos behind stored content
-	// (more preciselly before pdf end of file marker %%EOF) and forces CXref 
-	// reopen to handle new revision - all changed objects are stored in file 
-	// now.
+	// (more preciselly before pdf end of file marker %%EOF) and updates CXref 
+	// to handle new revision - all changed objects are stored in file now.
 	if(newRevision)
 	{
 		kernelPrintDbg(DBG_INFO, "Saving changes as new revision number "
@@ -536,9 +550,17 @@ void XRefWriter::saveChanges(bool newRevision)
 		storePos=newEofPos;
 		kernelPrintDbg(DBG_DBG, "New storePos="<<storePos);
 
-		// forces reinitialization of XRef and CXref internal structures from
-		// last xref position
-		CXref::reopen(xrefPos);
+		if(inPlace)
+		{
+			// entries of written objects are updated without parsing. 
+			// Layers are extended as well if they are already collected
+			CXref::appendSection(xrefPos, newEofPos, offsets);
+			if(!layersBroken && layers.size()==revisions.size())
+				appendLayer(offsets);
+		}else
+			// forces reinitialization of XRef and CXref internal structures 
+			// from last xref position
+			CXref::reopen(xrefPos);
 
 		// new revision number is added and current revision is updated - 
 		// we insert the newest revision so xrefPos value is stored
@@ -693,6 +715,12 @@ bad_header:
 	return -1;
 }
 
+void XRefWriter::getSnapshot(xrefcache::XRefSnapshot & snapshot)const
+{
+	CXref::getSnapshot(snapshot);
+	snapshot.revisions=revisions;
+}
+
 void XRefWriter::collectRevisions()
 {
 	kernelPrintDbg(DBG_DBG, "");
@@ -719,6 +747,8 @@ void XRefWriter::collectRevisions()
 		kernelPrintDbg(DBG_DBG, "Clearing revisions container.");
 		revisions.clear();
 	}
+	layers.clear();
+	layersBroken=false;
 
 	// uses deep copy to prevent problems with original data
 	Object * trailer = XRef::getTrailerDict()->clone();
@@ -852,17 +882,335 @@ void XRefWriter::changeRevision(unsigned revNumber)
 		throw OutOfRange();
 	}
 	
-	// forces CXRef to reopen from revisions[revNumber] offset
-	// which points to start of xref section for that revision
-	// and forces keeping all changes
-	size_t off=revisions[revNumber];
-	reopen(off, false);
+	// uses already parsed layers if possible. Otherwise forces CXRef to 
+	// reopen from revisions[revNumber] offset which points to start of xref 
+	// section for that revision and forces keeping all changes
+	if(!collectLayers() || !activateLayer(revNumber))
+	{
+		size_t off=revisions[revNumber];
+		reopen(off, false);
+	}
 
 	// everything ok, so current revision can be set
 	revision=revNumber;
 	kernelPrintDbg(DBG_INFO, "Revision changed to "<<revision);
 }
 
+namespace {
+
+/** XRef for one revision which is independent on the document xref.
+ *
+ * Uses XRef parsing code with its own internals, so that the document xref
+ * is not affected. It is used both to read cross reference sections of a
+ * revision and to fetch objects of a revision from its complete table.
+ */
+class RevisionXRef: public ::XRef
+{
+public:
+	/** Initialization constructor.
+	 * @param stream Stream with the document data (not owned).
+	 */
+	RevisionXRef(BaseStream * stream): ::XRef(stream, gFalse)
+	{
+		size=0;
+		maxObj=0;
+		start=str->getStart();
+	}
+
+	/** Reads sections of the revision.
+	 * @param off Offset of the revision cross reference section.
+	 * @param revisions Offsets of all revisions.
+	 *
+	 * Reads sections from the given offset and follows their Prev entries
+	 * until an offset of another revision is reached. Read entries and
+	 * trailer are available by getEntry, getSize and getTrailerDict.
+	 *
+	 * @return true on success, false if some section can't be parsed.
+	 */
+	bool read(Guint off, const std::vector<size_t> & revisions)
+	{
+		destroyInternals();
+		size=0;
+		maxObj=0;
+		setErrCode(errNone);
+
+		std::set<Guint> visited;
+		Guint pos=off;
+		visited.insert(pos);
+		while(readXRef(&pos))
+		{
+			// hybrid files refer to the section with the same revision
+			if(std::find(revisions.begin(), revisions.end(), (size_t)pos)!=revisions.end()
+					|| !visited.insert(pos).second)
+				break;
+		}
+		return isOk() && getTrailerDict()->isDict();
+	}
+
+	/** Initializes internals from already resolved table.
+	 * @param entriesA Cross reference table (ownership is taken over).
+	 * @param sizeA Size of the table.
+	 * @param maxObjA Maximum used object number.
+	 * @param trailerA Trailer of the revision (ownership is taken over).
+	 * @param lastXRefPosA Offset of the revision cross reference section.
+	 *
+	 * @return true on success, false otherwise.
+	 */
+	bool init(XRefEntry * entriesA, int sizeA, Guint maxObjA, ::Object * trailerA, Guint lastXRefPosA)
+	{
+		destroyInternals();
+		GBool ret=initInternals(entriesA, sizeA, NULL, 0, trailerA);
+		gfree(trailerA);
+		maxObj=maxObjA;
+		lastXRefPos=lastXRefPosA;
+		return ret;
+	}
+};
+
+/** Compares two entries.
+ * Missing and free entries are considered to be the same.
+ */
+bool sameEntry(const XRefEntry * e1, const XRefEntry * e2)
+{
+	bool free1=!e1 || e1->type==xrefEntryFree;
+	bool free2=!e2 || e2->type==xrefEntryFree;
+	if(free1 || free2)
+		return free1 && free2;
+	return e1->type==e2->type && e1->offset==e2->offset && e1->gen==e2->gen;
+}
+
+} // end of anonymous namespace
+
+bool XRefWriter::collectLayers()
+{
+	if(layersBroken)
+		return false;
+	if(layers.size()==revisions.size())
+		return true;
+
+	kernelPrintDbg(DBG_DBG, "Parsing layers for "<<revisions.size()-layers.size()<<" revisions");
+	RevisionXRef reader(str);
+	for(size_t rev=layers.size(); rev<revisions.size(); ++rev)
+	{
+		if(!reader.read(revisions[rev], revisions))
+		{
+			kernelPrintDbg(DBG_WARN, "Unable to parse cross reference sections for revision "<<rev);
+			layers.clear();
+			layersBroken=true;
+			return false;
+		}
+		RevisionLayer layer;
+		layer.size=reader.getSize();
+		for(int i=0; i<layer.size; ++i)
+		{
+			const XRefEntry * entry=reader.getEntry(i);
+			if(entry->offset==0xffffffff)
+				continue;
+			layer.nums.push_back(i);
+			layer.entries.push_back(*entry);
+		}
+		layer.trailer=boost::shared_ptr< ::Object>(reader.getTrailerDict()->clone(), xpdf::object_deleter());
+		layers.push_back(layer);
+		kernelPrintDbg(DBG_DBG, "Revision "<<rev<<" defines "<<layer.nums.size()<<" entries");
+	}
+	return true;
+}
+
+void XRefWriter::appendLayer(const ObjectOffsets & offsets)
+{
+	RevisionLayer layer;
+	layer.size=size;
+	for(ObjectOffsets::const_iterator i=offsets.begin(); i!=offsets.end(); ++i)
+	{
+		int num=i->first.num;
+		// offsets are sorted, so the same number can be only the last one
+		if(!layer.nums.empty() && layer.nums.back()==num)
+		{
+			layer.entries.pop_back();
+			layer.nums.pop_back();
+		}
+		layer.nums.push_back(num);
+		layer.entries.push_back(entries[num]);
+	}
+	layer.trailer=boost::shared_ptr< ::Object>(XRef::getTrailerDict()->clone(), xpdf::object_deleter());
+	layers.push_back(layer);
+	kernelPrintDbg(DBG_DBG, "Revision "<<layers.size()-1<<" defines "<<layer.nums.size()<<" entries");
+}
+
+const XRefEntry * XRefWriter::getLayerEntry(unsigned rev, int num)const
+{
+	assert(rev<layers.size());
+	for(int i=rev; i>=0; --i)
+	{
+		const RevisionLayer & layer=layers[i];
+		std::vector<int>::const_iterator pos=std::lower_bound(layer.nums.begin(), layer.nums.end(), num);
+		if(pos!=layer.nums.end() && *pos==num)
+			return &layer.entries[pos-layer.nums.begin()];
+	}
+	return NULL;
+}
+
+XRefEntry * XRefWriter::buildLayerTable(unsigned rev, int & tableSize, Guint & maxObjA)const
+{
+	assert(rev<layers.size());
+
+	// newer layers hide entries of older ones
+	tableSize=0;
+	for(unsigned i=0; i<=rev; ++i)
+		tableSize=std::max(tableSize, layers[i].size);
+	XRefEntry * table=(XRefEntry *)gmallocn(tableSize, sizeof(XRefEntry));
+	for(int i=0; i<tableSize; ++i)
+	{
+		table[i].offset=0xffffffff;
+		table[i].gen=0;
+		table[i].type=xrefEntryFree;
+	}
+	maxObjA=0;
+	for(int i=rev; i>=0; --i)
+	{
+		const RevisionLayer & layer=layers[i];
+		for(size_t j=0; j<layer.nums.size(); ++j)
+		{
+			int num=layer.nums[j];
+			if(table[num].offset!=0xffffffff)
+				continue;
+			table[num]=layer.entries[j];
+			if(table[num].type!=xrefEntryFree && (Guint)num>maxObjA)
+				maxObjA=num;
+		}
+	}
+	return table;
+}
+
+bool XRefWriter::activateLayer(unsigned rev)
+{
+	int tableSize;
+	Guint maxObjA;
+	XRefEntry * table=buildLayerTable(rev, tableSize, maxObjA);
+	return reopen(revisions[rev], table, tableSize, maxObjA, layers[rev].trailer->clone());
+}
+
+void XRefWriter::diffLayers(unsigned from, unsigned to, RevisionDiff & diff)const
+{
+	assert(from<layers.size() && to<layers.size());
+	if(from==to)
+		return;
+
+	// only objects defined by layers between both revisions may differ
+	unsigned low=std::min(from, to);
+	unsigned high=std::max(from, to);
+	ObjectNumSet candidates;
+	for(unsigned i=low+1; i<=high; ++i)
+		candidates.insert(layers[i].nums.begin(), layers[i].nums.end());
+
+	ObjectNumSet containers;
+	for(ObjectNumSet::const_iterator i=candidates.begin(); i!=candidates.end(); ++i)
+	{
+		const XRefEntry * fromEntry=getLayerEntry(from, *i);
+		const XRefEntry * toEntry=getLayerEntry(to, *i);
+		if(sameEntry(fromEntry, toEntry))
+			continue;
+		containers.insert(*i);
+		if(!fromEntry || fromEntry->type==xrefEntryFree)
+			diff.added.push_back(*i);
+		else if(!toEntry || toEntry->type==xrefEntryFree)
+			diff.removed.push_back(*i);
+		else
+			diff.changed.push_back(*i);
+	}
+
+	// compressed objects are different also if their object stream is. 
+	// Entries which differ are already classified above
+	if(containers.empty())
+		return;
+	ObjectNumSet compressed;
+	for(unsigned i=0; i<=high; ++i)
+	{
+		const RevisionLayer & layer=layers[i];
+		for(size_t j=0; j<layer.nums.size(); ++j)
+		{
+			const XRefEntry & entry=layer.entries[j];
+			int num=layer.nums[j];
+			if(entry.type!=xrefEntryCompressed || !containers.count(entry.offset) 
+					|| containers.count(num) || compressed.count(num))
+				continue;
+			const XRefEntry * fromEntry=getLayerEntry(from, num);
+			if(fromEntry && fromEntry->type==xrefEntryCompressed && containers.count(fromEntry->offset)
+					&& sameEntry(fromEntry, getLayerEntry(to, num)))
+				compressed.insert(num);
+		}
+	}
+	if(compressed.empty())
+		return;
+	diff.changed.insert(diff.changed.end(), compressed.begin(), compressed.end());
+	std::sort(diff.changed.begin(), diff.changed.end());
+}
+
+bool XRefWriter::getChangedObjects(unsigned rev, ObjectNumSet & nums)const
+{
+	if(rev>=layers.size() || revision>=layers.size())
+		return false;
+
+	RevisionDiff diff;
+	diffLayers(rev, revision, diff);
+	nums.insert(diff.added.begin(), diff.added.end());
+	nums.insert(diff.removed.begin(), diff.removed.end());
+	nums.insert(diff.changed.begin(), diff.changed.end());
+	kernelPrintDbg(DBG_DBG, nums.size()<<" objects differ between revisions "<<rev<<" and "<<revision);
+	return true;
+}
+
+bool XRefWriter::getRevisionDiff(unsigned from, unsigned to, RevisionDiff & diff)
+{
+	kernelPrintDbg(DBG_DBG, "from="<<from<<" to="<<to);
+
+	if(from>=revisions.size() || to>=revisions.size())
+	{
+		kernelPrintDbg(DBG_ERR, "unkown revision from="<<from<<" to="<<to);
+		throw OutOfRange();
+	}
+	diff.added.clear();
+	diff.removed.clear();
+	diff.changed.clear();
+	if(!collectLayers())
+		return false;
+
+	diffLayers(from, to, diff);
+	kernelPrintDbg(DBG_INFO, "Revisions "<<from<<" and "<<to<<" differ in "
+			<<diff.added.size()<<" added, "<<diff.removed.size()<<" removed and "
+			<<diff.changed.size()<<" changed objects");
+	return true;
+}
+
+::XRef * XRefWriter::getRevisionXRef(unsigned rev)
+{
+	kernelPrintDbg(DBG_DBG, "rev="<<rev);
+
+	check_need_credentials(this);
+
+	if(rev>=revisions.size())
+	{
+		kernelPrintDbg(DBG_ERR, "unkown revision with number="<<rev);
+		throw OutOfRange();
+	}
+	if(!collectLayers())
+		return NULL;
+
+	int tableSize;
+	Guint maxObjA;
+	XRefEntry * table=buildLayerTable(rev, tableSize, maxObjA);
+	RevisionXRef * revXRef=new RevisionXRef(str);
+	if(!revXRef->init(table, tableSize, maxObjA, layers[rev].trailer->clone(), revisions[rev]))
+	{
+		kernelPrintDbg(DBG_WARN, "Table of revision "<<rev<<" is not usable");
+		delete revXRef;
+		return NULL;
+	}
+	if(useEncrypt)
+		revXRef->setEncryption(permFlags, ownerPasswordOk, fileKey, keyLength, encVersion, encAlgorithm);
+	return revXRef;
+}
+
 size_t XRefWriter::getRevisionEnd(size_t xrefStart)const
 {
 	StreamWriter * streamWriter=dynamic_cast<StreamWriter *>(str);
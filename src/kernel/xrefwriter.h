@@ -107,6 +107,19 @@ public:
 	 * </ul>
 	 */
 	enum writerMode {easy, paranoid};
+
+	/** Differences between cross reference tables of two revisions.
+	 * All lists hold object numbers in increasing order.
+	 */
+	struct RevisionDiff
+	{
+		/** Objects which are present only in the target revision. */
+		std::vector<int> added;
+		/** Objects which are present only in the source revision. */
+		std::vector<int> removed;
+		/** Objects present in both revisions with different entries. */
+		std::vector<int> changed;
+	};
 private:
 	/** Mode for checking. */
 	writerMode mode;
@@ -146,6 +159,45 @@ private:
 	 */
 	RevisionStorage revisions;
 
+	/** Cross reference entries introduced by one revision.
+	 *
+	 * Contains entries from all cross reference sections which belong to the
+	 * revision (hybrid files use two sections for one revision) and its
+	 * trailer. Complete table of the revision is given by this layer put on
+	 * top of all older layers.
+	 */
+	struct RevisionLayer
+	{
+		/** Object numbers defined by the revision in increasing order. */
+		std::vector<int> nums;
+		/** Entries for object numbers from nums. */
+		std::vector<XRefEntry> entries;
+		/** Size of the table required by the revision sections. */
+		int size;
+		/** Trailer of the revision. */
+		boost::shared_ptr< ::Object> trailer;
+	};
+
+	/** Type for revision layers storage.
+	 * Elements are in the same order as in RevisionStorage.
+	 */
+	typedef std::vector<RevisionLayer> LayerStorage;
+
+	/** Parsed layers of revisions.
+	 *
+	 * Filled on demand by collectLayers for all revisions and kept for whole
+	 * instance life cycle, so that xref sections are parsed just once even if
+	 * revision is changed many times. Layers for revisions added by
+	 * saveChanges are parsed when they are needed.
+	 */
+	LayerStorage layers;
+
+	/** Flag whether layers can't be used for this document.
+	 * Set by collectLayers when some cross reference section can't be parsed
+	 * (e.g. damaged document with reconstructed xref table).
+	 */
+	bool layersBroken;
+
 	/** File offset for write changes.
 	 *
 	 * This offset is used as file position where to start writing changes. It
@@ -176,7 +228,7 @@ private:
 	 * It's not available to prevent uninitialized instances.
 	 * Sets mode to paranoid.
 	 */
-	XRefWriter():CXref(), mode(paranoid), pdf(NULL), revision(0), linearized(false)
+	XRefWriter():CXref(), mode(paranoid), pdf(NULL), revision(0), layersBroken(false), linearized(false)
 	{
 	}
 protected:
@@ -248,30 +300,106 @@ protected:
 	 */
 	size_t getRevisionEnd(size_t xrefStart)const;
 
+	/** Parses layers of all revisions.
+	 *
+	 * Parses cross reference sections of all revisions which don't have their
+	 * layer yet. Each revision consists of sections starting at its revisions
+	 * offset and following Prev entries until the offset of the previous
+	 * revision is reached.
+	 * <br>
+	 * If some section can't be parsed, layers are discarded and layersBroken
+	 * is set, so that revision changing falls back to CXref::reopen.
+	 *
+	 * @return true if layers for all revisions are available, false otherwise.
+	 */
+	bool collectLayers();
+
+	/** Appends layer for a revision which has just been saved.
+	 * @param offsets Offsets of objects written to the revision (in
+	 * increasing reference order).
+	 *
+	 * Used instead of parsing the written section when layers of all
+	 * previous revisions are available. Entries are taken from the current
+	 * table which has been already updated by CXref::appendSection.
+	 */
+	void appendLayer(const ObjectOffsets & offsets);
+
+	/** Returns entry of the object in given revision.
+	 * @param rev Revision number (must have its layer).
+	 * @param num Object number.
+	 *
+	 * Searches layers from the given revision towards older ones.
+	 *
+	 * @return Entry from the newest layer which defines the object or NULL if
+	 * no layer defines it.
+	 */
+	const XRefEntry * getLayerEntry(unsigned rev, int num)const;
+
+	/** Makes given revision current using its layers.
+	 * @param rev Revision number (must have its layer).
+	 *
+	 * Builds table of the revision from layers and reopens CXref with it
+	 * without parsing.
+	 *
+	 * @return true on success, false if CXref::reopen with the revision offset
+	 * has to be used instead.
+	 */
+	bool activateLayer(unsigned rev);
+
+	/** Builds complete cross reference table of given revision from layers.
+	 * @param rev Revision number (must have its layer).
+	 * @param tableSize Size of the returned table.
+	 * @param maxObjA Maximum object number used by the revision.
+	 *
+	 * @return Table allocated by gmallocn (caller is responsible for its
+	 * deallocation).
+	 */
+	XRefEntry * buildLayerTable(unsigned rev, int & tableSize, Guint & maxObjA)const;
+
+	/** Compares layers of two revisions.
+	 * @param from Source revision number (must have its layer).
+	 * @param to Target revision number (must have its layer).
+	 * @param diff Structure where differences are added.
+	 *
+	 * Implementation of getRevisionDiff.
+	 */
+	void diffLayers(unsigned from, unsigned to, RevisionDiff & diff)const;
+
 public:
 	/** Initialize constructor with file stream writer.
 	 * @param stream File stream with pdf content.
 	 * @param _pdf Pdf instance which maintains this instance (may be also NULL,
 	 * which means that instance is standalone).
 	 *
+	 * @param snapshot Resolved cross reference information of the stream
+	 * data (NULL if not available).
+	 *
 	 * Sets mode to paranoid. Sets file to FILE handle from stream. Collects 
-	 * all revisions (uses collectRevisions method) and sets storePos to the 
-	 * %%EOF position.
+	 * all revisions (uses collectRevisions method unless they are taken from
+	 * the snapshot) and sets storePos to the %%EOF position.
 	 * <br>
 	 * Allocates OldStylePdfWriter for pdfWriter field.
 	 * <br>
-	 * Stream is supplied to CXref constructor.
+	 * Stream and snapshot are supplied to CXref constructor.
 	 *
 	 * @throw MalformedFormatExeption if XRef creation fails (instance is
 	 * unusable in such situation).
 	 */
-	XRefWriter(StreamWriter * stream, CPdf * _pdf);
+	XRefWriter(StreamWriter * stream, CPdf * _pdf, 
+			const xrefcache::XRefSnapshot * snapshot=NULL);
 
 	/** Destrucrtor.
 	 *
 	 * Deallocates pdfWriter field if it is non NULL.
 	 */
 	~XRefWriter();
+
+	/** Gets resolved cross reference information.
+	 * @param snapshot Snapshot to be filled.
+	 *
+	 * Fills the same information as CXref::getSnapshot and all revisions.
+	 */
+	void getSnapshot(xrefcache::XRefSnapshot & snapshot)const;
 	
 	/** Sets new pdf writer implementator.
 	 * @param writer Implementation of IPdfWriter (must be non NULL).
@@ -425,7 +553,10 @@ public:
 	 * and produces error when called.
 	 * <br>
 	 * This is because branching is not implementable in PDF structure.
-	 * 
+	 * <br>
+	 * Cross reference sections are parsed only for the first change (see
+	 * collectLayers) and the current table is then built from layers.
+	 *
 	 * @throw OutOfRange if revNumber doesn't stand for any known revisions.
 	 * @throw NotImplementedException if pdf content is linearized.
 	 */ 
@@ -450,6 +581,61 @@ public:
 		return revisions.size();
 	}
 
+	/** Type for set of object numbers. */
+	typedef std::set<int> ObjectNumSet;
+
+	/** Collects objects which differ between the current and given revision.
+	 * @param rev Revision number to compare with.
+	 * @param nums Set where numbers of different objects are added.
+	 *
+	 * Object differs if its cross reference entry is not the same in both
+	 * revisions. Compressed objects differ also if their object stream
+	 * differs. Objects changed in memory are not considered because they are
+	 * not revision specific.
+	 *
+	 * @return true if nums were collected, false if layers are not available
+	 * (all objects have to be considered different then).
+	 */
+	bool getChangedObjects(unsigned rev, ObjectNumSet & nums)const;
+
+	/** Compares cross reference tables of two revisions.
+	 * @param from Source revision number.
+	 * @param to Target revision number.
+	 * @param diff Structure where differences are stored (previous content
+	 * is discarded).
+	 *
+	 * Uses only cross reference sections of revisions (see collectLayers),
+	 * so no object is parsed. Only objects defined by revisions between both
+	 * given ones are examined. Compressed objects are considered changed also
+	 * if their object stream has changed (although their entries are the
+	 * same). Objects changed in memory are not considered.
+	 * <br>
+	 * Revisions may be given in any order, added and removed lists are
+	 * always relative to the from revision.
+	 *
+	 * @throw OutOfRange if some of revisions doesn't exist.
+	 * @return true if diff was collected, false if cross reference sections
+	 * can't be used (e.g. damaged document with reconstructed xref).
+	 */
+	bool getRevisionDiff(unsigned from, unsigned to, RevisionDiff & diff);
+
+	/** Creates read only XRef for given revision.
+	 * @param rev Revision number.
+	 *
+	 * Returned instance shares the document stream and encryption settings
+	 * with this instance but uses cross reference table of the given
+	 * revision, so objects of any revision can be fetched without changing
+	 * the current revision. Objects changed in memory are not visible.
+	 * <br>
+	 * The instance must not outlive this one and caller is responsible for
+	 * its deallocation.
+	 *
+	 * @throw OutOfRange if revision doesn't exist.
+	 * @return New XRef instance or NULL if cross reference sections can't be
+	 * used.
+	 */
+	::XRef * getRevisionXRef(unsigned rev);
+
 	/** Clones content of stream until end of current position.
 	 * @param file File handle where to copy content.
 	 * 
@@ -512,7 +698,25 @@ public:
 		// implementation
 		return XRef::fetch(num, gen, obj);
 	}
-		
+
+	/** Fetches several indirect objects at once.
+	 * @param refs References of objects to fetch.
+	 * @param objs Vector where to store fetched objects.
+	 *
+	 * Same as fetch: delegates to the CXref::fetchObjects method in the
+	 * newest revision, otherwise objects are just parsed (without changes).
+	 *
+	 * @see CXref::fetchObjects
+	 */
+	virtual void fetchObjects(const RefList & refs, ObjectList & objs)const
+	{
+		if(utils::isLatestRevision(*this))
+			return CXref::fetchObjects(refs, objs);
+
+		objs.assign(refs.size(), (::Object *)NULL);
+		parseObjects(refs, objs);
+	}
+
 	/** Checks if given reference is known.
 	 * @param ref Reference to check.
 	 *
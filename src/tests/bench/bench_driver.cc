@@ -0,0 +1,649 @@
+/*
+ * PDFedit - free program for PDF document manipulation.
+ * Copyright (C) 2006-2009  PDFedit team: Michal Hocko,
+ *                                        Jozef Misutka,
+ *                                        Martin Petricek
+ *                   Former team members: Miroslav Jahoda
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (in doc/LICENSE.GPL); if not, write to the 
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, 
+ * MA  02111-1307  USA
+ *
+ * Project is hosted on http://sourceforge.net/projects/pdfedit
+ */
+
+// Unified benchmark driver.
+//
+// Runs named scenarios over a set of documents (directories are expanded to
+// all *.pdf files they contain) and writes one result line per scenario and
+// document:
+//
+// scenario=open:status=ok:count=5:min=..:p50=..:p90=..:p99=..:max=..:mean=..:stddev=..:rss=..:file=..
+//
+// Times are in miliseconds, rss is peak resident set size (as reported by
+// getrusage) of the process which run the scenario. Each scenario and
+// document pair runs in its own child process, so that peak RSS belongs to
+// that pair and a crash or a timeout doesn't stop the whole run.
+//
+// Two result files are compared by
+// bench_driver -c base_results new_results
+// which uses Welch's t-test for each pair present in both files and exits
+// with 1 if any pair got significantly slower, so it can be used as a gate.
+
+#include <kernel/cpdf.h>
+#include <kernel/cpage.h>
+#include <kernel/factories.h>
+#include <kernel/flattener.h>
+#include <kernel/delinearizator.h>
+#include <kernel/pdfwriter.h>
+#include <kernel/pdfedit-core-dev.h>
+#include <xpdf/SplashOutputDev.h>
+#include <splash/SplashTypes.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <fstream>
+#include <map>
+#include <boost/scoped_ptr.hpp>
+#include "utils.h"
+
+using namespace boost;
+using namespace pdfobjects;
+using namespace pdfobjects::utils;
+using namespace std;
+
+// accumulates measured parts of one scenario run
+class stopwatch
+{
+	time_stamp_t begin;
+	double total;
+public:
+	stopwatch(): total(0) {}
+	void start() { get_time_stamp(&begin); }
+	void stop()
+	{
+		time_stamp_t end;
+		get_time_stamp(&end);
+		total += time_diff(begin, end);
+	}
+	double elapsed()const { return total; }
+};
+
+// thrown by scenarios which don't make sense for the document
+struct skip_scenario {};
+
+// name of the scratch file used by scenarios which write documents
+static string scratch_file;
+
+static void copy_file(const char * from, const string & to)
+{
+	ifstream in(from, ios::binary);
+	ofstream out(to.c_str(), ios::binary|ios::trunc);
+	out << in.rdbuf();
+	if(!in || !out)
+		throw runtime_error("unable to copy "+string(from)+" to "+to);
+}
+
+static void scenario_open(const char * name, stopwatch & watch)
+{
+	watch.start();
+	shared_ptr<CPdf> pdf = open_file(name, CPdf::ReadOnly);
+	watch.stop();
+}
+
+static void scenario_pagewalk(const char * name, stopwatch & watch)
+{
+	shared_ptr<CPdf> pdf = open_file(name, CPdf::ReadOnly);
+	watch.start();
+	for(size_t i=1; i<=pdf->getPageCount(); ++i)
+		pdf->getPage(i);
+	watch.stop();
+}
+
+static void scenario_parse(const char * name, stopwatch & watch)
+{
+	shared_ptr<CPdf> pdf = open_file(name, CPdf::ReadOnly);
+	for(size_t i=1; i<=pdf->getPageCount(); ++i)
+	{
+		shared_ptr<CPage> page = pdf->getPage(i);
+		vector<shared_ptr<CContentStream> > streams;
+		watch.start();
+		page->getContentStreams(streams);
+		watch.stop();
+	}
+}
+
+static void scenario_text(const char * name, stopwatch & watch)
+{
+	shared_ptr<CPdf> pdf = open_file(name, CPdf::ReadOnly);
+	for(size_t i=1; i<=pdf->getPageCount(); ++i)
+	{
+		shared_ptr<CPage> page = pdf->getPage(i);
+		string text;
+		watch.start();
+		page->getText(text);
+		watch.stop();
+	}
+}
+
+static void scenario_render(const char * name, stopwatch & watch)
+{
+	shared_ptr<CPdf> pdf = open_file(name, CPdf::ReadOnly);
+	SplashColor paperColor;
+	paperColor[0] = paperColor[1] = paperColor[2] = 0xff;
+	for(size_t i=1; i<=pdf->getPageCount(); ++i)
+	{
+		shared_ptr<CPage> page = pdf->getPage(i);
+		SplashOutputDev splash(splashModeRGB8, 4, gFalse, paperColor);
+		splash.startDoc(pdf->getCXref());
+		watch.start();
+		page->displayPage(splash);
+		watch.stop();
+	}
+}
+
+// adds a new entry to all page dictionaries and saves them as a new
+// revision
+static void scenario_save(const char * name, stopwatch & watch)
+{
+	copy_file(name, scratch_file);
+	shared_ptr<CPdf> pdf = open_file(scratch_file.c_str(), CPdf::ReadWrite);
+	if(pdf->getMode() == CPdf::ReadOnly)
+		throw skip_scenario();
+	scoped_ptr<IProperty> value(CIntFactory::getInstance(1));
+	for(size_t i=1; i<=pdf->getPageCount(); ++i)
+		pdf->getPage(i)->getDictionary()->addProperty("PdfeditBench", *value);
+	watch.start();
+	pdf->save(true);
+	watch.stop();
+}
+
+static void scenario_flatten(const char * name, stopwatch & watch)
+{
+	watch.start();
+	shared_ptr<Flattener> flattener = Flattener::getInstance(name, new OldStylePdfWriter());
+	int ret = flattener->flatten(scratch_file.c_str());
+	watch.stop();
+	if(ret)
+		throw runtime_error(strerror(ret));
+}
+
+static void scenario_delinearize(const char * name, stopwatch & watch)
+{
+	watch.start();
+	shared_ptr<Delinearizator> delinearizator = Delinearizator::getInstance(name, new OldStylePdfWriter());
+	if(!delinearizator)
+		throw skip_scenario();
+	int ret = delinearizator->delinearize(scratch_file.c_str());
+	watch.stop();
+	if(ret)
+		throw runtime_error(strerror(ret));
+}
+
+typedef void (*scenario_fn)(const char *, stopwatch &);
+
+struct scenario
+{
+	const char * name;
+	scenario_fn fn;
+	const char * description;
+};
+
+static const scenario all_scenarios[] = {
+	{"open", scenario_open, "open document"},
+	{"pagewalk", scenario_pagewalk, "get all pages"},
+	{"parse", scenario_parse, "parse content streams of all pages"},
+	{"text", scenario_text, "extract text from all pages"},
+	{"render", scenario_render, "render all pages (72 DPI)"},
+	{"save", scenario_save, "change all page dictionaries and save them"},
+	{"flatten", scenario_flatten, "flatten document"},
+	{"delinearize", scenario_delinearize, "delinearize linearized document"},
+	{NULL, NULL, NULL}
+};
+
+static const scenario * find_scenario(const string & name)
+{
+	for(const scenario * s=all_scenarios; s->name; ++s)
+		if(name == s->name)
+			return s;
+	return NULL;
+}
+
+// percentile (nearest rank) of sorted samples
+static double percentile(const vector<double> & sorted, double p)
+{
+	size_t rank = (size_t)ceil(p/100*sorted.size());
+	if(rank)
+		--rank;
+	return sorted[min(rank, sorted.size()-1)];
+}
+
+// runs scenario in the current process and writes samples and peak RSS
+// to the given descriptor
+static int run_child(const scenario & s, const char * file, int warmup, int repeat, int fd)
+{
+	ostringstream out;
+	try
+	{
+		for(int i=0; i<warmup; ++i)
+		{
+			stopwatch watch;
+			s.fn(file, watch);
+		}
+		out << "ok";
+		for(int i=0; i<repeat; ++i)
+		{
+			stopwatch watch;
+			s.fn(file, watch);
+			out << " " << watch.elapsed();
+		}
+		struct rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+		out << " rss " << usage.ru_maxrss;
+	}catch(skip_scenario &)
+	{
+		out.str("skipped");
+	}catch(std::exception & e)
+	{
+		out.str("error");
+		cerr << s.name << " failed for " << file << ": " << e.what() << endl;
+	}
+	string data = out.str();
+	if(write(fd, data.c_str(), data.size()) != (ssize_t)data.size())
+		return 1;
+	return 0;
+}
+
+// runs scenario for the file in a child process and writes result line
+static void run_scenario(FILE * out, const scenario & s, const char * file,
+		int warmup, int repeat, int timeout)
+{
+	int fds[2];
+	if(pipe(fds))
+	{
+		perror("pipe");
+		exit(EXIT_FAILURE);
+	}
+	fflush(out);
+	pid_t pid = fork();
+	if(pid < 0)
+	{
+		perror("fork");
+		exit(EXIT_FAILURE);
+	}
+	if(!pid)
+	{
+		close(fds[0]);
+		if(timeout)
+			alarm(timeout);
+		_exit(run_child(s, file, warmup, repeat, fds[1]));
+	}
+	close(fds[1]);
+	string data;
+	char buf[512];
+	ssize_t len;
+	while((len = read(fds[0], buf, sizeof(buf))) > 0 || (len < 0 && errno == EINTR))
+		if(len > 0)
+			data.append(buf, len);
+	close(fds[0]);
+	int status;
+	while(waitpid(pid, &status, 0) < 0 && errno == EINTR)
+		;
+
+	istringstream in(data);
+	string result;
+	in >> result;
+	if(WIFSIGNALED(status))
+		result = (WTERMSIG(status) == SIGALRM)?"timeout":"crash";
+	else if(result.empty())
+		result = "error";
+	fprintf(out, "scenario=%s:status=%s", s.name, result.c_str());
+	if(result == "ok")
+	{
+		vector<double> samples;
+		string token;
+		long rss = 0;
+		while(in >> token)
+		{
+			if(token == "rss")
+			{
+				in >> rss;
+				break;
+			}
+			samples.push_back(atof(token.c_str()));
+		}
+		sort(samples.begin(), samples.end());
+		double sum = 0, sq_sum = 0;
+		for(size_t i=0; i<samples.size(); ++i)
+			sum += samples[i];
+		double mean = sum/samples.size();
+		for(size_t i=0; i<samples.size(); ++i)
+			sq_sum += (samples[i]-mean)*(samples[i]-mean);
+		double stddev = (samples.size()>1)?sqrt(sq_sum/(samples.size()-1)):0;
+		fprintf(out, ":count=%lu:min=%g:p50=%g:p90=%g:p99=%g:max=%g:mean=%g:stddev=%g:rss=%ld",
+				(unsigned long)samples.size(), samples.front(),
+				percentile(samples, 50), percentile(samples, 90),
+				percentile(samples, 99), samples.back(), mean, stddev, rss);
+	}
+	fprintf(out, ":file=%s\n", file);
+	fflush(out);
+}
+
+// one parsed result line
+struct bench_result
+{
+	string status;
+	unsigned long count;
+	double p50;
+	double mean;
+	double stddev;
+	long rss;
+	bench_result(): count(0), p50(0), mean(0), stddev(0), rss(0) {}
+};
+
+typedef map<pair<string, string>, bench_result> result_map;
+
+static bool read_results(const char * name, result_map & results)
+{
+	ifstream in(name);
+	if(!in)
+	{
+		cerr << "Unable to open " << name << endl;
+		return false;
+	}
+	string line;
+	while(getline(in, line))
+	{
+		if(line.compare(0, 9, "scenario="))
+			continue;
+		// file is the last field and it may contain ':'
+		size_t file_pos = line.find(":file=");
+		if(file_pos == string::npos)
+			continue;
+		string file = line.substr(file_pos+6);
+		map<string, string> fields;
+		istringstream in_line(line.substr(0, file_pos));
+		string field;
+		while(getline(in_line, field, ':'))
+		{
+			size_t eq = field.find('=');
+			if(eq != string::npos)
+				fields[field.substr(0, eq)] = field.substr(eq+1);
+		}
+		bench_result & r = results[make_pair(fields["scenario"], file)];
+		r.status = fields["status"];
+		r.count = strtoul(fields["count"].c_str(), NULL, 10);
+		r.p50 = atof(fields["p50"].c_str());
+		r.mean = atof(fields["mean"].c_str());
+		r.stddev = atof(fields["stddev"].c_str());
+		r.rss = atol(fields["rss"].c_str());
+	}
+	return true;
+}
+
+// continued fraction for the incomplete beta function
+static double beta_cf(double a, double b, double x)
+{
+	const double eps = 3e-12, fpmin = 1e-300;
+	double qab = a+b, qap = a+1, qam = a-1;
+	double c = 1, d = 1-qab*x/qap;
+	if(fabs(d) < fpmin)
+		d = fpmin;
+	d = 1/d;
+	double h = d;
+	for(int m=1; m<=300; ++m)
+	{
+		int m2 = 2*m;
+		double aa = m*(b-m)*x/((qam+m2)*(a+m2));
+		d = 1+aa*d;
+		if(fabs(d) < fpmin)
+			d = fpmin;
+		c = 1+aa/c;
+		if(fabs(c) < fpmin)
+			c = fpmin;
+		d = 1/d;
+		h *= d*c;
+		aa = -(a+m)*(qab+m)*x/((a+m2)*(qap+m2));
+		d = 1+aa*d;
+		if(fabs(d) < fpmin)
+			d = fpmin;
+		c = 1+aa/c;
+		if(fabs(c) < fpmin)
+			c = fpmin;
+		d = 1/d;
+		double del = d*c;
+		h *= del;
+		if(fabs(del-1) < eps)
+			break;
+	}
+	return h;
+}
+
+// regularized incomplete beta function I_x(a, b)
+static double incomplete_beta(double a, double b, double x)
+{
+	if(x <= 0)
+		return 0;
+	if(x >= 1)
+		return 1;
+	double bt = exp(lgamma(a+b)-lgamma(a)-lgamma(b)+a*log(x)+b*log(1-x));
+	if(x < (a+1)/(a+b+2))
+		return bt*beta_cf(a, b, x)/a;
+	return 1-bt*beta_cf(b, a, 1-x)/b;
+}
+
+// two sided p-value of Welch's t-test
+static double welch_p_value(const bench_result & a, const bench_result & b)
+{
+	if(a.count < 2 || b.count < 2)
+		return 1;
+	double va = a.stddev*a.stddev/a.count, vb = b.stddev*b.stddev/b.count;
+	if(va+vb == 0)
+		return (a.mean == b.mean)?1:0;
+	double t = (b.mean-a.mean)/sqrt(va+vb);
+	double df = (va+vb)*(va+vb)/(va*va/(a.count-1)+vb*vb/(b.count-1));
+	return incomplete_beta(df/2, 0.5, df/(df+t*t));
+}
+
+// compares results and returns number of significant regressions
+static int compare_results(const char * base_name, const char * new_name,
+		double alpha, double threshold, double min_change)
+{
+	result_map base, current;
+	if(!read_results(base_name, base) || !read_results(new_name, current))
+		return -1;
+	int regressions = 0;
+	map<string, pair<double, int> > ratios;
+	printf("%-12s %10s %10s %8s %8s %10s  %s\n", "scenario", "base", "new",
+			"change", "p", "rss", "file");
+	for(result_map::const_iterator i=current.begin(); i!=current.end(); ++i)
+	{
+		result_map::const_iterator b = base.find(i->first);
+		if(b == base.end())
+			continue;
+		const bench_result & old_r = b->second, & new_r = i->second;
+		const char * scenario_name = i->first.first.c_str(), * file = i->first.second.c_str();
+		if(old_r.status != "ok" || new_r.status != "ok")
+		{
+			if(old_r.status != new_r.status)
+				printf("%-12s %10s %10s %8s %8s %10s  %s\n", scenario_name,
+						old_r.status.c_str(), new_r.status.c_str(), "", "", "", file);
+			// something which worked doesn't work anymore
+			if(old_r.status == "ok")
+				++regressions;
+			continue;
+		}
+		double change = (old_r.mean > 0)?(new_r.mean/old_r.mean-1)*100:0;
+		double p = welch_p_value(old_r, new_r);
+		const char * verdict = "";
+		if(p < alpha && fabs(change) >= threshold
+				&& fabs(new_r.mean-old_r.mean) >= min_change)
+		{
+			verdict = (change > 0)?" REGRESSION":" improvement";
+			if(change > 0)
+				++regressions;
+		}
+		char rss[32];
+		snprintf(rss, sizeof(rss), "%+ld", new_r.rss-old_r.rss);
+		printf("%-12s %10.3f %10.3f %+7.1f%% %8.4f %10s  %s%s\n", scenario_name,
+				old_r.mean, new_r.mean, change, p, rss, file, verdict);
+		if(old_r.mean > 0 && new_r.mean > 0)
+		{
+			pair<double, int> & r = ratios[i->first.first];
+			r.first += log(new_r.mean/old_r.mean);
+			++r.second;
+		}
+	}
+	printf("\ngeometric mean of new/base time ratios:\n");
+	for(map<string, pair<double, int> >::const_iterator i=ratios.begin(); i!=ratios.end(); ++i)
+		printf("%-12s %+7.1f%% (%d documents)\n", i->first.c_str(),
+				(exp(i->second.first/i->second.second)-1)*100, i->second.second);
+	printf("\n%d significant regression(s) (alpha=%g, threshold=%g%%, %gms)\n",
+			regressions, alpha, threshold, min_change);
+	return regressions;
+}
+
+static void usage(const char * name)
+{
+	fprintf(stderr, "Usage: %s [-s scenario[,scenario...]] [-w warmup] [-r repeat]\n"
+			"\t\t[-t timeout] [-o output] file|directory...\n"
+			"       %s -c [-a alpha] [-p percent] [-m ms] base_results new_results\n"
+			"       %s -l\n\n"
+			"-s\tscenarios to run (all by default)\n"
+			"-w\tnumber of warm up runs (default 1)\n"
+			"-r\tnumber of measured runs (default 5)\n"
+			"-t\ttimeout for one scenario and document in seconds (default 0 - none)\n"
+			"-o\toutput file (default standard output)\n"
+			"-c\tcompare two result files, exit with 1 if there are regressions\n"
+			"-a\tsignificance level for comparison (default 0.05)\n"
+			"-p\tminimal change in percents reported as regression (default 5)\n"
+			"-m\tminimal change in miliseconds reported as regression (default 0.1)\n"
+			"-l\tlist scenarios\n",
+			name, name, name);
+}
+
+int main(int argc, char ** argv)
+{
+	if(pdfedit_core_dev_init(&argc, &argv))
+		return EXIT_FAILURE;
+
+	vector<const scenario *> scenarios;
+	int warmup = 1, repeat = 5, timeout = 0;
+	bool compare = false;
+	double alpha = 0.05, threshold = 5, min_change = 0.1;
+	const char * output = NULL;
+	int opt;
+	while((opt = getopt(argc, argv, "s:w:r:t:o:ca:p:m:lh")) != -1)
+	{
+		switch(opt)
+		{
+			case 's':
+			{
+				istringstream names(optarg);
+				string name;
+				while(getline(names, name, ','))
+				{
+					const scenario * s = find_scenario(name);
+					if(!s)
+					{
+						fprintf(stderr, "Unknown scenario %s\n", name.c_str());
+						return EXIT_FAILURE;
+					}
+					scenarios.push_back(s);
+				}
+				break;
+			}
+			case 'w':
+				warmup = atoi(optarg);
+				break;
+			case 'r':
+				repeat = atoi(optarg);
+				break;
+			case 't':
+				timeout = atoi(optarg);
+				break;
+			case 'o':
+				output = optarg;
+				break;
+			case 'c':
+				compare = true;
+				break;
+			case 'a':
+				alpha = atof(optarg);
+				break;
+			case 'p':
+				threshold = atof(optarg);
+				break;
+			case 'm':
+				min_change = atof(optarg);
+				break;
+			case 'l':
+				for(const scenario * s=all_scenarios; s->name; ++s)
+					printf("%-12s %s\n", s->name, s->description);
+				return EXIT_SUCCESS;
+			default:
+				usage(argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if(compare)
+	{
+		if(argc-optind != 2)
+		{
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+		int regressions = compare_results(argv[optind], argv[optind+1], alpha, threshold, min_change);
+		return (regressions)?EXIT_FAILURE:EXIT_SUCCESS;
+	}
+
+	if(optind >= argc || repeat < 1 || warmup < 0)
+	{
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	if(scenarios.empty())
+		for(const scenario * s=all_scenarios; s->name; ++s)
+			scenarios.push_back(s);
+	vector<string> files;
+	for(int i=optind; i<argc; ++i)
+		add_documents(argv[i], files);
+
+	FILE * out = stdout;
+	if(output && !(out = fopen(output, "w")))
+	{
+		perror(output);
+		return EXIT_FAILURE;
+	}
+	const char * tmp_dir = getenv("TMPDIR");
+	ostringstream scratch;
+	scratch << ((tmp_dir)?tmp_dir:"/tmp") << "/bench_driver-" << getpid() << ".pdf";
+	scratch_file = scratch.str();
+
+	for(size_t f=0; f<files.size(); ++f)
+		for(size_t s=0; s<scenarios.size(); ++s)
+			run_scenario(out, *scenarios[s], files[f].c_str(), warmup, repeat, timeout);
+	unlink(scratch_file.c_str());
+
+	if(out != stdout)
+		fclose(out);
+	pdfedit_core_dev_destroy();
+	return EXIT_SUCCESS;
+}
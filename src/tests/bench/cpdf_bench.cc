@@ -201,6 +201,92 @@ void bench_removePage(shared_ptr<CPdf> pdf, shared_ptr<CPdf> copy_pdf,
 	}
 }
 
+// moves per% of pages to random positions (removePage followed by
+// insertPage of the same page) and looks up position of a random page
+// after each move. Fixed seed is used so that results are comparable.
+void bench_reorderPages(shared_ptr<CPdf> pdf, struct result *result, int per)
+{
+	size_t count = pdf->getPageCount();
+	int number = count * per / 100;
+	time_stamp_t start, end;
+	// skip for read only documents
+	if(pdf->getMode() == CPdf::ReadOnly || count < 2)
+		return;
+	srand(1);
+	for (;number>0; --number)
+	{
+		size_t src = rand() % count + 1;
+		size_t dst = rand() % count + 1;
+		size_t lookup = rand() % count + 1;
+		get_time_stamp(&start);
+		shared_ptr<CPage> page = pdf->getPage(src);
+		pdf->removePage(src);
+		pdf->insertPage(page, dst);
+		pdf->getPagePosition(pdf->getPage(lookup));
+		get_time_stamp(&end);
+		if(result)
+			update_result(time_diff(start, end), *result);
+	}
+}
+
+// copies count pages from the document with given name to the end of pdf
+// (each page is copied with all objects it refers to). Source document is
+// reopened whenever all its pages have been copied, so that no page is
+// copied twice from the same CPdf instance
+void bench_copyPages(shared_ptr<CPdf> pdf, const char * name, 
+		struct result *result, int count)
+{
+	time_stamp_t start, end;
+	shared_ptr<CPdf> source;
+	size_t page_num = 0;
+	// skip for read only documents
+	if(pdf->getMode() == CPdf::ReadOnly)
+		return;
+	for (;count>0; --count)
+	{
+		if(!source || page_num == source->getPageCount())
+		{
+			source = open_file(name);
+			page_num = 0;
+			if(!source->getPageCount())
+				return;
+		}
+		shared_ptr<CPage> page = source->getPage(++page_num);
+		get_time_stamp(&start);
+		pdf->insertPage(page, pdf->getPageCount()+1);
+		get_time_stamp(&end);
+		if(result)
+			update_result(time_diff(start, end), *result);
+	}
+}
+
+// imports count pages from the document with given name to the end of pdf
+// by importPages (whole source document at once). Source document is 
+// reopened for each batch
+void bench_importPages(shared_ptr<CPdf> pdf, const char * name, 
+		struct result *result, int count)
+{
+	time_stamp_t start, end;
+	// skip for read only documents
+	if(pdf->getMode() == CPdf::ReadOnly)
+		return;
+	while(count>0)
+	{
+		shared_ptr<CPdf> source = open_file(name);
+		size_t page_count = source->getPageCount();
+		if(!page_count)
+			return;
+		if(page_count > (size_t)count)
+			page_count = count;
+		get_time_stamp(&start);
+		pdf->importPages(source, 1, page_count, pdf->getPageCount()+1);
+		get_time_stamp(&end);
+		if(result)
+			update_result(time_diff(start, end), *result);
+		count -= page_count;
+	}
+}
+
 // measures page forward iteration (hasNextPage && getNextPage starting
 // from getFirstPage)
 void bench_fwd_iter(shared_ptr<CPdf> pdf, struct result * result)
@@ -285,6 +371,25 @@ void bench_addIndirectProperty(shared_ptr<CPdf> pdf, shared_ptr<CPdf> helper_pdf
 	}
 }
 
+// measures clone of all page dictionaries (with their resources and
+// contents) done per times for each page
+void bench_clonePages(shared_ptr<CPdf> pdf, struct result * result, int per)
+{
+	time_stamp_t start, end;
+	for (size_t p=1; p<=pdf->getPageCount(); ++p)
+	{
+		shared_ptr<CDict> page_dict = pdf->getPage(p)->getDictionary();
+		for (int i=0; i<per; ++i)
+		{
+			get_time_stamp(&start);
+			shared_ptr<IProperty> clone = page_dict->clone();
+			get_time_stamp(&end);
+			if (result)
+				update_result(time_diff(start, end), *result);
+		}
+	}
+}
+
 void bench_changeRevision(shared_ptr<CPdf> pdf, struct result * result)
 {
 	time_stamp_t start, end;
@@ -409,6 +514,26 @@ int main(int argc, char **argv)
 			&removePage_all_front, PagePosition(PagePosition::FRONT), 100);
 	copy_pdf.reset();
 
+	// copies 10000 pages between documents
+	pdf = open_file(file_name);
+	DEFINE_RESULTS(copy_pages, "copy_pages_10000");
+	bench_copyPages(pdf, file_name, &copy_pages, 10000);
+
+	// imports 10000 pages between documents in batches
+	pdf = open_file(file_name);
+	DEFINE_RESULTS(import_pages, "import_pages_10000");
+	bench_importPages(pdf, file_name, &import_pages, 10000);
+
+	// random page reordering
+	pdf = open_file(file_name);
+	DEFINE_RESULTS(page_reorder_random, "page_reorder_random");
+	bench_reorderPages(pdf, &page_reorder_random, 100);
+
+	// clones page dictionaries
+	pdf = open_file(file_name);
+	DEFINE_RESULTS(clone_pages, "clone_pages");
+	bench_clonePages(pdf, &clone_pages, 10);
+
 	pdf = open_file(file_name);
 	DEFINE_RESULTS(change_revision, "change_revision");
 	bench_changeRevision(pdf, &change_revision);
@@ -433,6 +558,10 @@ int main(int argc, char **argv)
 		&insertPage_all_front,
 		&removePage_all_end,
 		&removePage_all_front,
+		&copy_pages,
+		&import_pages,
+		&page_reorder_random,
+		&clone_pages,
 		&change_revision,
 		NULL
 	};
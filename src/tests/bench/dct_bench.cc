@@ -0,0 +1,158 @@
+/*
+ * PDFedit - free program for PDF document manipulation.
+ * Copyright (C) 2006-2009  PDFedit team: Michal Hocko,
+ *                                        Jozef Misutka,
+ *                                        Martin Petricek
+ *                   Former team members: Miroslav Jahoda
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (in doc/LICENSE.GPL); if not, write to the 
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, 
+ * MA  02111-1307  USA
+ *
+ * Project is hosted on http://sourceforge.net/projects/pdfedit
+ */
+#include <kernel/cpdf.h>
+#include <kernel/cxref.h>
+#include <kernel/pdfedit-core-dev.h>
+#include <xpdf/GlobalParams.h>
+#include "utils.h"
+
+using namespace boost;
+using namespace pdfobjects;
+
+// Decodes the whole stream and returns a simple checksum of its data.
+// Decoded length is returned via len parameter.
+static unsigned long decode_stream(Stream *str, size_t &len)
+{
+	unsigned long sum = 0;
+	int c;
+
+	len = 0;
+	str->reset();
+	while((c = str->getChar()) != EOF)
+	{
+		sum = sum * 31 + c;
+		++len;
+	}
+	str->close();
+	return sum;
+}
+
+// Decodes the given DCT stream object with the given decoder and
+// accounts time into result.
+static unsigned long bench_decode(CXref *xref, int num, int gen, bool fast,
+		struct result &result, size_t &len)
+{
+	Object obj;
+	time_stamp_t start, end;
+	unsigned long sum;
+
+	globalParams->setDCTFastDecode(fast ? "yes" : "no");
+	xref->fetch(num, gen, &obj);
+	get_time_stamp(&start);
+	sum = decode_stream(obj.getStream(), len);
+	get_time_stamp(&end);
+	update_result(time_diff(start, end), result);
+	obj.free();
+	return sum;
+}
+
+// Decodes all DCT encoded streams (images) in the document with the
+// legacy and the fast DCT decoder and checks that both of them produce
+// the same data.
+static void bench_document(const char *name, struct result &dct_legacy,
+		struct result &dct_fast, int &images, size_t &pixels,
+		int &mismatches)
+{
+	shared_ptr<CPdf> pdf = open_file(name, CPdf::ReadOnly);
+	// documents encrypted with an empty user password are decoded as well
+	if(pdf->needsCredentials())
+		pdf->setCredentials(NULL, NULL);
+	CXref *xref = pdf->getCXref();
+
+	for(int num = 0; num < xref->getSize(); ++num)
+	{
+		XRefEntry *entry = xref->getEntry(num);
+		if(entry->type == xrefEntryFree)
+			continue;
+		int gen = (entry->type == xrefEntryCompressed) ? 0 : entry->gen;
+		Object obj;
+		xref->fetch(num, gen, &obj);
+		bool isDCT = obj.isStream() && obj.getStream()->getKind() == strDCT;
+		obj.free();
+		if(!isDCT)
+			continue;
+
+		size_t legacy_len, fast_len;
+		unsigned long legacy_sum = bench_decode(xref, num, gen, false,
+				dct_legacy, legacy_len);
+		unsigned long fast_sum = bench_decode(xref, num, gen, true,
+				dct_fast, fast_len);
+		++images;
+		pixels += legacy_len;
+		if(legacy_sum != fast_sum || legacy_len != fast_len)
+		{
+			fprintf(stderr, "%s: object %d %d: fast decoder output differs\n",
+					name, num, gen);
+			++mismatches;
+		}
+	}
+}
+
+// Runs bench_document for all given documents (directories are expanded
+// to all pdf documents they contain) and reports summary results.
+int main(int argc, char **argv)
+{
+	int ret;
+
+	if((ret = init_bench(argc, argv)))
+		return ret;
+
+	std::vector<std::string> files;
+	for(int i = 1; i < argc; ++i)
+		add_documents(argv[i], files);
+
+	DEFINE_RESULTS(dct_legacy, "dct_legacy");
+	DEFINE_RESULTS(dct_fast, "dct_fast");
+	int documents = 0, images = 0, mismatches = 0;
+	size_t pixels = 0;
+
+	for(size_t i = 0; i < files.size(); ++i)
+	{
+		const char *name = files[i].c_str();
+		try
+		{
+			bench_document(name, dct_legacy, dct_fast, images, pixels,
+					mismatches);
+			++documents;
+		}catch(std::exception &e)
+		{
+			// encrypted or damaged documents are skipped
+			fprintf(stderr, "%s: skipped (%s)\n", name, e.what());
+		}
+	}
+	globalParams->setDCTFastDecode("yes");
+
+	struct result *all_results [] = {
+		&dct_legacy,
+		&dct_fast,
+		NULL
+	};
+	print_results(stdout, all_results);
+	fprintf(stdout, "documents=%d:images=%d:bytes=%lu:mismatches=%d\n", 
+			documents, images, (unsigned long)pixels, mismatches);
+
+	fprintf(stdout, "\n---\n");
+	gMemReport(stdout);
+	return mismatches ? 1 : 0;
+}
@@ -0,0 +1,103 @@
+/*
+ * PDFedit - free program for PDF document manipulation.
+ * Copyright (C) 2006-2009  PDFedit team: Michal Hocko,
+ *                                        Jozef Misutka,
+ *                                        Martin Petricek
+ *                   Former team members: Miroslav Jahoda
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (in doc/LICENSE.GPL); if not, write to the 
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, 
+ * MA  02111-1307  USA
+ *
+ * Project is hosted on http://sourceforge.net/projects/pdfedit
+ */
+#include <kernel/cpdf.h>
+#include <kernel/cxref.h>
+#include <kernel/pdfedit-core-dev.h>
+#include "utils.h"
+
+using namespace boost;
+using namespace pdfobjects;
+
+// Decodes the whole stream and returns a simple checksum of its data.
+// Decoded length is returned via len parameter.
+static unsigned long decode_stream(Stream *str, size_t &len)
+{
+	unsigned long sum = 0;
+	int c;
+
+	len = 0;
+	str->reset();
+	while((c = str->getChar()) != EOF)
+	{
+		sum = sum * 31 + c;
+		++len;
+	}
+	str->close();
+	return sum;
+}
+
+// Decodes all JBIG2 encoded streams (images) in the document and
+// reports decoding throughput. Each JBIG2Decode stream holds exactly
+// one JBIG2 page, so the throughput is given in pages per second.
+int main(int argc, char **argv)
+{
+	int ret;
+
+	if((ret = init_bench(argc, argv)))
+		return ret;
+
+	shared_ptr<CPdf> pdf = open_file(file_name, CPdf::ReadOnly);
+	CXref *xref = pdf->getCXref();
+	DEFINE_RESULTS(jbig2_page, "jbig2_page");
+	int pages = 0;
+	size_t bytes = 0;
+	unsigned long sum = 0;
+
+	for(int num = 0; num < xref->getSize(); ++num)
+	{
+		XRefEntry *entry = xref->getEntry(num);
+		if(entry->type == xrefEntryFree)
+			continue;
+		int gen = (entry->type == xrefEntryCompressed) ? 0 : entry->gen;
+		Object obj;
+		xref->fetch(num, gen, &obj);
+		if(obj.isStream() && obj.getStream()->getKind() == strJBIG2)
+		{
+			time_stamp_t start, end;
+			size_t len;
+
+			get_time_stamp(&start);
+			sum += decode_stream(obj.getStream(), len);
+			get_time_stamp(&end);
+			update_result(time_diff(start, end), jbig2_page);
+			++pages;
+			bytes += len;
+		}
+		obj.free();
+	}
+
+	struct result *all_results [] = {
+		&jbig2_page,
+		NULL
+	};
+	print_results(stdout, all_results);
+	fprintf(stdout, "pages=%d:bytes=%lu:checksum=%lx:pages_per_sec=%.2f\n",
+			pages, (unsigned long)bytes, sum,
+			(jbig2_page.sum_time > 0) ?
+				pages * 1000.0 / jbig2_page.sum_time : 0.0);
+
+	fprintf(stdout, "\n---\n");
+	gMemReport(stdout);
+	return 0;
+}
@@ -22,6 +22,9 @@
  * Project is hosted on http://sourceforge.net/projects/pdfedit
  */
 #include <stdlib.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <algorithm>
 #include <kernel/pdfedit-core-dev.h>
 #include "utils.h"
 const char *file_name;
@@ -48,6 +51,34 @@ int init_bench(int argc, char **argv)
 	return parse_cmd_line(argc, argv);
 }
 
+static bool has_pdf_suffix(const std::string & name)
+{
+	if(name.size() < 4)
+		return false;
+	std::string suffix = name.substr(name.size()-4);
+	for(size_t i=0; i<suffix.size(); ++i)
+		suffix[i] = tolower(suffix[i]);
+	return suffix == ".pdf";
+}
+
+void add_documents(const char * path, std::vector<std::string> & files)
+{
+	DIR * dir = opendir(path);
+	if(!dir)
+	{
+		files.push_back(path);
+		return;
+	}
+	std::vector<std::string> names;
+	struct dirent * entry;
+	while((entry = readdir(dir)))
+		if(has_pdf_suffix(entry->d_name))
+			names.push_back(std::string(path)+"/"+entry->d_name);
+	closedir(dir);
+	std::sort(names.begin(), names.end());
+	files.insert(files.end(), names.begin(), names.end());
+}
+
 // result is in miliseconds
 double time_diff(time_stamp_t &start, time_stamp_t &end)
 {
@@ -31,11 +31,16 @@
 #include <time.h>
 #include <boost/shared_ptr.hpp>
 #include <limits.h>
+#include <string>
+#include <vector>
 
 extern const char * file_name;
 
 int init_bench(int argc, char **argv);
 
+// adds file or all pdf documents from the directory (sorted by name)
+void add_documents(const char * path, std::vector<std::string> & files);
+
 // redefine if something different than gettimeofday should
 // be used for time measuring
 typedef struct timeval time_stamp_t;
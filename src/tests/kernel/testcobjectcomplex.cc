@@ -628,6 +628,212 @@ c_forEach (std::ostream& oss, const char* filename)
 	return true;
 }
 
+//=====================================================================================
+// Copy-on-write clones
+//=====================================================================================
+
+namespace {
+	/** Observer which counts received notifications. */
+	class ChangeCounter : public observer::IObserver<IProperty>
+	{
+	public:
+		mutable size_t count;
+
+		ChangeCounter () : count (0) {}
+		virtual ~ChangeCounter () throw() {}
+
+		virtual void notify (boost::shared_ptr<IProperty>, 
+				boost::shared_ptr<const observer::IChangeContext<IProperty> >) const throw()
+			{ ++count; }
+		virtual priority_t getPriority () const throw()
+			{ return 0; }
+	};
+
+	/** Creates dictionary with nested dictionary, array and stream. */
+	boost::shared_ptr<CDict>
+	cow_dict ()
+	{
+		CDict dict;
+		CDict nested;
+		nested.addProperty ("x", CInt (1));
+		CArray array;
+		array.addProperty (CInt (1));
+		array.addProperty (nested);
+		CStream stream;
+		stream.setBuffer (string ("stream data"));
+		dict.addProperty ("n", nested);
+		dict.addProperty ("a", array);
+		dict.addProperty ("s", stream);
+		return IProperty::getSmartCObjectPtr<CDict> (dict.clone ());
+	}
+
+	string
+	cow_str (const IProperty& ip)
+	{
+		string str;
+		ip.getStringRepresentation (str);
+		return str;
+	}
+}
+
+bool
+c_cow_clone ()
+{
+	// mutating the original after clone
+	CInt changed (2);
+	boost::shared_ptr<CDict> dict = cow_dict ();
+	string orig = cow_str (*dict);
+	boost::shared_ptr<IProperty> clone = dict->clone ();
+	dict->getProperty<CDict> ("n")->setProperty ("x", changed);
+	dict->getProperty<CArray> ("a")->addProperty (CInt (3));
+	ip_validate (*clone, orig);
+	if (cow_str (*dict) == orig)
+		return false;
+
+	// mutating the clone after clone
+	dict = cow_dict ();
+	boost::shared_ptr<CDict> dictClone = IProperty::getSmartCObjectPtr<CDict> (dict->clone ());
+	dictClone->getProperty<CDict> ("n")->setProperty ("x", changed);
+	dictClone->delProperty ("a");
+	ip_validate (*dict, orig);
+	if (cow_str (*dictClone) == orig)
+		return false;
+
+	// both sides mutated, clone of clone outlives the original
+	dict = cow_dict ();
+	dictClone = IProperty::getSmartCObjectPtr<CDict> (dict->clone ());
+	boost::shared_ptr<IProperty> cloneOfClone = dictClone->clone ();
+	dict->getProperty<CDict> ("n")->addProperty ("y", CInt (1));
+	dictClone->getProperty<CDict> ("n")->addProperty ("z", CInt (1));
+	if (cow_str (*dict).find ("/z") != string::npos || cow_str (*dictClone).find ("/y") != string::npos)
+		return false;
+	dict.reset ();
+	dictClone.reset ();
+	ip_validate (*cloneOfClone, orig);
+
+	return true;
+}
+
+bool
+c_cow_escaped ()
+{
+	// child held by the caller must not be shared
+	boost::shared_ptr<CDict> dict = cow_dict ();
+	string orig = cow_str (*dict);
+	boost::shared_ptr<CDict> nested = dict->getProperty<CDict> ("n");
+	boost::shared_ptr<IProperty> clone = dict->clone ();
+	nested->addProperty ("y", CInt (1));
+	ip_validate (*clone, orig);
+	if (cow_str (*dict) == orig)
+		return false;
+
+	// escaped grandchild
+	dict = cow_dict ();
+	boost::shared_ptr<CInt> item = dict->getProperty<CArray> ("a")->getProperty<CInt> (0);
+	clone = dict->clone ();
+	item->setValue (42);
+	ip_validate (*clone, orig);
+	if (cow_str (*dict) == orig)
+		return false;
+
+	return true;
+}
+
+bool
+c_cow_const_read ()
+{
+	// const access returns shared items
+	boost::shared_ptr<CDict> dict = cow_dict ();
+	string orig = cow_str (*dict);
+	boost::shared_ptr<CDict> clone = IProperty::getSmartCObjectPtr<CDict> (dict->clone ());
+	const CDict& constDict = *dict;
+	const CDict& constClone = *clone;
+	if (constDict.getProperty ("n") != constClone.getProperty ("n"))
+		return false;
+	boost::shared_ptr<const CArray> array = constDict.getProperty<CArray> ("a");
+	if (array->getProperty (0) != constClone.getProperty<CArray> ("a")->getProperty (0))
+		return false;
+	std::vector<boost::shared_ptr<IProperty> > children;
+	constClone._getAllChildObjects (children);
+	if (children.size () != constDict.getPropertyCount () || constDict.getProperty ("n") != constClone.getProperty ("n"))
+		return false;
+	if (1 != utils::getIntFromDict (constDict.getProperty ("n"), "x") || constDict.getProperty ("n") != constClone.getProperty ("n"))
+		return false;
+
+	// mutable access still detaches
+	CInt changed (2);
+	clone->getProperty<CDict> ("n")->setProperty ("x", changed);
+	if (constDict.getProperty ("n") == constClone.getProperty ("n"))
+		return false;
+	ip_validate (*dict, orig);
+	if (cow_str (*clone) == orig)
+		return false;
+
+	return true;
+}
+
+bool
+c_cow_observer (const char* filename)
+{
+	boost::shared_ptr<CPdf> pdf = getTestCPdf (filename);
+	if (pdf->isLinearized () || utils::isEncrypted (pdf))
+		return true;
+
+	// observer is registered on a child of indirect object which is not
+	// held by anybody else, so items of the object are shared by its clone
+	IndiRef ref = pdf->addIndirectProperty (cow_dict ());
+	boost::shared_ptr<CDict> dict = IProperty::getSmartCObjectPtr<CDict> (pdf->getIndirectProperty (ref));
+	boost::shared_ptr<ChangeCounter> counter (new ChangeCounter ());
+	IProperty::Observer observer (counter);
+	boost::shared_ptr<CDict> nested = dict->getProperty<CDict> ("n");
+	nested->registerObserver (observer);
+	nested.reset ();
+	boost::shared_ptr<CDict> clone = IProperty::getSmartCObjectPtr<CDict> (dict->clone ());
+
+	// detach by clone doesn't take items with the observer from the original
+	CInt cloneValue (2);
+	clone->getProperty<CDict> ("n")->setProperty ("x", cloneValue);
+	if (counter->count)
+		return false;
+	nested = dict->getProperty<CDict> ("n");
+	CInt value (3);
+	nested->setProperty ("x", value);
+	if (1 != counter->count)
+		return false;
+	ip_validate (*clone->getProperty ("n"), "<<\n/x 2\n>>");
+	nested->unregisterObserver (observer);
+
+	return true;
+}
+
+bool
+c_cow_stream ()
+{
+	CStream stream;
+	stream.setBuffer (string ("stream data"));
+	stream.addProperty ("Foo", CInt (1));
+	boost::shared_ptr<CStream> clone = IProperty::getSmartCObjectPtr<CStream> (stream.clone ());
+
+	// buffer is shared until one of the streams sets new one
+	if (&stream.getBuffer () != &clone->getBuffer ())
+		return false;
+	clone->setBuffer (string ("other data"));
+	if (&stream.getBuffer () == &clone->getBuffer ())
+		return false;
+	string orig, changed;
+	stream.getDecodedStringRepresentation (orig);
+	clone->getDecodedStringRepresentation (changed);
+	if (orig != "stream data" || changed != "other data")
+		return false;
+
+	// dictionary is not shared after clone
+	clone->addProperty ("Bar", CInt (1));
+	if (stream.containsProperty ("Bar") || !clone->containsProperty ("Foo"))
+		return false;
+
+	return true;
+}
+
 //=========================================================================
 // class TestCObjectComplex
 //=========================================================================
@@ -638,6 +844,7 @@ class TestCObjectComplex : public CppUnit::TestFixture
 		CPPUNIT_TEST(TestGet);
 		CPPUNIT_TEST(TestSet);
 		CPPUNIT_TEST(TestForEach);
+		CPPUNIT_TEST(TestCopyOnWrite);
 	CPPUNIT_TEST_SUITE_END();
 
 private:
@@ -761,6 +968,38 @@ public:
 
 	}
 
+	void TestCopyOnWrite ()
+	{
+		OUTPUT << "CObjectComplex copy-on-write clones..." << endl;
+
+		TEST(" clone mutations")
+		CPPUNIT_ASSERT (c_cow_clone ());
+		OK_TEST;
+
+		TEST(" escaped children")
+		CPPUNIT_ASSERT (c_cow_escaped ());
+		OK_TEST;
+
+		TEST(" const access")
+		CPPUNIT_ASSERT (c_cow_const_read ());
+		OK_TEST;
+
+		TEST(" stream buffer")
+		CPPUNIT_ASSERT (c_cow_stream ());
+		OK_TEST;
+
+		for(TestParams::FileList::const_iterator it = TestParams::instance().files.begin(); 
+				it != TestParams::instance().files.end(); 
+					++it)
+		{
+			OUTPUT << "Testing filename: " << *it << endl;
+
+			TEST(" observers")
+			CPPUNIT_ASSERT (c_cow_observer ((*it).c_str()));
+			OK_TEST;
+		}
+	}
+
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION(TestCObjectComplex);
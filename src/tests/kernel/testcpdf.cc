@@ -29,8 +29,14 @@
 #include "kernel/factories.h"
 #include "kernel/cobjecthelpers.h"
 #include "kernel/cpdf.h"
+#include "kernel/cpageattributes.h"
 #include "kernel/pdfwriter.h"
 #include "kernel/delinearizator.h"
+#include "kernel/flattener.h"
+#include "kernel/xrefcache.h"
+#include "kernel/revisiondiff.h"
+#include "kernel/pageindex.h"
+#include "kernel/metrics.h"
 
 using namespace pdfobjects;
 using namespace utils;
@@ -77,6 +83,28 @@ public:
 	}
 };
 
+/** Observer which counts received notifications.
+ */
+class NotificationCounter:public observer::IObserver<IProperty>
+{
+public:
+	mutable size_t count;
+
+	NotificationCounter():count(0){}
+	virtual ~NotificationCounter()throw(){}
+
+	virtual void notify(boost::shared_ptr<IProperty>, 
+			boost::shared_ptr<const observer::IChangeContext<IProperty> >)const throw()
+	{
+		++count;
+	}
+
+	virtual priority_t getPriority()const throw()
+	{
+		return 0;
+	}
+};
+
 class TestCPdf: public CppUnit::TestFixture
 {
 	CPPUNIT_TEST_SUITE(TestCPdf);
@@ -697,6 +725,348 @@ public:
 		CPPUNIT_ASSERT(pdf->isChanged());
 	}
 
+	/** Checks page tree under given node.
+	 * @param node Page tree node.
+	 * @param fanOut Maximal number of kids of intermediate nodes.
+	 * @param depth Depth of the node.
+	 * @param leafDepth Depth of pages (0 until the first page is found).
+	 * @return Number of pages under the node.
+	 */
+	size_t checkBalancedPageTree(boost::shared_ptr<CDict> node, size_t fanOut, size_t depth, size_t & leafDepth)
+	{
+	using namespace utils;
+
+		if(getNodeType(node)==LeafNode)
+		{
+			if(!leafDepth)
+				leafDepth=depth;
+			CPPUNIT_ASSERT(leafDepth==depth);
+			return 1;
+		}
+		shared_ptr<CArray> kids=node->getProperty<CArray>("Kids");
+		CPPUNIT_ASSERT(kids->getPropertyCount()<=fanOut);
+		size_t count=0;
+		for(size_t i=0; i<kids->getPropertyCount(); ++i)
+		{
+			shared_ptr<CDict> kid=getCObjectFromRef<CDict>(kids->getProperty(i));
+			CPPUNIT_ASSERT(getValueFromSimple<CRef>(kid->getProperty("Parent"))==node->getIndiRef());
+			count+=checkBalancedPageTree(kid, fanOut, depth+1, leafDepth);
+		}
+		CPPUNIT_ASSERT((size_t)getIntFromIProperty(node->getProperty("Count"))==count);
+		return count;
+	}
+
+	void pageTreeRebuildTC(boost::shared_ptr<CPdf> pdf)
+	{
+	using namespace boost;
+	using namespace utils;
+
+		printf("%s\n", __FUNCTION__);
+		if(pdf->isLinearized())
+		{
+			printf("Usecase is not suitable becuase document is linearized\n");
+			return;
+		}
+
+		// collects pages and their inherited attributes
+		size_t pageCount=pdf->getPageCount();
+		vector<shared_ptr<CPage> > pages;
+		vector<string> attributes;
+		for(size_t i=1; i<=pageCount; ++i)
+		{
+			shared_ptr<CPage> page=pdf->getPage(i);
+			CPageAttributes::InheritedAttributes attrs;
+			CPageAttributes::fillInherited(page->getDictionary(), attrs);
+			string resources, mediaBox, cropBox, rotate;
+			attrs._resources->getStringRepresentation(resources);
+			attrs._mediaBox->getStringRepresentation(mediaBox);
+			attrs._cropBox->getStringRepresentation(cropBox);
+			attrs._rotate->getStringRepresentation(rotate);
+			pages.push_back(page);
+			attributes.push_back(resources+mediaBox+cropBox+rotate);
+		}
+
+		printf("TC01:\trebuildPageTree with too small fan-out should fail\n");
+		try
+		{
+			pdf->rebuildPageTree(1);
+			CPPUNIT_FAIL("rebuildPageTree should have failed");
+		}catch(ElementBadTypeException &)
+		{
+			/* ok */
+		}
+
+		printf("TC02:\trebuildPageTree keeps pages and their order\n");
+		try
+		{
+			pdf->rebuildPageTree(2);
+		}catch(AmbiguousPageTreeException &)
+		{
+			printf("Page tree is ambiguous and can't be rebuilt\n");
+			return;
+		}
+		CPPUNIT_ASSERT(pdf->getPageCount()==pageCount);
+		for(size_t i=1; i<=pageCount; ++i)
+		{
+			CPPUNIT_ASSERT(pages[i-1]->isValid());
+			CPPUNIT_ASSERT(pdf->getPage(i)==pages[i-1]);
+		}
+
+		printf("TC03:\trebuildPageTree keeps inherited attributes\n");
+		for(size_t i=1; i<=pageCount; ++i)
+		{
+			CPageAttributes::InheritedAttributes attrs;
+			CPageAttributes::fillInherited(pages[i-1]->getDictionary(), attrs);
+			string resources, mediaBox, cropBox, rotate;
+			attrs._resources->getStringRepresentation(resources);
+			attrs._mediaBox->getStringRepresentation(mediaBox);
+			attrs._cropBox->getStringRepresentation(cropBox);
+			attrs._rotate->getStringRepresentation(rotate);
+			CPPUNIT_ASSERT(attributes[i-1]==resources+mediaBox+cropBox+rotate);
+		}
+
+		printf("TC04:\trebuilt page tree is balanced\n");
+		size_t leafDepth=0;
+		CPPUNIT_ASSERT(checkBalancedPageTree(getPageTreeRoot(pdf), 2, 0, leafDepth)==pageCount);
+
+		printf("TC05:\tpage tree is still observed after rebuild\n");
+		if(pageCount>1)
+		{
+			shared_ptr<CPage> page=pdf->getPage(1);
+			pdf->removePage(1);
+			CPPUNIT_ASSERT(!page->isValid());
+			CPPUNIT_ASSERT(pdf->getPageCount()==pageCount-1);
+			CPPUNIT_ASSERT(pdf->getPagePosition(pages[1])==1);
+		}
+	}
+
+	void pageIndexTC(boost::shared_ptr<CPdf> pdf)
+	{
+	using namespace boost;
+	using namespace utils;
+
+		printf("%s\n", __FUNCTION__);
+
+		printf("TC01:\tinsert, remove and reorder keep the document order\n");
+		PageIndex index;
+		vector<IndiRef> model;
+		PageIndex::PageStorage removed;
+		unsigned int seed=1;
+		int nextNum=1;
+		for(int round=0; round<500; ++round)
+		{
+			seed=seed*1103515245+12345;
+			size_t pos=(seed>>8)%(model.size()+1);
+			size_t count=min((size_t)(1+round%3), model.size()-min(pos, model.size()));
+			if(model.size()<20 || round%4==0)
+			{
+				PageIndex::RefList refs;
+				for(int i=0; i<1+round%3; ++i)
+					refs.push_back(IndiRef(nextNum++, 0));
+				index.insert(pos, refs);
+				model.insert(model.begin()+pos, refs.begin(), refs.end());
+			}else if(round%4==1 && count)
+			{
+				index.remove(pos, count, removed);
+				model.erase(model.begin()+pos, model.begin()+pos+count);
+			}else if(count)
+			{
+				// moves pages to another position
+				PageIndex::RefList moved(model.begin()+pos, model.begin()+pos+count);
+				index.remove(pos, count, removed);
+				model.erase(model.begin()+pos, model.begin()+pos+count);
+				size_t to=(seed>>16)%(model.size()+1);
+				index.insert(to, moved);
+				model.insert(model.begin()+to, moved.begin(), moved.end());
+			}
+			CPPUNIT_ASSERT(index.size()==model.size());
+
+			// lookups between changes use both the positional array and 
+			// the treap
+			for(int i=0; i<round%5 && !model.empty(); ++i)
+			{
+				seed=seed*1103515245+12345;
+				size_t lookup=(seed>>8)%model.size();
+				CPPUNIT_ASSERT(index.getRef(lookup)==model[lookup]);
+				size_t found;
+				CPPUNIT_ASSERT(index.findRef(model[lookup], found) && found==lookup);
+			}
+		}
+		for(size_t i=0; i<model.size(); ++i)
+		{
+			CPPUNIT_ASSERT(index.getRef(i)==model[i]);
+			size_t pos;
+			CPPUNIT_ASSERT(index.findRef(model[i], pos) && pos==i);
+		}
+		PageIndex::RefList allRefs;
+		index.getRefs(allRefs);
+		CPPUNIT_ASSERT(allRefs==model);
+		CPPUNIT_ASSERT(removed.empty());
+		index.remove(0, index.size(), removed);
+		CPPUNIT_ASSERT(index.size()==0);
+
+		printf("TC02:\tambiguous reference becomes unique again\n");
+		IndiRef a(1, 0), b(2, 0), c(3, 0);
+		PageIndex::RefList ambiguous;
+		ambiguous.push_back(a);
+		ambiguous.push_back(b);
+		ambiguous.push_back(a);
+		ambiguous.push_back(c);
+		index.insert(0, ambiguous);
+		size_t pos;
+		CPPUNIT_ASSERT(index.getRefCount(a)==2);
+		CPPUNIT_ASSERT(!index.findRef(a, pos));
+		CPPUNIT_ASSERT(index.findRef(c, pos) && pos==3);
+		index.remove(0, 1, removed);
+		CPPUNIT_ASSERT(index.getRefCount(a)==1);
+		CPPUNIT_ASSERT(index.findRef(a, pos) && pos==1);
+		index.remove(1, 1, removed);
+		CPPUNIT_ASSERT(index.getRefCount(a)==0);
+		CPPUNIT_ASSERT(!index.findRef(a, pos));
+		CPPUNIT_ASSERT(index.findRef(c, pos) && pos==1);
+
+		if(pdf->isLinearized() || pdf->getPageCount()<2)
+		{
+			printf("Following usecases are not suitable becuase document is linearized or has less than 2 pages\n");
+			return;
+		}
+
+		printf("TC03:\tassign keeps existing page instances\n");
+		shared_ptr<CPage> page1=pdf->getPage(1), page2=pdf->getPage(2);
+		IndiRef ref1=page1->getDictionary()->getIndiRef();
+		IndiRef ref2=page2->getDictionary()->getIndiRef();
+		if(!(ref1==ref2))
+		{
+			IndiRef other(pdf->getCXref()->getNumObjects()+1, 0);
+			PageIndex pages;
+			PageIndex::RefList refs;
+			refs.push_back(ref1);
+			refs.push_back(ref2);
+			refs.push_back(other);
+			pages.insert(0, refs);
+			pages.setPage(0, page1);
+			pages.setPage(1, page2);
+			CPPUNIT_ASSERT(pages.findPage(ref1, page1, pos) && pos==0);
+			// reordered pages are taken over
+			refs.clear();
+			refs.push_back(other);
+			refs.push_back(ref2);
+			refs.push_back(ref1);
+			PageIndex::PageStorage dropped;
+			pages.assign(refs, dropped);
+			CPPUNIT_ASSERT(pages.isValid());
+			CPPUNIT_ASSERT(dropped.empty());
+			CPPUNIT_ASSERT(!pages.getPage(0));
+			CPPUNIT_ASSERT(pages.getPage(1)==page2);
+			CPPUNIT_ASSERT(pages.getPage(2)==page1);
+			// ambiguous pages are not taken over
+			refs.clear();
+			refs.push_back(ref1);
+			refs.push_back(ref2);
+			refs.push_back(ref1);
+			pages.assign(refs, dropped);
+			CPPUNIT_ASSERT(dropped.size()==1 && dropped[0]==page1);
+			CPPUNIT_ASSERT(pages.getPage(1)==page2);
+			CPPUNIT_ASSERT(!pages.getPage(0) && !pages.getPage(2));
+			pages.setPage(2, page1);
+			CPPUNIT_ASSERT(pages.findPage(ref1, page1, pos) && pos==2);
+		}
+
+		printf("TC04:\tpage positions follow replaced Kids array\n");
+		shared_ptr<CDict> pageDict=page1->getDictionary();
+		IndiRef parentRef=getValueFromSimple<CRef>(pageDict->getProperty("Parent"));
+		shared_ptr<CDict> parentDict=IProperty::getSmartCObjectPtr<CDict>(
+				pdf->getIndirectProperty(parentRef));
+		shared_ptr<CArray> kids=IProperty::getSmartCObjectPtr<CArray>(
+				parentDict->getProperty("Kids"));
+		vector<IndiRef> kidRefs;
+		bool leafKids=true;
+		for(size_t i=0; i<kids->getPropertyCount() && leafKids; ++i)
+		{
+			shared_ptr<IProperty> kid=kids->getProperty(i);
+			leafKids=isRef(kid) && getNodeType(kid)==LeafNode;
+			if(leafKids)
+				kidRefs.push_back(getValueFromSimple<CRef>(kid));
+		}
+		if(!leafKids || kidRefs.size()<2)
+		{
+			printf("Parent of the first page has other than page kids\n");
+			return;
+		}
+		size_t pageCount=pdf->getPageCount();
+		size_t base=pdf->getPagePosition(page1);
+		scoped_ptr<CArray> reversed(CArrayFactory::getInstance());
+		for(size_t i=kidRefs.size(); i>0; --i)
+		{
+			scoped_ptr<CRef> kidRef(CRefFactory::getInstance(kidRefs[i-1]));
+			reversed->addProperty(*kidRef);
+		}
+		parentDict->setProperty("Kids", *reversed);
+		CPPUNIT_ASSERT(pdf->getPageCount()==pageCount);
+		for(size_t i=0; i<kidRefs.size(); ++i)
+		{
+			shared_ptr<CPage> page=pdf->getPage(base+i);
+			CPPUNIT_ASSERT(page->getDictionary()->getIndiRef()==kidRefs[kidRefs.size()-1-i]);
+			CPPUNIT_ASSERT(pdf->getPagePosition(page)==base+i);
+		}
+	}
+
+	void notificationBatchTC(boost::shared_ptr<CPdf> pdf)
+	{
+	using namespace boost;
+	using namespace utils;
+
+		printf("%s\n", __FUNCTION__);
+		if(pdf->isLinearized() || !pdf->getPageCount())
+		{
+			printf("Usecase is not suitable becuase document is linearized or empty\n");
+			return;
+		}
+		shared_ptr<CDict> pageDict=pdf->getPage(1)->getDictionary();
+		shared_ptr<NotificationCounter> counter(new NotificationCounter());
+		IProperty::Observer observer(counter);
+		pageDict->registerObserver(observer);
+
+		printf("TC01:\tobservers are notified when the outermost batch ends\n");
+		CInt value(1);
+		pdf->beginNotificationBatch();
+		CPPUNIT_ASSERT(pdf->isNotificationBatch());
+		pageDict->addProperty("BatchTest", value);
+		pdf->beginNotificationBatch();
+		pageDict->setProperty("BatchTest", value);
+		pdf->endNotificationBatch();
+		CPPUNIT_ASSERT(counter->count==0);
+		pdf->endNotificationBatch();
+		CPPUNIT_ASSERT(!pdf->isNotificationBatch());
+
+		printf("TC02:\tchanges of the same entry are coalesced\n");
+		CPPUNIT_ASSERT(counter->count==1);
+
+		printf("TC03:\tadded and removed entry produces no notification\n");
+		counter->count=0;
+		pdf->beginNotificationBatch();
+		pageDict->addProperty("BatchTemp", value);
+		pageDict->delProperty("BatchTemp");
+		pageDict->delProperty("BatchTest");
+		pdf->endNotificationBatch();
+		CPPUNIT_ASSERT(counter->count==1);
+		pageDict->unregisterObserver(observer);
+
+		printf("TC04:\tpage tree is consistent when the batch ends\n");
+		size_t pageCount=pdf->getPageCount();
+		shared_ptr<CPage> page=pdf->getPage(1);
+		pdf->beginNotificationBatch();
+		pdf->removePage(1);
+		CPPUNIT_ASSERT(!page->isValid());
+		shared_ptr<CPage> inserted=pdf->insertPage(page, pageCount);
+		CPPUNIT_ASSERT(pdf->getPageCount()==pageCount);
+		CPPUNIT_ASSERT(pdf->getPagePosition(inserted)==pageCount);
+		pdf->endNotificationBatch();
+		CPPUNIT_ASSERT(pdf->getPagePosition(inserted)==pageCount);
+		shared_ptr<CDict> rootDict=getPageTreeRoot(pdf);
+		CPPUNIT_ASSERT((size_t)getIntFromIProperty(rootDict->getProperty("Count"))==pageCount);
+	}
+
 	void linearizedTC(boost::shared_ptr<CPdf> pdf)
 	{
 		printf("%s\n", __FUNCTION__);
@@ -879,6 +1249,54 @@ public:
 		prop = pdf->getIndirectProperty(ref);
 		CPPUNIT_ASSERT(prop->getType()==pInt);
 		CPPUNIT_ASSERT(utils::getValueFromSimple<CInt>(prop)==1);
+
+		printf("TC11:\tunchanged objects are shared between revisions\n");
+		std::vector<shared_ptr<IProperty> > pageDicts;
+		for(size_t i=1; i<=pdf->getPageCount(); ++i)
+			pageDicts.push_back(pdf->getPage(i)->getDictionary());
+		pdf->changeRevision(0);
+		XRefWriter* xref = dynamic_cast<XRefWriter *>(pdf->getCXref());
+		XRefWriter::ObjectNumSet changed;
+		CPPUNIT_ASSERT(xref->getChangedObjects(pdf->getRevisionsCount()-1, changed));
+		for(size_t i=0; i<pageDicts.size(); ++i)
+		{
+			IndiRef pageRef=pageDicts[i]->getIndiRef();
+			bool shared=pdf->getIndirectProperty(pageRef)==pageDicts[i];
+			CPPUNIT_ASSERT(shared==!changed.count(pageRef.num));
+		}
+
+		printf("TC12:\trevision diff test\n");
+		size_t last=pdf->getRevisionsCount()-1;
+		XRefWriter::RevisionDiff diff;
+		CPPUNIT_ASSERT(xref->getRevisionDiff(last, last, diff));
+		CPPUNIT_ASSERT(diff.added.empty() && diff.removed.empty() && diff.changed.empty());
+		utils::RevisionComparer comparer(*xref, 0, last);
+		const XRefWriter::RevisionDiff & revDiff=comparer.getDiff();
+		XRefWriter::ObjectNumSet diffNums(revDiff.added.begin(), revDiff.added.end());
+		diffNums.insert(revDiff.removed.begin(), revDiff.removed.end());
+		diffNums.insert(revDiff.changed.begin(), revDiff.changed.end());
+		CPPUNIT_ASSERT(diffNums==changed);
+		for(size_t i=0; i<revDiff.added.size(); ++i)
+		{
+			utils::ObjectDiffs objDiffs;
+			comparer.diffObject(revDiff.added[i], objDiffs);
+			CPPUNIT_ASSERT(objDiffs.size()==1 && objDiffs[0].kind==utils::ObjectDiff::typeChanged);
+		}
+		// objects are fetched from revisions without changing the current one
+		CPPUNIT_ASSERT(pdf->getActualRevision()==0);
+		utils::PageChanges pageChanges;
+		comparer.getPageChanges(pageChanges);
+		pdf->changeRevision(last);
+		size_t targetPages=0;
+		for(size_t i=0; i<pageChanges.size(); ++i)
+		{
+			if(pageChanges[i].kind==utils::PageChange::pageRemoved)
+				continue;
+			++targetPages;
+			CPPUNIT_ASSERT(pageChanges[i].toPos==targetPages);
+			CPPUNIT_ASSERT(pdf->getPage(targetPages)->getDictionary()->getIndiRef()==pageChanges[i].ref);
+		}
+		CPPUNIT_ASSERT(targetPages==pdf->getPageCount());
 	}
 #undef TRY_READONLY_OP
 	
@@ -1321,6 +1739,597 @@ public:
 	{
 	}
 
+	/** Returns string with page box attributes (they are not references, so
+	 * they are same for copied pages).
+	 */
+	string getPageBoxes(boost::shared_ptr<CPage> page)
+	{
+		CPageAttributes::InheritedAttributes attrs;
+		CPageAttributes::fillInherited(page->getDictionary(), attrs);
+		string mediaBox, cropBox, rotate;
+		attrs._mediaBox->getStringRepresentation(mediaBox);
+		attrs._cropBox->getStringRepresentation(cropBox);
+		attrs._rotate->getStringRepresentation(rotate);
+		return mediaBox+cropBox+rotate;
+	}
+
+	void importPagesTC(string fileName)
+	{
+	using namespace boost;
+
+		printf("%s\n", __FUNCTION__);
+		shared_ptr<CPdf> pdf=getTestCPdf(fileName.c_str());
+		shared_ptr<CPdf> source=getTestCPdf(fileName.c_str());
+		if(pdf->isLinearized() || utils::isEncrypted(pdf))
+		{
+			printf("Usecase is not suitable becuase document is linearized or encrypted\n");
+			return;
+		}
+		size_t pageCount=pdf->getPageCount();
+		size_t sourceCount=source->getPageCount();
+		if(!sourceCount)
+			return;
+		vector<shared_ptr<CPage> > pages;
+		for(size_t i=1; i<=pageCount; ++i)
+			pages.push_back(pdf->getPage(i));
+
+		printf("TC01:\timportPages with bad parameters should fail\n");
+		try
+		{
+			pdf->importPages(source, 0, 1, 1);
+			CPPUNIT_FAIL("importPages should have failed");
+		}catch(PageNotFoundException &)
+		{
+			/* ok */
+		}
+		try
+		{
+			pdf->importPages(source, 1, sourceCount+1, 1);
+			CPPUNIT_FAIL("importPages should have failed");
+		}catch(PageNotFoundException &)
+		{
+			/* ok */
+		}
+		try
+		{
+			pdf->importPages(pdf, 1, 1, 1);
+			CPPUNIT_FAIL("importPages should have failed");
+		}catch(AmbiguousPageTreeException &)
+		{
+			/* ok */
+		}
+		try
+		{
+			pdf->importPages(shared_ptr<CPdf>(), 1, 1, 1);
+			CPPUNIT_FAIL("importPages should have failed");
+		}catch(ElementBadTypeException &)
+		{
+			/* ok */
+		}
+		CPPUNIT_ASSERT(pdf->getPageCount()==pageCount);
+
+		printf("TC02:\timportPages inserts all pages in the range at given position\n");
+		size_t pos=pageCount/2+1;
+		try
+		{
+			pdf->importPages(source, 1, sourceCount, pos);
+		}catch(AmbiguousPageTreeException &)
+		{
+			printf("Page tree is ambiguous and pages can't be imported\n");
+			return;
+		}
+		CPPUNIT_ASSERT(pdf->getPageCount()==pageCount+sourceCount);
+		for(size_t i=1; i<=sourceCount; ++i)
+		{
+			shared_ptr<CPage> page=pdf->getPage(pos+i-1);
+			CPPUNIT_ASSERT(getPageBoxes(page)==getPageBoxes(source->getPage(i)));
+			CPPUNIT_ASSERT(pdf->getPagePosition(page)==pos+i-1);
+		}
+
+		printf("TC03:\tpages behind position are shifted\n");
+		for(size_t i=0; i<pageCount; ++i)
+		{
+			CPPUNIT_ASSERT(pages[i]->isValid());
+			size_t expected=(i+1<pos)?i+1:i+1+sourceCount;
+			CPPUNIT_ASSERT(pdf->getPagePosition(pages[i])==expected);
+		}
+
+		printf("TC04:\tpage imported again is separate page\n");
+		shared_ptr<CPage> first=pdf->getPage(pos);
+		pdf->importPages(source, 1, 1, 1);
+		CPPUNIT_ASSERT(pdf->getPageCount()==pageCount+sourceCount+1);
+		shared_ptr<CPage> second=pdf->getPage(1);
+		CPPUNIT_ASSERT(second!=first);
+		CPPUNIT_ASSERT(!(second->getDictionary()->getIndiRef()==first->getDictionary()->getIndiRef()));
+		CPPUNIT_ASSERT(getPageBoxes(second)==getPageBoxes(first));
+		CPPUNIT_ASSERT(pdf->getPagePosition(second)==1);
+		CPPUNIT_ASSERT(pdf->getPagePosition(first)==pos+1);
+
+		printf("TC05:\timported pages can be removed\n");
+		pdf->removePage(1);
+		CPPUNIT_ASSERT(!second->isValid());
+		CPPUNIT_ASSERT(first->isValid());
+		CPPUNIT_ASSERT(pdf->getPagePosition(first)==pos);
+		pdf->removePage(pos);
+		CPPUNIT_ASSERT(!first->isValid());
+		CPPUNIT_ASSERT(pdf->getPageCount()==pageCount+sourceCount-1);
+	}
+
+	void flattenerDedupTC(string fileName)
+	{
+	using namespace boost;
+	using namespace pdfobjects::utils;
+
+		printf("%s\n", __FUNCTION__);
+		shared_ptr<CPdf> original=getTestCPdf(fileName.c_str(), CPdf::ReadOnly);
+		if(original->isLinearized() || utils::isEncrypted(original))
+		{
+			printf("Usecase is not suitable becuase document is linearized or encrypted\n");
+			return;
+		}
+		size_t pageCount=original->getPageCount();
+		if(!pageCount)
+			return;
+
+		// document with all pages twice - imported pages have their own
+		// copies of all objects
+		string mergedFile=fileName+"-merged.pdf";
+		FILE * file=fopen(mergedFile.c_str(), "wb");
+		original->clone(file);
+		fclose(file);
+		{
+			shared_ptr<CPdf> merged=getTestCPdf(mergedFile.c_str());
+			merged->importPages(getTestCPdf(fileName.c_str(), CPdf::ReadOnly), 1, pageCount, pageCount+1);
+			merged->save();
+		}
+
+		printf("TC01:\tflattening with deduplication merges copied objects\n");
+		string plainFile=fileName+"-flattened.pdf";
+		string dedupFile=fileName+"-dedup.pdf";
+		{
+			shared_ptr<Flattener> flattener=Flattener::getInstance(mergedFile.c_str(), new OldStylePdfWriter());
+			CPPUNIT_ASSERT(flattener->flatten(plainFile.c_str())==0);
+			CPPUNIT_ASSERT(flattener->getDuplicateCount()==0);
+		}
+		size_t duplicates;
+		{
+			shared_ptr<Flattener> flattener=Flattener::getInstance(mergedFile.c_str(), new OldStylePdfWriter());
+			flattener->setDeduplicate(true);
+			CPPUNIT_ASSERT(flattener->flatten(dedupFile.c_str())==0);
+			duplicates=flattener->getDuplicateCount();
+		}
+
+		printf("TC02:\tdeduplicated document has the same pages\n");
+		{
+			shared_ptr<CPdf> plain=getTestCPdf(plainFile.c_str(), CPdf::ReadOnly);
+			shared_ptr<CPdf> dedup=getTestCPdf(dedupFile.c_str(), CPdf::ReadOnly);
+			CPPUNIT_ASSERT(plain->getPageCount()==2*pageCount);
+			CPPUNIT_ASSERT(dedup->getPageCount()==2*pageCount);
+			CPPUNIT_ASSERT((size_t)dedup->getCXref()->getNumObjects()+duplicates
+					==(size_t)plain->getCXref()->getNumObjects());
+			for(size_t i=1; i<=2*pageCount; ++i)
+			{
+				shared_ptr<CPage> page=dedup->getPage(i);
+				CPPUNIT_ASSERT(getPageBoxes(page)==getPageBoxes(plain->getPage(i)));
+				CPPUNIT_ASSERT(getPageBoxes(page)==getPageBoxes(original->getPage((i-1)%pageCount+1)));
+			}
+		}
+		#if TEMP_FILES_CREATE
+		#else
+			remove(mergedFile.c_str());
+			remove(plainFile.c_str());
+			remove(dedupFile.c_str());
+		#endif
+	}
+
+	void linearizatorTC(string fileName)
+	{
+	using namespace boost;
+
+		printf("%s\n", __FUNCTION__);
+		shared_ptr<CPdf> original=getTestCPdf(fileName.c_str(), CPdf::ReadOnly);
+		if(original->isLinearized() || !original->getPageCount())
+		{
+			printf("Usecase is not suitable becuase document is linearized or has no pages\n");
+			return;
+		}
+
+		printf("TC01:\tsaveLinearized produces linearized document\n");
+		string linFile=fileName+"-linearized.pdf";
+		FILE * file=fopen(linFile.c_str(), "wb");
+		CPPUNIT_ASSERT(file);
+		CPPUNIT_ASSERT(original->saveLinearized(file)==0);
+		fclose(file);
+		{
+			shared_ptr<CPdf> linearized=getTestCPdf(linFile.c_str(), CPdf::ReadOnly);
+			CPPUNIT_ASSERT(linearized->isLinearized());
+
+			printf("TC02:\tlinearized document has the same pages\n");
+			CPPUNIT_ASSERT(linearized->getPageCount()==original->getPageCount());
+			for(size_t i=1; i<=original->getPageCount(); ++i)
+				CPPUNIT_ASSERT(getPageBoxes(linearized->getPage(i))==getPageBoxes(original->getPage(i)));
+
+			printf("TC03:\tlinearized document can't be linearized again\n");
+			FILE * again=tmpfile();
+			CPPUNIT_ASSERT(again);
+			try
+			{
+				linearized->saveLinearized(again);
+				CPPUNIT_FAIL("saveLinearized should have failed");
+			}catch(NotImplementedException &)
+			{
+				/* ok */
+			}
+			fclose(again);
+		}
+		#if TEMP_FILES_CREATE
+		#else
+			remove(linFile.c_str());
+		#endif
+	}
+
+	void incrementalSaveTC(string fileName)
+	{
+	using namespace boost;
+
+		printf("%s\n", __FUNCTION__);
+		string incFile=fileName+"-incremental.pdf";
+		{
+			shared_ptr<CPdf> original=getTestCPdf(fileName.c_str(), CPdf::ReadOnly);
+			if(original->isLinearized())
+			{
+				printf("Usecase is not suitable becuase document is linearized\n");
+				return;
+			}
+			FILE * file=fopen(incFile.c_str(), "wb");
+			CPPUNIT_ASSERT(file);
+			original->clone(file);
+			fclose(file);
+		}
+
+		printf("TC01:\tsaved revisions are usable without reopening\n");
+		std::vector<IndiRef> refs;
+		size_t revisions;
+		{
+			shared_ptr<CPdf> pdf=getTestCPdf(incFile.c_str());
+			revisions=pdf->getRevisionsCount();
+			for(int i=0; i<3; ++i)
+			{
+				shared_ptr<IProperty> prop(CIntFactory::getInstance(i));
+				refs.push_back(pdf->addIndirectProperty(prop));
+				pdf->save(true);
+				CPPUNIT_ASSERT(pdf->getRevisionsCount()==revisions+i+1);
+				for(int j=0; j<=i; ++j)
+					CPPUNIT_ASSERT(utils::getValueFromSimple<CInt>(pdf->getIndirectProperty(refs[j]))==j);
+			}
+
+			printf("TC02:\tsaved objects are added by saved revisions\n");
+			XRefWriter * xref=dynamic_cast<XRefWriter *>(pdf->getCXref());
+			XRefWriter::RevisionDiff diff;
+			// damaged documents don't provide revision diffs
+			if(xref->getRevisionDiff(revisions-1, pdf->getRevisionsCount()-1, diff))
+				for(size_t j=0; j<refs.size(); ++j)
+					CPPUNIT_ASSERT(std::binary_search(diff.added.begin(), diff.added.end(), refs[j].num));
+			pdf->changeRevision(revisions-1);
+			pdf->changeRevision(pdf->getRevisionsCount()-1);
+			CPPUNIT_ASSERT(utils::getValueFromSimple<CInt>(pdf->getIndirectProperty(refs[0]))==0);
+		}
+
+		printf("TC03:\tsaved document contains all revisions\n");
+		{
+			shared_ptr<CPdf> pdf=getTestCPdf(incFile.c_str(), CPdf::ReadOnly);
+			CPPUNIT_ASSERT(pdf->getRevisionsCount()==revisions+refs.size());
+			for(size_t j=0; j<refs.size(); ++j)
+				CPPUNIT_ASSERT(utils::getValueFromSimple<CInt>(pdf->getIndirectProperty(refs[j]))==(int)j);
+		}
+		#if TEMP_FILES_CREATE
+		#else
+			remove(incFile.c_str());
+		#endif
+	}
+
+	void bulkFetchTC(boost::shared_ptr<CPdf> pdf)
+	{
+	using namespace boost;
+
+		printf("%s\n", __FUNCTION__);
+		CXref * xref=pdf->getCXref();
+
+		printf("TC01:\tbulk fetched objects are same as fetched one by one\n");
+		// unknown references are fetched as objNull and all references
+		// are used more times so that more batches are parsed
+		CXref::RefList refs;
+		for(int i=0; i<xref->getSize()+2; ++i)
+		{
+			::Ref ref={i, 0};
+			if(i<xref->getSize())
+			{
+				XRefEntry * entry=xref->getEntry(i);
+				if(entry->type==xrefEntryFree)
+					continue;
+				if(entry->type==xrefEntryUncompressed)
+					ref.gen=entry->gen;
+			}
+			refs.push_back(ref);
+		}
+		refs.insert(refs.end(), refs.begin(), refs.end());
+		CXref::ObjectList objs;
+		xref->fetchObjects(refs, objs);
+		CPPUNIT_ASSERT(objs.size()==refs.size());
+		for(size_t i=0; i<refs.size(); ++i)
+		{
+			::Object obj;
+			xref->fetch(refs[i].num, refs[i].gen, &obj);
+			string str, bulkStr;
+			xpdfObjToString(obj, str);
+			xpdfObjToString(*objs[i], bulkStr);
+			CPPUNIT_ASSERT(str==bulkStr);
+			obj.free();
+			xpdf::freeXpdfObject(objs[i]);
+		}
+
+		if(pdf->getMode()==CPdf::ReadOnly)
+		{
+			printf("Document is in read-only mode - skipping the rest\n");
+			return;
+		}
+		printf("TC02:\tbulk fetched objects contain changes\n");
+		shared_ptr<IProperty> prop(CIntFactory::getInstance(1));
+		IndiRef ref=pdf->addIndirectProperty(prop);
+		::Ref xpdfRef={(int)ref.num, (int)ref.gen};
+		CXref::RefList changedRefs(refs.begin(), refs.begin()+std::min(refs.size(), (size_t)10));
+		changedRefs.push_back(xpdfRef);
+		xref->fetchObjects(changedRefs, objs);
+		CPPUNIT_ASSERT(objs.back()->isInt() && objs.back()->getInt()==1);
+		for(size_t i=0; i<objs.size(); ++i)
+			xpdf::freeXpdfObject(objs[i]);
+	}
+
+	void bulkFetchFiltersTC()
+	{
+	using namespace boost;
+
+		printf("%s\n", __FUNCTION__);
+
+		// document with enough streams to be parsed in more batches where
+		// all streams have indirect DecodeParms or JBIG2Globals
+		const int firstStream=5;
+		const int streams=192;
+		std::vector<string> objects;
+		objects.push_back("<< /Type /Catalog /Pages 2 0 R >>");
+		objects.push_back("<< /Type /Pages /Kids [] /Count 0 >>");
+		objects.push_back("<< /Predictor 1 >>");
+		objects.push_back("<< /Length 4 >>\nstream\nGLOB\nendstream");
+		for(int i=0; i<streams; ++i)
+		{
+			switch(i%3)
+			{
+				case 0:
+					objects.push_back("<< /Length 7 /Filter /AHx /DecodeParms 3 0 R >>\n"
+							"stream\n414243>\nendstream");
+					break;
+				case 1:
+					objects.push_back("<< /Length 7 /Filter [/AHx] /DecodeParms [3 0 R] >>\n"
+							"stream\n444546>\nendstream");
+					break;
+				default:
+					objects.push_back("<< /Length 4 /Filter /JBIG2Decode "
+							"/DecodeParms << /JBIG2Globals 4 0 R >> >>\n"
+							"stream\nJBIG\nendstream");
+			}
+		}
+		std::ostringstream data;
+		std::vector<size_t> offsets;
+		data << "%PDF-1.4\n";
+		for(size_t i=0; i<objects.size(); ++i)
+		{
+			offsets.push_back(data.str().size());
+			data << i+1 << " 0 obj\n" << objects[i] << "\nendobj\n";
+		}
+		size_t xrefPos=data.str().size();
+		data << "xref\n0 " << objects.size()+1 << "\n0000000000 65535 f \n";
+		for(size_t i=0; i<offsets.size(); ++i)
+		{
+			char entry[32];
+			sprintf(entry, "%010lu 00000 n \n", (unsigned long)offsets[i]);
+			data << entry;
+		}
+		data << "trailer\n<< /Size " << objects.size()+1 << " /Root 1 0 R >>\n"
+			<< "startxref\n" << xrefPos << "\n%%EOF\n";
+		string fileName="bulkfetch-filters.pdf";
+		FILE * file=fopen(fileName.c_str(), "wb");
+		CPPUNIT_ASSERT(file);
+		fwrite(data.str().c_str(), 1, data.str().size(), file);
+		fclose(file);
+
+		{
+			shared_ptr<CPdf> pdf=getTestCPdf(fileName.c_str(), CPdf::ReadOnly);
+			CXref * xref=pdf->getCXref();
+			CXref::RefList refs;
+			for(int i=firstStream; i<firstStream+streams; ++i)
+			{
+				::Ref ref={i, 0};
+				refs.push_back(ref);
+			}
+
+			printf("TC01:\tindirect filter parameters are not fetched through shared xref\n");
+			// each CXref::fetch is counted by xrefFetchTime
+			bool metricsEnabled=metrics::isEnabled();
+			metrics::setEnabled(true);
+			unsigned long fetches=metrics::xrefFetchTime.getCount();
+			CXref::ObjectList objs;
+			xref->fetchObjects(refs, objs);
+			CPPUNIT_ASSERT(metrics::xrefFetchTime.getCount()==fetches);
+			metrics::setEnabled(metricsEnabled);
+
+			printf("TC02:\tbulk fetched streams are decoded same as fetched one by one\n");
+			// JBIG2 streams read their globals here, after private views of
+			// the batch are gone
+			CPPUNIT_ASSERT(objs.size()==refs.size());
+			for(size_t i=0; i<refs.size(); ++i)
+			{
+				::Object obj;
+				xref->fetch(refs[i].num, refs[i].gen, &obj);
+				CPPUNIT_ASSERT(obj.isStream() && objs[i]->isStream());
+				string str, bulkStr;
+				getStringFromXpdfStream(str, obj);
+				getStringFromXpdfStream(bulkStr, *objs[i]);
+				CPPUNIT_ASSERT(str==bulkStr);
+				if(i%3==0)
+					CPPUNIT_ASSERT(bulkStr=="ABC");
+				else if(i%3==1)
+					CPPUNIT_ASSERT(bulkStr=="DEF");
+				obj.free();
+				xpdf::freeXpdfObject(objs[i]);
+			}
+		}
+		#if TEMP_FILES_CREATE
+		#else
+			remove(fileName.c_str());
+		#endif
+	}
+
+	void pagePrefetchTC(string fileName)
+	{
+		printf("%s\n", __FUNCTION__);
+		boost::shared_ptr<CPdf> pdf=getTestCPdf(fileName.c_str(), CPdf::ReadOnly);
+		boost::shared_ptr<CPdf> prefetchPdf=getTestCPdf(fileName.c_str(), CPdf::ReadOnly);
+		prefetchPdf->setPagePrefetch(2);
+		CPPUNIT_ASSERT(prefetchPdf->getPagePrefetch()==2);
+		CPPUNIT_ASSERT(prefetchPdf->getCXref()->isPrefetchEnabled());
+
+		printf("TC01:\tpages are same with prefetching\n");
+		CPPUNIT_ASSERT(pdf->getPageCount()==prefetchPdf->getPageCount());
+		for(size_t pos=1; pos<=pdf->getPageCount(); ++pos)
+		{
+			string text, prefetchText;
+			pdf->getPage(pos)->getText(text);
+			prefetchPdf->getPage(pos)->getText(prefetchText);
+			CPPUNIT_ASSERT(text==prefetchText);
+		}
+
+		printf("TC02:\tobjects are same with prefetching\n");
+		CXref * xref=pdf->getCXref();
+		CXref * prefetchXref=prefetchPdf->getCXref();
+		CPPUNIT_ASSERT(xref->getSize()==prefetchXref->getSize());
+		for(int i=1; i<xref->getSize(); ++i)
+		{
+			XRefEntry * entry=xref->getEntry(i);
+			if(entry->type==xrefEntryFree)
+				continue;
+			int gen=(entry->type==xrefEntryUncompressed)?entry->gen:0;
+			::Object obj, prefetchObj;
+			xref->fetch(i, gen, &obj);
+			prefetchXref->fetch(i, gen, &prefetchObj);
+			string str, prefetchStr;
+			xpdfObjToString(obj, str);
+			xpdfObjToString(prefetchObj, prefetchStr);
+			CPPUNIT_ASSERT(str==prefetchStr);
+			obj.free();
+			prefetchObj.free();
+		}
+
+		printf("TC03:\tprefetching can be disabled\n");
+		prefetchPdf->setPagePrefetch(0);
+		CPPUNIT_ASSERT(prefetchPdf->getPagePrefetch()==0);
+		CPPUNIT_ASSERT(!prefetchXref->isPrefetchEnabled());
+		if(prefetchPdf->getPageCount())
+			prefetchPdf->getPage(1);
+	}
+
+	/** Collects page dictionary references of the document.
+	 */
+	static std::vector<IndiRef> getPageRefs(boost::shared_ptr<CPdf> pdf)
+	{
+		std::vector<IndiRef> refs;
+		for(size_t i=1; i<=pdf->getPageCount(); ++i)
+			refs.push_back(pdf->getPage(i)->getDictionary()->getIndiRef());
+		return refs;
+	}
+
+	void xrefCacheTC(string fileName)
+	{
+	using namespace boost;
+
+		printf("%s\n", __FUNCTION__);
+		string copyFile=fileName+"-xrefcache.pdf";
+		string sidecarFile=copyFile+xrefcache::SUFFIX;
+		{
+			std::ifstream in(fileName.c_str(), std::ios::binary);
+			std::ofstream out(copyFile.c_str(), std::ios::binary);
+			out << in.rdbuf();
+		}
+		remove(sidecarFile.c_str());
+		shared_ptr<CPdf> original=getTestCPdf(copyFile.c_str(), CPdf::ReadOnly);
+		std::vector<IndiRef> pageRefs=getPageRefs(original);
+
+		xrefcache::setEnabled(true);
+		printf("TC01:	sidecar is created when document is opened\n");
+		{
+			shared_ptr<CPdf> pdf=getTestCPdf(copyFile.c_str(), CPdf::ReadOnly);
+			CPPUNIT_ASSERT(!pdf->getCXref()->isRestored());
+			FILE * sidecar=fopen(sidecarFile.c_str(), "rb");
+			CPPUNIT_ASSERT(sidecar);
+			fclose(sidecar);
+		}
+
+		printf("TC02:	document opened with sidecar is the same\n");
+		{
+			shared_ptr<CPdf> pdf=getTestCPdf(copyFile.c_str(), CPdf::ReadOnly);
+			CXref * xref=pdf->getCXref();
+			CXref * originalXref=original->getCXref();
+			CPPUNIT_ASSERT(xref->isRestored());
+			CPPUNIT_ASSERT(xref->getSize()==originalXref->getSize());
+			for(int i=0; i<xref->getSize(); ++i)
+			{
+				XRefEntry * entry=xref->getEntry(i);
+				XRefEntry * originalEntry=originalXref->getEntry(i);
+				CPPUNIT_ASSERT(entry->offset==originalEntry->offset);
+				CPPUNIT_ASSERT(entry->gen==originalEntry->gen);
+				CPPUNIT_ASSERT(entry->type==originalEntry->type);
+			}
+			CPPUNIT_ASSERT(xref->getLastXRefPos()==originalXref->getLastXRefPos());
+			CPPUNIT_ASSERT(xref->getRootNum()==originalXref->getRootNum());
+			CPPUNIT_ASSERT(xref->getRootGen()==originalXref->getRootGen());
+			CPPUNIT_ASSERT(pdf->getRevisionsCount()==original->getRevisionsCount());
+			CPPUNIT_ASSERT(getPageRefs(pdf)==pageRefs);
+		}
+
+		printf("TC03:	sidecar is not used when document changes\n");
+		{
+			FILE * file=fopen(copyFile.c_str(), "ab");
+			fputs("\n%changed\n", file);
+			fclose(file);
+			shared_ptr<CPdf> pdf=getTestCPdf(copyFile.c_str(), CPdf::ReadOnly);
+			CPPUNIT_ASSERT(!pdf->getCXref()->isRestored());
+			CPPUNIT_ASSERT(getPageRefs(pdf)==pageRefs);
+		}
+		{
+			shared_ptr<CPdf> pdf=getTestCPdf(copyFile.c_str(), CPdf::ReadOnly);
+			CPPUNIT_ASSERT(pdf->getCXref()->isRestored());
+			CPPUNIT_ASSERT(getPageRefs(pdf)==pageRefs);
+		}
+
+		printf("TC04:	damaged sidecar is ignored\n");
+		{
+			FILE * sidecar=fopen(sidecarFile.c_str(), "r+b");
+			fseek(sidecar, 20, SEEK_SET);
+			int c=fgetc(sidecar);
+			fseek(sidecar, 20, SEEK_SET);
+			fputc(c^0xff, sidecar);
+			fclose(sidecar);
+			shared_ptr<CPdf> pdf=getTestCPdf(copyFile.c_str(), CPdf::ReadOnly);
+			CPPUNIT_ASSERT(!pdf->getCXref()->isRestored());
+			CPPUNIT_ASSERT(getPageRefs(pdf)==pageRefs);
+		}
+		xrefcache::setEnabled(false);
+		#if TEMP_FILES_CREATE
+		#else
+			remove(copyFile.c_str());
+			remove(sidecarFile.c_str());
+		#endif
+	}
+
 	void tearDown()
 	{
 	}
@@ -1349,12 +2358,23 @@ public:
 			cloneTC(pdf, fileName);
 			indirectPropertyTC(pdf);
 			pageManipulationTC(pdf);
+			pageTreeRebuildTC(pdf);
+			pageIndexTC(pdf);
+			notificationBatchTC(pdf);
+			bulkFetchTC(pdf);
+			pagePrefetchTC(fileName);
+			importPagesTC(fileName);
+			flattenerDedupTC(fileName);
+			linearizatorTC(fileName);
+			incrementalSaveTC(fileName);
+			xrefCacheTC(fileName);
 			linearizedTC(pdf);
 
 			delinearizatorTC(fileName);
 			changeTrailerTC(fileName);
 		}
 		revisionsTC();
+		bulkFetchFiltersTC();
 		printf("TEST_CPDF testig finished\n");
 
 	}
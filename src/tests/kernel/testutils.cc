@@ -26,8 +26,11 @@
 #include "kernel/static.h"
 #include "tests/kernel/testmain.h"
 #include "utils/confparser.h"
+#include "utils/debugtrace.h"
 #include "kernel/modecontroller.h"
 #include "kernel/operatorhinter.h"
+#include "kernel/metrics.h"
+#include "kernel/indirefmap.h"
 
 template<typename T=pdfobjects::IProperty>
 class Observer:public observer::IObserver<T>
@@ -334,12 +337,231 @@ public:
 		return true;
 	}
 
+	bool debugTraceTC()
+	{
+	using namespace std;
+	using namespace debug;
+
+		OUTPUT << __FUNCTION__<<endl;
+		DebugTarget target(DBG_PANIC, cerr);
+		vector<TraceEntry> entries;
+		clearTrace();
+
+		OUTPUT << "TC01:\tNothing is traced by default\n";
+		printDbg("TEST", DBG_WARN, target, "not traced");
+		CPPUNIT_ASSERT(collectTrace(entries)==0);
+
+		OUTPUT << "TC02:\tMessages up to trace level are traced\n";
+		changeTraceLevel(target, DBG_WARN);
+		unsigned int line=__LINE__+1;
+		printDbg("TEST", DBG_WARN, target, "traced "<<1);
+		printDbg("TEST", DBG_INFO, target, "not traced");
+		CPPUNIT_ASSERT(collectTrace(entries)==1);
+		CPPUNIT_ASSERT(entries[0].prefix=="TEST");
+		CPPUNIT_ASSERT(entries[0].level==DBG_WARN);
+		CPPUNIT_ASSERT(entries[0].line==line);
+		CPPUNIT_ASSERT(entries[0].message=="traced 1");
+
+		OUTPUT << "TC03:\tLong messages are truncated\n";
+		entries.clear();
+		clearTrace();
+		printDbg("TEST", DBG_ERR, target, string(2*TRACE_MESSAGE_SIZE, 'x'));
+		CPPUNIT_ASSERT(collectTrace(entries)==1);
+		CPPUNIT_ASSERT(entries[0].message==string(TRACE_MESSAGE_SIZE, 'x'));
+
+		OUTPUT << "TC04:\tRing buffer keeps the newest records\n";
+		entries.clear();
+		for(size_t i=0; i<TRACE_RING_SIZE+10; ++i)
+			printDbg("TEST", DBG_ERR, target, i);
+		CPPUNIT_ASSERT(collectTrace(entries)==TRACE_RING_SIZE);
+		ostringstream last;
+		last << TRACE_RING_SIZE+9;
+		CPPUNIT_ASSERT(entries.back().message==last.str());
+
+		OUTPUT << "TC05:\tDumped trace can be read back\n";
+		stringstream dump;
+		CPPUNIT_ASSERT(dumpTrace(dump)==TRACE_RING_SIZE);
+		vector<TraceEntry> readEntries;
+		CPPUNIT_ASSERT(readTrace(dump, readEntries));
+		CPPUNIT_ASSERT(readEntries.size()==entries.size());
+		for(size_t i=0; i<entries.size(); ++i)
+		{
+			CPPUNIT_ASSERT(readEntries[i].message==entries[i].message);
+			CPPUNIT_ASSERT(readEntries[i].file==entries[i].file);
+			CPPUNIT_ASSERT(readEntries[i].line==entries[i].line);
+			CPPUNIT_ASSERT(readEntries[i].seconds==entries[i].seconds);
+			CPPUNIT_ASSERT(readEntries[i].microseconds==entries[i].microseconds);
+		}
+
+		OUTPUT << "TC06:\tTruncated trace is detected\n";
+		string data=dump.str();
+		istringstream truncated(data.substr(0, data.size()-1));
+		readEntries.clear();
+		CPPUNIT_ASSERT(!readTrace(truncated, readEntries));
+		CPPUNIT_ASSERT(readEntries.size()==TRACE_RING_SIZE-1);
+
+		changeTraceLevel(target, DBG_PANIC, false);
+		clearTrace();
+		return true;
+	}
+
+	bool metricsTC()
+	{
+	using namespace std;
+	using namespace pdfobjects::metrics;
+
+		OUTPUT << __FUNCTION__<<endl;
+		Counter counter("test_counter", "Test counter");
+		Histogram histogram("test_histogram", "Test histogram");
+		bool wasEnabled=isEnabled();
+
+		OUTPUT << "TC01:\tNothing is collected when disabled\n";
+		setEnabled(false);
+		counter.add();
+		histogram.observe(10);
+		{
+			ScopedTimer timer(histogram);
+		}
+		CPPUNIT_ASSERT(counter.getValue()==0);
+		CPPUNIT_ASSERT(histogram.getCount()==0);
+
+		OUTPUT << "TC02:\tDurations are counted in the proper buckets\n";
+		setEnabled(true);
+		counter.add(3);
+		histogram.observe(1);
+		histogram.observe(3);
+		histogram.observe(100000000);
+		CPPUNIT_ASSERT(counter.getValue()==3);
+		CPPUNIT_ASSERT(histogram.getCount()==3);
+		CPPUNIT_ASSERT(histogram.getSum()==100000004);
+		CPPUNIT_ASSERT(histogram.getBucket(0)==1);
+		CPPUNIT_ASSERT(histogram.getBucket(2)==1);
+		CPPUNIT_ASSERT(histogram.getBucket(Histogram::BOUNDS)==1);
+
+		OUTPUT << "TC03:\tDump contains registered metrics\n";
+		ostringstream prometheus;
+		dump(prometheus, PROMETHEUS);
+		CPPUNIT_ASSERT(prometheus.str().find("pdfedit_test_counter_total 3\n")!=string::npos);
+		CPPUNIT_ASSERT(prometheus.str().find("pdfedit_test_histogram_seconds_bucket{le=\"0.000005\"} 2\n")!=string::npos);
+		CPPUNIT_ASSERT(prometheus.str().find("pdfedit_test_histogram_seconds_count 3\n")!=string::npos);
+		ostringstream json;
+		dump(json, JSON);
+		CPPUNIT_ASSERT(json.str().find("\"test_counter\": 3")!=string::npos);
+		CPPUNIT_ASSERT(json.str().find("\"+Inf\": 3")!=string::npos);
+
+		OUTPUT << "TC04:\tUnknown dump format is rejected\n";
+		CPPUNIT_ASSERT(!setupDump("xml", ""));
+
+		reset();
+		CPPUNIT_ASSERT(counter.getValue()==0);
+		CPPUNIT_ASSERT(histogram.getCount()==0);
+		setEnabled(wasEnabled);
+		return true;
+	}
+
+	bool indiRefMapTC()
+	{
+	using namespace std;
+	using namespace pdfobjects;
+
+		OUTPUT << __FUNCTION__<<endl;
+		typedef IndiRefMap<int> Map;
+		typedef map<IndiRef, int, utils::IndComparator> Model;
+		Map refMap;
+
+		OUTPUT << "TC01:\tEmpty map contains nothing\n";
+		CPPUNIT_ASSERT(refMap.empty());
+		CPPUNIT_ASSERT(refMap.begin()==refMap.end());
+		CPPUNIT_ASSERT(refMap.find(IndiRef(1, 0))==refMap.end());
+		CPPUNIT_ASSERT(refMap.erase(IndiRef(1, 0))==0);
+
+		OUTPUT << "TC02:\tInsert doesn't overwrite existing element\n";
+		CPPUNIT_ASSERT(refMap.insert(Map::value_type(IndiRef(1, 0), 1)).second);
+		pair<Map::iterator, bool> result=refMap.insert(Map::value_type(IndiRef(1, 0), 2));
+		CPPUNIT_ASSERT(!result.second);
+		CPPUNIT_ASSERT(result.first->second==1);
+		CPPUNIT_ASSERT(refMap.insert(Map::value_type(IndiRef(1, 1), 3)).second);
+		CPPUNIT_ASSERT(refMap.size()==2);
+		// value is overwritten through the iterator
+		result.first->second=2;
+		CPPUNIT_ASSERT(refMap.find(IndiRef(1, 0))->second==2);
+		CPPUNIT_ASSERT(refMap.find(IndiRef(1, 1))->second==3);
+		refMap.clear();
+		CPPUNIT_ASSERT(refMap.empty());
+		CPPUNIT_ASSERT(refMap.find(IndiRef(1, 0))==refMap.end());
+
+		OUTPUT << "TC03:\tErase keeps collision chains reachable\n";
+		// 8 elements fit into the initial table of 16 slots so that
+		// they form clusters. Each of them is erased from a separate
+		// copy and all others have to be still found.
+		Map full;
+		for(int i=1; i<=8; ++i)
+			full.insert(Map::value_type(IndiRef(i*7, i%2), i));
+		for(int erased=1; erased<=8; ++erased)
+		{
+			Map copy(full);
+			CPPUNIT_ASSERT(copy.erase(IndiRef(erased*7, erased%2))==1);
+			CPPUNIT_ASSERT(copy.size()==7);
+			CPPUNIT_ASSERT(copy.find(IndiRef(erased*7, erased%2))==copy.end());
+			for(int i=1; i<=8; ++i)
+			{
+				if(i==erased)
+					continue;
+				Map::const_iterator element=copy.find(IndiRef(i*7, i%2));
+				CPPUNIT_ASSERT(element!=copy.end() && element->second==i);
+			}
+		}
+
+		OUTPUT << "TC04:\tTable grows and keeps all elements\n";
+		Model model;
+		for(int i=1; i<=5000; ++i)
+		{
+			IndiRef ref(i, i%3);
+			CPPUNIT_ASSERT(refMap.insert(Map::value_type(ref, i)).second);
+			model.insert(Model::value_type(ref, i));
+		}
+		CPPUNIT_ASSERT(refMap.size()==model.size());
+		for(Model::const_iterator i=model.begin(); i!=model.end(); ++i)
+		{
+			Map::const_iterator element=refMap.find(i->first);
+			CPPUNIT_ASSERT(element!=refMap.end() && element->second==i->second);
+		}
+
+		OUTPUT << "TC05:\tIteration after erase visits remaining elements\n";
+		unsigned int seed=1;
+		for(int i=0; i<3000; ++i)
+		{
+			seed=seed*1103515245+12345;
+			IndiRef ref((seed>>8)%5000+1, ((seed>>8)%5000+1)%3);
+			size_t expected=model.erase(ref);
+			if(i%2)
+			{
+				CPPUNIT_ASSERT(refMap.erase(ref)==expected);
+				continue;
+			}
+			Map::iterator element=refMap.find(ref);
+			CPPUNIT_ASSERT((element!=refMap.end())==(expected==1));
+			if(element!=refMap.end())
+				refMap.erase(element);
+		}
+		CPPUNIT_ASSERT(refMap.size()==model.size());
+		Model visited;
+		for(Map::const_iterator i=refMap.begin(); i!=refMap.end(); ++i)
+			CPPUNIT_ASSERT(visited.insert(*i).second);
+		CPPUNIT_ASSERT(visited==model);
+
+		return true;
+	}
+
 	void Test()
 	{
 		CPPUNIT_ASSERT(tokenizerTC());
 		CPPUNIT_ASSERT(modeControllerTC());
 		CPPUNIT_ASSERT(operatorHinterTC());
 		CPPUNIT_ASSERT(observerHandlerTC());
+		CPPUNIT_ASSERT(debugTraceTC());
+		CPPUNIT_ASSERT(metricsTC());
+		CPPUNIT_ASSERT(indiRefMapTC());
 	}
 };
 CPPUNIT_TEST_SUITE_REGISTRATION(TestUtils);
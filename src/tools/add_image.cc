@@ -153,6 +153,10 @@ main(int argc, char ** argv)
 	// 
 	// parameter parsing
 	//
+	// parameters for pdfedit_core_dev_init (e.g. --metrics) would be
+	// rejected as unknown options
+	if (pdfedit_core_dev_parse_args(&argc, &argv))
+		return 1;
 	po::options_description desc("Allowed options\nExample options: --file=test.pdf --where=1 --png=test.png --p=100 --p=100");
 	desc.add_options()
 		("help", "produce help message")
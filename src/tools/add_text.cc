@@ -78,6 +78,10 @@ main(int argc, char ** argv)
 	// 
 	// parameter parsing
 	//
+	// parameters for pdfedit_core_dev_init (e.g. --metrics) would be
+	// rejected as unknown options
+	if (pdfedit_core_dev_parse_args(&argc, &argv))
+		return 1;
 	po::options_description desc("Allowed options");
 	desc.add_options()
 		("help", "produce help message")
@@ -0,0 +1,82 @@
+/*
+ * PDFedit - free program for PDF document manipulation.
+ * Copyright (C) 2006-2009  PDFedit team: Michal Hocko,
+ *                                        Jozef Misutka,
+ *                                        Martin Petricek
+ *                   Former team members: Miroslav Jahoda
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (in doc/LICENSE.GPL); if not, write to the 
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, 
+ * MA  02111-1307  USA
+ *
+ * Project is hosted on http://sourceforge.net/projects/pdfedit
+ */
+#include <fstream>
+#include <boost/program_options.hpp>
+#include "utils/debugtrace.h"
+
+using namespace std;
+using namespace boost;
+namespace po = program_options;
+
+int main(int argc, char ** argv)
+{
+	po::options_description desc("Allowed options");
+	desc.add_options()
+		("help", "produce help message")
+		("file", po::value<string>(), "Binary trace file (see debug::dumpTrace)")
+		("level", po::value<unsigned int>(), "Print only messages with priority up to given level")
+		("thread", po::value<unsigned int>(), "Print only messages from given thread")
+	;
+	
+	po::variables_map vm;
+	try {
+		po::store(po::parse_command_line(argc, argv, desc), vm);
+		po::notify(vm);    
+	}catch(std::exception& e)
+	{
+		std::cout << "exception - " << e.what() << ". Please, check your parameters." << endl;
+		return 1;
+	}   
+
+	if (vm.count("help") || !vm.count("file"))
+	{
+		cout << desc << "\n";
+		return 1;
+	}
+
+	string input_file = vm["file"].as<string>(); 
+	ifstream input(input_file.c_str(), ios::in | ios::binary);
+	if (!input)
+	{
+		cerr << "Unable to open " << input_file << endl;
+		return 1;
+	}
+
+	vector<debug::TraceEntry> entries;
+	bool complete = debug::readTrace(input, entries);
+	for (vector<debug::TraceEntry>::const_iterator i = entries.begin(); i != entries.end(); ++i)
+	{
+		if (vm.count("level") && i->level > vm["level"].as<unsigned int>())
+			continue;
+		if (vm.count("thread") && i->thread != vm["thread"].as<unsigned int>())
+			continue;
+		debug::formatTraceEntry(cout, *i);
+	}
+	if (!complete)
+	{
+		cerr << input_file << " is not a trace file or it is truncated" << endl;
+		return 1;
+	}
+	return 0;
+}
@@ -50,7 +50,7 @@ int delinearize(const char *input, const char *output)
 int main(int argc, char ** argv)
 {
 	int ret;
-	if(pdfedit_core_dev_init())
+	if(pdfedit_core_dev_init(&argc, &argv))
 	{
 		std::cerr << "Unable to initialize pdfedit-dev" << std::endl;
 		return 1;
@@ -22,42 +22,99 @@
  * Project is hosted on http://sourceforge.net/projects/pdfedit
  */
 #include "kernel/pdfedit-core-dev.h"
+#include "kernel/cpdf.h"
 #include "kernel/flattener.h"
 #include "kernel/pdfwriter.h"
 #include "utils/debug.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 
 using namespace pdfobjects;
 #define suffix ".flatten"
-int flatten_file(const char *fname)
+#define tmpSuffix ".tmp"
+
+/** Rebuilds page tree in the copy of given document.
+ * @param fname Input file.
+ * @param tmpFile Output file (copy of fname with rebuilt page tree).
+ * @param fanOut Fan-out of rebuilt page tree.
+ *
+ * Replaced page tree nodes are kept in tmpFile but they are not reachable
+ * anymore and so they are not written by flattener.
+ */
+void rebuild_page_tree(const char *fname, const char *tmpFile, size_t fanOut)
 {
-using namespace utils;
-	boost::shared_ptr<utils::Flattener> flattener = 
-		Flattener::getInstance(fname, new OldStylePdfWriter()); 
-	if(!flattener) {
-		std::cerr << "Unable to open "<<fname<<" file"<<std::endl;
-		return 1;
+	{
+		std::ifstream input(fname, std::ios::binary);
+		std::ofstream output(tmpFile, std::ios::binary);
+		output << input.rdbuf();
 	}
+	boost::shared_ptr<CPdf> pdf = CPdf::getInstance(tmpFile, CPdf::ReadWrite);
+	pdf->rebuildPageTree(fanOut);
+	pdf->save();
+}
+
+int flatten_file(const char *fname, size_t fanOut, bool dedup)
+{
+using namespace utils;
 	std::string outputFile(fname);
 	outputFile+=suffix;
-	std::cout << "Writing output to "<<outputFile<<std::endl;
-	return flattener->flatten(outputFile.c_str());
+	std::string inputFile(fname);
+	if(fanOut)
+	{
+		inputFile=outputFile+tmpSuffix;
+		std::cout << "Rebuilding page tree with fan-out "<<fanOut<<std::endl;
+		rebuild_page_tree(fname, inputFile.c_str(), fanOut);
+	}
+	int ret = 1;
+	{
+		boost::shared_ptr<utils::Flattener> flattener = 
+			Flattener::getInstance(inputFile.c_str(), new OldStylePdfWriter()); 
+		if(!flattener) {
+			std::cerr << "Unable to open "<<inputFile<<" file"<<std::endl;
+		}else {
+			std::cout << "Writing output to "<<outputFile<<std::endl;
+			flattener->setDeduplicate(dedup);
+			ret = flattener->flatten(outputFile.c_str());
+			if(dedup)
+				std::cout << flattener->getDuplicateCount()<<" duplicate objects merged"<<std::endl;
+		}
+	}
+	if(fanOut)
+		remove(inputFile.c_str());
+	return ret;
 }
 
 int main(int argc, char** argv)
 {
-	if(pdfedit_core_dev_init())
+	if(pdfedit_core_dev_init(&argc, &argv))
 	{
 		std::cerr << "Unable to initialize pdfedit-dev" << std::endl;
 		return 1;
 	}
 	//debug::changeDebugLevel(debug::utilsDebugTarget, debug::DBG_DBG);
 	int ret = 0;
+	size_t fanOut = 0;
+	bool dedup = false;
 	for(int i=1; i<argc; ++i)
 	{
+		// -fanout N rebuilds page tree of all following files
+		if(!strcmp(argv[i], "-fanout") && i+1<argc)
+		{
+			fanOut = atoi(argv[++i]);
+			continue;
+		}
+		// -dedup merges objects with the same content in all following files
+		if(!strcmp(argv[i], "-dedup"))
+		{
+			dedup = true;
+			continue;
+		}
 		const char *fname= argv[i];
 		try
 		{
-			ret = flatten_file(fname);
+			ret = flatten_file(fname, fanOut, dedup);
 		}catch(...)
 		{
 			std::cerr << fname << " is not a valid pdf document - ignoring"<<std::endl;
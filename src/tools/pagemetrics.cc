@@ -83,6 +83,10 @@ main(int argc, char ** argv)
 	// 
 	// parameter parsing
 	//
+	// parameters for pdfedit_core_dev_init (e.g. --metrics) would be
+	// rejected as unknown options
+	if (pdfedit_core_dev_parse_args(&argc, &argv))
+		return 1;
 	po::options_description desc("Example:\npagemetrics-tool.exe --file=test.pdf --alg=sr --p=90\n\nAllowed options");
 	desc.add_options()
 		("help", "produce help message")
@@ -96,6 +100,7 @@ main(int argc, char ** argv)
 		("p", po::value<P>(), "parameters (e.g. for transformation matrix :) --p 1 --p 1 --p 1 --p 1 --p 1 --p 1)")
 		("from", po::value<size_t>()->default_value(1), "start page (default 0)")
 		("to", po::value<size_t>(), "end page (default till the end of file)")
+		("prefetch", po::value<size_t>()->default_value(0), "number of following pages prefetched on background (0 disables)")
 	;
 
 	po::variables_map vm;
@@ -116,6 +121,7 @@ main(int argc, char ** argv)
 	string file = vm["file"].as<string>(); 
 	unsigned int from = vm["from"].as<unsigned int>();
 	string alg = vm["alg"].as<string>();
+	size_t prefetch = vm["prefetch"].as<size_t>();
 	P p = vm["p"].as<P>();
 	unsigned int to = numeric_limits<unsigned int>::max();
 	if (vm.count("to")) 
@@ -132,6 +138,7 @@ main(int argc, char ** argv)
 
 		// open pdf
 		shared_ptr<CPdf> pdf = CPdf::getInstance (file.c_str(), CPdf::ReadWrite);
+		pdf->setPagePrefetch(prefetch);
 
 		// sane values
 		to = std::min(to, pdf->getPageCount()+1);
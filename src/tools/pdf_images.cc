@@ -64,6 +64,10 @@ main(int argc, char ** argv)
 	// 
 	// parameter parsing
 	//
+	// parameters for pdfedit_core_dev_init (e.g. --metrics) would be
+	// rejected as unknown options
+	if (pdfedit_core_dev_parse_args(&argc, &argv))
+		return 1;
 	po::options_description desc("Allowed options");
 	desc.add_options()
 		("help", "produce help message")
@@ -72,6 +76,7 @@ main(int argc, char ** argv)
 		("what", po::value<string>(), "pages to convert")
 		("hdpi", po::value<size_t>()->default_value(72), "horizontal dpi")
 		("vdpi", po::value<size_t>()->default_value(72), "vertical dpi")
+		("prefetch", po::value<size_t>()->default_value(0), "number of following pages prefetched on background (0 disables)")
 	;
 
 	po::variables_map vm;
@@ -98,6 +103,7 @@ main(int argc, char ** argv)
 	string dir (vm["dir"].as<string>());
 	size_t hdpi = vm["hdpi"].as<size_t>();
 	size_t vdpi = vm["vdpi"].as<size_t>();
+	size_t prefetch = vm["prefetch"].as<size_t>();
 
 	try
 	{
@@ -108,6 +114,7 @@ main(int argc, char ** argv)
 
 		// open pdf
 		shared_ptr<CPdf> pdf = CPdf::getInstance (file.c_str(), CPdf::ReadWrite);
+		pdf->setPagePrefetch(prefetch);
 		ImageOutputDev img_out (const_cast<char*> (dir.c_str()), gTrue);
 
 		// alter display params
@@ -357,7 +357,7 @@ int compare_objects(const char*f1, const char*f2, RefContainer& refs)
 
 int main(int argc, char ** argv)
 {
-	if(pdfedit_core_dev_init())
+	if(pdfedit_core_dev_init(&argc, &argv))
 	{
 		std::cerr << "Unable to initialize pdfedit-dev" << std::endl;
 		return 1;
@@ -79,7 +79,7 @@ void print_pages(const char *fname, RefContainer &refs)
 }
 int main(int argc, char ** argv)
 {
-	if(pdfedit_core_dev_init())
+	if(pdfedit_core_dev_init(&argc, &argv))
 	{
 		std::cerr << "Unable to initialize pdfedit-dev" << std::endl;
 		return 1;
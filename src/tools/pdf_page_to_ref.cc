@@ -71,7 +71,7 @@ void print_pages(const char *fname, PagePosList &pagePosList)
 
 int main(int argc, char** argv)
 {
-	if(pdfedit_core_dev_init())
+	if(pdfedit_core_dev_init(&argc, &argv))
 	{
 		std::cerr << "Unable to initialize pdfedit-dev" << std::endl;
 		return 1;
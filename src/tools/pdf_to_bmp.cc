@@ -178,6 +178,10 @@ main(int argc, char ** argv)
 	// 
 	// parameter parsing
 	//
+	// parameters for pdfedit_core_dev_init (e.g. --metrics) would be
+	// rejected as unknown options
+	if (pdfedit_core_dev_parse_args(&argc, &argv))
+		return 1;
 	po::options_description desc("Allowed options");
 	desc.add_options()
 		("help", "produce help message")
@@ -185,6 +189,7 @@ main(int argc, char ** argv)
 		("what", po::value<Pages>(), "page to convert")
 		("hdpi", po::value<size_t>()->default_value(72), "horizontal dpi")
 		("vdpi", po::value<size_t>()->default_value(72), "vertical dpi")
+		("prefetch", po::value<size_t>()->default_value(0), "number of following pages prefetched on background (0 disables)")
 	;
 
 	po::variables_map vm;
@@ -210,6 +215,7 @@ main(int argc, char ** argv)
 
 	size_t hdpi = vm["hdpi"].as<size_t>();
 	size_t vdpi = vm["vdpi"].as<size_t>();
+	size_t prefetch = vm["prefetch"].as<size_t>();
 
 	try
 	{
@@ -226,6 +232,7 @@ main(int argc, char ** argv)
 
 		// open pdf
 		shared_ptr<CPdf> pdf = CPdf::getInstance (file.c_str(), CPdf::ReadWrite);
+		pdf->setPagePrefetch(prefetch);
 
 
 		if (pages.empty())
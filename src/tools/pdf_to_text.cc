@@ -77,6 +77,10 @@ main(int argc, char ** argv)
 	// 
 	// parameter parsing
 	//
+	// parameters for pdfedit_core_dev_init (e.g. --metrics) would be
+	// rejected as unknown options
+	if (pdfedit_core_dev_parse_args(&argc, &argv))
+		return 1;
 	po::options_description desc("Allowed options");
 	desc.add_options()
 		("help", "produce help message")
@@ -85,6 +89,7 @@ main(int argc, char ** argv)
 		("output-pages", po::value<bool>()->default_value(DEFAULT_OUTPUT_PAGES), "output page number before each page")
 		("encoding", po::value<string>()->default_value(DEFAULT_ENCODING), "encoding to use")
 		("font-dir", po::value<string>()->default_value(DEFAULT_FONT_DIR), "(xpdf) font directory with font definitions(e.g. N019003L.PFB)")
+		("prefetch", po::value<size_t>()->default_value(0), "number of following pages prefetched on background (0 disables)")
 	;
 
 	po::variables_map vm;
@@ -106,6 +111,7 @@ main(int argc, char ** argv)
 	bool output_pages = vm["output-pages"].as<bool>(); 
 	string encoding = vm["encoding"].as<string>(); 
 	string font_dir = vm["font-dir"].as<string>(); 
+	size_t prefetch = vm["prefetch"].as<size_t>();
 	
 	Pages pages;
 	if (vm.count("what"))
@@ -120,6 +126,7 @@ main(int argc, char ** argv)
 
 		// open pdf
 		shared_ptr<CPdf> pdf = CPdf::getInstance (file.c_str(), CPdf::ReadWrite);
+		pdf->setPagePrefetch(prefetch);
 
 		if (pages.empty())
 		{
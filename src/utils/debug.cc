@@ -57,4 +57,23 @@ void changeDebugLevel(unsigned int level)
 	changeDebugLevel(utilsDebugTarget, level);
 }
 
+void changeTraceLevel(DebugTarget & debugTarget, unsigned int level, bool enable)
+{
+	unsigned int mask=0;
+	if(enable)
+	{
+		// all priorities up to level (included)
+		for(unsigned int i=0; i<=level && i<DBG_DBG+1; ++i)
+			mask|=1u<<i;
+	}
+	debugTarget.traceMask=mask;
+}
+
+void changeTraceLevel(unsigned int level, bool enable)
+{
+	changeTraceLevel(kernelDebugTarget, level, enable);
+	changeTraceLevel(guiDebugTarget, level, enable);
+	changeTraceLevel(utilsDebugTarget, level, enable);
+}
+
 }
@@ -63,6 +63,19 @@ template<> struct CompileTimeChecker<true> { CompileTimeChecker(...) {} };
 #define DEFAULT_DEBUG_LEVEL debug::DBG_ERR
 #endif
 
+/** The least important priority which is compiled in.
+ * Messages with lower priority (higher number) are removed at compile time
+ * together with the runtime check of the debug level and argument
+ * formatting, so they don't cost anything even in hot paths. They are still
+ * type checked, though. Runtime debug level can't enable removed messages.
+ * <br>
+ * All messages are compiled in by default. configure script sets the value
+ * (see --with-compiled-debug-level).
+ */
+#ifndef COMPILED_DEBUG_LEVEL
+#define COMPILED_DEBUG_LEVEL debug::DBG_DBG
+#endif
+
 /** Panic situation priority.
  * After this kind of message, program usually ends without any resonable
  * rescue routines. It should contain the cause of this state.
@@ -119,17 +132,26 @@ struct DebugTarget
 	/** Stream for data. */
 	std::ostream &stream;
 
+	/** Filter for message tracing.
+	 *
+	 * Bit mask of priorities (bit number is the priority) which are stored
+	 * to the trace ring buffer of the current thread (see debugtrace.h). 
+	 * Tracing is independent on debugLevel and it is disabled by default.
+	 * Use changeTraceLevel function to change the value.
+	 */
+	unsigned int traceMask;
+
 	/** Defaul constructor.
 	 * Initializes debugLevel to DEFAULT_DEBUG_LEVEL and stream to 
-	 * the standard error.
+	 * the standard error. Tracing is disabled.
 	 */
-	DebugTarget():debugLevel(DEFAULT_DEBUG_LEVEL), stream(std::cerr) {}
+	DebugTarget():debugLevel(DEFAULT_DEBUG_LEVEL), stream(std::cerr), traceMask(0) {}
 
 	/** Constructor for full initialization.
 	 * @param level Debug level to be used.
 	 * @param s Stream to be used.
 	 */
-	DebugTarget(unsigned int level, std::ostream & s): debugLevel(level), stream(s) {}
+	DebugTarget(unsigned int level, std::ostream & s): debugLevel(level), stream(s), traceMask(0) {}
 };
 
 /** Debug target for kernel. */
@@ -156,6 +178,46 @@ unsigned int changeDebugLevel(DebugTarget & debugTarget, unsigned int level);
  */
 void changeDebugLevel(unsigned int level);
 
+/** Changes tracing filter for given debug target.
+ * @param debugTarget Debug target to update.
+ * @param level The least important priority to be traced.
+ * @param enable Flag for enabling/disabling of tracing.
+ *
+ * Messages with priority up to given level are traced when enable is true,
+ * otherwise tracing is disabled for the target. Note that messages removed 
+ * at compile time (see COMPILED_DEBUG_LEVEL) can't be traced.
+ */
+void changeTraceLevel(DebugTarget & debugTarget, unsigned int level, bool enable=true);
+
+/** Changes tracing filter for all standard debug targets.
+ * @param level The least important priority to be traced.
+ * @param enable Flag for enabling/disabling of tracing.
+ */
+void changeTraceLevel(unsigned int level, bool enable=true);
+
+/** Starts a new trace record in the ring buffer of the current thread.
+ * @param prefix Prefix of the message.
+ * @param level Priority of the message.
+ * @param file Source file name.
+ * @param function Function name.
+ * @param line Line number.
+ *
+ * All string parameters have to be string literals, because just pointers
+ * are stored.
+ * <br>
+ * This is a helper for _printDbg macro, use debugtrace.h functions to 
+ * work with the trace.
+ *
+ * @return Stream for the message of the record (messages are truncated to
+ * TRACE_MESSAGE_SIZE).
+ */
+std::ostream & beginTrace(const char * prefix, unsigned int level, 
+		const char * file, const char * function, unsigned int line);
+
+/** Finishes trace record started by beginTrace.
+ */
+void endTrace();
+
 /** Prints message with given priority.
  * @param prefix Prefix for message.
  * @param dbgLevel Priority of message.
@@ -225,15 +287,27 @@ void changeDebugLevel(unsigned int level);
  * @code
  * priority:prefix:fileName:functionName:line: message
  * @endcode
+ * If the priority is enabled in target::traceMask, message is also stored to
+ * the trace ring buffer.
+ * <br>
+ * Whole statement is removed by compiler if priority is lower than
+ * COMPILED_DEBUG_LEVEL.
  */
 #define _printDbg(prefix, level, target, msg)					\
 	do {									\
-	if (target.debugLevel >= level) { 					\
-		target.stream << level <<":"<<prefix<<":"			\
-		    << __FILE__ << ":" << __FUNCTION__ <<":"<< __LINE__ 	\
-			<< ": "							\
-			<<  msg 						\
-			<< std::endl;						\
+	if ((level) <= COMPILED_DEBUG_LEVEL) {					\
+		if (target.debugLevel >= level) { 				\
+			target.stream << level <<":"<<prefix<<":"		\
+			    << __FILE__ << ":" << __FUNCTION__ <<":"<< __LINE__ \
+				<< ": "						\
+				<<  msg 					\
+				<< std::endl;					\
+		}								\
+		if (target.traceMask & (1u << (level))) {			\
+			debug::beginTrace(prefix, (level), __FILE__, 		\
+					__FUNCTION__, __LINE__) << msg;		\
+			debug::endTrace();					\
+		}								\
 	}									\
 	}while(0)
 
@@ -0,0 +1,462 @@
+/*
+ * PDFedit - free program for PDF document manipulation.
+ * Copyright (C) 2006-2009  PDFedit team: Michal Hocko,
+ *                                        Jozef Misutka,
+ *                                        Martin Petricek
+ *                   Former team members: Miroslav Jahoda
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (in doc/LICENSE.GPL); if not, write to the 
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, 
+ * MA  02111-1307  USA
+ *
+ * Project is hosted on http://sourceforge.net/projects/pdfedit
+ */
+// vim:tabstop=4:shiftwidth=4:noexpandtab:textwidth=80
+#include "kernel/static.h" // WIN32 port - precompiled headers - REMOVE IN FUTURE!
+#include "utils/debugtrace.h"
+
+#include <cstring>
+#include <algorithm>
+#include <iomanip>
+#ifdef WIN32
+#  include <windows.h>
+#else
+#  include <pthread.h>
+#  include <sys/time.h>
+#endif
+#include <goo/GMutex.h>
+
+namespace debug
+{
+
+namespace {
+
+/** Stream buffer which writes to a fixed size memory.
+ * Characters which don't fit are silently dropped.
+ */
+class FixedStreamBuf: public std::streambuf
+{
+public:
+	/** Sets buffer for following output.
+	 * @param buffer Buffer for characters.
+	 * @param size Size of the buffer.
+	 */
+	void reset(char * buffer, size_t size)
+	{
+		setp(buffer, buffer+size);
+	}
+
+	/** Returns number of characters written since the last reset.
+	 */
+	size_t length()const
+	{
+		return pptr()-pbase();
+	}
+
+protected:
+	virtual int_type overflow(int_type c)
+	{
+		return traits_type::not_eof(c);
+	}
+};
+
+/** Trace record in the ring buffer.
+ */
+struct TraceRecord
+{
+	/** Sequence number of the record (0 while the record is written). */
+	volatile unsigned long sequence;
+	unsigned long seconds;
+	unsigned int microseconds;
+	const char * prefix;
+	const char * file;
+	const char * function;
+	unsigned int level;
+	unsigned int line;
+	size_t length;
+	char message[TRACE_MESSAGE_SIZE];
+};
+
+/** Ring buffer of one thread.
+ */
+struct TraceRing
+{
+	/** Identifier of the ring. */
+	unsigned int id;
+
+	/** Number of records written to the ring. */
+	unsigned long sequence;
+
+	/** Depth of nested beginTrace calls (messages traced while formatting
+	 * other message are ignored).
+	 */
+	unsigned int depth;
+
+	/** Record being written. */
+	TraceRecord * current;
+
+	FixedStreamBuf buffer;
+	std::ostream stream;
+
+	/** Stream for ignored messages. */
+	std::ostream nullStream;
+
+	TraceRecord records[TRACE_RING_SIZE];
+
+	TraceRing(unsigned int i)
+		:id(i), sequence(0), depth(0), current(NULL), 
+		 stream(&buffer), nullStream(NULL)
+	{
+		for(size_t j=0; j<TRACE_RING_SIZE; ++j)
+			records[j].sequence=0;
+	}
+};
+
+/** Makes sure that record content is written before its sequence number
+ * (and read after it).
+ */
+inline void traceBarrier()
+{
+#ifdef WIN32
+	MemoryBarrier();
+#else
+	__sync_synchronize();
+#endif
+}
+
+/** Gets current time.
+ * @param seconds Seconds since the Epoch.
+ * @param microseconds Microseconds part of the time.
+ */
+void traceTime(unsigned long & seconds, unsigned int & microseconds)
+{
+#ifdef WIN32
+	FILETIME ft;
+	GetSystemTimeAsFileTime(&ft);
+	ULARGE_INTEGER t;
+	t.LowPart=ft.dwLowDateTime;
+	t.HighPart=ft.dwHighDateTime;
+	// FILETIME counts 100ns intervals since 1601
+	t.QuadPart-=116444736000000000ULL;
+	seconds=(unsigned long)(t.QuadPart/10000000);
+	microseconds=(unsigned int)(t.QuadPart/10%1000000);
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	seconds=tv.tv_sec;
+	microseconds=tv.tv_usec;
+#endif
+}
+
+void releaseRing(void * ring);
+
+/** All ring buffers.
+ * Ring buffer is assigned to the thread when it traces the first message and
+ * it is returned to the free list when the thread finishes (records are kept 
+ * until they are overwritten by a new owner).
+ */
+class TraceRegistry
+{
+	GMutex mutex;
+#ifdef WIN32
+	DWORD key;
+#else
+	pthread_key_t key;
+#endif
+	std::vector<TraceRing *> rings;
+	std::vector<TraceRing *> freeRings;
+public:
+	TraceRegistry()
+	{
+		gInitMutex(&mutex);
+#ifdef WIN32
+		key=TlsAlloc();
+#else
+		pthread_key_create(&key, releaseRing);
+#endif
+	}
+
+	/** Returns ring buffer of the current thread.
+	 */
+	TraceRing * getRing()
+	{
+#ifdef WIN32
+		TraceRing * ring=static_cast<TraceRing *>(TlsGetValue(key));
+#else
+		TraceRing * ring=static_cast<TraceRing *>(pthread_getspecific(key));
+#endif
+		if(ring)
+			return ring;
+		gLockMutex(&mutex);
+		if(freeRings.empty())
+		{
+			ring=new TraceRing(rings.size());
+			rings.push_back(ring);
+		}else
+		{
+			ring=freeRings.back();
+			freeRings.pop_back();
+		}
+		gUnlockMutex(&mutex);
+#ifdef WIN32
+		TlsSetValue(key, ring);
+#else
+		pthread_setspecific(key, ring);
+#endif
+		return ring;
+	}
+
+	/** Returns ring buffer to the free list.
+	 */
+	void release(TraceRing * ring)
+	{
+		gLockMutex(&mutex);
+		freeRings.push_back(ring);
+		gUnlockMutex(&mutex);
+	}
+
+	/** Locks registry and returns all rings.
+	 * Registry has to be unlocked by unlock.
+	 */
+	const std::vector<TraceRing *> & lock()
+	{
+		gLockMutex(&mutex);
+		return rings;
+	}
+
+	void unlock()
+	{
+		gUnlockMutex(&mutex);
+	}
+};
+
+TraceRegistry & getRegistry()
+{
+	// never destroyed, because threads may finish after static destructors
+	static TraceRegistry * registry=new TraceRegistry();
+	return *registry;
+}
+
+void releaseRing(void * ring)
+{
+	getRegistry().release(static_cast<TraceRing *>(ring));
+}
+
+/** Orders trace entries by time (and by production order within thread).
+ */
+bool traceEntryLess(const TraceEntry & e1, const TraceEntry & e2)
+{
+	if(e1.seconds!=e2.seconds)
+		return e1.seconds<e2.seconds;
+	if(e1.microseconds!=e2.microseconds)
+		return e1.microseconds<e2.microseconds;
+	if(e1.thread!=e2.thread)
+		return e1.thread<e2.thread;
+	return e1.sequence<e2.sequence;
+}
+
+void writeNumber(std::ostream & out, unsigned long value, size_t bytes)
+{
+	for(size_t i=0; i<bytes; ++i)
+		out.put((char)((value>>(8*i))&0xff));
+}
+
+void writeString(std::ostream & out, const std::string & str)
+{
+	size_t len=std::min(str.size(), (size_t)0xffff);
+	writeNumber(out, len, 2);
+	out.write(str.data(), len);
+}
+
+bool readNumber(std::istream & in, unsigned long & value, size_t bytes)
+{
+	value=0;
+	for(size_t i=0; i<bytes; ++i)
+	{
+		int c=in.get();
+		if(c==EOF)
+			return false;
+		value|=(unsigned long)(c&0xff)<<(8*i);
+	}
+	return true;
+}
+
+bool readString(std::istream & in, std::string & str)
+{
+	unsigned long len;
+	if(!readNumber(in, len, 2))
+		return false;
+	str.resize(len);
+	if(len)
+		in.read(&str[0], len);
+	return (size_t)in.gcount()==len || !len;
+}
+
+/** Magic string of the binary trace format. */
+const char TRACE_MAGIC[]="PDFTRACE";
+
+} // end of anonymous namespace for trace ring buffers
+
+std::ostream & beginTrace(const char * prefix, unsigned int level, 
+		const char * file, const char * function, unsigned int line)
+{
+	TraceRing * ring=getRegistry().getRing();
+	if(ring->depth++)
+		return ring->nullStream;
+	TraceRecord * record=&ring->records[ring->sequence%TRACE_RING_SIZE];
+	record->sequence=0;
+	traceBarrier();
+	traceTime(record->seconds, record->microseconds);
+	record->prefix=prefix;
+	record->file=file;
+	record->function=function;
+	record->level=level;
+	record->line=line;
+	ring->current=record;
+	ring->buffer.reset(record->message, TRACE_MESSAGE_SIZE);
+	ring->stream.clear();
+	return ring->stream;
+}
+
+void endTrace()
+{
+	TraceRing * ring=getRegistry().getRing();
+	if(--ring->depth)
+		return;
+	TraceRecord * record=ring->current;
+	record->length=ring->buffer.length();
+	traceBarrier();
+	record->sequence=++ring->sequence;
+	ring->current=NULL;
+}
+
+size_t collectTrace(std::vector<TraceEntry> & entries)
+{
+	size_t start=entries.size();
+	TraceRegistry & registry=getRegistry();
+	const std::vector<TraceRing *> & rings=registry.lock();
+	for(std::vector<TraceRing *>::const_iterator i=rings.begin(); i!=rings.end(); ++i)
+	{
+		const TraceRing * ring=*i;
+		for(size_t j=0; j<TRACE_RING_SIZE; ++j)
+		{
+			const TraceRecord & record=ring->records[j];
+			unsigned long sequence=record.sequence;
+			if(!sequence)
+				continue;
+			traceBarrier();
+			TraceEntry entry;
+			entry.seconds=record.seconds;
+			entry.microseconds=record.microseconds;
+			entry.thread=ring->id;
+			entry.sequence=sequence;
+			entry.level=record.level;
+			entry.prefix=record.prefix;
+			entry.file=record.file;
+			entry.function=record.function;
+			entry.line=record.line;
+			entry.message.assign(record.message, 
+					std::min(record.length, TRACE_MESSAGE_SIZE));
+			traceBarrier();
+			// record has been overwritten meanwhile
+			if(sequence!=record.sequence)
+				continue;
+			entries.push_back(entry);
+		}
+	}
+	registry.unlock();
+	std::sort(entries.begin()+start, entries.end(), traceEntryLess);
+	return entries.size()-start;
+}
+
+size_t dumpTrace(std::ostream & out)
+{
+	std::vector<TraceEntry> entries;
+	collectTrace(entries);
+	out.write(TRACE_MAGIC, strlen(TRACE_MAGIC));
+	writeNumber(out, TRACE_FORMAT_VERSION, 4);
+	for(std::vector<TraceEntry>::const_iterator i=entries.begin(); i!=entries.end(); ++i)
+	{
+		writeNumber(out, i->seconds, 4);
+		writeNumber(out, i->microseconds, 4);
+		writeNumber(out, i->thread, 4);
+		writeNumber(out, i->sequence, 4);
+		writeNumber(out, i->line, 4);
+		writeNumber(out, i->level, 1);
+		writeString(out, i->prefix);
+		writeString(out, i->file);
+		writeString(out, i->function);
+		writeString(out, i->message);
+	}
+	out.flush();
+	return entries.size();
+}
+
+void clearTrace()
+{
+	TraceRegistry & registry=getRegistry();
+	const std::vector<TraceRing *> & rings=registry.lock();
+	for(std::vector<TraceRing *>::const_iterator i=rings.begin(); i!=rings.end(); ++i)
+		for(size_t j=0; j<TRACE_RING_SIZE; ++j)
+			(*i)->records[j].sequence=0;
+	registry.unlock();
+}
+
+bool readTrace(std::istream & in, std::vector<TraceEntry> & entries)
+{
+	char magic[sizeof(TRACE_MAGIC)-1];
+	in.read(magic, sizeof(magic));
+	if((size_t)in.gcount()!=sizeof(magic) || memcmp(magic, TRACE_MAGIC, sizeof(magic)))
+		return false;
+	unsigned long value;
+	if(!readNumber(in, value, 4) || value!=TRACE_FORMAT_VERSION)
+		return false;
+	while(in.peek()!=EOF)
+	{
+		TraceEntry entry;
+		if(!readNumber(in, entry.seconds, 4))
+			return false;
+		if(!readNumber(in, value, 4))
+			return false;
+		entry.microseconds=(unsigned int)value;
+		if(!readNumber(in, value, 4))
+			return false;
+		entry.thread=(unsigned int)value;
+		if(!readNumber(in, value, 4))
+			return false;
+		entry.sequence=(unsigned int)value;
+		if(!readNumber(in, value, 4))
+			return false;
+		entry.line=(unsigned int)value;
+		if(!readNumber(in, value, 1))
+			return false;
+		entry.level=(unsigned int)value;
+		if(!readString(in, entry.prefix) || !readString(in, entry.file) 
+				|| !readString(in, entry.function) || !readString(in, entry.message))
+			return false;
+		entries.push_back(entry);
+	}
+	return true;
+}
+
+void formatTraceEntry(std::ostream & out, const TraceEntry & entry)
+{
+	out << "[" << entry.seconds << "." 
+		<< std::setw(6) << std::setfill('0') << entry.microseconds << std::setfill(' ')
+		<< "] #" << entry.thread << " "
+		<< entry.level << ":" << entry.prefix << ":"
+		<< entry.file << ":" << entry.function << ":" << entry.line
+		<< ": " << entry.message << std::endl;
+}
+
+} // namespace debug
@@ -0,0 +1,152 @@
+/*
+ * PDFedit - free program for PDF document manipulation.
+ * Copyright (C) 2006-2009  PDFedit team: Michal Hocko,
+ *                                        Jozef Misutka,
+ *                                        Martin Petricek
+ *                   Former team members: Miroslav Jahoda
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (in doc/LICENSE.GPL); if not, write to the 
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, 
+ * MA  02111-1307  USA
+ *
+ * Project is hosted on http://sourceforge.net/projects/pdfedit
+ */
+// vim:tabstop=4:shiftwidth=4:noexpandtab:textwidth=80
+#ifndef _DEBUGTRACE_H_
+#define _DEBUGTRACE_H_
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "utils/debug.h"
+
+// =============================================================================
+namespace debug {
+// =============================================================================
+
+/** Maximal length of traced message.
+ * Longer messages are truncated.
+ */
+const size_t TRACE_MESSAGE_SIZE = 120;
+
+/** Number of records in the ring buffer of each thread.
+ * The oldest records are overwritten when the ring is full.
+ */
+const size_t TRACE_RING_SIZE = 1024;
+
+/** Trace record.
+ *
+ * Messages enabled by DebugTarget::traceMask are stored to the ring buffer
+ * of the thread which produced them (see _printDbg). Each thread writes
+ * just to its own ring, so no locking is needed when tracing. Records are
+ * collected by collectTrace or dumpTrace to the binary format which can be
+ * read by readTrace and formatted by formatTraceEntry (see also 
+ * debug_trace_printer tool) later.
+ * <br>
+ * Binary format (all numbers are stored in little endian):
+ * <pre>
+ * trace   := "PDFTRACE" version(u32) record*
+ * record  := seconds(u32) microseconds(u32) thread(u32)
+ *            sequence(u32) line(u32) level(u8) prefix file function
+ *            message
+ * string  := length(u16) bytes
+ * </pre>
+ */
+struct TraceEntry
+{
+	/** Time of the record (seconds since the Epoch). */
+	unsigned long seconds;
+
+	/** Microseconds part of the time of the record. */
+	unsigned int microseconds;
+
+	/** Identifier of the ring buffer (thread) which produced the record.
+	 * Ring buffers of finished threads are reused by new threads.
+	 */
+	unsigned int thread;
+
+	/** Sequence number of the record in its ring buffer. */
+	unsigned int sequence;
+
+	/** Priority of the message. */
+	unsigned int level;
+
+	/** Prefix of the message. */
+	std::string prefix;
+
+	/** Source file name. */
+	std::string file;
+
+	/** Function name. */
+	std::string function;
+
+	/** Line number. */
+	unsigned int line;
+
+	/** Message (possibly truncated). */
+	std::string message;
+};
+
+/** Version of the binary trace format. */
+const unsigned int TRACE_FORMAT_VERSION = 1;
+
+/** Collects records from all ring buffers.
+ * @param entries Container for records (records are appended).
+ *
+ * Records are sorted by their time. Records which are being written by other
+ * threads at the moment are skipped.
+ *
+ * @return Number of collected records.
+ */
+size_t collectTrace(std::vector<TraceEntry> & entries);
+
+/** Writes records from all ring buffers to the stream in binary format.
+ * @param out Output stream (should be opened in binary mode).
+ *
+ * @return Number of written records.
+ */
+size_t dumpTrace(std::ostream & out);
+
+/** Discards all traced records.
+ *
+ * Records which are being written by other threads at the moment may
+ * survive.
+ */
+void clearTrace();
+
+/** Reads records in binary format.
+ * @param in Input stream (should be opened in binary mode).
+ * @param entries Container for records (records are appended).
+ *
+ * @return true if whole stream has been read, false if it is not in trace
+ * format or it is truncated (records read so far are kept).
+ */
+bool readTrace(std::istream & in, std::vector<TraceEntry> & entries);
+
+/** Formats trace record.
+ * @param out Output stream.
+ * @param entry Trace record.
+ *
+ * Uses _printDbg format prefixed by time and thread:
+ * @code
+ * [seconds.microseconds] #thread priority:prefix:fileName:functionName:line: message
+ * @endcode
+ */
+void formatTraceEntry(std::ostream & out, const TraceEntry & entry);
+
+// =============================================================================
+} // namespace debug
+// =============================================================================
+
+#endif // _DEBUGTRACE_H_
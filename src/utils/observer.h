@@ -310,6 +310,20 @@ public:
 	 */
 	virtual priority_t getPriority()const throw() =0;
 
+	/** Checks whether notification can be delayed.
+	 *
+	 * Value keeper may postpone notifications (and coalesce more changes of
+	 * the same value to one notification) for deferrable observers.
+	 * Observers which have to be synchronized with the value all the time
+	 * should return false to be notified immediately.
+	 *
+	 * @return true by default.
+	 */
+	virtual bool isDeferrable()const throw()
+	{
+		return true;
+	}
+
 	/** Sets active flag value.
 	 * @param active Flag value to be set.
 	 * @return previous value of the flag.
@@ -655,6 +669,42 @@ public:
 				o->notify (newValue, context);
 		}
 	}
+
+	/**
+	 * Notify all active observers with given deferrable flag.
+	 *
+	 * Same as notifyObservers but observers which IObserver::isDeferrable
+	 * value is different from given one are ignored.
+	 *
+	 * @param newValue Object with new value.
+	 * @param context Context in which the change has been made.
+	 * @param deferrable Deferrable flag of observers to notify.
+	 */
+	void notifyObservers (boost::shared_ptr<T> newValue, boost::shared_ptr<const ObserverContext> context, bool deferrable)
+	{
+		typename ObserverList::const_iterator it = observers.begin ();
+		for (; it != observers.end(); ++it)
+		{
+			Observer o = (*it);
+			if(o->isActive() && o->isDeferrable()==deferrable)
+				o->notify (newValue, context);
+		}
+	}
+
+	/**
+	 * Checks whether there is an active observer with given deferrable flag.
+	 *
+	 * @param deferrable Deferrable flag of observers.
+	 * @return true if at least one such observer is registered.
+	 */
+	bool hasActiveObservers (bool deferrable)const
+	{
+		typename ObserverList::const_iterator it = observers.begin ();
+		for (; it != observers.end(); ++it)
+			if((*it)->isActive() && (*it)->isDeferrable()==deferrable)
+				return true;
+		return false;
+	}
 	
 };
 
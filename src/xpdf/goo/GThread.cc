@@ -0,0 +1,190 @@
+//========================================================================
+//
+// GThread.cc
+//
+//========================================================================
+
+#include <xpdf-aconf.h>
+
+#ifdef WIN32
+#  include <windows.h>
+#else
+#  include <pthread.h>
+#  include <unistd.h>
+#endif
+#include "goo/GMutex.h"
+#include "goo/GThread.h"
+
+// Upper limit for the number of threads started by gParallelFor().
+#define gMaxParallelThreads 64
+
+//------------------------------------------------------------------------
+
+int gGetNumCPUs() {
+  int n;
+
+#ifdef WIN32
+  SYSTEM_INFO info;
+
+  GetSystemInfo(&info);
+  n = (int)info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+  n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#else
+  n = 1;
+#endif
+  return n < 1 ? 1 : n;
+}
+
+//------------------------------------------------------------------------
+// gParallelFor
+//------------------------------------------------------------------------
+
+struct GParallelJob {
+  GParallelFunc func;
+  void *data;
+  int n;
+  int next;			// next job index to be handed out
+  GMutex mutex;
+};
+
+static void gParallelWorker(GParallelJob *job) {
+  int idx;
+
+  while (1) {
+    gLockMutex(&job->mutex);
+    idx = job->next++;
+    gUnlockMutex(&job->mutex);
+    if (idx >= job->n) {
+      break;
+    }
+    (*job->func)(job->data, idx);
+  }
+}
+
+#ifdef WIN32
+static DWORD WINAPI gParallelThreadMain(LPVOID arg) {
+  gParallelWorker((GParallelJob *)arg);
+  return 0;
+}
+#else
+static void *gParallelThreadMain(void *arg) {
+  gParallelWorker((GParallelJob *)arg);
+  return NULL;
+}
+#endif
+
+void gParallelFor(int n, GParallelFunc func, void *data, int nThreads) {
+  GParallelJob job;
+#ifdef WIN32
+  HANDLE threads[gMaxParallelThreads];
+#else
+  pthread_t threads[gMaxParallelThreads];
+#endif
+  int nStarted, i;
+
+  if (nThreads <= 0) {
+    nThreads = gGetNumCPUs();
+  }
+  if (nThreads > n) {
+    nThreads = n;
+  }
+  if (nThreads > gMaxParallelThreads) {
+    nThreads = gMaxParallelThreads;
+  }
+  if (nThreads <= 1) {
+    for (i = 0; i < n; ++i) {
+      (*func)(data, i);
+    }
+    return;
+  }
+
+  job.func = func;
+  job.data = data;
+  job.n = n;
+  job.next = 0;
+  gInitMutex(&job.mutex);
+
+  // the calling thread is the first worker
+  nStarted = 0;
+  for (i = 1; i < nThreads; ++i) {
+#ifdef WIN32
+    if (!(threads[nStarted] = CreateThread(NULL, 0, &gParallelThreadMain,
+					   &job, 0, NULL))) {
+      break;
+    }
+#else
+    if (pthread_create(&threads[nStarted], NULL, &gParallelThreadMain,
+		       &job)) {
+      break;
+    }
+#endif
+    ++nStarted;
+  }
+  gParallelWorker(&job);
+  for (i = 0; i < nStarted; ++i) {
+#ifdef WIN32
+    WaitForSingleObject(threads[i], INFINITE);
+    CloseHandle(threads[i]);
+#else
+    pthread_join(threads[i], NULL);
+#endif
+  }
+
+  gDestroyMutex(&job.mutex);
+}
+
+//------------------------------------------------------------------------
+// gStartThread
+//------------------------------------------------------------------------
+
+struct GThreadStart {
+  GThreadFunc func;
+  void *data;
+};
+
+#ifdef WIN32
+static DWORD WINAPI gThreadMain(LPVOID arg) {
+#else
+static void *gThreadMain(void *arg) {
+#endif
+  GThreadStart start;
+
+  start = *(GThreadStart *)arg;
+  delete (GThreadStart *)arg;
+  (*start.func)(start.data);
+#ifdef WIN32
+  return 0;
+#else
+  return NULL;
+#endif
+}
+
+GBool gStartThread(GThreadHandle *thread, GThreadFunc func, void *data) {
+  GThreadStart *start;
+
+  start = new GThreadStart;
+  start->func = func;
+  start->data = data;
+#ifdef WIN32
+  if (!(*thread = CreateThread(NULL, 0, &gThreadMain, start, 0, NULL))) {
+    delete start;
+    return gFalse;
+  }
+#else
+  if (pthread_create(thread, NULL, &gThreadMain, start)) {
+    delete start;
+    return gFalse;
+  }
+#endif
+  return gTrue;
+}
+
+void gJoinThread(GThreadHandle *thread) {
+#ifdef WIN32
+  WaitForSingleObject(*thread, INFINITE);
+  CloseHandle(*thread);
+#else
+  pthread_join(*thread, NULL);
+#endif
+}
@@ -0,0 +1,51 @@
+//========================================================================
+//
+// GThread.h
+//
+// Portable worker thread helpers.
+//
+//========================================================================
+
+#ifndef GTHREAD_H
+#define GTHREAD_H
+
+#include <xpdf-aconf.h>
+
+#include "goo/gtypes.h"
+
+#ifdef WIN32
+#  include <windows.h>
+typedef HANDLE GThreadHandle;
+#else
+#  include <pthread.h>
+typedef pthread_t GThreadHandle;
+#endif
+
+// Job function for gParallelFor(): processes job number <idx>.
+typedef void (*GParallelFunc)(void *data, int idx);
+
+// Returns the number of online processors (at least 1).
+extern int gGetNumCPUs();
+
+// Runs func(data, 0) .. func(data, n - 1) on up to <nThreads> threads
+// (the calling thread is one of them; <nThreads> <= 0 means one thread
+// per processor).  Jobs are handed out in increasing order and may run
+// concurrently, so they must not share mutable state.  Returns when all
+// jobs are done.  If no additional thread can be started, the jobs are
+// simply run sequentially in the calling thread.
+extern void gParallelFor(int n, GParallelFunc func, void *data,
+			 int nThreads);
+
+// Thread function for gStartThread().
+typedef void (*GThreadFunc)(void *data);
+
+// Starts func(data) on a new thread and stores its handle in <thread>.
+// Returns gFalse if the thread can't be started.
+extern GBool gStartThread(GThreadHandle *thread, GThreadFunc func,
+			  void *data);
+
+// Waits until the thread started by gStartThread() finishes and
+// releases its handle.
+extern void gJoinThread(GThreadHandle *thread);
+
+#endif
@@ -12,12 +12,14 @@
 
 #ifdef WIN32
 #  include <time.h>
+#  include <io.h>
 #else
 #  if defined(MACOS)
 #    include <sys/stat.h>
 #  elif !defined(ACORN)
 #    include <sys/types.h>
 #    include <sys/stat.h>
+#    include <sys/mman.h>
 #    include <fcntl.h>
 #  endif
 #  include <limits.h>
@@ -573,6 +575,96 @@ char *getLine(char *buf, int size, FILE *f) {
   return buf;
 }
 
+//------------------------------------------------------------------------
+// GFileMap
+//------------------------------------------------------------------------
+
+GFileMap::GFileMap(FILE *f, Guint offset, Guint lengthA) {
+#if defined(WIN32)
+  SYSTEM_INFO info;
+  LARGE_INTEGER fileSize;
+  HANDLE file;
+  Guint delta;
+#elif !defined(ACORN) && !defined(MACOS) && !defined(VMS)
+  struct stat st;
+  long pageSize;
+  Guint delta;
+  void *p;
+#endif
+
+  data = NULL;
+  length = 0;
+  base = NULL;
+#if defined(WIN32)
+  mapping = NULL;
+  file = (HANDLE)_get_osfhandle(_fileno(f));
+  if (file == INVALID_HANDLE_VALUE ||
+      !GetFileSizeEx(file, &fileSize) ||
+      fileSize.HighPart != 0 || fileSize.LowPart <= offset) {
+    return;
+  }
+  length = fileSize.LowPart - offset;
+  if (lengthA > 0 && lengthA < length) {
+    length = lengthA;
+  }
+  // view offsets have to be multiples of the allocation granularity
+  GetSystemInfo(&info);
+  delta = offset % info.dwAllocationGranularity;
+  if (!(mapping = CreateFileMapping(file, NULL, PAGE_READONLY,
+				    0, 0, NULL))) {
+    return;
+  }
+  if (!(base = MapViewOfFile(mapping, FILE_MAP_READ, 0, offset - delta,
+			     length + delta))) {
+    CloseHandle(mapping);
+    mapping = NULL;
+    return;
+  }
+  data = (const char *)base + delta;
+#elif !defined(ACORN) && !defined(MACOS) && !defined(VMS)
+  baseLength = 0;
+  if (fstat(fileno(f), &st) || !S_ISREG(st.st_mode) ||
+      st.st_size <= (off_t)offset) {
+    return;
+  }
+  length = (Guint)(st.st_size - (off_t)offset);
+  if ((off_t)length != st.st_size - (off_t)offset) {
+    length = 0xffffffff;
+  }
+  if (lengthA > 0 && lengthA < length) {
+    length = lengthA;
+  }
+  // mmap offsets have to be page aligned
+  pageSize = sysconf(_SC_PAGESIZE);
+  delta = pageSize > 0 ? offset % (Guint)pageSize : 0;
+  baseLength = (size_t)length + delta;
+  p = mmap(NULL, baseLength, PROT_READ, MAP_SHARED, fileno(f),
+	   (off_t)(offset - delta));
+  if (p == MAP_FAILED) {
+    length = 0;
+    return;
+  }
+  base = p;
+  data = (const char *)base + delta;
+#else
+  (void)f;
+  (void)offset;
+  (void)lengthA;
+#endif
+}
+
+GFileMap::~GFileMap() {
+  if (!base) {
+    return;
+  }
+#if defined(WIN32)
+  UnmapViewOfFile(base);
+  CloseHandle(mapping);
+#elif !defined(ACORN) && !defined(MACOS) && !defined(VMS)
+  munmap(base, baseLength);
+#endif
+}
+
 //------------------------------------------------------------------------
 // GDir and GDirEntry
 //------------------------------------------------------------------------
@@ -92,6 +92,38 @@ extern GBool executeCommand(const char *cmd);
 // conventions.
 extern char *getLine(char *buf, int size, FILE *f);
 
+//------------------------------------------------------------------------
+// GFileMap
+//------------------------------------------------------------------------
+
+// Read-only memory mapping of a part of an open file.
+class GFileMap {
+public:
+
+  // Map the contents of <f> from <offset> on.  If <length> is 0, the
+  // rest of the file is mapped, otherwise at most <length> bytes.
+  // Data written through <f> must be flushed before.
+  GFileMap(FILE *f, Guint offset, Guint length);
+  ~GFileMap();
+
+  // Was the mapping successful?
+  GBool isOk()const { return data != NULL; }
+
+  const char *getData()const { return data; }
+  Guint getLength()const { return length; }
+
+private:
+
+  const char *data;		// mapped data starting at <offset>
+  Guint length;			// length of the data
+  void *base;			// mapped region (page aligned)
+#if defined(WIN32)
+  HANDLE mapping;
+#else
+  size_t baseLength;		// length of the mapped region
+#endif
+};
+
 //------------------------------------------------------------------------
 // GDir and GDirEntry
 //------------------------------------------------------------------------
@@ -226,7 +226,10 @@ inline void Splash::pipeRun(SplashPipe *pipe) {
 
   // dynamic pattern
   if (pipe->pattern) {
-    pipe->pattern->getColor(pipe->x, pipe->y, pipe->cSrcVal);
+    if (!pipe->pattern->getColor(pipe->x, pipe->y, pipe->cSrcVal)) {
+      pipeIncX(pipe);
+      return;
+    }
   }
 
   if (pipe->noTransparency && !state->blendFunc) {
@@ -678,6 +681,11 @@ inline void Splash::drawSpan(SplashPipe *pipe, int x0, int x1, int y,
 			     GBool noClip) {
   int x;
 
+  if (pipe->pattern) {
+    drawPatternSpan(pipe, x0, x1, y, noClip);
+    return;
+  }
+
   pipeSetXY(pipe, x0, y);
   if (noClip) {
     for (x = x0; x <= x1; ++x) {
@@ -699,6 +707,43 @@ inline void Splash::drawSpan(SplashPipe *pipe, int x0, int x1, int y,
   }
 }
 
+// Draws a span with a dynamic pattern: the pattern colors for the
+// whole span are fetched in one getColorSpan() call and then fed to the
+// pipe as a fixed source color.
+void Splash::drawPatternSpan(SplashPipe *pipe, int x0, int x1, int y,
+			     GBool noClip) {
+  SplashPattern *pattern;
+  SplashColorPtr p;
+  Guchar *q;
+  GBool drawn;
+  int x;
+
+  if (x0 > x1) {
+    return;
+  }
+  pattern = pipe->pattern;
+  pattern->getColorSpan(x0, x1, y, spanColors, spanCovered);
+  pipe->pattern = NULL;
+  drawn = gFalse;
+  pipeSetXY(pipe, x0, y);
+  for (x = x0, p = spanColors, q = spanCovered; x <= x1;
+       ++x, p += splashMaxColorComps, ++q) {
+    if (*q && (noClip || state->clip->test(x, y))) {
+      pipe->cSrc = p;
+      pipeRun(pipe);
+      updateModX(x);
+      drawn = gTrue;
+    } else {
+      pipeIncX(pipe);
+    }
+  }
+  if (drawn) {
+    updateModY(y);
+  }
+  pipe->cSrc = pipe->cSrcVal;
+  pipe->pattern = pattern;
+}
+
 inline void Splash::drawAALine(SplashPipe *pipe, int x0, int x1, int y) {
 #if splashAASize == 4
   static int bitCount4[16] = { 0, 1, 1, 2, 1, 2, 2, 3,
@@ -788,6 +833,8 @@ Splash::Splash(SplashBitmap *bitmapA, GBool vectorAntialiasA,
   } else {
     aaBuf = NULL;
   }
+  spanColors = (SplashColorPtr)gmallocn(bitmap->width, splashMaxColorComps);
+  spanCovered = (Guchar *)gmalloc(bitmap->width);
   clearModRegion();
   debugMode = gFalse;
 }
@@ -811,6 +858,8 @@ Splash::Splash(SplashBitmap *bitmapA, GBool vectorAntialiasA,
   } else {
     aaBuf = NULL;
   }
+  spanColors = (SplashColorPtr)gmallocn(bitmap->width, splashMaxColorComps);
+  spanCovered = (Guchar *)gmalloc(bitmap->width);
   clearModRegion();
   debugMode = gFalse;
 }
@@ -823,6 +872,8 @@ Splash::~Splash() {
   if (vectorAntialias) {
     delete aaBuf;
   }
+  gfree(spanColors);
+  gfree(spanCovered);
 }
 
 //------------------------------------------------------------------------
@@ -1561,6 +1612,14 @@ SplashError Splash::fillWithPattern(SplashPath *path, GBool eo,
   return splashOk;
 }
 
+SplashError Splash::shadedFill(SplashPath *path, SplashPattern *pattern) {
+  if (debugMode) {
+    printf("shadedFill:\n");
+    dumpPath(path);
+  }
+  return fillWithPattern(path, gFalse, pattern, state->fillAlpha);
+}
+
 SplashError Splash::xorFill(SplashPath *path, GBool eo) {
   SplashPipe pipe;
   SplashXPath *xPath;
@@ -143,6 +143,10 @@ public:
   // Fill a path using the current fill pattern.
   SplashError fill(SplashPath *path, GBool eo);
 
+  // Fill a path using a shading <pattern> (instead of the current fill
+  // pattern).  Pixels not covered by the pattern are left untouched.
+  SplashError shadedFill(SplashPath *path, SplashPattern *pattern);
+
   // Fill a path, XORing with the current fill pattern.
   SplashError xorFill(SplashPath *path, GBool eo);
 
@@ -249,6 +253,8 @@ private:
   void drawAAPixelInit();
   void drawAAPixel(SplashPipe *pipe, int x, int y);
   void drawSpan(SplashPipe *pipe, int x0, int x1, int y, GBool noClip);
+  void drawPatternSpan(SplashPipe *pipe, int x0, int x1, int y,
+		       GBool noClip);
   void drawAALine(SplashPipe *pipe, int x0, int x1, int y);
   void transform(SplashCoord *matrix, SplashCoord xi, SplashCoord yi,
 		 SplashCoord *xo, SplashCoord *yo);
@@ -284,6 +290,8 @@ private:
 				//   bitmap containing the alpha0 values
   int alpha0X, alpha0Y;		// offset within alpha0Bitmap
   SplashCoord aaGamma[splashAASize * splashAASize + 1];
+  SplashColorPtr spanColors;	// pattern colors for drawPatternSpan
+  Guchar *spanCovered;		// pattern coverage for drawPatternSpan
   int modXMin, modYMin, modXMax, modYMax;
   SplashClipResult opClipRes;
   GBool vectorAntialias;
@@ -10,6 +10,9 @@
 #pragma implementation
 #endif
 
+#include <math.h>
+#include <string.h>
+#include "goo/gmem.h"
 #include "splash/SplashMath.h"
 #include "splash/SplashScreen.h"
 #include "splash/SplashPattern.h"
@@ -24,6 +27,16 @@ SplashPattern::SplashPattern() {
 SplashPattern::~SplashPattern() {
 }
 
+void SplashPattern::getColorSpan(int x0, int x1, int y, SplashColorPtr colors,
+				 Guchar *covered) {
+  int x;
+
+  for (x = x0; x <= x1; ++x) {
+    *covered++ = getColor(x, y, colors) ? 1 : 0;
+    colors += splashMaxColorComps;
+  }
+}
+
 //------------------------------------------------------------------------
 // SplashSolidColor
 //------------------------------------------------------------------------
@@ -35,6 +48,210 @@ SplashSolidColor::SplashSolidColor(SplashColorPtr colorA) {
 SplashSolidColor::~SplashSolidColor() {
 }
 
-void SplashSolidColor::getColor(int x, int y, SplashColorPtr c) {
+GBool SplashSolidColor::getColor(int x, int y, SplashColorPtr c) {
   splashColorCopy(c, color);
+  return gTrue;
+}
+
+//------------------------------------------------------------------------
+// SplashUnivariatePattern
+//------------------------------------------------------------------------
+
+SplashUnivariatePattern::SplashUnivariatePattern(SplashColorPtr lutA,
+						 int lutSizeA,
+						 GBool extend0A,
+						 GBool extend1A) {
+  lutSize = lutSizeA;
+  lut = (SplashColorPtr)gmallocn(lutSize, splashMaxColorComps);
+  memcpy(lut, lutA, lutSize * splashMaxColorComps);
+  extend0 = extend0A;
+  extend1 = extend1A;
+}
+
+SplashUnivariatePattern::~SplashUnivariatePattern() {
+  gfree(lut);
+}
+
+GBool SplashUnivariatePattern::getColor(int x, int y, SplashColorPtr c) {
+  double t;
+  int i;
+
+  // sample at the pixel center
+  if (!getParameter(x + 0.5, y + 0.5, &t)) {
+    return gFalse;
+  }
+  if (t < 0) {
+    if (!extend0) {
+      return gFalse;
+    }
+    i = 0;
+  } else if (t > 1) {
+    if (!extend1) {
+      return gFalse;
+    }
+    i = lutSize - 1;
+  } else {
+    i = (int)(t * (lutSize - 1) + 0.5);
+  }
+  splashColorCopy(c, lut + i * splashMaxColorComps);
+  return gTrue;
+}
+
+//------------------------------------------------------------------------
+// SplashAxialPattern
+//------------------------------------------------------------------------
+
+SplashAxialPattern::SplashAxialPattern(SplashColorPtr lutA, int lutSizeA,
+				       GBool extend0A, GBool extend1A,
+				       double txA, double tyA, double tcA):
+  SplashUnivariatePattern(lutA, lutSizeA, extend0A, extend1A)
+{
+  tx = txA;
+  ty = tyA;
+  tc = tcA;
+  idxBuf = NULL;
+  idxBufSize = 0;
+}
+
+SplashPattern *SplashAxialPattern::copy() {
+  return new SplashAxialPattern(lut, lutSize, extend0, extend1, tx, ty, tc);
+}
+
+SplashAxialPattern::~SplashAxialPattern() {
+  gfree(idxBuf);
+}
+
+GBool SplashAxialPattern::getParameter(double x, double y, double *t) {
+  *t = tx * x + ty * y + tc;
+  return gTrue;
+}
+
+void SplashAxialPattern::getColorSpan(int x0, int x1, int y,
+				      SplashColorPtr colors,
+				      Guchar *covered) {
+  double scale, u0, du;
+  int n, i, idx, last;
+
+  n = x1 - x0 + 1;
+  if (n <= 0) {
+    return;
+  }
+  if (n > idxBufSize) {
+    idxBuf = (int *)greallocn(idxBuf, n, sizeof(int));
+    idxBufSize = n;
+  }
+
+  // table position of the first pixel center and the per-pixel step;
+  // values outside the table are marked with -1 (before) and lutSize
+  // (after) so that the gather loop can apply the extend flags
+  scale = lutSize - 1;
+  u0 = (tx * (x0 + 0.5) + ty * (y + 0.5) + tc) * scale + 0.5;
+  du = tx * scale;
+  last = lutSize - 1;
+  for (i = 0; i < n; ++i) {
+    double u = u0 + i * du;
+    idxBuf[i] = u < 0 ? -1 : u >= lutSize ? lutSize : (int)u;
+  }
+
+  for (i = 0; i < n; ++i) {
+    idx = idxBuf[i];
+    if (idx < 0) {
+      if (!extend0) {
+	covered[i] = 0;
+	continue;
+      }
+      idx = 0;
+    } else if (idx > last) {
+      if (!extend1) {
+	covered[i] = 0;
+	continue;
+      }
+      idx = last;
+    }
+    covered[i] = 1;
+    splashColorCopy(colors + i * splashMaxColorComps,
+		    lut + idx * splashMaxColorComps);
+  }
+}
+
+//------------------------------------------------------------------------
+// SplashRadialPattern
+//------------------------------------------------------------------------
+
+SplashRadialPattern::SplashRadialPattern(SplashColorPtr lutA, int lutSizeA,
+					 GBool extend0A, GBool extend1A,
+					 double *matA,
+					 double x0A, double y0A, double r0A,
+					 double x1A, double y1A, double r1A):
+  SplashUnivariatePattern(lutA, lutSizeA, extend0A, extend1A)
+{
+  int i;
+
+  for (i = 0; i < 6; ++i) {
+    mat[i] = matA[i];
+  }
+  x0 = x0A;
+  y0 = y0A;
+  r0 = r0A;
+  x1 = x1A;
+  y1 = y1A;
+  r1 = r1A;
+  dx = x1 - x0;
+  dy = y1 - y0;
+  dr = r1 - r0;
+  a = dx * dx + dy * dy - dr * dr;
+}
+
+SplashPattern *SplashRadialPattern::copy() {
+  return new SplashRadialPattern(lut, lutSize, extend0, extend1, mat,
+				 x0, y0, r0, x1, y1, r1);
+}
+
+SplashRadialPattern::~SplashRadialPattern() {
+}
+
+GBool SplashRadialPattern::getParameter(double x, double y, double *t) {
+  double xs, ys, b, c, d, s, sA, sB;
+  int i;
+
+  // the point lies on the circle with center (x0 + s * dx, y0 + s *
+  // dy) and radius r0 + s * dr, where
+  //   a * s^2 - 2 * b * s + c = 0
+  // the larger valid root wins (circles are painted in order of
+  // increasing s)
+  xs = x * mat[0] + y * mat[2] + mat[4] - x0;
+  ys = x * mat[1] + y * mat[3] + mat[5] - y0;
+  b = xs * dx + ys * dy + r0 * dr;
+  c = xs * xs + ys * ys - r0 * r0;
+  if (fabs(a) < 1e-9) {
+    if (fabs(b) < 1e-9) {
+      return gFalse;
+    }
+    sA = sB = c / (2 * b);
+  } else {
+    d = b * b - a * c;
+    if (d < 0) {
+      return gFalse;
+    }
+    d = sqrt(d);
+    sA = (b + d) / a;
+    sB = (b - d) / a;
+    if (sA < sB) {
+      s = sA;
+      sA = sB;
+      sB = s;
+    }
+  }
+  for (i = 0; i < 2; ++i) {
+    s = i ? sB : sA;
+    if (r0 + s * dr < 0) {
+      continue;
+    }
+    if ((s < 0 && !extend0) || (s > 1 && !extend1)) {
+      continue;
+    }
+    *t = s;
+    return gTrue;
+  }
+  return gFalse;
 }
@@ -30,8 +30,16 @@ public:
 
   virtual ~SplashPattern();
 
-  // Return the color value for a specific pixel.
-  virtual void getColor(int x, int y, SplashColorPtr c) = 0;
+  // Return the color value for a specific pixel.  Returns false if
+  // the pattern doesn't cover the pixel (it is left untouched).
+  virtual GBool getColor(int x, int y, SplashColorPtr c) = 0;
+
+  // Return the color values for the pixels <x0>..<x1> of row <y>.
+  // Colors are stored with a stride of splashMaxColorComps bytes,
+  // <covered> gets a non-zero byte for each pixel the pattern covers.
+  // The default implementation calls getColor() for each pixel.
+  virtual void getColorSpan(int x0, int x1, int y, SplashColorPtr colors,
+			    Guchar *covered);
 
   // Returns true if this pattern object will return the same color
   // value for all pixels.
@@ -53,7 +61,7 @@ public:
 
   virtual ~SplashSolidColor();
 
-  virtual void getColor(int x, int y, SplashColorPtr c);
+  virtual GBool getColor(int x, int y, SplashColorPtr c);
 
   virtual GBool isStatic() { return gTrue; }
 
@@ -62,4 +70,99 @@ private:
   SplashColor color;
 };
 
+//------------------------------------------------------------------------
+// SplashUnivariatePattern
+//------------------------------------------------------------------------
+
+// Base class for shadings whose color depends on a single parameter t
+// in [0, 1].  Colors are taken from a precomputed lookup table which
+// the caller builds at device resolution.
+class SplashUnivariatePattern: public SplashPattern {
+public:
+
+  // <lutA> contains <lutSizeA> colors (splashMaxColorComps bytes
+  // each), evenly spaced over t = [0, 1]; it is copied.
+  SplashUnivariatePattern(SplashColorPtr lutA, int lutSizeA,
+			  GBool extend0A, GBool extend1A);
+
+  virtual ~SplashUnivariatePattern();
+
+  virtual GBool getColor(int x, int y, SplashColorPtr c);
+
+  virtual GBool isStatic() { return gFalse; }
+
+protected:
+
+  // Compute the shading parameter for the device space point (<x>,
+  // <y>).  Returns false if the point isn't covered by the shading.
+  virtual GBool getParameter(double x, double y, double *t) = 0;
+
+  SplashColorPtr lut;
+  int lutSize;
+  GBool extend0, extend1;
+};
+
+//------------------------------------------------------------------------
+// SplashAxialPattern
+//------------------------------------------------------------------------
+
+// Axial shading; t is an affine function of the device coordinates:
+// t = tx * x + ty * y + tc.
+class SplashAxialPattern: public SplashUnivariatePattern {
+public:
+
+  SplashAxialPattern(SplashColorPtr lutA, int lutSizeA,
+		     GBool extend0A, GBool extend1A,
+		     double txA, double tyA, double tcA);
+
+  virtual SplashPattern *copy();
+
+  virtual ~SplashAxialPattern();
+
+  // t changes linearly along a row, so whole spans are looked up in
+  // two tight loops (table index computation and color gather).
+  virtual void getColorSpan(int x0, int x1, int y, SplashColorPtr colors,
+			    Guchar *covered);
+
+protected:
+
+  virtual GBool getParameter(double x, double y, double *t);
+
+private:
+
+  double tx, ty, tc;
+  int *idxBuf;			// lookup table indexes for getColorSpan
+  int idxBufSize;
+};
+
+//------------------------------------------------------------------------
+// SplashRadialPattern
+//------------------------------------------------------------------------
+
+// Radial shading between circles (x0, y0, r0) and (x1, y1, r1), given
+// in shading space.  <mat> maps device space to shading space:
+//    [xs ys 1] = [x y 1] * mat
+class SplashRadialPattern: public SplashUnivariatePattern {
+public:
+
+  SplashRadialPattern(SplashColorPtr lutA, int lutSizeA,
+		      GBool extend0A, GBool extend1A, double *matA,
+		      double x0A, double y0A, double r0A,
+		      double x1A, double y1A, double r1A);
+
+  virtual SplashPattern *copy();
+
+  virtual ~SplashRadialPattern();
+
+protected:
+
+  virtual GBool getParameter(double x, double y, double *t);
+
+private:
+
+  double mat[6];
+  double x0, y0, r0, x1, y1, r1;
+  double dx, dy, dr, a;		// precomputed circle deltas
+};
+
 #endif
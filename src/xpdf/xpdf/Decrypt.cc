@@ -14,13 +14,39 @@
 
 #include <string.h>
 #include "goo/gmem.h"
+#include "goo/GString.h"
+#if MULTITHREADED
+#include "goo/GMutex.h"
+#endif
 #include "xpdf/Decrypt.h"
 
+// AES-NI is used when the compiler can generate it for a single
+// function and the CPU reports it at run time.
+#if !defined(DISABLE_AESNI) && \
+    (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || \
+     (defined(__GNUC__) && \
+      (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define HAVE_AESNI 1
+#include <cpuid.h>
+#include <wmmintrin.h>
+#define AESNI_FUNC __attribute__((target("aes,sse2")))
+#elif !defined(DISABLE_AESNI) && defined(_MSC_VER) && _MSC_VER >= 1600 && \
+      (defined(_M_X64) || defined(_M_IX86))
+#define HAVE_AESNI 1
+#include <intrin.h>
+#include <wmmintrin.h>
+#define AESNI_FUNC
+#endif
+
 static void rc4InitKey(Guchar *key, int keyLen, Guchar *state);
 static Guchar rc4DecryptByte(Guchar *state, Guchar *x, Guchar *y, Guchar c);
+static void rc4DecryptBlock(Guchar *state, Guchar *x, Guchar *y,
+			    Guchar *buf, int len);
 static void aesKeyExpansion(DecryptAESState *s,
 			    Guchar *objKey, int objKeyLen);
 static void aesDecryptBlock(DecryptAESState *s, Guchar *in, GBool last);
+static void aesDecryptBlocks(DecryptAESState *s, Guchar *buf, int nBlocks);
 static void md5(Guchar *msg, int msgLen, Guchar *digest);
 
 static Guchar passwordPad[32] = {
@@ -30,6 +56,102 @@ static Guchar passwordPad[32] = {
   0x2f, 0x0c, 0xa9, 0xfe, 0x64, 0x53, 0x69, 0x7a
 };
 
+//------------------------------------------------------------------------
+// file key cache
+//------------------------------------------------------------------------
+
+// Authorizing a document (and re-authorizing it after it is reopened)
+// runs the whole key derivation again.  Successful results are kept
+// in a small cache, indexed by an MD5 digest of all the inputs, so
+// the passwords themselves are never stored.
+
+#define fileKeyCacheSize 8
+
+struct FileKeyCacheEntry {
+  GBool valid;
+  Guchar digest[16];
+  Guchar fileKey[16];
+  GBool ownerPasswordOk;
+};
+
+static class FileKeyCache {
+public:
+
+  FileKeyCache() {
+    int i;
+
+    for (i = 0; i < fileKeyCacheSize; ++i) {
+      entries[i].valid = gFalse;
+    }
+    next = 0;
+#if MULTITHREADED
+    gInitMutex(&mutex);
+#endif
+  }
+
+  GBool lookup(Guchar *digest, Guchar *fileKey, int keyLength,
+	       GBool *ownerPasswordOk) {
+    GBool found;
+    int i;
+
+    found = gFalse;
+#if MULTITHREADED
+    gLockMutex(&mutex);
+#endif
+    for (i = 0; i < fileKeyCacheSize; ++i) {
+      if (entries[i].valid && !memcmp(entries[i].digest, digest, 16)) {
+	memcpy(fileKey, entries[i].fileKey, keyLength);
+	*ownerPasswordOk = entries[i].ownerPasswordOk;
+	found = gTrue;
+	break;
+      }
+    }
+#if MULTITHREADED
+    gUnlockMutex(&mutex);
+#endif
+    return found;
+  }
+
+  void add(Guchar *digest, Guchar *fileKey, int keyLength,
+	   GBool ownerPasswordOk) {
+#if MULTITHREADED
+    gLockMutex(&mutex);
+#endif
+    entries[next].valid = gTrue;
+    memcpy(entries[next].digest, digest, 16);
+    memcpy(entries[next].fileKey, fileKey, keyLength);
+    entries[next].ownerPasswordOk = ownerPasswordOk;
+    next = (next + 1) % fileKeyCacheSize;
+#if MULTITHREADED
+    gUnlockMutex(&mutex);
+#endif
+  }
+
+private:
+
+  FileKeyCacheEntry entries[fileKeyCacheSize];
+  int next;			// next entry to be replaced
+#if MULTITHREADED
+  GMutex mutex;
+#endif
+} fileKeyCache;
+
+static void appendKeyInput(GString *buf, const GString *s) {
+  int len;
+
+  if (!s) {
+    buf->append('\0');
+    return;
+  }
+  len = s->getLength();
+  buf->append('\1');
+  buf->append((char)(len & 0xff));
+  buf->append((char)((len >> 8) & 0xff));
+  buf->append((char)((len >> 16) & 0xff));
+  buf->append((char)((len >> 24) & 0xff));
+  buf->append(s->getCString(), len);
+}
+
 //------------------------------------------------------------------------
 // Decrypt
 //------------------------------------------------------------------------
@@ -40,6 +162,45 @@ GBool Decrypt::makeFileKey(int encVersion, int encRevision, int keyLength,
 			   GString *ownerPassword, GString *userPassword,
 			   Guchar *fileKey, GBool encryptMetadata,
 			   GBool *ownerPasswordOk) {
+  GString *keyInput;
+  Guchar digest[16];
+  GBool ok;
+
+  if (keyLength < 1 || keyLength > 16) {
+    return makeFileKey1(encVersion, encRevision, keyLength, ownerKey, userKey,
+			permissions, fileID, ownerPassword, userPassword,
+			fileKey, encryptMetadata, ownerPasswordOk);
+  }
+
+  keyInput = GString::format((char *)"{0:d} {1:d} {2:d} {3:d} {4:d} ",
+			     encVersion, encRevision, keyLength,
+			     permissions, encryptMetadata ? 1 : 0);
+  appendKeyInput(keyInput, ownerKey);
+  appendKeyInput(keyInput, userKey);
+  appendKeyInput(keyInput, fileID);
+  appendKeyInput(keyInput, ownerPassword);
+  appendKeyInput(keyInput, userPassword);
+  md5((Guchar *)keyInput->getCString(), keyInput->getLength(), digest);
+  delete keyInput;
+  if (fileKeyCache.lookup(digest, fileKey, keyLength, ownerPasswordOk)) {
+    return gTrue;
+  }
+
+  ok = makeFileKey1(encVersion, encRevision, keyLength, ownerKey, userKey,
+		    permissions, fileID, ownerPassword, userPassword,
+		    fileKey, encryptMetadata, ownerPasswordOk);
+  if (ok) {
+    fileKeyCache.add(digest, fileKey, keyLength, *ownerPasswordOk);
+  }
+  return ok;
+}
+
+GBool Decrypt::makeFileKey1(int encVersion, int encRevision, int keyLength,
+			    const GString *ownerKey, const GString *userKey,
+			    int permissions, GString *fileID,
+			    GString *ownerPassword, GString *userPassword,
+			    Guchar *fileKey, GBool encryptMetadata,
+			    GBool *ownerPasswordOk) {
   Guchar test[32], test2[32];
   GString *userPassword2;
   Guchar fState[256];
@@ -246,6 +407,7 @@ void DecryptStream::reset() {
   int i;
 
   str->reset();
+  resetInput();
   switch (algo) {
   case cryptRC4:
     state.rc4.x = state.rc4.y = 0;
@@ -255,7 +417,7 @@ void DecryptStream::reset() {
   case cryptAES:
     aesKeyExpansion(&state.aes, objKey, objKeyLength);
     for (i = 0; i < 16; ++i) {
-      state.aes.cbc[i] = str->getChar();
+      state.aes.cbc[i] = getInputChar();
     }
     state.aes.bufIdx = 16;
     break;
@@ -264,13 +426,13 @@ void DecryptStream::reset() {
 
 int DecryptStream::getChar() {
   Guchar in[16];
-  int c, i;
+  int c;
 
   c = EOF; // make gcc happy
   switch (algo) {
   case cryptRC4:
     if (state.rc4.buf == EOF) {
-      c = str->getChar();
+      c = getInputChar();
       if (c != EOF) {
 	state.rc4.buf = rc4DecryptByte(state.rc4.state, &state.rc4.x,
 				       &state.rc4.y, (Guchar)c);
@@ -281,13 +443,10 @@ int DecryptStream::getChar() {
     break;
   case cryptAES:
     if (state.aes.bufIdx == 16) {
-      for (i = 0; i < 16; ++i) {
-	if ((c = str->getChar()) == EOF) {
-	  return EOF;
-	}
-	in[i] = (Guchar)c;
+      if (getInputBlock((char *)in, 16) < 16) {
+	return EOF;
       }
-      aesDecryptBlock(&state.aes, in, str->lookChar() == EOF);
+      aesDecryptBlock(&state.aes, in, lookInputChar() == EOF);
     }
     if (state.aes.bufIdx == 16) {
       c = EOF;
@@ -301,13 +460,13 @@ int DecryptStream::getChar() {
 
 int DecryptStream::lookChar() {
   Guchar in[16];
-  int c, i;
+  int c;
 
   c = EOF; // make gcc happy
   switch (algo) {
   case cryptRC4:
     if (state.rc4.buf == EOF) {
-      c = str->getChar();
+      c = getInputChar();
       if (c != EOF) {
 	state.rc4.buf = rc4DecryptByte(state.rc4.state, &state.rc4.x,
 				       &state.rc4.y, (Guchar)c);
@@ -317,13 +476,10 @@ int DecryptStream::lookChar() {
     break;
   case cryptAES:
     if (state.aes.bufIdx == 16) {
-      for (i = 0; i < 16; ++i) {
-	if ((c = str->getChar()) == EOF) {
-	  return EOF;
-	}
-	in[i] = c;
+      if (getInputBlock((char *)in, 16) < 16) {
+	return EOF;
       }
-      aesDecryptBlock(&state.aes, in, str->lookChar() == EOF);
+      aesDecryptBlock(&state.aes, in, lookInputChar() == EOF);
     }
     if (state.aes.bufIdx == 16) {
       c = EOF;
@@ -335,6 +491,69 @@ int DecryptStream::lookChar() {
   return c;
 }
 
+int DecryptStream::getBlock(char *blk, int size) {
+  Guchar in[16];
+  GBool last;
+  int n, m;
+
+  n = 0;
+  switch (algo) {
+  case cryptRC4:
+    if (n < size && state.rc4.buf != EOF) {
+      blk[n++] = (char)state.rc4.buf;
+      state.rc4.buf = EOF;
+    }
+    // decrypt in place
+    m = getInputBlock(blk + n, size - n);
+    rc4DecryptBlock(state.rc4.state, &state.rc4.x, &state.rc4.y,
+		    (Guchar *)blk + n, m);
+    n += m;
+    break;
+  case cryptAES:
+    while (n < size) {
+      if (state.aes.bufIdx == 16 && size - n >= 16) {
+	// decrypt whole blocks in place, except for the last block of
+	// the stream which has to go through padding removal
+	m = getInputBlock(blk + n, (size - n) & ~15);
+	if (m < 16) {
+	  break;
+	}
+	// a truncated trailing block is dropped and the preceding block
+	// is not treated as padded, same as in getChar
+	last = !(m & 15) && lookInputChar() == EOF;
+	m &= ~15;
+	if (last) {
+	  m -= 16;
+	  memcpy(in, blk + n + m, 16);
+	}
+	aesDecryptBlocks(&state.aes, (Guchar *)blk + n, m / 16);
+	n += m;
+	if (!last) {
+	  continue;
+	}
+	aesDecryptBlock(&state.aes, in, gTrue);
+      } else if (state.aes.bufIdx == 16) {
+	if (getInputBlock((char *)in, 16) < 16) {
+	  break;
+	}
+	aesDecryptBlock(&state.aes, in, lookInputChar() == EOF);
+	if (state.aes.bufIdx == 16) {
+	  break;
+	}
+      }
+      m = 16 - state.aes.bufIdx;
+      if (m > size - n) {
+	m = size - n;
+      }
+      memcpy(blk + n, state.aes.buf + state.aes.bufIdx, m);
+      state.aes.bufIdx += m;
+      n += m;
+    }
+    break;
+  }
+  return n;
+}
+
 GBool DecryptStream::isBinary(GBool last)const {
   return str->isBinary(last);
 }
@@ -372,6 +591,26 @@ static Guchar rc4DecryptByte(Guchar *state, Guchar *x, Guchar *y, Guchar c) {
   return c ^ state[(tx + ty) % 256];
 }
 
+static void rc4DecryptBlock(Guchar *state, Guchar *x, Guchar *y,
+			    Guchar *buf, int len) {
+  Guchar x1, y1, tx, ty;
+  int i;
+
+  x1 = *x;
+  y1 = *y;
+  for (i = 0; i < len; ++i) {
+    x1 = (x1 + 1) & 0xff;
+    tx = state[x1];
+    y1 = (y1 + tx) & 0xff;
+    ty = state[y1];
+    state[x1] = ty;
+    state[y1] = tx;
+    buf[i] ^= state[(tx + ty) & 0xff];
+  }
+  *x = x1;
+  *y = y1;
+}
+
 //------------------------------------------------------------------------
 // AES decryption
 //------------------------------------------------------------------------
@@ -439,37 +678,6 @@ static inline Guint rotWord(Guint x) {
   return ((x << 8) & 0xffffffff) | (x >> 24);
 }
 
-static inline void invSubBytes(Guchar *state) {
-  int i;
-
-  for (i = 0; i < 16; ++i) {
-    state[i] = invSbox[state[i]];
-  }
-}
-
-static inline void invShiftRows(Guchar *state) {
-  Guchar t;
-
-  t = state[7];
-  state[7] = state[6];
-  state[6] = state[5];
-  state[5] = state[4];
-  state[4] = t;
-
-  t = state[8];
-  state[8] = state[10];
-  state[10] = t;
-  t = state[9];
-  state[9] = state[11];
-  state[11] = t;
-
-  t = state[12];
-  state[12] = state[13];
-  state[13] = state[14];
-  state[14] = state[15];
-  state[15] = t;
-}
-
 // {09} \cdot s
 static inline Guchar mul09(Guchar s) {
   Guchar s2, s4, s8;
@@ -510,22 +718,6 @@ static inline Guchar mul0e(Guchar s) {
   return s2 ^ s4 ^ s8;
 }
 
-static inline void invMixColumns(Guchar *state) {
-  int c;
-  Guchar s0, s1, s2, s3;
-
-  for (c = 0; c < 4; ++c) {
-    s0 = state[c];
-    s1 = state[4+c];
-    s2 = state[8+c];
-    s3 = state[12+c];
-    state[c] =    mul0e(s0) ^ mul0b(s1) ^ mul0d(s2) ^ mul09(s3);
-    state[4+c] =  mul09(s0) ^ mul0e(s1) ^ mul0b(s2) ^ mul0d(s3);
-    state[8+c] =  mul0d(s0) ^ mul09(s1) ^ mul0e(s2) ^ mul0b(s3);
-    state[12+c] = mul0b(s0) ^ mul0d(s1) ^ mul09(s2) ^ mul0e(s3);
-  }
-}
-
 static inline void invMixColumnsW(Guint *w) {
   int c;
   Guchar s0, s1, s2, s3;
@@ -542,17 +734,51 @@ static inline void invMixColumnsW(Guint *w) {
   }
 }
 
-static inline void addRoundKey(Guchar *state, Guint *w) {
-  int c;
+// Decryption tables: td[0][x] is InvMixColumns applied to the column
+// (invSbox[x], 0, 0, 0), td[1..3] are the same columns rotated by one
+// byte each, so that one round is 16 lookups and XORs.
+static Guint td[4][256];
 
-  for (c = 0; c < 4; ++c) {
-    state[c] ^= w[c] >> 24;
-    state[4+c] ^= w[c] >> 16;
-    state[8+c] ^= w[c] >> 8;
-    state[12+c] ^= w[c];
+static GBool aesInitTables() {
+  Guchar x;
+  Guint t;
+  int i;
+
+  for (i = 0; i < 256; ++i) {
+    x = invSbox[i];
+    t = (mul0e(x) << 24) | (mul09(x) << 16) | (mul0d(x) << 8) | mul0b(x);
+    td[0][i] = t;
+    td[1][i] = (t >> 8) | (t << 24);
+    td[2][i] = (t >> 16) | (t << 16);
+    td[3][i] = (t >> 24) | (t << 8);
   }
+  return gTrue;
 }
 
+static GBool aesTablesOk = aesInitTables();
+
+#if HAVE_AESNI
+
+static GBool aesniCheck() {
+#ifdef _MSC_VER
+  int regs[4];
+
+  __cpuid(regs, 1);
+  return (regs[2] >> 25) & 1;
+#else
+  unsigned int eax, ebx, ecx, edx;
+
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+    return gFalse;
+  }
+  return (ecx >> 25) & 1;
+#endif
+}
+
+static GBool aesniOk = aesniCheck();
+
+#endif
+
 static void aesKeyExpansion(DecryptAESState *s,
 			    Guchar *objKey, int objKeyLen) {
   Guint temp;
@@ -574,52 +800,160 @@ static void aesKeyExpansion(DecryptAESState *s,
   for (round = 1; round <= 9; ++round) {
     invMixColumnsW(&s->w[round * 4]);
   }
+  for (i = 0; i < 44; ++i) {
+    s->rk[4*i] = (Guchar)(s->w[i] >> 24);
+    s->rk[4*i+1] = (Guchar)(s->w[i] >> 16);
+    s->rk[4*i+2] = (Guchar)(s->w[i] >> 8);
+    s->rk[4*i+3] = (Guchar)s->w[i];
+  }
 }
 
-static void aesDecryptBlock(DecryptAESState *s, Guchar *in, GBool last) {
-  int c, round, n, i;
+#if HAVE_AESNI
 
-  // initial state
-  for (c = 0; c < 4; ++c) {
-    s->state[c] = in[4*c];
-    s->state[4+c] = in[4*c+1];
-    s->state[8+c] = in[4*c+2];
-    s->state[12+c] = in[4*c+3];
+// The round keys are already in the form of the equivalent inverse
+// cipher, which is what AESDEC expects.
+AESNI_FUNC static void aesniDecryptBlocks(DecryptAESState *s,
+					  Guchar *buf, int nBlocks) {
+  __m128i k[11];
+  __m128i cbc, in0, in1, in2, in3, x0, x1, x2, x3;
+  int i, round;
+
+  for (round = 0; round <= 10; ++round) {
+    k[round] = _mm_loadu_si128((__m128i *)(s->rk + 16 * round));
+  }
+  cbc = _mm_loadu_si128((__m128i *)s->cbc);
+  i = 0;
+
+  // CBC decryption is parallel - four blocks are in flight at once
+  for (; i + 4 <= nBlocks; i += 4) {
+    in0 = _mm_loadu_si128((__m128i *)(buf + 16 * i));
+    in1 = _mm_loadu_si128((__m128i *)(buf + 16 * i + 16));
+    in2 = _mm_loadu_si128((__m128i *)(buf + 16 * i + 32));
+    in3 = _mm_loadu_si128((__m128i *)(buf + 16 * i + 48));
+    x0 = _mm_xor_si128(in0, k[10]);
+    x1 = _mm_xor_si128(in1, k[10]);
+    x2 = _mm_xor_si128(in2, k[10]);
+    x3 = _mm_xor_si128(in3, k[10]);
+    for (round = 9; round >= 1; --round) {
+      x0 = _mm_aesdec_si128(x0, k[round]);
+      x1 = _mm_aesdec_si128(x1, k[round]);
+      x2 = _mm_aesdec_si128(x2, k[round]);
+      x3 = _mm_aesdec_si128(x3, k[round]);
+    }
+    x0 = _mm_aesdeclast_si128(x0, k[0]);
+    x1 = _mm_aesdeclast_si128(x1, k[0]);
+    x2 = _mm_aesdeclast_si128(x2, k[0]);
+    x3 = _mm_aesdeclast_si128(x3, k[0]);
+    _mm_storeu_si128((__m128i *)(buf + 16 * i), _mm_xor_si128(x0, cbc));
+    _mm_storeu_si128((__m128i *)(buf + 16 * i + 16), _mm_xor_si128(x1, in0));
+    _mm_storeu_si128((__m128i *)(buf + 16 * i + 32), _mm_xor_si128(x2, in1));
+    _mm_storeu_si128((__m128i *)(buf + 16 * i + 48), _mm_xor_si128(x3, in2));
+    cbc = in3;
+  }
+  for (; i < nBlocks; ++i) {
+    in0 = _mm_loadu_si128((__m128i *)(buf + 16 * i));
+    x0 = _mm_xor_si128(in0, k[10]);
+    for (round = 9; round >= 1; --round) {
+      x0 = _mm_aesdec_si128(x0, k[round]);
+    }
+    x0 = _mm_aesdeclast_si128(x0, k[0]);
+    _mm_storeu_si128((__m128i *)(buf + 16 * i), _mm_xor_si128(x0, cbc));
+    cbc = in0;
   }
+  _mm_storeu_si128((__m128i *)s->cbc, cbc);
+}
 
-  // round 0
-  addRoundKey(s->state, &s->w[10 * 4]);
+#endif
 
-  // rounds 1-9
-  for (round = 9; round >= 1; --round) {
-    invSubBytes(s->state);
-    invShiftRows(s->state);
-    invMixColumns(s->state);
-    addRoundKey(s->state, &s->w[round * 4]);
+// Decrypt <nBlocks> 16-byte blocks in place (CBC mode, chained through
+// s->cbc).  Padding is not touched.
+static void aesDecryptBlocks(DecryptAESState *s, Guchar *buf, int nBlocks) {
+  Guchar in[16];
+  Guint s0, s1, s2, s3, t0, t1, t2, t3;
+  Guint *w;
+  int i, j, round;
+
+#if HAVE_AESNI
+  if (aesniOk) {
+    aesniDecryptBlocks(s, buf, nBlocks);
+    return;
   }
+#endif
 
-  // round 10
-  invSubBytes(s->state);
-  invShiftRows(s->state);
-  addRoundKey(s->state, &s->w[0]);
+  w = s->w;
+  for (i = 0; i < nBlocks; ++i, buf += 16) {
+    memcpy(in, buf, 16);
+
+    // round 0
+    s0 = ((in[0] << 24) | (in[1] << 16) | (in[2] << 8) | in[3]) ^ w[40];
+    s1 = ((in[4] << 24) | (in[5] << 16) | (in[6] << 8) | in[7]) ^ w[41];
+    s2 = ((in[8] << 24) | (in[9] << 16) | (in[10] << 8) | in[11]) ^ w[42];
+    s3 = ((in[12] << 24) | (in[13] << 16) | (in[14] << 8) | in[15]) ^ w[43];
+
+    // rounds 1-9
+    for (round = 9; round >= 1; --round) {
+      t0 = td[0][s0 >> 24] ^ td[1][(s3 >> 16) & 0xff] ^
+	   td[2][(s2 >> 8) & 0xff] ^ td[3][s1 & 0xff] ^ w[round * 4];
+      t1 = td[0][s1 >> 24] ^ td[1][(s0 >> 16) & 0xff] ^
+	   td[2][(s3 >> 8) & 0xff] ^ td[3][s2 & 0xff] ^ w[round * 4 + 1];
+      t2 = td[0][s2 >> 24] ^ td[1][(s1 >> 16) & 0xff] ^
+	   td[2][(s0 >> 8) & 0xff] ^ td[3][s3 & 0xff] ^ w[round * 4 + 2];
+      t3 = td[0][s3 >> 24] ^ td[1][(s2 >> 16) & 0xff] ^
+	   td[2][(s1 >> 8) & 0xff] ^ td[3][s0 & 0xff] ^ w[round * 4 + 3];
+      s0 = t0;
+      s1 = t1;
+      s2 = t2;
+      s3 = t3;
+    }
 
-  // CBC
-  for (c = 0; c < 4; ++c) {
-    s->buf[4*c] = s->state[c] ^ s->cbc[4*c];
-    s->buf[4*c+1] = s->state[4+c] ^ s->cbc[4*c+1];
-    s->buf[4*c+2] = s->state[8+c] ^ s->cbc[4*c+2];
-    s->buf[4*c+3] = s->state[12+c] ^ s->cbc[4*c+3];
+    // round 10
+    t0 = ((invSbox[s0 >> 24] << 24) | (invSbox[(s3 >> 16) & 0xff] << 16) |
+	  (invSbox[(s2 >> 8) & 0xff] << 8) | invSbox[s1 & 0xff]) ^ w[0];
+    t1 = ((invSbox[s1 >> 24] << 24) | (invSbox[(s0 >> 16) & 0xff] << 16) |
+	  (invSbox[(s3 >> 8) & 0xff] << 8) | invSbox[s2 & 0xff]) ^ w[1];
+    t2 = ((invSbox[s2 >> 24] << 24) | (invSbox[(s1 >> 16) & 0xff] << 16) |
+	  (invSbox[(s0 >> 8) & 0xff] << 8) | invSbox[s3 & 0xff]) ^ w[2];
+    t3 = ((invSbox[s3 >> 24] << 24) | (invSbox[(s2 >> 16) & 0xff] << 16) |
+	  (invSbox[(s1 >> 8) & 0xff] << 8) | invSbox[s0 & 0xff]) ^ w[3];
+
+    // CBC
+    buf[0] = (Guchar)(t0 >> 24) ^ s->cbc[0];
+    buf[1] = (Guchar)(t0 >> 16) ^ s->cbc[1];
+    buf[2] = (Guchar)(t0 >> 8) ^ s->cbc[2];
+    buf[3] = (Guchar)t0 ^ s->cbc[3];
+    buf[4] = (Guchar)(t1 >> 24) ^ s->cbc[4];
+    buf[5] = (Guchar)(t1 >> 16) ^ s->cbc[5];
+    buf[6] = (Guchar)(t1 >> 8) ^ s->cbc[6];
+    buf[7] = (Guchar)t1 ^ s->cbc[7];
+    buf[8] = (Guchar)(t2 >> 24) ^ s->cbc[8];
+    buf[9] = (Guchar)(t2 >> 16) ^ s->cbc[9];
+    buf[10] = (Guchar)(t2 >> 8) ^ s->cbc[10];
+    buf[11] = (Guchar)t2 ^ s->cbc[11];
+    buf[12] = (Guchar)(t3 >> 24) ^ s->cbc[12];
+    buf[13] = (Guchar)(t3 >> 16) ^ s->cbc[13];
+    buf[14] = (Guchar)(t3 >> 8) ^ s->cbc[14];
+    buf[15] = (Guchar)t3 ^ s->cbc[15];
+
+    // save the input block for the next CBC
+    for (j = 0; j < 16; ++j) {
+      s->cbc[j] = in[j];
+    }
   }
+}
 
-  // save the input block for the next CBC
-  for (i = 0; i < 16; ++i) {
-    s->cbc[i] = in[i];
-  }
+static void aesDecryptBlock(DecryptAESState *s, Guchar *in, GBool last) {
+  int n, i;
+
+  memcpy(s->buf, in, 16);
+  aesDecryptBlocks(s, s->buf, 1);
 
   // remove padding
   s->bufIdx = 0;
   if (last) {
     n = s->buf[15];
+    if (n > 16) { // invalid padding - keep the whole block
+      n = 0;
+    }
     for (i = 15; i >= n; --i) {
       s->buf[i] = s->buf[i-n];
     }
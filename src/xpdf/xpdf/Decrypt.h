@@ -37,7 +37,9 @@ public:
   // least 16 bytes.  Checks <ownerPassword> and then <userPassword>
   // and returns true if either is correct.  Sets <ownerPasswordOk> if
   // the owner password was correct.  Either or both of the passwords
-  // may be NULL, which is treated as an empty string.
+  // may be NULL, which is treated as an empty string.  Successfully
+  // generated keys are cached, so authorizing the same document again
+  // doesn't repeat the key derivation.
   static GBool makeFileKey(int encVersion, int encRevision, int keyLength,
 			   const GString *ownerKey, const GString *userKey,
 			   int permissions, GString *fileID,
@@ -47,6 +49,12 @@ public:
 
 private:
 
+  static GBool makeFileKey1(int encVersion, int encRevision, int keyLength,
+			    const GString *ownerKey, const GString *userKey,
+			    int permissions, GString *fileID,
+			    GString *ownerPassword, GString *userPassword,
+			    Guchar *fileKey, GBool encryptMetadata,
+			    GBool *ownerPasswordOk);
   static GBool makeFileKey2(int encVersion, int encRevision, int keyLength,
 			    const GString *ownerKey, const GString *userKey,
 			    int permissions, GString *fileID,
@@ -65,8 +73,8 @@ struct DecryptRC4State {
 };
 
 struct DecryptAESState {
-  Guint w[44];
-  Guchar state[16];
+  Guint w[44];			// decryption round keys
+  Guchar rk[11 * 16];		// w as bytes (used by AES-NI)
   Guchar cbc[16];
   Guchar buf[16];
   int bufIdx;
@@ -92,6 +100,7 @@ public:
   virtual void reset();
   virtual int getChar();
   virtual int lookChar();
+  virtual int getBlock(char *blk, int size);
   virtual GBool isBinary(GBool last)const;
   virtual Stream *getUndecodedStream() { return this; }
   virtual Stream *clone();
@@ -150,6 +150,15 @@ GBool Function::init(const Dict *dict) {
   return gFalse;
 }
 
+void Function::transformBatch(const double *in, double *out,
+			      int count)const {
+  int i;
+
+  for (i = 0; i < count; ++i) {
+    transform(in + i * m, out + i * n);
+  }
+}
+
 //------------------------------------------------------------------------
 // IdentityFunction
 //------------------------------------------------------------------------
@@ -375,6 +384,13 @@ void SampledFunction::transform(const double *in, double *out)const {
   double efrac1[funcMaxInputs];
   int i, j, k, idx, t;
 
+  // single input functions (the usual shading case) don't need the
+  // generic m-linear interpolation
+  if (m == 1 && sampleSize[0] > 0) {
+    transform1(in[0], out);
+    return;
+  }
+
   // map input values into sample array
   for (i = 0; i < m; ++i) {
     x = (in[i] - domain[i][0]) * inputMul[i] + encode[i][0];
@@ -425,6 +441,52 @@ void SampledFunction::transform(const double *in, double *out)const {
   }
 }
 
+void SampledFunction::transform1(double in, double *out)const {
+  double x, efrac0, efrac1, y;
+  const double *s0, *s1;
+  int e0, e1, i;
+
+  x = (in - domain[0][0]) * inputMul[0] + encode[0][0];
+  if (x < 0) {
+    x = 0;
+  } else if (x > sampleSize[0] - 1) {
+    x = sampleSize[0] - 1;
+  }
+  e0 = (int)x;
+  if ((e1 = e0 + 1) >= sampleSize[0]) {
+    e1 = e0;
+  }
+  efrac1 = x - e0;
+  efrac0 = 1 - efrac1;
+
+  // idxMul[0] == n, so the two tuples are contiguous runs of n samples
+  s0 = samples + e0 * n;
+  s1 = samples + e1 * n;
+  for (i = 0; i < n; ++i) {
+    y = (efrac0 * s0[i] + efrac1 * s1[i]) * (decode[i][1] - decode[i][0]) +
+        decode[i][0];
+    if (y < range[i][0]) {
+      y = range[i][0];
+    } else if (y > range[i][1]) {
+      y = range[i][1];
+    }
+    out[i] = y;
+  }
+}
+
+void SampledFunction::transformBatch(const double *in, double *out,
+				     int count)const {
+  int i;
+
+  if (m != 1 || sampleSize[0] <= 0) {
+    Function::transformBatch(in, out, count);
+    return;
+  }
+  for (i = 0; i < count; ++i) {
+    transform1(in[i], out + i * n);
+  }
+}
+
 //------------------------------------------------------------------------
 // ExponentialFunction
 //------------------------------------------------------------------------
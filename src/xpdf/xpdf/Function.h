@@ -67,6 +67,12 @@ public:
   // Transform an input tuple into an output tuple.
   virtual void transform(const double *in, double *out)const = 0;
 
+  // Transform <count> input tuples (packed, m values each) into
+  // <count> output tuples (packed, n values each).  The default
+  // implementation calls transform() for each tuple.
+  virtual void transformBatch(const double *in, double *out,
+			      int count)const;
+
   virtual GBool isOk()const = 0;
 
 protected:
@@ -108,6 +114,8 @@ public:
   virtual Function *copy()const { return new SampledFunction(this); }
   virtual int getType()const { return 0; }
   virtual void transform(const double *in, double *out)const;
+  virtual void transformBatch(const double *in, double *out,
+			      int count)const;
   virtual GBool isOk()const { return ok; }
 
   int getSampleSize(int i) { return sampleSize[i]; }
@@ -121,6 +129,9 @@ private:
 
   SampledFunction(const SampledFunction *func);
 
+  // Single input function evaluation (linear interpolation only).
+  void transform1(double in, double *out)const;
+
   int				// number of samples for each domain element
     sampleSize[funcMaxInputs];
   double			// min and max values for domain encoder
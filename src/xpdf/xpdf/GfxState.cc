@@ -1597,6 +1597,37 @@ GfxPattern *GfxShadingPattern::copy()const {
   return new GfxShadingPattern(shading->copy(), matrix);
 }
 
+// Evaluates a set of shading functions for a batch of parameter
+// values.  There can be one function with n outputs or n functions
+// with one output each (where n = number of color components).
+static void getShadingColors(Function * const *funcs, int nFuncs,
+			     const double *t, GfxColor *colors, int count) {
+  double *out;
+  int nOut, i, j, k;
+
+  for (k = 0; k < count; ++k) {
+    for (i = 0; i < gfxColorMaxComps; ++i) {
+      colors[k].c[i] = 0;
+    }
+  }
+  for (i = 0; i < nFuncs; ++i) {
+    nOut = funcs[i]->getOutputSize();
+    if (i + nOut > gfxColorMaxComps) {
+      nOut = gfxColorMaxComps - i;
+    }
+    out = (double *)gmallocn(count, funcs[i]->getOutputSize() *
+			     sizeof(double));
+    funcs[i]->transformBatch(t, out, count);
+    for (k = 0; k < count; ++k) {
+      for (j = 0; j < nOut; ++j) {
+	colors[k].c[i + j] =
+	    dblToCol(out[k * funcs[i]->getOutputSize() + j]);
+      }
+    }
+    gfree(out);
+  }
+}
+
 //------------------------------------------------------------------------
 // GfxShading
 //------------------------------------------------------------------------
@@ -2069,6 +2100,11 @@ void GfxAxialShading::getColor(double t, GfxColor *color)const {
   }
 }
 
+void GfxAxialShading::getColors(const double *t, GfxColor *colors,
+				int count)const {
+  getShadingColors(funcs, nFuncs, t, colors, count);
+}
+
 //------------------------------------------------------------------------
 // GfxRadialShading
 //------------------------------------------------------------------------
@@ -2237,6 +2273,11 @@ void GfxRadialShading::getColor(double t, GfxColor *color)const {
   }
 }
 
+void GfxRadialShading::getColors(const double *t, GfxColor *colors,
+				 int count)const {
+  getShadingColors(funcs, nFuncs, t, colors, count);
+}
+
 //------------------------------------------------------------------------
 // GfxShadingBitBuf
 //------------------------------------------------------------------------
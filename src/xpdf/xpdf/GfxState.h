@@ -722,6 +722,9 @@ public:
   int getNFuncs()const { return nFuncs; }
   Function *getFunc(int i)const { return funcs[i]; }
   void getColor(double t, GfxColor *color)const;
+  // Evaluate the shading functions for <count> parameter values at
+  // once (e.g., to build a color lookup table).
+  void getColors(const double *t, GfxColor *colors, int count)const;
 
 private:
 
@@ -761,6 +764,9 @@ public:
   int getNFuncs()const { return nFuncs; }
   Function *getFunc(int i)const { return funcs[i]; }
   void getColor(double t, GfxColor *color)const;
+  // Evaluate the shading functions for <count> parameter values at
+  // once (e.g., to build a color lookup table).
+  void getColors(const double *t, GfxColor *colors, int count)const;
 
 private:
 
@@ -712,6 +712,8 @@ GlobalParams::GlobalParams(const char *cfgFileName) {
   screenGamma = 1.0;
   screenBlackThreshold = 0.0;
   screenWhiteThreshold = 1.0;
+  dctFastDecode = gTrue;
+  decodeThreads = 0;
   urlCommand = NULL;
   movieCommand = NULL;
   mapNumericCharNames = gTrue;
@@ -1108,6 +1110,10 @@ void GlobalParams::parseLine(const char *buf, const GString *fileName, int line)
     } else if (!cmd->cmp("screenWhiteThreshold")) {
       parseFloat("screenWhiteThreshold", &screenWhiteThreshold,
 		 tokens, fileName, line);
+    } else if (!cmd->cmp("dctFastDecode")) {
+      parseYesNo("dctFastDecode", &dctFastDecode, tokens, fileName, line);
+    } else if (!cmd->cmp("decodeThreads")) {
+      parseInteger("decodeThreads", &decodeThreads, tokens, fileName, line);
     } else if (!cmd->cmp("urlCommand")) {
       parseCommand("urlCommand", &urlCommand, tokens, fileName, line);
     } else if (!cmd->cmp("movieCommand")) {
@@ -2450,6 +2456,24 @@ double GlobalParams::getScreenWhiteThreshold()const {
   return thresh;
 }
 
+GBool GlobalParams::getDCTFastDecode()const {
+  GBool f;
+
+  lockGlobalParams;
+  f = dctFastDecode;
+  unlockGlobalParams;
+  return f;
+}
+
+int GlobalParams::getDecodeThreads()const {
+  int n;
+
+  lockGlobalParams;
+  n = decodeThreads;
+  unlockGlobalParams;
+  return n;
+}
+
 GBool GlobalParams::getMapNumericCharNames()const {
   GBool map;
 
@@ -2855,6 +2879,21 @@ void GlobalParams::setScreenWhiteThreshold(double thresh) {
   unlockGlobalParams;
 }
 
+GBool GlobalParams::setDCTFastDecode(const char *s) {
+  GBool ok;
+
+  lockGlobalParams;
+  ok = parseYesNo2(s, &dctFastDecode);
+  unlockGlobalParams;
+  return ok;
+}
+
+void GlobalParams::setDecodeThreads(int n) {
+  lockGlobalParams;
+  decodeThreads = n;
+  unlockGlobalParams;
+}
+
 void GlobalParams::setMapNumericCharNames(GBool map) {
   lockGlobalParams;
   mapNumericCharNames = map;
@@ -260,6 +260,8 @@ public:
   double getScreenGamma()const;
   double getScreenBlackThreshold()const;
   double getScreenWhiteThreshold()const;
+  GBool getDCTFastDecode()const;
+  int getDecodeThreads()const;
   const GString *getURLCommand()const { return urlCommand; }
   const GString *getMovieCommand() { return movieCommand; }
   GBool getMapNumericCharNames()const;
@@ -311,6 +313,8 @@ public:
   void setScreenGamma(double gamma);
   void setScreenBlackThreshold(double thresh);
   void setScreenWhiteThreshold(double thresh);
+  GBool setDCTFastDecode(const char *s);
+  void setDecodeThreads(int n);
   void setMapNumericCharNames(GBool map);
   void setMapUnknownCharNames(GBool map);
   void setPrintCommands(GBool printCommandsA);
@@ -442,6 +446,9 @@ private:
   double screenGamma;		// screen gamma correction
   double screenBlackThreshold;	// screen black clamping threshold
   double screenWhiteThreshold;	// screen white clamping threshold
+  GBool dctFastDecode;		// use the buffered/parallel DCT decoder
+  int decodeThreads;		// max number of image decoder threads
+				//   (0 = one per processor)
   GString *urlCommand;		// command executed for URL links
   GString *movieCommand;	// command executed for movie annotations
   GBool mapNumericCharNames;	// map numeric char names (from font subsets)?
@@ -27,6 +27,16 @@
 static int contextSize[4] = { 16, 13, 10, 10 };
 static int refContextSize[2] = { 13, 10 };
 
+// nominal AT pixel positions for the generic region templates (these
+// are the positions handled by JBIG2Stream::readGenericRow())
+static int genericNominalATX[4][4] = {
+  { 3, -3,  2, -2 }, { 3, 0, 0, 0 }, { 2, 0, 0, 0 }, { 2, 0, 0, 0 }
+};
+static int genericNominalATY[4][4] = {
+  { -1, -1, -2, -2 }, { -1, 0, 0, 0 }, { -1, 0, 0, 0 }, { -1, 0, 0, 0 }
+};
+static int genericNumAT[4] = { 4, 1, 1, 1 };
+
 //------------------------------------------------------------------------
 // JBIG2HuffmanTable
 //------------------------------------------------------------------------
@@ -669,6 +679,7 @@ public:
   void duplicateRow(int yDest, int ySrc);
   void combine(JBIG2Bitmap *bitmap, int x, int y, Guint combOp);
   Guchar *getDataPtr() { return data; }
+  int getLineSize() { return line; }
   int getDataSize() { return h * line; }
 
 private:
@@ -932,7 +943,39 @@ void JBIG2Bitmap::combine(JBIG2Bitmap *bitmap, int x, int y,
 	xx = x0;
       }
 
-      // middle bytes
+      // middle bytes -- four at a time, as big-endian 32-bit words
+      for (; xx < x1 - 32; xx += 32) {
+	src0 = src1;
+	src1 = (srcPtr[0] << 24) | (srcPtr[1] << 16) |
+	       (srcPtr[2] << 8) | srcPtr[3];
+	srcPtr += 4;
+	src = (src1 >> s1) | ((src0 << 24) << s2);
+	src1 &= 0xff;
+	dest = (destPtr[0] << 24) | (destPtr[1] << 16) |
+	       (destPtr[2] << 8) | destPtr[3];
+	switch (combOp) {
+	case 0: // or
+	  dest |= src;
+	  break;
+	case 1: // and
+	  dest &= src;
+	  break;
+	case 2: // xor
+	  dest ^= src;
+	  break;
+	case 3: // xnor
+	  dest ^= ~src;
+	  break;
+	case 4: // replace
+	  dest = src;
+	  break;
+	}
+	destPtr[0] = (Guchar)(dest >> 24);
+	destPtr[1] = (Guchar)(dest >> 16);
+	destPtr[2] = (Guchar)(dest >> 8);
+	destPtr[3] = (Guchar)dest;
+	destPtr += 4;
+      }
       for (; xx < x1 - 8; xx += 8) {
 	dest = *destPtr;
 	src0 = src1;
@@ -1188,6 +1231,19 @@ Stream * JBIG2Stream::clone()
     Stream * str = globalsStream.getStream();
     if (str->getPos())
       error(-1, "globalStream is not in initial state when cloning JBIG2Stream");
+
+    // globals stream may be read from a private stream view which doesn't
+    // outlive this stream (see XRef::fetchFrom), so it is cloned too
+    Object * cloneGlobals=globalsStream.clone();
+    if(!cloneGlobals)
+    {
+      delete cloneStream;
+      return NULL;
+    }
+    Stream * result=new JBIG2Stream(cloneStream, cloneGlobals);
+    cloneGlobals->free();
+    gfree(cloneGlobals);
+    return result;
   }
   return new JBIG2Stream(cloneStream, &globalsStream);
 }
@@ -2688,6 +2744,7 @@ JBIG2Bitmap *JBIG2Stream::readGenericBitmap(GBool mmr, int w, int h,
   int *refLine, *codingLine;
   int code1, code2, code3;
   int x, y, a0i, b1i, blackPixels, pix, i;
+  GBool fast;
 
   bitmap = new JBIG2Bitmap(0, w, h);
   bitmap->clearToZero();
@@ -2904,11 +2961,24 @@ JBIG2Bitmap *JBIG2Stream::readGenericBitmap(GBool mmr, int w, int h,
       }
     }
 
+    // without a skip bitmap, and with the AT pixels at their nominal
+    // positions (which is what nearly all encoders use), rows are
+    // decoded by readGenericRow()
+    fast = !useSkip;
+    for (i = 0; i < genericNumAT[templ]; ++i) {
+      if (atx[i] != genericNominalATX[templ][i] ||
+	  aty[i] != genericNominalATY[templ][i]) {
+	fast = gFalse;
+      }
+    }
+
     ltp = 0;
     cx = cx0 = cx1 = cx2 = 0; // make gcc happy
     for (y = 0; y < h; ++y) {
 
-      // check for a "typical" (duplicate) row
+      // check for a "typical" (duplicate) row -- this is just a copy
+      // of the previous row (row 0 is already cleared), so the
+      // context doesn't need to be set up at all
       if (tpgdOn) {
 	if (arithDecoder->decodeBit(ltpCX, genericRegionStats)) {
 	  ltp = !ltp;
@@ -2921,6 +2991,11 @@ JBIG2Bitmap *JBIG2Stream::readGenericBitmap(GBool mmr, int w, int h,
 	}
       }
 
+      if (fast) {
+	readGenericRow(bitmap, y, templ);
+	continue;
+      }
+
       switch (templ) {
       case 0:
 
@@ -3073,6 +3148,94 @@ JBIG2Bitmap *JBIG2Stream::readGenericBitmap(GBool mmr, int w, int h,
   return bitmap;
 }
 
+// Decode row <y> of a generic region bitmap, with the AT pixels at
+// their nominal positions.  This produces exactly the same contexts as
+// the pixel-by-pixel loops in readGenericBitmap(), but builds them
+// with shifts: each of the two rows above is read a byte at a time
+// into a 24-bit window (previous, current, and next byte), the pixels
+// already decoded in this row are kept in <cur>, and the decoded row
+// is written a byte at a time.  Pixels off the left or right edge
+// read as zero: the padding bits at the end of each row are always
+// zero, and the window bytes beyond either end of the row are zero.
+void JBIG2Stream::readGenericRow(JBIG2Bitmap *bitmap, int y, int templ) {
+  Guchar *p, *p1, *p2;
+  Guint w1, w2, v1, v2, cx, cur;
+  int w, line, x, i, n;
+
+  w = bitmap->getWidth();
+  line = bitmap->getLineSize();
+  p = bitmap->getDataPtr() + y * line;
+  p1 = (y >= 1) ? p - line : (Guchar *)NULL;
+  p2 = (y >= 2) ? p - 2 * line : (Guchar *)NULL;
+  w1 = p1 ? p1[0] : 0;
+  w2 = p2 ? p2[0] : 0;
+  cur = 0;
+
+  for (x = 0; x < w; x += 8) {
+
+    // shift the next byte of each row into the windows -- pixel x + i
+    // is now at bit 15 - i
+    w1 <<= 8;
+    w2 <<= 8;
+    if (x + 8 < w) {
+      if (p1) {
+	w1 |= p1[(x >> 3) + 1];
+      }
+      if (p2) {
+	w2 |= p2[(x >> 3) + 1];
+      }
+    }
+    n = (w - x < 8) ? w - x : 8;
+
+    switch (templ) {
+    case 0:
+      for (i = 0; i < n; ++i) {
+	// v1 bits 6..0 = row y-1, pixels x-3 .. x+3
+	// v2 bits 4..0 = row y-2, pixels x-2 .. x+2
+	v1 = w1 >> (12 - i);
+	v2 = w2 >> (13 - i);
+	cx = ((v2 & 0x0e) << 12) | ((v1 & 0x3e) << 7) | ((cur & 0x0f) << 4) |
+	     ((v1 & 1) << 3) | ((v1 >> 4) & 4) |
+	     ((v2 & 1) << 1) | ((v2 >> 4) & 1);
+	cur = (cur << 1) | arithDecoder->decodeBit(cx, genericRegionStats);
+      }
+      break;
+    case 1:
+      for (i = 0; i < n; ++i) {
+	// v1 bits 5..0 = row y-1, pixels x-2 .. x+3
+	// v2 bits 3..0 = row y-2, pixels x-1 .. x+2
+	v1 = w1 >> (12 - i);
+	v2 = w2 >> (13 - i);
+	cx = ((v2 & 0x0f) << 9) | ((v1 & 0x3e) << 3) | ((cur & 0x07) << 1) |
+	     (v1 & 1);
+	cur = (cur << 1) | arithDecoder->decodeBit(cx, genericRegionStats);
+      }
+      break;
+    case 2:
+      for (i = 0; i < n; ++i) {
+	// v1 bits 4..0 = row y-1, pixels x-2 .. x+2
+	// v2 bits 2..0 = row y-2, pixels x-1 .. x+1
+	v1 = w1 >> (13 - i);
+	v2 = w2 >> (14 - i);
+	cx = ((v2 & 0x07) << 7) | ((v1 & 0x1e) << 2) | ((cur & 0x03) << 1) |
+	     (v1 & 1);
+	cur = (cur << 1) | arithDecoder->decodeBit(cx, genericRegionStats);
+      }
+      break;
+    case 3:
+      for (i = 0; i < n; ++i) {
+	// v1 bits 5..0 = row y-1, pixels x-3 .. x+2
+	v1 = w1 >> (13 - i);
+	cx = ((v1 & 0x3e) << 4) | ((cur & 0x0f) << 1) | (v1 & 1);
+	cur = (cur << 1) | arithDecoder->decodeBit(cx, genericRegionStats);
+      }
+      break;
+    }
+
+    p[x >> 3] = (Guchar)(cur << (8 - n));
+  }
+}
+
 void JBIG2Stream::readGenericRefinementRegionSeg(Guint segNum, GBool imm,
 						 GBool lossless, Guint length,
 						 Guint *refSegs,
@@ -88,6 +88,7 @@ private:
 				 GBool useSkip, JBIG2Bitmap *skip,
 				 int *atx, int *aty,
 				 int mmrDataLength);
+  void readGenericRow(JBIG2Bitmap *bitmap, int y, int templ);
   void readGenericRefinementRegionSeg(Guint segNum, GBool imm,
 				      GBool lossless, Guint length,
 				      Guint *refSegs,
@@ -14,7 +14,9 @@
 
 #include <limits.h>
 #include "goo/gmem.h"
+#include "goo/GThread.h"
 #include "xpdf/Error.h"
+#include "xpdf/GlobalParams.h"
 #include "xpdf/JArithmeticDecoder.h"
 #include "xpdf/JPXStream.h"
 
@@ -59,6 +61,23 @@
 
 //------------------------------------------------------------------------
 
+// number of rows (or columns) processed together by the IDWT -- each
+// lifting step loops over this many independent lanes, which lets the
+// compiler use SIMD instructions
+#define jpxIDWTLanes         8
+
+//------------------------------------------------------------------------
+
+// One code-block decode job, run (possibly in parallel with other
+// jobs) after the whole codestream has been read.
+struct JPXDecodeJob {
+  JPXTileComp *tileComp;
+  Guint res, sb;		// resolution level and subband
+  JPXCodeBlock *cb;
+};
+
+//------------------------------------------------------------------------
+
 // arithmetic decoder context for the significance propagation and
 // cleanup passes:
 //     [horiz][vert][diag][subband]
@@ -246,6 +265,12 @@ JPXStream::JPXStream(Stream *strA):
   bitBufLen = 0;
   bitBufSkip = gFalse;
   byteCount = 0;
+
+  reductionLevel = 0;
+  reduceOutput = gFalse;
+  outStep = 1;
+  jobs = NULL;
+  nThreads = 1;
 }
 
 // creates new JPXStream with cloned stream holder
@@ -257,15 +282,31 @@ Stream * JPXStream::clone()
   if(!cloneStream)
     return NULL;
 
-  return new JPXStream(cloneStream);
+  JPXStream *jpxStr = new JPXStream(cloneStream);
+  jpxStr->setReductionLevel(reductionLevel);
+  jpxStr->reduceOutput = reduceOutput;
+  return jpxStr;
 } 
 
+void JPXStream::setImageReduction(int factor) {
+  int levels;
+
+  levels = 0;
+  while (levels < 16 && (2 << levels) <= factor) {
+    ++levels;
+  }
+  reductionLevel = levels;
+  reduceOutput = factor > 1;
+}
+
 JPXStream::~JPXStream() {
   close();
   delete str;
 }
 
 void JPXStream::reset() {
+  Guint red, i;
+
   str->reset();
   if (readBoxes()) {
     curY = img.yOffset;
@@ -273,6 +314,19 @@ void JPXStream::reset() {
     // readBoxes reported an error, so we go immediately to EOF
     curY = img.ySize;
   }
+
+  // only the reduction which has been done in all tiles is reported,
+  // the rest is left to the caller
+  outStep = 1;
+  if (reduceOutput && curY < img.ySize) {
+    red = (Guint)reductionLevel;
+    for (i = 0; i < img.nXTiles * img.nYTiles; ++i) {
+      if (img.tiles[i].reduction < red) {
+	red = img.tiles[i].reduction;
+      }
+    }
+    outStep = 1 << red;
+  }
   curX = img.xOffset;
   curComp = 0;
   readBufLen = 0;
@@ -331,6 +385,8 @@ void JPXStream::close() {
 			for (k = 0; k < subband->nXCBs * subband->nYCBs; ++k) {
 			  cb = &subband->cbs[k];
 			  gfree(cb->coeffs);
+			  gfree(cb->dataBuf);
+			  gfree(cb->segs);
 			  if (cb->arithDecoder) {
 			    delete cb->arithDecoder;
 			  }
@@ -400,7 +456,7 @@ int JPXStream::lookChar() {
 
 void JPXStream::fillReadBuf() {
   JPXTileComp *tileComp;
-  Guint tileIdx, tx, ty;
+  Guint tileIdx, tx, ty, red, n;
   int pix, pixBits;
 
   do {
@@ -416,6 +472,25 @@ void JPXStream::fillReadBuf() {
 #endif
     tx = jpxCeilDiv((curX - img.xTileOffset) % img.xTileSize, tileComp->hSep);
     ty = jpxCeilDiv((curY - img.yTileOffset) % img.yTileSize, tileComp->vSep);
+    if ((red = img.tiles[tileIdx].reduction)) {
+      // map to the nearest sample of the reduced resolution image
+      tx = jpxFloorDivPow2(tileComp->x0 + tx, red)
+	   - jpxCeilDivPow2(tileComp->x0, red);
+      if ((int)tx < 0) {
+	tx = 0;
+      } else if (tx >= (n = jpxCeilDivPow2(tileComp->x1, red)
+			    - jpxCeilDivPow2(tileComp->x0, red))) {
+	tx = n - 1;
+      }
+      ty = jpxFloorDivPow2(tileComp->y0 + ty, red)
+	   - jpxCeilDivPow2(tileComp->y0, red);
+      if ((int)ty < 0) {
+	ty = 0;
+      } else if (ty >= (n = jpxCeilDivPow2(tileComp->y1, red)
+			    - jpxCeilDivPow2(tileComp->y0, red))) {
+	ty = n - 1;
+      }
+    }
     pix = (int)tileComp->data[ty * (tileComp->x1 - tileComp->x0) + tx];
     pixBits = tileComp->prec;
 #if 1 //~ ignore the palette, assume the PDF ColorSpace object is valid
@@ -431,9 +506,9 @@ void JPXStream::fillReadBuf() {
     if (++curComp == (Guint)(havePalette ? palette.nComps : img.nComps)) {
 #endif
       curComp = 0;
-      if (++curX == img.xSize) {
+      if ((curX += outStep) >= img.xSize) {
 	curX = img.xOffset;
-	++curY;
+	curY += outStep;
       }
     }
     if (pixBits == 8) {
@@ -874,8 +949,6 @@ GBool JPXStream::readColorSpecBox(Guint dataLen) {
 }
 
 GBool JPXStream::readCodestream(Guint len) {
-  JPXTile *tile;
-  JPXTileComp *tileComp;
   int segType=0;
   GBool haveSIZ, haveCOD, haveQCD, haveSOT;
   Guint precinctSize=0, style=0;
@@ -927,6 +1000,7 @@ GBool JPXStream::readCodestream(Guint len) {
       for (i = 0; i < img.nXTiles * img.nYTiles; ++i) {
 	img.tiles[i].tileComps = (JPXTileComp *)gmallocn(img.nComps,
 							 sizeof(JPXTileComp));
+	img.tiles[i].reduction = 0;
 	for (comp = 0; comp < img.nComps; ++comp) {
 	  img.tiles[i].tileComps[comp].quantSteps = NULL;
 	  img.tiles[i].tileComps[comp].data = NULL;
@@ -1379,20 +1453,7 @@ GBool JPXStream::readCodestream(Guint len) {
   }
 
   //----- finish decoding the image
-  for (i = 0; i < img.nXTiles * img.nYTiles; ++i) {
-    tile = &img.tiles[i];
-    for (comp = 0; comp < img.nComps; ++comp) {
-      tileComp = &tile->tileComps[comp];
-      inverseTransform(tileComp);
-    }
-    if (!inverseMultiCompAndDC(tile)) {
-      return gFalse;
-    }
-  }
-
-  //~ can free memory below tileComps here, and also tileComp.buf
-
-  return gTrue;
+  return decodeImage();
 }
 
 GBool JPXStream::readTilePart() {
@@ -1795,7 +1856,7 @@ GBool JPXStream::readTilePart() {
       } else {
 	n = tileComp->y1 - tileComp->y0;
       }
-      tileComp->buf = (int *)gmallocn(n + 8, sizeof(int));
+      tileComp->buf = (int *)gmallocn(n + 8, jpxIDWTLanes * sizeof(int));
       for (r = 0; r <= tileComp->nDecompLevels; ++r) {
 	resLevel = &tileComp->resLevels[r];
 	k = r == 0 ? tileComp->nDecompLevels
@@ -1908,6 +1969,10 @@ GBool JPXStream::readTilePart() {
 		  cb->coeffs[cbi].len = 0;
 		  cb->coeffs[cbi].mag = 0;
 		}
+		cb->dataBuf = NULL;
+		cb->dataBufLen = cb->dataBufSize = 0;
+		cb->segs = NULL;
+		cb->nSegs = cb->segsSize = 0;
 		cb->arithDecoder = NULL;
 		cb->stats = NULL;
 		++cb;
@@ -1917,6 +1982,15 @@ GBool JPXStream::readTilePart() {
 	}
       }
     }
+
+    // number of resolution levels to skip -- limited by the smallest
+    // number of decomposition levels in any component
+    tile->reduction = reductionLevel > 0 ? (Guint)reductionLevel : 0;
+    for (comp = 0; comp < img.nComps; ++comp) {
+      if (tile->tileComps[comp].nDecompLevels < tile->reduction) {
+	tile->reduction = tile->tileComps[comp].nDecompLevels;
+      }
+    }
   }
 
   return readTilePartData(tileIdx, tilePartLen, tilePartToEOC);
@@ -2134,8 +2208,8 @@ GBool JPXStream::readTilePartData(Guint tileIdx,
 	for (cbX = 0; cbX < subband->nXCBs; ++cbX) {
 	  cb = &subband->cbs[cbY * subband->nXCBs + cbX];
 	  if (cb->included) {
-	    if (!readCodeBlockData(tileComp, resLevel, precinct, subband,
-				   tile->res, sb, cb)) {
+	    if (!readCodeBlockData(cb, tile->res + tile->reduction
+				         <= tileComp->nDecompLevels)) {
 	      return gFalse;
 	    }
 	    tilePartLen -= cb->dataLen;
@@ -2221,12 +2295,88 @@ GBool JPXStream::readTilePartData(Guint tileIdx,
   return gFalse;
 }
 
-GBool JPXStream::readCodeBlockData(JPXTileComp *tileComp,
-				   JPXResLevel *resLevel,
-				   JPXPrecinct *precinct,
-				   JPXSubband *subband,
-				   Guint res, Guint sb,
-				   JPXCodeBlock *cb) {
+// Read the code-block data from the current packet.  The data is only
+// buffered here -- the coefficients are decoded by decodeImage(), once
+// the whole codestream has been read, so that independent code-blocks
+// can be decoded in parallel.  If <keep> is false, the data is not
+// needed (see setReductionLevel) and is skipped.
+GBool JPXStream::readCodeBlockData(JPXCodeBlock *cb, GBool keep) {
+  Guint i;
+  int c;
+
+  if (!keep) {
+    for (i = 0; i < cb->dataLen; ++i) {
+      if (str->getChar() == EOF) {
+	break;
+      }
+    }
+    return gTrue;
+  }
+
+  if (cb->nSegs == cb->segsSize) {
+    cb->segsSize = cb->segsSize ? 2 * cb->segsSize : 4;
+    cb->segs = (JPXCodeBlockSeg *)greallocn(cb->segs, cb->segsSize,
+					    sizeof(JPXCodeBlockSeg));
+  }
+  cb->segs[cb->nSegs].nCodingPasses = cb->nCodingPasses;
+  cb->segs[cb->nSegs].dataLen = cb->dataLen;
+  ++cb->nSegs;
+
+  for (i = 0; i < cb->dataLen; ++i) {
+    // a truncated stream reads as 0xff bytes, both here and from the
+    // MemStream in decodeCodeBlock(), so stop at EOF
+    if ((c = str->getChar()) == EOF) {
+      break;
+    }
+    if (cb->dataBufLen == cb->dataBufSize) {
+      cb->dataBufSize = cb->dataBufSize ? 2 * cb->dataBufSize : 256;
+      cb->dataBuf = (Guchar *)grealloc(cb->dataBuf, cb->dataBufSize);
+    }
+    cb->dataBuf[cb->dataBufLen++] = (Guchar)c;
+  }
+  return gTrue;
+}
+
+// Decode all buffered packet data for one code-block.  This only
+// touches the code-block's own state, so different code-blocks can be
+// decoded concurrently.
+void JPXStream::decodeCodeBlock(JPXTileComp *tileComp, Guint res, Guint sb,
+				JPXCodeBlock *cb) {
+  MemStream *segStr;
+  Object obj;
+  Guint i;
+
+  obj.initNull();
+  segStr = new MemStream((char *)cb->dataBuf, 0, cb->dataBufLen, &obj);
+  for (i = 0; i < cb->nSegs; ++i) {
+    cb->nCodingPasses = cb->segs[i].nCodingPasses;
+    cb->dataLen = cb->segs[i].dataLen;
+    decodeCodeBlockSeg(tileComp, res, sb, cb, segStr);
+  }
+  delete segStr;
+
+  // the code-block is complete -- free everything except the
+  // coefficients
+  if (cb->arithDecoder) {
+    delete cb->arithDecoder;
+    cb->arithDecoder = NULL;
+  }
+  if (cb->stats) {
+    delete cb->stats;
+    cb->stats = NULL;
+  }
+  gfree(cb->dataBuf);
+  cb->dataBuf = NULL;
+  cb->dataBufLen = cb->dataBufSize = 0;
+  gfree(cb->segs);
+  cb->segs = NULL;
+  cb->nSegs = cb->segsSize = 0;
+}
+
+// Decode the coding passes from one packet's worth of code-block data,
+// read from <segStr>.
+void JPXStream::decodeCodeBlockSeg(JPXTileComp *tileComp, Guint res, Guint sb,
+				   JPXCodeBlock *cb, Stream *segStr) {
   JPXCoeff *coeff0, *coeff1, *coeff;
   Guint horiz, vert, diag, all, cx, xorBit;
   int horizSign, vertSign;
@@ -2238,7 +2388,7 @@ GBool JPXStream::readCodeBlockData(JPXTileComp *tileComp,
   } else {
     cover(64);
     cb->arithDecoder = new JArithmeticDecoder();
-    cb->arithDecoder->setStream(str, cb->dataLen);
+    cb->arithDecoder->setStream(segStr, cb->dataLen);
     cb->arithDecoder->start();
     cb->stats = new JArithmeticDecoderStats(jpxNContexts);
     cb->stats->setEntry(jpxContextSigProp, 4, 0);
@@ -2534,12 +2684,103 @@ GBool JPXStream::readCodeBlockData(JPXTileComp *tileComp,
   }
 
   cb->arithDecoder->cleanup();
+}
+
+// Decode all code-blocks and run the inverse transforms.  Code-blocks
+// are independent of each other, as are the tile-components in the
+// IDWT, so both are spread across the decoder threads.
+GBool JPXStream::decodeImage() {
+  JPXTile *tile;
+  JPXTileComp *tileComp;
+  JPXResLevel *resLevel;
+  JPXSubband *subband;
+  Guint nJobs, jobsSize, i, comp, r, sb, k;
+
+  nThreads = globalParams ? globalParams->getDecodeThreads() : 0;
+  if (nThreads <= 0) {
+    nThreads = gGetNumCPUs();
+  }
+
+  //----- decode the code-blocks
+  nJobs = jobsSize = 0;
+  for (i = 0; i < img.nXTiles * img.nYTiles; ++i) {
+    tile = &img.tiles[i];
+    for (comp = 0; comp < img.nComps; ++comp) {
+      tileComp = &tile->tileComps[comp];
+      if (!tileComp->data) {
+	continue;
+      }
+      for (r = 0; r + tile->reduction <= tileComp->nDecompLevels; ++r) {
+	resLevel = &tileComp->resLevels[r];
+	for (sb = 0; sb < (Guint)(r == 0 ? 1 : 3); ++sb) {
+	  subband = &resLevel->precincts[0].subbands[sb];
+	  for (k = 0; k < subband->nXCBs * subband->nYCBs; ++k) {
+	    if (!subband->cbs[k].nSegs) {
+	      continue;
+	    }
+	    if (nJobs == jobsSize) {
+	      jobsSize = jobsSize ? 2 * jobsSize : 256;
+	      jobs = (JPXDecodeJob *)greallocn(jobs, jobsSize,
+					       sizeof(JPXDecodeJob));
+	    }
+	    jobs[nJobs].tileComp = tileComp;
+	    jobs[nJobs].res = r;
+	    jobs[nJobs].sb = sb;
+	    jobs[nJobs].cb = &subband->cbs[k];
+	    ++nJobs;
+	  }
+	}
+      }
+    }
+  }
+  gParallelFor(nJobs, &decodeCodeBlockJob, this, nThreads);
+  gfree(jobs);
+  jobs = NULL;
+
+  //----- inverse transforms
+  gParallelFor(img.nXTiles * img.nYTiles * img.nComps,
+	       &inverseTransformJob, this, nThreads);
+  for (i = 0; i < img.nXTiles * img.nYTiles; ++i) {
+    if (!inverseMultiCompAndDC(&img.tiles[i])) {
+      return gFalse;
+    }
+  }
+
+  //~ can free memory below tileComps here, and also tileComp.buf
+
   return gTrue;
 }
 
+// gParallelFor() job: decodes code-block job number <idx>.
+void JPXStream::decodeCodeBlockJob(void *data, int idx) {
+  JPXStream *jpxStr;
+  JPXDecodeJob *job;
+
+  jpxStr = (JPXStream *)data;
+  job = &jpxStr->jobs[idx];
+  jpxStr->decodeCodeBlock(job->tileComp, job->res, job->sb, job->cb);
+}
+
+// gParallelFor() job: IDWT for tile-component number <idx> (numbered
+// tile by tile).
+void JPXStream::inverseTransformJob(void *data, int idx) {
+  JPXStream *jpxStr;
+  JPXTile *tile;
+  JPXTileComp *tileComp;
+
+  jpxStr = (JPXStream *)data;
+  tile = &jpxStr->img.tiles[idx / jpxStr->img.nComps];
+  tileComp = &tile->tileComps[idx % jpxStr->img.nComps];
+  if (tileComp->data) {
+    jpxStr->inverseTransform(tileComp, tile->reduction);
+  }
+}
+
 // Inverse quantization, and wavelet transform (IDWT).  This also does
-// the initial shift to convert to fixed point format.
-void JPXStream::inverseTransform(JPXTileComp *tileComp) {
+// the initial shift to convert to fixed point format.  The last
+// <reduction> levels are skipped, leaving a reduced resolution image
+// in the upper-left corner of the data array.
+void JPXStream::inverseTransform(JPXTileComp *tileComp, Guint reduction) {
   JPXResLevel *resLevel;
   JPXPrecinct *precinct;
   JPXSubband *subband;
@@ -2625,7 +2866,7 @@ void JPXStream::inverseTransform(JPXTileComp *tileComp) {
 
   //----- IDWT for each level
 
-  for (r = 1; r <= tileComp->nDecompLevels; ++r) {
+  for (r = 1; r + reduction <= tileComp->nDecompLevels; ++r) {
     resLevel = &tileComp->resLevels[r];
 
     // (n)LL is already in the upper-left corner of the
@@ -2666,7 +2907,7 @@ void JPXStream::inverseTransformLevel(JPXTileComp *tileComp,
   double mu;
   int val;
   int *dataPtr;
-  Guint xo, yo;
+  Guint xo, yo, w, n;
   Guint x, y, sb, cbX, cbY;
   int xx, yy;
 
@@ -2760,33 +3001,57 @@ void JPXStream::inverseTransformLevel(JPXTileComp *tileComp,
   }
 
   //----- horizontal (row) transforms
+  w = tileComp->x1 - tileComp->x0;
   dataPtr = tileComp->data;
-  for (y = 0; y < ny1 - ny0; ++y) {
-    inverseTransform1D(tileComp, dataPtr, 1, nx0, nx1);
-    dataPtr += tileComp->x1 - tileComp->x0;
+  for (y = 0; y < ny1 - ny0; y += jpxIDWTLanes) {
+    n = ny1 - ny0 - y;
+    inverseTransform1D(tileComp, dataPtr, 1, w,
+		       n < jpxIDWTLanes ? n : jpxIDWTLanes, nx0, nx1);
+    dataPtr += jpxIDWTLanes * w;
   }
 
   //----- vertical (column) transforms
   dataPtr = tileComp->data;
-  for (x = 0; x < nx1 - nx0; ++x) {
-    inverseTransform1D(tileComp, dataPtr,
-		       tileComp->x1 - tileComp->x0, ny0, ny1);
-    ++dataPtr;
+  for (x = 0; x < nx1 - nx0; x += jpxIDWTLanes) {
+    n = nx1 - nx0 - x;
+    inverseTransform1D(tileComp, dataPtr, w, 1,
+		       n < jpxIDWTLanes ? n : jpxIDWTLanes, ny0, ny1);
+    dataPtr += jpxIDWTLanes;
   }
 }
 
+// Copy buf[src] to buf[dst], for all lanes.
+static inline void jpxCopyLanes(int *buf, Guint dst, Guint src) {
+  int *d, *s;
+  Guint l;
+
+  d = &buf[dst * jpxIDWTLanes];
+  s = &buf[src * jpxIDWTLanes];
+  for (l = 0; l < jpxIDWTLanes; ++l) {
+    d[l] = s[l];
+  }
+}
+
+// 1-D inverse transform on <nLanes> (<= jpxIDWTLanes) independent rows
+// or columns.  Sample i of lane l is data[i * stride + l * laneStride].
+// The samples are gathered into tileComp->buf, lane-interleaved
+// (buf[i * jpxIDWTLanes + l]), so that each lifting step can work on
+// all lanes at once.
 void JPXStream::inverseTransform1D(JPXTileComp *tileComp,
 				   int *data, Guint stride,
+				   Guint laneStride, Guint nLanes,
 				   Guint i0, Guint i1) {
-  int *buf;
-  Guint offset, end, i;
+  int *buf, *b, *bPrev, *bNext;
+  Guint offset, end, i, l;
 
   //----- special case for length = 1
   if (i1 - i0 == 1) {
     cover(79);
     if (i0 & 1) {
       cover(104);
-      *data >>= 1;
+      for (l = 0; l < nLanes; ++l) {
+	data[l * laneStride] >>= 1;
+      }
     }
 
   } else {
@@ -2800,43 +3065,49 @@ void JPXStream::inverseTransform1D(JPXTileComp *tileComp,
     //----- gather
     buf = tileComp->buf;
     for (i = 0; i < i1 - i0; ++i) {
-      buf[offset + i] = data[i * stride];
+      b = &buf[(offset + i) * jpxIDWTLanes];
+      for (l = 0; l < nLanes; ++l) {
+	b[l] = data[i * stride + l * laneStride];
+      }
+      for (; l < jpxIDWTLanes; ++l) {
+	b[l] = 0;
+      }
     }
 
     //----- extend right
-    buf[end] = buf[end - 2];
+    jpxCopyLanes(buf, end, end - 2);
     if (i1 - i0 == 2) {
       cover(81);
-      buf[end+1] = buf[offset + 1];
-      buf[end+2] = buf[offset];
-      buf[end+3] = buf[offset + 1];
+      jpxCopyLanes(buf, end + 1, offset + 1);
+      jpxCopyLanes(buf, end + 2, offset);
+      jpxCopyLanes(buf, end + 3, offset + 1);
     } else {
       cover(82);
-      buf[end+1] = buf[end - 3];
+      jpxCopyLanes(buf, end + 1, end - 3);
       if (i1 - i0 == 3) {
 	cover(105);
-	buf[end+2] = buf[offset + 1];
-	buf[end+3] = buf[offset + 2];
+	jpxCopyLanes(buf, end + 2, offset + 1);
+	jpxCopyLanes(buf, end + 3, offset + 2);
       } else {
 	cover(106);
-	buf[end+2] = buf[end - 4];
+	jpxCopyLanes(buf, end + 2, end - 4);
 	if (i1 - i0 == 4) {
 	  cover(107);
-	  buf[end+3] = buf[offset + 1];
+	  jpxCopyLanes(buf, end + 3, offset + 1);
 	} else {
 	  cover(108);
-	  buf[end+3] = buf[end - 5];
+	  jpxCopyLanes(buf, end + 3, end - 5);
 	}
       }
     }
 
     //----- extend left
-    buf[offset - 1] = buf[offset + 1];
-    buf[offset - 2] = buf[offset + 2];
-    buf[offset - 3] = buf[offset + 3];
+    jpxCopyLanes(buf, offset - 1, offset + 1);
+    jpxCopyLanes(buf, offset - 2, offset + 2);
+    jpxCopyLanes(buf, offset - 3, offset + 3);
     if (offset == 4) {
       cover(83);
-      buf[0] = buf[offset + 4];
+      jpxCopyLanes(buf, 0, offset + 4);
     }
 
     //----- 9-7 irreversible filter
@@ -2845,27 +3116,53 @@ void JPXStream::inverseTransform1D(JPXTileComp *tileComp,
       cover(84);
       // step 1 (even)
       for (i = 1; i <= end + 2; i += 2) {
-	buf[i] = (int)(idwtKappa * buf[i]);
+	b = &buf[i * jpxIDWTLanes];
+	for (l = 0; l < jpxIDWTLanes; ++l) {
+	  b[l] = (int)(idwtKappa * b[l]);
+	}
       }
       // step 2 (odd)
       for (i = 0; i <= end + 3; i += 2) {
-	buf[i] = (int)(idwtIKappa * buf[i]);
+	b = &buf[i * jpxIDWTLanes];
+	for (l = 0; l < jpxIDWTLanes; ++l) {
+	  b[l] = (int)(idwtIKappa * b[l]);
+	}
       }
       // step 3 (even)
       for (i = 1; i <= end + 2; i += 2) {
-	buf[i] = (int)(buf[i] - idwtDelta * (buf[i-1] + buf[i+1]));
+	b = &buf[i * jpxIDWTLanes];
+	bPrev = b - jpxIDWTLanes;
+	bNext = b + jpxIDWTLanes;
+	for (l = 0; l < jpxIDWTLanes; ++l) {
+	  b[l] = (int)(b[l] - idwtDelta * (bPrev[l] + bNext[l]));
+	}
       }
       // step 4 (odd)
       for (i = 2; i <= end + 1; i += 2) {
-	buf[i] = (int)(buf[i] - idwtGamma * (buf[i-1] + buf[i+1]));
+	b = &buf[i * jpxIDWTLanes];
+	bPrev = b - jpxIDWTLanes;
+	bNext = b + jpxIDWTLanes;
+	for (l = 0; l < jpxIDWTLanes; ++l) {
+	  b[l] = (int)(b[l] - idwtGamma * (bPrev[l] + bNext[l]));
+	}
       }
       // step 5 (even)
       for (i = 3; i <= end; i += 2) {
-	buf[i] = (int)(buf[i] - idwtBeta * (buf[i-1] + buf[i+1]));
+	b = &buf[i * jpxIDWTLanes];
+	bPrev = b - jpxIDWTLanes;
+	bNext = b + jpxIDWTLanes;
+	for (l = 0; l < jpxIDWTLanes; ++l) {
+	  b[l] = (int)(b[l] - idwtBeta * (bPrev[l] + bNext[l]));
+	}
       }
       // step 6 (odd)
       for (i = 4; i <= end - 1; i += 2) {
-	buf[i] = (int)(buf[i] - idwtAlpha * (buf[i-1] + buf[i+1]));
+	b = &buf[i * jpxIDWTLanes];
+	bPrev = b - jpxIDWTLanes;
+	bNext = b + jpxIDWTLanes;
+	for (l = 0; l < jpxIDWTLanes; ++l) {
+	  b[l] = (int)(b[l] - idwtAlpha * (bPrev[l] + bNext[l]));
+	}
       }
 
     //----- 5-3 reversible filter
@@ -2874,17 +3171,30 @@ void JPXStream::inverseTransform1D(JPXTileComp *tileComp,
       cover(85);
       // step 1 (even)
       for (i = 3; i <= end; i += 2) {
-	buf[i] -= (buf[i-1] + buf[i+1] + 2) >> 2;
+	b = &buf[i * jpxIDWTLanes];
+	bPrev = b - jpxIDWTLanes;
+	bNext = b + jpxIDWTLanes;
+	for (l = 0; l < jpxIDWTLanes; ++l) {
+	  b[l] -= (bPrev[l] + bNext[l] + 2) >> 2;
+	}
       }
       // step 2 (odd)
       for (i = 4; i < end; i += 2) {
-	buf[i] += (buf[i-1] + buf[i+1]) >> 1;
+	b = &buf[i * jpxIDWTLanes];
+	bPrev = b - jpxIDWTLanes;
+	bNext = b + jpxIDWTLanes;
+	for (l = 0; l < jpxIDWTLanes; ++l) {
+	  b[l] += (bPrev[l] + bNext[l]) >> 1;
+	}
       }
     }
 
     //----- scatter
     for (i = 0; i < i1 - i0; ++i) {
-      data[i * stride] = buf[offset + i];
+      b = &buf[(offset + i) * jpxIDWTLanes];
+      for (l = 0; l < nLanes; ++l) {
+	data[i * stride + l * laneStride] = b[l];
+      }
     }
   }
 }
@@ -2895,7 +3205,7 @@ GBool JPXStream::inverseMultiCompAndDC(JPXTile *tile) {
   JPXTileComp *tileComp;
   int coeff, d0, d1, d2, t, minVal, maxVal, zeroVal;
   int *dataPtr;
-  Guint j, comp, x, y;
+  Guint j, comp, x, y, w, nx, ny;
 
   //----- inverse multi-component transform
 
@@ -2908,13 +3218,19 @@ GBool JPXStream::inverseMultiCompAndDC(JPXTile *tile) {
 	tile->tileComps[1].vSep != tile->tileComps[2].vSep) {
       return gFalse;
     }
+    tileComp = &tile->tileComps[0];
+    w = tileComp->x1 - tileComp->x0;
+    nx = jpxCeilDivPow2(tileComp->x1, tile->reduction)
+         - jpxCeilDivPow2(tileComp->x0, tile->reduction);
+    ny = jpxCeilDivPow2(tileComp->y1, tile->reduction)
+         - jpxCeilDivPow2(tileComp->y0, tile->reduction);
 
     // inverse irreversible multiple component transform
     if (tile->tileComps[0].transform == 0) {
       cover(87);
-      j = 0;
-      for (y = 0; y < tile->tileComps[0].y1 - tile->tileComps[0].y0; ++y) {
-	for (x = 0; x < tile->tileComps[0].x1 - tile->tileComps[0].x0; ++x) {
+      for (y = 0; y < ny; ++y) {
+	j = y * w;
+	for (x = 0; x < nx; ++x) {
 	  d0 = tile->tileComps[0].data[j];
 	  d1 = tile->tileComps[1].data[j];
 	  d2 = tile->tileComps[2].data[j];
@@ -2929,9 +3245,9 @@ GBool JPXStream::inverseMultiCompAndDC(JPXTile *tile) {
     // inverse reversible multiple component transform
     } else {
       cover(88);
-      j = 0;
-      for (y = 0; y < tile->tileComps[0].y1 - tile->tileComps[0].y0; ++y) {
-	for (x = 0; x < tile->tileComps[0].x1 - tile->tileComps[0].x0; ++x) {
+      for (y = 0; y < ny; ++y) {
+	j = y * w;
+	for (x = 0; x < nx; ++x) {
 	  d0 = tile->tileComps[0].data[j];
 	  d1 = tile->tileComps[1].data[j];
 	  d2 = tile->tileComps[2].data[j];
@@ -2947,15 +3263,20 @@ GBool JPXStream::inverseMultiCompAndDC(JPXTile *tile) {
   //----- DC level shift
   for (comp = 0; comp < img.nComps; ++comp) {
     tileComp = &tile->tileComps[comp];
+    w = tileComp->x1 - tileComp->x0;
+    nx = jpxCeilDivPow2(tileComp->x1, tile->reduction)
+         - jpxCeilDivPow2(tileComp->x0, tile->reduction);
+    ny = jpxCeilDivPow2(tileComp->y1, tile->reduction)
+         - jpxCeilDivPow2(tileComp->y0, tile->reduction);
 
     // signed: clip
     if (tileComp->sgned) {
       cover(89);
       minVal = -(1 << (tileComp->prec - 1));
       maxVal = (1 << (tileComp->prec - 1)) - 1;
-      dataPtr = tileComp->data;
-      for (y = 0; y < tileComp->y1 - tileComp->y0; ++y) {
-	for (x = 0; x < tileComp->x1 - tileComp->x0; ++x) {
+      for (y = 0; y < ny; ++y) {
+	dataPtr = &tileComp->data[y * w];
+	for (x = 0; x < nx; ++x) {
 	  coeff = *dataPtr;
 	  if (tileComp->transform == 0) {
 	    cover(109);
@@ -2977,9 +3298,9 @@ GBool JPXStream::inverseMultiCompAndDC(JPXTile *tile) {
       cover(90);
       maxVal = (1 << tileComp->prec) - 1;
       zeroVal = 1 << (tileComp->prec - 1);
-      dataPtr = tileComp->data;
-      for (y = 0; y < tileComp->y1 - tileComp->y0; ++y) {
-	for (x = 0; x < tileComp->x1 - tileComp->x0; ++x) {
+      for (y = 0; y < ny; ++y) {
+	dataPtr = &tileComp->data[y * w];
+	for (x = 0; x < nx; ++x) {
 	  coeff = *dataPtr;
 	  if (tileComp->transform == 0) {
 	    cover(112);
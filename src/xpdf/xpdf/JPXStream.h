@@ -21,6 +21,7 @@
 
 class JArithmeticDecoder;
 class JArithmeticDecoderStats;
+struct JPXDecodeJob;
 
 //------------------------------------------------------------------------
 
@@ -119,6 +120,11 @@ struct JPXCoeff {
 
 //------------------------------------------------------------------------
 
+struct JPXCodeBlockSeg {
+  Guint nCodingPasses;		// number of coding passes in this pkt
+  Guint dataLen;		// pkt data length
+};
+
 struct JPXCodeBlock {
   //----- size
   Guint x0, y0, x1, y1;		// bounds
@@ -138,6 +144,16 @@ struct JPXCodeBlock {
   Guint nCodingPasses;		// number of coding passes in this pkt
   Guint dataLen;		// pkt data length
 
+  //----- buffered pkt data (decoded after the whole codestream has
+  //----- been read)
+  Guchar *dataBuf;		// pkt data from all layers, concatenated
+  Guint dataBufLen;		// number of valid bytes in dataBuf
+  Guint dataBufSize;		// allocated size of dataBuf
+  JPXCodeBlockSeg *segs;	// coding passes and data length for each
+				//   pkt that included this code-block
+  Guint nSegs;			// number of valid entries in segs
+  Guint segsSize;		// allocated size of segs
+
   //----- coefficient data
   JPXCoeff *coeffs;		// the coefficients
   JArithmeticDecoder		// arithmetic decoder
@@ -239,6 +255,8 @@ struct JPXTile {
   Guint x0, y0, x1, y1;		// bounds of the tile, in ref coords
   Guint maxNDecompLevels;	// max number of decomposition levels used
 				//   in any component in this tile
+  Guint reduction;		// number of resolution levels which are
+				//   not decoded (see setReductionLevel)
 
   //----- progression order loop counters
   Guint comp;			//   component
@@ -287,6 +305,23 @@ public:
   virtual void getImageParams(int *bitsPerComponent,
 			      StreamColorSpaceMode *csMode);
 
+  // Decode the image <levels> resolution levels below full
+  // resolution, i.e., skip the code-blocks and the inverse wavelet
+  // transform of the <levels> highest levels.  Each decoded sample is
+  // replicated to cover 2^<levels> x 2^<levels> pixels, so the stream
+  // still returns the full image size.  This is limited to the number
+  // of decomposition levels in the codestream.  Must be called before
+  // reset().
+  void setReductionLevel(int levels) { reductionLevel = levels; }
+
+  // Return the image reduced by <factor> in each direction: this
+  // decodes log2(<factor>) fewer resolution levels (as far as the
+  // codestream allows, see setReductionLevel()) and returns only every
+  // n-th sample of every n-th row, where n (see getImageReduction())
+  // is the reduction which has actually been decoded in all tiles.
+  virtual void setImageReduction(int factor);
+  virtual int getImageReduction() { return (int)outStep; }
+
 private:
 
   void fillReadBuf();
@@ -297,19 +332,22 @@ private:
   GBool readTilePart();
   GBool readTilePartData(Guint tileIdx,
 			 Guint tilePartLen, GBool tilePartToEOC);
-  GBool readCodeBlockData(JPXTileComp *tileComp,
-			  JPXResLevel *resLevel,
-			  JPXPrecinct *precinct,
-			  JPXSubband *subband,
-			  Guint res, Guint sb,
-			  JPXCodeBlock *cb);
-  void inverseTransform(JPXTileComp *tileComp);
+  GBool readCodeBlockData(JPXCodeBlock *cb, GBool keep);
+  GBool decodeImage();
+  static void decodeCodeBlockJob(void *data, int idx);
+  static void inverseTransformJob(void *data, int idx);
+  void decodeCodeBlock(JPXTileComp *tileComp, Guint res, Guint sb,
+		       JPXCodeBlock *cb);
+  void decodeCodeBlockSeg(JPXTileComp *tileComp, Guint res, Guint sb,
+			  JPXCodeBlock *cb, Stream *segStr);
+  void inverseTransform(JPXTileComp *tileComp, Guint reduction);
   void inverseTransformLevel(JPXTileComp *tileComp,
 			     Guint r, JPXResLevel *resLevel,
 			     Guint nx0, Guint ny0,
 			     Guint nx1, Guint ny1);
   void inverseTransform1D(JPXTileComp *tileComp,
 			  int *data, Guint stride,
+			  Guint laneStride, Guint nLanes,
 			  Guint i0, Guint i1);
   GBool inverseMultiCompAndDC(JPXTile *tile);
   GBool readBoxHdr(Guint *boxType, Guint *boxLen, Guint *dataLen);
@@ -344,6 +382,12 @@ private:
 				//   (for bit stuffing)
   Guint byteCount;		// number of available bytes left
 
+  int reductionLevel;		// requested resolution reduction
+  GBool reduceOutput;		// set if the returned image is reduced
+  Guint outStep;		// sample step of the returned image
+  JPXDecodeJob *jobs;		// code-block jobs, while decoding
+  int nThreads;			// number of decoder threads
+
   Guint curX, curY, curComp;	// current position for lookChar/getChar
   Guint readBuf;		// read buffer
   Guint readBufLen;		// number of valid bits in readBuf
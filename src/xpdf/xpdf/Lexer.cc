@@ -46,9 +46,10 @@ char specialChars[256] = {
 // Lexer
 //------------------------------------------------------------------------
 
-Lexer::Lexer(const XRef *xref, Stream *str) {
+Lexer::Lexer(const XRef *xref, Stream *str): lexStr(this) {
   Object obj;
 
+  bufPtr = bufEnd = buf;
   curStr.initStream(str);
   streams = new Array(xref);
   streams->add(curStr.copy(&obj));
@@ -57,9 +58,10 @@ Lexer::Lexer(const XRef *xref, Stream *str) {
   curStr.streamReset();
 }
 
-Lexer::Lexer(const XRef *xref, const Object *obj) {
+Lexer::Lexer(const XRef *xref, const Object *obj): lexStr(this) {
   Object obj2;
 
+  bufPtr = bufEnd = buf;
   if (obj->isStream()) {
     streams = new Array(xref);
     freeArray = gTrue;
@@ -85,11 +87,18 @@ Lexer::~Lexer() {
   }
 }
 
-int Lexer::getChar() {
-  int c;
+GBool Lexer::fillBuf(GBool nextStream) {
+  int n;
 
-  c = EOF;
-  while (!curStr.isNone() && (c = curStr.streamGetChar()) == EOF) {
+  bufPtr = bufEnd = buf;
+  while (!curStr.isNone()) {
+    if ((n = curStr.streamGetBlock(buf, lexerBufSize)) > 0) {
+      bufEnd = buf + n;
+      return gTrue;
+    }
+    if (!nextStream) {
+      break;
+    }
     curStr.streamClose();
     curStr.free();
     ++strPtr;
@@ -98,14 +107,22 @@ int Lexer::getChar() {
       curStr.streamReset();
     }
   }
-  return c;
+  return gFalse;
 }
 
-int Lexer::lookChar() {
-  if (curStr.isNone()) {
-    return EOF;
+int Lexer::getBlock(char *blk, int size) {
+  int n;
+
+  n = (int)(bufEnd - bufPtr);
+  if (n > size) {
+    n = size;
+  }
+  memcpy(blk, bufPtr, n);
+  bufPtr += n;
+  if (n < size && !curStr.isNone()) {
+    n += curStr.streamGetBlock(blk + n, size - n);
   }
-  return curStr.streamLookChar();
+  return n;
 }
 
 Object *Lexer::getObj(Object *obj) {
@@ -483,3 +500,66 @@ void Lexer::skipToNextLine() {
 GBool Lexer::isSpace(int c) {
   return c >= 0 && c <= 0xff && specialChars[c] == 1;
 }
+
+//------------------------------------------------------------------------
+// LexerStream
+//------------------------------------------------------------------------
+
+StreamKind LexerStream::getKind()const {
+  return lexer->curStr.getStream()->getKind();
+}
+
+Stream *LexerStream::clone() {
+  return lexer->curStr.getStream()->clone();
+}
+
+void LexerStream::reset() {
+  lexer->bufPtr = lexer->bufEnd = lexer->buf;
+  lexer->curStr.streamReset();
+}
+
+int LexerStream::getChar() {
+  int c;
+
+  c = lexer->lookChar();
+  if (c != EOF) {
+    ++lexer->bufPtr;
+  }
+  return c;
+}
+
+int LexerStream::lookChar() {
+  return lexer->lookChar();
+}
+
+int LexerStream::getBlock(char *blk, int size) {
+  return lexer->getBlock(blk, size);
+}
+
+int LexerStream::getPos()const {
+  return lexer->getPos();
+}
+
+void LexerStream::setPos(Guint pos, int dir) {
+  lexer->setPos(pos, dir);
+}
+
+GBool LexerStream::isBinary(GBool last)const {
+  return lexer->curStr.getStream()->isBinary(last);
+}
+
+BaseStream *LexerStream::getBaseStream() {
+  return lexer->curStr.getStream()->getBaseStream();
+}
+
+Stream *LexerStream::getUndecodedStream() {
+  return lexer->curStr.getStream()->getUndecodedStream();
+}
+
+const Dict *LexerStream::getDict()const {
+  return lexer->curStr.getStream()->getDict();
+}
+
+Stream *LexerStream::getNextStream() {
+  return lexer->curStr.getStream();
+}
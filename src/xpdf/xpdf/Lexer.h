@@ -19,9 +19,43 @@
 #include "xpdf/Stream.h"
 
 class XRef;
+class Lexer;
 
 extern char specialChars[256];
 #define tokBufSize 128		// size of token buffer
+#define lexerBufSize 256	// size of input buffer
+
+//------------------------------------------------------------------------
+// LexerStream
+//------------------------------------------------------------------------
+
+// Stream returned by Lexer::getStream().  The lexer reads its input in
+// blocks, so the current stream is ahead of the lexer position.  This
+// stream reads the current stream through the lexer buffer, so that data
+// embedded in the lexer input (e.g. inline images) are read from the
+// right position.  Everything else is forwarded to the current stream.
+class LexerStream: public Stream {
+public:
+
+  LexerStream(Lexer *lexerA): lexer(lexerA) {}
+  virtual StreamKind getKind()const;
+  virtual Stream * clone();
+  virtual void reset();
+  virtual int getChar();
+  virtual int lookChar();
+  virtual int getBlock(char *blk, int size);
+  virtual int getPos()const;
+  virtual void setPos(Guint pos, int dir = 0);
+  virtual GBool isBinary(GBool last = gTrue)const;
+  virtual BaseStream *getBaseStream();
+  virtual Stream *getUndecodedStream();
+  virtual const Dict *getDict()const;
+  virtual Stream *getNextStream();
+
+private:
+
+  Lexer *lexer;
+};
 
 //------------------------------------------------------------------------
 // Lexer
@@ -50,18 +84,21 @@ public:
   // Skip over one character.
   void skipChar() { getChar(); }
 
-  // Get stream.
+  // Get stream.  The returned stream reads from the current lexer
+  // position (see LexerStream).
   Stream *getStream()const
-    { return curStr.isNone() ? (Stream *)NULL : curStr.getStream(); }
+    { return curStr.isNone() ? (Stream *)NULL : &lexStr; }
 
   // Get current position in file.  This is only used for error
   // messages, so it returns an int instead of a Guint.
   int getPos()const
-    { return curStr.isNone() ? -1 : (int)curStr.streamGetPos(); }
+    { return curStr.isNone() ? -1 :
+	(int)curStr.streamGetPos() - (int)(bufEnd - bufPtr); }
 
   // Set position in file.
   void setPos(Guint pos, int dir = 0)
-    { if (!curStr.isNone()) curStr.streamSetPos(pos, dir); }
+    { bufPtr = bufEnd = buf;
+      if (!curStr.isNone()) curStr.streamSetPos(pos, dir); }
 
   // Returns true if <c> is a whitespace character.
   static GBool isSpace(int c);
@@ -72,14 +109,33 @@ public:
 
 private:
 
-  int getChar();
-  int lookChar();
+  friend class LexerStream;
+
+  // Get next char, continues with the next stream at the end of the
+  // current one.
+  int getChar()
+    { return (bufPtr < bufEnd || fillBuf(gTrue)) ? (*bufPtr++ & 0xff) : EOF; }
+
+  // Look at next char from the current stream.
+  int lookChar()
+    { return (bufPtr < bufEnd || fillBuf(gFalse)) ? (*bufPtr & 0xff) : EOF; }
+
+  // Get up to <size> chars from the current stream.
+  int getBlock(char *blk, int size);
+
+  // Fill buf from the current stream.  If it is at its end and
+  // <nextStream> is set, continues with the next stream.
+  GBool fillBuf(GBool nextStream);
 
   Array *streams;		// array of input streams
   int strPtr;			// index of current stream
   Object curStr;		// current stream
   GBool freeArray;		// should lexer free the streams array?
   char tokBuf[tokBufSize];	// temporary token buffer
+  char buf[lexerBufSize];	// input buffer
+  char *bufPtr;			// next char in buf
+  char *bufEnd;			// end of valid data in buf
+  mutable LexerStream lexStr;	// stream returned by getStream()
 };
 
 #endif
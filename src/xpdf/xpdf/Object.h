@@ -191,6 +191,7 @@ public:
   void streamClose()const;
   int streamGetChar()const;
   int streamLookChar()const;
+  int streamGetBlock(char *blk, int size)const;
   char *streamGetLine(char *buf, int size)const;
   Guint streamGetPos()const;
   void streamSetPos(Guint pos, int dir = 0)const;
@@ -306,6 +307,9 @@ inline int Object::streamGetChar()const
 inline int Object::streamLookChar()const
   { return stream->lookChar(); }
 
+inline int Object::streamGetBlock(char *blk, int size)const
+  { return stream->getBlock(blk, size); }
+
 inline char *Object::streamGetLine(char *buf, int size)const
   { return stream->getLine(buf, size); }
 
@@ -21,9 +21,11 @@
 #include "xpdf/XRef.h"
 #include "xpdf/Error.h"
 
-Parser::Parser(const XRef *xrefA, Lexer *lexerA, GBool allowStreamsA) {
+Parser::Parser(const XRef *xrefA, Lexer *lexerA, GBool allowStreamsA,
+	       BaseStream *fetchStrA) {
   xref = xrefA;
   lexer = lexerA;
+  fetchStr = fetchStrA;
   inlineImg = 0;
   endOfActStream = 0;
   allowStreams = allowStreamsA;
@@ -47,7 +49,8 @@ Object *Parser::getObj(Object *obj, const Guchar *fileKey,
   DecryptStream *decrypt;
   const GString *s; 
   GString *s2;
-  int c;
+  char decryptBuf[256];
+  int n;
 
   // refill buffer after inline image data
   if (inlineImg == 2) {
@@ -141,8 +144,8 @@ Object *Parser::getObj(Object *obj, const Guchar *fileKey,
 				fileKey, encAlgorithm, keyLength,
 				objNum, objGen);
     decrypt->reset();
-    while ((c = decrypt->getChar()) != EOF) {
-      s2->append((char)c);
+    while ((n = decrypt->getBlock(decryptBuf, sizeof(decryptBuf))) > 0) {
+      s2->append(decryptBuf, n);
     }
     delete decrypt;
     obj->initString(s2);
@@ -175,7 +178,11 @@ Stream *Parser::makeStream(const Object *dict, const Guchar *fileKey,
   pos = lexer->getPos();
 
   // get length
-  dict->dictLookup("Length", &obj);
+  if (xref) {
+    xref->lookupFrom(fetchStr, dict->getDict(), "Length", &obj);
+  } else {
+    dict->dictLookup("Length", &obj);
+  }
   if (obj.isInt()) {
     length = (Guint)obj.getInt();
     obj.free();
@@ -223,7 +230,7 @@ Stream *Parser::makeStream(const Object *dict, const Guchar *fileKey,
   }
 
   // get filters
-  str = str->addFilters(dict);
+  str = str->addFilters(dict, xref, fetchStr);
 
   return str;
 }
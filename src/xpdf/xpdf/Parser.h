@@ -24,8 +24,10 @@
 class Parser {
 public:
 
-  // Constructor.
-  Parser(const XRef *xrefA, Lexer *lexerA, GBool allowStreamsA);
+  // Constructor.  Stream lengths and filter parameters are looked up
+  // through <fetchStrA> (see XRef::lookupFrom).
+  Parser(const XRef *xrefA, Lexer *lexerA, GBool allowStreamsA,
+	 BaseStream *fetchStrA = NULL);
 
   // Destructor.
   ~Parser();
@@ -55,6 +57,7 @@ private:
   const XRef *xref;		// the xref table for this PDF file
   Lexer *lexer;			// input stream
   GBool allowStreams;		// parse stream objects?
+  BaseStream *fetchStr;		// stream for indirect stream lengths
   Object buf1, buf2;		// next two tokens
   int inlineImg;		// set when inline image data is encountered
   size_t endOfActStream; // 1 means end of act stream
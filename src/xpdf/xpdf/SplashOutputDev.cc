@@ -1308,6 +1308,215 @@ void SplashOutputDev::eoFill(GfxState *state) {
   delete path;
 }
 
+// Builds a color lookup table with <lutSize> entries, evenly spaced
+// over the function domain of an axial or radial shading.  All
+// entries are evaluated in a single batch.  Returns a gmalloc'ed
+// table.
+SplashColorPtr SplashOutputDev::makeShadingLUT(GfxShading *shading,
+					       int lutSize) {
+  SplashColorPtr lut;
+  GfxColor *colors;
+  double *tVals;
+  double t0, t1;
+  int i;
+
+  if (shading->getType() == 2) {
+    t0 = ((GfxAxialShading *)shading)->getDomain0();
+    t1 = ((GfxAxialShading *)shading)->getDomain1();
+  } else {
+    t0 = ((GfxRadialShading *)shading)->getDomain0();
+    t1 = ((GfxRadialShading *)shading)->getDomain1();
+  }
+  tVals = (double *)gmallocn(lutSize, sizeof(double));
+  for (i = 0; i < lutSize; ++i) {
+    tVals[i] = t0 + (t1 - t0) * i / (lutSize - 1);
+  }
+  colors = (GfxColor *)gmallocn(lutSize, sizeof(GfxColor));
+  if (shading->getType() == 2) {
+    ((GfxAxialShading *)shading)->getColors(tVals, colors, lutSize);
+  } else {
+    ((GfxRadialShading *)shading)->getColors(tVals, colors, lutSize);
+  }
+  lut = (SplashColorPtr)gmallocn(lutSize, splashMaxColorComps);
+  convertShadingLUT(shading->getColorSpace(), colors, lutSize, lut);
+  gfree(colors);
+  gfree(tVals);
+  return lut;
+}
+
+// Converts the shading colors <colors> into <n> lookup table entries
+// (splashMaxColorComps bytes each) in the output color mode.
+void SplashOutputDev::convertShadingLUT(const GfxColorSpace *colorSpace,
+					const GfxColor *colors, int n,
+					SplashColorPtr lut) {
+  GfxGray gray;
+  GfxRGB rgb;
+#if SPLASH_CMYK
+  GfxCMYK cmyk;
+#endif
+  SplashColorPtr p;
+  int i;
+
+  for (i = 0, p = lut; i < n; ++i, p += splashMaxColorComps) {
+    switch (colorMode) {
+    case splashModeMono1:
+    case splashModeMono8:
+      colorSpace->getGray(&colors[i], &gray);
+      if (reverseVideo) {
+	gray = gfxColorComp1 - gray;
+      }
+      p[0] = colToByte(gray);
+      break;
+    case splashModeRGB8:
+    case splashModeBGR8:
+      colorSpace->getRGB(&colors[i], &rgb);
+      if (reverseVideo) {
+	rgb.r = gfxColorComp1 - rgb.r;
+	rgb.g = gfxColorComp1 - rgb.g;
+	rgb.b = gfxColorComp1 - rgb.b;
+      }
+      p[0] = colToByte(rgb.r);
+      p[1] = colToByte(rgb.g);
+      p[2] = colToByte(rgb.b);
+      break;
+#if SPLASH_CMYK
+    case splashModeCMYK8:
+      colorSpace->getCMYK(&colors[i], &cmyk);
+      p[0] = colToByte(cmyk.c);
+      p[1] = colToByte(cmyk.m);
+      p[2] = colToByte(cmyk.y);
+      p[3] = colToByte(cmyk.k);
+      break;
+#endif
+    }
+  }
+}
+
+// Returns the bounding box of the current clip region as a path (in
+// user space).
+SplashPath *SplashOutputDev::getUserClipPath(GfxState *state) {
+  SplashPath *path;
+  double xMin, yMin, xMax, yMax;
+
+  state->getUserClipBBox(&xMin, &yMin, &xMax, &yMax);
+  path = new SplashPath();
+  path->moveTo((SplashCoord)xMin, (SplashCoord)yMin);
+  path->lineTo((SplashCoord)xMax, (SplashCoord)yMin);
+  path->lineTo((SplashCoord)xMax, (SplashCoord)yMax);
+  path->lineTo((SplashCoord)xMin, (SplashCoord)yMax);
+  path->close();
+  return path;
+}
+
+GBool SplashOutputDev::axialShadedFill(GfxState *state,
+				       GfxAxialShading *shading) {
+  SplashColorPtr lut;
+  SplashPattern *pattern;
+  SplashPath *path;
+  const double *ctm;
+  double ictm[6], x0, y0, x1, y1, dx, dy, ddx, ddy, det, mul;
+  int lutSize;
+
+  if (state->getFillColorSpace()->isNonMarking()) {
+    return gTrue;
+  }
+  shading->getCoords(&x0, &y0, &x1, &y1);
+  dx = x1 - x0;
+  dy = y1 - y0;
+  ctm = state->getCTM();
+  det = ctm[0] * ctm[3] - ctm[1] * ctm[2];
+  if ((fabs(dx) < 0.01 && fabs(dy) < 0.01) || fabs(det) < 1e-6) {
+    // degenerate axis or matrix - let Gfx handle it
+    return gFalse;
+  }
+
+  // device space -> user space
+  det = 1 / det;
+  ictm[0] = ctm[3] * det;
+  ictm[1] = -ctm[1] * det;
+  ictm[2] = -ctm[2] * det;
+  ictm[3] = ctm[0] * det;
+  ictm[4] = (ctm[2] * ctm[5] - ctm[3] * ctm[4]) * det;
+  ictm[5] = (ctm[1] * ctm[4] - ctm[0] * ctm[5]) * det;
+
+  // one table entry per device pixel along the axis
+  state->transformDelta(dx, dy, &ddx, &ddy);
+  lutSize = (int)sqrt(ddx * ddx + ddy * ddy) + 2;
+  if (lutSize > splashOutMaxShadingLUTSize) {
+    lutSize = splashOutMaxShadingLUTSize;
+  }
+
+  lut = makeShadingLUT(shading, lutSize);
+
+  // t = ((x - x0) * dx + (y - y0) * dy) / (dx^2 + dy^2) in user space,
+  // which is an affine function of the device coordinates
+  mul = 1 / (dx * dx + dy * dy);
+  pattern = new SplashAxialPattern(lut, lutSize,
+				   shading->getExtend0(), shading->getExtend1(),
+				   (ictm[0] * dx + ictm[1] * dy) * mul,
+				   (ictm[2] * dx + ictm[3] * dy) * mul,
+				   ((ictm[4] - x0) * dx + (ictm[5] - y0) * dy)
+				     * mul);
+  gfree(lut);
+
+  path = getUserClipPath(state);
+  splash->shadedFill(path, pattern);
+  delete path;
+  delete pattern;
+  return gTrue;
+}
+
+GBool SplashOutputDev::radialShadedFill(GfxState *state,
+					GfxRadialShading *shading) {
+  SplashColorPtr lut;
+  SplashPattern *pattern;
+  SplashPath *path;
+  const double *ctm;
+  double ictm[6], x0, y0, r0, x1, y1, r1, det, len;
+  int lutSize;
+
+  if (state->getFillColorSpace()->isNonMarking()) {
+    return gTrue;
+  }
+  shading->getCoords(&x0, &y0, &r0, &x1, &y1, &r1);
+  ctm = state->getCTM();
+  det = ctm[0] * ctm[3] - ctm[1] * ctm[2];
+  if (fabs(det) < 1e-6) {
+    return gFalse;
+  }
+
+  // device space -> shading (user) space
+  len = sqrt(fabs(det));
+  det = 1 / det;
+  ictm[0] = ctm[3] * det;
+  ictm[1] = -ctm[1] * det;
+  ictm[2] = -ctm[2] * det;
+  ictm[3] = ctm[0] * det;
+  ictm[4] = (ctm[2] * ctm[5] - ctm[3] * ctm[4]) * det;
+  ictm[5] = (ctm[1] * ctm[4] - ctm[0] * ctm[5]) * det;
+
+  // one table entry per device pixel of circle movement
+  len *= fabs(r1 - r0) + sqrt((x1 - x0) * (x1 - x0) + (y1 - y0) * (y1 - y0));
+  lutSize = (int)len + 2;
+  if (lutSize > splashOutMaxShadingLUTSize) {
+    lutSize = splashOutMaxShadingLUTSize;
+  }
+
+  lut = makeShadingLUT(shading, lutSize);
+
+  pattern = new SplashRadialPattern(lut, lutSize,
+				    shading->getExtend0(),
+				    shading->getExtend1(),
+				    ictm, x0, y0, r0, x1, y1, r1);
+  gfree(lut);
+
+  path = getUserClipPath(state);
+  splash->shadedFill(path, pattern);
+  delete path;
+  delete pattern;
+  return gTrue;
+}
+
 void SplashOutputDev::clip(GfxState *state) {
   SplashPath *path;
 
@@ -1960,6 +2169,32 @@ GBool SplashOutputDev::alphaImageSrc(void *data, SplashColorPtr colorLine,
   return gTrue;
 }
 
+// Returns the factor (a power of two) by which a <width> x <height>
+// image can be reduced before drawing: each step halves the
+// resolution, and at least one sample per device pixel is kept in
+// each direction.  Reduced images are computed by averaging samples,
+// so this is limited to 8-bit components of non-indexed color spaces.
+static int getImageReduction(GfxState *state, int width, int height,
+			     GfxImageColorMap *colorMap) {
+  const double *ctm;
+  double w, h;
+  int reduction;
+
+  if (colorMap->getBits() != 8 ||
+      colorMap->getColorSpace()->getMode() == csIndexed) {
+    return 1;
+  }
+  ctm = state->getCTM();
+  w = sqrt(ctm[0] * ctm[0] + ctm[1] * ctm[1]);
+  h = sqrt(ctm[2] * ctm[2] + ctm[3] * ctm[3]);
+  reduction = 1;
+  while (reduction < 256 &&
+	 width / (2 * reduction) >= w && height / (2 * reduction) >= h) {
+    reduction *= 2;
+  }
+  return reduction;
+}
+
 void SplashOutputDev::drawImage(GfxState *state, Object *ref, Stream *str,
 				int width, int height,
 				GfxImageColorMap *colorMap,
@@ -1975,7 +2210,7 @@ void SplashOutputDev::drawImage(GfxState *state, Object *ref, Stream *str,
   GfxCMYK cmyk;
 #endif
   Guchar pix;
-  int n, i;
+  int reduction, n, i;
 
   ctm = state->getCTM();
   mat[0] = ctm[0];
@@ -1985,9 +2220,14 @@ void SplashOutputDev::drawImage(GfxState *state, Object *ref, Stream *str,
   mat[4] = ctm[2] + ctm[4];
   mat[5] = ctm[3] + ctm[5];
 
-  imgData.imgStr = new ImageStream(str, width,
+  // (color key masking needs the exact sample values)
+  reduction = maskColors ? 1 : getImageReduction(state, width, height,
+						 colorMap);
+  imgData.imgStr = new ImageStream(str, width, height,
 				   colorMap->getNumPixelComps(),
-				   colorMap->getBits());
+				   colorMap->getBits(), reduction);
+  width = imgData.imgStr->getWidth();
+  height = imgData.imgStr->getHeight();
   imgData.imgStr->reset();
   imgData.colorMap = colorMap;
   imgData.maskColors = maskColors;
@@ -2193,6 +2433,15 @@ void SplashOutputDev::drawMaskedImage(GfxState *state, Object *ref,
 
   } else {
 
+    // set up the (possibly reduced) source image
+    imgData.imgStr = new ImageStream(str, width, height,
+				     colorMap->getNumPixelComps(),
+				     colorMap->getBits(),
+				     getImageReduction(state, width, height,
+						       colorMap));
+    width = imgData.imgStr->getWidth();
+    height = imgData.imgStr->getHeight();
+
     //----- scale the mask image to the same size as the source image
 
     mat[0] = (SplashCoord)width;
@@ -2229,9 +2478,6 @@ void SplashOutputDev::drawMaskedImage(GfxState *state, Object *ref,
     mat[4] = ctm[2] + ctm[4];
     mat[5] = ctm[3] + ctm[5];
 
-    imgData.imgStr = new ImageStream(str, width,
-				     colorMap->getNumPixelComps(),
-				     colorMap->getBits());
     imgData.imgStr->reset();
     imgData.colorMap = colorMap;
     imgData.mask = maskBitmap;
@@ -2329,9 +2575,14 @@ void SplashOutputDev::drawSoftMaskedImage(GfxState *state, Object *ref,
 
   //----- set up the soft mask
 
-  imgMaskData.imgStr = new ImageStream(maskStr, maskWidth,
+  imgMaskData.imgStr = new ImageStream(maskStr, maskWidth, maskHeight,
 				       maskColorMap->getNumPixelComps(),
-				       maskColorMap->getBits());
+				       maskColorMap->getBits(),
+				       getImageReduction(state, maskWidth,
+							 maskHeight,
+							 maskColorMap));
+  maskWidth = imgMaskData.imgStr->getWidth();
+  maskHeight = imgMaskData.imgStr->getHeight();
   imgMaskData.imgStr->reset();
   imgMaskData.colorMap = maskColorMap;
   imgMaskData.maskColors = NULL;
@@ -2361,9 +2612,13 @@ void SplashOutputDev::drawSoftMaskedImage(GfxState *state, Object *ref,
 
   //----- draw the source image
 
-  imgData.imgStr = new ImageStream(str, width,
+  imgData.imgStr = new ImageStream(str, width, height,
 				   colorMap->getNumPixelComps(),
-				   colorMap->getBits());
+				   colorMap->getBits(),
+				   getImageReduction(state, width, height,
+						     colorMap));
+  width = imgData.imgStr->getWidth();
+  height = imgData.imgStr->getHeight();
   imgData.imgStr->reset();
   imgData.colorMap = colorMap;
   imgData.maskColors = NULL;
@@ -38,6 +38,9 @@ struct SplashTransparencyGroup;
 // number of Type 3 fonts to cache
 #define splashOutT3FontCacheSize 8
 
+// maximum number of entries in a shading color lookup table
+#define splashOutMaxShadingLUTSize 4096
+
 //------------------------------------------------------------------------
 // SplashOutputDev
 //------------------------------------------------------------------------
@@ -67,6 +70,11 @@ public:
   // text in Type 3 fonts will be drawn with drawChar/drawString.
   virtual GBool interpretType3Chars()const { return gTrue; }
 
+  // Does this device use functionShadedFill(), axialShadedFill(), and
+  // radialShadedFill()?  Axial and radial shadings are filled from a
+  // color lookup table; function shadings fall back to Gfx.
+  virtual GBool useShadedFills()const { return gTrue; }
+
   //----- initialization and control
 
   // Start a page.
@@ -104,6 +112,10 @@ public:
   virtual void fill(GfxState *state);
   virtual void eoFill(GfxState *state);
 
+  //----- shaded fills
+  virtual GBool axialShadedFill(GfxState *state, GfxAxialShading *shading);
+  virtual GBool radialShadedFill(GfxState *state, GfxRadialShading *shading);
+
   //----- path clipping
   virtual void clip(GfxState *state);
   virtual void eoClip(GfxState *state);
@@ -204,6 +216,11 @@ private:
 #else
   SplashPattern *getColor(GfxGray gray, GfxRGB *rgb);
 #endif
+  SplashColorPtr makeShadingLUT(GfxShading *shading, int lutSize);
+  void convertShadingLUT(const GfxColorSpace *colorSpace,
+			 const GfxColor *colors, int n,
+			 SplashColorPtr lut);
+  SplashPath *getUserClipPath(GfxState *state);
   SplashPath *convertPath(GfxState *state, GfxPath *path);
   void doUpdateFont(GfxState *state);
   void drawType3Glyph(T3FontCache *t3Font,
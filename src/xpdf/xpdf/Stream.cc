@@ -35,12 +35,15 @@
 #include <ctype.h>
 #include "goo/gmem.h"
 #include "goo/gfile.h"
+#include "goo/GThread.h"
 #include "xpdf/config.h"
 #include "xpdf/Error.h"
 #include "xpdf/Object.h"
 #include "xpdf/Lexer.h"
 #include "xpdf/GfxState.h"
+#include "xpdf/GlobalParams.h"
 #include "xpdf/Stream.h"
+#include "xpdf/XRef.h"
 #include "xpdf/JBIG2Stream.h"
 #include "xpdf/JPXStream.h"
 #include "xpdf/Stream-CCITT.h"
@@ -76,6 +79,30 @@ int Stream::getRawChar() {
   return EOF;
 }
 
+int Stream::getBlock(char *blk, int size) {
+  int n, c;
+
+  for (n = 0; n < size; ++n) {
+    if ((c = getChar()) == EOF) {
+      break;
+    }
+    blk[n] = (char)c;
+  }
+  return n;
+}
+
+int Stream::getRawBlock(char *blk, int size) {
+  int n, c;
+
+  for (n = 0; n < size; ++n) {
+    if ((c = getRawChar()) == EOF) {
+      break;
+    }
+    blk[n] = (char)c;
+  }
+  return n;
+}
+
 char *Stream::getLine(char *buf, int size) {
   int i;
   int c;
@@ -101,34 +128,57 @@ GString *Stream::getPSFilter(int psLevel,const char *indent)const {
   return new GString();
 }
 
-Stream *Stream::addFilters(const Object *dict) {
+// Looks up <key> in the <dict> dictionary.  If <fetchStr> is given,
+// an indirect value is fetched through it (see XRef::lookupFrom).
+static Object *filterLookup(const Object *dict, const char *key,
+			    const XRef *xref, BaseStream *fetchStr,
+			    Object *obj) {
+  if (xref && fetchStr) {
+    return xref->lookupFrom(fetchStr, dict->getDict(), key, obj);
+  }
+  return dict->dictLookup(key, obj);
+}
+
+// Gets the <i>th element of the <array> (see filterLookup).
+static Object *filterArrayGet(const Object *array, int i,
+			      const XRef *xref, BaseStream *fetchStr,
+			      Object *obj) {
+  if (xref && fetchStr) {
+    return xref->resolveFrom(fetchStr, array->arrayGetNF(i, obj));
+  }
+  return array->arrayGet(i, obj);
+}
+
+Stream *Stream::addFilters(const Object *dict, const XRef *xref,
+			    BaseStream *fetchStr) {
   Object obj, obj2;
   Object params, params2;
   Stream *str;
   int i;
 
   str = this;
-  dict->dictLookup("Filter", &obj);
+  filterLookup(dict, "Filter", xref, fetchStr, &obj);
   if (obj.isNull()) {
     obj.free();
-    dict->dictLookup("F", &obj);
+    filterLookup(dict, "F", xref, fetchStr, &obj);
   }
-  dict->dictLookup("DecodeParms", &params);
+  filterLookup(dict, "DecodeParms", xref, fetchStr, &params);
   if (params.isNull()) {
     params.free();
-    dict->dictLookup("DP", &params);
+    filterLookup(dict, "DP", xref, fetchStr, &params);
   }
   if (obj.isName()) {
-    str = makeFilter(obj.getName(), str, &params);
+    str = makeFilter(obj.getName(), str, &params, xref, fetchStr);
   } else if (obj.isArray()) {
     for (i = 0; i < obj.arrayGetLength(); ++i) {
-      obj.arrayGet(i, &obj2);
+      filterArrayGet(&obj, i, xref, fetchStr, &obj2);
       if (params.isArray())
-	params.arrayGet(i, &params2);
+	filterArrayGet(&params, i, xref, fetchStr, &params2);
       else
 	params2.initNull();
       if (obj2.isName()) {
-	str = makeFilter(obj2.getName(), str, &params2);
+	str = makeFilter(obj2.getName(), str, &params2, xref,
+			 fetchStr);
       } else {
 	error(getPos(), "Bad filter name");
 	str = new EOFStream(str);
@@ -145,7 +195,8 @@ Stream *Stream::addFilters(const Object *dict) {
   return str;
 }
 
-Stream *Stream::makeFilter(const char *name, Stream *str, const Object *params) {
+Stream *Stream::makeFilter(const char *name, Stream *str, const Object *params,
+			   const XRef *xref, BaseStream *fetchStr) {
   int pred;			// parameters
   int colors;
   int bits;
@@ -167,23 +218,23 @@ Stream *Stream::makeFilter(const char *name, Stream *str, const Object *params)
     bits = 8;
     early = 1;
     if (params->isDict()) {
-      params->dictLookup("Predictor", &obj);
+      filterLookup(params, "Predictor", xref, fetchStr, &obj);
       if (obj.isInt())
 	pred = obj.getInt();
       obj.free();
-      params->dictLookup("Columns", &obj);
+      filterLookup(params, "Columns", xref, fetchStr, &obj);
       if (obj.isInt())
 	columns = obj.getInt();
       obj.free();
-      params->dictLookup("Colors", &obj);
+      filterLookup(params, "Colors", xref, fetchStr, &obj);
       if (obj.isInt())
 	colors = obj.getInt();
       obj.free();
-      params->dictLookup("BitsPerComponent", &obj);
+      filterLookup(params, "BitsPerComponent", xref, fetchStr, &obj);
       if (obj.isInt())
 	bits = obj.getInt();
       obj.free();
-      params->dictLookup("EarlyChange", &obj);
+      filterLookup(params, "EarlyChange", xref, fetchStr, &obj);
       if (obj.isInt())
 	early = obj.getInt();
       obj.free();
@@ -200,37 +251,37 @@ Stream *Stream::makeFilter(const char *name, Stream *str, const Object *params)
     endOfBlock = gTrue;
     black = gFalse;
     if (params->isDict()) {
-      params->dictLookup("K", &obj);
+      filterLookup(params, "K", xref, fetchStr, &obj);
       if (obj.isInt()) {
 	encoding = obj.getInt();
       }
       obj.free();
-      params->dictLookup("EndOfLine", &obj);
+      filterLookup(params, "EndOfLine", xref, fetchStr, &obj);
       if (obj.isBool()) {
 	endOfLine = obj.getBool();
       }
       obj.free();
-      params->dictLookup("EncodedByteAlign", &obj);
+      filterLookup(params, "EncodedByteAlign", xref, fetchStr, &obj);
       if (obj.isBool()) {
 	byteAlign = obj.getBool();
       }
       obj.free();
-      params->dictLookup("Columns", &obj);
+      filterLookup(params, "Columns", xref, fetchStr, &obj);
       if (obj.isInt()) {
 	columns = obj.getInt();
       }
       obj.free();
-      params->dictLookup("Rows", &obj);
+      filterLookup(params, "Rows", xref, fetchStr, &obj);
       if (obj.isInt()) {
 	rows = obj.getInt();
       }
       obj.free();
-      params->dictLookup("EndOfBlock", &obj);
+      filterLookup(params, "EndOfBlock", xref, fetchStr, &obj);
       if (obj.isBool()) {
 	endOfBlock = obj.getBool();
       }
       obj.free();
-      params->dictLookup("BlackIs1", &obj);
+      filterLookup(params, "BlackIs1", xref, fetchStr, &obj);
       if (obj.isBool()) {
 	black = obj.getBool();
       }
@@ -241,7 +292,8 @@ Stream *Stream::makeFilter(const char *name, Stream *str, const Object *params)
   } else if (!strcmp(name, "DCTDecode") || !strcmp(name, "DCT")) {
     colorXform = -1;
     if (params->isDict()) {
-      if (params->dictLookup("ColorTransform", &obj)->isInt()) {
+      if (filterLookup(params, "ColorTransform", xref, fetchStr,
+		       &obj)->isInt()) {
 	colorXform = obj.getInt();
       }
       obj.free();
@@ -253,19 +305,19 @@ Stream *Stream::makeFilter(const char *name, Stream *str, const Object *params)
     colors = 1;
     bits = 8;
     if (params->isDict()) {
-      params->dictLookup("Predictor", &obj);
+      filterLookup(params, "Predictor", xref, fetchStr, &obj);
       if (obj.isInt())
 	pred = obj.getInt();
       obj.free();
-      params->dictLookup("Columns", &obj);
+      filterLookup(params, "Columns", xref, fetchStr, &obj);
       if (obj.isInt())
 	columns = obj.getInt();
       obj.free();
-      params->dictLookup("Colors", &obj);
+      filterLookup(params, "Colors", xref, fetchStr, &obj);
       if (obj.isInt())
 	colors = obj.getInt();
       obj.free();
-      params->dictLookup("BitsPerComponent", &obj);
+      filterLookup(params, "BitsPerComponent", xref, fetchStr, &obj);
       if (obj.isInt())
 	bits = obj.getInt();
       obj.free();
@@ -273,7 +325,7 @@ Stream *Stream::makeFilter(const char *name, Stream *str, const Object *params)
     str = new FlateStream(str, pred, columns, colors, bits);
   } else if (!strcmp(name, "JBIG2Decode")) {
     if (params->isDict()) {
-      params->dictLookup("JBIG2Globals", &globals);
+      filterLookup(params, "JBIG2Globals", xref, fetchStr, &globals);
     }
     str = new JBIG2Stream(str, &globals);
     globals.free();
@@ -304,6 +356,7 @@ BaseStream::~BaseStream() {
 
 FilterStream::FilterStream(Stream *strA) {
   str = strA;
+  inputPtr = inputEnd = inputBlk;
 }
 
 FilterStream::~FilterStream() {
@@ -317,6 +370,53 @@ void FilterStream::setPos(Guint pos, int dir) {
   error(-1, "Internal: called setPos() on FilterStream");
 }
 
+int FilterStream::lookInputChar() {
+  if (inputPtr < inputEnd) {
+    return *inputPtr & 0xff;
+  }
+  // don't consume anything from an unbounded stream
+  if (!str->isBounded()) {
+    return str->lookChar();
+  }
+  return fillInput() ? (*inputPtr & 0xff) : EOF;
+}
+
+int FilterStream::getInputBlock(char *blk, int size) {
+  int n, m;
+
+  n = (int)(inputEnd - inputPtr);
+  if (n > size) {
+    n = size;
+  }
+  memcpy(blk, inputPtr, n);
+  inputPtr += n;
+  if (n < size) {
+    // the rest is read directly, without copying through inputBlk -- the
+    // caller asked for exactly these chars, so this is safe even if str is
+    // not bounded
+    m = str->getBlock(blk + n, size - n);
+    n += m;
+  }
+  return n;
+}
+
+GBool FilterStream::fillInput() {
+  int n, c;
+
+  if (str->isBounded()) {
+    n = str->getBlock(inputBlk, filterInputBufSize);
+  } else {
+    // exactly one char, so that nothing behind our data is consumed
+    n = 0;
+    if ((c = str->getChar()) != EOF) {
+      inputBlk[n++] = (char)c;
+    }
+  }
+  inputPtr = inputBlk;
+  inputEnd = inputBlk + n;
+  return n > 0;
+}
+
 //------------------------------------------------------------------------
 // ImageStream
 //------------------------------------------------------------------------
@@ -326,6 +426,7 @@ ImageStream::ImageStream(Stream *strA, int widthA, int nCompsA, int nBitsA) {
 
   str = strA;
   width = widthA;
+  height = 0;
   nComps = nCompsA;
   nBits = nBitsA;
 
@@ -341,14 +442,118 @@ ImageStream::ImageStream(Stream *strA, int widthA, int nCompsA, int nBitsA) {
   }
   imgLine = (Guchar *)gmallocn(imgLineSize, sizeof(Guchar));
   imgIdx = nVals;
+  if (nBits != 8) {
+    if (nVals > (INT_MAX - 7) / nBits) {
+      // force a call to gmallocn(-1,...), which will throw an exception
+      inputLineSize = -1;
+    } else {
+      inputLineSize = (nVals * nBits + 7) >> 3;
+    }
+    inputLine = (Guchar *)gmallocn(inputLineSize, sizeof(Guchar));
+  } else {
+    // 8 bit lines are read directly into imgLine
+    inputLineSize = nVals;
+    inputLine = NULL;
+  }
+
+  reduction = 1;
+  fullWidth = width;
+  fullHeight = height;
+  boxSize = 1;
+  srcWidth = srcHeight = srcY = srcVals = 0;
+  srcLine = NULL;
+  boxSum = NULL;
+}
+
+ImageStream::ImageStream(Stream *strA, int widthA, int heightA,
+			 int nCompsA, int nBitsA, int reductionA) {
+  int imgLineSize;
+
+  str = strA;
+  nComps = nCompsA;
+  nBits = nBitsA;
+  reduction = 1;
+  if (nBits == 8 && widthA > 0 && heightA > 0) {
+    // (limited so that the box sums can't overflow)
+    while (2 * reduction <= reductionA && reduction < 256) {
+      reduction <<= 1;
+    }
+  }
+  fullWidth = widthA;
+  fullHeight = heightA;
+  width = reduction > 1 ? (widthA - 1) / reduction + 1 : widthA;
+  height = reduction > 1 ? (heightA - 1) / reduction + 1 : heightA;
+
+  nVals = width * nComps;
+  if (nBits == 1) {
+    imgLineSize = (nVals + 7) & ~7;
+  } else {
+    imgLineSize = nVals;
+  }
+  if (width > INT_MAX / nComps) {
+    // force a call to gmallocn(-1,...), which will throw an exception
+    imgLineSize = -1;
+  }
+  imgLine = (Guchar *)gmallocn(imgLineSize, sizeof(Guchar));
+  imgIdx = nVals;
+  if (nBits != 8) {
+    if (nVals > (INT_MAX - 7) / nBits) {
+      // force a call to gmallocn(-1,...), which will throw an exception
+      inputLineSize = -1;
+    } else {
+      inputLineSize = (nVals * nBits + 7) >> 3;
+    }
+    inputLine = (Guchar *)gmallocn(inputLineSize, sizeof(Guchar));
+  } else {
+    // 8 bit lines are read directly into imgLine
+    inputLineSize = nVals;
+    inputLine = NULL;
+  }
+
+  boxSize = 1;
+  srcWidth = srcHeight = srcY = srcVals = 0;
+  srcLine = NULL;
+  boxSum = NULL;
 }
 
 ImageStream::~ImageStream() {
   gfree(imgLine);
+  gfree(inputLine);
+  gfree(srcLine);
+  gfree(boxSum);
 }
 
 void ImageStream::reset() {
+  int strReduction;
+
+  // the base stream is reduced only while it is read through this
+  // image stream -- other readers get the full image
+  if (reduction > 1) {
+    str->setImageReduction(reduction);
+  }
   str->reset();
+  if (reduction > 1) {
+    str->setImageReduction(1);
+    gfree(srcLine);
+    gfree(boxSum);
+    srcLine = NULL;
+    boxSum = NULL;
+
+    // whatever the base stream didn't reduce is box filtered here
+    strReduction = str->getImageReduction();
+    if (strReduction < 1 || strReduction > reduction) {
+      strReduction = 1;
+    }
+    boxSize = reduction / strReduction;
+    srcWidth = (fullWidth - 1) / strReduction + 1;
+    srcHeight = (fullHeight - 1) / strReduction + 1;
+    srcY = 0;
+    if (boxSize > 1) {
+      srcVals = srcWidth * nComps;
+      srcLine = (Guchar *)gmallocn(srcVals, sizeof(Guchar));
+      boxSum = (Guint *)gmallocn(nVals, sizeof(Guint));
+    }
+  }
 }
 
 GBool ImageStream::getPixel(Guchar *pix) {
@@ -365,14 +570,75 @@ GBool ImageStream::getPixel(Guchar *pix) {
 }
 
 Guchar *ImageStream::getLine() {
+  Guchar *p;
+  Guint *q;
+  int nLines, cols, n, x, i, j;
+
+  if (boxSize == 1) {
+    readLine();
+    return imgLine;
+  }
+
+  // sum up the next <boxSize> lines
+  memset(boxSum, 0, nVals * sizeof(Guint));
+  for (nLines = 0; nLines < boxSize && srcY < srcHeight; ++nLines, ++srcY) {
+    readInput(srcLine, srcVals);
+    p = srcLine;
+    q = boxSum;
+    for (x = 0; x < srcWidth; x += boxSize) {
+      cols = srcWidth - x < boxSize ? srcWidth - x : boxSize;
+      for (i = 0; i < cols; ++i) {
+	for (j = 0; j < nComps; ++j) {
+	  q[j] += *p++;
+	}
+      }
+      q += nComps;
+    }
+  }
+  if (nLines == 0) {
+    nLines = 1;
+  }
+
+  // and average them -- the boxes at the right and bottom edges may be
+  // smaller
+  q = boxSum;
+  p = imgLine;
+  for (x = 0; x < srcWidth; x += boxSize) {
+    cols = srcWidth - x < boxSize ? srcWidth - x : boxSize;
+    n = nLines * cols;
+    for (j = 0; j < nComps; ++j) {
+      *p++ = (Guchar)((*q++ + n / 2) / n);
+    }
+  }
+  return imgLine;
+}
+
+void ImageStream::readInput(Guchar *p, int n) {
+  int m;
+
+  m = str->getBlock((char *)p, n);
+  // missing data are read as EOF (0xff) as if read by getChar()
+  if (m < n) {
+    memset(p + m, 0xff, n - m);
+  }
+}
+
+void ImageStream::readLine() {
   Gulong buf, bitMask;
+  Guchar *p;
   int bits;
   int c;
   int i;
 
+  if (nBits == 8) {
+    readInput(imgLine, nVals);
+    return;
+  }
+  readInput(inputLine, inputLineSize);
+  p = inputLine;
   if (nBits == 1) {
     for (i = 0; i < nVals; i += 8) {
-      c = str->getChar();
+      c = *p++;
       imgLine[i+0] = (Guchar)((c >> 7) & 1);
       imgLine[i+1] = (Guchar)((c >> 6) & 1);
       imgLine[i+2] = (Guchar)((c >> 5) & 1);
@@ -382,32 +648,37 @@ Guchar *ImageStream::getLine() {
       imgLine[i+6] = (Guchar)((c >> 1) & 1);
       imgLine[i+7] = (Guchar)(c & 1);
     }
-  } else if (nBits == 8) {
-    for (i = 0; i < nVals; ++i) {
-      imgLine[i] = str->getChar();
-    }
   } else {
     bitMask = (1 << nBits) - 1;
     buf = 0;
     bits = 0;
     for (i = 0; i < nVals; ++i) {
       if (bits < nBits) {
-	buf = (buf << 8) | (str->getChar() & 0xff);
+	buf = (buf << 8) | *p++;
 	bits += 8;
       }
       imgLine[i] = (Guchar)((buf >> (bits - nBits)) & bitMask);
       bits -= nBits;
     }
   }
-  return imgLine;
 }
 
 void ImageStream::skipLine() {
-  int n, i;
+  char buf[256];
+  int n, m;
 
-  n = (nVals * nBits + 7) >> 3;
-  for (i = 0; i < n; ++i) {
-    str->getChar();
+  if (boxSize > 1) {
+    getLine();
+    return;
+  }
+  // imgLine is kept untouched
+  n = inputLineSize;
+  while (n > 0) {
+    m = str->getBlock(buf, n < (int)sizeof(buf) ? n : (int)sizeof(buf));
+    if (m <= 0) {
+      break;
+    }
+    n -= m;
   }
 }
 
@@ -424,6 +695,7 @@ void StreamPredictor::initContext(int predictorA,
   nComps = nCompsA;
   nBits = nBitsA;
   predLine = NULL;
+  rawLine = NULL;
   ok = gFalse;
 
   nVals = width * nComps;
@@ -439,6 +711,7 @@ void StreamPredictor::initContext(int predictorA,
   predLine = (Guchar *)gmalloc(rowBytes);
   memset(predLine, 0, rowBytes);
   predIdx = rowBytes;
+  rawLine = (Guchar *)gmalloc(rowBytes);
 
   ok = gTrue;
 }
@@ -457,6 +730,7 @@ StreamPredictor::StreamPredictor(Stream * strA, PredictorContext & context)
 
 StreamPredictor::~StreamPredictor() {
   gfree(predLine);
+  gfree(rawLine);
 }
 
 int StreamPredictor::lookChar() {
@@ -477,6 +751,27 @@ int StreamPredictor::getChar() {
   return predLine[predIdx++];
 }
 
+int StreamPredictor::getBlock(char *blk, int size) {
+  int n, m;
+
+  n = 0;
+  while (n < size) {
+    if (predIdx >= rowBytes) {
+      if (!getNextLine()) {
+	break;
+      }
+    }
+    m = rowBytes - predIdx;
+    if (m > size - n) {
+      m = size - n;
+    }
+    memcpy(blk + n, predLine + predIdx, m);
+    predIdx += m;
+    n += m;
+  }
+  return n;
+}
+
 GBool StreamPredictor::getNextLine() {
   int curPred;
   Guchar upLeftBuf[gfxColorMaxComps * 2 + 1];
@@ -484,7 +779,7 @@ GBool StreamPredictor::getNextLine() {
   int c;
   Gulong inBuf, outBuf, bitMask;
   int inBits, outBits;
-  int i, j, k, kk;
+  int i, j, k, kk, end;
 
   // get PNG optimum predictor number
   if (predictor >= 10) {
@@ -496,22 +791,23 @@ GBool StreamPredictor::getNextLine() {
     curPred = predictor;
   }
 
-  // read the raw line, apply PNG (byte) predictor
+  // read the raw line -- if it is shorter, this ought to return false,
+  // but some (broken) PDF files contain truncated image data, and Adobe
+  // apparently reads the last partial line
+  end = pixBytes + str->getRawBlock((char *)rawLine + pixBytes,
+				    rowBytes - pixBytes);
+  if (end == pixBytes) {
+    return gFalse;
+  }
+
+  // apply PNG (byte) predictor
   memset(upLeftBuf, 0, pixBytes + 1);
-  for (i = pixBytes; i < rowBytes; ++i) {
+  for (i = pixBytes; i < end; ++i) {
     for (j = pixBytes; j > 0; --j) {
       upLeftBuf[j] = upLeftBuf[j-1];
     }
     upLeftBuf[0] = predLine[i];
-    if ((c = str->getRawChar()) == EOF) {
-      if (i > pixBytes) {
-	// this ought to return false, but some (broken) PDF files
-	// contain truncated image data, and Adobe apparently reads the
-	// last partial line
-	break;
-      }
-      return gFalse;
-    }
+    c = rawLine[i];
     switch (curPred) {
     case 11:			// PNG sub
       predLine[i] = predLine[i - pixBytes] + (Guchar)c;
@@ -733,6 +1029,47 @@ GBool FileStream::fillBuf() {
   return gTrue;
 }
 
+int FileStream::getBlock(char *blk, int size) {
+  int n, m;
+
+  n = 0;
+  while (n < size) {
+    if (bufPtr >= bufEnd) {
+      if (size - n < fileStreamBufSize) {
+	if (!fillBuf()) {
+	  break;
+	}
+      } else {
+	// big blocks are read directly, bypassing buf
+	bufPos += bufEnd - buf;
+	bufPtr = bufEnd = buf;
+	if (limited && bufPos >= start + length) {
+	  break;
+	}
+	m = size - n;
+	if (limited && bufPos + m > start + length) {
+	  m = start + length - bufPos;
+	}
+	m = fread(blk + n, 1, m, f);
+	if (m <= 0) {
+	  break;
+	}
+	bufPos += m;
+	n += m;
+	continue;
+      }
+    }
+    m = (int)(bufEnd - bufPtr);
+    if (m > size - n) {
+      m = size - n;
+    }
+    memcpy(blk + n, bufPtr, m);
+    bufPtr += m;
+    n += m;
+  }
+  return n;
+}
+
 void FileStream::setPos(Guint pos, int dir) {
   Guint size;
 
@@ -782,6 +1119,22 @@ void FileStream::moveStart(int delta) {
   bufPos = start;
 }
 
+GFileMap *FileStream::map() {
+  GFileMap *fileMap;
+
+  if (limited && length == 0) {
+    return NULL;
+  }
+  // the file may be opened for writing as well
+  fflush(f);
+  fileMap = new GFileMap(f, start, limited ? length : 0);
+  if (!fileMap->isOk()) {
+    delete fileMap;
+    return NULL;
+  }
+  return fileMap;
+}
+
 //------------------------------------------------------------------------
 // MemStream
 //------------------------------------------------------------------------
@@ -849,6 +1202,18 @@ void MemStream::reset() {
 void MemStream::close() {
 }
 
+int MemStream::getBlock(char *blk, int size) {
+  int n;
+
+  n = (int)(bufEnd - bufPtr);
+  if (n > size) {
+    n = size;
+  }
+  memcpy(blk, bufPtr, n);
+  bufPtr += n;
+  return n;
+}
+
 void MemStream::setPos(Guint pos, int dir) {
   Guint i;
 
@@ -930,6 +1295,17 @@ int EmbedStream::lookChar() {
   return str->lookChar();
 }
 
+int EmbedStream::getBlock(char *blk, int size) {
+  int n;
+
+  if (limited && (Guint)size > length) {
+    size = (int)length;
+  }
+  n = str->getBlock(blk, size);
+  length -= n;
+  return n;
+}
+
 void EmbedStream::setPos(Guint pos, int dir) {
   error(-1, "Internal: called setPos() on EmbedStream");
 }
@@ -971,6 +1347,7 @@ ASCIIHexStream::~ASCIIHexStream() {
 
 void ASCIIHexStream::reset() {
   str->reset();
+  resetInput();
   buf = EOF;
   eof = gFalse;
 }
@@ -985,7 +1362,7 @@ int ASCIIHexStream::lookChar() {
     return EOF;
   }
   do {
-    c1 = str->getChar();
+    c1 = getInputChar();
   } while (isspace(c1));
   if (c1 == '>') {
     eof = gTrue;
@@ -993,7 +1370,7 @@ int ASCIIHexStream::lookChar() {
     return buf;
   }
   do {
-    c2 = str->getChar();
+    c2 = getInputChar();
   } while (isspace(c2));
   if (c2 == '>') {
     eof = gTrue;
@@ -1073,6 +1450,7 @@ ASCII85Stream::~ASCII85Stream() {
 
 void ASCII85Stream::reset() {
   str->reset();
+  resetInput();
   index = n = 0;
   eof = gFalse;
 }
@@ -1086,7 +1464,7 @@ int ASCII85Stream::lookChar() {
       return EOF;
     index = 0;
     do {
-      c[0] = str->getChar();
+      c[0] = getInputChar();
     } while (Lexer::isSpace(c[0]));
     if (c[0] == '~' || c[0] == EOF) {
       eof = gTrue;
@@ -1098,7 +1476,7 @@ int ASCII85Stream::lookChar() {
     } else {
       for (k = 1; k < 5; ++k) {
 	do {
-	  c[k] = str->getChar();
+	  c[k] = getInputChar();
 	} while (Lexer::isSpace(c[k]));
 	if (c[k] == '~' || c[k] == EOF)
 	  break;
@@ -1237,8 +1615,40 @@ int LZWStream::getRawChar() {
   return seqBuf[seqIndex++];
 }
 
+int LZWStream::getBlock(char *blk, int size) {
+  if (pred) {
+    return pred->getBlock(blk, size);
+  }
+  return getRawBlock(blk, size);
+}
+
+int LZWStream::getRawBlock(char *blk, int size) {
+  int n, m;
+
+  if (eof) {
+    return 0;
+  }
+  n = 0;
+  while (n < size) {
+    if (seqIndex >= seqLength) {
+      if (!processNextCode()) {
+	break;
+      }
+    }
+    m = seqLength - seqIndex;
+    if (m > size - n) {
+      m = size - n;
+    }
+    memcpy(blk + n, seqBuf + seqIndex, m);
+    seqIndex += m;
+    n += m;
+  }
+  return n;
+}
+
 void LZWStream::reset() {
   str->reset();
+  resetInput();
   eof = gFalse;
   inputBits = 0;
   clearTable();
@@ -1325,7 +1735,7 @@ int LZWStream::getCode() {
   int code;
 
   while (inputBits < nextBits) {
-    if ((c = str->getChar()) == EOF)
+    if ((c = getInputChar()) == EOF)
       return EOF;
     inputBuf = (inputBuf << 8) | (c & 0xff);
     inputBits += 8;
@@ -1383,6 +1793,7 @@ RunLengthStream::~RunLengthStream() {
 
 void RunLengthStream::reset() {
   str->reset();
+  resetInput();
   bufPtr = bufEnd = buf;
   eof = gFalse;
 }
@@ -1404,13 +1815,32 @@ GBool RunLengthStream::isBinary(GBool last)const {
   return str->isBinary(gTrue);
 }
 
+int RunLengthStream::getBlock(char *blk, int size) {
+  int n, m;
+
+  n = 0;
+  while (n < size) {
+    if (bufPtr >= bufEnd && !fillBuf()) {
+      break;
+    }
+    m = (int)(bufEnd - bufPtr);
+    if (m > size - n) {
+      m = size - n;
+    }
+    memcpy(blk + n, bufPtr, m);
+    bufPtr += m;
+    n += m;
+  }
+  return n;
+}
+
 GBool RunLengthStream::fillBuf() {
   int c;
   int n, i;
 
   if (eof)
     return gFalse;
-  c = str->getChar();
+  c = getInputChar();
   if (c == 0x80 || c == EOF) {
     eof = gTrue;
     return gFalse;
@@ -1418,10 +1848,10 @@ GBool RunLengthStream::fillBuf() {
   if (c < 0x80) {
     n = c + 1;
     for (i = 0; i < n; ++i)
-      buf[i] = (char)str->getChar();
+      buf[i] = (char)getInputChar();
   } else {
     n = 0x101 - c;
-    c = str->getChar();
+    c = getInputChar();
     for (i = 0; i < n; ++i)
       buf[i] = (char)c;
   }
@@ -2142,6 +2572,34 @@ static int dctZigZag[64] = {
   63
 };
 
+// zig zag decode map into transposed data units (fast decoder)
+static int dctZigZagT[64];
+
+// basis functions for the reduced-size IDCT (fast decoder):
+// tab[k * n + u] = round(4096 * c(u) * cos((2k + 1) * u * pi / 2n)),
+// with c(0) = 1 / (2 * sqrt(2)) and c(u) = 1/2 otherwise (i.e., the
+// 8 x 8 IDCT weights)
+static int dctScaledTab4[16] = {
+  1448,  1892,  1448,   784,
+  1448,   784, -1448, -1892,
+  1448,  -784, -1448,  1892,
+  1448, -1892,  1448,  -784
+};
+static int dctScaledTab2[4] = {
+  1448,  1448,
+  1448, -1448
+};
+
+// the fast decoder only uses multiple threads for images with at
+// least this many pixels
+#define dctParallelMinPixels (512 * 512)
+
+// number of restart intervals per thread in one band
+#define dctBandSegsPerThread 4
+
+// max size of a band of decoded pixels, in bytes
+#define dctMaxBandSize (16 * 1024 * 1024)
+
 DCTStream::DCTStream(Stream *strA, GBool colorXformA):
     FilterStream(strA) {
   int i, j;
@@ -2159,6 +2617,14 @@ DCTStream::DCTStream(Stream *strA, GBool colorXformA):
     }
     frameBuf[i] = NULL;
   }
+  fastDecode = gFalse;
+  scanData = NULL;
+  segments = NULL;
+  numSegments = 0;
+  outBuf = outPtr = outEnd = NULL;
+  reqReduction = 1;
+  reductionShift = 0;
+  outWidth = outHeight = 0;
 
   if (!dctClipInit) {
     for (i = -256; i < 0; ++i)
@@ -2167,6 +2633,8 @@ DCTStream::DCTStream(Stream *strA, GBool colorXformA):
       dctClip[dctClipOffset + i] = i;
     for (i = 256; i < 512; ++i)
       dctClip[dctClipOffset + i] = 255;
+    for (i = 0; i < 64; ++i)
+      dctZigZagT[i] = ((dctZigZag[i] & 7) << 3) | (dctZigZag[i] >> 3);
     dctClipInit = 1;
   }
 }
@@ -2188,9 +2656,12 @@ DCTStream::~DCTStream() {
 }
 
 void DCTStream::reset() {
+  DCTFastStatus fastStatus;
   int i, j;
 
   str->reset();
+  freeFastDecode();
+  reductionShift = 0;
 
   progressive = interleaved = gFalse;
   width = height = 0;
@@ -2271,6 +2742,20 @@ void DCTStream::reset() {
     x = 0;
     y = 0;
 
+  } else if ((fastStatus = initFastDecode()) != dctFastUnsupported) {
+
+    // the legacy decoder can't take over a consumed scan, so the
+    // stream ends here (rather than returning a blank image)
+    if (fastStatus == dctFastError) {
+      y = height;
+      return;
+    }
+
+    // initialize counters
+    comp = 0;
+    x = 0;
+    y = 0;
+
   } else {
 
     // allocate a buffer for one row of MCUs
@@ -2303,12 +2788,19 @@ void DCTStream::close() {
     gfree(frameBuf[i]);
     frameBuf[i] = NULL;
   }
+  freeFastDecode();
   FilterStream::close();
 }
 
 int DCTStream::getChar() {
   int c;
 
+  if (fastDecode) {
+    if (outPtr == outEnd && !decodeBand()) {
+      return EOF;
+    }
+    return *outPtr++;
+  }
   if (y >= height) {
     return EOF;
   }
@@ -2348,6 +2840,12 @@ int DCTStream::getChar() {
 }
 
 int DCTStream::lookChar() {
+  if (fastDecode) {
+    if (outPtr == outEnd && !decodeBand()) {
+      return EOF;
+    }
+    return *outPtr;
+  }
   if (y >= height) {
     return EOF;
   }
@@ -3140,6 +3638,681 @@ int DCTStream::readBit() {
   return bit;
 }
 
+//------------------------------------------------------------------------
+// fast decoder
+//------------------------------------------------------------------------
+
+// Inverse DCT for the fast decoder.  This computes exactly the same
+// result as DCTStream::transformDataUnit(), but each pass processes
+// all eight rows (or columns) at once, with the zero-AC shortcut done
+// by selection instead of branching, which lets the compiler turn the
+// loops into SIMD code.  <dataIn> must be dequantized and transposed
+// (dataIn[col * 8 + row]); <dataIn> is clobbered.
+static void dctFastTransform(int dataIn[64], Guchar dataOut[64]) {
+  int tmp[64];
+  int p0, p1, p2, p3, p4, p5, p6, p7, dc, ac;
+  int v0, v1, v2, v3, v4, v5, v6, v7, t;
+  int i, j;
+
+  // inverse DCT on rows (lane i = row i)
+  for (i = 0; i < 8; ++i) {
+    p0 = dataIn[0*8 + i];
+    p1 = dataIn[1*8 + i];
+    p2 = dataIn[2*8 + i];
+    p3 = dataIn[3*8 + i];
+    p4 = dataIn[4*8 + i];
+    p5 = dataIn[5*8 + i];
+    p6 = dataIn[6*8 + i];
+    p7 = dataIn[7*8 + i];
+    ac = p1 | p2 | p3 | p4 | p5 | p6 | p7;
+    dc = (dctSqrt2 * p0 + 512) >> 10;
+
+    // stage 4
+    v0 = (dctSqrt2 * p0 + 128) >> 8;
+    v1 = (dctSqrt2 * p4 + 128) >> 8;
+    v2 = p2;
+    v3 = p6;
+    v4 = (dctSqrt1d2 * (p1 - p7) + 128) >> 8;
+    v7 = (dctSqrt1d2 * (p1 + p7) + 128) >> 8;
+    v5 = p3 << 4;
+    v6 = p5 << 4;
+
+    // stage 3
+    t = (v0 - v1+ 1) >> 1;
+    v0 = (v0 + v1 + 1) >> 1;
+    v1 = t;
+    t = (v2 * dctSin6 + v3 * dctCos6 + 128) >> 8;
+    v2 = (v2 * dctCos6 - v3 * dctSin6 + 128) >> 8;
+    v3 = t;
+    t = (v4 - v6 + 1) >> 1;
+    v4 = (v4 + v6 + 1) >> 1;
+    v6 = t;
+    t = (v7 + v5 + 1) >> 1;
+    v5 = (v7 - v5 + 1) >> 1;
+    v7 = t;
+
+    // stage 2
+    t = (v0 - v3 + 1) >> 1;
+    v0 = (v0 + v3 + 1) >> 1;
+    v3 = t;
+    t = (v1 - v2 + 1) >> 1;
+    v1 = (v1 + v2 + 1) >> 1;
+    v2 = t;
+    t = (v4 * dctSin3 + v7 * dctCos3 + 2048) >> 12;
+    v4 = (v4 * dctCos3 - v7 * dctSin3 + 2048) >> 12;
+    v7 = t;
+    t = (v5 * dctSin1 + v6 * dctCos1 + 2048) >> 12;
+    v5 = (v5 * dctCos1 - v6 * dctSin1 + 2048) >> 12;
+    v6 = t;
+
+    // stage 1
+    tmp[0*8 + i] = ac ? v0 + v7 : dc;
+    tmp[7*8 + i] = ac ? v0 - v7 : dc;
+    tmp[1*8 + i] = ac ? v1 + v6 : dc;
+    tmp[6*8 + i] = ac ? v1 - v6 : dc;
+    tmp[2*8 + i] = ac ? v2 + v5 : dc;
+    tmp[5*8 + i] = ac ? v2 - v5 : dc;
+    tmp[3*8 + i] = ac ? v3 + v4 : dc;
+    tmp[4*8 + i] = ac ? v3 - v4 : dc;
+  }
+
+  // transpose back to row-major order
+  for (i = 0; i < 8; ++i) {
+    for (j = 0; j < 8; ++j) {
+      dataIn[i * 8 + j] = tmp[j * 8 + i];
+    }
+  }
+
+  // inverse DCT on columns (lane i = column i)
+  for (i = 0; i < 8; ++i) {
+    p0 = dataIn[0*8 + i];
+    p1 = dataIn[1*8 + i];
+    p2 = dataIn[2*8 + i];
+    p3 = dataIn[3*8 + i];
+    p4 = dataIn[4*8 + i];
+    p5 = dataIn[5*8 + i];
+    p6 = dataIn[6*8 + i];
+    p7 = dataIn[7*8 + i];
+    ac = p1 | p2 | p3 | p4 | p5 | p6 | p7;
+    dc = (dctSqrt2 * p0 + 8192) >> 14;
+
+    // stage 4
+    v0 = (dctSqrt2 * p0 + 2048) >> 12;
+    v1 = (dctSqrt2 * p4 + 2048) >> 12;
+    v2 = p2;
+    v3 = p6;
+    v4 = (dctSqrt1d2 * (p1 - p7) + 2048) >> 12;
+    v7 = (dctSqrt1d2 * (p1 + p7) + 2048) >> 12;
+    v5 = p3;
+    v6 = p5;
+
+    // stage 3
+    t = (v0 - v1 + 1) >> 1;
+    v0 = (v0 + v1 + 1) >> 1;
+    v1 = t;
+    t = (v2 * dctSin6 + v3 * dctCos6 + 2048) >> 12;
+    v2 = (v2 * dctCos6 - v3 * dctSin6 + 2048) >> 12;
+    v3 = t;
+    t = (v4 - v6 + 1) >> 1;
+    v4 = (v4 + v6 + 1) >> 1;
+    v6 = t;
+    t = (v7 + v5 + 1) >> 1;
+    v5 = (v7 - v5 + 1) >> 1;
+    v7 = t;
+
+    // stage 2
+    t = (v0 - v3 + 1) >> 1;
+    v0 = (v0 + v3 + 1) >> 1;
+    v3 = t;
+    t = (v1 - v2 + 1) >> 1;
+    v1 = (v1 + v2 + 1) >> 1;
+    v2 = t;
+    t = (v4 * dctSin3 + v7 * dctCos3 + 2048) >> 12;
+    v4 = (v4 * dctCos3 - v7 * dctSin3 + 2048) >> 12;
+    v7 = t;
+    t = (v5 * dctSin1 + v6 * dctCos1 + 2048) >> 12;
+    v5 = (v5 * dctCos1 - v6 * dctSin1 + 2048) >> 12;
+    v6 = t;
+
+    // stage 1
+    tmp[0*8 + i] = ac ? v0 + v7 : dc;
+    tmp[7*8 + i] = ac ? v0 - v7 : dc;
+    tmp[1*8 + i] = ac ? v1 + v6 : dc;
+    tmp[6*8 + i] = ac ? v1 - v6 : dc;
+    tmp[2*8 + i] = ac ? v2 + v5 : dc;
+    tmp[5*8 + i] = ac ? v2 - v5 : dc;
+    tmp[3*8 + i] = ac ? v3 + v4 : dc;
+    tmp[4*8 + i] = ac ? v3 - v4 : dc;
+  }
+
+  // convert to 8-bit integers
+  for (i = 0; i < 64; ++i) {
+    t = 128 + ((tmp[i] + 8) >> 4);
+    dataOut[i] = (Guchar)(t < 0 ? 0 : t > 255 ? 255 : t);
+  }
+}
+
+// Reduced-size inverse DCT for the fast decoder: computes the n x n
+// pixel block (n = 8 >> <shift>) which the 8 x 8 block reduces to, by
+// evaluating the lowest n x n frequencies at the centers of the n x n
+// sub-blocks.  <dataIn> is dequantized and transposed, as for
+// dctFastTransform().
+static void dctFastScaledTransform(int dataIn[64], int shift,
+				   Guchar *dataOut) {
+  int tmp[16];
+  int *tab;
+  int n, k, l, u, v, t;
+
+  n = 8 >> shift;
+  if (n == 1) {
+    t = 128 + ((dataIn[0] + 4) >> 3);
+    dataOut[0] = (Guchar)(t < 0 ? 0 : t > 255 ? 255 : t);
+    return;
+  }
+  tab = (n == 4) ? dctScaledTab4 : dctScaledTab2;
+
+  // rows: tmp[v * n + k] = sum_u tab[k * n + u] * data[u, v]
+  for (v = 0; v < n; ++v) {
+    for (k = 0; k < n; ++k) {
+      t = 0;
+      for (u = 0; u < n; ++u) {
+	t += tab[k * n + u] * dataIn[u * 8 + v];
+      }
+      tmp[v * n + k] = (t + 8) >> 4;
+    }
+  }
+
+  // columns
+  for (l = 0; l < n; ++l) {
+    for (k = 0; k < n; ++k) {
+      t = 0;
+      for (v = 0; v < n; ++v) {
+	t += tab[l * n + v] * tmp[v * n + k];
+      }
+      t = 128 + ((t + (1 << 19)) >> 20);
+      dataOut[l * n + k] = (Guchar)(t < 0 ? 0 : t > 255 ? 255 : t);
+    }
+  }
+}
+
+// Convert <n> YCbCr pixels to RGB, or YCbCrK to CMYK (if <cmyk> is
+// set; K is left unchanged), in place.  Uses the same arithmetic as
+// DCTStream::readMCURow().
+static void dctFastColorConvert(Guchar *c0, Guchar *c1, Guchar *c2,
+				int n, GBool cmyk) {
+  int pY, pCb, pCr, pR, pG, pB, inv, i;
+
+  inv = cmyk ? 255 : 0;
+  for (i = 0; i < n; ++i) {
+    pY = c0[i] << 16;
+    pCb = c1[i] - 128;
+    pCr = c2[i] - 128;
+    pR = (pY + dctCrToR * pCr + 32768) >> 16;
+    pG = (pY + dctCbToG * pCb + dctCrToG * pCr + 32768) >> 16;
+    pB = (pY + dctCbToB * pCb + 32768) >> 16;
+    pR = pR < 0 ? 0 : pR > 255 ? 255 : pR;
+    pG = pG < 0 ? 0 : pG > 255 ? 255 : pG;
+    pB = pB < 0 ? 0 : pB > 255 ? 255 : pB;
+    c0[i] = (Guchar)(pR ^ inv);
+    c1[i] = (Guchar)(pG ^ inv);
+    c2[i] = (Guchar)(pB ^ inv);
+  }
+}
+
+// Sets up the fast decoder for a baseline interleaved scan (the
+// header up to and including the SOS marker has been read).  Returns
+// dctFastUnsupported if the legacy MCU row decoder has to be used
+// instead and dctFastError if the scan data can't be read.
+DCTFastStatus DCTStream::initFastDecode() {
+  int rowBytes, cc, i, j;
+
+  if (globalParams && !globalParams->getDCTFastDecode()) {
+    return dctFastUnsupported;
+  }
+  if (mcuWidth > 32 || mcuHeight > 32) {
+    return dctFastUnsupported;
+  }
+  for (cc = 0; cc < numComps; ++cc) {
+    if (compInfo[cc].hSample < 1 || compInfo[cc].vSample < 1 ||
+	mcuWidth % (8 * compInfo[cc].hSample) ||
+	mcuHeight % (8 * compInfo[cc].vSample) ||
+	compInfo[cc].quantTable < 0 || compInfo[cc].quantTable >= 4 ||
+	scanInfo.dcHuffTable[cc] >= numDCHuffTables ||
+	scanInfo.acHuffTable[cc] >= numACHuffTables) {
+      return dctFastUnsupported;
+    }
+  }
+  if (width <= 0 || height <= 0 || width > INT_MAX / 128) {
+    return dctFastUnsupported;
+  }
+  mcusPerRow = (width + mcuWidth - 1) / mcuWidth;
+  mcuRows = (height + mcuHeight - 1) / mcuHeight;
+  if (mcusPerRow > INT_MAX / mcuRows) {
+    return dctFastUnsupported;
+  }
+
+  // scale down in the DCT domain if a reduced image was requested
+  reductionShift = 0;
+  while (reductionShift < 3 && (2 << reductionShift) <= reqReduction) {
+    ++reductionShift;
+  }
+  outWidth = ((width - 1) >> reductionShift) + 1;
+  outHeight = ((height - 1) >> reductionShift) + 1;
+  rowBytes = outWidth * numComps * (mcuHeight >> reductionShift);
+
+  // the IDCT works on transposed blocks, so the quantization tables
+  // are transposed here
+  for (cc = 0; cc < numComps; ++cc) {
+    for (i = 0; i < 8; ++i) {
+      for (j = 0; j < 8; ++j) {
+	fastQuant[cc][j * 8 + i] =
+	    quantTables[compInfo[cc].quantTable][i * 8 + j];
+      }
+    }
+  }
+
+  fastDecode = gTrue;
+  if (!readScanData()) {
+    error(getPos(), "Bad DCT data: scan is too large, image is not decoded");
+    freeFastDecode();
+    return dctFastError;
+  }
+
+  // restart intervals can only be decoded in parallel if there is
+  // more than one of them, and it is only worth it for larger images
+  fastThreads = globalParams ? globalParams->getDecodeThreads() : 0;
+  if (fastThreads <= 0) {
+    fastThreads = gGetNumCPUs();
+  }
+  if (numSegments < 2 || (double)width * height < dctParallelMinPixels) {
+    fastThreads = 1;
+  }
+  if (fastThreads > 1) {
+    bandRows = (dctBandSegsPerThread * fastThreads * restartInterval +
+		mcusPerRow - 1) / mcusPerRow;
+    if (bandRows > dctMaxBandSize / rowBytes) {
+      bandRows = dctMaxBandSize / rowBytes;
+    }
+    if (bandRows > mcuRows) {
+      bandRows = mcuRows;
+    }
+    if (bandRows < 1) {
+      bandRows = 1;
+    }
+  } else {
+    bandRows = 1;
+  }
+  outBuf = (Guchar *)gmallocn(bandRows, rowBytes);
+  outPtr = outEnd = outBuf;
+  nextMCURow = 0;
+  return dctFastOk;
+}
+
+// Reads the rest of the stream, removes the byte stuffing, and splits
+// the entropy-coded data into restart intervals.  Returns false if the
+// scan is too large (the stream has been consumed anyway).
+GBool DCTStream::readScanData() {
+  DCTSegment *seg;
+  int size, bufSize, nMCUs, marker, r, w, c, c2, i;
+
+  size = 0;
+  bufSize = 65536;
+  scanData = (Guchar *)gmalloc(bufSize);
+  while ((c = str->getChar()) != EOF) {
+    if (size == bufSize) {
+      if (bufSize > INT_MAX / 2) {
+	return gFalse;
+      }
+      bufSize *= 2;
+      scanData = (Guchar *)grealloc(scanData, bufSize);
+    }
+    scanData[size++] = (Guchar)c;
+  }
+
+  nMCUs = mcusPerRow * mcuRows;
+  if (restartInterval > 0) {
+    numSegments = (nMCUs - 1) / restartInterval + 1;
+  } else {
+    numSegments = 1;
+  }
+  segments = (DCTSegment *)gmallocn(numSegments, sizeof(DCTSegment));
+  for (i = 0; i < numSegments; ++i) {
+    seg = &segments[i];
+    seg->firstMCU = seg->nextMCU = i * restartInterval;
+    seg->lastMCU = numSegments > 1 ? seg->firstMCU + restartInterval : nMCUs;
+    if (seg->lastMCU > nMCUs) {
+      seg->lastMCU = nMCUs;
+    }
+    seg->failMCU = -1;
+    seg->badMarker = gFalse;
+    seg->bitBuf = 0;
+    seg->bitCount = 0;
+    seg->padBytes = 0;
+    seg->prevDC[0] = seg->prevDC[1] = seg->prevDC[2] = seg->prevDC[3] = 0;
+  }
+
+  // the unstuffed data is written back into scanData
+  r = w = 0;
+  marker = 0xd0;
+  for (i = 0; i < numSegments; ++i) {
+    segments[i].data = scanData + w;
+    c2 = EOF;
+    while (r < size) {
+      c = scanData[r++];
+      if (c == 0xff) {
+	while (r < size && scanData[r] == 0xff) {
+	  ++r;
+	}
+	if (r < size && scanData[r] == 0x00) {
+	  ++r;
+	} else {
+	  c2 = r < size ? scanData[r++] : EOF;
+	  break;
+	}
+      }
+      scanData[w++] = (Guchar)c;
+    }
+    segments[i].dataEnd = scanData + w;
+    if (i + 1 < numSegments && c2 != marker) {
+      for (++i; i < numSegments; ++i) {
+	segments[i].data = segments[i].dataEnd = scanData + w;
+	segments[i].badMarker = gTrue;
+      }
+      break;
+    }
+    if (++marker == 0xd8) {
+      marker = 0xd0;
+    }
+  }
+  return gTrue;
+}
+
+void DCTStream::freeFastDecode() {
+  gfree(scanData);
+  scanData = NULL;
+  gfree(segments);
+  segments = NULL;
+  numSegments = 0;
+  gfree(outBuf);
+  outBuf = outPtr = outEnd = NULL;
+  fastDecode = gFalse;
+}
+
+// Decodes the next band of MCU rows into outBuf.  Returns false at
+// the end of the image, or if the band could not be decoded at all.
+GBool DCTStream::decodeBand() {
+  DCTSegment *seg, *failSeg;
+  int firstRow, lastRow, failMCU, nRows, nJobs, i;
+
+  if (nextMCURow >= mcuRows) {
+    return gFalse;
+  }
+  firstRow = nextMCURow;
+  lastRow = firstRow + bandRows;
+  if (lastRow > mcuRows) {
+    lastRow = mcuRows;
+  }
+  bandFirstMCU = firstRow * mcusPerRow;
+  bandLastMCU = lastRow * mcusPerRow;
+  if (restartInterval > 0) {
+    bandFirstSeg = bandFirstMCU / restartInterval;
+    nJobs = (bandLastMCU - 1) / restartInterval + 1 - bandFirstSeg;
+  } else {
+    bandFirstSeg = 0;
+    nJobs = 1;
+  }
+  gParallelFor(nJobs, &decodeSegmentJob, this, fastThreads);
+
+  // the image ends with the first MCU row which could not be decoded
+  failSeg = NULL;
+  failMCU = bandLastMCU;
+  for (i = 0; i < nJobs; ++i) {
+    seg = &segments[bandFirstSeg + i];
+    if (seg->failMCU >= 0 && seg->failMCU < failMCU) {
+      failSeg = seg;
+      failMCU = seg->failMCU;
+    }
+  }
+  if (failSeg) {
+    if (failSeg->badMarker) {
+      error(getPos(), "Bad DCT data: incorrect restart marker");
+    } else {
+      error(getPos(), "Bad DCT data: invalid or truncated data");
+    }
+    lastRow = failMCU / mcusPerRow;
+    nextMCURow = mcuRows;
+  } else {
+    nextMCURow = lastRow;
+  }
+  nRows = lastRow * (mcuHeight >> reductionShift);
+  if (nRows > outHeight) {
+    nRows = outHeight;
+  }
+  nRows -= firstRow * (mcuHeight >> reductionShift);
+  outPtr = outBuf;
+  outEnd = outBuf + (nRows > 0 ? nRows : 0) * outWidth * numComps;
+  return outPtr < outEnd;
+}
+
+// gParallelFor() job: decodes the MCUs of restart interval
+// bandFirstSeg + <idx> that fall into the current band.
+void DCTStream::decodeSegmentJob(void *data, int idx) {
+  DCTStream *dct;
+  DCTSegment *seg;
+  int mcu, lastMCU;
+
+  dct = (DCTStream *)data;
+  seg = &dct->segments[dct->bandFirstSeg + idx];
+  if (seg->failMCU >= 0) {
+    return;
+  }
+  if (seg->badMarker) {
+    seg->failMCU = seg->firstMCU;
+    return;
+  }
+  lastMCU = seg->lastMCU < dct->bandLastMCU ? seg->lastMCU
+                                            : dct->bandLastMCU;
+  for (mcu = seg->nextMCU; mcu < lastMCU; ++mcu) {
+    if (!dct->decodeFastMCU(seg, mcu)) {
+      seg->failMCU = mcu;
+      return;
+    }
+  }
+  seg->nextMCU = mcu;
+}
+
+// Decodes one MCU and stores its pixels into outBuf.  This is called
+// concurrently for different restart intervals, so it must only
+// modify <seg> and the MCU's own part of outBuf.  With a reduced
+// image, each data unit yields (8 >> reductionShift)^2 pixels.
+GBool DCTStream::decodeFastMCU(DCTSegment *seg, int mcu) {
+  int data[64];
+  Guchar block[64];
+  Guchar mcuBuf[4][32 * 32];
+  Guchar *p, *q;
+  int h, v, horiz, vert, hSub, vSub, x0, y0, w, nRows;
+  int mcuW, mcuH, size, x1, y1, x2, y2, x3, y3, cc, i;
+
+  mcuW = mcuWidth >> reductionShift;
+  mcuH = mcuHeight >> reductionShift;
+  size = 8 >> reductionShift;
+
+  // decode and transform the data units
+  for (cc = 0; cc < numComps; ++cc) {
+    h = compInfo[cc].hSample;
+    v = compInfo[cc].vSample;
+    horiz = mcuW / h;
+    vert = mcuH / v;
+    hSub = horiz / size;
+    vSub = vert / size;
+    for (y1 = 0; y1 < mcuH; y1 += vert) {
+      for (x1 = 0; x1 < mcuW; x1 += horiz) {
+	if (!readFastDataUnit(seg, &dcHuffTables[scanInfo.dcHuffTable[cc]],
+			      &acHuffTables[scanInfo.acHuffTable[cc]],
+			      fastQuant[cc], &seg->prevDC[cc], data)) {
+	  return gFalse;
+	}
+	if (reductionShift) {
+	  dctFastScaledTransform(data, reductionShift, block);
+	} else {
+	  dctFastTransform(data, block);
+	}
+	p = &mcuBuf[cc][y1 * mcuW + x1];
+	if (hSub == 1 && vSub == 1) {
+	  for (y2 = 0; y2 < size; ++y2) {
+	    memcpy(p, block + y2 * size, size);
+	    p += mcuW;
+	  }
+	} else {
+	  for (y2 = 0; y2 < size; ++y2) {
+	    q = p;
+	    for (x2 = 0; x2 < size; ++x2) {
+	      for (x3 = 0; x3 < hSub; ++x3) {
+		*q++ = block[y2 * size + x2];
+	      }
+	    }
+	    for (y3 = 1; y3 < vSub; ++y3) {
+	      memcpy(p + y3 * mcuW, p, horiz);
+	    }
+	    p += vSub * mcuW;
+	  }
+	}
+      }
+    }
+  }
+
+  // the bit reader pads the data with zero bytes -- if any of them
+  // were used, the data was truncated
+  if (seg->padBytes * 8 > seg->bitCount) {
+    return gFalse;
+  }
+
+  // color space conversion
+  if (colorXform && numComps >= 3) {
+    dctFastColorConvert(mcuBuf[0], mcuBuf[1], mcuBuf[2],
+			mcuW * mcuH, numComps == 4);
+  }
+
+  // copy the visible part of the MCU into outBuf
+  x0 = (mcu % mcusPerRow) * mcuW;
+  y0 = (mcu / mcusPerRow - bandFirstMCU / mcusPerRow) * mcuH;
+  w = outWidth - x0 < mcuW ? outWidth - x0 : mcuW;
+  nRows = outHeight - (mcu / mcusPerRow) * mcuH;
+  if (nRows > mcuH) {
+    nRows = mcuH;
+  }
+  for (y1 = 0; y1 < nRows; ++y1) {
+    p = outBuf + ((y0 + y1) * outWidth + x0) * numComps;
+    if (numComps == 1) {
+      memcpy(p, &mcuBuf[0][y1 * mcuW], w);
+    } else {
+      for (cc = 0; cc < numComps; ++cc) {
+	q = &mcuBuf[cc][y1 * mcuW];
+	for (i = 0; i < w; ++i) {
+	  p[i * numComps + cc] = q[i];
+	}
+      }
+    }
+  }
+  return gTrue;
+}
+
+// Refill the bit buffer of <seg> to at least 25 bits.  Zero bytes are
+// fed in after the end of the data.
+#define dctFillBits(seg)						\
+  while ((seg)->bitCount <= 24) {					\
+    if ((seg)->data < (seg)->dataEnd) {					\
+      (seg)->bitBuf |= (Guint)*(seg)->data++ << (24 - (seg)->bitCount); \
+    } else {								\
+      ++(seg)->padBytes;						\
+    }									\
+    (seg)->bitCount += 8;						\
+  }
+
+// Read one data unit, dequantized and in transposed order (see
+// dctFastTransform), using the same decoding rules as readDataUnit().
+GBool DCTStream::readFastDataUnit(DCTSegment *seg, DCTHuffTable *dcHuffTable,
+				  DCTHuffTable *acHuffTable, int *quantTable,
+				  int *prevDC, int data[64]) {
+  int run, size, amp, c, i, j;
+
+  memset(data, 0, 64 * sizeof(int));
+  if ((size = readFastHuffSym(seg, dcHuffTable)) == 9999) {
+    return gFalse;
+  }
+  if (size > 0) {
+    if (size > 16) {
+      return gFalse;
+    }
+    dctFillBits(seg);
+    amp = (int)(seg->bitBuf >> (32 - size));
+    seg->bitBuf <<= size;
+    seg->bitCount -= size;
+    if (amp < (1 << (size - 1))) {
+      amp -= (1 << size) - 1;
+    }
+  } else {
+    amp = 0;
+  }
+  *prevDC += amp;
+  data[0] = *prevDC * quantTable[0];
+  i = 1;
+  while (i < 64) {
+    run = 0;
+    while ((c = readFastHuffSym(seg, acHuffTable)) == 0xf0 && run < 0x30) {
+      run += 0x10;
+    }
+    if (c == 9999) {
+      return gFalse;
+    }
+    if (c == 0x00) {
+      break;
+    }
+    run += (c >> 4) & 0x0f;
+    size = c & 0x0f;
+    if (size > 0) {
+      dctFillBits(seg);
+      amp = (int)(seg->bitBuf >> (32 - size));
+      seg->bitBuf <<= size;
+      seg->bitCount -= size;
+      if (amp < (1 << (size - 1))) {
+	amp -= (1 << size) - 1;
+      }
+    } else {
+      amp = 0;
+    }
+    i += run;
+    if (i < 64) {
+      j = dctZigZagT[i++];
+      data[j] = amp * quantTable[j];
+    }
+  }
+  return gTrue;
+}
+
+int DCTStream::readFastHuffSym(DCTSegment *seg, DCTHuffTable *table) {
+  Guint code;
+  int entry, codeBits;
+
+  dctFillBits(seg);
+  if ((entry = table->lookup[seg->bitBuf >> (32 - 9)])) {
+    codeBits = entry >> 8;
+    seg->bitBuf <<= codeBits;
+    seg->bitCount -= codeBits;
+    return entry & 0xff;
+  }
+  for (codeBits = 10; codeBits <= 16; ++codeBits) {
+    code = seg->bitBuf >> (32 - codeBits);
+    if ((int)code - table->firstCode[codeBits] < table->numCodes[codeBits]) {
+      code -= table->firstCode[codeBits];
+      seg->bitBuf <<= codeBits;
+      seg->bitCount -= codeBits;
+      return table->sym[table->firstSym[codeBits] + code];
+    }
+  }
+  return 9999;
+}
+
 GBool DCTStream::readHeader() {
   GBool doScan;
   int n;
@@ -3374,7 +4547,7 @@ GBool DCTStream::readHuffmanTables() {
   int index;
   Gushort code;
   Guchar sym;
-  int i;
+  int i, j, k;
   int c;
 
   length = read16() - 2;
@@ -3410,6 +4583,22 @@ GBool DCTStream::readHuffmanTables() {
     for (i = 0; i < sym; ++i)
       tbl->sym[i] = str->getChar();
     length -= sym;
+
+    // build the lookahead table for the fast decoder -- shorter codes
+    // are filled in last, so they win (as in readHuffSym)
+    memset(tbl->lookup, 0, sizeof(tbl->lookup));
+    for (i = 9; i >= 1; --i) {
+      for (j = 0; j < tbl->numCodes[i]; ++j) {
+	code = tbl->firstCode[i] + j;
+	if (code >= (1 << i) || tbl->firstSym[i] + j >= 256) {
+	  break;
+	}
+	for (k = 0; k < (1 << (9 - i)); ++k) {
+	  tbl->lookup[(code << (9 - i)) + k] =
+	      (Gushort)((i << 8) | tbl->sym[tbl->firstSym[i] + j]);
+	}
+      }
+    }
   }
   return gTrue;
 }
@@ -4242,12 +5431,13 @@ void FlateStream::reset() {
   eof = gTrue;
 
   str->reset();
+  resetInput();
 
   // read header
   //~ need to look at window size?
   endOfBlock = eof = gTrue;
-  cmf = str->getChar();
-  flg = str->getChar();
+  cmf = getInputChar();
+  flg = getInputChar();
   if (cmf == EOF || flg == EOF)
     return;
   if ((cmf & 0x0f) != 0x08) {
@@ -4312,6 +5502,39 @@ int FlateStream::getRawChar() {
   return c;
 }
 
+int FlateStream::getBlock(char *blk, int size) {
+  if (pred) {
+    return pred->getBlock(blk, size);
+  }
+  return getRawBlock(blk, size);
+}
+
+int FlateStream::getRawBlock(char *blk, int size) {
+  int n, m;
+
+  n = 0;
+  while (n < size) {
+    while (remain == 0) {
+      if (endOfBlock && eof)
+	return n;
+      readSome();
+    }
+    // copy up to the end of the (circular) window
+    m = remain;
+    if (m > size - n) {
+      m = size - n;
+    }
+    if (m > flateWindow - index) {
+      m = flateWindow - index;
+    }
+    memcpy(blk + n, buf + index, m);
+    index = (index + m) & flateMask;
+    remain -= m;
+    n += m;
+  }
+  return n;
+}
+
 GString *FlateStream::getPSFilter(int psLevel,const char *indent)const {
   GString *s;
 
@@ -4374,7 +5597,7 @@ void FlateStream::readSome() {
   } else {
     len = (blockLen < flateWindow) ? blockLen : flateWindow;
     for (i = 0, j = index; i < len; ++i, j = (j + 1) & flateMask) {
-      if ((c = str->getChar()) == EOF) {
+      if ((c = getInputChar()) == EOF) {
 	endOfBlock = eof = gTrue;
 	break;
       }
@@ -4418,16 +5641,16 @@ GBool FlateStream::startBlock() {
   // uncompressed block
   if (blockHdr == 0) {
     compressedBlock = gFalse;
-    if ((c = str->getChar()) == EOF)
+    if ((c = getInputChar()) == EOF)
       goto err;
     blockLen = c & 0xff;
-    if ((c = str->getChar()) == EOF)
+    if ((c = getInputChar()) == EOF)
       goto err;
     blockLen |= (c & 0xff) << 8;
-    if ((c = str->getChar()) == EOF)
+    if ((c = getInputChar()) == EOF)
       goto err;
     check = c & 0xff;
-    if ((c = str->getChar()) == EOF)
+    if ((c = getInputChar()) == EOF)
       goto err;
     check |= (c & 0xff) << 8;
     if (check != (~blockLen & 0xffff))
@@ -4623,7 +5846,7 @@ int FlateStream::getHuffmanCodeWord(FlateHuffmanTab *tab) {
   int c;
 
   while (codeSize < tab->maxLen) {
-    if ((c = str->getChar()) == EOF) {
+    if ((c = getInputChar()) == EOF) {
       break;
     }
     codeBuf |= (c & 0xff) << codeSize;
@@ -4642,7 +5865,7 @@ int FlateStream::getCodeWord(int bits) {
   int c;
 
   while (codeSize < bits) {
-    if ((c = str->getChar()) == EOF)
+    if ((c = getInputChar()) == EOF)
       return EOF;
     codeBuf |= (c & 0xff) << codeSize;
     codeSize += 8;
@@ -15,6 +15,8 @@
 //              - All filter stream using StremPredictor stores PredictorContext
 //                to enable cloning
 //              - dictionary modificator access methods
+//              - addFilters can resolve parameters through a private stream
+//                view
 //
 //========================================================================
 
@@ -31,6 +33,8 @@
 #include "goo/gtypes.h"
 #include "xpdf/Object.h"
 
+class GFileMap;
+
 class BaseStream;
 
 //------------------------------------------------------------------------
@@ -104,6 +108,22 @@ public:
   // This is only used by StreamPredictor.
   virtual int getRawChar();
 
+  // Get up to <size> chars from stream into <blk>.  Returns the number
+  // of chars read, which is less than <size> only at the end of the
+  // stream.  This default implementation calls getChar() for each
+  // char, streams which can copy whole blocks override it.
+  virtual int getBlock(char *blk, int size);
+
+  // Same as getBlock() but without using the predictor.  This is only
+  // used by StreamPredictor.
+  virtual int getRawBlock(char *blk, int size);
+
+  // Does the stream end exactly where its data end?  Filters read
+  // their input ahead only from bounded streams, because unbounded
+  // ones (e.g. inline image data) are followed by data which belong
+  // to somebody else.
+  virtual GBool isBounded()const { return gFalse; }
+
   // Get next line from stream.
   virtual char *getLine(char *buf, int size);
 
@@ -138,16 +158,30 @@ public:
   virtual void getImageParams(UNUSED_PARAM int *bitsPerComponent,
 			      UNUSED_PARAM StreamColorSpaceMode *csMode) {}
 
+  // Ask an image decoder to return the image reduced by <factor> (a
+  // power of two) in each direction, i.e., ceil(width / factor) x
+  // ceil(height / factor) pixels, starting with the next reset().
+  // The decoder may use a smaller reduction (or none at all), see
+  // getImageReduction().
+  virtual void setImageReduction(UNUSED_PARAM int factor) {}
+
+  // Returns the reduction factor in effect since the last reset().
+  virtual int getImageReduction() { return 1; }
+
   // Return the next stream in the "stack".
   virtual Stream *getNextStream() { return NULL; }
 
   // Add filters to this stream according to the parameters in <dict>.
+  // If <fetchStr> is given, indirect parameters are fetched through it
+  // (see XRef::lookupFrom) rather than through the shared <xref> state.
   // Returns the new stream.
-  Stream *addFilters(const Object *dict);
+  Stream *addFilters(const Object *dict, const XRef *xref = NULL,
+		     BaseStream *fetchStr = NULL);
 
 private:
 
-  Stream *makeFilter(const char *name, Stream *str, const Object *params);
+  Stream *makeFilter(const char *name, Stream *str, const Object *params,
+		     const XRef *xref, BaseStream *fetchStr);
 
   int ref;			// reference count
 };
@@ -178,6 +212,11 @@ public:
   virtual Guint getStart()const = 0;
   virtual void moveStart(int delta) = 0;
 
+  // Map the stream data (from the start position on) to memory.
+  // Returns NULL if this stream doesn't support it.  The caller
+  // deletes the returned map.
+  virtual GFileMap *map() { return NULL; }
+
   // Dict accessors.
   void dictAdd(char *key, Object *val);
   Object *dictUpdate(char *key, Object *val);
@@ -202,6 +241,8 @@ inline Object *BaseStream::dictDel(const char *key)
 // This is the base class for all streams that filter another stream.
 //------------------------------------------------------------------------
 
+#define filterInputBufSize 256
+
 class FilterStream: public Stream {
 public:
 
@@ -211,6 +252,7 @@ public:
   virtual Stream * clone()=0;
   virtual int getPos()const { return str->getPos(); }
   virtual void setPos(Guint pos, int dir = 0);
+  virtual GBool isBounded()const { return str->isBounded(); }
   virtual BaseStream *getBaseStream() { return str->getBaseStream(); }
   virtual Stream *getUndecodedStream() { return str->getUndecodedStream(); }
   virtual const Dict *getDict()const { return str->getDict(); }
@@ -218,7 +260,25 @@ public:
 
 protected:
 
+  // Buffered reading of the input stream.  If <str> is bounded, it is
+  // read in blocks, otherwise exactly the requested chars are read.
+  // Filters which read their input this way have to call resetInput()
+  // after str->reset().
+  int getInputChar()
+    { return (inputPtr < inputEnd || fillInput()) ? (*inputPtr++ & 0xff) : EOF; }
+  int lookInputChar();
+  int getInputBlock(char *blk, int size);
+  void resetInput() { inputPtr = inputEnd = inputBlk; }
+
   Stream *str;
+
+private:
+
+  GBool fillInput();
+
+  char inputBlk[filterInputBufSize];
+  char *inputPtr;
+  char *inputEnd;
 };
 
 //------------------------------------------------------------------------
@@ -233,6 +293,17 @@ public:
   // which may be different from the predictor parameters.
   ImageStream(Stream *strA, int widthA, int nCompsA, int nBitsA);
 
+  // Create an image stream object which returns the <widthA> x
+  // <heightA> image reduced by <reductionA> (a power of two) in each
+  // direction -- see getWidth() and getHeight().  The base stream is
+  // asked to decode at reduced size (DCT, JPX), and whatever
+  // reduction it doesn't do is done here by averaging each block of
+  // pixels while reading (box filter).  Reduction is only supported
+  // for 8-bit components, and only makes sense if the component
+  // values can be averaged (i.e., not for indexed color).
+  ImageStream(Stream *strA, int widthA, int heightA, int nCompsA, int nBitsA,
+	      int reductionA);
+
   ~ImageStream();
 
   // Reset the stream.
@@ -249,15 +320,35 @@ public:
   // Skip an entire line from the image.
   void skipLine();
 
+  // Image size, in pixels, as returned by getLine().
+  int getWidth() { return width; }
+  int getHeight() { return height; }
+
 private:
 
+  void readLine();
+  void readInput(Guchar *p, int n);
+
   Stream *str;			// base stream
   int width;			// pixels per line
+  int height;			// number of lines (reduced image only)
   int nComps;			// components per pixel
   int nBits;			// bits per component
   int nVals;			// components per line
   Guchar *imgLine;		// line buffer
   int imgIdx;			// current index in imgLine
+  Guchar *inputLine;		// packed line read from str
+  int inputLineSize;		// number of bytes in inputLine
+
+  // reduced image
+  int reduction;		// requested reduction factor
+  int fullWidth, fullHeight;	// image size before reduction
+  int boxSize;			// box filter size (1 = no filtering)
+  int srcWidth, srcHeight;	// size of the image read from str
+  int srcY;			// next line to be read from str
+  int srcVals;			// components per line read from str
+  Guchar *srcLine;		// line read from str
+  Guint *boxSum;		// per-component sums of the current line
 };
 
 //------------------------------------------------------------------------
@@ -290,6 +381,7 @@ public:
 
   int lookChar();
   int getChar();
+  int getBlock(char *blk, int size);
 
 private:
 
@@ -305,6 +397,7 @@ private:
   int rowBytes;			// bytes per line
   Guchar *predLine;		// line buffer
   int predIdx;			// current index in predLine
+  Guchar *rawLine;		// raw (not predicted) line
   GBool ok;
 
   // initialize internal structures from context variables
@@ -336,10 +429,13 @@ public:
     { return (bufPtr >= bufEnd && !fillBuf()) ? EOF : (*bufPtr++ & 0xff); }
   virtual int lookChar()
     { return (bufPtr >= bufEnd && !fillBuf()) ? EOF : (*bufPtr & 0xff); }
+  virtual int getBlock(char *blk, int size);
+  virtual GBool isBounded()const { return limited; }
   virtual int getPos()const { return bufPos + (bufPtr - buf); }
   virtual void setPos(Guint pos, int dir = 0);
   virtual Guint getStart()const { return start; }
   virtual void moveStart(int delta);
+  virtual GFileMap *map();
 
 protected:
 
@@ -376,6 +472,8 @@ public:
     { return (bufPtr < bufEnd) ? (*bufPtr++ & 0xff) : EOF; }
   virtual int lookChar()
     { return (bufPtr < bufEnd) ? (*bufPtr & 0xff) : EOF; }
+  virtual int getBlock(char *blk, int size);
+  virtual GBool isBounded()const { return gTrue; }
   virtual int getPos()const { return (int)(bufPtr - buf); }
   virtual void setPos(Guint pos, int dir = 0);
   virtual Guint getStart()const { return start; }
@@ -412,6 +510,8 @@ public:
   virtual int getChar();
   virtual Stream * clone();
   virtual int lookChar();
+  virtual int getBlock(char *blk, int size);
+  virtual GBool isBounded()const { return limited; }
   virtual int getPos()const { return str->getPos(); }
   virtual void setPos(Guint pos, int dir = 0);
   virtual Guint getStart()const;
@@ -491,6 +591,8 @@ public:
   virtual Stream * clone();
   virtual int lookChar();
   virtual int getRawChar();
+  virtual int getBlock(char *blk, int size);
+  virtual int getRawBlock(char *blk, int size);
   virtual GString *getPSFilter(int psLevel, const char *indent)const;
   virtual GBool isBinary(GBool last = gTrue)const;
 
@@ -537,6 +639,7 @@ public:
     { return (bufPtr >= bufEnd && !fillBuf()) ? EOF : (*bufPtr++ & 0xff); }
   virtual int lookChar()
     { return (bufPtr >= bufEnd && !fillBuf()) ? EOF : (*bufPtr & 0xff); }
+  virtual int getBlock(char *blk, int size);
   virtual GString *getPSFilter(int psLevel, const char *indent)const;
   virtual GBool isBinary(GBool last = gTrue)const;
 
@@ -630,6 +733,31 @@ struct DCTHuffTable {
   Gushort firstCode[17];	// first code for this bit length
   Gushort numCodes[17];		// number of codes of this bit length
   Guchar sym[256];		// symbols
+  Gushort lookup[1 << 9];	// 9-bit lookahead table for the fast
+				//   decoder: (length << 8) | symbol,
+				//   0 = code is longer than 9 bits
+};
+
+// State of one restart interval in the fast DCT decoder
+struct DCTSegment {
+  Guchar *data;			// entropy-coded data (with the ff 00
+  Guchar *dataEnd;		//   stuffing already removed)
+  int firstMCU, lastMCU;	// MCUs [firstMCU, lastMCU) are coded here
+  int nextMCU;			// next MCU to be decoded
+  int failMCU;			// MCU where decoding failed, or -1
+  GBool badMarker;		// set if the restart marker was missing
+  Guint bitBuf;			// bit buffer (next bit is the MSB)
+  int bitCount;			// number of valid bits in bitBuf
+  int padBytes;			// zero bytes fed in beyond dataEnd
+  int prevDC[4];		// DC coefficient accumulators
+};
+
+// Result of DCTStream::initFastDecode()
+enum DCTFastStatus {
+  dctFastUnsupported,		// the legacy decoder has to be used
+  dctFastOk,			// the fast decoder is set up
+  dctFastError			// the scan has been consumed, but it
+				//   can't be decoded
 };
 
 class DCTStream: public FilterStream {
@@ -645,6 +773,8 @@ public:
   virtual int lookChar();
   virtual GString *getPSFilter(int psLevel, const char *indent)const;
   virtual GBool isBinary(GBool last = gTrue)const;
+  virtual void setImageReduction(int factor) { reqReduction = factor; }
+  virtual int getImageReduction() { return 1 << reductionShift; }
   Stream *getRawStream() { return str; }
 
 private:
@@ -678,6 +808,30 @@ private:
   int inputBuf;			// input buffer for variable length codes
   int inputBits;		// number of valid bits in input buffer
 
+  // fast decoder (baseline interleaved images only): the scan is
+  // decoded in bands of MCU rows, restart intervals within a band
+  // are decoded in parallel
+  GBool fastDecode;		// set if the fast decoder is in use
+  int fastThreads;		// max number of decoder threads
+  Guchar *scanData;		// entropy-coded data of the scan
+  DCTSegment *segments;		// restart intervals
+  int numSegments;		// number of restart intervals
+  int mcusPerRow, mcuRows;	// image size, in MCUs
+  int bandRows;			// number of MCU rows per band
+  int nextMCURow;		// first MCU row of the next band
+  int bandFirstMCU;		// MCUs of the band being decoded
+  int bandLastMCU;
+  int bandFirstSeg;		// first restart interval of that band
+  int fastQuant[4][64];		// quantization tables (transposed)
+  int reqReduction;		// requested image reduction
+  int reductionShift;		// log2 of the reduction in effect: the
+				//   fast decoder can scale by 1/2, 1/4,
+				//   or 1/8 in the DCT domain
+  int outWidth, outHeight;	// size of the (reduced) image
+  Guchar *outBuf;		// decoded pixels of the current band
+  Guchar *outPtr;		// next pixel byte to be returned
+  Guchar *outEnd;		// end of the decoded pixels
+
   void restart();
   GBool readMCURow();
   void readScan();
@@ -693,6 +847,16 @@ private:
   int readHuffSym(DCTHuffTable *table);
   int readAmp(int size);
   int readBit();
+  DCTFastStatus initFastDecode();
+  GBool readScanData();
+  void freeFastDecode();
+  GBool decodeBand();
+  static void decodeSegmentJob(void *data, int idx);
+  GBool decodeFastMCU(DCTSegment *seg, int mcu);
+  GBool readFastDataUnit(DCTSegment *seg, DCTHuffTable *dcHuffTable,
+			 DCTHuffTable *acHuffTable, int *quantTable,
+			 int *prevDC, int data[64]);
+  int readFastHuffSym(DCTSegment *seg, DCTHuffTable *table);
   GBool readHeader();
   GBool readBaselineSOF();
   GBool readProgressiveSOF();
@@ -747,6 +911,8 @@ public:
   virtual int getChar();
   virtual int lookChar();
   virtual int getRawChar();
+  virtual int getBlock(char *blk, int size);
+  virtual int getRawBlock(char *blk, int size);
   virtual GString *getPSFilter(int psLevel, const char *indent)const;
   virtual GBool isBinary(GBool last = gTrue)const;
 
@@ -802,6 +968,7 @@ public:
   virtual Stream * clone();
   virtual int getChar() { return EOF; }
   virtual int lookChar() { return EOF; }
+  virtual int getBlock(UNUSED_PARAM char *blk, UNUSED_PARAM int size) { return 0; }
   virtual GString *getPSFilter(UNUSED_PARAM	int psLevel, UNUSED_PARAM	const char *indent)const  { return NULL; }
   virtual GBool isBinary(UNUSED_PARAM	GBool last = gTrue)const { return gFalse; }
 };
@@ -17,6 +17,9 @@
 #include <string.h>
 #include <ctype.h>
 #include "goo/gmem.h"
+#include "goo/gfile.h"
+#include "goo/GThread.h"
+#include "xpdf/GlobalParams.h"
 #include "xpdf/Object.h"
 #include "xpdf/Stream.h"
 #include "xpdf/Lexer.h"
@@ -49,8 +52,9 @@ class ObjectStream {
 public:
 
   // Create an object stream, using object number <objStrNum>,
-  // generation 0.
-  ObjectStream(const XRef *xref, int objStrNumA);
+  // generation 0.  The stream object is read through <strA> (see
+  // XRef::fetchFrom) if given, otherwise it is fetched from <xref>.
+  ObjectStream(const XRef *xref, int objStrNumA, BaseStream *strA = NULL);
 
   GBool isOk()const { return ok; }
 
@@ -72,7 +76,8 @@ private:
   GBool ok;
 };
 
-ObjectStream::ObjectStream(const XRef *xref, int objStrNumA) {
+ObjectStream::ObjectStream(const XRef *xref, int objStrNumA,
+			   BaseStream *strA) {
   Stream *str;
   Parser *parser;
   int *offsets;
@@ -87,11 +92,17 @@ ObjectStream::ObjectStream(const XRef *xref, int objStrNumA) {
 
   // we don't have to check for isOk here because fetch failure
   // is reported via returned objNull
-  if (!xref->fetch(objStrNum, 0, &objStr)->isStream()) {
+  if (strA) {
+    xref->fetchFrom(strA, NULL, objStrNum, 0, &objStr);
+  } else {
+    xref->fetch(objStrNum, 0, &objStr);
+  }
+  if (!objStr.isStream()) {
     goto err1;
   }
 
-  if (!objStr.streamGetDict()->lookup("N", &obj1)->isInt()) {
+  if (!xref->lookupFrom(strA, objStr.streamGetDict(), "N",
+			&obj1)->isInt()) {
     obj1.free();
     goto err1;
   }
@@ -101,7 +112,8 @@ ObjectStream::ObjectStream(const XRef *xref, int objStrNumA) {
     goto err1;
   }
 
-  if (!objStr.streamGetDict()->lookup("First", &obj1)->isInt()) {
+  if (!xref->lookupFrom(strA, objStr.streamGetDict(), "First",
+			&obj1)->isInt()) {
     obj1.free();
     goto err1;
   }
@@ -216,7 +228,7 @@ Object *ObjectStream::getObject(int objIdx, int objNum, Object *obj) {
 //------------------------------------------------------------------------
 
 static const char * PDFHEADER="%PDF-";
-XRef::XRef(BaseStream *strA):entries(NULL), streamEnds(NULL), objStr(NULL) {
+XRef::XRef(BaseStream *strA, GBool initA):entries(NULL), streamEnds(NULL), objStr(NULL) {
   // inits stream and initializes internals
   str = strA;
 
@@ -235,6 +247,9 @@ XRef::XRef(BaseStream *strA):entries(NULL), streamEnds(NULL), objStr(NULL) {
   }while (!(header = strstr(buffer, PDFHEADER)));
   header+=strlen(PDFHEADER);
   pdfVersion.append(header);
+  if (!initA) {
+    return;
+  }
 
   // gets position of last xref section
   Guint pos = getStartXref();
@@ -311,6 +326,80 @@ void XRef::initInternals(Guint pos)
   d->setXRef(this);
 }
 
+/** Initializes XRef internal structures from resolved entries.
+ * @param entriesA Xref entries (gmalloc-ed).
+ * @param sizeA Number of entries.
+ * @param streamEndsA Stream end positions (gmalloc-ed, may be NULL).
+ * @param streamEndsLenA Number of stream end positions.
+ * @param trailerDictA Trailer dictionary (the content is taken over and
+ * the object is freed).
+ *
+ * Assumes that str field is already initialized.
+ */
+GBool XRef::initInternals(XRefEntry *entriesA, int sizeA,
+			  Guint *streamEndsA, int streamEndsLenA,
+			  Object *trailerDictA)
+{
+  Object obj;
+
+  setErrCode(errNone);
+  entries = entriesA;
+  size = sizeA;
+  streamEnds = streamEndsA;
+  streamEndsLen = streamEndsLenA;
+  objStr = NULL;
+
+  useEncrypt = gFalse;
+  permFlags = defPermFlags;
+  ownerPasswordOk = gFalse;
+
+  start = str->getStart();
+  trailerDictA->copy(&trailerDict);
+  trailerDictA->free();
+
+  // the catalog has to be available
+  if (!trailerDict.isDict() ||
+      !trailerDict.dictLookupNF("Root", &obj)->isRef()) {
+    obj.free();
+    setErrCode(errDamaged);
+    return gFalse;
+  }
+  obj.free();
+  ((Dict *)trailerDict.getDict())->setXRef(this);
+  return gTrue;
+}
+
+/** Updates XRef internal structures for an appended section.
+ * @param sizeA Minimal number of entries.
+ * @param trailerDictA Trailer dictionary of the appended section (the 
+ * content is taken over and the object is freed).
+ */
+void XRef::appendInternals(int sizeA, Object *trailerDictA)
+{
+  if (sizeA > size) {
+    entries = (XRefEntry *)greallocn(entries, sizeA, sizeof(XRefEntry));
+    for (int i = size; i < sizeA; ++i) {
+      entries[i].offset = 0xffffffff;
+      entries[i].gen = 0;
+      entries[i].type = xrefEntryFree;
+    }
+    size = sizeA;
+  }
+
+  // appended section may replace object stream which is cached
+  if (objStr) {
+    delete objStr;
+    objStr = NULL;
+  }
+
+  trailerDict.free();
+  trailerDictA->copy(&trailerDict);
+  trailerDictA->free();
+  if (trailerDict.isDict()) {
+    ((Dict *)trailerDict.getDict())->setXRef(this);
+  }
+}
+
 void XRef::destroyInternals()
 {
   if(entries)
@@ -756,67 +845,337 @@ GBool XRef::readXRefStreamSection(Stream *xrefStr, int *w, int first, int n) {
   return gTrue;
 }
 
+//------------------------------------------------------------------------
+// xref reconstruction
+//------------------------------------------------------------------------
+
+// Damaged files bigger than this are split into chunks of this size
+// which are scanned in parallel.
+#define xrefScanChunkSize (4 * 1024 * 1024)
+
+// Maximum line length - this has to stay the same as the size of the
+// buffer constructXRef used to read the file line by line with
+// Stream::getLine, because long lines are split at this length.
+#define xrefScanLineSize 255
+
+struct XRefScanObj {
+  Guint pos;			// position of the line
+  int num;
+  int gen;
+};
+
+// Markers found in one chunk of the file.  The chunk contains lines
+// starting in [<begin>, <end>), both are offsets to the scanned data.
+struct XRefScanChunk {
+  Guint begin;
+  Guint end;
+  XRefScanObj *objs;		// 'num gen obj' lines
+  int objsLen, objsSize;
+  Guint *trailers;		// positions of 'trailer' lines
+  int trailersLen, trailersSize;
+  Guint *streamEnds;		// 'endstream' positions
+  int streamEndsLen, streamEndsSize;
+};
+
+struct XRefScan {
+  const char *data;		// whole scanned data
+  Guint length;
+  Guint pos;			// stream position of data[0]
+  XRefScanChunk *chunks;
+  int nChunks;
+};
+
 /** Returns the size of EOL marker preceding the given possition.
- * @param pos Position at the begginning of the line.
- * @param str Stream
- *
- * Stream will keep its current possition.
+ * @param data Scanned data.
+ * @param pos Offset at the begginning of the line.
  *
  * @return length of the EOL (if any) preceeing pos.
  */
-static int eolLength(Guint pos, BaseStream *str)
+static int eolLength(const char *data, Guint pos)
 {
-	Guint currPos = str->getPos();
-	str->setPos(pos-2);
-	int ch1 = str->getChar();
-	int ch2 = str->getChar();
+	if (pos < 2)
+		return 0;
+	char ch1 = data[pos-2];
+	char ch2 = data[pos-1];
 	int eoln = 0;
 	if (ch1 == '\r' && ch2 == '\n')
 		eoln = 2;
 	else if (ch2 == '\n')
 			eoln = 1;
-	str->setPos(currPos);
 	return eoln;
 }
 
+// Returns the offset of the first line which starts at or after <pos>
+// (<pos> > 0) because of an end of line marker.  Lines always start
+// there, regardless of where the preceding line started.
+static Guint xrefScanSync(const char *data, Guint length, Guint pos) {
+  const char *p, *nl, *cr;
+
+  if (pos >= length) {
+    return length;
+  }
+  p = data + pos - 1;
+  nl = (const char *)memchr(p, '\n', length - pos + 1);
+  cr = (const char *)memchr(p, '\r', (nl ? nl : data + length) - p);
+  if (cr) {
+    pos = (Guint)(cr - data) + 1;
+    if (pos < length && data[pos] == '\n') {
+      ++pos;
+    }
+    return pos;
+  }
+  return nl ? (Guint)(nl - data) + 1 : length;
+}
+
+// Scans the lines of one chunk, exactly as Stream::getLine would have
+// split them.
+static void xrefScanChunk(XRefScan *scan, XRefScanChunk *chunk) {
+  const char *data, *p, *q, *lineEnd, *nl, *cr;
+  char buf[xrefScanLineSize + 1];
+  Guint pos, next, n;
+  int num, gen;
+
+  data = scan->data;
+  pos = chunk->begin;
+  while (pos < chunk->end) {
+
+    // find the end of the line
+    p = data + pos;
+    n = scan->length - pos;
+    if (n > xrefScanLineSize) {
+      n = xrefScanLineSize;
+    }
+    nl = (const char *)memchr(p, '\n', n);
+    cr = (const char *)memchr(p, '\r', nl ? nl - p : n);
+    if (cr) {
+      lineEnd = cr;
+      next = pos + (Guint)(cr - p) + 1;
+      if (next < scan->length && data[next] == '\n') {
+	++next;
+      }
+    } else if (nl) {
+      lineEnd = nl;
+      next = pos + (Guint)(nl - p) + 1;
+    } else {
+      lineEnd = p + n;
+      next = pos + n;
+    }
+
+    // skip whitespace
+    q = p;
+    while (q < lineEnd && *q && Lexer::isSpace(*q & 0xff)) ++q;
+
+    // got trailer dictionary
+    if (lineEnd - q >= 7 && !memcmp(q, "trailer", 7)) {
+      if (chunk->trailersLen == chunk->trailersSize) {
+	chunk->trailersSize += 16;
+	chunk->trailers = (Guint *)greallocn(chunk->trailers,
+					     chunk->trailersSize,
+					     sizeof(Guint));
+      }
+      chunk->trailers[chunk->trailersLen++] = scan->pos + pos;
+
+    // look for object
+    } else if (q < lineEnd && isdigit((unsigned char)*q)) {
+      memcpy(buf, q, lineEnd - q);
+      buf[lineEnd - q] = '\0';
+      q = buf;
+      num = (int)strtoul(q, NULL, 10);
+      if (num > 0) {
+	do {
+	  ++q;
+	} while (*q && isdigit((unsigned char)*q));
+	if (isspace((unsigned char)*q)) {
+	  do {
+	    ++q;
+	  } while (*q && isspace((unsigned char)*q));
+	  if (isdigit((unsigned char)*q)) {
+	    gen = (int)strtoul(q, NULL, 10);
+	    do {
+	      ++q;
+	    } while (*q && isdigit((unsigned char)*q));
+	    if (isspace((unsigned char)*q)) {
+	      do {
+		++q;
+	      } while (*q && isspace((unsigned char)*q));
+	      if (!strncmp(q, "obj", 3)) {
+		if (chunk->objsLen == chunk->objsSize) {
+		  chunk->objsSize = chunk->objsSize ? 2 * chunk->objsSize
+		                                    : 256;
+		  chunk->objs = (XRefScanObj *)greallocn(chunk->objs,
+							 chunk->objsSize,
+							 sizeof(XRefScanObj));
+		}
+		chunk->objs[chunk->objsLen].pos = scan->pos + pos;
+		chunk->objs[chunk->objsLen].num = num;
+		chunk->objs[chunk->objsLen].gen = gen;
+		++chunk->objsLen;
+	      }
+	    }
+	  }
+	}
+      }
+
+    } else if (lineEnd - q >= 9 && !memcmp(q, "endstream", 9)) {
+      if (chunk->streamEndsLen == chunk->streamEndsSize) {
+	chunk->streamEndsSize += 64;
+	chunk->streamEnds = (Guint *)greallocn(chunk->streamEnds,
+					       chunk->streamEndsSize,
+					       sizeof(Guint));
+      }
+      // We are reading lines and the pdf specification says that:
+      // "The sequence of bytes that make up a stream lie between the stream
+      // and endstream keywords; the stream dictionary specifies the exact 
+      // number of bytes. It is recommended that there be an end-of-line 
+      // marker after the data and before endstream; this marker is not 
+      // included in the stream length."
+      // So we have to either add stream data that preceeds the keyword
+      // or decrease the lenght by the lenght of EOL marker if we are at 
+      // the beggining of line
+      chunk->streamEnds[chunk->streamEndsLen++] = scan->pos + pos + 
+	      (q-p)?q-p
+	      :-eolLength(data, pos);
+    }
+
+    pos = next;
+  }
+}
+
+// gParallelFor() job: finds the bounds of chunk number <idx> and scans
+// it.
+static void xrefScanJob(void *data, int idx) {
+  XRefScan *scan;
+  XRefScanChunk *chunk;
+  Guint pos;
+
+  scan = (XRefScan *)data;
+  chunk = &scan->chunks[idx];
+  pos = (Guint)idx * xrefScanChunkSize;
+  chunk->begin = idx == 0 ? 0 : xrefScanSync(scan->data, scan->length, pos);
+  if (idx == scan->nChunks - 1) {
+    chunk->end = scan->length;
+  } else {
+    chunk->end = xrefScanSync(scan->data, scan->length,
+			      pos + xrefScanChunkSize);
+  }
+  xrefScanChunk(scan, chunk);
+}
+
 // Attempt to construct an xref table for a damaged file.
+//
+// The whole file is mapped to memory (or read, if the stream can't be
+// mapped) and scanned for object headers, trailers and endstream
+// keywords - big files in several chunks at once.  The results are
+// merged in the file order, so that later objects override earlier
+// ones as when the file is read sequentially.
 GBool XRef::constructXRef() {
   Parser *parser = NULL;
   Object newTrailerDict, obj;
-  char buf[256];
-  Guint pos;
-  int num, gen;
-  int newSize;
-  int streamEndsSize;
-  char *p;
-  int i;
-  GBool gotRoot;
+  XRefScan scan;
+  XRefScanChunk *chunk;
+  GFileMap *fileMap;
+  char *buf;
+  Guint bufSize;
+  int n, maxNum, newSize, nThreads;
+  int i, j;
+  GBool gotRoot, ret;
 
   gfree(entries);
   size = 0;
   entries = NULL;
+  gfree(streamEnds);
+  streamEnds = NULL;
+  streamEndsLen = 0;
 
   error(-1, "PDF file is damaged - attempting to reconstruct xref table...");
   gotRoot = gFalse;
-  streamEndsLen = streamEndsSize = 0;
+  ret = gFalse;
 
+  // get the file contents
   str->reset();
-  while (1) {
-    pos = str->getPos();
-    if (!str->getLine(buf, 256)) {
-      break;
-    }
-    p = buf;
+  scan.pos = str->getPos();
+  buf = NULL;
+  if ((fileMap = str->map())) {
+    scan.data = fileMap->getData();
+    scan.length = fileMap->getLength();
+  } else {
+    scan.length = bufSize = 0;
+    do {
+      if (scan.length == bufSize) {
+	bufSize = bufSize ? 2 * bufSize : 65536;
+	buf = (char *)grealloc(buf, bufSize);
+      }
+      n = str->getBlock(buf + scan.length, (int)(bufSize - scan.length));
+      scan.length += n;
+    } while (n > 0);
+    scan.data = buf;
+  }
 
-    // skip whitespace
-    while (*p && Lexer::isSpace(*p & 0xff)) ++p;
+  // scan it
+  scan.nChunks = (int)((scan.length + xrefScanChunkSize - 1) /
+		       xrefScanChunkSize);
+  if (scan.nChunks < 1) {
+    scan.nChunks = 1;
+  }
+  scan.chunks = (XRefScanChunk *)gmallocn(scan.nChunks,
+					  sizeof(XRefScanChunk));
+  memset(scan.chunks, 0, scan.nChunks * sizeof(XRefScanChunk));
+  nThreads = globalParams ? globalParams->getDecodeThreads() : 0;
+  gParallelFor(scan.nChunks, &xrefScanJob, &scan, nThreads);
+
+  // merge the results
+  maxNum = 0;
+  n = 0;
+  for (i = 0; i < scan.nChunks; ++i) {
+    chunk = &scan.chunks[i];
+    for (j = 0; j < chunk->objsLen; ++j) {
+      if (chunk->objs[j].num > maxNum) {
+	maxNum = chunk->objs[j].num;
+      }
+    }
+    n += chunk->streamEndsLen;
+  }
+  if (maxNum > 0) {
+    newSize = (maxNum + 1 + 255) & ~255;
+    if (newSize < 0) {
+      error(-1, "Bad object number");
+      goto err;
+    }
+    entries = (XRefEntry *)gmallocn(newSize, sizeof(XRefEntry));
+    for (i = 0; i < newSize; ++i) {
+      entries[i].offset = 0xffffffff;
+      entries[i].gen = 0;
+      entries[i].type = xrefEntryFree;
+    }
+    size = newSize;
+  }
+  if (n > 0) {
+    streamEnds = (Guint *)gmallocn(n, sizeof(Guint));
+  }
+  for (i = 0; i < scan.nChunks; ++i) {
+    chunk = &scan.chunks[i];
+    for (j = 0; j < chunk->objsLen; ++j) {
+      XRefScanObj *o = &chunk->objs[j];
+      if (entries[o->num].type == xrefEntryFree ||
+	  o->gen >= entries[o->num].gen) {
+	entries[o->num].offset = o->pos - start;
+	entries[o->num].gen = o->gen;
+	entries[o->num].type = xrefEntryUncompressed;
+      }
+    }
+    memcpy(streamEnds + streamEndsLen, chunk->streamEnds,
+	   chunk->streamEndsLen * sizeof(Guint));
+    streamEndsLen += chunk->streamEndsLen;
+  }
 
-    // got trailer dictionary
-    if (!strncmp(p, "trailer", 7)) {
+  // parse trailer dictionaries, the last one with Root wins
+  for (i = 0; i < scan.nChunks; ++i) {
+    chunk = &scan.chunks[i];
+    for (j = 0; j < chunk->trailersLen; ++j) {
       obj.initNull();
       parser = new Parser(NULL,
 		 new Lexer(NULL,
-		   str->makeSubStream(pos + 7, gFalse, 0, &obj)),
+		   str->makeSubStream(chunk->trailers[j] + 7, gFalse, 0, &obj)),
 		 gFalse);
       if (!parser->getObj(&newTrailerDict))
         goto malformedErr;
@@ -833,86 +1192,31 @@ GBool XRef::constructXRef() {
       }
       newTrailerDict.free();
       delete parser;
-
-    // look for object
-    } else if (isdigit((unsigned char)(*p))) {
-      num = (int)strtoul(p, NULL, 10);
-      if (num > 0) {
-	do {
-	  ++p;
-	} while (*p && isdigit((unsigned char)*p));
-	if (isspace((unsigned char)*p)) {
-	  do {
-	    ++p;
-	  } while (*p && isspace((unsigned char)*p));
-	  if (isdigit((unsigned char)*p)) {
-	    gen = (int)strtoul(p, NULL, 10);
-	    do {
-	      ++p;
-	    } while (*p && isdigit((unsigned char)*p));
-	    if (isspace((unsigned char)*p)) {
-	      do {
-		++p;
-	      } while (*p && isspace((unsigned char)*p));
-	      if (!strncmp(p, "obj", 3)) {
-		if (num >= size) {
-		  newSize = (num + 1 + 255) & ~255;
-		  if (newSize < 0) {
-		    error(-1, "Bad object number");
-		    return gFalse;
-		  }
-		  entries = (XRefEntry *)
-		      greallocn(entries, newSize, sizeof(XRefEntry));
-		  for (i = size; i < newSize; ++i) {
-		    entries[i].offset = 0xffffffff;
-		    entries[i].gen = 0;
-		    entries[i].type = xrefEntryFree;
-		  }
-		  size = newSize;
-		}
-		if (entries[num].type == xrefEntryFree ||
-		    gen >= entries[num].gen) {
-		  entries[num].offset = pos - start;
-		  entries[num].gen = gen;
-		  entries[num].type = xrefEntryUncompressed;
-		}
-	      }
-	    }
-	  }
-	}
-      }
-
-    } else if (!strncmp(p, "endstream", 9)) {
-      if (streamEndsLen == streamEndsSize) {
-	streamEndsSize += 64;
-	streamEnds = (Guint *)greallocn(streamEnds,
-					streamEndsSize, sizeof(int));
-      }
-      // We are reading lines and the pdf specification says that:
-      // "The sequence of bytes that make up a stream lie between the stream
-      // and endstream keywords; the stream dictionary specifies the exact 
-      // number of bytes. It is recommended that there be an end-of-line 
-      // marker after the data and before endstream; this marker is not 
-      // included in the stream length."
-      // So we have to either add stream data that preceeds the keyword
-      // or decrease the lenght by the lenght of EOL marker if we are at 
-      // the beggining of line
-      streamEnds[streamEndsLen++] = pos + 
-	      (p-buf)?p-buf
-	      :-eolLength(pos, str);
+      parser = NULL;
     }
   }
 
-  if (gotRoot)
-    return gTrue;
+  if (gotRoot) {
+    ret = gTrue;
+  } else {
+    error(-1, "Couldn't find trailer dictionary");
+  }
+  goto err;
 
-  error(-1, "Couldn't find trailer dictionary");
-  return gFalse;
 malformedErr:
   error(-1, "malformed content. Not able to parse.");
   if (parser)
     delete parser;
-  return gFalse;
+err:
+  for (i = 0; i < scan.nChunks; ++i) {
+    gfree(scan.chunks[i].objs);
+    gfree(scan.chunks[i].trailers);
+    gfree(scan.chunks[i].streamEnds);
+  }
+  gfree(scan.chunks);
+  delete fileMap;
+  gfree(buf);
+  return ret;
 }
 
 void XRef::setEncryption(int permFlagsA, GBool ownerPasswordOkA,
@@ -952,17 +1256,63 @@ GBool XRef::okToAddNotes(GBool ignoreOwnerPW)const {
 }
 
 Object *XRef::fetch(int num, int gen, Object *obj)const {
-  XRefEntry *e;
-  Parser *parser;
-  Object obj1, obj2, obj3;
-  GBool failed = gFalse;
-
   // check for bogus ref - this can happen in corrupted PDF files
   if (num < 0 || num >= size) {
-    goto err_no_obj;
+    return obj->initNull();
   }
 
   setErrCode(errNone);
+  if (!fetchEntry(NULL, &objStr, num, gen, obj)) {
+    setErrCode(errDamaged);
+    ok = false;
+  }
+  return obj;
+}
+
+GBool XRef::fetchFrom(BaseStream *strA, ObjectStream **objStrA,
+		      int num, int gen, Object *obj)const {
+  // check for bogus ref - this can happen in corrupted PDF files
+  if (num < 0 || num >= size) {
+    obj->initNull();
+    return gTrue;
+  }
+  return fetchEntry(strA, objStrA, num, gen, obj);
+}
+
+void XRef::freeObjectStream(ObjectStream *objStrA) {
+  delete objStrA;
+}
+
+Object *XRef::lookupFrom(BaseStream *strA, const Dict *dict,
+			 const char *key, Object *obj)const {
+  if (!strA) {
+    return dict->lookup(key, obj);
+  }
+  return resolveFrom(strA, dict->lookupNF(key, obj));
+}
+
+Object *XRef::resolveFrom(BaseStream *strA, Object *obj)const {
+  ObjectStream *objStrA;
+  Ref ref;
+
+  if (!obj->isRef()) {
+    return obj;
+  }
+  ref = obj->getRef();
+  obj->free();
+  objStrA = NULL;
+  fetchFrom(strA, &objStrA, ref.num, ref.gen, obj);
+  freeObjectStream(objStrA);
+  return obj;
+}
+
+GBool XRef::fetchEntry(BaseStream *strA, ObjectStream **objStrA,
+		       int num, int gen, Object *obj)const {
+  XRefEntry *e;
+  Parser *parser;
+  Object obj1, obj2, obj3;
+  GBool failed = gFalse;
+
   e = &entries[num];
   switch (e->type) {
 
@@ -973,16 +1323,21 @@ Object *XRef::fetch(int num, int gen, Object *obj)const {
     obj1.initNull();
     parser = new Parser(this,
 	       new Lexer(this,
-		 str->makeSubStream(start + e->offset, gFalse, 0, &obj1)),
-	       gTrue);
-    if (!parser->getObj(&obj1))
+		 (strA ? strA : str)->makeSubStream(start + e->offset,
+						    gFalse, 0, &obj1)),
+	       gTrue, strA);
+    if (!parser->getObj(&obj1)) {
+      delete parser;
       goto err_damaged;
+    }
     if (!parser->getObj(&obj2)) {
       obj1.free();
+      delete parser;
       goto err_damaged;
     }
     if (!parser->getObj(&obj3)) {
       obj2.free();
+      delete parser;
       goto err_damaged;
     } 
     if (!obj1.isInt() || obj1.getInt() != num ||
@@ -1007,21 +1362,22 @@ Object *XRef::fetch(int num, int gen, Object *obj)const {
     break;
 
   case xrefEntryCompressed:
-    if (gen != 0) {
+    // object streams can't be nested
+    if (gen != 0 || !objStrA) {
       goto err_no_obj;
     }
-    if (!objStr || objStr->getObjStrNum() != (int)e->offset) {
-      if (objStr) {
-	delete objStr;
+    if (!*objStrA || (*objStrA)->getObjStrNum() != (int)e->offset) {
+      if (*objStrA) {
+	delete *objStrA;
       }
-      objStr = new ObjectStream(this, e->offset);
-      if (!objStr->isOk()) {
-	delete objStr;
-	objStr = NULL;
+      *objStrA = new ObjectStream(this, e->offset, strA);
+      if (!(*objStrA)->isOk()) {
+	delete *objStrA;
+	*objStrA = NULL;
 	goto err_damaged;
       }
     }
-    objStr->getObject(e->gen, num, obj);
+    (*objStrA)->getObject(e->gen, num, obj);
     break;
 
   default:
@@ -1029,13 +1385,14 @@ Object *XRef::fetch(int num, int gen, Object *obj)const {
     goto err_no_obj;
   }
 
-  return obj;
+  return gTrue;
 
  err_damaged:
-  setErrCode(errDamaged);
-  ok = false;
+  obj->initNull();
+  return gFalse;
  err_no_obj:
-  return obj->initNull();
+  obj->initNull();
+  return gTrue;
 }
 
 Object *XRef::getDocInfo(Object *obj) {
@@ -1047,6 +1404,10 @@ Object *XRef::getDocInfoNF(Object *obj) {
   return getTrailerDict()->dictLookupNF("Info", obj);
 }
 
+int XRef::getObjStrNum()const {
+  return objStr ? objStr->getObjStrNum() : -1;
+}
+
 GBool XRef::getStreamEnd(Guint streamStart, Guint *streamEnd)const {
   int a, b, m;
 
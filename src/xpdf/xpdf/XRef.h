@@ -20,6 +20,14 @@
 //              - maxObj field added which contains the maximum present 
 //                indirect object number
 //              - pdfVersion and getPDFVersion added
+//              - internals can be initialized from already resolved entries
+//                (e.g. loaded from a cache)
+//              - internals can be updated in place for an appended cross
+//                reference section
+//              - fetchFrom method for concurrent fetching through private
+//                stream views
+//              - lookupFrom and resolveFrom methods for resolving values
+//                through private stream views
 //
 //========================================================================
 
@@ -74,8 +82,10 @@ typedef int RefState;
 class XRef {
 public:
 
-  // Constructor.  Read xref table from stream.
-  XRef(BaseStream *strA);
+  // Constructor.  Read xref table from stream.  If <initA> is false,
+  // only the header is read and the caller has to initialize internals
+  // (using one of initInternals methods).
+  XRef(BaseStream *strA, GBool initA = gTrue);
 
   // Destructor.
   virtual ~XRef();
@@ -109,6 +119,29 @@ public:
   
   // Fetch an indirect reference.
   virtual Object *fetch(int num, int gen, Object *obj)const;
+
+  // Fetch an indirect reference like XRef::fetch but read it through
+  // <strA> (a base stream over the same data as the document stream,
+  // e.g. a MemStream over its mapping) and keep the decoded object
+  // stream in <*objStrA> (to be released by freeObjectStream).  No
+  // shared state (including ok and errCode) is touched, so calls with
+  // distinct streams and caches may run concurrently.  Returns gFalse
+  // if the object is damaged.
+  GBool fetchFrom(BaseStream *strA, ObjectStream **objStrA,
+		  int num, int gen, Object *obj)const;
+  static void freeObjectStream(ObjectStream *objStrA);
+
+  // Look up <key> in <dict> and resolve an indirect value through
+  // fetchFrom with <strA> (or fetch if <strA> is NULL).  Used for
+  // values which are needed while an object is being fetched from
+  // <strA> (e.g. stream Length), so that concurrent fetchFrom calls
+  // don't go through fetch.
+  Object *lookupFrom(BaseStream *strA, const Dict *dict, const char *key,
+		     Object *obj)const;
+
+  // If <obj> is a reference, replace it by the referenced object
+  // fetched through fetchFrom with <strA> (see lookupFrom).
+  Object *resolveFrom(BaseStream *strA, Object *obj)const;
   
   // Return the document's Info dictionary (if any).
   virtual Object *getDocInfo(Object *obj);
@@ -146,6 +179,9 @@ public:
   // Direct access.
   virtual int getSize()const { return size; }
   virtual XRefEntry *getEntry(int i)const { return &entries[i]; }
+
+  // Returns number of the currently cached object stream (-1 if none).
+  int getObjStrNum()const;
   virtual const Object *getTrailerDict()const { return &trailerDict; }
 
   virtual const char *getPDFVersion()const {return pdfVersion.getCString(); }
@@ -185,6 +221,24 @@ protected:
 
   // inits all internal structures which may change
   void initInternals(Guint pos);
+  // fetches valid entry <num> through <strA> (<str> and the virtual
+  // fetch for object streams if NULL) using <*objStrA> as the object
+  // stream cache; returns gFalse if the object is damaged
+  GBool fetchEntry(BaseStream *strA, ObjectStream **objStrA,
+		   int num, int gen, Object *obj)const;
+  // inits internal structures from already resolved xref entries and
+  // trailer (ownership of all given data is taken over even on failure);
+  // lastXRefPos, eofPos and maxObj have to be set by caller
+  GBool initInternals(XRefEntry *entriesA, int sizeA,
+		      Guint *streamEndsA, int streamEndsLenA,
+		      Object *trailerDictA);
+  // updates internal structures for a cross reference section appended
+  // after the current one without parsing it: enlarges the table to sizeA
+  // (new entries are free), replaces the trailer (content of trailerDictA
+  // is taken over and the object is freed) and drops cached object stream;
+  // entries of appended objects, lastXRefPos, eofPos and maxObj have to be
+  // set by caller
+  void appendInternals(int sizeA, Object *trailerDictA);
   // destroy all internal structures which may be reinitialized
   void destroyInternals();
 